@@ -1516,6 +1516,15 @@ static errno_t confdb_init_domain_timeouts(struct confdb_ctx *cdb,
         goto done;
     }
 
+    ret = get_entry_as_uint32(res->msgs[0], &domain->slow_search_threshold,
+                              CONFDB_DOMAIN_CACHE_SLOW_SEARCH_THRESHOLD, 0);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "Invalid value for [%s]\n",
+              CONFDB_DOMAIN_CACHE_SLOW_SEARCH_THRESHOLD);
+        goto done;
+    }
+
     ret = EOK;
 
 done:
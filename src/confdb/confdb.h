@@ -117,6 +117,7 @@
 #define CONFDB_NSS_MEMCACHE_SIZE_GROUP "memcache_size_group"
 #define CONFDB_NSS_MEMCACHE_SIZE_INITGROUPS "memcache_size_initgroups"
 #define CONFDB_NSS_MEMCACHE_SIZE_SID "memcache_size_sid"
+#define CONFDB_NSS_MEMCACHE_GROWTH_LIMIT "memcache_growth_limit"
 #define CONFDB_NSS_HOMEDIR_SUBSTRING "homedir_substring"
 #define CONFDB_DEFAULT_HOMEDIR_SUBSTRING "/home"
 
@@ -248,6 +249,8 @@
 #define CONFDB_DOMAIN_PWD_EXPIRATION_WARNING "pwd_expiration_warning"
 #define CONFDB_DOMAIN_REFRESH_EXPIRED_INTERVAL "refresh_expired_interval"
 #define CONFDB_DOMAIN_REFRESH_EXPIRED_INTERVAL_OFFSET "refresh_expired_interval_offset"
+#define CONFDB_DOMAIN_CACHE_SNAPSHOT_INTERVAL "cache_snapshot_interval"
+#define CONFDB_DOMAIN_CACHE_SLOW_SEARCH_THRESHOLD "cache_slow_search_threshold"
 #define CONFDB_DOMAIN_OFFLINE_TIMEOUT "offline_timeout"
 #define CONFDB_DOMAIN_OFFLINE_TIMEOUT_MAX "offline_timeout_max"
 #define CONFDB_DOMAIN_OFFLINE_TIMEOUT_RANDOM_OFFSET "offline_timeout_random_offset"
@@ -393,6 +396,7 @@ struct sss_domain_info {
     uint32_t subdomain_refresh_interval;
     uint32_t subdomain_refresh_interval_offset;
     uint32_t cached_auth_timeout;
+    uint32_t slow_search_threshold;
 
     int pwd_expiration_warning;
 
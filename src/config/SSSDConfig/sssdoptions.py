@@ -76,6 +76,8 @@ class SSSDOptions(object):
             'Size (in megabytes) of the data table allocated inside fast in-memory cache for group requests'),
         'memcache_size_initgroups': _(
             'Size (in megabytes) of the data table allocated inside fast in-memory cache for initgroups requests'),
+        'memcache_growth_limit': _(
+            'Maximum factor by which the fast in-memory caches can grow beyond their configured size'),
         'homedir_substring': _('The value of this option will be used in the expansion of the override_homedir option '
                                'if the template contains the format string %H.'),
         'get_domains_timeout': _('Specifies time in seconds for which the list of subdomains will be considered '
@@ -195,6 +197,8 @@ class SSSDOptions(object):
         'entry_cache_resolver_timeout': _('Entry cache timeout length (seconds)'),
         'refresh_expired_interval': _('How often should expired entries be refreshed in background'),
         'refresh_expired_interval_offset': _("Maximum period deviation when refreshing expired entries in background"),
+        'cache_snapshot_interval': _('How often should a read-only snapshot of the cache be published for the responders'),
+        'cache_slow_search_threshold': _('Log cache searches that take longer than this many milliseconds'),
         'dyndns_update': _("Whether to automatically update the client's DNS entry"),
         'dyndns_update_per_family': _('Whether DNS update of A and AAAA record should be performed '
                                       'in one update or in two separate updates'),
@@ -399,6 +403,7 @@ class SSSDOptions(object):
 
         'ldap_connection_expiration_timeout': _('How long to retain a connection to the LDAP server before '
                                                 'disconnecting'),
+        'ldap_connection_pool_size': _('Number of connections to the LDAP server that lookups are spread over'),
 
         'ldap_disable_paging': _('Disable the LDAP paging control'),
         'ldap_disable_range_retrieval': _('Disable Active Directory range retrieval'),
@@ -408,10 +413,13 @@ class SSSDOptions(object):
         # [provider/ldap/id]
         'ldap_search_timeout': _('Length of time to wait for a search request'),
         'ldap_enumeration_search_timeout': _('Length of time to wait for a enumeration request'),
+        'ldap_enumeration_search_partitions': _('Number of concurrent searches a full user enumeration is split into'),
         'ldap_enumeration_refresh_timeout': _('Length of time between enumeration updates'),
         'ldap_enumeration_refresh_offset': _('Maximum period deviation between enumeration updates'),
         'ldap_purge_cache_timeout': _('Length of time between cache cleanups'),
         'ldap_purge_cache_offset': _('Maximum time deviation between cache cleanups'),
+        'ldap_change_tracking': _('Server side change tracking used to keep the cache up to date'),
+        'ldap_change_tracking_interval': _('Length of time between change tracking updates'),
         'ldap_id_use_start_tls': _('Require TLS for ID lookups'),
         'ldap_id_mapping': _('Use ID-mapping of objectSID instead of pre-set IDs'),
         'ldap_user_search_base': _('Base DN for user lookups'),
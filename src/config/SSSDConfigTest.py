@@ -605,6 +605,8 @@ class SSSDConfigTestSSSDDomain(unittest.TestCase):
             'pam_gssapi_indicators_map',
             'refresh_expired_interval',
             'refresh_expired_interval_offset',
+            'cache_snapshot_interval',
+            'cache_slow_search_threshold',
             'local_auth_policy']
 
         self.assertTrue(type(options) == dict,
@@ -970,6 +972,8 @@ class SSSDConfigTestSSSDDomain(unittest.TestCase):
             'pam_gssapi_indicators_map',
             'refresh_expired_interval',
             'refresh_expired_interval_offset',
+            'cache_snapshot_interval',
+            'cache_slow_search_threshold',
             'dyndns_refresh_interval',
             'dyndns_refresh_interval_offset',
             'local_auth_policy']
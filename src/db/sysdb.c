@@ -27,6 +27,7 @@
 #include "db/sysdb_private.h"
 #include "confdb/confdb.h"
 #include "util/probes.h"
+#include "shared/murmurhash3.h"
 #include <time.h>
 
 errno_t sysdb_dn_sanitize(TALLOC_CTX *mem_ctx, const char *input,
@@ -280,22 +281,239 @@ struct sysdb_attrs *sysdb_new_attrs(TALLOC_CTX *mem_ctx)
     return talloc_zero(mem_ctx, struct sysdb_attrs);
 }
 
+/* Entries read from LDAP often have dozens of attributes and every one of
+ * them is looked up by name while the entry is saved. Lists with at least
+ * SYSDB_ATTRS_INDEX_MIN elements are therefore indexed by an open
+ * addressing hash table over the lowercased attribute names. Smaller
+ * lists are scanned linearly, which is faster for them. */
+#define SYSDB_ATTRS_INDEX_MIN 16
+#define SYSDB_ATTRS_NAME_MAX 256
+
+struct sysdb_attrs_index_slot {
+    uint32_t hash;
+    int pos;             /* position in attrs->a, -1 if the slot is free */
+    const char *lname;   /* interned lowercased name */
+};
+
+struct sysdb_attrs_index {
+    /* attrs->a and number of its elements the index describes */
+    struct ldb_message_element *a;
+    int num;
+
+    uint32_t size;
+    struct sysdb_attrs_index_slot *slots;
+};
+
+static bool sysdb_attrs_lower_name(const char *name, char *buf,
+                                   size_t buflen, size_t *_len)
+{
+    size_t i;
+
+    for (i = 0; name[i] != '\0'; i++) {
+        if (i + 1 >= buflen) {
+            return false;
+        }
+        buf[i] = tolower((unsigned char)name[i]);
+    }
+    buf[i] = '\0';
+
+    *_len = i;
+    return true;
+}
+
+static errno_t sysdb_attrs_index_add(struct sysdb_attrs_index *idx,
+                                     const char *name, int pos)
+{
+    char lname[SYSDB_ATTRS_NAME_MAX];
+    struct sysdb_attrs_index_slot *slot;
+    uint32_t mask = idx->size - 1;
+    uint32_t hash;
+    uint32_t i;
+    size_t len;
+
+    if (!sysdb_attrs_lower_name(name, lname, sizeof(lname), &len)) {
+        return E2BIG;
+    }
+
+    hash = murmurhash3(lname, len, 0);
+    for (i = hash & mask; ; i = (i + 1) & mask) {
+        slot = &idx->slots[i];
+        if (slot->pos == -1) {
+            break;
+        }
+
+        /* Later elements win, as with the linear scan. */
+        if (slot->hash == hash && strcmp(slot->lname, lname) == 0) {
+            slot->pos = pos;
+            return EOK;
+        }
+    }
+
+    slot->lname = talloc_strndup(idx->slots, lname, len);
+    if (slot->lname == NULL) {
+        return ENOMEM;
+    }
+    slot->hash = hash;
+    slot->pos = pos;
+
+    return EOK;
+}
+
+static errno_t sysdb_attrs_index_build(struct sysdb_attrs *attrs)
+{
+    struct sysdb_attrs_index *idx;
+    uint32_t size;
+    uint32_t i;
+    errno_t ret;
+    int pos;
+
+    talloc_zfree(attrs->index);
+
+    /* keep the load factor below 1/2 even after the list doubles */
+    for (size = 64; size < 4 * (uint32_t)attrs->num; size *= 2) ;
+
+    idx = talloc_zero(attrs, struct sysdb_attrs_index);
+    if (idx == NULL) {
+        return ENOMEM;
+    }
+
+    idx->slots = talloc_array(idx, struct sysdb_attrs_index_slot, size);
+    if (idx->slots == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+    idx->size = size;
+    for (i = 0; i < size; i++) {
+        idx->slots[i].pos = -1;
+    }
+
+    for (pos = 0; pos < attrs->num; pos++) {
+        ret = sysdb_attrs_index_add(idx, attrs->a[pos].name, pos);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    idx->a = attrs->a;
+    idx->num = attrs->num;
+    attrs->index = idx;
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        talloc_free(idx);
+    }
+    return ret;
+}
+
+/* Makes sure attrs->index describes the current list. Returns an error if
+ * the list should be scanned linearly instead. */
+static errno_t sysdb_attrs_index_update(struct sysdb_attrs *attrs)
+{
+    struct sysdb_attrs_index *idx = attrs->index;
+    errno_t ret;
+    int pos;
+
+    if (idx == NULL || idx->a != attrs->a || idx->num > attrs->num
+            || 2 * (uint32_t)attrs->num > idx->size) {
+        return sysdb_attrs_index_build(attrs);
+    }
+
+    /* Elements were appended without going through the index. */
+    for (pos = idx->num; pos < attrs->num; pos++) {
+        ret = sysdb_attrs_index_add(idx, attrs->a[pos].name, pos);
+        if (ret != EOK) {
+            talloc_zfree(attrs->index);
+            return ret;
+        }
+    }
+    idx->num = attrs->num;
+
+    return EOK;
+}
+
+static errno_t sysdb_attrs_index_find(struct sysdb_attrs *attrs,
+                                      const char *name,
+                                      struct ldb_message_element **_el)
+{
+    char lname[SYSDB_ATTRS_NAME_MAX];
+    struct sysdb_attrs_index_slot *slot;
+    struct sysdb_attrs_index *idx;
+    uint32_t mask;
+    uint32_t hash;
+    uint32_t i;
+    size_t len;
+    errno_t ret;
+
+    if (!sysdb_attrs_lower_name(name, lname, sizeof(lname), &len)) {
+        return E2BIG;
+    }
+
+    ret = sysdb_attrs_index_update(attrs);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    idx = attrs->index;
+    mask = idx->size - 1;
+    hash = murmurhash3(lname, len, 0);
+    for (i = hash & mask; idx->slots[i].pos != -1; i = (i + 1) & mask) {
+        slot = &idx->slots[i];
+        if (slot->hash != hash || strcmp(slot->lname, lname) != 0) {
+            continue;
+        }
+
+        if (strcasecmp(attrs->a[slot->pos].name, name) != 0) {
+            /* The element was changed behind our back. */
+            talloc_zfree(attrs->index);
+            return EAGAIN;
+        }
+
+        *_el = &attrs->a[slot->pos];
+        return EOK;
+    }
+
+    return ENOENT;
+}
+
 int sysdb_attrs_get_el_ext(struct sysdb_attrs *attrs, const char *name,
                            bool alloc, struct ldb_message_element **el)
 {
     struct ldb_message_element *e = NULL;
+    size_t size;
     int i;
+    errno_t ret;
 
-    for (i = 0; i < attrs->num; i++) {
-        if (strcasecmp(name, attrs->a[i].name) == 0)
-            e = &(attrs->a[i]);
+    ret = EINVAL;
+    if (attrs->num >= SYSDB_ATTRS_INDEX_MIN) {
+        ret = sysdb_attrs_index_find(attrs, name, &e);
+        if (ret != EOK && ret != ENOENT) {
+            e = NULL;
+        }
+    }
+
+    if (ret != EOK && ret != ENOENT) {
+        for (i = 0; i < attrs->num; i++) {
+            if (strcasecmp(name, attrs->a[i].name) == 0)
+                e = &(attrs->a[i]);
+        }
     }
 
     if (!e && alloc) {
-        e = talloc_realloc(attrs, attrs->a,
-                           struct ldb_message_element, attrs->num+1);
-        if (!e) return ENOMEM;
-        attrs->a = e;
+        /* Grow geometrically, entries are built one attribute at a time. */
+        size = talloc_array_length(attrs->a);
+        if (attrs->num + 1 > size) {
+            size = attrs->num < 8 ? attrs->num + 1 : 2 * attrs->num;
+            e = talloc_realloc(attrs, attrs->a,
+                               struct ldb_message_element, size);
+            if (!e) return ENOMEM;
+
+            if (attrs->index != NULL && attrs->index->a == attrs->a) {
+                attrs->index->a = e;
+            }
+            attrs->a = e;
+        }
+        e = attrs->a;
 
         e[attrs->num].name = talloc_strdup(e, name);
         if (!e[attrs->num].name) return ENOMEM;
@@ -879,13 +1097,101 @@ char *sysdb_group_strdn(TALLOC_CTX *mem_ctx,
 
 /* =Transactions========================================================== */
 
-int sysdb_transaction_start(struct sysdb_ctx *sysdb)
+static void sysdb_txn_histogram_add(struct sysdb_txn_histogram *hist,
+                                    uint64_t us, bool cancelled)
+{
+    unsigned int bucket = 0;
+
+    while (bucket < SYSDB_TXN_STATS_BUCKETS - 1 && (us >> (bucket + 1)) > 0) {
+        bucket++;
+    }
+
+    hist->count++;
+    hist->total_us += us;
+    hist->buckets[bucket]++;
+    if (us > hist->max_us) {
+        hist->max_us = us;
+    }
+    if (cancelled) {
+        hist->cancelled++;
+    }
+}
+
+static struct sysdb_txn_histogram *
+sysdb_txn_caller_histogram(struct sysdb_ctx *sysdb, const char *tag)
+{
+    struct sysdb_txn_histogram *callers;
+    size_t i;
+
+    /* The tags are function names so the pointers match in most cases. */
+    for (i = 0; i < sysdb->txn_num_callers; i++) {
+        if (sysdb->txn_callers[i].name == tag
+                || strcmp(sysdb->txn_callers[i].name, tag) == 0) {
+            return &sysdb->txn_callers[i];
+        }
+    }
+
+    callers = talloc_realloc(sysdb, sysdb->txn_callers,
+                             struct sysdb_txn_histogram,
+                             sysdb->txn_num_callers + 1);
+    if (callers == NULL) {
+        return NULL;
+    }
+
+    sysdb->txn_callers = callers;
+    memset(&callers[i], 0, sizeof(struct sysdb_txn_histogram));
+    callers[i].name = tag;
+    sysdb->txn_num_callers++;
+
+    return &callers[i];
+}
+
+/* Called with the nesting level of the transaction that has just ended */
+static void sysdb_txn_stats_update(struct sysdb_ctx *sysdb, bool cancelled)
+{
+    struct sysdb_txn_histogram *hist;
+    struct sysdb_txn_frame *frame;
+    int level = sysdb->transaction_nesting;
+    uint64_t us;
+
+    if (level < 0 || level >= SYSDB_TXN_MAX_FRAMES) {
+        return;
+    }
+
+    frame = &sysdb->txn_frames[level];
+    if (frame->start == 0) {
+        return;
+    }
+
+    us = get_spend_time_us(frame->start);
+    frame->start = 0;
+
+    hist = &sysdb->txn_levels[level < SYSDB_TXN_STATS_LEVELS ?
+                                  level : SYSDB_TXN_STATS_LEVELS - 1];
+    sysdb_txn_histogram_add(hist, us, cancelled);
+
+    if (level == 0) {
+        hist = sysdb_txn_caller_histogram(sysdb, frame->tag);
+        if (hist != NULL) {
+            sysdb_txn_histogram_add(hist, us, cancelled);
+        }
+    }
+}
+
+int sysdb_transaction_start_ex(struct sysdb_ctx *sysdb, const char *tag)
 {
     int ret;
 
     ret = ldb_transaction_start(sysdb->ldb);
     if (ret == LDB_SUCCESS) {
         PROBE(SYSDB_TRANSACTION_START, sysdb->transaction_nesting);
+        if (sysdb->transaction_nesting >= 0
+                && sysdb->transaction_nesting < SYSDB_TXN_MAX_FRAMES) {
+            sysdb->txn_frames[sysdb->transaction_nesting].start =
+                                                            get_start_time();
+            sysdb->txn_frames[sysdb->transaction_nesting].tag =
+                                                tag == NULL ? "unknown" : tag;
+        }
         sysdb->transaction_nesting++;
     } else {
         DEBUG(SSSDBG_CRIT_FAILURE,
@@ -906,6 +1212,11 @@ int sysdb_transaction_commit(struct sysdb_ctx *sysdb)
     if (ret == LDB_SUCCESS) {
         sysdb->transaction_nesting--;
         PROBE(SYSDB_TRANSACTION_COMMIT_AFTER, sysdb->transaction_nesting);
+        sysdb_txn_stats_update(sysdb, false);
+        if (sysdb->transaction_nesting == 0) {
+            sysdb_ts_batch_txn_end(sysdb, true);
+            sysdb_snapshot_changed(sysdb);
+        }
     } else {
         DEBUG(SSSDBG_CRIT_FAILURE,
               "Failed to commit ldb transaction! (%d)\n", ret);
@@ -921,6 +1232,9 @@ int sysdb_transaction_cancel(struct sysdb_ctx *sysdb)
     if (ret == LDB_SUCCESS) {
         sysdb->transaction_nesting--;
         PROBE(SYSDB_TRANSACTION_CANCEL, sysdb->transaction_nesting);
+        sysdb_txn_stats_update(sysdb, true);
+        /* A cancelled nested transaction fails the outer one as well */
+        sysdb_ts_batch_txn_end(sysdb, false);
     } else {
         DEBUG(SSSDBG_CRIT_FAILURE,
               "Failed to cancel ldb transaction! (%d)\n", ret);
@@ -928,6 +1242,51 @@ int sysdb_transaction_cancel(struct sysdb_ctx *sysdb)
     return sysdb_error_to_errno(ret);
 }
 
+errno_t sysdb_transaction_stats(TALLOC_CTX *mem_ctx,
+                                struct sysdb_ctx *sysdb,
+                                struct sysdb_txn_histogram **_levels,
+                                struct sysdb_txn_histogram **_callers,
+                                size_t *_num_callers)
+{
+    struct sysdb_txn_histogram *levels;
+    struct sysdb_txn_histogram *callers = NULL;
+    int i;
+
+    levels = talloc_memdup(mem_ctx, sysdb->txn_levels,
+                           sizeof(sysdb->txn_levels));
+    if (levels == NULL) {
+        return ENOMEM;
+    }
+
+    for (i = 0; i < SYSDB_TXN_STATS_LEVELS; i++) {
+        if (i == SYSDB_TXN_STATS_LEVELS - 1) {
+            levels[i].name = talloc_asprintf(levels, "nesting level %d+", i);
+        } else {
+            levels[i].name = talloc_asprintf(levels, "nesting level %d", i);
+        }
+        if (levels[i].name == NULL) {
+            talloc_free(levels);
+            return ENOMEM;
+        }
+    }
+
+    if (sysdb->txn_num_callers > 0) {
+        callers = talloc_memdup(mem_ctx, sysdb->txn_callers,
+                                sizeof(struct sysdb_txn_histogram)
+                                    * sysdb->txn_num_callers);
+        if (callers == NULL) {
+            talloc_free(levels);
+            return ENOMEM;
+        }
+    }
+
+    *_levels = levels;
+    *_callers = callers;
+    *_num_callers = sysdb->txn_num_callers;
+
+    return EOK;
+}
+
 int compare_ldb_dn_comp_num(const void *m1, const void *m2)
 {
     struct ldb_message *msg1 = talloc_get_type(*(void **) discard_const(m1),
@@ -967,6 +1326,7 @@ int sysdb_attrs_replace_name(struct sysdb_attrs *attrs, const char *oldname,
 
         talloc_free(discard_const(e->name));
         e->name = dummy;
+        talloc_zfree(attrs->index);
     }
 
     return EOK;
@@ -1404,6 +1764,154 @@ done:
     return ret;
 }
 
+errno_t sysdb_get_change_tracking_cookie(TALLOC_CTX *mem_ctx,
+                                         struct sss_domain_info *domain,
+                                         uint8_t **_cookie,
+                                         size_t *_cookie_len)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_dn *dn;
+    struct ldb_result *res;
+    const struct ldb_val *val;
+    const char *attrs[] = { SYSDB_CHANGE_TRACKING_COOKIE, NULL };
+    uint8_t *cookie;
+    errno_t ret;
+    int lret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    dn = sysdb_domain_dn(tmp_ctx, domain);
+    if (dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    lret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, dn, LDB_SCOPE_BASE,
+                      attrs, NULL);
+    if (lret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(lret);
+        goto done;
+    }
+
+    if (res->count == 0) {
+        ret = ENOENT;
+        goto done;
+    } else if (res->count != 1) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Got more than one reply for base search!\n");
+        ret = EIO;
+        goto done;
+    }
+
+    val = ldb_msg_find_ldb_val(res->msgs[0], SYSDB_CHANGE_TRACKING_COOKIE);
+    if (val == NULL || val->length == 0) {
+        ret = ENOENT;
+        goto done;
+    }
+
+    cookie = talloc_memdup(mem_ctx, val->data, val->length);
+    if (cookie == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    *_cookie = cookie;
+    *_cookie_len = val->length;
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+errno_t sysdb_set_change_tracking_cookie(struct sss_domain_info *domain,
+                                         const uint8_t *cookie,
+                                         size_t cookie_len)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message *msg;
+    struct ldb_result *res;
+    struct ldb_val val;
+    errno_t ret;
+    int lret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    msg = ldb_msg_new(tmp_ctx);
+    if (msg == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    msg->dn = sysdb_domain_dn(msg, domain);
+    if (msg->dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    lret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, msg->dn,
+                      LDB_SCOPE_BASE, NULL, NULL);
+    if (lret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(lret);
+        goto done;
+    }
+
+    if (res->count == 0) {
+        if (cookie == NULL) {
+            ret = EOK;
+            goto done;
+        }
+
+        lret = ldb_msg_add_string(msg, "cn", domain->name);
+    } else if (cookie == NULL) {
+        lret = ldb_msg_add_empty(msg, SYSDB_CHANGE_TRACKING_COOKIE,
+                                 LDB_FLAG_MOD_DELETE, NULL);
+    } else {
+        lret = ldb_msg_add_empty(msg, SYSDB_CHANGE_TRACKING_COOKIE,
+                                 LDB_FLAG_MOD_REPLACE, NULL);
+    }
+    if (lret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(lret);
+        goto done;
+    }
+
+    if (cookie != NULL) {
+        val.data = discard_const(cookie);
+        val.length = cookie_len;
+        lret = ldb_msg_add_value(msg, SYSDB_CHANGE_TRACKING_COOKIE, &val, NULL);
+        if (lret != LDB_SUCCESS) {
+            ret = sysdb_error_to_errno(lret);
+            goto done;
+        }
+    }
+
+    if (res->count == 0) {
+        lret = ldb_add(domain->sysdb->ldb, msg);
+    } else {
+        lret = ldb_modify(domain->sysdb->ldb, msg);
+        if (lret == LDB_ERR_NO_SUCH_ATTRIBUTE && cookie == NULL) {
+            lret = LDB_SUCCESS;
+        }
+    }
+
+    if (lret != LDB_SUCCESS) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "ldb operation failed: [%s](%d)[%s]\n",
+              ldb_strerror(lret), lret, ldb_errstring(domain->sysdb->ldb));
+    }
+    ret = sysdb_error_to_errno(lret);
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
 /*
  * An entity with multiple names would have multiple SYSDB_NAME attributes
  * after being translated into sysdb names using a map.
@@ -1518,7 +2026,7 @@ errno_t sysdb_msg2attrs(TALLOC_CTX *mem_ctx, size_t count,
     }
 
     for (i = 0; i < count; i++) {
-        a[i] = talloc(a, struct sysdb_attrs);
+        a[i] = talloc_zero(a, struct sysdb_attrs);
         if (a[i] == NULL) {
             DEBUG(SSSDBG_CRIT_FAILURE, "talloc failed.\n");
             talloc_free(a);
@@ -1930,6 +2438,39 @@ done:
     return differs;
 }
 
+bool sysdb_msg_attrs_diff(struct ldb_dn *entry_dn,
+                          struct ldb_message *db_msg,
+                          struct sysdb_attrs *attrs,
+                          int mod_op)
+{
+    struct ldb_message *new_entry_msg;
+    TALLOC_CTX *tmp_ctx;
+    bool differs = true;
+
+    if (db_msg == NULL) {
+        return true;
+    }
+
+    if (attrs == NULL || attrs->num == 0) {
+        return false;
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return true;
+    }
+
+    new_entry_msg = sysdb_attrs2msg(tmp_ctx, entry_dn, attrs, mod_op);
+    if (new_entry_msg == NULL) {
+        goto done;
+    }
+
+    differs = sysdb_ldb_msg_difference(entry_dn, db_msg, new_entry_msg);
+done:
+    talloc_free(tmp_ctx);
+    return differs;
+}
+
 void ldb_debug_messages(void *context, enum ldb_debug_level level,
                         const char *fmt, va_list ap)
 {
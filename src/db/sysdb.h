@@ -257,6 +257,8 @@
 #define SYSDB_HAS_ENUMERATED_ID       0x00000001
 #define SYSDB_HAS_ENUMERATED_RESOLVER 0x00000002
 
+#define SYSDB_CHANGE_TRACKING_COOKIE "changeTrackingCookie"
+
 #define SYSDB_DEFAULT_ATTRS SYSDB_LAST_UPDATE, \
                             SYSDB_CACHE_EXPIRE, \
                             SYSDB_INITGR_EXPIRE, \
@@ -319,6 +321,19 @@ static inline const char **SYSDB_GRSRC_ATTRS(const struct sss_domain_info *domai
     }
 }
 
+/* Group attributes without the members, for lookups which only report the
+ * group itself */
+#define SYSDB_GRSRC_HEADER_ATTRS {SYSDB_NAME, SYSDB_GIDNUM, \
+                                  SYSDB_DEFAULT_ATTRS, \
+                                  SYSDB_SID_STR, \
+                                  SYSDB_OVERRIDE_DN, \
+                                  SYSDB_OVERRIDE_OBJECT_DN, \
+                                  SYSDB_DEFAULT_OVERRIDE_NAME, \
+                                  SYSDB_UUID, \
+                                  ORIGINALAD_PREFIX SYSDB_NAME, \
+                                  ORIGINALAD_PREFIX SYSDB_GIDNUM, \
+                                  NULL}
+
 #define SYSDB_NETGR_ATTRS {SYSDB_NAME, SYSDB_NETGROUP_TRIPLE, \
                            SYSDB_NETGROUP_MEMBER, \
                            SYSDB_DEFAULT_ATTRS, \
@@ -379,9 +394,16 @@ static inline const char **SYSDB_GRSRC_ATTRS(const struct sss_domain_info *domai
 struct confdb_ctx;
 struct sysdb_ctx;
 
+struct sysdb_attrs_index;
+
 struct sysdb_attrs {
     int num;
     struct ldb_message_element *a;
+
+    /* Name lookup index, built on demand for large attribute lists and
+     * private to sysdb.c. Code that renames elements of a in place must
+     * not do so directly, use sysdb_attrs_replace_name(). */
+    struct sysdb_attrs_index *index;
 };
 
 /* sysdb_attrs helper functions */
@@ -549,11 +571,74 @@ struct ldb_context *sysdb_ctx_get_ldb(struct sysdb_ctx *sysdb);
 
 int compare_ldb_dn_comp_num(const void *m1, const void *m2);
 
-/* functions to start and finish transactions */
-int sysdb_transaction_start(struct sysdb_ctx *sysdb);
+/* Buffer the updates of the timestamp cache in memory and write them in
+ * a single transaction once max_entries of them are pending or flush_msec
+ * milliseconds after the first one. Calls can be nested, each
+ * sysdb_ts_batch_begin() must be paired with sysdb_ts_batch_end() which
+ * flushes the pending updates once the last user is gone.
+ */
+errno_t sysdb_ts_batch_begin(struct sysdb_ctx *sysdb,
+                             struct tevent_context *ev,
+                             size_t max_entries,
+                             uint32_t flush_msec);
+void sysdb_ts_batch_end(struct sysdb_ctx *sysdb);
+
+/* Writes all pending timestamp cache updates now */
+errno_t sysdb_ts_batch_flush(struct sysdb_ctx *sysdb);
+
+/* Writes a read-only snapshot of the users and groups in the cache next
+ * to the cache file. Responders answer name, ID, UPN and SID lookups from
+ * it as long as the cache was not modified after the snapshot was taken.
+ * Does nothing if the cache did not change since the last snapshot.
+ */
+errno_t sysdb_snapshot_publish(struct sysdb_ctx *sysdb);
+
+/* Removes the snapshot, lookups go to the cache again */
+errno_t sysdb_snapshot_remove(struct sysdb_ctx *sysdb);
+
+/* Publishes a new snapshot delay_msec after a transaction that changed the
+ * cache was committed, changes made in the meantime are included. */
+errno_t sysdb_snapshot_publish_on_change(struct sysdb_ctx *sysdb,
+                                         struct tevent_context *ev,
+                                         uint32_t delay_msec);
+
+/* functions to start and finish transactions, the tag names the caller in
+ * the transaction statistics */
+int sysdb_transaction_start_ex(struct sysdb_ctx *sysdb, const char *tag);
+#define sysdb_transaction_start(sysdb) \
+    sysdb_transaction_start_ex(sysdb, __func__)
 int sysdb_transaction_commit(struct sysdb_ctx *sysdb);
 int sysdb_transaction_cancel(struct sysdb_ctx *sysdb);
 
+#define SYSDB_TXN_STATS_BUCKETS 24
+#define SYSDB_TXN_STATS_LEVELS 4
+
+/* Histogram of the time a transaction was held open, from start until
+ * commit or cancel. Bucket i counts transactions that took
+ * [2^i, 2^(i+1)) microseconds, the first bucket also counts shorter ones
+ * and the last one all longer ones.
+ */
+struct sysdb_txn_histogram {
+    const char *name;
+    uint64_t count;
+    uint64_t cancelled;
+    uint64_t total_us;
+    uint64_t max_us;
+    uint64_t buckets[SYSDB_TXN_STATS_BUCKETS];
+};
+
+/* Returns the transaction statistics kept since the sysdb context was
+ * created. There is one histogram per nesting level, the last level also
+ * counts all deeper transactions, and one histogram per caller tag of
+ * the outermost transactions, which are the ones that block other
+ * processes from reading the cache.
+ */
+errno_t sysdb_transaction_stats(TALLOC_CTX *mem_ctx,
+                                struct sysdb_ctx *sysdb,
+                                struct sysdb_txn_histogram **_levels,
+                                struct sysdb_txn_histogram **_callers,
+                                size_t *_num_callers);
+
 /* functions related to subdomains */
 errno_t sysdb_domain_create(struct sysdb_ctx *sysdb, const char *domain_name);
 
@@ -756,6 +841,13 @@ errno_t sysdb_search_group_override_by_name(TALLOC_CTX *mem_ctx,
                                             struct ldb_result **override_obj,
                                             struct ldb_result **orig_obj);
 
+errno_t sysdb_search_group_override_attrs_by_gid(TALLOC_CTX *mem_ctx,
+                                            struct sss_domain_info *domain,
+                                            gid_t gid,
+                                            const char **attrs,
+                                            struct ldb_result **override_obj,
+                                            struct ldb_result **orig_obj);
+
 errno_t sysdb_search_user_override_by_uid(TALLOC_CTX *mem_ctx,
                                           struct sss_domain_info *domain,
                                           uid_t uid,
@@ -803,6 +895,21 @@ int sysdb_getgrgid_with_views(TALLOC_CTX *mem_ctx,
                               gid_t gid,
                               struct ldb_result **res);
 
+/* If with_members is false neither the members nor their overrides are
+ * read, which is the expensive part for large groups. The result must then
+ * not be used to report group members. */
+int sysdb_getgrnam_with_views_ex(TALLOC_CTX *mem_ctx,
+                                 struct sss_domain_info *domain,
+                                 const char *name,
+                                 bool with_members,
+                                 struct ldb_result **res);
+
+int sysdb_getgrgid_with_views_ex(TALLOC_CTX *mem_ctx,
+                                 struct sss_domain_info *domain,
+                                 gid_t gid,
+                                 bool with_members,
+                                 struct ldb_result **res);
+
 struct ldb_message_element *
 sss_view_ldb_msg_find_element(struct sss_domain_info *dom,
                               const struct ldb_message *msg,
@@ -1224,6 +1331,55 @@ int sysdb_store_group(struct sss_domain_info *domain,
                       uint64_t cache_timeout,
                       time_t now);
 
+/* One entry of a bulk store. The input members have the same meaning as the
+ * parameters of sysdb_store_user(), the result of storing this particular
+ * entry is returned in ret.
+ */
+struct sysdb_store_user_item {
+    struct sss_domain_info *domain;
+    const char *name;
+    const char *pwd;
+    uid_t uid;
+    gid_t gid;
+    const char *gecos;
+    const char *homedir;
+    const char *shell;
+    const char *orig_dn;
+    struct sysdb_attrs *attrs;
+    char **remove_attrs;
+    uint64_t cache_timeout;
+
+    errno_t ret;
+};
+
+/* Stores a batch of users in a single transaction. Cached entries are read
+ * with one search per chunk of names, entries that did not change only get
+ * their timestamp cache record refreshed, the rest is written with
+ * sysdb_store_user(). Failing to store an entry does not fail the batch,
+ * check the ret member of each item.
+ */
+errno_t sysdb_store_users_bulk(struct sysdb_ctx *sysdb,
+                               struct sysdb_store_user_item *users,
+                               size_t num_users,
+                               time_t now);
+
+/* Group counterpart of struct sysdb_store_user_item */
+struct sysdb_store_group_item {
+    struct sss_domain_info *domain;
+    const char *name;
+    gid_t gid;
+    struct sysdb_attrs *attrs;
+    uint64_t cache_timeout;
+
+    errno_t ret;
+};
+
+/* Group counterpart of sysdb_store_users_bulk() */
+errno_t sysdb_store_groups_bulk(struct sysdb_ctx *sysdb,
+                                struct sysdb_store_group_item *groups,
+                                size_t num_groups,
+                                time_t now);
+
 int sysdb_add_group_member(struct sss_domain_info *domain,
                            const char *group,
                            const char *member,
@@ -1441,6 +1597,18 @@ errno_t sysdb_set_enumerated(struct sss_domain_info *domain,
                              uint32_t provider,
                              bool has_enumerated);
 
+/* Cookie of the server side change tracking (syncrepl or DirSync), the
+ * cookie is removed if cookie is NULL. ENOENT is returned if no cookie
+ * was stored yet. */
+errno_t sysdb_get_change_tracking_cookie(TALLOC_CTX *mem_ctx,
+                                         struct sss_domain_info *domain,
+                                         uint8_t **_cookie,
+                                         size_t *_cookie_len);
+
+errno_t sysdb_set_change_tracking_cookie(struct sss_domain_info *domain,
+                                         const uint8_t *cookie,
+                                         size_t cookie_len);
+
 errno_t sysdb_remove_attrs(struct sss_domain_info *domain,
                            const char *name,
                            enum sysdb_member_type type,
@@ -783,6 +783,7 @@ int sysdb_domain_init_internal(TALLOC_CTX *mem_ctx,
     TALLOC_CTX *tmp_ctx = NULL;
     bool ldb_file_missing;
     struct sysdb_ctx *sysdb;
+    uint64_t slow_usec;
     int ret;
 
     tmp_ctx = talloc_new(NULL);
@@ -829,6 +830,22 @@ int sysdb_domain_init_internal(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
+    slow_usec = (uint64_t) domain->slow_search_threshold * 1000;
+    ret = sysdb_search_stats_init(sysdb->ldb, sysdb->ldb_file, "cache",
+                                  slow_usec);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    if (sysdb->ldb_ts != NULL) {
+        ret = sysdb_search_stats_init(sysdb->ldb_ts, sysdb->ldb_ts_file,
+                                      "timestamp cache",
+                                      slow_usec);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
 done:
     if (ret == EOK) {
         *_ctx = talloc_steal(mem_ctx, sysdb);
@@ -29,6 +29,7 @@
 #include "db/sysdb_ipnetworks.h"
 #include "util/crypto/sss_crypto.h"
 #include "util/cert.h"
+#include "util/sss_ptr_hash.h"
 #include <time.h>
 
 #define SSS_SYSDB_NO_CACHE 0x0
@@ -160,6 +161,7 @@ static int sysdb_delete_ts_entry(struct sysdb_ctx *sysdb,
         return EOK;
     }
 
+    sysdb_ts_batch_drop(sysdb, dn);
     return sysdb_delete_cache_entry(sysdb->ldb_ts, dn, true);
 }
 
@@ -281,9 +283,9 @@ int sysdb_cache_search_entry(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = ldb_search(ldb, tmp_ctx, &res,
-                     base_dn, scope, attrs,
-                     filter?"%s":NULL, filter);
+    ret = sysdb_ldb_search(ldb, tmp_ctx, &res,
+                           base_dn, scope, attrs,
+                           filter?"%s":NULL, filter);
     if (ret != EOK) {
         ret = sysdb_error_to_errno(ret);
         goto done;
@@ -332,6 +334,8 @@ int sysdb_search_ts_entry(TALLOC_CTX *mem_ctx,
                           size_t *_msgs_count,
                           struct ldb_message ***_msgs)
 {
+    errno_t ret;
+
     if (sysdb->ldb_ts == NULL) {
         if (_msgs_count != NULL) {
             *_msgs_count = 0;
@@ -343,8 +347,52 @@ int sysdb_search_ts_entry(TALLOC_CTX *mem_ctx,
         return EOK;
     }
 
-    return sysdb_cache_search_entry(mem_ctx, sysdb->ldb_ts, base_dn, scope,
-                                    filter, attrs, _msgs_count, _msgs);
+    /* Buffered updates must be visible to the search. They are applied
+     * to the result of a plain base search, anything else needs them
+     * written first. Updates of a running transaction cannot be written
+     * before it is committed, only base searches see them. */
+    if (scope != LDB_SCOPE_BASE || filter != NULL) {
+        if (sysdb_ts_batch_pending(sysdb, NULL)) {
+            ret = sysdb_ts_batch_flush(sysdb);
+            if (ret != EOK) {
+                DEBUG(SSSDBG_MINOR_FAILURE,
+                      "Cannot flush timestamp cache updates [%d]: %s\n",
+                      ret, sss_strerror(ret));
+            }
+        }
+
+        return sysdb_cache_search_entry(mem_ctx, sysdb->ldb_ts, base_dn,
+                                        scope, filter, attrs,
+                                        _msgs_count, _msgs);
+    }
+
+    ret = sysdb_cache_search_entry(mem_ctx, sysdb->ldb_ts, base_dn, scope,
+                                   filter, attrs, _msgs_count, _msgs);
+    if (ret == ENOENT && sysdb_ts_batch_pending(sysdb, base_dn)) {
+        /* The record is only buffered so far */
+        ret = sysdb_ts_batch_flush(sysdb);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Cannot flush timestamp cache updates [%d]: %s\n",
+                  ret, sss_strerror(ret));
+        }
+
+        ret = sysdb_cache_search_entry(mem_ctx, sysdb->ldb_ts, base_dn,
+                                       scope, filter, attrs,
+                                       _msgs_count, _msgs);
+    }
+    if (ret != EOK) {
+        return ret;
+    }
+
+    for (size_t c = 0; c < *_msgs_count; c++) {
+        ret = sysdb_ts_batch_overlay(sysdb, (*_msgs)[c], attrs);
+        if (ret != EOK) {
+            return ret;
+        }
+    }
+
+    return EOK;
 }
 
 /* =Search-Entry-by-SID-string============================================ */
@@ -674,9 +722,10 @@ int sysdb_search_user_by_upn_res(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res,
-                     base_dn, LDB_SCOPE_SUBTREE, attrs ? attrs : def_attrs,
-                     SYSDB_PWUPN_FILTER, sanitized, sanitized, sanitized);
+    ret = sysdb_ldb_search(domain->sysdb->ldb, tmp_ctx, &res,
+                           base_dn, LDB_SCOPE_SUBTREE,
+                           attrs ? attrs : def_attrs,
+                           SYSDB_PWUPN_FILTER, sanitized, sanitized, sanitized);
     if (ret != EOK) {
         ret = sysdb_error_to_errno(ret);
         goto done;
@@ -1397,10 +1446,17 @@ static int sysdb_rep_ts_entry_attr(struct sysdb_ctx *sysdb,
                                    struct ldb_dn *entry_dn,
                                    struct sysdb_attrs *attrs)
 {
+    errno_t ret;
+
     if (sysdb->ldb_ts == NULL || attrs->num == 0) {
         return EOK;
     }
 
+    ret = sysdb_ts_batch_add(sysdb, entry_dn, attrs);
+    if (ret != ENOTSUP) {
+        return ret;
+    }
+
     return sysdb_set_cache_entry_attr(sysdb->ldb_ts, entry_dn,
                                       attrs, SYSDB_MOD_REP);
 }
@@ -3001,6 +3057,652 @@ static errno_t sysdb_store_group_attrs(struct sss_domain_info *domain,
     return EOK;
 }
 
+/* =Store-Users/Groups-In-Bulk============================================ */
+
+/* Number of names looked up by a single search when prefetching the
+ * cached entries of a batch. Keeps the filter at a reasonable size.
+ */
+#define SYSDB_BULK_SEARCH_CHUNK 100
+
+static char *sysdb_bulk_key(TALLOC_CTX *mem_ctx,
+                            struct sss_domain_info *domain,
+                            const char *name)
+{
+    return talloc_asprintf(mem_ctx, "%s:%s", domain->name, name);
+}
+
+static errno_t sysdb_bulk_search_chunk(TALLOC_CTX *mem_ctx,
+                                       struct sss_domain_info *domain,
+                                       enum sysdb_obj_type obj_type,
+                                       const char **names,
+                                       size_t num_names,
+                                       hash_table_t *table)
+{
+    static const char *attrs[] = { "*", NULL };
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message **msgs;
+    struct ldb_dn *base_dn;
+    const char *oc;
+    const char *name;
+    size_t msgs_count;
+    char *sanitized;
+    char *filter;
+    char *key;
+    size_t i;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    if (obj_type == SYSDB_USER) {
+        base_dn = sysdb_user_base_dn(tmp_ctx, domain);
+        oc = SYSDB_USER_CLASS;
+    } else {
+        base_dn = sysdb_group_base_dn(tmp_ctx, domain);
+        oc = SYSDB_GROUP_CLASS;
+    }
+    if (base_dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    filter = talloc_asprintf(tmp_ctx, "(&(%s=%s)(|",
+                             SYSDB_OBJECTCATEGORY, oc);
+    if (filter == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (i = 0; i < num_names; i++) {
+        ret = sss_filter_sanitize(tmp_ctx, names[i], &sanitized);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        filter = talloc_asprintf_append(filter, "(%s=%s)",
+                                        SYSDB_NAME, sanitized);
+        if (filter == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+    }
+
+    filter = talloc_asprintf_append(filter, "))");
+    if (filter == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    /* Only the main cache is read here, the comparison done by the callers
+     * must not see the values kept in the timestamp cache */
+    ret = sysdb_cache_search_entry(tmp_ctx, domain->sysdb->ldb, base_dn,
+                                   LDB_SCOPE_SUBTREE, filter, attrs,
+                                   &msgs_count, &msgs);
+    if (ret == ENOENT) {
+        ret = EOK;
+        goto done;
+    } else if (ret != EOK) {
+        goto done;
+    }
+
+    for (i = 0; i < msgs_count; i++) {
+        name = ldb_msg_find_attr_as_string(msgs[i], SYSDB_NAME, NULL);
+        if (name == NULL) {
+            continue;
+        }
+
+        key = sysdb_bulk_key(tmp_ctx, domain, name);
+        if (key == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        talloc_steal(mem_ctx, msgs[i]);
+        ret = sss_ptr_hash_add(table, key, msgs[i], struct ldb_message);
+        if (ret == EEXIST) {
+            continue;
+        } else if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+/* Reads the cached entries of all the names in the batch into table,
+ * keyed by sysdb_bulk_key(). Names that are not found, including aliases
+ * of case-insensitive domains, are simply missing from the table.
+ */
+static errno_t sysdb_bulk_prefetch(TALLOC_CTX *mem_ctx,
+                                   enum sysdb_obj_type obj_type,
+                                   struct sss_domain_info **domains,
+                                   const char **names,
+                                   size_t num_entries,
+                                   hash_table_t *table)
+{
+    struct sss_domain_info *dom;
+    const char **chunk;
+    bool *visited;
+    size_t num_chunk;
+    size_t i;
+    size_t j;
+    errno_t ret;
+
+    visited = talloc_zero_array(mem_ctx, bool, num_entries);
+    chunk = talloc_zero_array(mem_ctx, const char *, SYSDB_BULK_SEARCH_CHUNK);
+    if (visited == NULL || chunk == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (i = 0; i < num_entries; i++) {
+        if (visited[i]) {
+            continue;
+        }
+
+        /* The entries of a batch usually belong to a single domain or
+         * a handful of them, collect the names of one domain at a time */
+        dom = domains[i];
+        num_chunk = 0;
+        for (j = i; j < num_entries; j++) {
+            if (visited[j] || domains[j] != dom) {
+                continue;
+            }
+            visited[j] = true;
+
+            if (names[j] == NULL) {
+                continue;
+            }
+
+            chunk[num_chunk] = names[j];
+            num_chunk++;
+
+            if (num_chunk == SYSDB_BULK_SEARCH_CHUNK) {
+                ret = sysdb_bulk_search_chunk(mem_ctx, dom, obj_type,
+                                              chunk, num_chunk, table);
+                if (ret != EOK) {
+                    goto done;
+                }
+                num_chunk = 0;
+            }
+        }
+
+        if (num_chunk > 0) {
+            ret = sysdb_bulk_search_chunk(mem_ctx, dom, obj_type,
+                                          chunk, num_chunk, table);
+            if (ret != EOK) {
+                goto done;
+            }
+        }
+    }
+
+    ret = EOK;
+
+done:
+    talloc_free(visited);
+    talloc_free(chunk);
+    return ret;
+}
+
+static struct ldb_message *sysdb_bulk_lookup(TALLOC_CTX *mem_ctx,
+                                             hash_table_t *table,
+                                             struct sss_domain_info *domain,
+                                             const char *name)
+{
+    struct ldb_message *msg;
+    char *key;
+
+    key = sysdb_bulk_key(mem_ctx, domain, name);
+    if (key == NULL) {
+        return NULL;
+    }
+
+    msg = sss_ptr_hash_lookup(table, key, struct ldb_message);
+    talloc_free(key);
+
+    return msg;
+}
+
+/* Writes the timestamp attributes of an entry that did not change, the same
+ * way sysdb_set_entry_attr() does when it finds no difference.
+ */
+static errno_t sysdb_bulk_update_ts(struct sysdb_ctx *sysdb,
+                                    struct ldb_dn *entry_dn,
+                                    struct sysdb_attrs *attrs,
+                                    uint64_t cache_timeout,
+                                    time_t now)
+{
+    struct sysdb_attrs *ts_attrs;
+    TALLOC_CTX *tmp_ctx;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ts_attrs = sysdb_filter_ts_attrs(tmp_ctx, attrs);
+    if (ts_attrs == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = sysdb_attrs_add_time_t(ts_attrs, SYSDB_LAST_UPDATE, now);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sysdb_attrs_add_time_t(ts_attrs, SYSDB_CACHE_EXPIRE,
+                                 ((cache_timeout) ?
+                                  (now + cache_timeout) : 0));
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sysdb_rep_ts_entry_attr(sysdb, entry_dn, ts_attrs);
+    if (ret == ENOENT) {
+        DEBUG(SSSDBG_TRACE_FUNC,
+              "The TS value for %s does not exist, trying to create it\n",
+              ldb_dn_get_linearized(entry_dn));
+        ret = sysdb_create_ts_entry(sysdb, entry_dn, ts_attrs);
+    }
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+/* Returns true if storing the user would modify the main cache entry */
+static bool sysdb_bulk_user_differs(struct sysdb_store_user_item *item,
+                                    struct ldb_message *db_msg,
+                                    struct sysdb_attrs *attrs)
+{
+    struct sysdb_attrs *basic;
+    bool differs = true;
+    errno_t ret;
+    size_t i;
+
+    basic = sysdb_new_attrs(NULL);
+    if (basic == NULL) {
+        return true;
+    }
+
+    /* Mirrors what sysdb_store_user() adds on top of the attributes */
+    if (item->pwd && !*item->pwd) {
+        ret = sysdb_attrs_add_string(basic, SYSDB_PWD, item->pwd);
+        if (ret != EOK) goto done;
+    }
+
+    if (item->uid) {
+        ret = sysdb_attrs_add_uint32(basic, SYSDB_UIDNUM, item->uid);
+        if (ret != EOK) goto done;
+    }
+
+    if (item->gid) {
+        ret = sysdb_attrs_add_uint32(basic, SYSDB_GIDNUM, item->gid);
+        if (ret != EOK) goto done;
+    }
+
+    if (item->uid && !item->gid && sss_domain_is_mpg(item->domain)) {
+        ret = sysdb_attrs_add_uint32(basic, SYSDB_GIDNUM, item->uid);
+        if (ret != EOK) goto done;
+    }
+
+    if (item->gecos) {
+        ret = sysdb_attrs_add_string(basic, SYSDB_GECOS, item->gecos);
+        if (ret != EOK) goto done;
+    }
+
+    if (item->homedir) {
+        ret = sysdb_attrs_add_string(basic, SYSDB_HOMEDIR, item->homedir);
+        if (ret != EOK) goto done;
+    }
+
+    if (item->shell) {
+        ret = sysdb_attrs_add_string(basic, SYSDB_SHELL, item->shell);
+        if (ret != EOK) goto done;
+    }
+
+    if (sysdb_msg_attrs_diff(db_msg->dn, db_msg, attrs, SYSDB_MOD_REP)
+            || sysdb_msg_attrs_diff(db_msg->dn, db_msg, basic,
+                                    SYSDB_MOD_REP)) {
+        goto done;
+    }
+
+    if (item->remove_attrs != NULL) {
+        for (i = 0; item->remove_attrs[i] != NULL; i++) {
+            if (strcasecmp(item->remove_attrs[i], SYSDB_MEMBEROF) == 0) {
+                continue;
+            }
+
+            if (ldb_msg_find_element(db_msg,
+                                     item->remove_attrs[i]) != NULL) {
+                DEBUG(SSSDBG_TRACE_INTERNAL,
+                      "Deleted attr [%s] of entry [%s].\n",
+                      item->remove_attrs[i],
+                      ldb_dn_get_linearized(db_msg->dn));
+                goto done;
+            }
+        }
+    }
+
+    differs = false;
+
+done:
+    talloc_free(basic);
+    return differs;
+}
+
+/* Returns true if storing the group would modify the main cache entry */
+static bool sysdb_bulk_group_differs(struct sysdb_store_group_item *item,
+                                     struct ldb_message *db_msg,
+                                     struct sysdb_attrs *attrs)
+{
+    struct sysdb_attrs *basic;
+    bool differs = true;
+    errno_t ret;
+
+    basic = sysdb_new_attrs(NULL);
+    if (basic == NULL) {
+        return true;
+    }
+
+    /* Mirrors what sysdb_store_group() adds on top of the attributes */
+    if (item->gid) {
+        ret = sysdb_attrs_add_uint32(basic, SYSDB_GIDNUM, item->gid);
+        if (ret != EOK) goto done;
+    }
+
+    differs = sysdb_msg_attrs_diff(db_msg->dn, db_msg, attrs, SYSDB_MOD_REP)
+              || sysdb_msg_attrs_diff(db_msg->dn, db_msg, basic,
+                                      SYSDB_MOD_REP);
+
+done:
+    talloc_free(basic);
+    return differs;
+}
+
+errno_t sysdb_store_users_bulk(struct sysdb_ctx *sysdb,
+                               struct sysdb_store_user_item *users,
+                               size_t num_users,
+                               time_t now)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct sss_domain_info **domains;
+    struct sysdb_store_user_item *item;
+    struct ldb_message *db_msg;
+    struct sysdb_attrs *attrs;
+    hash_table_t *table = NULL;
+    const char **names;
+    size_t num_unchanged = 0;
+    size_t i;
+    errno_t ret;
+    errno_t sret;
+    bool in_transaction = false;
+
+    if (num_users == 0) {
+        return EOK;
+    }
+
+    if (now == 0) {
+        now = time(NULL);
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sysdb_transaction_start(sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to start transaction\n");
+        goto done;
+    }
+    in_transaction = true;
+
+    /* Without a timestamp cache every entry is written anyway, there is
+     * nothing to gain from reading the cached entries first */
+    if (sysdb->ldb_ts != NULL) {
+        domains = talloc_zero_array(tmp_ctx, struct sss_domain_info *,
+                                    num_users);
+        names = talloc_zero_array(tmp_ctx, const char *, num_users);
+        table = sss_ptr_hash_create(tmp_ctx, NULL, NULL);
+        if (domains == NULL || names == NULL || table == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        for (i = 0; i < num_users; i++) {
+            domains[i] = users[i].domain;
+            names[i] = users[i].name;
+        }
+
+        ret = sysdb_bulk_prefetch(tmp_ctx, SYSDB_USER, domains, names,
+                                  num_users, table);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE,
+                  "Cannot read cached users [%d]: %s\n",
+                  ret, sss_strerror(ret));
+            goto done;
+        }
+    }
+
+    for (i = 0; i < num_users; i++) {
+        item = &users[i];
+
+        if (item->domain == NULL || item->name == NULL) {
+            item->ret = EINVAL;
+            continue;
+        }
+
+        db_msg = NULL;
+        if (table != NULL) {
+            db_msg = sysdb_bulk_lookup(tmp_ctx, table,
+                                       item->domain, item->name);
+        }
+
+        if (db_msg != NULL) {
+            attrs = item->attrs;
+            if (attrs == NULL) {
+                attrs = sysdb_new_attrs(tmp_ctx);
+                if (attrs == NULL) {
+                    ret = ENOMEM;
+                    goto done;
+                }
+            }
+
+            if (!sysdb_bulk_user_differs(item, db_msg, attrs)) {
+                item->ret = sysdb_bulk_update_ts(sysdb, db_msg->dn, attrs,
+                                                 item->cache_timeout, now);
+                if (item->ret == EOK) {
+                    DEBUG(SSSDBG_TRACE_LIBS,
+                          "The user record of %s did not change, only "
+                          "updated the timestamp cache\n", item->name);
+                    num_unchanged++;
+                    continue;
+                }
+            }
+        }
+
+        item->ret = sysdb_store_user(item->domain, item->name, item->pwd,
+                                     item->uid, item->gid, item->gecos,
+                                     item->homedir, item->shell,
+                                     item->orig_dn, item->attrs,
+                                     item->remove_attrs,
+                                     item->cache_timeout, now);
+        if (item->ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "Failed to store user %s [%d]: %s\n",
+                  item->name, item->ret, sss_strerror(item->ret));
+        }
+    }
+
+    ret = sysdb_transaction_commit(sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to commit transaction\n");
+        goto done;
+    }
+    in_transaction = false;
+
+    DEBUG(SSSDBG_TRACE_FUNC,
+          "Stored %zu users, %zu of them did not change\n",
+          num_users, num_unchanged);
+
+done:
+    if (in_transaction) {
+        sret = sysdb_transaction_cancel(sysdb);
+        if (sret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Could not cancel transaction\n");
+        }
+    }
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+errno_t sysdb_store_groups_bulk(struct sysdb_ctx *sysdb,
+                                struct sysdb_store_group_item *groups,
+                                size_t num_groups,
+                                time_t now)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct sss_domain_info **domains;
+    struct sysdb_store_group_item *item;
+    struct ldb_message *db_msg;
+    struct sysdb_attrs *attrs;
+    hash_table_t *table = NULL;
+    const char **names;
+    size_t num_unchanged = 0;
+    size_t i;
+    errno_t ret;
+    errno_t sret;
+    bool in_transaction = false;
+
+    if (num_groups == 0) {
+        return EOK;
+    }
+
+    if (now == 0) {
+        now = time(NULL);
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sysdb_transaction_start(sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to start transaction\n");
+        goto done;
+    }
+    in_transaction = true;
+
+    if (sysdb->ldb_ts != NULL) {
+        domains = talloc_zero_array(tmp_ctx, struct sss_domain_info *,
+                                    num_groups);
+        names = talloc_zero_array(tmp_ctx, const char *, num_groups);
+        table = sss_ptr_hash_create(tmp_ctx, NULL, NULL);
+        if (domains == NULL || names == NULL || table == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        for (i = 0; i < num_groups; i++) {
+            domains[i] = groups[i].domain;
+            names[i] = groups[i].name;
+        }
+
+        ret = sysdb_bulk_prefetch(tmp_ctx, SYSDB_GROUP, domains, names,
+                                  num_groups, table);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE,
+                  "Cannot read cached groups [%d]: %s\n",
+                  ret, sss_strerror(ret));
+            goto done;
+        }
+    }
+
+    for (i = 0; i < num_groups; i++) {
+        item = &groups[i];
+
+        if (item->domain == NULL || item->name == NULL) {
+            item->ret = EINVAL;
+            continue;
+        }
+
+        db_msg = NULL;
+        if (table != NULL) {
+            db_msg = sysdb_bulk_lookup(tmp_ctx, table,
+                                       item->domain, item->name);
+        }
+
+        if (db_msg != NULL) {
+            attrs = item->attrs;
+            if (attrs == NULL) {
+                attrs = sysdb_new_attrs(tmp_ctx);
+                if (attrs == NULL) {
+                    ret = ENOMEM;
+                    goto done;
+                }
+            }
+
+            /* Same shortcut as sysdb_store_group(): an unchanged
+             * modifyTimestamp means only the timestamps need a refresh */
+            item->ret = sysdb_check_and_update_ts_grp(item->domain,
+                                                      item->name, attrs,
+                                                      item->cache_timeout,
+                                                      now);
+            if (item->ret != EOK && !sysdb_bulk_group_differs(item, db_msg,
+                                                              attrs)) {
+                item->ret = sysdb_bulk_update_ts(sysdb, db_msg->dn, attrs,
+                                                 item->cache_timeout, now);
+            }
+
+            if (item->ret == EOK) {
+                DEBUG(SSSDBG_TRACE_LIBS,
+                      "The group record of %s did not change, only "
+                      "updated the timestamp cache\n", item->name);
+                num_unchanged++;
+                continue;
+            }
+        }
+
+        item->ret = sysdb_store_group(item->domain, item->name, item->gid,
+                                      item->attrs, item->cache_timeout, now);
+        if (item->ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Failed to store group %s [%d]: %s\n",
+                  item->name, item->ret, sss_strerror(item->ret));
+        }
+    }
+
+    ret = sysdb_transaction_commit(sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to commit transaction\n");
+        goto done;
+    }
+    in_transaction = false;
+
+    DEBUG(SSSDBG_TRACE_FUNC,
+          "Stored %zu groups, %zu of them did not change\n",
+          num_groups, num_unchanged);
+
+done:
+    if (in_transaction) {
+        sret = sysdb_transaction_cancel(sysdb);
+        if (sret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Could not cancel transaction\n");
+        }
+    }
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
 /* =Add-User-to-Group(Native/Legacy)====================================== */
 static int
 sysdb_group_membership_mod(struct sss_domain_info *domain,
@@ -3825,6 +4527,13 @@ int sysdb_search_ts_users(TALLOC_CTX *mem_ctx,
         return ERR_NO_TS;
     }
 
+    ret = sysdb_ts_batch_flush(domain->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Cannot flush timestamp cache updates [%d]: %s\n",
+              ret, sss_strerror(ret));
+    }
+
     ret = sysdb_cache_search_users(mem_ctx, domain, domain->sysdb->ldb_ts,
                                     sub_filter, attrs, &msgs_count, &msgs);
     if (ret == EOK) {
@@ -4189,6 +4898,13 @@ int sysdb_search_ts_groups(TALLOC_CTX *mem_ctx,
         return ERR_NO_TS;
     }
 
+    ret = sysdb_ts_batch_flush(domain->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Cannot flush timestamp cache updates [%d]: %s\n",
+              ret, sss_strerror(ret));
+    }
+
     ret = sysdb_cache_search_groups(mem_ctx, domain, domain->sysdb->ldb_ts,
                                     sub_filter, attrs, &msgs_count, &msgs);
     if (ret == EOK) {
@@ -4999,9 +5715,9 @@ static errno_t sysdb_search_object_attr(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, basedn,
-                     LDB_SCOPE_SUBTREE, attrs ? attrs : def_attrs,
-                     "%s", filter);
+    ret = sysdb_ldb_search(domain->sysdb->ldb, tmp_ctx, &res, basedn,
+                           LDB_SCOPE_SUBTREE, attrs ? attrs : def_attrs,
+                           "%s", filter);
     if (ret != EOK) {
         ret = sysdb_error_to_errno(ret);
         DEBUG(SSSDBG_OP_FAILURE, "ldb_search failed.\n");
@@ -5139,6 +5855,28 @@ errno_t sysdb_search_object_by_sid(TALLOC_CTX *mem_ctx,
                                    const char **attrs,
                                    struct ldb_result **res)
 {
+    struct sysdb_snapshot_key key;
+    struct ldb_result *snap_res;
+    errno_t ret;
+
+    key.type = SYSDB_SNAPSHOT_SID;
+    key.value = sid_str;
+
+    ret = sysdb_snapshot_search(mem_ctx, domain, &key, 1, attrs, &snap_res);
+    if (ret == EOK && snap_res->count == 1) {
+        ret = sysdb_merge_res_ts_attrs(domain->sysdb, snap_res, attrs);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "Cannot merge timestamp cache values\n");
+            /* non-fatal */
+        }
+
+        *res = snap_res;
+        return EOK;
+    } else if (ret == EOK) {
+        /* Let the cache search report the duplicate */
+        talloc_free(snap_res);
+    }
+
     return sysdb_search_object_by_str_attr(mem_ctx, domain, SYSDB_SID_FILTER,
                                            sid_str, attrs, true, res);
 }
@@ -5531,6 +6269,8 @@ errno_t sysdb_mark_entry_as_expired_ldb_dn(struct sss_domain_info *dom,
     }
 
     if (dom->sysdb->ldb_ts != NULL) {
+        /* A buffered update must not overwrite the expiration later */
+        sysdb_ts_batch_drop(dom->sysdb, msg->dn);
         ret = ldb_modify(dom->sysdb->ldb_ts, msg);
         if (ret != LDB_SUCCESS) {
             DEBUG(SSSDBG_MINOR_FAILURE,
@@ -5626,6 +6366,7 @@ int sysdb_invalidate_cache_entry(struct sss_domain_info *domain,
     }
 
     if (sysdb->ldb_ts != NULL) {
+        sysdb_ts_batch_drop(sysdb, entry_dn);
         ret = sysdb_set_cache_entry_attr(sysdb->ldb_ts, entry_dn,
                                          attrs, SYSDB_MOD_REP);
         if (ret != EOK) {
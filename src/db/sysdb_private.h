@@ -127,6 +127,9 @@
 
 #include "db/sysdb.h"
 
+/* Nesting depth up to which transaction hold times are measured */
+#define SYSDB_TXN_MAX_FRAMES 16
+
 struct sysdb_ctx {
     struct ldb_context *ldb;
     char *ldb_file;
@@ -135,6 +138,28 @@ struct sysdb_ctx {
     char *ldb_ts_file;
 
     int transaction_nesting;
+
+    /* Transaction statistics, see sysdb_transaction_stats() */
+    struct sysdb_txn_frame {
+        uint64_t start;
+        const char *tag;
+    } txn_frames[SYSDB_TXN_MAX_FRAMES];
+    struct sysdb_txn_histogram txn_levels[SYSDB_TXN_STATS_LEVELS];
+    struct sysdb_txn_histogram *txn_callers;
+    size_t txn_num_callers;
+
+    /* Buffered timestamp cache updates, see sysdb_ts_batch_begin() */
+    struct sysdb_ts_batch *ts_batch;
+
+    /* Read-only snapshot of the cache, see sysdb_snapshot_publish() */
+    struct sysdb_snapshot *snapshot;
+    time_t snapshot_checked;
+    uint64_t snapshot_seqnum;
+    struct sysdb_snapshot_stamp *snapshot_stamp;
+    bool snapshot_no_stamp;
+    struct tevent_context *snapshot_ev;
+    struct tevent_timer *snapshot_timer;
+    uint32_t snapshot_delay_msec;
 };
 
 /* Internal utility functions */
@@ -148,6 +173,10 @@ errno_t sysdb_ldb_connect(TALLOC_CTX *mem_ctx,
                           const char *filename,
                           int flags,
                           struct ldb_context **_ldb);
+errno_t sysdb_ldb_list_indexes(TALLOC_CTX *mem_ctx,
+                               struct ldb_context *ldb,
+                               const char *attribute,
+                               const char ***_indexes);
 errno_t sysdb_ldb_mod_index(TALLOC_CTX *mem_ctx,
                             enum sysdb_index_actions action,
                             struct ldb_context *ldb,
@@ -157,6 +186,21 @@ errno_t sysdb_manage_index(TALLOC_CTX *mem_ctx,
                            const char *name,
                            const char *attribute,
                            const char ***indexes);
+
+/* Attributes of slow searches that no index could serve, recorded by the
+ * SSSD processes using the cache in ldb_file. Sorted by the time the
+ * searches took, attributes that are indexed by now are left out. */
+struct sysdb_index_advice {
+    const char *attr;
+    uint64_t count;
+    uint64_t usec;
+};
+
+errno_t sysdb_index_advise(TALLOC_CTX *mem_ctx,
+                           const char *ldb_file,
+                           struct sysdb_index_advice **_advice,
+                           size_t *_count);
+
 struct sysdb_dom_upgrade_ctx {
     struct sss_names_ctx *names; /* upgrade to 0.18 needs to parse names */
 };
@@ -240,6 +284,39 @@ errno_t sysdb_merge_msg_list_ts_attrs(struct sysdb_ctx *ctx,
 struct ldb_result *sss_merge_ldb_results(struct ldb_result *res,
                                          struct ldb_result *subres);
 
+/* Search instrumentation, see sysdb_search_stats.c
+ *
+ * sysdb_ldb_search() behaves like ldb_search() but reports the search
+ * through the sysdb_search_start/end systemtap probes and logs searches
+ * that take at least the threshold given to sysdb_search_stats_init() in
+ * microseconds, 0 disables the log. Attributes of slow unindexed searches
+ * are saved next to ldb_file for sysdb_index_advise().
+ * sysdb_search_stats_reset_indexes() should be called when the index list
+ * of the database changes. */
+struct sysdb_search_counters {
+    uint64_t searches;
+    uint64_t errors;
+    uint64_t entries;
+    uint64_t slow_searches;
+    uint64_t usec;
+};
+
+errno_t sysdb_search_stats_init(struct ldb_context *ldb,
+                                const char *ldb_file,
+                                const char *db_name,
+                                uint64_t slow_usec);
+void sysdb_search_stats_reset_indexes(struct ldb_context *ldb);
+/* Counters of the searches since sysdb_search_stats_init() */
+errno_t sysdb_search_stats_get_counters(struct ldb_context *ldb,
+                                        struct sysdb_search_counters *_counters);
+int sysdb_ldb_search(struct ldb_context *ldb,
+                     TALLOC_CTX *mem_ctx,
+                     struct ldb_result **_res,
+                     struct ldb_dn *base,
+                     enum ldb_scope scope,
+                     const char * const *attrs,
+                     const char *exp_fmt, ...) SSS_ATTRIBUTE_PRINTF(7, 8);
+
 /* Search Entry in an ldb cache */
 int sysdb_cache_search_entry(TALLOC_CTX *mem_ctx,
                              struct ldb_context *ldb,
@@ -303,4 +380,79 @@ bool sysdb_entry_attrs_diff(struct sysdb_ctx *sysdb,
                             struct sysdb_attrs *attrs,
                             int mod_op);
 
+/* Buffers an update of the timestamp attributes of entry_dn. Returns
+ * ENOTSUP if batching is not active and the caller must write the update
+ * directly. Updates made inside a sysdb transaction are kept apart until
+ * it ends, see sysdb_ts_batch_txn_end(). A buffered update creates the
+ * record if it does not exist.
+ */
+errno_t sysdb_ts_batch_add(struct sysdb_ctx *sysdb,
+                           struct ldb_dn *entry_dn,
+                           struct sysdb_attrs *ts_attrs);
+
+/* Called when a sysdb transaction ends. The updates buffered inside the
+ * transaction are queued for the flush if the outermost transaction was
+ * committed and dropped if any transaction was cancelled.
+ */
+void sysdb_ts_batch_txn_end(struct sysdb_ctx *sysdb, bool committed);
+
+/* Forgets a buffered update, used when the entry is being deleted */
+void sysdb_ts_batch_drop(struct sysdb_ctx *sysdb,
+                         struct ldb_dn *entry_dn);
+
+/* Applies the buffered update of msg->dn, if any, to a message read
+ * from the timestamp cache
+ */
+errno_t sysdb_ts_batch_overlay(struct sysdb_ctx *sysdb,
+                               struct ldb_message *msg,
+                               const char **attrs);
+
+/* Returns true if there is a buffered update of entry_dn or, with
+ * entry_dn set to NULL, of any entry
+ */
+bool sysdb_ts_batch_pending(struct sysdb_ctx *sysdb,
+                            struct ldb_dn *entry_dn);
+
+/* Schedules a new snapshot after the cache was changed, if enabled with
+ * sysdb_snapshot_publish_on_change() */
+void sysdb_snapshot_changed(struct sysdb_ctx *sysdb);
+
+/* Keys of the entries in the cache snapshot */
+enum sysdb_snapshot_key_type {
+    SYSDB_SNAPSHOT_USER_NAME = 'n',
+    SYSDB_SNAPSHOT_USER_ALIAS = 'a',
+    SYSDB_SNAPSHOT_USER_UID = 'u',
+    SYSDB_SNAPSHOT_USER_UPN = 'p',
+    SYSDB_SNAPSHOT_GROUP_NAME = 'N',
+    SYSDB_SNAPSHOT_GROUP_ALIAS = 'A',
+    SYSDB_SNAPSHOT_GROUP_GID = 'g',
+    SYSDB_SNAPSHOT_SID = 's',
+};
+
+struct sysdb_snapshot_key {
+    enum sysdb_snapshot_key_type type;
+    const char *value;
+};
+
+/* Looks the entries matching any of the keys up in the snapshot published
+ * by the backend. Only the attributes in attrs are returned, the timestamp
+ * attributes must be merged by the caller. Returns ENOENT if nothing was
+ * found or there is no up-to-date snapshot, the caller must search the
+ * cache then.
+ */
+errno_t sysdb_snapshot_search(TALLOC_CTX *mem_ctx,
+                              struct sss_domain_info *domain,
+                              const struct sysdb_snapshot_key *keys,
+                              size_t num_keys,
+                              const char **attrs,
+                              struct ldb_result **_res);
+
+/* Same as sysdb_entry_attrs_diff() but compares against an entry that
+ * the caller has already read from the cache instead of searching for it.
+ */
+bool sysdb_msg_attrs_diff(struct ldb_dn *entry_dn,
+                          struct ldb_message *db_msg,
+                          struct sysdb_attrs *attrs,
+                          int mod_op);
+
 #endif /* __INT_SYS_DB_H__ */
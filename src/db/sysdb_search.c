@@ -279,6 +279,58 @@ errno_t sysdb_merge_msg_list_ts_attrs(struct sysdb_ctx *ctx,
     return sysdb_merge_res_ts_attrs(ctx, &res, attrs);
 }
 
+/* Looks a user or group up by name in the snapshot, matching the same
+ * values as SYSDB_PWNAM_FILTER and SYSDB_GRNAM_FILTER */
+static errno_t sysdb_snapshot_search_name(TALLOC_CTX *mem_ctx,
+                                          struct sss_domain_info *domain,
+                                          enum sysdb_snapshot_key_type name_type,
+                                          enum sysdb_snapshot_key_type alias_type,
+                                          const char *name,
+                                          const char **attrs,
+                                          struct ldb_result **_res)
+{
+    struct sysdb_snapshot_key keys[3];
+    char *lc_name;
+    errno_t ret;
+
+    if (domain->case_sensitive) {
+        lc_name = talloc_strdup(mem_ctx, name);
+    } else {
+        lc_name = sss_tc_utf8_str_tolower(mem_ctx, name);
+    }
+    if (lc_name == NULL) {
+        return ENOMEM;
+    }
+
+    keys[0].type = alias_type;
+    keys[0].value = lc_name;
+    keys[1].type = alias_type;
+    keys[1].value = name;
+    keys[2].type = name_type;
+    keys[2].value = name;
+
+    ret = sysdb_snapshot_search(mem_ctx, domain, keys, 3, attrs, _res);
+    talloc_free(lc_name);
+    return ret;
+}
+
+static errno_t sysdb_snapshot_search_id(TALLOC_CTX *mem_ctx,
+                                        struct sss_domain_info *domain,
+                                        enum sysdb_snapshot_key_type type,
+                                        unsigned long int id,
+                                        const char **attrs,
+                                        struct ldb_result **_res)
+{
+    struct sysdb_snapshot_key key;
+    char id_str[32];
+
+    snprintf(id_str, sizeof(id_str), "%lu", id);
+    key.type = type;
+    key.value = id_str;
+
+    return sysdb_snapshot_search(mem_ctx, domain, &key, 1, attrs, _res);
+}
+
 /* users */
 
 int sysdb_getpwnam(TALLOC_CTX *mem_ctx,
@@ -311,12 +363,19 @@ int sysdb_getpwnam(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
-                     LDB_SCOPE_SUBTREE, attrs, SYSDB_PWNAM_FILTER,
-                     lc_sanitized_name,
-                     sanitized_name, sanitized_name);
-    if (ret) {
+    /* Answer from the snapshot of the cache if there is an up-to-date one */
+    ret = sysdb_snapshot_search_name(tmp_ctx, domain,
+                                     SYSDB_SNAPSHOT_USER_NAME,
+                                     SYSDB_SNAPSHOT_USER_ALIAS,
+                                     name, attrs, &res);
+    if (ret == ENOENT) {
+        ret = sysdb_ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
+                               LDB_SCOPE_SUBTREE, attrs, SYSDB_PWNAM_FILTER,
+                               lc_sanitized_name,
+                               sanitized_name, sanitized_name);
         ret = sysdb_error_to_errno(ret);
+    }
+    if (ret != EOK) {
         goto done;
     }
 
@@ -441,10 +500,15 @@ int sysdb_getpwuid(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
-                     LDB_SCOPE_SUBTREE, attrs, SYSDB_PWUID_FILTER, ul_uid);
-    if (ret) {
+    ret = sysdb_snapshot_search_id(tmp_ctx, domain, SYSDB_SNAPSHOT_USER_UID,
+                                   ul_uid, attrs, &res);
+    if (ret == ENOENT) {
+        ret = sysdb_ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
+                               LDB_SCOPE_SUBTREE, attrs, SYSDB_PWUID_FILTER,
+                               ul_uid);
         ret = sysdb_error_to_errno(ret);
+    }
+    if (ret != EOK) {
         goto done;
     }
 
@@ -607,6 +671,7 @@ int sysdb_getpwupn(TALLOC_CTX *mem_ctx,
     TALLOC_CTX *tmp_ctx;
     struct ldb_result *res;
     static const char *attrs[] = SYSDB_PW_ATTRS;
+    struct sysdb_snapshot_key key;
     errno_t ret;
 
     tmp_ctx = talloc_new(NULL);
@@ -615,6 +680,29 @@ int sysdb_getpwupn(TALLOC_CTX *mem_ctx,
         return ENOMEM;
     }
 
+    /* The snapshot is only consulted for lookups in a single domain, an
+     * ambiguous result is left to the cache search to report */
+    if (domain_scope) {
+        key.type = SYSDB_SNAPSHOT_USER_UPN;
+        key.value = upn;
+
+        ret = sysdb_snapshot_search(tmp_ctx, domain, &key, 1, attrs, &res);
+        if (ret == EOK && res->count == 1) {
+            ret = sysdb_merge_res_ts_attrs(domain->sysdb, res, attrs);
+            if (ret != EOK) {
+                DEBUG(SSSDBG_MINOR_FAILURE,
+                      "Cannot merge timestamp cache values\n");
+                /* non-fatal */
+            }
+
+            *_res = talloc_steal(mem_ctx, res);
+            ret = EOK;
+            goto done;
+        } else if (ret != EOK && ret != ENOENT) {
+            goto done;
+        }
+    }
+
     ret = sysdb_search_user_by_upn_res(tmp_ctx, domain, domain_scope, upn, attrs, &res);
     if (ret != EOK && ret != ENOENT) {
         DEBUG(SSSDBG_OP_FAILURE, "sysdb_search_user_by_upn_res() failed.\n");
@@ -656,8 +744,8 @@ errno_t sysdb_search_ts_matches(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = ldb_search(sysdb->ldb, tmp_ctx, &res, NULL,
-                     LDB_SCOPE_SUBTREE, attrs, "%s", filter);
+    ret = sysdb_ldb_search(sysdb->ldb, tmp_ctx, &res, NULL,
+                           LDB_SCOPE_SUBTREE, attrs, "%s", filter);
     if (ret) {
         ret = sysdb_error_to_errno(ret);
         goto done;
@@ -953,8 +1041,8 @@ int sysdb_enumpwent_filter(TALLOC_CTX *mem_ctx,
     }
     DEBUG(SSSDBG_TRACE_LIBS, "Searching cache with [%s]\n", filter);
 
-    ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
-                     LDB_SCOPE_SUBTREE, attrs, "%s", filter);
+    ret = sysdb_ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
+                           LDB_SCOPE_SUBTREE, attrs, "%s", filter);
     if (ret) {
         ret = sysdb_error_to_errno(ret);
         goto done;
@@ -1086,26 +1174,54 @@ static int mpg_res_convert(struct ldb_result *res)
     return EOK;
 }
 
+static int sysdb_getgrnam_internal(TALLOC_CTX *mem_ctx,
+                                   struct sss_domain_info *domain,
+                                   const char *name,
+                                   const char **attrs,
+                                   struct ldb_result **_res);
+
+static int sysdb_getgrgid_internal(TALLOC_CTX *mem_ctx,
+                                   struct sss_domain_info *domain,
+                                   gid_t gid,
+                                   const char **default_attrs,
+                                   const char **additional_attrs,
+                                   struct ldb_result **_res);
+
 int sysdb_getgrnam_with_views(TALLOC_CTX *mem_ctx,
                               struct sss_domain_info *domain,
                               const char *name,
                               struct ldb_result **res)
+{
+    return sysdb_getgrnam_with_views_ex(mem_ctx, domain, name, true, res);
+}
+
+int sysdb_getgrnam_with_views_ex(TALLOC_CTX *mem_ctx,
+                                 struct sss_domain_info *domain,
+                                 const char *name,
+                                 bool with_members,
+                                 struct ldb_result **res)
 {
     TALLOC_CTX *tmp_ctx;
     int ret;
     struct ldb_result *orig_obj = NULL;
     struct ldb_result *override_obj = NULL;
     struct ldb_message_element *el;
+    static const char *header_attrs[] = SYSDB_GRSRC_HEADER_ATTRS;
+    const char **attrs;
 
     tmp_ctx = talloc_new(NULL);
     if (!tmp_ctx) {
         return ENOMEM;
     }
 
+    attrs = with_members ? SYSDB_GRSRC_ATTRS(domain) : header_attrs;
+
     /* If there are views we first have to search the overrides for matches */
     if (DOM_HAS_VIEWS(domain)) {
-        ret = sysdb_search_group_override_by_name(tmp_ctx, domain, name,
-                                                  &override_obj, &orig_obj);
+        ret = sysdb_search_group_override_attrs_by_name(tmp_ctx, domain,
+                                                        name, attrs,
+                                                        &override_obj,
+                                                        &orig_obj);
         if (ret != EOK && ret != ENOENT) {
             DEBUG(SSSDBG_OP_FAILURE,
                   "sysdb_search_group_override_by_name failed.\n");
@@ -1116,7 +1232,8 @@ int sysdb_getgrnam_with_views(TALLOC_CTX *mem_ctx,
     /* If there are no views or nothing was found in the overrides the
      * original objects are searched. */
     if (orig_obj == NULL) {
-        ret = sysdb_getgrnam(tmp_ctx, domain, name, &orig_obj);
+        ret = sysdb_getgrnam_internal(tmp_ctx, domain, name, attrs,
+                                      &orig_obj);
         if (ret != EOK) {
             DEBUG(SSSDBG_OP_FAILURE, "sysdb_getgrnam failed.\n");
             goto done;
@@ -1150,11 +1267,13 @@ int sysdb_getgrnam_with_views(TALLOC_CTX *mem_ctx,
 
         /* Must be called even without views to check to
          * SYSDB_DEFAULT_OVERRIDE_NAME */
-        ret = sysdb_add_group_member_overrides(domain, orig_obj->msgs[0]);
-        if (ret != EOK) {
-            DEBUG(SSSDBG_OP_FAILURE,
-                  "sysdb_add_group_member_overrides failed.\n");
-            goto done;
+        if (with_members) {
+            ret = sysdb_add_group_member_overrides(domain, orig_obj->msgs[0]);
+            if (ret != EOK) {
+                DEBUG(SSSDBG_OP_FAILURE,
+                      "sysdb_add_group_member_overrides failed.\n");
+                goto done;
+            }
         }
     }
 
@@ -1177,13 +1296,13 @@ done:
     return ret;
 }
 
-int sysdb_getgrnam(TALLOC_CTX *mem_ctx,
-                   struct sss_domain_info *domain,
-                   const char *name,
-                   struct ldb_result **_res)
+static int sysdb_getgrnam_internal(TALLOC_CTX *mem_ctx,
+                                   struct sss_domain_info *domain,
+                                   const char *name,
+                                   const char **attrs,
+                                   struct ldb_result **_res)
 {
     TALLOC_CTX *tmp_ctx;
-    const char **attrs = SYSDB_GRSRC_ATTRS(domain);
     const char *fmt_filter;
     char *sanitized_name;
     struct ldb_dn *base_dn;
@@ -1219,9 +1338,10 @@ int sysdb_getgrnam(TALLOC_CTX *mem_ctx,
             goto done;
         }
 
-        ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
-                         LDB_SCOPE_SUBTREE, attrs, fmt_filter,
-                         lc_sanitized_name, sanitized_name, sanitized_name);
+        ret = sysdb_ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
+                               LDB_SCOPE_SUBTREE, attrs, fmt_filter,
+                               lc_sanitized_name, sanitized_name,
+                               sanitized_name);
         if (ret != EOK) {
             ret = sysdb_error_to_errno(ret);
             goto done;
@@ -1243,6 +1363,14 @@ int sysdb_getgrnam(TALLOC_CTX *mem_ctx,
     } else {
         fmt_filter = SYSDB_GRNAM_FILTER;
         base_dn = sysdb_group_base_dn(tmp_ctx, domain);
+
+        ret = sysdb_snapshot_search_name(tmp_ctx, domain,
+                                         SYSDB_SNAPSHOT_GROUP_NAME,
+                                         SYSDB_SNAPSHOT_GROUP_ALIAS,
+                                         name, attrs, &res);
+        if (ret != EOK && ret != ENOENT) {
+            goto done;
+        }
     }
     if (base_dn == NULL) {
         ret = ENOMEM;
@@ -1253,9 +1381,10 @@ int sysdb_getgrnam(TALLOC_CTX *mem_ctx,
      * it's a MPG and we're dealing with a overridden group, which has to
      * use the very same filter as a non MPG domain. */
     if (res == NULL) {
-        ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
-                         LDB_SCOPE_SUBTREE, attrs, fmt_filter,
-                         lc_sanitized_name, sanitized_name, sanitized_name);
+        ret = sysdb_ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
+                               LDB_SCOPE_SUBTREE, attrs, fmt_filter,
+                               lc_sanitized_name, sanitized_name,
+                               sanitized_name);
         if (ret != EOK) {
             ret = sysdb_error_to_errno(ret);
             goto done;
@@ -1280,26 +1409,49 @@ done:
     return ret;
 }
 
+int sysdb_getgrnam(TALLOC_CTX *mem_ctx,
+                   struct sss_domain_info *domain,
+                   const char *name,
+                   struct ldb_result **_res)
+{
+    return sysdb_getgrnam_internal(mem_ctx, domain, name,
+                                   SYSDB_GRSRC_ATTRS(domain), _res);
+}
+
 int sysdb_getgrgid_with_views(TALLOC_CTX *mem_ctx,
                               struct sss_domain_info *domain,
                               gid_t gid,
                               struct ldb_result **res)
+{
+    return sysdb_getgrgid_with_views_ex(mem_ctx, domain, gid, true, res);
+}
+
+int sysdb_getgrgid_with_views_ex(TALLOC_CTX *mem_ctx,
+                                 struct sss_domain_info *domain,
+                                 gid_t gid,
+                                 bool with_members,
+                                 struct ldb_result **res)
 {
     TALLOC_CTX *tmp_ctx;
     int ret;
     struct ldb_result *orig_obj = NULL;
     struct ldb_result *override_obj = NULL;
     struct ldb_message_element *el;
+    static const char *header_attrs[] = SYSDB_GRSRC_HEADER_ATTRS;
+    const char **attrs;
 
     tmp_ctx = talloc_new(NULL);
     if (!tmp_ctx) {
         return ENOMEM;
     }
 
+    attrs = with_members ? SYSDB_GRSRC_ATTRS(domain) : header_attrs;
+
     /* If there are views we first have to search the overrides for matches */
     if (DOM_HAS_VIEWS(domain)) {
-        ret = sysdb_search_group_override_by_gid(tmp_ctx, domain, gid,
-                                                 &override_obj, &orig_obj);
+        ret = sysdb_search_group_override_attrs_by_gid(tmp_ctx, domain, gid,
+                                                       attrs, &override_obj,
+                                                       &orig_obj);
         if (ret != EOK && ret != ENOENT) {
             DEBUG(SSSDBG_OP_FAILURE,
                   "sysdb_search_group_override_by_gid failed.\n");
@@ -1310,7 +1462,8 @@ int sysdb_getgrgid_with_views(TALLOC_CTX *mem_ctx,
     /* If there are no views or nothing was found in the overrides the
      * original objects are searched. */
     if (orig_obj == NULL) {
-        ret = sysdb_getgrgid(tmp_ctx, domain, gid, &orig_obj);
+        ret = sysdb_getgrgid_internal(tmp_ctx, domain, gid, attrs, NULL,
+                                      &orig_obj);
         if (ret != EOK) {
             DEBUG(SSSDBG_OP_FAILURE, "sysdb_getgrgid failed.\n");
             goto done;
@@ -1344,11 +1497,13 @@ int sysdb_getgrgid_with_views(TALLOC_CTX *mem_ctx,
 
         /* Must be called even without views to check to
          * SYSDB_DEFAULT_OVERRIDE_NAME */
-        ret = sysdb_add_group_member_overrides(domain, orig_obj->msgs[0]);
-        if (ret != EOK) {
-            DEBUG(SSSDBG_OP_FAILURE,
-                  "sysdb_add_group_member_overrides failed.\n");
-            goto done;
+        if (with_members) {
+            ret = sysdb_add_group_member_overrides(domain, orig_obj->msgs[0]);
+            if (ret != EOK) {
+                DEBUG(SSSDBG_OP_FAILURE,
+                      "sysdb_add_group_member_overrides failed.\n");
+                goto done;
+            }
         }
     }
 
@@ -1371,11 +1526,12 @@ done:
     return ret;
 }
 
-int sysdb_getgrgid_attrs(TALLOC_CTX *mem_ctx,
-                         struct sss_domain_info *domain,
-                         gid_t gid,
-                         const char **additional_attrs,
-                         struct ldb_result **_res)
+static int sysdb_getgrgid_internal(TALLOC_CTX *mem_ctx,
+                                   struct sss_domain_info *domain,
+                                   gid_t gid,
+                                   const char **default_attrs,
+                                   const char **additional_attrs,
+                                   struct ldb_result **_res)
 {
     TALLOC_CTX *tmp_ctx;
     unsigned long int ul_gid = gid;
@@ -1384,7 +1540,6 @@ int sysdb_getgrgid_attrs(TALLOC_CTX *mem_ctx,
     struct ldb_dn *base_dn;
     struct ldb_result *res = NULL;
     int ret;
-    const char **default_attrs = SYSDB_GRSRC_ATTRS(domain);
     const char **attrs = NULL;
 
     tmp_ctx = talloc_new(NULL);
@@ -1419,8 +1574,9 @@ int sysdb_getgrgid_attrs(TALLOC_CTX *mem_ctx,
             goto done;
         }
 
-        ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
-                         LDB_SCOPE_SUBTREE, attrs, fmt_filter, ul_gid, ul_gid, ul_gid);
+        ret = sysdb_ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
+                               LDB_SCOPE_SUBTREE, attrs, fmt_filter,
+                               ul_gid, ul_gid, ul_gid);
         if (ret != EOK) {
             ret = sysdb_error_to_errno(ret);
             goto done;
@@ -1439,6 +1595,13 @@ int sysdb_getgrgid_attrs(TALLOC_CTX *mem_ctx,
     } else {
         fmt_filter = SYSDB_GRGID_FILTER;
         base_dn = sysdb_group_base_dn(tmp_ctx, domain);
+
+        ret = sysdb_snapshot_search_id(tmp_ctx, domain,
+                                       SYSDB_SNAPSHOT_GROUP_GID,
+                                       ul_gid, attrs, &res);
+        if (ret != EOK && ret != ENOENT) {
+            goto done;
+        }
     }
     if (base_dn == NULL) {
         ret = ENOMEM;
@@ -1449,8 +1612,8 @@ int sysdb_getgrgid_attrs(TALLOC_CTX *mem_ctx,
      * it's a MPG and we're dealing with a overridden group, which has to
      * use the very same filter as a non MPG domain. */
     if (res == NULL) {
-        ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
-                         LDB_SCOPE_SUBTREE, attrs, fmt_filter, ul_gid);
+        ret = sysdb_ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
+                               LDB_SCOPE_SUBTREE, attrs, fmt_filter, ul_gid);
         if (ret != EOK) {
             ret = sysdb_error_to_errno(ret);
             goto done;
@@ -1475,6 +1638,17 @@ done:
     return ret;
 }
 
+int sysdb_getgrgid_attrs(TALLOC_CTX *mem_ctx,
+                         struct sss_domain_info *domain,
+                         gid_t gid,
+                         const char **additional_attrs,
+                         struct ldb_result **_res)
+{
+    return sysdb_getgrgid_internal(mem_ctx, domain, gid,
+                                   SYSDB_GRSRC_ATTRS(domain),
+                                   additional_attrs, _res);
+}
+
 int sysdb_getgrgid(TALLOC_CTX *mem_ctx,
                    struct sss_domain_info *domain,
                    gid_t gid,
@@ -1562,8 +1736,8 @@ int sysdb_enumgrent_filter(TALLOC_CTX *mem_ctx,
     }
     DEBUG(SSSDBG_TRACE_LIBS, "Searching cache with [%s]\n", filter);
 
-    lret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
-                      LDB_SCOPE_SUBTREE, attrs, "%s", filter);
+    lret = sysdb_ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
+                            LDB_SCOPE_SUBTREE, attrs, "%s", filter);
     if (lret != LDB_SUCCESS) {
         ret = sysdb_error_to_errno(lret);
         goto done;
@@ -1968,10 +2142,10 @@ int sysdb_get_user_attr(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
-                     LDB_SCOPE_SUBTREE, attributes,
-                     SYSDB_PWNAM_FILTER, lc_sanitized_name, sanitized_name,
-                     sanitized_name);
+    ret = sysdb_ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
+                           LDB_SCOPE_SUBTREE, attributes,
+                           SYSDB_PWNAM_FILTER, lc_sanitized_name,
+                           sanitized_name, sanitized_name);
     if (ret) {
         ret = sysdb_error_to_errno(ret);
         goto done;
@@ -2413,12 +2587,12 @@ int sysdb_get_netgroup_attr(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &result, base_dn,
-                     LDB_SCOPE_SUBTREE, attributes,
-                     SYSDB_NETGR_FILTER,
-                     lc_sanitized_netgroup,
-                     sanitized_netgroup,
-                     sanitized_netgroup);
+    ret = sysdb_ldb_search(domain->sysdb->ldb, tmp_ctx, &result, base_dn,
+                           LDB_SCOPE_SUBTREE, attributes,
+                           SYSDB_NETGR_FILTER,
+                           lc_sanitized_netgroup,
+                           sanitized_netgroup,
+                           sanitized_netgroup);
     if (ret) {
         ret = sysdb_error_to_errno(ret);
         goto done;
@@ -0,0 +1,739 @@
+/*
+   SSSD
+
+   System Database - search instrumentation
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <dirent.h>
+#include <dhash.h>
+
+#include "util/util.h"
+#include "util/probes.h"
+#include "db/sysdb_private.h"
+
+/* Searches are instrumented per ldb context, so the cache and the
+ * timestamp cache of a domain are reported separately. The state is
+ * attached to the ldb context because many internal callers only have
+ * that at hand. */
+#define SYSDB_SEARCH_STATS_OPAQUE "sssd_sysdb_search_stats"
+
+/* Unindexed searches that take at least this long are recorded as index
+ * candidates, faster ones are not worth an index. */
+#define SYSDB_INDEX_CANDIDATE_USEC 5000
+
+/* How often the index list is re-read and the candidates are saved */
+#define SYSDB_SEARCH_STATS_INTERVAL 60
+
+/* Each process saves the candidates it recorded since it started into
+ * <cache file>.idxstats.<process name>, one line per attribute with the
+ * number of searches and the time they took. */
+#define SYSDB_INDEX_STATS_SUFFIX ".idxstats."
+
+struct sysdb_index_candidate {
+    uint64_t count;
+    uint64_t usec;
+};
+
+struct sysdb_search_stats {
+    const char *db_name;
+    uint64_t slow_usec;
+    struct sysdb_search_counters counters;
+
+    /* Indexed attributes, read on first use */
+    const char **indexes;
+    time_t indexes_read;
+
+    /* Attributes of unindexed equality filters */
+    const char *stats_file;
+    hash_table_t *candidates;
+    time_t saved;
+    bool dirty;
+};
+
+static void *sysdb_search_stats_hash_alloc(const size_t size, void *pvt)
+{
+    return talloc_size(pvt, size);
+}
+
+static void sysdb_search_stats_hash_free(void *ptr, void *pvt)
+{
+    talloc_free(ptr);
+}
+
+static char *sysdb_index_stats_file(TALLOC_CTX *mem_ctx,
+                                    const char *ldb_file)
+{
+    char *path;
+    char *p;
+
+    path = talloc_asprintf(mem_ctx, "%s" SYSDB_INDEX_STATS_SUFFIX "%s",
+                           ldb_file, debug_prg_name);
+    if (path == NULL) {
+        return NULL;
+    }
+
+    /* the process name may contain the domain name in brackets */
+    for (p = path + strlen(ldb_file) + strlen(SYSDB_INDEX_STATS_SUFFIX);
+         *p != '\0'; p++) {
+        if (!isalnum(*p) && *p != '-' && *p != '_' && *p != '.') {
+            *p = '_';
+        }
+    }
+
+    return path;
+}
+
+static struct sysdb_search_stats *
+sysdb_search_stats_get(struct ldb_context *ldb)
+{
+    return talloc_get_type(ldb_get_opaque(ldb, SYSDB_SEARCH_STATS_OPAQUE),
+                           struct sysdb_search_stats);
+}
+
+errno_t sysdb_search_stats_init(struct ldb_context *ldb,
+                                const char *ldb_file,
+                                const char *db_name,
+                                uint64_t slow_usec)
+{
+    struct sysdb_search_stats *old_stats;
+    struct sysdb_search_stats *stats;
+    int ret;
+
+    stats = talloc_zero(ldb, struct sysdb_search_stats);
+    if (stats == NULL) {
+        return ENOMEM;
+    }
+
+    stats->db_name = talloc_strdup(stats, db_name);
+    if (stats->db_name == NULL) {
+        talloc_free(stats);
+        return ENOMEM;
+    }
+    stats->slow_usec = slow_usec;
+
+    if (ldb_file != NULL) {
+        stats->stats_file = sysdb_index_stats_file(stats, ldb_file);
+        if (stats->stats_file == NULL) {
+            talloc_free(stats);
+            return ENOMEM;
+        }
+
+        ret = hash_create_ex(0, &stats->candidates, 0, 0, 0, 0,
+                             sysdb_search_stats_hash_alloc,
+                             sysdb_search_stats_hash_free,
+                             stats, NULL, NULL);
+        if (ret != HASH_SUCCESS) {
+            talloc_free(stats);
+            return ENOMEM;
+        }
+    }
+
+    old_stats = sysdb_search_stats_get(ldb);
+
+    ret = ldb_set_opaque(ldb, SYSDB_SEARCH_STATS_OPAQUE, stats);
+    if (ret != LDB_SUCCESS) {
+        talloc_free(stats);
+        return sysdb_error_to_errno(ret);
+    }
+
+    /* the counters start again when the statistics are initialized twice */
+    talloc_free(old_stats);
+
+    return EOK;
+}
+
+errno_t sysdb_search_stats_get_counters(struct ldb_context *ldb,
+                                        struct sysdb_search_counters *_counters)
+{
+    struct sysdb_search_stats *stats;
+
+    stats = sysdb_search_stats_get(ldb);
+    if (stats == NULL) {
+        return ENOENT;
+    }
+
+    *_counters = stats->counters;
+    return EOK;
+}
+
+void sysdb_search_stats_reset_indexes(struct ldb_context *ldb)
+{
+    struct sysdb_search_stats *stats;
+
+    stats = sysdb_search_stats_get(ldb);
+    if (stats != NULL) {
+        talloc_zfree(stats->indexes);
+    }
+}
+
+static const char **
+sysdb_search_stats_indexes(struct ldb_context *ldb,
+                           struct sysdb_search_stats *stats)
+{
+    TALLOC_CTX *tmp_ctx;
+    const char **indexes;
+    errno_t ret;
+
+    if (stats->indexes != NULL) {
+        /* indexes can be added by sssctl while SSSD is running */
+        if (time(NULL) - stats->indexes_read < SYSDB_SEARCH_STATS_INTERVAL) {
+            return stats->indexes;
+        }
+        talloc_zfree(stats->indexes);
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return NULL;
+    }
+
+    ret = sysdb_ldb_list_indexes(tmp_ctx, ldb, NULL, &indexes);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Cannot read the index list of the %s [%d]: %s\n",
+              stats->db_name, ret, sss_strerror(ret));
+        /* Report searches as unindexed rather than retrying every time */
+        indexes = talloc_zero_array(tmp_ctx, const char *, 1);
+        if (indexes == NULL) {
+            talloc_free(tmp_ctx);
+            return NULL;
+        }
+    }
+
+    stats->indexes = talloc_steal(stats, indexes);
+    stats->indexes_read = time(NULL);
+    talloc_free(tmp_ctx);
+    return stats->indexes;
+}
+
+static bool sysdb_search_attr_indexed(const char **indexes, const char *attr)
+{
+    int i;
+
+    if (strcasecmp(attr, "dn") == 0
+            || strcasecmp(attr, "distinguishedName") == 0) {
+        return true;
+    }
+
+    for (i = 0; indexes[i] != NULL; i++) {
+        if (strcasecmp(indexes[i], attr) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Follows the rules ldb applies when it picks an index: an AND is served
+ * by any indexed branch, an OR only if all of its branches are indexed
+ * and only equality matches can be looked up in an index. */
+static bool sysdb_search_tree_indexed(const char **indexes,
+                                      struct ldb_parse_tree *tree)
+{
+    unsigned int i;
+
+    switch (tree->operation) {
+    case LDB_OP_EQUALITY:
+        return sysdb_search_attr_indexed(indexes, tree->u.equality.attr);
+    case LDB_OP_AND:
+        for (i = 0; i < tree->u.list.num_elements; i++) {
+            if (sysdb_search_tree_indexed(indexes,
+                                          tree->u.list.elements[i])) {
+                return true;
+            }
+        }
+        return false;
+    case LDB_OP_OR:
+        if (tree->u.list.num_elements == 0) {
+            return false;
+        }
+        for (i = 0; i < tree->u.list.num_elements; i++) {
+            if (!sysdb_search_tree_indexed(indexes,
+                                           tree->u.list.elements[i])) {
+                return false;
+            }
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool sysdb_search_is_indexed(struct ldb_context *ldb,
+                                    enum ldb_scope scope,
+                                    const char *filter)
+{
+    struct sysdb_search_stats *stats;
+    struct ldb_parse_tree *tree;
+    const char **indexes;
+    bool indexed;
+
+    if (scope == LDB_SCOPE_BASE) {
+        /* the entry is read by its key */
+        return true;
+    }
+
+    if (filter == NULL) {
+        return false;
+    }
+
+    stats = sysdb_search_stats_get(ldb);
+    if (stats == NULL) {
+        return false;
+    }
+
+    indexes = sysdb_search_stats_indexes(ldb, stats);
+    if (indexes == NULL) {
+        return false;
+    }
+
+    tree = ldb_parse_tree(NULL, filter);
+    if (tree == NULL) {
+        return false;
+    }
+
+    indexed = sysdb_search_tree_indexed(indexes, tree);
+    talloc_free(tree);
+
+    return indexed;
+}
+
+static void sysdb_index_candidate_add(struct sysdb_search_stats *stats,
+                                      const char *attr,
+                                      uint64_t usec)
+{
+    struct sysdb_index_candidate *candidate;
+    hash_value_t value;
+    hash_key_t key;
+    int ret;
+
+    key.type = HASH_KEY_STRING;
+    key.str = discard_const(attr);
+
+    ret = hash_lookup(stats->candidates, &key, &value);
+    if (ret == HASH_SUCCESS) {
+        candidate = value.ptr;
+    } else {
+        candidate = talloc_zero(stats, struct sysdb_index_candidate);
+        if (candidate == NULL) {
+            return;
+        }
+
+        value.type = HASH_VALUE_PTR;
+        value.ptr = candidate;
+        ret = hash_enter(stats->candidates, &key, &value);
+        if (ret != HASH_SUCCESS) {
+            talloc_free(candidate);
+            return;
+        }
+    }
+
+    candidate->count++;
+    candidate->usec += usec;
+    stats->dirty = true;
+}
+
+/* Records the attributes whose index would have served the search */
+static void sysdb_index_candidates_record(struct sysdb_search_stats *stats,
+                                          const char **indexes,
+                                          struct ldb_parse_tree *tree,
+                                          uint64_t usec)
+{
+    unsigned int i;
+
+    switch (tree->operation) {
+    case LDB_OP_EQUALITY:
+        if (!sysdb_search_attr_indexed(indexes, tree->u.equality.attr)) {
+            sysdb_index_candidate_add(stats, tree->u.equality.attr, usec);
+        }
+        break;
+    case LDB_OP_AND:
+    case LDB_OP_OR:
+        for (i = 0; i < tree->u.list.num_elements; i++) {
+            sysdb_index_candidates_record(stats, indexes,
+                                          tree->u.list.elements[i], usec);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void sysdb_index_candidates_save(struct sysdb_search_stats *stats)
+{
+    hash_entry_t *entries = NULL;
+    struct sysdb_index_candidate *candidate;
+    unsigned long count;
+    char *tmp_path = NULL;
+    char *data = NULL;
+    unsigned long i;
+    ssize_t written;
+    int fd = -1;
+    int ret;
+
+    ret = hash_entries(stats->candidates, &count, &entries);
+    if (ret != HASH_SUCCESS) {
+        return;
+    }
+
+    data = talloc_strdup(stats, "");
+    for (i = 0; i < count && data != NULL; i++) {
+        candidate = entries[i].value.ptr;
+        data = talloc_asprintf_append(data, "%s %"PRIu64" %"PRIu64"\n",
+                                      entries[i].key.str,
+                                      candidate->count, candidate->usec);
+    }
+    if (data == NULL) {
+        goto done;
+    }
+
+    tmp_path = talloc_asprintf(stats, "%s.XXXXXX", stats->stats_file);
+    if (tmp_path == NULL) {
+        goto done;
+    }
+
+    fd = mkstemp(tmp_path);
+    if (fd == -1) {
+        ret = errno;
+        DEBUG(SSSDBG_MINOR_FAILURE, "Cannot create [%s] [%d]: %s\n",
+              tmp_path, ret, sss_strerror(ret));
+        talloc_zfree(tmp_path);
+        goto done;
+    }
+
+    written = sss_atomic_write_s(fd, data, strlen(data));
+    if (written == -1 || (size_t) written != strlen(data)) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Cannot write [%s]\n", tmp_path);
+        goto done;
+    }
+
+    ret = close(fd);
+    fd = -1;
+    if (ret != 0) {
+        goto done;
+    }
+
+    ret = rename(tmp_path, stats->stats_file);
+    if (ret != 0) {
+        ret = errno;
+        DEBUG(SSSDBG_MINOR_FAILURE, "Cannot rename [%s] to [%s] [%d]: %s\n",
+              tmp_path, stats->stats_file, ret, sss_strerror(ret));
+        goto done;
+    }
+    talloc_zfree(tmp_path);
+
+    stats->dirty = false;
+
+done:
+    if (fd != -1) {
+        close(fd);
+    }
+    if (tmp_path != NULL) {
+        unlink(tmp_path);
+        talloc_free(tmp_path);
+    }
+    talloc_free(data);
+    talloc_free(entries);
+}
+
+static void sysdb_index_candidates_update(struct ldb_context *ldb,
+                                          struct sysdb_search_stats *stats,
+                                          enum ldb_scope scope,
+                                          const char *filter,
+                                          uint64_t usec)
+{
+    struct ldb_parse_tree *tree;
+    const char **indexes;
+    time_t now;
+
+    if (stats->candidates == NULL) {
+        return;
+    }
+
+    if (scope != LDB_SCOPE_BASE && filter != NULL
+            && usec >= SYSDB_INDEX_CANDIDATE_USEC) {
+        indexes = sysdb_search_stats_indexes(ldb, stats);
+        tree = indexes == NULL ? NULL : ldb_parse_tree(NULL, filter);
+        if (tree != NULL) {
+            if (!sysdb_search_tree_indexed(indexes, tree)) {
+                sysdb_index_candidates_record(stats, indexes, tree, usec);
+            }
+            talloc_free(tree);
+        }
+    }
+
+    now = time(NULL);
+    if (stats->dirty && now - stats->saved >= SYSDB_SEARCH_STATS_INTERVAL) {
+        stats->saved = now;
+        sysdb_index_candidates_save(stats);
+    }
+}
+
+int sysdb_ldb_search(struct ldb_context *ldb,
+                     TALLOC_CTX *mem_ctx,
+                     struct ldb_result **_res,
+                     struct ldb_dn *base,
+                     enum ldb_scope scope,
+                     const char * const *attrs,
+                     const char *exp_fmt, ...)
+{
+    struct sysdb_search_stats *stats;
+    struct ldb_result *res = NULL;
+    const char *base_str;
+    char *filter = NULL;
+    uint64_t start_time;
+    uint64_t spent;
+    unsigned int count;
+    va_list ap;
+    int ret;
+
+    if (exp_fmt != NULL) {
+        va_start(ap, exp_fmt);
+        filter = talloc_vasprintf(NULL, exp_fmt, ap);
+        va_end(ap);
+        if (filter == NULL) {
+            return LDB_ERR_OPERATIONS_ERROR;
+        }
+    }
+
+    base_str = base == NULL ? NULL : ldb_dn_get_linearized(base);
+
+    PROBE(SYSDB_SEARCH_START, PROBE_SAFE_STR(base_str), scope,
+          PROBE_SAFE_STR(filter));
+    start_time = get_start_time();
+
+    ret = ldb_search(ldb, mem_ctx, &res, base, scope, attrs,
+                     filter == NULL ? NULL : "%s", filter);
+
+    spent = get_spend_time_us(start_time);
+    count = (ret == LDB_SUCCESS && res != NULL) ? res->count : 0;
+
+    PROBE(SYSDB_SEARCH_END, PROBE_SAFE_STR(base_str), scope,
+          PROBE_SAFE_STR(filter), count,
+          sysdb_search_is_indexed(ldb, scope, filter), ret);
+
+    stats = sysdb_search_stats_get(ldb);
+    if (stats != NULL) {
+        stats->counters.searches++;
+        stats->counters.entries += count;
+        stats->counters.usec += spent;
+        if (ret != LDB_SUCCESS) {
+            stats->counters.errors++;
+        }
+    }
+
+    if (stats != NULL && stats->slow_usec > 0 && spent >= stats->slow_usec) {
+        stats->counters.slow_searches++;
+        DEBUG(SSSDBG_IMPORTANT_INFO,
+              "Slow search in the %s took %s: base [%s] scope [%d] "
+              "filter [%s] returned %u entries, %s\n",
+              stats->db_name, sss_format_time(spent),
+              base_str == NULL ? "-" : base_str, scope,
+              filter == NULL ? "-" : filter, count,
+              sysdb_search_is_indexed(ldb, scope, filter) ?
+                    "indexed" : "not indexed");
+    }
+
+    if (stats != NULL && ret == LDB_SUCCESS) {
+        sysdb_index_candidates_update(ldb, stats, scope, filter, spent);
+    }
+
+    talloc_free(filter);
+    *_res = res;
+    return ret;
+}
+
+static errno_t sysdb_index_advice_add(TALLOC_CTX *mem_ctx,
+                                      struct sysdb_index_advice **_advice,
+                                      size_t *_count,
+                                      const char *attr,
+                                      uint64_t count,
+                                      uint64_t usec)
+{
+    struct sysdb_index_advice *advice = *_advice;
+    size_t i;
+
+    for (i = 0; i < *_count; i++) {
+        if (strcasecmp(advice[i].attr, attr) == 0) {
+            advice[i].count += count;
+            advice[i].usec += usec;
+            return EOK;
+        }
+    }
+
+    advice = talloc_realloc(mem_ctx, advice, struct sysdb_index_advice,
+                            *_count + 1);
+    if (advice == NULL) {
+        return ENOMEM;
+    }
+
+    advice[*_count].attr = talloc_strdup(advice, attr);
+    if (advice[*_count].attr == NULL) {
+        return ENOMEM;
+    }
+    advice[*_count].count = count;
+    advice[*_count].usec = usec;
+
+    *_advice = advice;
+    (*_count)++;
+    return EOK;
+}
+
+static errno_t sysdb_index_advice_read(TALLOC_CTX *mem_ctx,
+                                       const char *path,
+                                       struct sysdb_index_advice **_advice,
+                                       size_t *_count)
+{
+    char attr[256];
+    char line[512];
+    uint64_t count;
+    uint64_t usec;
+    errno_t ret;
+    FILE *f;
+
+    f = fopen(path, "r");
+    if (f == NULL) {
+        ret = errno;
+        DEBUG(SSSDBG_MINOR_FAILURE, "Cannot open [%s] [%d]: %s\n",
+              path, ret, sss_strerror(ret));
+        /* the file may have just been replaced */
+        return ret == ENOENT ? EOK : ret;
+    }
+
+    ret = EOK;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "%255s %"SCNu64" %"SCNu64,
+                   attr, &count, &usec) != 3) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "Skipping malformed line in [%s]\n",
+                  path);
+            continue;
+        }
+
+        ret = sysdb_index_advice_add(mem_ctx, _advice, _count,
+                                     attr, count, usec);
+        if (ret != EOK) {
+            break;
+        }
+    }
+
+    fclose(f);
+    return ret;
+}
+
+static int sysdb_index_advice_cmp(const void *a, const void *b)
+{
+    const struct sysdb_index_advice *x = a;
+    const struct sysdb_index_advice *y = b;
+
+    if (x->usec != y->usec) {
+        return x->usec < y->usec ? 1 : -1;
+    }
+
+    return strcasecmp(x->attr, y->attr);
+}
+
+errno_t sysdb_index_advise(TALLOC_CTX *mem_ctx,
+                           const char *ldb_file,
+                           struct sysdb_index_advice **_advice,
+                           size_t *_count)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct sysdb_index_advice *advice = NULL;
+    struct dirent *dent;
+    const char **indexes;
+    const char *base;
+    char *prefix;
+    char *dir;
+    char *path;
+    size_t count = 0;
+    size_t i, j;
+    DIR *d = NULL;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    base = strrchr(ldb_file, '/');
+    if (base == NULL) {
+        dir = talloc_strdup(tmp_ctx, ".");
+        base = ldb_file;
+    } else {
+        dir = talloc_strndup(tmp_ctx, ldb_file, base - ldb_file);
+        base++;
+    }
+    prefix = talloc_asprintf(tmp_ctx, "%s" SYSDB_INDEX_STATS_SUFFIX, base);
+    if (dir == NULL || prefix == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    d = opendir(dir);
+    if (d == NULL) {
+        ret = errno;
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot open [%s] [%d]: %s\n",
+              dir, ret, sss_strerror(ret));
+        goto done;
+    }
+
+    while ((dent = readdir(d)) != NULL) {
+        if (strncmp(dent->d_name, prefix, strlen(prefix)) != 0) {
+            continue;
+        }
+
+        path = talloc_asprintf(tmp_ctx, "%s/%s", dir, dent->d_name);
+        if (path == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        ret = sysdb_index_advice_read(tmp_ctx, path, &advice, &count);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    /* Drop the attributes that got indexed meanwhile */
+    if (count > 0) {
+        ret = sysdb_manage_index(tmp_ctx, SYSDB_IDX_LIST, ldb_file, NULL,
+                                 &indexes);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        for (i = 0, j = 0; i < count; i++) {
+            if (sysdb_search_attr_indexed(indexes, advice[i].attr)) {
+                continue;
+            }
+            advice[j++] = advice[i];
+        }
+        count = j;
+
+        qsort(advice, count, sizeof(*advice), sysdb_index_advice_cmp);
+    }
+
+    *_advice = talloc_steal(mem_ctx, advice);
+    *_count = count;
+    ret = EOK;
+
+done:
+    if (d != NULL) {
+        closedir(d);
+    }
+    talloc_free(tmp_ctx);
+    return ret;
+}
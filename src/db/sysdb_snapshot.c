@@ -0,0 +1,1341 @@
+/*
+   SSSD
+
+   System Database - read-only snapshot of users and groups
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* The backend periodically dumps the users and groups of the cache into a
+ * file which the responders map into memory. The most common lookups are
+ * then answered from the file with a hash lookup instead of an indexed ldb
+ * search which has to fetch and unpack the index and entry records.
+ *
+ * The snapshot carries the change stamp of the cache it was created from,
+ * the sequence number tdb keeps in the header of the cache file and
+ * increases with every committed change. Every lookup compares it with the
+ * stamp of the mapped cache file header, which is a plain memory read, so
+ * once the cache is modified by any process the snapshot is ignored and
+ * lookups go to ldb until a new one is published. The backend publishes a
+ * new snapshot shortly after it changed the cache, see
+ * sysdb_snapshot_publish_on_change(), and periodically. If the cache is not
+ * a tdb file the ldb sequence number is compared instead, which costs a
+ * read of the cache. The timestamp attributes are not taken from the
+ * snapshot, they are always merged from the timestamp cache.
+ *
+ * Layout of the file, all numbers are in host byte order:
+ *   struct sysdb_snapshot_header
+ *   uint32_t first slot of each bucket [num_buckets + 1]
+ *   struct sysdb_snapshot_slot [num_slots], ordered by bucket
+ *   data: keys and packed entries
+ *
+ * A key is the key type, the lower-cased domain name, a NUL byte and the
+ * value. A packed entry is the DN, the number of elements and for each
+ * element its name, the number of values and the values. Strings and
+ * values are prefixed with their length as uint32_t.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include "util/util.h"
+#include "shared/murmurhash3.h"
+#include "db/sysdb_private.h"
+
+#define SYSDB_SNAPSHOT_MAGIC 0x534e4150 /* SNAP */
+#define SYSDB_SNAPSHOT_VERSION 1
+#define SYSDB_SNAPSHOT_SEED 0x5e5510a1
+
+/* How often a new snapshot is looked for while there is no current one */
+#define SYSDB_SNAPSHOT_RECHECK_SEC 1
+
+/* ldb opens the cache tdb with TDB_SEQNUM, tdb then increases the sequence
+ * number in the file header on every change. Both are part of the tdb file
+ * format. */
+#define SYSDB_TDB_MAGIC "TDB file\n"
+#define SYSDB_TDB_SEQNUM_OFFSET 48
+
+struct sysdb_snapshot_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t seqnum;
+    uint64_t db_stamp;
+    uint64_t db_dev;
+    uint64_t db_ino;
+    uint32_t num_buckets;
+    uint32_t num_slots;
+    uint32_t buckets_offset;
+    uint32_t slots_offset;
+    uint32_t data_offset;
+    uint32_t size;
+};
+
+struct sysdb_snapshot_slot {
+    uint32_t hash;
+    uint32_t key_offset;
+    uint32_t key_len;
+    uint32_t entry_offset;
+};
+
+struct sysdb_snapshot {
+    uint8_t *addr;
+    size_t size;
+    dev_t dev;
+    ino_t ino;
+
+    const struct sysdb_snapshot_header *hdr;
+    const uint32_t *buckets;
+    const struct sysdb_snapshot_slot *slots;
+    const uint8_t *data;
+    size_t data_size;
+};
+
+struct sysdb_snapshot_stamp {
+    uint8_t *addr;
+    size_t size;
+};
+
+static char *sysdb_snapshot_path(TALLOC_CTX *mem_ctx, struct sysdb_ctx *sysdb)
+{
+    return talloc_asprintf(mem_ctx, "%s.snapshot", sysdb->ldb_file);
+}
+
+static int sysdb_snapshot_stamp_destructor(struct sysdb_snapshot_stamp *stamp)
+{
+    munmap(stamp->addr, stamp->size);
+    return 0;
+}
+
+/* Maps the header of the cache file, fails with ENOTSUP if the cache is
+ * not a tdb file */
+static errno_t sysdb_snapshot_stamp_map(struct sysdb_ctx *sysdb)
+{
+    struct sysdb_snapshot_stamp *stamp;
+    struct stat st;
+    void *addr;
+    size_t size;
+    errno_t ret;
+    int fd;
+
+    size = SYSDB_TDB_SEQNUM_OFFSET + sizeof(uint32_t);
+
+    fd = open(sysdb->ldb_file, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return errno;
+    }
+
+    ret = fstat(fd, &st);
+    if (ret != 0) {
+        ret = errno;
+        close(fd);
+        return ret;
+    }
+
+    if (st.st_size < (off_t)size) {
+        close(fd);
+        return ENOTSUP;
+    }
+
+    addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return errno;
+    }
+
+    if (memcmp(addr, SYSDB_TDB_MAGIC, sizeof(SYSDB_TDB_MAGIC) - 1) != 0) {
+        munmap(addr, size);
+        return ENOTSUP;
+    }
+
+    stamp = talloc_zero(sysdb, struct sysdb_snapshot_stamp);
+    if (stamp == NULL) {
+        munmap(addr, size);
+        return ENOMEM;
+    }
+    stamp->addr = addr;
+    stamp->size = size;
+    talloc_set_destructor(stamp, sysdb_snapshot_stamp_destructor);
+
+    sysdb->snapshot_stamp = stamp;
+    return EOK;
+}
+
+/* Reads the change stamp of the cache, the header is mapped on first use */
+static errno_t sysdb_snapshot_stamp_read(struct sysdb_ctx *sysdb,
+                                         uint64_t *_stamp)
+{
+    errno_t ret;
+
+    if (sysdb->snapshot_stamp == NULL) {
+        if (sysdb->snapshot_no_stamp) {
+            return ENOTSUP;
+        }
+
+        ret = sysdb_snapshot_stamp_map(sysdb);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_TRACE_FUNC,
+                  "Cannot map the header of [%s], comparing the sequence "
+                  "number instead [%d]: %s\n",
+                  sysdb->ldb_file, ret, sss_strerror(ret));
+            sysdb->snapshot_no_stamp = true;
+            return ENOTSUP;
+        }
+    }
+
+    *_stamp = *(volatile uint32_t *)(sysdb->snapshot_stamp->addr
+                                     + SYSDB_TDB_SEQNUM_OFFSET);
+    return EOK;
+}
+
+static char *sysdb_snapshot_key(TALLOC_CTX *mem_ctx,
+                                char type,
+                                const char *domain,
+                                size_t domain_len,
+                                const char *value,
+                                bool lowercase,
+                                size_t *_len)
+{
+    char *key;
+    size_t value_len;
+    size_t i;
+
+    value_len = strlen(value);
+    key = talloc_size(mem_ctx, domain_len + value_len + 3);
+    if (key == NULL) {
+        return NULL;
+    }
+
+    key[0] = type;
+    for (i = 0; i < domain_len; i++) {
+        key[i + 1] = tolower((unsigned char)domain[i]);
+    }
+    key[domain_len + 1] = '\0';
+
+    if (lowercase) {
+        value = sss_tc_utf8_str_tolower(key, value);
+        if (value == NULL) {
+            talloc_free(key);
+            return NULL;
+        }
+        value_len = strlen(value);
+    }
+    memcpy(key + domain_len + 2, value, value_len + 1);
+
+    *_len = domain_len + value_len + 2;
+    return key;
+}
+
+/* =Publish=============================================================== */
+
+struct sysdb_snapshot_buf {
+    uint8_t *data;
+    size_t len;
+    size_t alloc;
+};
+
+static errno_t sysdb_snapshot_buf_add(struct sysdb_snapshot_buf *buf,
+                                      const void *data,
+                                      size_t len)
+{
+    uint8_t *tmp;
+    size_t alloc;
+
+    if (buf->len + len > buf->alloc) {
+        alloc = MAX(buf->alloc * 2, buf->len + len);
+        tmp = talloc_realloc(NULL, buf->data, uint8_t, alloc);
+        if (tmp == NULL) {
+            return ENOMEM;
+        }
+        buf->data = tmp;
+        buf->alloc = alloc;
+    }
+
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+
+    return EOK;
+}
+
+static errno_t sysdb_snapshot_buf_add_u32(struct sysdb_snapshot_buf *buf,
+                                          uint32_t val)
+{
+    return sysdb_snapshot_buf_add(buf, &val, sizeof(val));
+}
+
+static errno_t sysdb_snapshot_buf_add_blob(struct sysdb_snapshot_buf *buf,
+                                           const void *data,
+                                           size_t len)
+{
+    errno_t ret;
+
+    if (len > UINT32_MAX) {
+        return EFBIG;
+    }
+
+    ret = sysdb_snapshot_buf_add_u32(buf, len);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    return sysdb_snapshot_buf_add(buf, data, len);
+}
+
+struct sysdb_snapshot_builder {
+    struct sysdb_snapshot_buf data;
+    struct sysdb_snapshot_slot *slots;
+    size_t num_slots;
+    size_t alloc_slots;
+};
+
+static errno_t sysdb_snapshot_pack_entry(struct sysdb_snapshot_buf *buf,
+                                         struct ldb_message *msg)
+{
+    struct ldb_message_element *el;
+    const char *dn;
+    unsigned int i;
+    unsigned int j;
+    errno_t ret;
+
+    dn = ldb_dn_get_linearized(msg->dn);
+    if (dn == NULL) {
+        return EINVAL;
+    }
+
+    ret = sysdb_snapshot_buf_add_blob(buf, dn, strlen(dn));
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = sysdb_snapshot_buf_add_u32(buf, msg->num_elements);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    for (i = 0; i < msg->num_elements; i++) {
+        el = &msg->elements[i];
+
+        ret = sysdb_snapshot_buf_add_blob(buf, el->name, strlen(el->name));
+        if (ret != EOK) {
+            return ret;
+        }
+
+        ret = sysdb_snapshot_buf_add_u32(buf, el->num_values);
+        if (ret != EOK) {
+            return ret;
+        }
+
+        for (j = 0; j < el->num_values; j++) {
+            ret = sysdb_snapshot_buf_add_blob(buf, el->values[j].data,
+                                              el->values[j].length);
+            if (ret != EOK) {
+                return ret;
+            }
+        }
+    }
+
+    return EOK;
+}
+
+static errno_t sysdb_snapshot_add_keys(TALLOC_CTX *mem_ctx,
+                                       struct sysdb_snapshot_builder *builder,
+                                       char type,
+                                       const struct ldb_val *domain,
+                                       struct ldb_message *msg,
+                                       const char *attr,
+                                       bool lowercase,
+                                       uint32_t entry_offset)
+{
+    struct ldb_message_element *el;
+    struct sysdb_snapshot_slot *slot;
+    size_t alloc;
+    size_t len;
+    char *key;
+    unsigned int i;
+    errno_t ret;
+
+    el = ldb_msg_find_element(msg, attr);
+    if (el == NULL) {
+        return EOK;
+    }
+
+    for (i = 0; i < el->num_values; i++) {
+        key = sysdb_snapshot_key(mem_ctx, type,
+                                 (const char *)domain->data, domain->length,
+                                 (const char *)el->values[i].data,
+                                 lowercase, &len);
+        if (key == NULL) {
+            return ENOMEM;
+        }
+
+        if (builder->num_slots == builder->alloc_slots) {
+            alloc = MAX(builder->alloc_slots * 2, 64);
+            slot = talloc_realloc(mem_ctx, builder->slots,
+                                  struct sysdb_snapshot_slot, alloc);
+            if (slot == NULL) {
+                return ENOMEM;
+            }
+            builder->slots = slot;
+            builder->alloc_slots = alloc;
+        }
+
+        slot = &builder->slots[builder->num_slots];
+        slot->hash = murmurhash3(key, len, SYSDB_SNAPSHOT_SEED);
+        slot->key_offset = builder->data.len;
+        slot->key_len = len;
+        slot->entry_offset = entry_offset;
+
+        ret = sysdb_snapshot_buf_add(&builder->data, key, len);
+        talloc_free(key);
+        if (ret != EOK) {
+            return ret;
+        }
+
+        builder->num_slots++;
+    }
+
+    return EOK;
+}
+
+static errno_t sysdb_snapshot_add_entry(TALLOC_CTX *mem_ctx,
+                                        struct sysdb_snapshot_builder *builder,
+                                        struct ldb_message *msg)
+{
+    const struct ldb_val *domain;
+    const char *category;
+    uint32_t entry_offset;
+    bool is_user;
+    int comp_num;
+    errno_t ret;
+
+    /* name=...,cn=users|groups,cn=<domain>,cn=sysdb */
+    comp_num = ldb_dn_get_comp_num(msg->dn);
+    if (comp_num < 4) {
+        return EOK;
+    }
+
+    domain = ldb_dn_get_component_val(msg->dn, comp_num - 2);
+    if (domain == NULL) {
+        return EOK;
+    }
+
+    category = ldb_msg_find_attr_as_string(msg, SYSDB_OBJECTCATEGORY, NULL);
+    if (category == NULL) {
+        return EOK;
+    }
+    is_user = (strcasecmp(category, SYSDB_USER_CLASS) == 0);
+
+    if (builder->data.len > UINT32_MAX) {
+        return EFBIG;
+    }
+    entry_offset = builder->data.len;
+
+    ret = sysdb_snapshot_pack_entry(&builder->data, msg);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = sysdb_snapshot_add_keys(mem_ctx, builder, SYSDB_SNAPSHOT_SID,
+                                  domain, msg, SYSDB_SID_STR, false,
+                                  entry_offset);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    if (is_user) {
+        ret = sysdb_snapshot_add_keys(mem_ctx, builder,
+                                      SYSDB_SNAPSHOT_USER_NAME,
+                                      domain, msg, SYSDB_NAME, false,
+                                      entry_offset);
+        if (ret != EOK) {
+            return ret;
+        }
+
+        ret = sysdb_snapshot_add_keys(mem_ctx, builder,
+                                      SYSDB_SNAPSHOT_USER_ALIAS,
+                                      domain, msg, SYSDB_NAME_ALIAS, false,
+                                      entry_offset);
+        if (ret != EOK) {
+            return ret;
+        }
+
+        ret = sysdb_snapshot_add_keys(mem_ctx, builder,
+                                      SYSDB_SNAPSHOT_USER_UID,
+                                      domain, msg, SYSDB_UIDNUM, false,
+                                      entry_offset);
+        if (ret != EOK) {
+            return ret;
+        }
+
+        /* Matched case-insensitively by ldb */
+        ret = sysdb_snapshot_add_keys(mem_ctx, builder,
+                                      SYSDB_SNAPSHOT_USER_UPN,
+                                      domain, msg, SYSDB_UPN, true,
+                                      entry_offset);
+        if (ret != EOK) {
+            return ret;
+        }
+
+        ret = sysdb_snapshot_add_keys(mem_ctx, builder,
+                                      SYSDB_SNAPSHOT_USER_UPN,
+                                      domain, msg, SYSDB_CANONICAL_UPN, true,
+                                      entry_offset);
+        if (ret != EOK) {
+            return ret;
+        }
+
+        ret = sysdb_snapshot_add_keys(mem_ctx, builder,
+                                      SYSDB_SNAPSHOT_USER_UPN,
+                                      domain, msg, SYSDB_USER_EMAIL, true,
+                                      entry_offset);
+        if (ret != EOK) {
+            return ret;
+        }
+    } else {
+        ret = sysdb_snapshot_add_keys(mem_ctx, builder,
+                                      SYSDB_SNAPSHOT_GROUP_NAME,
+                                      domain, msg, SYSDB_NAME, false,
+                                      entry_offset);
+        if (ret != EOK) {
+            return ret;
+        }
+
+        ret = sysdb_snapshot_add_keys(mem_ctx, builder,
+                                      SYSDB_SNAPSHOT_GROUP_ALIAS,
+                                      domain, msg, SYSDB_NAME_ALIAS, false,
+                                      entry_offset);
+        if (ret != EOK) {
+            return ret;
+        }
+
+        ret = sysdb_snapshot_add_keys(mem_ctx, builder,
+                                      SYSDB_SNAPSHOT_GROUP_GID,
+                                      domain, msg, SYSDB_GIDNUM, false,
+                                      entry_offset);
+        if (ret != EOK) {
+            return ret;
+        }
+    }
+
+    return EOK;
+}
+
+static errno_t sysdb_snapshot_write_all(int fd, void *data, size_t len)
+{
+    ssize_t written;
+
+    written = sss_atomic_write_s(fd, data, len);
+    if (written == -1) {
+        return errno;
+    }
+
+    if (written != len) {
+        return EIO;
+    }
+
+    return EOK;
+}
+
+static errno_t sysdb_snapshot_write(TALLOC_CTX *mem_ctx,
+                                    const char *path,
+                                    struct sysdb_snapshot_header *hdr,
+                                    struct sysdb_snapshot_builder *builder)
+{
+    struct sysdb_snapshot_slot *slots;
+    uint32_t *buckets;
+    uint32_t *next;
+    uint32_t b;
+    size_t size;
+    size_t i;
+    char *tmp_path = NULL;
+    int fd = -1;
+    errno_t ret;
+
+    hdr->num_slots = builder->num_slots;
+    hdr->num_buckets = MAX(builder->num_slots, 1);
+
+    /* Order the slots by bucket */
+    buckets = talloc_zero_array(mem_ctx, uint32_t, hdr->num_buckets + 1);
+    next = talloc_zero_array(mem_ctx, uint32_t, hdr->num_buckets);
+    slots = talloc_array(mem_ctx, struct sysdb_snapshot_slot,
+                         MAX(builder->num_slots, 1));
+    if (buckets == NULL || next == NULL || slots == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (i = 0; i < builder->num_slots; i++) {
+        buckets[builder->slots[i].hash % hdr->num_buckets + 1]++;
+    }
+
+    for (b = 0; b < hdr->num_buckets; b++) {
+        buckets[b + 1] += buckets[b];
+        next[b] = buckets[b];
+    }
+
+    for (i = 0; i < builder->num_slots; i++) {
+        b = builder->slots[i].hash % hdr->num_buckets;
+        slots[next[b]++] = builder->slots[i];
+    }
+
+    hdr->buckets_offset = sizeof(struct sysdb_snapshot_header);
+    hdr->slots_offset = hdr->buckets_offset
+                            + (hdr->num_buckets + 1) * sizeof(uint32_t);
+    hdr->data_offset = hdr->slots_offset
+                            + hdr->num_slots * sizeof(struct sysdb_snapshot_slot);
+    size = (size_t)hdr->data_offset + builder->data.len;
+    if (size > UINT32_MAX) {
+        DEBUG(SSSDBG_OP_FAILURE, "The cache is too big for a snapshot\n");
+        ret = EFBIG;
+        goto done;
+    }
+    hdr->size = size;
+
+    tmp_path = talloc_asprintf(mem_ctx, "%s.XXXXXX", path);
+    if (tmp_path == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    fd = mkstemp(tmp_path);
+    if (fd == -1) {
+        ret = errno;
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot create [%s] [%d]: %s\n",
+              tmp_path, ret, sss_strerror(ret));
+        talloc_zfree(tmp_path);
+        goto done;
+    }
+
+    ret = sysdb_snapshot_write_all(fd, hdr, sizeof(*hdr));
+    if (ret == EOK) {
+        ret = sysdb_snapshot_write_all(fd, buckets,
+                                  (hdr->num_buckets + 1) * sizeof(uint32_t));
+    }
+    if (ret == EOK) {
+        ret = sysdb_snapshot_write_all(fd, slots,
+                                       hdr->num_slots * sizeof(*slots));
+    }
+    if (ret == EOK) {
+        ret = sysdb_snapshot_write_all(fd, builder->data.data,
+                                       builder->data.len);
+    }
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot write [%s] [%d]: %s\n",
+              tmp_path, ret, sss_strerror(ret));
+        goto done;
+    }
+
+    ret = close(fd);
+    fd = -1;
+    if (ret != 0) {
+        ret = errno;
+        goto done;
+    }
+
+    ret = rename(tmp_path, path);
+    if (ret != 0) {
+        ret = errno;
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot rename [%s] to [%s] [%d]: %s\n",
+              tmp_path, path, ret, sss_strerror(ret));
+        goto done;
+    }
+    talloc_zfree(tmp_path);
+
+    ret = EOK;
+
+done:
+    if (fd != -1) {
+        close(fd);
+    }
+    if (tmp_path != NULL) {
+        unlink(tmp_path);
+    }
+    talloc_free(buckets);
+    talloc_free(next);
+    talloc_free(slots);
+    return ret;
+}
+
+errno_t sysdb_snapshot_publish(struct sysdb_ctx *sysdb)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct sysdb_snapshot_header hdr = { 0 };
+    struct sysdb_snapshot_builder builder = { { 0 } };
+    struct ldb_result *res;
+    struct ldb_dn *base_dn;
+    struct stat st;
+    uint64_t seqnum;
+    bool in_transaction = false;
+    const char *path;
+    unsigned int i;
+    errno_t sret;
+    errno_t ret;
+    int lret;
+
+    if (sysdb->transaction_nesting > 0) {
+        /* Try again next time */
+        return EOK;
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    path = sysdb_snapshot_path(tmp_ctx, sysdb);
+    base_dn = ldb_dn_new(tmp_ctx, sysdb->ldb, SYSDB_BASE);
+    if (path == NULL || base_dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    /* Nobody can write to the cache until the snapshot is in place,
+     * otherwise it could carry the sequence number of data it does not
+     * contain. */
+    ret = sysdb_transaction_start(sysdb);
+    if (ret != EOK) {
+        goto done;
+    }
+    in_transaction = true;
+
+    lret = ldb_sequence_number(sysdb->ldb, LDB_SEQ_HIGHEST_SEQ, &seqnum);
+    if (lret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(lret);
+        goto done;
+    }
+
+    if (seqnum == sysdb->snapshot_seqnum) {
+        DEBUG(SSSDBG_TRACE_INTERNAL, "Snapshot is up to date\n");
+        ret = EOK;
+        goto done;
+    }
+
+    /* The transaction keeps other writers out, the stamp matches the data
+     * read below */
+    ret = sysdb_snapshot_stamp_read(sysdb, &hdr.db_stamp);
+    if (ret != EOK && ret != ENOTSUP) {
+        goto done;
+    }
+
+    ret = stat(sysdb->ldb_file, &st);
+    if (ret != 0) {
+        ret = errno;
+        goto done;
+    }
+
+    lret = ldb_search(sysdb->ldb, tmp_ctx, &res, base_dn, LDB_SCOPE_SUBTREE,
+                      NULL, "(|(%s)(%s))", SYSDB_UC, SYSDB_GC);
+    if (lret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(lret);
+        goto done;
+    }
+
+    for (i = 0; i < res->count; i++) {
+        ret = sysdb_snapshot_add_entry(tmp_ctx, &builder, res->msgs[i]);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    hdr.magic = SYSDB_SNAPSHOT_MAGIC;
+    hdr.version = SYSDB_SNAPSHOT_VERSION;
+    hdr.seqnum = seqnum;
+    hdr.db_dev = st.st_dev;
+    hdr.db_ino = st.st_ino;
+
+    ret = sysdb_snapshot_write(tmp_ctx, path, &hdr, &builder);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC,
+          "Published snapshot of %u entries with %zu keys at seqnum %"PRIu64"\n",
+          res->count, builder.num_slots, seqnum);
+
+    sysdb->snapshot_seqnum = seqnum;
+    /* Let lookups in this process pick up the new file right away */
+    sysdb->snapshot_checked = 0;
+    ret = EOK;
+
+done:
+    if (in_transaction) {
+        /* Nothing was written */
+        sret = sysdb_transaction_cancel(sysdb);
+        if (sret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Could not cancel transaction\n");
+        }
+    }
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot publish snapshot [%d]: %s\n",
+              ret, sss_strerror(ret));
+    }
+    talloc_free(builder.data.data);
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+errno_t sysdb_snapshot_remove(struct sysdb_ctx *sysdb)
+{
+    char *path;
+    errno_t ret;
+
+    path = sysdb_snapshot_path(NULL, sysdb);
+    if (path == NULL) {
+        return ENOMEM;
+    }
+
+    ret = unlink(path);
+    if (ret != 0 && errno != ENOENT) {
+        ret = errno;
+        DEBUG(SSSDBG_MINOR_FAILURE, "Cannot remove [%s] [%d]: %s\n",
+              path, ret, sss_strerror(ret));
+    } else {
+        ret = EOK;
+    }
+
+    sysdb->snapshot_seqnum = 0;
+    talloc_zfree(sysdb->snapshot);
+    talloc_free(path);
+    return ret;
+}
+
+static void sysdb_snapshot_publish_timer(struct tevent_context *ev,
+                                         struct tevent_timer *tt,
+                                         struct timeval tv,
+                                         void *pvt)
+{
+    struct sysdb_ctx *sysdb;
+
+    sysdb = talloc_get_type(pvt, struct sysdb_ctx);
+    sysdb->snapshot_timer = NULL;
+
+    /* Errors are logged, the periodic publish tries again */
+    sysdb_snapshot_publish(sysdb);
+}
+
+errno_t sysdb_snapshot_publish_on_change(struct sysdb_ctx *sysdb,
+                                         struct tevent_context *ev,
+                                         uint32_t delay_msec)
+{
+    if (ev == NULL) {
+        return EINVAL;
+    }
+
+    sysdb->snapshot_ev = ev;
+    sysdb->snapshot_delay_msec = delay_msec;
+    return EOK;
+}
+
+void sysdb_snapshot_changed(struct sysdb_ctx *sysdb)
+{
+    struct timeval tv;
+
+    if (sysdb->snapshot_ev == NULL || sysdb->snapshot_timer != NULL) {
+        return;
+    }
+
+    tv = tevent_timeval_current_ofs(sysdb->snapshot_delay_msec / 1000,
+                                    (sysdb->snapshot_delay_msec % 1000) * 1000);
+    sysdb->snapshot_timer = tevent_add_timer(sysdb->snapshot_ev, sysdb, tv,
+                                             sysdb_snapshot_publish_timer,
+                                             sysdb);
+    if (sysdb->snapshot_timer == NULL) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Cannot schedule the snapshot, it is published with the "
+              "next periodic run\n");
+    }
+}
+
+/* =Lookup================================================================ */
+
+static int sysdb_snapshot_destructor(struct sysdb_snapshot *snap)
+{
+    munmap(snap->addr, snap->size);
+    return 0;
+}
+
+static errno_t sysdb_snapshot_map(TALLOC_CTX *mem_ctx,
+                                  struct sysdb_ctx *sysdb,
+                                  const char *path,
+                                  struct sysdb_snapshot **_snap)
+{
+    const struct sysdb_snapshot_header *hdr;
+    struct sysdb_snapshot *snap;
+    struct stat db_st;
+    struct stat st;
+    uint64_t end;
+    void *addr;
+    int fd;
+    errno_t ret;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return errno;
+    }
+
+    ret = fstat(fd, &st);
+    if (ret != 0) {
+        ret = errno;
+        close(fd);
+        return ret;
+    }
+
+    if (st.st_size < (off_t)sizeof(struct sysdb_snapshot_header)
+            || st.st_size > UINT32_MAX) {
+        close(fd);
+        return EINVAL;
+    }
+
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return errno;
+    }
+
+    snap = talloc_zero(mem_ctx, struct sysdb_snapshot);
+    if (snap == NULL) {
+        munmap(addr, st.st_size);
+        return ENOMEM;
+    }
+    snap->addr = addr;
+    snap->size = st.st_size;
+    snap->dev = st.st_dev;
+    snap->ino = st.st_ino;
+    talloc_set_destructor(snap, sysdb_snapshot_destructor);
+
+    hdr = addr;
+    end = (uint64_t)hdr->buckets_offset
+              + ((uint64_t)hdr->num_buckets + 1) * sizeof(uint32_t);
+    if (hdr->magic != SYSDB_SNAPSHOT_MAGIC
+            || hdr->version != SYSDB_SNAPSHOT_VERSION
+            || hdr->size != snap->size
+            || hdr->num_buckets == 0
+            || hdr->buckets_offset != sizeof(struct sysdb_snapshot_header)
+            || hdr->slots_offset != end
+            || hdr->data_offset != hdr->slots_offset
+                   + (uint64_t)hdr->num_slots
+                         * sizeof(struct sysdb_snapshot_slot)
+            || hdr->data_offset > hdr->size) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Snapshot [%s] is corrupted\n", path);
+        ret = EINVAL;
+        goto done;
+    }
+
+    /* A left-over of a cache that was removed in the meantime */
+    ret = stat(sysdb->ldb_file, &db_st);
+    if (ret != 0) {
+        ret = errno;
+        goto done;
+    }
+
+    if (db_st.st_dev != hdr->db_dev || db_st.st_ino != hdr->db_ino) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Snapshot [%s] belongs to another cache\n",
+              path);
+        ret = ESTALE;
+        goto done;
+    }
+
+    snap->hdr = hdr;
+    snap->buckets = (const uint32_t *)(snap->addr + hdr->buckets_offset);
+    snap->slots = (const struct sysdb_snapshot_slot *)
+                        (snap->addr + hdr->slots_offset);
+    snap->data = snap->addr + hdr->data_offset;
+    snap->data_size = hdr->size - hdr->data_offset;
+
+    *_snap = snap;
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        talloc_free(snap);
+    }
+    return ret;
+}
+
+/* Compares the snapshot with the current content of the cache */
+static bool sysdb_snapshot_is_current(struct sysdb_ctx *sysdb,
+                                      struct sysdb_snapshot *snap)
+{
+    uint64_t seqnum;
+    uint64_t stamp;
+    errno_t ret;
+    int lret;
+
+    ret = sysdb_snapshot_stamp_read(sysdb, &stamp);
+    if (ret == EOK) {
+        return snap->hdr->db_stamp == stamp;
+    }
+
+    lret = ldb_sequence_number(sysdb->ldb, LDB_SEQ_HIGHEST_SEQ, &seqnum);
+    if (lret != LDB_SUCCESS) {
+        return false;
+    }
+
+    return snap->hdr->seqnum == seqnum;
+}
+
+/* Returns the snapshot if it matches the current content of the cache.
+ * The mapped snapshot is compared with the cache on every call. Only when
+ * it is outdated or missing a newly published one is looked for, at most
+ * once per SYSDB_SNAPSHOT_RECHECK_SEC. */
+static struct sysdb_snapshot *sysdb_snapshot_get(struct sysdb_ctx *sysdb)
+{
+    struct sysdb_snapshot *snap;
+    struct stat st;
+    time_t now;
+    char *path;
+    errno_t ret;
+
+    if (sysdb->snapshot != NULL
+            && sysdb_snapshot_is_current(sysdb, sysdb->snapshot)) {
+        return sysdb->snapshot;
+    }
+
+    now = time(NULL);
+    if (now - sysdb->snapshot_checked < SYSDB_SNAPSHOT_RECHECK_SEC) {
+        return NULL;
+    }
+    sysdb->snapshot_checked = now;
+
+    path = sysdb_snapshot_path(NULL, sysdb);
+    if (path == NULL) {
+        return NULL;
+    }
+
+    ret = stat(path, &st);
+    if (ret != 0) {
+        talloc_zfree(sysdb->snapshot);
+        goto done;
+    }
+
+    if (sysdb->snapshot != NULL
+            && sysdb->snapshot->dev == st.st_dev
+            && sysdb->snapshot->ino == st.st_ino) {
+        /* Still the outdated one */
+        goto done;
+    }
+
+    talloc_zfree(sysdb->snapshot);
+    ret = sysdb_snapshot_map(sysdb, sysdb, path, &snap);
+    if (ret != EOK) {
+        goto done;
+    }
+    sysdb->snapshot = snap;
+
+    DEBUG(SSSDBG_TRACE_INTERNAL,
+          "Mapped snapshot [%s] at seqnum %"PRIu64"\n",
+          path, snap->hdr->seqnum);
+
+    talloc_free(path);
+    return sysdb_snapshot_is_current(sysdb, snap) ? snap : NULL;
+
+done:
+    talloc_free(path);
+    return NULL;
+}
+
+struct sysdb_snapshot_cursor {
+    const uint8_t *p;
+    const uint8_t *end;
+};
+
+static bool sysdb_snapshot_read_u32(struct sysdb_snapshot_cursor *cur,
+                                    uint32_t *_val)
+{
+    if ((size_t)(cur->end - cur->p) < sizeof(uint32_t)) {
+        return false;
+    }
+
+    memcpy(_val, cur->p, sizeof(uint32_t));
+    cur->p += sizeof(uint32_t);
+    return true;
+}
+
+static bool sysdb_snapshot_read_blob(struct sysdb_snapshot_cursor *cur,
+                                     const uint8_t **_data,
+                                     uint32_t *_len)
+{
+    uint32_t len;
+
+    if (!sysdb_snapshot_read_u32(cur, &len)
+            || (size_t)(cur->end - cur->p) < len) {
+        return false;
+    }
+
+    *_data = cur->p;
+    *_len = len;
+    cur->p += len;
+    return true;
+}
+
+static bool sysdb_snapshot_attr_wanted(const char **attrs,
+                                       const uint8_t *name,
+                                       uint32_t len)
+{
+    size_t i;
+
+    if (attrs == NULL) {
+        return true;
+    }
+
+    for (i = 0; attrs[i] != NULL; i++) {
+        if (strcmp(attrs[i], "*") == 0) {
+            return true;
+        }
+
+        if (strlen(attrs[i]) == len
+                && strncasecmp(attrs[i], (const char *)name, len) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static errno_t sysdb_snapshot_unpack(TALLOC_CTX *mem_ctx,
+                                     struct ldb_context *ldb,
+                                     struct sysdb_snapshot *snap,
+                                     uint32_t entry_offset,
+                                     const char **attrs,
+                                     struct ldb_message **_msg)
+{
+    struct sysdb_snapshot_cursor cur;
+    struct ldb_message_element *el;
+    struct ldb_message *msg;
+    const uint8_t *data;
+    uint32_t num_elements;
+    uint32_t num_values;
+    uint32_t len;
+    uint32_t i;
+    uint32_t j;
+    char *str;
+    errno_t ret;
+    int lret;
+
+    if (entry_offset >= snap->data_size) {
+        return EINVAL;
+    }
+    cur.p = snap->data + entry_offset;
+    cur.end = snap->data + snap->data_size;
+
+    msg = ldb_msg_new(mem_ctx);
+    if (msg == NULL) {
+        return ENOMEM;
+    }
+
+    if (!sysdb_snapshot_read_blob(&cur, &data, &len)
+            || !sysdb_snapshot_read_u32(&cur, &num_elements)) {
+        ret = EINVAL;
+        goto done;
+    }
+
+    str = talloc_strndup(msg, (const char *)data, len);
+    if (str == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    msg->dn = ldb_dn_new(msg, ldb, str);
+    if (msg->dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (i = 0; i < num_elements; i++) {
+        if (!sysdb_snapshot_read_blob(&cur, &data, &len)
+                || !sysdb_snapshot_read_u32(&cur, &num_values)) {
+            ret = EINVAL;
+            goto done;
+        }
+
+        el = NULL;
+        if (sysdb_snapshot_attr_wanted(attrs, data, len)) {
+            str = talloc_strndup(msg, (const char *)data, len);
+            if (str == NULL) {
+                ret = ENOMEM;
+                goto done;
+            }
+
+            lret = ldb_msg_add_empty(msg, str, 0, &el);
+            talloc_free(str);
+            if (lret != LDB_SUCCESS) {
+                ret = sysdb_error_to_errno(lret);
+                goto done;
+            }
+
+            if (num_values > (size_t)(cur.end - cur.p)) {
+                ret = EINVAL;
+                goto done;
+            }
+
+            el->values = talloc_array(msg->elements, struct ldb_val,
+                                      num_values);
+            if (el->values == NULL) {
+                ret = ENOMEM;
+                goto done;
+            }
+        }
+
+        for (j = 0; j < num_values; j++) {
+            if (!sysdb_snapshot_read_blob(&cur, &data, &len)) {
+                ret = EINVAL;
+                goto done;
+            }
+
+            if (el == NULL) {
+                continue;
+            }
+
+            /* ldb values are always NUL terminated */
+            el->values[j].data = talloc_size(el->values, len + 1);
+            if (el->values[j].data == NULL) {
+                ret = ENOMEM;
+                goto done;
+            }
+            memcpy(el->values[j].data, data, len);
+            el->values[j].data[len] = '\0';
+            el->values[j].length = len;
+            el->num_values++;
+        }
+    }
+
+    *_msg = msg;
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        talloc_free(msg);
+    }
+    return ret;
+}
+
+errno_t sysdb_snapshot_search(TALLOC_CTX *mem_ctx,
+                              struct sss_domain_info *domain,
+                              const struct sysdb_snapshot_key *keys,
+                              size_t num_keys,
+                              const char **attrs,
+                              struct ldb_result **_res)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct sysdb_snapshot *snap;
+    const struct sysdb_snapshot_slot *slot;
+    struct ldb_message *msg;
+    struct ldb_result *res;
+    uint32_t *found = NULL;
+    uint32_t hash;
+    uint32_t b;
+    uint32_t s;
+    size_t len;
+    size_t i;
+    size_t j;
+    char *key;
+    errno_t ret;
+
+    snap = sysdb_snapshot_get(domain->sysdb);
+    if (snap == NULL) {
+        return ENOENT;
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    res = talloc_zero(tmp_ctx, struct ldb_result);
+    if (res == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (i = 0; i < num_keys; i++) {
+        if (keys[i].value == NULL) {
+            continue;
+        }
+
+        key = sysdb_snapshot_key(tmp_ctx, keys[i].type,
+                                 domain->name, strlen(domain->name),
+                                 keys[i].value,
+                                 keys[i].type == SYSDB_SNAPSHOT_USER_UPN,
+                                 &len);
+        if (key == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        hash = murmurhash3(key, len, SYSDB_SNAPSHOT_SEED);
+        b = hash % snap->hdr->num_buckets;
+        if (snap->buckets[b] > snap->buckets[b + 1]
+                || snap->buckets[b + 1] > snap->hdr->num_slots) {
+            ret = EINVAL;
+            goto done;
+        }
+
+        for (s = snap->buckets[b]; s < snap->buckets[b + 1]; s++) {
+            slot = &snap->slots[s];
+            if (slot->hash != hash || slot->key_len != len
+                    || slot->key_offset > snap->data_size
+                    || snap->data_size - slot->key_offset < len
+                    || memcmp(snap->data + slot->key_offset, key, len) != 0) {
+                continue;
+            }
+
+            /* Several keys may point to the same entry */
+            for (j = 0; j < res->count; j++) {
+                if (found[j] == slot->entry_offset) {
+                    break;
+                }
+            }
+            if (j < res->count) {
+                continue;
+            }
+
+            ret = sysdb_snapshot_unpack(res, domain->sysdb->ldb, snap,
+                                        slot->entry_offset, attrs, &msg);
+            if (ret != EOK) {
+                goto done;
+            }
+
+            found = talloc_realloc(tmp_ctx, found, uint32_t, res->count + 1);
+            res->msgs = talloc_realloc(res, res->msgs, struct ldb_message *,
+                                       res->count + 2);
+            if (found == NULL || res->msgs == NULL) {
+                ret = ENOMEM;
+                goto done;
+            }
+            found[res->count] = slot->entry_offset;
+            res->msgs[res->count] = msg;
+            res->count++;
+            res->msgs[res->count] = NULL;
+        }
+
+        talloc_free(key);
+    }
+
+    if (res->count == 0) {
+        ret = ENOENT;
+        goto done;
+    }
+
+    *_res = talloc_steal(mem_ctx, res);
+    ret = EOK;
+
+done:
+    if (ret == EINVAL) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Snapshot is corrupted, not using it\n");
+        talloc_zfree(domain->sysdb->snapshot);
+        ret = ENOENT;
+    }
+    talloc_free(tmp_ctx);
+    return ret;
+}
@@ -0,0 +1,595 @@
+/*
+   SSSD
+
+   System Database - batching of timestamp cache updates
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Updates of the timestamp cache are kept in memory while batching is
+ * active and written in a single ldb transaction once enough of them
+ * piled up, once the flush timer fires or when batching ends.
+ *
+ * Losing the buffered updates (e.g. on crash) is harmless: the timestamp
+ * cache then still contains the previous values and the affected entries
+ * simply look expired earlier than they should.
+ *
+ * Updates made inside a sysdb transaction are queued separately and only
+ * join the batch when the transaction is committed, a cancelled
+ * transaction drops them together with the cache changes they belong to.
+ * New records are never buffered, sysdb_create_ts_entry() writes them
+ * directly.
+ */
+
+#include "util/util.h"
+#include "util/probes.h"
+#include "util/sss_ptr_hash.h"
+#include "db/sysdb_private.h"
+
+struct sysdb_ts_batch_queue {
+    /* Pending updates, keyed by the casefolded entry DN */
+    hash_table_t *table;
+    struct sysdb_ts_batch_entry *entries;
+    size_t num_entries;
+};
+
+struct sysdb_ts_batch_entry {
+    struct sysdb_ts_batch_queue *queue;
+    struct ldb_message *msg;
+
+    struct sysdb_ts_batch_entry *prev;
+    struct sysdb_ts_batch_entry *next;
+};
+
+struct sysdb_ts_batch {
+    struct sysdb_ctx *sysdb;
+    struct tevent_context *ev;
+    struct tevent_timer *timer;
+
+    size_t max_entries;
+    uint32_t flush_msec;
+    unsigned int users;
+
+    /* Updates waiting for the flush */
+    struct sysdb_ts_batch_queue committed;
+    /* Updates made in the running sysdb transaction */
+    struct sysdb_ts_batch_queue txn;
+};
+
+static int sysdb_ts_batch_entry_destructor(struct sysdb_ts_batch_entry *entry)
+{
+    DLIST_REMOVE(entry->queue->entries, entry);
+    entry->queue->num_entries--;
+
+    return 0;
+}
+
+static void sysdb_ts_batch_queue_clear(struct sysdb_ts_batch_queue *queue)
+{
+    while (queue->entries != NULL) {
+        talloc_free(queue->entries);
+    }
+}
+
+static int sysdb_ts_batch_destructor(struct sysdb_ts_batch *batch)
+{
+    if (batch->sysdb->ts_batch == batch) {
+        batch->sysdb->ts_batch = NULL;
+    }
+
+    return 0;
+}
+
+static const char *sysdb_ts_batch_key(struct ldb_dn *dn)
+{
+    return ldb_dn_get_casefold(dn);
+}
+
+static errno_t sysdb_ts_batch_write(struct ldb_context *ldb,
+                                    struct ldb_message *msg)
+{
+    struct ldb_message *add_msg;
+    unsigned int i;
+    int lret;
+
+    lret = ldb_modify(ldb, msg);
+    if (lret == LDB_ERR_NO_SUCH_OBJECT) {
+        /* The record was not there yet, create it the same way
+         * sysdb_set_entry_attr() does when replacing fails */
+        add_msg = ldb_msg_copy_shallow(msg, msg);
+        if (add_msg == NULL) {
+            return ENOMEM;
+        }
+
+        for (i = 0; i < add_msg->num_elements; i++) {
+            add_msg->elements[i].flags = 0;
+        }
+
+        lret = ldb_add(ldb, add_msg);
+        talloc_free(add_msg);
+    }
+
+    if (lret != LDB_SUCCESS) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Cannot write timestamps of %s: [%s](%d)[%s]\n",
+              ldb_dn_get_linearized(msg->dn),
+              ldb_strerror(lret), lret, ldb_errstring(ldb));
+    }
+
+    return sysdb_error_to_errno(lret);
+}
+
+errno_t sysdb_ts_batch_flush(struct sysdb_ctx *sysdb)
+{
+    struct sysdb_ts_batch *batch = sysdb->ts_batch;
+    struct sysdb_ts_batch_entry *entry;
+    size_t num_entries;
+    size_t num_failed = 0;
+    errno_t ret;
+    int lret;
+
+    if (batch == NULL || batch->committed.num_entries == 0) {
+        return EOK;
+    }
+
+    talloc_zfree(batch->timer);
+
+    num_entries = batch->committed.num_entries;
+    PROBE(SYSDB_TS_FLUSH_START, num_entries);
+
+    lret = ldb_transaction_start(sysdb->ldb_ts);
+    if (lret != LDB_SUCCESS) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Failed to start timestamp cache transaction (%d)\n", lret);
+        ret = sysdb_error_to_errno(lret);
+        goto done;
+    }
+
+    for (entry = batch->committed.entries; entry != NULL;
+         entry = entry->next) {
+        ret = sysdb_ts_batch_write(sysdb->ldb_ts, entry->msg);
+        if (ret != EOK) {
+            /* Not fatal, the entry will just look expired */
+            num_failed++;
+        }
+    }
+
+    lret = ldb_transaction_commit(sysdb->ldb_ts);
+    if (lret != LDB_SUCCESS) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Failed to commit timestamp cache transaction (%d)\n", lret);
+        ret = sysdb_error_to_errno(lret);
+        goto done;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC,
+          "Flushed %zu timestamp cache updates, %zu failed\n",
+          num_entries, num_failed);
+    ret = EOK;
+
+done:
+    /* Whatever happened, the buffered values are not retried. If the
+     * write failed the entries will be refreshed once they expire. */
+    sysdb_ts_batch_queue_clear(&batch->committed);
+
+    PROBE(SYSDB_TS_FLUSH_END, num_entries, ret);
+    return ret;
+}
+
+static void sysdb_ts_batch_timer(struct tevent_context *ev,
+                                 struct tevent_timer *tt,
+                                 struct timeval tv,
+                                 void *pvt)
+{
+    struct sysdb_ts_batch *batch;
+    errno_t ret;
+
+    batch = talloc_get_type(pvt, struct sysdb_ts_batch);
+    batch->timer = NULL;
+
+    ret = sysdb_ts_batch_flush(batch->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Cannot flush timestamp cache updates [%d]: %s\n",
+              ret, sss_strerror(ret));
+    }
+}
+
+static errno_t sysdb_ts_batch_merge_el(struct ldb_message *msg,
+                                       struct ldb_message_element *src,
+                                       int flags)
+{
+    struct ldb_message_element *el;
+    unsigned int i;
+    int lret;
+
+    ldb_msg_remove_attr(msg, src->name);
+
+    lret = ldb_msg_add_empty(msg, src->name, flags, &el);
+    if (lret != LDB_SUCCESS) {
+        return sysdb_error_to_errno(lret);
+    }
+
+    if (src->num_values == 0) {
+        return EOK;
+    }
+
+    el->values = talloc_array(msg->elements, struct ldb_val, src->num_values);
+    if (el->values == NULL) {
+        return ENOMEM;
+    }
+
+    for (i = 0; i < src->num_values; i++) {
+        el->values[i] = ldb_val_dup(el->values, &src->values[i]);
+        if (el->values[i].data == NULL && src->values[i].data != NULL) {
+            return ENOMEM;
+        }
+    }
+    el->num_values = src->num_values;
+
+    return EOK;
+}
+
+static struct sysdb_ts_batch_entry *
+sysdb_ts_batch_queue_get(struct sysdb_ts_batch *batch,
+                         struct sysdb_ts_batch_queue *queue,
+                         struct ldb_dn *entry_dn)
+{
+    struct sysdb_ts_batch_entry *entry;
+    const char *key;
+    errno_t ret;
+
+    key = sysdb_ts_batch_key(entry_dn);
+    if (key == NULL) {
+        return NULL;
+    }
+
+    entry = sss_ptr_hash_lookup(queue->table, key,
+                                struct sysdb_ts_batch_entry);
+    if (entry != NULL) {
+        return entry;
+    }
+
+    entry = talloc_zero(batch, struct sysdb_ts_batch_entry);
+    if (entry == NULL) {
+        return NULL;
+    }
+
+    entry->queue = queue;
+    entry->msg = ldb_msg_new(entry);
+    if (entry->msg == NULL) {
+        talloc_free(entry);
+        return NULL;
+    }
+
+    entry->msg->dn = ldb_dn_copy(entry->msg, entry_dn);
+    if (entry->msg->dn == NULL) {
+        talloc_free(entry);
+        return NULL;
+    }
+
+    ret = sss_ptr_hash_add(queue->table, key, entry,
+                           struct sysdb_ts_batch_entry);
+    if (ret != EOK) {
+        talloc_free(entry);
+        return NULL;
+    }
+
+    DLIST_ADD_END(queue->entries, entry, struct sysdb_ts_batch_entry *);
+    queue->num_entries++;
+    talloc_set_destructor(entry, sysdb_ts_batch_entry_destructor);
+
+    return entry;
+}
+
+/* Later updates of the same entry replace the earlier values */
+static errno_t sysdb_ts_batch_queue_add(struct sysdb_ts_batch *batch,
+                                        struct sysdb_ts_batch_queue *queue,
+                                        struct ldb_dn *entry_dn,
+                                        struct ldb_message_element *els,
+                                        unsigned int num_els)
+{
+    struct sysdb_ts_batch_entry *entry;
+    unsigned int i;
+    errno_t ret;
+
+    entry = sysdb_ts_batch_queue_get(batch, queue, entry_dn);
+    if (entry == NULL) {
+        return ENOMEM;
+    }
+
+    for (i = 0; i < num_els; i++) {
+        ret = sysdb_ts_batch_merge_el(entry->msg, &els[i],
+                                      LDB_FLAG_MOD_REPLACE);
+        if (ret != EOK) {
+            talloc_free(entry);
+            return ret;
+        }
+    }
+
+    return EOK;
+}
+
+static errno_t sysdb_ts_batch_schedule(struct sysdb_ctx *sysdb)
+{
+    struct sysdb_ts_batch *batch = sysdb->ts_batch;
+    struct timeval tv;
+
+    if (batch->committed.num_entries >= batch->max_entries) {
+        return sysdb_ts_batch_flush(sysdb);
+    }
+
+    if (batch->timer == NULL && batch->committed.num_entries > 0) {
+        tv = tevent_timeval_current_ofs(batch->flush_msec / 1000,
+                                        (batch->flush_msec % 1000) * 1000);
+        batch->timer = tevent_add_timer(batch->ev, batch, tv,
+                                        sysdb_ts_batch_timer, batch);
+        if (batch->timer == NULL) {
+            /* Without a timer the updates would wait for the next flush
+             * for too long, write them out now */
+            return sysdb_ts_batch_flush(sysdb);
+        }
+    }
+
+    return EOK;
+}
+
+errno_t sysdb_ts_batch_add(struct sysdb_ctx *sysdb,
+                           struct ldb_dn *entry_dn,
+                           struct sysdb_attrs *ts_attrs)
+{
+    struct sysdb_ts_batch *batch = sysdb->ts_batch;
+    errno_t ret;
+
+    if (batch == NULL) {
+        return ENOTSUP;
+    }
+
+    if (sysdb->transaction_nesting > 0) {
+        return sysdb_ts_batch_queue_add(batch, &batch->txn, entry_dn,
+                                        ts_attrs->a, ts_attrs->num);
+    }
+
+    ret = sysdb_ts_batch_queue_add(batch, &batch->committed, entry_dn,
+                                   ts_attrs->a, ts_attrs->num);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    return sysdb_ts_batch_schedule(sysdb);
+}
+
+void sysdb_ts_batch_txn_end(struct sysdb_ctx *sysdb, bool committed)
+{
+    struct sysdb_ts_batch *batch = sysdb->ts_batch;
+    struct sysdb_ts_batch_entry *entry;
+    errno_t ret = EOK;
+
+    if (batch == NULL || batch->txn.num_entries == 0) {
+        return;
+    }
+
+    if (!committed) {
+        DEBUG(SSSDBG_TRACE_FUNC,
+              "Dropping %zu timestamp cache updates of a cancelled "
+              "transaction\n", batch->txn.num_entries);
+        sysdb_ts_batch_queue_clear(&batch->txn);
+        return;
+    }
+
+    for (entry = batch->txn.entries; entry != NULL; entry = entry->next) {
+        ret = sysdb_ts_batch_queue_add(batch, &batch->committed,
+                                       entry->msg->dn,
+                                       entry->msg->elements,
+                                       entry->msg->num_elements);
+        if (ret != EOK) {
+            break;
+        }
+    }
+
+    sysdb_ts_batch_queue_clear(&batch->txn);
+
+    if (ret == EOK) {
+        ret = sysdb_ts_batch_schedule(sysdb);
+    }
+    if (ret != EOK) {
+        /* Not fatal, the affected entries will just look expired */
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Cannot queue timestamp cache updates [%d]: %s\n",
+              ret, sss_strerror(ret));
+    }
+}
+
+void sysdb_ts_batch_drop(struct sysdb_ctx *sysdb,
+                         struct ldb_dn *entry_dn)
+{
+    struct sysdb_ts_batch *batch = sysdb->ts_batch;
+    const char *key;
+
+    if (batch == NULL) {
+        return;
+    }
+
+    key = sysdb_ts_batch_key(entry_dn);
+    if (key == NULL) {
+        return;
+    }
+
+    talloc_free(sss_ptr_hash_lookup(batch->committed.table, key,
+                                    struct sysdb_ts_batch_entry));
+    talloc_free(sss_ptr_hash_lookup(batch->txn.table, key,
+                                    struct sysdb_ts_batch_entry));
+}
+
+bool sysdb_ts_batch_pending(struct sysdb_ctx *sysdb,
+                            struct ldb_dn *entry_dn)
+{
+    const char *key;
+
+    /* Only the committed updates can be flushed */
+    if (sysdb->ts_batch == NULL
+            || sysdb->ts_batch->committed.num_entries == 0) {
+        return false;
+    }
+
+    if (entry_dn == NULL) {
+        return true;
+    }
+
+    key = sysdb_ts_batch_key(entry_dn);
+    if (key == NULL) {
+        /* Be pessimistic */
+        return true;
+    }
+
+    return sss_ptr_hash_has_key(sysdb->ts_batch->committed.table, key);
+}
+
+static errno_t sysdb_ts_batch_queue_overlay(struct sysdb_ts_batch_queue *queue,
+                                            const char *key,
+                                            struct ldb_message *msg,
+                                            const char **attrs)
+{
+    struct sysdb_ts_batch_entry *entry;
+    struct ldb_message_element *el;
+    unsigned int i;
+    errno_t ret;
+
+    if (queue->num_entries == 0) {
+        return EOK;
+    }
+
+    entry = sss_ptr_hash_lookup(queue->table, key,
+                                struct sysdb_ts_batch_entry);
+    if (entry == NULL) {
+        return EOK;
+    }
+
+    for (i = 0; i < entry->msg->num_elements; i++) {
+        el = &entry->msg->elements[i];
+        if (attrs != NULL
+                && !string_in_list(el->name, discard_const(attrs), false)
+                && !string_in_list("*", discard_const(attrs), false)) {
+            continue;
+        }
+
+        ret = sysdb_ts_batch_merge_el(msg, el, 0);
+        if (ret != EOK) {
+            return ret;
+        }
+    }
+
+    return EOK;
+}
+
+errno_t sysdb_ts_batch_overlay(struct sysdb_ctx *sysdb,
+                               struct ldb_message *msg,
+                               const char **attrs)
+{
+    struct sysdb_ts_batch *batch = sysdb->ts_batch;
+    const char *key;
+    errno_t ret;
+
+    if (batch == NULL
+            || (batch->committed.num_entries == 0
+                && batch->txn.num_entries == 0)) {
+        return EOK;
+    }
+
+    key = sysdb_ts_batch_key(msg->dn);
+    if (key == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sysdb_ts_batch_queue_overlay(&batch->committed, key, msg, attrs);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    /* The running transaction sees its own updates */
+    return sysdb_ts_batch_queue_overlay(&batch->txn, key, msg, attrs);
+}
+
+errno_t sysdb_ts_batch_begin(struct sysdb_ctx *sysdb,
+                             struct tevent_context *ev,
+                             size_t max_entries,
+                             uint32_t flush_msec)
+{
+    struct sysdb_ts_batch *batch;
+
+    if (sysdb->ldb_ts == NULL) {
+        /* Nothing to batch */
+        return EOK;
+    }
+
+    if (sysdb->ts_batch != NULL) {
+        sysdb->ts_batch->users++;
+        return EOK;
+    }
+
+    if (ev == NULL || max_entries == 0) {
+        return EINVAL;
+    }
+
+    batch = talloc_zero(sysdb, struct sysdb_ts_batch);
+    if (batch == NULL) {
+        return ENOMEM;
+    }
+
+    batch->committed.table = sss_ptr_hash_create(batch, NULL, NULL);
+    batch->txn.table = sss_ptr_hash_create(batch, NULL, NULL);
+    if (batch->committed.table == NULL || batch->txn.table == NULL) {
+        talloc_free(batch);
+        return ENOMEM;
+    }
+
+    batch->sysdb = sysdb;
+    batch->ev = ev;
+    batch->max_entries = max_entries;
+    batch->flush_msec = flush_msec;
+    batch->users = 1;
+
+    sysdb->ts_batch = batch;
+    talloc_set_destructor(batch, sysdb_ts_batch_destructor);
+
+    DEBUG(SSSDBG_TRACE_FUNC,
+          "Batching timestamp cache updates, up to %zu entries or %u ms\n",
+          max_entries, flush_msec);
+
+    return EOK;
+}
+
+void sysdb_ts_batch_end(struct sysdb_ctx *sysdb)
+{
+    struct sysdb_ts_batch *batch = sysdb->ts_batch;
+    errno_t ret;
+
+    if (batch == NULL) {
+        return;
+    }
+
+    batch->users--;
+    if (batch->users > 0) {
+        return;
+    }
+
+    ret = sysdb_ts_batch_flush(sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Cannot flush timestamp cache updates [%d]: %s\n",
+              ret, sss_strerror(ret));
+    }
+
+    talloc_free(batch);
+}
@@ -309,6 +309,7 @@ static errno_t invalidate_entry_override(struct sysdb_ctx *sysdb,
     }
 
     if (sysdb->ldb_ts != NULL) {
+        sysdb_ts_batch_drop(sysdb, msg_repl->dn);
         ret = ldb_modify(sysdb->ldb_ts, msg_repl);
         if (ret != LDB_SUCCESS && ret != LDB_ERR_NO_SUCH_ATTRIBUTE) {
             DEBUG(SSSDBG_OP_FAILURE,
@@ -1491,12 +1492,12 @@ static errno_t sysdb_search_override_by_id(TALLOC_CTX *mem_ctx,
                                            struct sss_domain_info *domain,
                                            unsigned long int id,
                                            enum override_object_type type,
+                                           const char **group_attrs,
                                            struct ldb_result **override_obj,
                                            struct ldb_result **orig_obj)
 {
     TALLOC_CTX *tmp_ctx;
     static const char *user_attrs[] = SYSDB_PW_ATTRS;
-    const char **group_attrs = SYSDB_GRSRC_ATTRS(domain);
     const char **attrs;
     struct ldb_dn *base_dn;
     struct ldb_result *override_res;
@@ -1526,7 +1527,7 @@ static errno_t sysdb_search_override_by_id(TALLOC_CTX *mem_ctx,
         break;
     case OO_TYPE_GROUP:
         filter = SYSDB_GROUP_GID_OVERRIDE_FILTER;
-        attrs = group_attrs;
+        attrs = group_attrs != NULL ? group_attrs : SYSDB_GRSRC_ATTRS(domain);
         break;
     default:
         DEBUG(SSSDBG_CRIT_FAILURE, "Unexpected override object type [%d].\n",
@@ -1618,7 +1619,7 @@ errno_t sysdb_search_user_override_by_uid(TALLOC_CTX *mem_ctx,
                                            struct ldb_result **orig_obj)
 {
     return sysdb_search_override_by_id(mem_ctx, domain, uid, OO_TYPE_USER,
-                                       override_obj, orig_obj);
+                                       NULL, override_obj, orig_obj);
 }
 
 errno_t sysdb_search_group_override_by_gid(TALLOC_CTX *mem_ctx,
@@ -1628,7 +1629,18 @@ errno_t sysdb_search_group_override_by_gid(TALLOC_CTX *mem_ctx,
                                             struct ldb_result **orig_obj)
 {
     return sysdb_search_override_by_id(mem_ctx, domain, gid, OO_TYPE_GROUP,
-                                       override_obj, orig_obj);
+                                       NULL, override_obj, orig_obj);
+}
+
+errno_t sysdb_search_group_override_attrs_by_gid(TALLOC_CTX *mem_ctx,
+                                            struct sss_domain_info *domain,
+                                            gid_t gid,
+                                            const char **attrs,
+                                            struct ldb_result **override_obj,
+                                            struct ldb_result **orig_obj)
+{
+    return sysdb_search_override_by_id(mem_ctx, domain, gid, OO_TYPE_GROUP,
+                                       attrs, override_obj, orig_obj);
 }
 
 /**
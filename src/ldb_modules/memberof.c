@@ -64,18 +64,22 @@ struct mbof_add_operation {
     struct ldb_dn *entry_dn;
 
     struct ldb_message *entry;
+    bool started;
 };
 
 struct mbof_memberuid_op {
     struct ldb_dn *dn;
     struct ldb_message_element *el;
+    hash_table_t *vals_index;
 };
 
 struct mbof_add_ctx {
     struct mbof_ctx *ctx;
 
     struct mbof_add_operation *add_list;
+    struct mbof_add_operation *add_tail;
     struct mbof_add_operation *current_op;
+    hash_table_t *addop_index;
 
     struct ldb_message *msg;
     struct ldb_dn *msg_dn;
@@ -233,7 +237,9 @@ static int mbof_append_muop(TALLOC_CTX *memctx,
     int num_muops = *_num_muops;
     struct mbof_memberuid_op *op;
     struct ldb_val *val;
-    int i;
+    hash_value_t value;
+    hash_key_t key;
+    int i, ret;
 
     op = NULL;
     if (muops) {
@@ -270,27 +276,49 @@ static int mbof_append_muop(TALLOC_CTX *memctx,
             return LDB_ERR_OPERATIONS_ERROR;
         }
         op->el->flags = flags;
+        op->vals_index = NULL;
     }
 
-    for (i = 0; i < op->el->num_values; i++) {
-        if (strcmp((char *)op->el->values[i].data, name) == 0) {
-            /* we already have this value, get out*/
-            return LDB_SUCCESS;
+    /* groups with many ghost members can collect a lot of values here,
+     * so look them up in a table instead of comparing each of them */
+    if (!op->vals_index) {
+        ret = hash_create_ex(0, &op->vals_index, 0, 0, 0, 0,
+                             hash_alloc, hash_free, op->el, NULL, NULL);
+        if (ret != HASH_SUCCESS) {
+            return LDB_ERR_OPERATIONS_ERROR;
         }
     }
 
-    val = talloc_realloc(op->el, op->el->values,
-                         struct ldb_val, op->el->num_values + 1);
-    if (!val) {
-        return LDB_ERR_OPERATIONS_ERROR;
+    key.type = HASH_KEY_STRING;
+    key.str = discard_const(name);
+    if (hash_has_key(op->vals_index, &key)) {
+        /* we already have this value, get out*/
+        return LDB_SUCCESS;
+    }
+
+    /* grow the array geometrically, it may receive many values */
+    if (op->el->num_values == talloc_array_length(op->el->values)) {
+        val = talloc_realloc(op->el, op->el->values, struct ldb_val,
+                             MAX(16, op->el->num_values * 2));
+        if (!val) {
+            return LDB_ERR_OPERATIONS_ERROR;
+        }
+        op->el->values = val;
     }
+    val = op->el->values;
+
     val[op->el->num_values].data = (uint8_t *)talloc_strdup(val, name);
     if (!val[op->el->num_values].data) {
         return LDB_ERR_OPERATIONS_ERROR;
     }
     val[op->el->num_values].length = strlen(name);
 
-    op->el->values = val;
+    value.type = HASH_VALUE_UNDEF;
+    ret = hash_enter(op->vals_index, &key, &value);
+    if (ret != HASH_SUCCESS) {
+        return LDB_ERR_OPERATIONS_ERROR;
+    }
+
     op->el->num_values++;
 
     return LDB_SUCCESS;
@@ -338,29 +366,92 @@ static int mbof_append_muop(TALLOC_CTX *memctx,
  * it and only propagated to parent groups.
  */
 
+static int mbof_merge_parents(struct mbof_add_operation *addop,
+                              struct mbof_dn_array *parents)
+{
+    struct ldb_dn **dns;
+    int num;
+    int i, j;
+
+    dns = talloc_array(addop, struct ldb_dn *,
+                       addop->parents->num + parents->num);
+    if (!dns) {
+        return LDB_ERR_OPERATIONS_ERROR;
+    }
+
+    /* the original array may be shared with sibling operations,
+     * so always build a private copy */
+    for (i = 0; i < addop->parents->num; i++) {
+        dns[i] = addop->parents->dns[i];
+    }
+    num = addop->parents->num;
+
+    for (i = 0; i < parents->num; i++) {
+        for (j = 0; j < addop->parents->num; j++) {
+            if (ldb_dn_compare(parents->dns[i], dns[j]) == 0) {
+                break;
+            }
+        }
+        if (j < addop->parents->num) {
+            continue;
+        }
+        dns[num] = parents->dns[i];
+        num++;
+    }
+
+    if (num == addop->parents->num) {
+        /* nothing new */
+        talloc_free(dns);
+        return LDB_SUCCESS;
+    }
+
+    addop->parents = talloc_zero(addop, struct mbof_dn_array);
+    if (!addop->parents) {
+        return LDB_ERR_OPERATIONS_ERROR;
+    }
+    addop->parents->dns = talloc_steal(addop->parents, dns);
+    addop->parents->num = num;
+
+    return LDB_SUCCESS;
+}
+
 static int mbof_append_addop(struct mbof_add_ctx *add_ctx,
                              struct mbof_dn_array *parents,
                              struct ldb_dn *entry_dn)
 {
-    struct mbof_add_operation *lastop = NULL;
     struct mbof_add_operation *addop;
+    hash_value_t value;
+    hash_key_t key;
+    int ret;
 
-    /* test if this is a duplicate */
-    /* FIXME: this is not efficient */
-    if (add_ctx->add_list) {
-        do {
-            if (lastop) {
-                lastop = lastop->next;
-            } else {
-                lastop = add_ctx->add_list;
-            }
+    if (!add_ctx->addop_index) {
+        ret = hash_create_ex(1024, &add_ctx->addop_index, 0, 0, 0, 0,
+                             hash_alloc, hash_free, add_ctx, NULL, NULL);
+        if (ret != HASH_SUCCESS) {
+            return LDB_ERR_OPERATIONS_ERROR;
+        }
+    }
 
-            /* FIXME: check if this is right, might have to compare parents */
-            if (ldb_dn_compare(lastop->entry_dn, entry_dn) == 0) {
-                /* duplicate found */
-                return LDB_SUCCESS;
-            }
-        } while (lastop->next);
+    key.type = HASH_KEY_STRING;
+    key.str = discard_const(ldb_dn_get_casefold(entry_dn));
+    if (!key.str) {
+        return LDB_ERR_OPERATIONS_ERROR;
+    }
+
+    /* Nested groups often reach the same entry through several paths.
+     * If there is still an operation queued for it, just fold the new
+     * parents into that one, so each entry is looked up and modified
+     * only once. If the entry was already handled, queue another
+     * operation: it will only add the parents that are still missing
+     * from its memberof attribute. */
+    ret = hash_lookup(add_ctx->addop_index, &key, &value);
+    if (ret == HASH_SUCCESS) {
+        addop = talloc_get_type(value.ptr, struct mbof_add_operation);
+        if (!addop->started) {
+            return mbof_merge_parents(addop, parents);
+        }
+    } else if (ret != HASH_ERROR_KEY_NOT_FOUND) {
+        return LDB_ERR_OPERATIONS_ERROR;
     }
 
     addop = talloc_zero(add_ctx, struct mbof_add_operation);
@@ -372,11 +463,19 @@ static int mbof_append_addop(struct mbof_add_ctx *add_ctx,
     addop->parents = parents;
     addop->entry_dn = entry_dn;
 
-    if (add_ctx->add_list) {
-        lastop->next = addop;
+    value.type = HASH_VALUE_PTR;
+    value.ptr = addop;
+    ret = hash_enter(add_ctx->addop_index, &key, &value);
+    if (ret != HASH_SUCCESS) {
+        return LDB_ERR_OPERATIONS_ERROR;
+    }
+
+    if (add_ctx->add_tail) {
+        add_ctx->add_tail->next = addop;
     } else {
         add_ctx->add_list = addop;
     }
+    add_ctx->add_tail = addop;
 
     return LDB_SUCCESS;
 }
@@ -650,6 +749,7 @@ static int mbof_next_add(struct mbof_add_operation *addop)
 
     /* mark the operation as being handled */
     add_ctx->current_op = addop;
+    addop->started = true;
 
     ret = ldb_build_search_req(&req, ldb, ctx,
                                addop->entry_dn, LDB_SCOPE_BASE,
@@ -3514,6 +3614,85 @@ static int mbof_mod_process_membel(TALLOC_CTX *mem_ctx,
     return LDB_SUCCESS;
 }
 
+/* Remove the values present in both arrays. A replace usually resends the
+ * whole ghost list of a group, which can have hundreds of thousands of
+ * values, so only the real difference must be propagated to the parents. */
+static int mbof_drop_common_vals(TALLOC_CTX *mem_ctx,
+                                 struct mbof_val_array *added,
+                                 struct mbof_val_array *removed)
+{
+    TALLOC_CTX *tmp_ctx;
+    hash_table_t *table;
+    hash_value_t value;
+    hash_key_t key;
+    int i, n, ret;
+
+    if (!removed || removed->num == 0 || !added || added->num == 0) {
+        return LDB_SUCCESS;
+    }
+
+    tmp_ctx = talloc_new(mem_ctx);
+    if (!tmp_ctx) {
+        return LDB_ERR_OPERATIONS_ERROR;
+    }
+
+    ret = hash_create_ex(removed->num, &table, 0, 0, 0, 0,
+                         hash_alloc, hash_free, tmp_ctx, NULL, NULL);
+    if (ret != HASH_SUCCESS) {
+        ret = LDB_ERR_OPERATIONS_ERROR;
+        goto done;
+    }
+
+    key.type = HASH_KEY_STRING;
+    value.type = HASH_VALUE_INT;
+
+    for (i = 0; i < removed->num; i++) {
+        key.str = (char *) removed->vals[i].data;
+        value.i = 0;
+        ret = hash_enter(table, &key, &value);
+        if (ret != HASH_SUCCESS) {
+            ret = LDB_ERR_OPERATIONS_ERROR;
+            goto done;
+        }
+    }
+
+    for (i = 0, n = 0; i < added->num; i++) {
+        key.str = (char *) added->vals[i].data;
+        if (hash_has_key(table, &key)) {
+            /* preexisting one, not removed, nor added */
+            value.i = 1;
+            ret = hash_enter(table, &key, &value);
+            if (ret != HASH_SUCCESS) {
+                ret = LDB_ERR_OPERATIONS_ERROR;
+                goto done;
+            }
+            continue;
+        }
+        added->vals[n++] = added->vals[i];
+    }
+    added->num = n;
+
+    for (i = 0, n = 0; i < removed->num; i++) {
+        key.str = (char *) removed->vals[i].data;
+        ret = hash_lookup(table, &key, &value);
+        if (ret != HASH_SUCCESS) {
+            ret = LDB_ERR_OPERATIONS_ERROR;
+            goto done;
+        }
+        if (value.i == 1) {
+            continue;
+        }
+        removed->vals[n++] = removed->vals[i];
+    }
+    removed->num = n;
+
+    ret = LDB_SUCCESS;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
 static int mbof_mod_process_ghel(TALLOC_CTX *mem_ctx,
                                  struct ldb_message *entry,
                                  const struct ldb_message_element *ghel,
@@ -3524,7 +3703,7 @@ static int mbof_mod_process_ghel(TALLOC_CTX *mem_ctx,
     const struct ldb_message_element *el;
     struct mbof_val_array *removed = NULL;
     struct mbof_val_array *added = NULL;
-    int i, j, ret;
+    int ret;
 
     if (!ghel) {
         /* Nothing to do.. */
@@ -3591,27 +3770,11 @@ static int mbof_mod_process_ghel(TALLOC_CTX *mem_ctx,
         }
 
         /* remove from arrays values that ended up unchanged */
-        if (removed && removed->num && added && added->num) {
-            for (i = 0; i < added->num; i++) {
-                for (j = 0; j < removed->num; j++) {
-                    if (strcmp((const char *) added->vals[i].data,
-                               (const char *) removed->vals[j].data) == 0) {
-                        break;
-                    }
-                }
-                if (j < removed->num) {
-                    /* preexisting one, not removed, nor added */
-                    for (; j+1 < removed->num; j++) {
-                        removed->vals[j] = removed->vals[j+1];
-                    }
-                    removed->num--;
-                    for (j = i; j+1 < added->num; j++) {
-                        added->vals[j] = added->vals[j+1];
-                    }
-                    added->num--;
-                    i--;
-                }
-            }
+        ret = mbof_drop_common_vals(mem_ctx, added, removed);
+        if (ret != LDB_SUCCESS) {
+            talloc_free(added);
+            talloc_free(removed);
+            return ret;
         }
         break;
 
@@ -172,6 +172,10 @@ struct dp_option ad_def_ldap_opts[] = {
     { "ldap_library_debug_level", DP_OPT_NUMBER, NULL_NUMBER, NULL_NUMBER},
     { "ldap_use_ppolicy", DP_OPT_BOOL, BOOL_TRUE, BOOL_TRUE },
     { "ldap_ppolicy_pwd_change_threshold", DP_OPT_NUMBER, { .number = 0 }, NULL_NUMBER },
+    { "ldap_connection_pool_size", DP_OPT_NUMBER, { .number = 1 }, NULL_NUMBER },
+    { "ldap_change_tracking", DP_OPT_STRING, { "none" }, NULL_STRING },
+    { "ldap_change_tracking_interval", DP_OPT_NUMBER, { .number = 60 }, NULL_NUMBER },
+    { "ldap_enumeration_search_partitions", DP_OPT_NUMBER, { .number = 1 }, NULL_NUMBER },
     DP_OPTION_TERMINATOR
 };
 
@@ -289,11 +289,17 @@ errno_t be_refresh_ctx_init_with_callbacks(struct be_ctx *be_ctx,
     return EOK;
 }
 
+/* A refresh cycle mostly only bumps the timestamps of the refreshed
+ * entries, write them to the timestamp cache in batches */
+#define BE_REFRESH_TS_BATCH_SIZE 1000
+#define BE_REFRESH_TS_FLUSH_MSEC 2000
+
 struct be_refresh_state {
     struct tevent_context *ev;
     struct be_ctx *be_ctx;
     struct be_refresh_ctx *ctx;
     struct be_refresh_cb_ctx *cb_ctx;
+    bool ts_batch;
 
     struct sss_domain_info *domain;
     enum be_refresh_type index;
@@ -316,6 +322,15 @@ static void be_refresh_batch_step_wakeup(struct tevent_context *ev,
 static errno_t be_refresh_step(struct tevent_req *req);
 static void be_refresh_done(struct tevent_req *subreq);
 
+static int be_refresh_state_destructor(struct be_refresh_state *state)
+{
+    if (state->ts_batch) {
+        sysdb_ts_batch_end(state->be_ctx->domain->sysdb);
+    }
+
+    return 0;
+}
+
 struct tevent_req *be_refresh_send(TALLOC_CTX *mem_ctx,
                                    struct tevent_context *ev,
                                    struct be_ctx *be_ctx,
@@ -350,6 +365,19 @@ struct tevent_req *be_refresh_send(TALLOC_CTX *mem_ctx,
         goto immediately;
     }
 
+    ret = sysdb_ts_batch_begin(be_ctx->domain->sysdb, ev,
+                               BE_REFRESH_TS_BATCH_SIZE,
+                               BE_REFRESH_TS_FLUSH_MSEC);
+    if (ret == EOK) {
+        state->ts_batch = true;
+        talloc_set_destructor(state, be_refresh_state_destructor);
+    } else {
+        /* Not fatal, the updates are just written one by one */
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Cannot batch timestamp cache updates [%d]: %s\n",
+              ret, sss_strerror(ret));
+    }
+
     ret = be_refresh_step(req);
     if (ret == EOK) {
         goto immediately;
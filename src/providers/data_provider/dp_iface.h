@@ -204,6 +204,20 @@ errno_t dp_backend_is_online(TALLOC_CTX *mem_ctx,
                              const char *domname,
                              bool *_is_online);
 
+/* The values returned by TransactionStats hold DP_TXN_STATS_STRIDE numbers
+ * for each name: count, cancelled, total_us, max_us and the buckets of the
+ * histogram as described at struct sysdb_txn_histogram. The first
+ * SYSDB_TXN_STATS_LEVELS names are the nesting levels, the rest are the
+ * callers of outermost transactions. */
+#define DP_TXN_STATS_STRIDE (4 + SYSDB_TXN_STATS_BUCKETS)
+
+errno_t dp_backend_transaction_stats(TALLOC_CTX *mem_ctx,
+                                     struct sbus_request *sbus_req,
+                                     struct be_ctx *be_ctx,
+                                     const char *domname,
+                                     const char ***_names,
+                                     uint64_t **_values);
+
 /* sssd.DataProvider.Failover */
 errno_t
 dp_failover_list_services(TALLOC_CTX *mem_ctx,
@@ -57,3 +57,97 @@ dp_backend_is_online(TALLOC_CTX *mem_ctx,
 
     return EOK;
 }
+
+static errno_t
+dp_backend_add_txn_histogram(struct sysdb_txn_histogram *hist,
+                             const char **names,
+                             uint64_t *values,
+                             size_t index)
+{
+    uint64_t *v = &values[index * DP_TXN_STATS_STRIDE];
+
+    names[index] = talloc_strdup(names, hist->name);
+    if (names[index] == NULL) {
+        return ENOMEM;
+    }
+
+    v[0] = hist->count;
+    v[1] = hist->cancelled;
+    v[2] = hist->total_us;
+    v[3] = hist->max_us;
+    memcpy(&v[4], hist->buckets, sizeof(hist->buckets));
+
+    return EOK;
+}
+
+errno_t
+dp_backend_transaction_stats(TALLOC_CTX *mem_ctx,
+                             struct sbus_request *sbus_req,
+                             struct be_ctx *be_ctx,
+                             const char *domname,
+                             const char ***_names,
+                             uint64_t **_values)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct sss_domain_info *domain;
+    struct sysdb_txn_histogram *levels;
+    struct sysdb_txn_histogram *callers;
+    size_t num_callers;
+    size_t num;
+    const char **names;
+    uint64_t *values;
+    errno_t ret;
+
+    if (SBUS_REQ_STRING_IS_EMPTY(domname)) {
+        domain = be_ctx->domain;
+    } else {
+        domain = find_domain_by_name(be_ctx->domain, domname, false);
+        if (domain == NULL) {
+            return ERR_DOMAIN_NOT_FOUND;
+        }
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sysdb_transaction_stats(tmp_ctx, domain->sysdb, &levels,
+                                  &callers, &num_callers);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    num = SYSDB_TXN_STATS_LEVELS + num_callers;
+
+    names = talloc_zero_array(tmp_ctx, const char *, num + 1);
+    values = talloc_zero_array(tmp_ctx, uint64_t, num * DP_TXN_STATS_STRIDE);
+    if (names == NULL || values == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (size_t i = 0; i < SYSDB_TXN_STATS_LEVELS; i++) {
+        ret = dp_backend_add_txn_histogram(&levels[i], names, values, i);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    for (size_t i = 0; i < num_callers; i++) {
+        ret = dp_backend_add_txn_histogram(&callers[i], names, values,
+                                           SYSDB_TXN_STATS_LEVELS + i);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    *_names = talloc_steal(mem_ctx, names);
+    *_values = talloc_steal(mem_ctx, values);
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+
+    return ret;
+}
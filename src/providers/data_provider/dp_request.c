@@ -385,6 +385,7 @@ static void dp_req_done(struct tevent_req *subreq)
     struct dp_req_state *state;
     struct tevent_req *req;
     errno_t ret;
+    errno_t sret;
 
     req = tevent_req_callback_data(subreq, struct tevent_req);
     state = tevent_req_data(req, struct dp_req_state);
@@ -395,6 +396,18 @@ static void dp_req_done(struct tevent_req *subreq)
     talloc_zfree(subreq);
     state->dp_req->handler_req = NULL;
 
+    /* The responder reads the cache as soon as we reply, make sure it
+     * sees the timestamps written by this request. */
+    if (state->dp_req->domain != NULL
+            && state->dp_req->domain->sysdb != NULL) {
+        sret = sysdb_ts_batch_flush(state->dp_req->domain->sysdb);
+        if (sret != EOK) {
+            DP_REQ_DEBUG(SSSDBG_MINOR_FAILURE, state->dp_req->name,
+                         "Cannot flush timestamp cache updates [%d]: %s",
+                         sret, sss_strerror(sret));
+        }
+    }
+
     PROBE(DP_REQ_DONE, state->dp_req->name, state->dp_req->target,
           state->dp_req->method, ret, sss_strerror(ret));
 
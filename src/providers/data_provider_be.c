@@ -59,6 +59,10 @@
 #define OFFLINE_TIMEOUT_DEFAULT 60
 #define OFFLINE_TIMEOUT_MAX_DEFAULT 3600
 
+/* Changes are usually stored in bursts, e.g. by a refresh. Publishing a
+ * little later takes a whole burst into one snapshot. */
+#define BE_CACHE_SNAPSHOT_DELAY_MSEC 1000
+
 /* sssd.service */
 static errno_t
 data_provider_go_offline(TALLOC_CTX *mem_ctx,
@@ -575,6 +579,67 @@ static int watch_netlink(struct be_ctx *ctx)
     return EOK;
 }
 
+static errno_t
+be_publish_cache_snapshot(TALLOC_CTX *mem_ctx,
+                          struct tevent_context *ev,
+                          struct be_ctx *be_ctx,
+                          struct be_ptask *be_ptask,
+                          void *pvt)
+{
+    return sysdb_snapshot_publish(be_ctx->domain->sysdb);
+}
+
+static errno_t be_cache_snapshot_init(struct be_ctx *be_ctx)
+{
+    int interval;
+    errno_t ret;
+
+    /* A snapshot left over from the previous run may not match the cache
+     * anymore, e.g. if the cache was removed in the meantime */
+    ret = sysdb_snapshot_remove(be_ctx->domain->sysdb);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = confdb_get_int(be_ctx->cdb, be_ctx->conf_path,
+                         CONFDB_DOMAIN_CACHE_SNAPSHOT_INTERVAL, 0,
+                         &interval);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CONF_SETTINGS,
+              "Failed to get cache_snapshot_interval from confdb. "
+              "Cache snapshot will be disabled.\n");
+        return EOK;
+    }
+
+    if (interval <= 0) {
+        return EOK;
+    }
+
+    ret = be_ptask_create_sync(be_ctx, be_ctx, interval, interval,
+                               interval, 0, interval, 0,
+                               be_publish_cache_snapshot, NULL,
+                               "Cache snapshot",
+                               BE_PTASK_OFFLINE_EXECUTE, NULL);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "Unable to initialize cache snapshot periodic task "
+              "[%d]: %s\n", ret, sss_strerror(ret));
+        return ret;
+    }
+
+    /* The periodic task catches changes made outside of sysdb transactions */
+    ret = sysdb_snapshot_publish_on_change(be_ctx->domain->sysdb, be_ctx->ev,
+                                           BE_CACHE_SNAPSHOT_DELAY_MSEC);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "Unable to publish cache snapshots on change [%d]: %s\n",
+              ret, sss_strerror(ret));
+        return ret;
+    }
+
+    return EOK;
+}
+
 static errno_t
 be_register_monitor_iface(struct sbus_connection *conn, struct be_ctx *be_ctx)
 {
@@ -748,6 +813,11 @@ errno_t be_process_init(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
+    ret = be_cache_snapshot_init(be_ctx);
+    if (ret != EOK) {
+        goto done;
+    }
+
     ret = sss_monitor_register_service(be_ctx, be_ctx->conn,
                                        be_ctx->identity, DATA_PROVIDER_VERSION,
                                        MT_SVC_PROVIDER);
@@ -34,6 +34,7 @@
 #include "util/crypto/sss_crypto.h"
 
 #include "providers/ldap/sdap_idmap.h"
+#include "providers/ldap/sdap_sync.h"
 
 errno_t ldap_id_setup_tasks(struct sdap_id_ctx *ctx)
 {
@@ -65,8 +66,12 @@ errno_t sdap_id_setup_tasks(struct be_ctx *be_ctx,
                                   sdom->dom->name);
         ret = ldap_id_setup_cleanup(ctx, sdom);
     }
+    if (ret != EOK) {
+        return ret;
+    }
 
-    return ret;
+    /* set up server side change tracking task */
+    return sdap_sync_setup_task(be_ctx, ctx, sdom);
 }
 
 static void sdap_uri_callback(void *private_data, struct fo_server *server)
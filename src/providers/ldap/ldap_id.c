@@ -525,7 +525,8 @@ static void users_get_search(struct tevent_req *req)
                                  state->attrs, state->filter,
                                  dp_opt_get_int(state->ctx->opts->basic,
                                                 SDAP_SEARCH_TIMEOUT),
-                                 lookup_type, state->extra_attrs);
+                                 lookup_type, state->extra_attrs,
+                                 NULL, NULL);
     if (!subreq) {
         tevent_req_error(req, ENOMEM);
         return;
@@ -240,6 +240,10 @@ enum sdap_basic_opt {
     SDAP_LIBRARY_DEBUG_LEVEL,
     SDAP_USE_PPOLICY,
     SDAP_PPOLICY_PWD_CHANGE_THRESHOLD,
+    SDAP_CONNECTION_POOL_SIZE,
+    SDAP_CHANGE_TRACKING,
+    SDAP_CHANGE_TRACKING_INTERVAL,
+    SDAP_ENUM_SEARCH_PARTITIONS,
 
     SDAP_OPTS_BASIC /* opts counter */
 };
@@ -21,6 +21,7 @@
 
 
 #include <ctype.h>
+#include <sys/resource.h>
 #include "util/util.h"
 #include "util/strtonum.h"
 #include "util/probes.h"
@@ -39,6 +40,8 @@ struct sdap_op {
     uint64_t start_time;
     int timeout;
     bool done;
+    /* intermediate responses precede the final result of the operation */
+    bool intermediate;
 
     sdap_op_callback_t *callback;
     void *data;
@@ -369,6 +372,13 @@ static void sdap_process_message(struct tevent_context *ev,
         /* go and process entry */
         break;
 
+    case LDAP_RES_INTERMEDIATE:
+        if (op->intermediate) {
+            /* more results follow, see sdap_get_ctrl_search_send() */
+            break;
+        }
+        /* fall through */
+        SSS_ATTRIBUTE_FALLTHROUGH;
     case LDAP_RES_BIND:
     case LDAP_RES_SEARCH_RESULT:
     case LDAP_RES_MODIFY:
@@ -377,7 +387,6 @@ static void sdap_process_message(struct tevent_context *ev,
     case LDAP_RES_MODDN:
     case LDAP_RES_COMPARE:
     case LDAP_RES_EXTENDED:
-    case LDAP_RES_INTERMEDIATE:
         /* no more results expected with this msgid */
         op->done = true;
         break;
@@ -1996,12 +2005,32 @@ static void generic_ext_search_handler(struct tevent_req *subreq,
 }
 
 /* ==Generic Search exposing all options======================= */
+#ifdef HAVE_SYSTEMTAP
+/* Peak resident set size of the process, reported by the stream probes */
+static long sdap_peak_rss_kb(void)
+{
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+
+    return usage.ru_maxrss;
+}
+#endif
+
 struct sdap_get_and_parse_generic_state {
     struct sdap_attr_map *map;
     int map_num_attrs;
 
     struct sdap_reply sreply;
     struct sdap_options *opts;
+
+    const char *filter;
+    sdap_stream_batch_fn batch_fn;
+    void *batch_pvt;
+    size_t num_entries;
+    size_t num_batches;
 };
 
 static void sdap_get_and_parse_generic_done(struct tevent_req *subreq);
@@ -2009,22 +2038,25 @@ static errno_t sdap_get_and_parse_generic_parse_entry(struct sdap_handle *sh,
                                                       struct sdap_msg *msg,
                                                       void *pvt);
 
-struct tevent_req *sdap_get_and_parse_generic_send(TALLOC_CTX *memctx,
-                                                   struct tevent_context *ev,
-                                                   struct sdap_options *opts,
-                                                   struct sdap_handle *sh,
-                                                   const char *search_base,
-                                                   int scope,
-                                                   const char *filter,
-                                                   const char **attrs,
-                                                   struct sdap_attr_map *map,
-                                                   int map_num_attrs,
-                                                   int attrsonly,
-                                                   LDAPControl **serverctrls,
-                                                   LDAPControl **clientctrls,
-                                                   int sizelimit,
-                                                   int timeout,
-                                                   bool allow_paging)
+static struct tevent_req *
+sdap_get_and_parse_generic_internal_send(TALLOC_CTX *memctx,
+                                         struct tevent_context *ev,
+                                         struct sdap_options *opts,
+                                         struct sdap_handle *sh,
+                                         const char *search_base,
+                                         int scope,
+                                         const char *filter,
+                                         const char **attrs,
+                                         struct sdap_attr_map *map,
+                                         int map_num_attrs,
+                                         int attrsonly,
+                                         LDAPControl **serverctrls,
+                                         LDAPControl **clientctrls,
+                                         int sizelimit,
+                                         int timeout,
+                                         bool allow_paging,
+                                         sdap_stream_batch_fn batch_fn,
+                                         void *batch_pvt)
 {
     struct tevent_req *req = NULL;
     struct tevent_req *subreq = NULL;
@@ -2038,6 +2070,9 @@ struct tevent_req *sdap_get_and_parse_generic_send(TALLOC_CTX *memctx,
     state->map = map;
     state->map_num_attrs = map_num_attrs;
     state->opts = opts;
+    state->filter = filter;
+    state->batch_fn = batch_fn;
+    state->batch_pvt = batch_pvt;
 
     if (allow_paging) {
         flags |= SDAP_SRCH_FLG_PAGING;
@@ -2047,6 +2082,11 @@ struct tevent_req *sdap_get_and_parse_generic_send(TALLOC_CTX *memctx,
         flags |= SDAP_SRCH_FLG_ATTRS_ONLY;
     }
 
+    if (batch_fn != NULL) {
+        PROBE(SDAP_STREAM_SEARCH_START, PROBE_SAFE_STR(filter),
+              sdap_peak_rss_kb());
+    }
+
     subreq = sdap_get_generic_ext_send(state, ev, opts, sh, search_base,
                                        scope, filter, attrs, serverctrls,
                                        clientctrls, sizelimit, timeout,
@@ -2061,6 +2101,94 @@ struct tevent_req *sdap_get_and_parse_generic_send(TALLOC_CTX *memctx,
     return req;
 }
 
+struct tevent_req *sdap_get_and_parse_generic_send(TALLOC_CTX *memctx,
+                                                   struct tevent_context *ev,
+                                                   struct sdap_options *opts,
+                                                   struct sdap_handle *sh,
+                                                   const char *search_base,
+                                                   int scope,
+                                                   const char *filter,
+                                                   const char **attrs,
+                                                   struct sdap_attr_map *map,
+                                                   int map_num_attrs,
+                                                   int attrsonly,
+                                                   LDAPControl **serverctrls,
+                                                   LDAPControl **clientctrls,
+                                                   int sizelimit,
+                                                   int timeout,
+                                                   bool allow_paging)
+{
+    return sdap_get_and_parse_generic_internal_send(memctx, ev, opts, sh,
+                                                    search_base, scope,
+                                                    filter, attrs,
+                                                    map, map_num_attrs,
+                                                    attrsonly, serverctrls,
+                                                    clientctrls, sizelimit,
+                                                    timeout, allow_paging,
+                                                    NULL, NULL);
+}
+
+struct tevent_req *
+sdap_get_and_parse_generic_stream_send(TALLOC_CTX *memctx,
+                                       struct tevent_context *ev,
+                                       struct sdap_options *opts,
+                                       struct sdap_handle *sh,
+                                       const char *search_base,
+                                       int scope,
+                                       const char *filter,
+                                       const char **attrs,
+                                       struct sdap_attr_map *map,
+                                       int map_num_attrs,
+                                       int sizelimit,
+                                       int timeout,
+                                       bool allow_paging,
+                                       sdap_stream_batch_fn batch_fn,
+                                       void *batch_pvt)
+{
+    if (batch_fn == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Streamed search without a callback\n");
+        return NULL;
+    }
+
+    return sdap_get_and_parse_generic_internal_send(memctx, ev, opts, sh,
+                                                    search_base, scope,
+                                                    filter, attrs,
+                                                    map, map_num_attrs,
+                                                    0, NULL, NULL,
+                                                    sizelimit, timeout,
+                                                    allow_paging,
+                                                    batch_fn, batch_pvt);
+}
+
+/* Hands the collected entries over to the stream callback and frees them */
+static errno_t
+sdap_get_and_parse_generic_flush(struct sdap_get_and_parse_generic_state *state)
+{
+    errno_t ret;
+
+    if (state->sreply.reply_count == 0) {
+        return EOK;
+    }
+
+    ret = state->batch_fn(state->sreply.reply, state->sreply.reply_count,
+                          state->batch_pvt);
+
+    state->num_entries += state->sreply.reply_count;
+    state->num_batches++;
+
+    talloc_zfree(state->sreply.reply);
+    state->sreply.reply_count = 0;
+    state->sreply.reply_max = 0;
+
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Processing a batch of entries failed [%d]: %s\n",
+              ret, sss_strerror(ret));
+    }
+
+    return ret;
+}
+
 static errno_t sdap_get_and_parse_generic_parse_entry(struct sdap_handle *sh,
                                                       struct sdap_msg *msg,
                                                       void *pvt)
@@ -2090,6 +2218,12 @@ static errno_t sdap_get_and_parse_generic_parse_entry(struct sdap_handle *sh,
     }
 
     /* add_to_reply steals attrs, no need to free them here */
+
+    if (state->batch_fn != NULL
+            && state->sreply.reply_count >= SDAP_STREAM_BATCH_SIZE) {
+        return sdap_get_and_parse_generic_flush(state);
+    }
+
     return EOK;
 }
 
@@ -2099,8 +2233,37 @@ static void sdap_get_and_parse_generic_done(struct tevent_req *subreq)
                                                       struct tevent_req);
     struct sdap_get_and_parse_generic_state *state =
                 tevent_req_data(req, struct sdap_get_and_parse_generic_state);
+    size_t ref_count;
+    char **refs;
+    errno_t ret;
 
-    return generic_ext_search_handler(subreq, state->opts);
+    if (state->batch_fn == NULL) {
+        return generic_ext_search_handler(subreq, state->opts);
+    }
+
+    ret = sdap_get_generic_ext_recv(subreq, state, &ref_count, &refs);
+    talloc_zfree(subreq);
+    if (ret == EOK) {
+        /* Referrals are ignored as in the generic handler */
+        talloc_free(refs);
+        ret = sdap_get_and_parse_generic_flush(state);
+    }
+
+    PROBE(SDAP_STREAM_SEARCH_END, PROBE_SAFE_STR(state->filter),
+          state->num_entries, state->num_batches, sdap_peak_rss_kb());
+
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Streamed search failed [%d]: %s\n",
+              ret, sss_strerror(ret));
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC,
+          "Streamed search returned %zu entries in %zu batches\n",
+          state->num_entries, state->num_batches);
+
+    tevent_req_done(req);
 }
 
 int sdap_get_and_parse_generic_recv(struct tevent_req *req,
@@ -2648,6 +2811,209 @@ int sdap_sd_search_recv(struct tevent_req *req,
     return EOK;
 }
 
+/* ==Search returning the response control=============================== */
+struct sdap_get_ctrl_search_state {
+    struct sdap_handle *sh;
+    struct sdap_op *op;
+    const char *resp_ctrl_oid;
+
+    sdap_ctrl_search_cb msg_cb;
+    void *cb_data;
+
+    int result;
+    struct berval *resp_ctrl_value;
+};
+
+static void sdap_get_ctrl_search_done(struct sdap_op *op,
+                                      struct sdap_msg *reply,
+                                      int error, void *pvt);
+
+struct tevent_req *
+sdap_get_ctrl_search_send(TALLOC_CTX *memctx,
+                          struct tevent_context *ev,
+                          struct sdap_handle *sh,
+                          const char *search_base,
+                          int scope,
+                          const char *filter,
+                          const char **attrs,
+                          LDAPControl **serverctrls,
+                          const char *resp_ctrl_oid,
+                          int timeout,
+                          sdap_ctrl_search_cb msg_cb,
+                          void *cb_data)
+{
+    struct sdap_get_ctrl_search_state *state;
+    struct tevent_req *req;
+    char *stat_info;
+    int msgid;
+    int lret;
+    errno_t ret;
+
+    req = tevent_req_create(memctx, &state,
+                            struct sdap_get_ctrl_search_state);
+    if (req == NULL) {
+        return NULL;
+    }
+
+    state->sh = sh;
+    state->resp_ctrl_oid = resp_ctrl_oid;
+    state->msg_cb = msg_cb;
+    state->cb_data = cb_data;
+    state->result = LDAP_OTHER;
+
+    DEBUG(SSSDBG_TRACE_INTERNAL,
+          "calling ldap_search_ext with [%s][%s].\n",
+          filter == NULL ? "no filter" : filter, search_base);
+
+    lret = ldap_search_ext(sh->ldap, search_base, scope, filter,
+                           discard_const(attrs), 0, serverctrls, NULL,
+                           NULL, 0, &msgid);
+    if (lret != LDAP_SUCCESS) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "ldap_search_ext failed: %s\n", sss_ldap_err2string(lret));
+        if (lret == LDAP_SERVER_DOWN) {
+            ret = ETIMEDOUT;
+        } else if (lret == LDAP_FILTER_ERROR) {
+            ret = ERR_INVALID_FILTER;
+        } else {
+            ret = EIO;
+        }
+        goto fail;
+    }
+    DEBUG(SSSDBG_TRACE_INTERNAL, "ldap_search_ext called, msgid = %d\n", msgid);
+
+    stat_info = talloc_asprintf(state, "server: [%s] filter: [%s] base: [%s]",
+                                sdap_get_server_peer_str_safe(sh),
+                                filter, search_base);
+    if (stat_info == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE, "Failed to create info string, ignored.\n");
+    }
+
+    ret = sdap_op_add(state, ev, sh, msgid, stat_info,
+                      sdap_get_ctrl_search_done, req, timeout, &state->op);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to set up operation!\n");
+        goto fail;
+    }
+
+    /* The sync protocol sends intermediate responses in the middle of
+     * the search, the search result still ends it */
+    state->op->intermediate = true;
+
+    return req;
+
+fail:
+    tevent_req_error(req, ret);
+    tevent_req_post(req, ev);
+    return req;
+}
+
+static void sdap_get_ctrl_search_done(struct sdap_op *op,
+                                      struct sdap_msg *reply,
+                                      int error, void *pvt)
+{
+    struct tevent_req *req = talloc_get_type(pvt, struct tevent_req);
+    struct sdap_get_ctrl_search_state *state = tevent_req_data(req,
+                                        struct sdap_get_ctrl_search_state);
+    LDAPControl **returned_controls = NULL;
+    LDAPControl *resp_ctrl;
+    char *errmsg = NULL;
+    int lret;
+    errno_t ret;
+
+    if (error) {
+        tevent_req_error(req, error);
+        return;
+    }
+
+    switch (ldap_msgtype(reply->msg)) {
+    case LDAP_RES_SEARCH_REFERENCE:
+        /* Referrals are not followed by change tracking searches */
+        sdap_unlock_next_reply(state->op);
+        break;
+
+    case LDAP_RES_SEARCH_ENTRY:
+    case LDAP_RES_INTERMEDIATE:
+        ret = state->msg_cb(state->sh, reply->msg, state->cb_data);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "reply parsing callback failed.\n");
+            tevent_req_error(req, ret);
+            return;
+        }
+
+        sdap_unlock_next_reply(state->op);
+        break;
+
+    case LDAP_RES_SEARCH_RESULT:
+        lret = ldap_parse_result(state->sh->ldap, reply->msg,
+                                 &state->result, NULL, &errmsg, NULL,
+                                 &returned_controls, 0);
+        if (lret != LDAP_SUCCESS) {
+            DEBUG(SSSDBG_OP_FAILURE,
+                  "ldap_parse_result failed (%d)\n", state->op->msgid);
+            tevent_req_error(req, EIO);
+            return;
+        }
+
+        DEBUG(SSSDBG_TRACE_FUNC, "Search result: %s(%d), %s\n",
+              sss_ldap_err2string(state->result), state->result,
+              errmsg ? errmsg : "no errmsg set");
+        ldap_memfree(errmsg);
+
+        resp_ctrl = ldap_control_find(state->resp_ctrl_oid,
+                                      returned_controls, NULL);
+        if (resp_ctrl != NULL && resp_ctrl->ldctl_value.bv_val != NULL) {
+            state->resp_ctrl_value = talloc_zero(state, struct berval);
+            if (state->resp_ctrl_value == NULL) {
+                ldap_controls_free(returned_controls);
+                tevent_req_error(req, ENOMEM);
+                return;
+            }
+
+            state->resp_ctrl_value->bv_len = resp_ctrl->ldctl_value.bv_len;
+            state->resp_ctrl_value->bv_val = talloc_memdup(
+                                                state->resp_ctrl_value,
+                                                resp_ctrl->ldctl_value.bv_val,
+                                                resp_ctrl->ldctl_value.bv_len);
+            if (state->resp_ctrl_value->bv_val == NULL) {
+                ldap_controls_free(returned_controls);
+                tevent_req_error(req, ENOMEM);
+                return;
+            }
+        }
+        ldap_controls_free(returned_controls);
+
+        tevent_req_done(req);
+        return;
+
+    default:
+        /* what is going on here !? */
+        tevent_req_error(req, EIO);
+        return;
+    }
+}
+
+int sdap_get_ctrl_search_recv(struct tevent_req *req,
+                              TALLOC_CTX *mem_ctx,
+                              int *_result,
+                              struct berval **_resp_ctrl_value)
+{
+    struct sdap_get_ctrl_search_state *state = tevent_req_data(req,
+                                        struct sdap_get_ctrl_search_state);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    if (_result != NULL) {
+        *_result = state->result;
+    }
+
+    if (_resp_ctrl_value != NULL) {
+        *_resp_ctrl_value = talloc_steal(mem_ctx, state->resp_ctrl_value);
+    }
+
+    return EOK;
+}
+
 /* ==Attribute scoped search============================================ */
 struct sdap_asq_search_state {
     struct sdap_attr_map_info *maps;
@@ -80,7 +80,11 @@ int sdap_search_user_recv(TALLOC_CTX *memctx, struct tevent_req *req,
                           char **higher_usn, struct sysdb_attrs ***users,
                           size_t *count);
 
-/* Search users in LDAP using the request above, save them to cache */
+/* Decides whether an entry returned by a search is saved to the cache */
+typedef bool (*sdap_entry_keep_fn)(struct sysdb_attrs *entry, void *pvt);
+
+/* Search users in LDAP using the request above, save them to cache. When
+ * keep_fn is set only the users it accepts are saved. */
 struct tevent_req *sdap_get_users_send(TALLOC_CTX *memctx,
                                        struct tevent_context *ev,
                                        struct sss_domain_info *dom,
@@ -92,7 +96,9 @@ struct tevent_req *sdap_get_users_send(TALLOC_CTX *memctx,
                                        const char *filter,
                                        int timeout,
                                        enum sdap_entry_lookup_type lookup_type,
-                                       struct sysdb_attrs *mapped_attrs);
+                                       struct sysdb_attrs *mapped_attrs,
+                                       sdap_entry_keep_fn keep_fn,
+                                       void *keep_pvt);
 int sdap_get_users_recv(struct tevent_req *req,
                         TALLOC_CTX *mem_ctx, char **timestamp);
 
@@ -246,6 +252,35 @@ int sdap_get_and_parse_generic_recv(struct tevent_req *req,
                                     size_t *reply_count,
                                     struct sysdb_attrs ***reply);
 
+/* Number of parsed entries handed over at once by a streamed search */
+#define SDAP_STREAM_BATCH_SIZE 256
+
+/* Receives a batch of entries of a streamed search. The entries are freed
+ * when the callback returns, an error cancels the search. */
+typedef errno_t (*sdap_stream_batch_fn)(struct sysdb_attrs **entries,
+                                        size_t count,
+                                        void *pvt);
+
+/* Like sdap_get_and_parse_generic_send() but the entries are handed over to
+ * batch_fn while the search is still running instead of being collected,
+ * sdap_get_and_parse_generic_recv() then returns no entries. */
+struct tevent_req *
+sdap_get_and_parse_generic_stream_send(TALLOC_CTX *memctx,
+                                       struct tevent_context *ev,
+                                       struct sdap_options *opts,
+                                       struct sdap_handle *sh,
+                                       const char *search_base,
+                                       int scope,
+                                       const char *filter,
+                                       const char **attrs,
+                                       struct sdap_attr_map *map,
+                                       int map_num_attrs,
+                                       int sizelimit,
+                                       int timeout,
+                                       bool allow_paging,
+                                       sdap_stream_batch_fn batch_fn,
+                                       void *batch_pvt);
+
 struct tevent_req *sdap_get_generic_send(TALLOC_CTX *memctx,
                                          struct tevent_context *ev,
                                          struct sdap_options *opts,
@@ -323,6 +358,32 @@ int sdap_sd_search_recv(struct tevent_req *req,
                         size_t *_ref_count,
                         char ***_refs);
 
+/* Called for every entry and intermediate response of the search */
+typedef errno_t (*sdap_ctrl_search_cb)(struct sdap_handle *sh,
+                                       LDAPMessage *msg,
+                                       void *pvt);
+
+/* Search which is not paged and returns the result code and the value of
+ * the response control resp_ctrl_oid instead of failing on unexpected
+ * results. Used by the change tracking searches. */
+struct tevent_req *
+sdap_get_ctrl_search_send(TALLOC_CTX *memctx,
+                          struct tevent_context *ev,
+                          struct sdap_handle *sh,
+                          const char *search_base,
+                          int scope,
+                          const char *filter,
+                          const char **attrs,
+                          LDAPControl **serverctrls,
+                          const char *resp_ctrl_oid,
+                          int timeout,
+                          sdap_ctrl_search_cb msg_cb,
+                          void *cb_data);
+int sdap_get_ctrl_search_recv(struct tevent_req *req,
+                              TALLOC_CTX *mem_ctx,
+                              int *_result,
+                              struct berval **_resp_ctrl_value);
+
 errno_t
 sdap_attrs_add_ldap_attr(struct sysdb_attrs *ldap_attrs,
                          const char *attr_name,
@@ -24,6 +24,7 @@
 */
 
 #include <errno.h>
+#include <ctype.h>
 
 #include "util/util.h"
 #include "db/sysdb.h"
@@ -36,6 +37,7 @@ static struct tevent_req *enum_users_send(TALLOC_CTX *memctx,
                                           struct tevent_context *ev,
                                           struct sdap_id_ctx *ctx,
                                           struct sdap_domain *sdom,
+                                          struct sdap_id_conn_cache *conn_cache,
                                           struct sdap_id_op *op,
                                           bool purge);
 static errno_t enum_users_recv(struct tevent_req *req);
@@ -44,6 +46,7 @@ static struct tevent_req *enum_groups_send(TALLOC_CTX *memctx,
                                           struct tevent_context *ev,
                                           struct sdap_id_ctx *ctx,
                                           struct sdap_domain *sdom,
+                                          struct sdap_id_conn_cache *conn_cache,
                                           struct sdap_id_op *op,
                                           bool purge);
 static errno_t enum_groups_recv(struct tevent_req *req);
@@ -186,6 +189,7 @@ static void sdap_dom_enum_ex_get_users(struct tevent_req *subreq)
 
     subreq = enum_users_send(state, state->ev,
                              state->ctx, state->sdom,
+                             state->user_conn->conn_cache,
                              state->user_op, state->purge);
     if (subreq == NULL) {
         tevent_req_error(req, ENOMEM);
@@ -257,6 +261,7 @@ static void sdap_dom_enum_ex_get_groups(struct tevent_req *subreq)
 
     subreq = enum_groups_send(state, state->ev, state->ctx,
                               state->sdom,
+                              state->group_conn->conn_cache,
                               state->group_op, state->purge);
     if (subreq == NULL) {
         tevent_req_error(req, ENOMEM);
@@ -417,6 +422,439 @@ errno_t sdap_dom_enum_recv(struct tevent_req *req)
     return sdap_dom_enum_ex_recv(req);
 }
 
+/* ==Partitioned-Enumeration-Search======================================== */
+
+/* A full enumeration can be split into several searches running at the same
+ * time, each one on its own connection from the pool. The entries are split
+ * by the first character of their name, the last partition gets all names
+ * which do not start with any of these characters. */
+#define ENUM_PARTITION_CHARS "abcdefghijklmnopqrstuvwxyz0123456789"
+#define ENUM_MAX_PARTITIONS 16
+
+enum enum_search_type {
+    ENUM_SEARCH_USERS,
+    ENUM_SEARCH_GROUPS
+};
+
+struct enum_search_state {
+    struct tevent_context *ev;
+    struct sdap_id_ctx *ctx;
+    struct sdap_domain *sdom;
+    enum enum_search_type type;
+    const char **attrs;
+
+    size_t num_parts;
+    size_t num_active;
+    char *higher_usn;
+    errno_t error;
+};
+
+struct enum_search_part {
+    struct tevent_req *req;
+    size_t idx;
+    char *filter;
+    struct sdap_id_op *op;
+    bool own_op;
+};
+
+static errno_t enum_search_part_connect(struct enum_search_part *part);
+static void enum_search_part_connected(struct tevent_req *subreq);
+static errno_t enum_search_part_search(struct enum_search_part *part);
+static void enum_search_part_done(struct tevent_req *subreq);
+static void enum_search_part_finish(struct enum_search_part *part,
+                                    errno_t ret);
+
+/* Range of ENUM_PARTITION_CHARS searched by the partition idx, the last
+ * partition searches the names not starting with any of them */
+static void enum_search_part_range(size_t idx, size_t num_parts,
+                                   size_t *_start, size_t *_end)
+{
+    size_t num_chars = sizeof(ENUM_PARTITION_CHARS) - 1;
+
+    if (idx == num_parts - 1) {
+        *_start = 0;
+        *_end = num_chars;
+        return;
+    }
+
+    *_start = idx * num_chars / (num_parts - 1);
+    *_end = (idx + 1) * num_chars / (num_parts - 1);
+}
+
+static char *enum_search_part_filter(TALLOC_CTX *mem_ctx,
+                                     const char *name_attr,
+                                     const char *base_filter,
+                                     size_t idx,
+                                     size_t num_parts)
+{
+    const char *chars = ENUM_PARTITION_CHARS;
+    size_t start;
+    size_t end;
+    bool last;
+    char *filter;
+    size_t i;
+
+    if (num_parts == 1) {
+        return talloc_strdup(mem_ctx, base_filter);
+    }
+
+    enum_search_part_range(idx, num_parts, &start, &end);
+
+    last = (idx == num_parts - 1);
+    if (last) {
+        filter = talloc_asprintf(mem_ctx, "(&%s(!(|", base_filter);
+    } else {
+        filter = talloc_asprintf(mem_ctx, "(&%s(|", base_filter);
+    }
+
+    for (i = start; i < end && filter != NULL; i++) {
+        filter = talloc_asprintf_append_buffer(filter, "(%s=%c*)",
+                                               name_attr, chars[i]);
+    }
+
+    if (filter != NULL) {
+        filter = talloc_asprintf_append_buffer(filter, last ? ")))" : "))");
+    }
+
+    return filter;
+}
+
+/* Partition whose search returns the names starting with c */
+static size_t enum_search_char_part(char c, size_t num_parts)
+{
+    const char *pos;
+    size_t start;
+    size_t end;
+    size_t i;
+    size_t idx;
+
+    pos = strchr(ENUM_PARTITION_CHARS, tolower((unsigned char) c));
+    if (c == '\0' || pos == NULL) {
+        return num_parts - 1;
+    }
+    i = pos - ENUM_PARTITION_CHARS;
+
+    for (idx = 0; idx < num_parts - 1; idx++) {
+        enum_search_part_range(idx, num_parts, &start, &end);
+        if (i >= start && i < end) {
+            return idx;
+        }
+    }
+
+    return num_parts - 1;
+}
+
+/* An entry with several names is returned by the search of each partition
+ * one of its names falls into. Only the first of these partitions saves it,
+ * the last partition returns the entry only if no other one does. */
+static bool enum_search_part_keep(struct sysdb_attrs *entry, void *pvt)
+{
+    struct enum_search_part *part = talloc_get_type(pvt,
+                                                    struct enum_search_part);
+    struct enum_search_state *state = tevent_req_data(part->req,
+                                                  struct enum_search_state);
+    struct ldb_message_element *el;
+    size_t owner;
+    size_t idx;
+    size_t i;
+    errno_t ret;
+
+    ret = sysdb_attrs_get_el_ext(entry, SYSDB_NAME, false, &el);
+    if (ret != EOK || el->num_values < 2) {
+        /* a single name matches the filter of this partition only */
+        return true;
+    }
+
+    owner = state->num_parts - 1;
+    for (i = 0; i < el->num_values; i++) {
+        idx = enum_search_char_part((char) el->values[i].data[0],
+                                    state->num_parts);
+        if (idx < owner) {
+            owner = idx;
+        }
+    }
+
+    return owner == part->idx;
+}
+
+static struct tevent_req *enum_search_send(TALLOC_CTX *memctx,
+                                           struct tevent_context *ev,
+                                           struct sdap_id_ctx *ctx,
+                                           struct sdap_domain *sdom,
+                                           struct sdap_id_conn_cache *conn_cache,
+                                           struct sdap_id_op *op,
+                                           enum enum_search_type type,
+                                           const char *filter,
+                                           const char **attrs,
+                                           bool partition)
+{
+    struct tevent_req *req;
+    struct enum_search_state *state;
+    struct enum_search_part *part;
+    const char *name_attr;
+    int num_parts;
+    size_t i;
+    int ret;
+
+    req = tevent_req_create(memctx, &state, struct enum_search_state);
+    if (req == NULL) return NULL;
+
+    state->ev = ev;
+    state->ctx = ctx;
+    state->sdom = sdom;
+    state->type = type;
+    state->attrs = attrs;
+    state->error = EOK;
+
+    state->num_parts = 1;
+    if (partition) {
+        num_parts = dp_opt_get_int(ctx->opts->basic,
+                                   SDAP_ENUM_SEARCH_PARTITIONS);
+        if (num_parts > ENUM_MAX_PARTITIONS) {
+            DEBUG(SSSDBG_CONF_SETTINGS,
+                  "Limiting the number of enumeration partitions to %d\n",
+                  ENUM_MAX_PARTITIONS);
+            num_parts = ENUM_MAX_PARTITIONS;
+        }
+        if (num_parts > 1) {
+            state->num_parts = num_parts;
+        }
+    }
+
+    if (type == ENUM_SEARCH_USERS) {
+        name_attr = ctx->opts->user_map[SDAP_AT_USER_NAME].name;
+    } else {
+        name_attr = ctx->opts->group_map[SDAP_AT_GROUP_NAME].name;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Enumerating %s with %zu search(es)\n",
+          type == ENUM_SEARCH_USERS ? "users" : "groups", state->num_parts);
+
+    for (i = 0; i < state->num_parts; i++) {
+        part = talloc_zero(state, struct enum_search_part);
+        if (part == NULL) {
+            ret = ENOMEM;
+            goto fail;
+        }
+        part->req = req;
+        part->idx = i;
+
+        part->filter = enum_search_part_filter(part, name_attr, filter,
+                                               i, state->num_parts);
+        if (part->filter == NULL) {
+            ret = ENOMEM;
+            goto fail;
+        }
+
+        /* The first search reuses the connection of the caller */
+        if (i == 0) {
+            part->op = op;
+            part->own_op = false;
+            ret = enum_search_part_search(part);
+        } else {
+            part->op = sdap_id_op_create(part, conn_cache);
+            if (part->op == NULL) {
+                ret = ENOMEM;
+                goto fail;
+            }
+            part->own_op = true;
+            ret = enum_search_part_connect(part);
+        }
+        if (ret != EOK) {
+            goto fail;
+        }
+
+        state->num_active++;
+    }
+
+    return req;
+
+fail:
+    if (state->num_active == 0) {
+        tevent_req_error(req, ret);
+        tevent_req_post(req, ev);
+    } else {
+        /* let the searches which already run finish */
+        state->error = ret;
+    }
+    return req;
+}
+
+static errno_t enum_search_part_connect(struct enum_search_part *part)
+{
+    struct tevent_req *subreq;
+    errno_t ret;
+
+    subreq = sdap_id_op_connect_send(part->op, part, &ret);
+    if (subreq == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "sdap_id_op_connect_send failed: %d\n", ret);
+        return ret;
+    }
+
+    tevent_req_set_callback(subreq, enum_search_part_connected, part);
+    return EOK;
+}
+
+static void enum_search_part_connected(struct tevent_req *subreq)
+{
+    struct enum_search_part *part = tevent_req_callback_data(subreq,
+                                                    struct enum_search_part);
+    int dp_error;
+    errno_t ret;
+
+    ret = sdap_id_op_connect_recv(subreq, &dp_error);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Enumeration partition %zu failed to connect: (%d)[%s]\n",
+              part->idx, ret, sss_strerror(ret));
+        enum_search_part_finish(part, dp_error == DP_ERR_OFFLINE ? EAGAIN
+                                                                 : ret);
+        return;
+    }
+
+    ret = enum_search_part_search(part);
+    if (ret != EOK) {
+        enum_search_part_finish(part, ret);
+    }
+}
+
+static errno_t enum_search_part_search(struct enum_search_part *part)
+{
+    struct enum_search_state *state = tevent_req_data(part->req,
+                                                  struct enum_search_state);
+    struct tevent_req *subreq;
+    int timeout;
+
+    DEBUG(SSSDBG_TRACE_INTERNAL, "Enumeration partition %zu: [%s]\n",
+          part->idx, part->filter);
+
+    timeout = dp_opt_get_int(state->ctx->opts->basic,
+                             SDAP_ENUM_SEARCH_TIMEOUT);
+
+    if (state->type == ENUM_SEARCH_USERS) {
+        subreq = sdap_get_users_send(part, state->ev,
+                                     state->sdom->dom,
+                                     state->sdom->dom->sysdb,
+                                     state->ctx->opts,
+                                     state->sdom->user_search_bases,
+                                     sdap_id_op_handle(part->op),
+                                     state->attrs, part->filter,
+                                     timeout, SDAP_LOOKUP_ENUMERATE, NULL,
+                                     state->num_parts > 1 ?
+                                        enum_search_part_keep : NULL,
+                                     part);
+    } else {
+        subreq = sdap_get_groups_send(part, state->ev,
+                                      state->sdom,
+                                      state->ctx->opts,
+                                      sdap_id_op_handle(part->op),
+                                      state->attrs, part->filter,
+                                      timeout, SDAP_LOOKUP_ENUMERATE, false);
+    }
+    if (subreq == NULL) {
+        return ENOMEM;
+    }
+
+    tevent_req_set_callback(subreq, enum_search_part_done, part);
+    return EOK;
+}
+
+static void enum_search_part_done(struct tevent_req *subreq)
+{
+    struct enum_search_part *part = tevent_req_callback_data(subreq,
+                                                    struct enum_search_part);
+    struct enum_search_state *state = tevent_req_data(part->req,
+                                                  struct enum_search_state);
+    char *usn_value = NULL;
+    int dp_error;
+    errno_t ret;
+
+    if (state->type == ENUM_SEARCH_USERS) {
+        ret = sdap_get_users_recv(subreq, state, &usn_value);
+    } else {
+        ret = sdap_get_groups_recv(subreq, state, &usn_value);
+    }
+    talloc_zfree(subreq);
+
+    if (part->own_op) {
+        ret = sdap_id_op_done(part->op, ret, &dp_error);
+        if (dp_error == DP_ERR_OK && ret != EOK) {
+            /* retry */
+            ret = enum_search_part_connect(part);
+            if (ret != EOK) {
+                enum_search_part_finish(part, ret);
+            }
+            return;
+        }
+    }
+
+    if (ret == ENOENT) {
+        /* nothing in this partition */
+        ret = EOK;
+    }
+
+    if (ret == EOK && usn_value != NULL) {
+        if (state->higher_usn == NULL
+                || strlen(usn_value) > strlen(state->higher_usn)
+                || (strlen(usn_value) == strlen(state->higher_usn)
+                    && strcmp(usn_value, state->higher_usn) > 0)) {
+            talloc_free(state->higher_usn);
+            state->higher_usn = usn_value;
+        } else {
+            talloc_free(usn_value);
+        }
+    }
+
+    enum_search_part_finish(part, ret);
+}
+
+static void enum_search_part_finish(struct enum_search_part *part,
+                                    errno_t ret)
+{
+    struct tevent_req *req = part->req;
+    struct enum_search_state *state = tevent_req_data(req,
+                                                  struct enum_search_state);
+
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Enumeration partition %zu failed: %d: %s\n",
+              part->idx, ret, sss_strerror(ret));
+        if (state->error == EOK) {
+            state->error = ret;
+        }
+    }
+
+    /* the first partition does not own its operation */
+    talloc_free(part);
+
+    state->num_active--;
+    if (state->num_active > 0) {
+        return;
+    }
+
+    if (state->error != EOK) {
+        tevent_req_error(req, state->error);
+        return;
+    }
+
+    tevent_req_done(req);
+}
+
+static errno_t enum_search_recv(struct tevent_req *req,
+                                TALLOC_CTX *mem_ctx,
+                                char **_usn_value)
+{
+    struct enum_search_state *state = tevent_req_data(req,
+                                                  struct enum_search_state);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    *_usn_value = talloc_steal(mem_ctx, state->higher_usn);
+    return EOK;
+}
+
 /* ==User-Enumeration===================================================== */
 struct enum_users_state {
     struct tevent_context *ev;
@@ -434,6 +872,7 @@ static struct tevent_req *enum_users_send(TALLOC_CTX *memctx,
                                           struct tevent_context *ev,
                                           struct sdap_id_ctx *ctx,
                                           struct sdap_domain *sdom,
+                                          struct sdap_id_conn_cache *conn_cache,
                                           struct sdap_id_op *op,
                                           bool purge)
 {
@@ -441,6 +880,7 @@ static struct tevent_req *enum_users_send(TALLOC_CTX *memctx,
     struct enum_users_state *state;
     int ret;
     bool use_mapping;
+    bool incremental = false;
 
     req = tevent_req_create(memctx, &state, struct enum_users_state);
     if (!req) return NULL;
@@ -492,6 +932,7 @@ static struct tevent_req *enum_users_send(TALLOC_CTX *memctx,
         /* If we have lastUSN available and we're not doing a full
          * refresh, limit to changes with a higher entryUSN value.
          */
+        incremental = true;
         state->filter = talloc_asprintf_append_buffer(
                 state->filter,
                 "(%s>=%s)(!(%s=%s))",
@@ -525,16 +966,11 @@ static struct tevent_req *enum_users_send(TALLOC_CTX *memctx,
      * search base at a time.
      */
 
-    subreq = sdap_get_users_send(state, state->ev,
-                                 state->sdom->dom,
-                                 state->sdom->dom->sysdb,
-                                 state->ctx->opts,
-                                 state->sdom->user_search_bases,
-                                 sdap_id_op_handle(state->op),
-                                 state->attrs, state->filter,
-                                 dp_opt_get_int(state->ctx->opts->basic,
-                                                SDAP_ENUM_SEARCH_TIMEOUT),
-                                 SDAP_LOOKUP_ENUMERATE, NULL);
+    /* Only a full enumeration is worth splitting, the USN limited one
+     * returns just the changed entries */
+    subreq = enum_search_send(state, state->ev, state->ctx, state->sdom,
+                              conn_cache, state->op, ENUM_SEARCH_USERS,
+                              state->filter, state->attrs, !incremental);
     if (!subreq) {
         ret = ENOMEM;
         goto fail;
@@ -560,7 +996,7 @@ static void enum_users_done(struct tevent_req *subreq)
     unsigned usn_number;
     int ret;
 
-    ret = sdap_get_users_recv(subreq, state, &usn_value);
+    ret = enum_search_recv(subreq, state, &usn_value);
     talloc_zfree(subreq);
     if (ret) {
         tevent_req_error(req, ret);
@@ -609,6 +1045,7 @@ static struct tevent_req *enum_groups_send(TALLOC_CTX *memctx,
                                           struct tevent_context *ev,
                                           struct sdap_id_ctx *ctx,
                                           struct sdap_domain *sdom,
+                                          struct sdap_id_conn_cache *conn_cache,
                                           struct sdap_id_op *op,
                                           bool purge)
 {
@@ -707,14 +1144,11 @@ static struct tevent_req *enum_groups_send(TALLOC_CTX *memctx,
      * search base at a time.
      */
 
-    subreq = sdap_get_groups_send(state, state->ev,
-                                  state->sdom,
-                                  state->ctx->opts,
-                                  sdap_id_op_handle(state->op),
-                                  state->attrs, state->filter,
-                                  dp_opt_get_int(state->ctx->opts->basic,
-                                                 SDAP_ENUM_SEARCH_TIMEOUT),
-                                  SDAP_LOOKUP_ENUMERATE, false);
+    /* The members of the groups are resolved against all groups returned
+     * by the same search, so the groups are never split */
+    subreq = enum_search_send(state, state->ev, state->ctx, state->sdom,
+                              conn_cache, state->op, ENUM_SEARCH_GROUPS,
+                              state->filter, state->attrs, false);
     if (!subreq) {
         ret = ENOMEM;
         goto fail;
@@ -740,7 +1174,7 @@ static void enum_groups_done(struct tevent_req *subreq)
     unsigned usn_number;
     int ret;
 
-    ret = sdap_get_groups_recv(subreq, state, &usn_value);
+    ret = enum_search_recv(subreq, state, &usn_value);
     talloc_zfree(subreq);
     if (ret) {
         tevent_req_error(req, ret);
@@ -340,38 +340,6 @@ done:
     /* FIXME: support non legacy */
     /* FIXME: support storing additional attributes */
 
-static errno_t
-sdap_store_group_with_gid(struct sss_domain_info *domain,
-                          const char *name,
-                          gid_t gid,
-                          struct sysdb_attrs *group_attrs,
-                          uint64_t cache_timeout,
-                          bool posix_group,
-                          time_t now)
-{
-    errno_t ret;
-
-    /* make sure that non-POSIX (empty or explicit gid=0) groups have the
-     * gidNumber set to zero even if updating existing group */
-    if (!posix_group) {
-        ret = sysdb_attrs_add_uint32(group_attrs, SYSDB_GIDNUM, 0);
-        if (ret) {
-            DEBUG(SSSDBG_OP_FAILURE,
-                  "Could not set explicit GID 0 for %s\n", name);
-            return ret;
-        }
-    }
-
-    ret = sysdb_store_group(domain, name, gid, group_attrs,
-                            cache_timeout, now);
-    if (ret) {
-        DEBUG(SSSDBG_OP_FAILURE, "Could not store group %s\n", name);
-        return ret;
-    }
-
-    return ret;
-}
-
 static errno_t
 sdap_process_ghost_members(struct sysdb_attrs *attrs,
                            struct sdap_options *opts,
@@ -491,15 +459,19 @@ sdap_process_ghost_members(struct sysdb_attrs *attrs,
     return EOK;
 }
 
-static int sdap_save_group(TALLOC_CTX *memctx,
-                           struct sdap_options *opts,
-                           struct sss_domain_info *dom,
-                           struct sysdb_attrs *attrs,
-                           bool populate_members,
-                           bool store_original_member,
-                           hash_table_t *ghosts,
-                           char **_usn_value,
-                           time_t now)
+/* Translates the LDAP attributes of a group into the arguments needed to
+ * store it in the cache. On success with item->name left NULL the group
+ * must be skipped without storing anything.
+ */
+static int sdap_save_group_prepare(TALLOC_CTX *memctx,
+                                   struct sdap_options *opts,
+                                   struct sss_domain_info *dom,
+                                   struct sysdb_attrs *attrs,
+                                   bool populate_members,
+                                   bool store_original_member,
+                                   hash_table_t *ghosts,
+                                   struct sysdb_store_group_item *item,
+                                   char **_usn_value)
 {
     struct ldb_message_element *el;
     struct sysdb_attrs *group_attrs;
@@ -514,6 +486,8 @@ static int sdap_save_group(TALLOC_CTX *memctx,
     char *sid_str;
     struct sss_domain_info *subdomain;
 
+    memset(item, 0, sizeof(struct sysdb_store_group_item));
+
     tmpctx = talloc_new(NULL);
     if (!tmpctx) {
         ret = ENOMEM;
@@ -744,23 +718,28 @@ static int sdap_save_group(TALLOC_CTX *memctx,
         DEBUG(SSSDBG_CRIT_FAILURE, "Failed to save group names\n");
         goto done;
     }
-    DEBUG(SSSDBG_TRACE_FUNC, "Storing info for group %s\n", group_name);
 
-    ret = sdap_store_group_with_gid(dom, group_name, gid, group_attrs,
-                                    dom->group_timeout,
-                                    posix_group, now);
-    if (ret) {
-        DEBUG(SSSDBG_MINOR_FAILURE,
-              "Could not store group with GID: [%s]\n",
-               sss_strerror(ret));
-        goto done;
+    /* make sure that non-POSIX (empty or explicit gid=0) groups have the
+     * gidNumber set to zero even if updating existing group */
+    if (!posix_group) {
+        ret = sysdb_attrs_add_uint32(group_attrs, SYSDB_GIDNUM, 0);
+        if (ret) {
+            DEBUG(SSSDBG_OP_FAILURE,
+                  "Could not set explicit GID 0 for %s\n", group_name);
+            goto done;
+        }
     }
 
+    item->domain = dom;
+    item->name = talloc_steal(memctx, group_name);
+    item->gid = gid;
+    item->attrs = talloc_steal(memctx, group_attrs);
+    item->cache_timeout = dom->group_timeout;
+
     if (_usn_value) {
         *_usn_value = talloc_steal(memctx, usn_value);
     }
 
-    talloc_steal(memctx, group_attrs);
     ret = EOK;
 
 done:
@@ -1036,6 +1015,11 @@ static int sdap_save_groups(TALLOC_CTX *memctx,
                             char **_usn_value)
 {
     TALLOC_CTX *tmpctx;
+    struct sysdb_store_group_item *items;
+    struct sysdb_attrs **item_groups;
+    char **usn_values;
+    size_t num_items = 0;
+    size_t c;
     char *higher_usn = NULL;
     char *usn_value;
     bool twopass;
@@ -1085,29 +1069,55 @@ static int sdap_save_groups(TALLOC_CTX *memctx,
         }
     }
 
-    now = time(NULL);
-    for (i = 0; i < num_groups; i++) {
-        usn_value = NULL;
+    items = talloc_zero_array(tmpctx, struct sysdb_store_group_item,
+                              num_groups);
+    item_groups = talloc_zero_array(tmpctx, struct sysdb_attrs *, num_groups);
+    usn_values = talloc_zero_array(tmpctx, char *, num_groups);
+    if (items == NULL || item_groups == NULL || usn_values == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
 
+    /* Do not fail completely on errors.
+     * Just report the failure to save and go on */
+    for (i = 0; i < num_groups; i++) {
         /* if 2 pass savemembers = false */
-        ret = sdap_save_group(tmpctx, opts, dom, groups[i],
-                              populate_members,
-                              has_nesting && save_orig_member,
-                              ghosts, &usn_value, now);
-
-        /* Do not fail completely on errors.
-         * Just report the failure to save and go on */
+        ret = sdap_save_group_prepare(tmpctx, opts, dom, groups[i],
+                                      populate_members,
+                                      has_nesting && save_orig_member,
+                                      ghosts, &items[num_items],
+                                      &usn_values[num_items]);
         if (ret) {
             DEBUG(SSSDBG_OP_FAILURE,
                   "Failed to store group %d. Ignoring.\n", i);
-        } else {
-            DEBUG(SSSDBG_TRACE_ALL, "Group %d processed!\n", i);
-            if (twopass && !populate_members) {
-                saved_groups[nsaved_groups] = groups[i];
-                nsaved_groups++;
-            }
+        } else if (items[num_items].name != NULL) {
+            item_groups[num_items] = groups[i];
+            num_items++;
+        }
+    }
+
+    now = time(NULL);
+    ret = sysdb_store_groups_bulk(sysdb, items, num_items, now);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to store groups [%d]: %s\n",
+              ret, sss_strerror(ret));
+        goto done;
+    }
+
+    for (c = 0; c < num_items; c++) {
+        if (items[c].ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE,
+                  "Failed to store group %s. Ignoring.\n", items[c].name);
+            continue;
         }
 
+        DEBUG(SSSDBG_TRACE_ALL, "Group %s processed!\n", items[c].name);
+        if (twopass && !populate_members) {
+            saved_groups[nsaved_groups] = item_groups[c];
+            nsaved_groups++;
+        }
+
+        usn_value = usn_values[c];
         if (usn_value) {
             if (higher_usn) {
                 if ((strlen(usn_value) > strlen(higher_usn)) ||
@@ -1185,6 +1195,21 @@ struct sdap_process_group_state {
     size_t check_count;
 
     bool enumeration;
+    struct sdap_search_base **group_search_bases;
+    struct sdap_pending_members *pending;
+};
+
+/* Members of enumerated groups which were not cached yet when the group was
+ * saved. With a streamed enumeration a member group may arrive in a later
+ * batch than the group it is a member of. */
+struct sdap_pending_member {
+    char *group_dn;
+    char *member_dn;
+};
+
+struct sdap_pending_members {
+    struct sdap_pending_member *list;
+    size_t count;
 };
 
 static void sdap_process_group_members(struct tevent_req *subreq);
@@ -1220,6 +1245,83 @@ static errno_t sdap_process_group_create_dns(TALLOC_CTX *mem_ctx,
     return EOK;
 }
 
+/* Resolves the members of the group against the cache. Returns EBUSY if
+ * some members need to be looked up in LDAP first, which never happens for
+ * an enumeration. */
+static errno_t sdap_process_group_start(struct tevent_req *req,
+                                        struct sdap_process_group_state *state)
+{
+    struct ldb_message_element *el;
+    struct ldb_message_element *ghostel;
+    int ret;
+
+    ret = sysdb_attrs_get_el(state->group,
+                        state->opts->group_map[SDAP_AT_GROUP_MEMBER].sys_name,
+                        &el);
+    if (ret) {
+        return ret;
+    }
+
+    /* Group without members */
+    if (el->num_values == 0) {
+        DEBUG(SSSDBG_FUNC_DATA, "No Members. Done!\n");
+        return EOK;
+    }
+
+    ret = sysdb_attrs_get_el(state->group,
+                             SYSDB_GHOST,
+                             &ghostel);
+    if (ret) {
+        return ret;
+    }
+
+    if (ghostel->num_values == 0) {
+        /* Element was probably newly created, look for "member" again */
+        ret = sysdb_attrs_get_el(state->group,
+                        state->opts->group_map[SDAP_AT_GROUP_MEMBER].sys_name,
+                        &el);
+        if (ret != EOK) {
+            return ret;
+        }
+    }
+
+
+    ret = sdap_process_group_create_dns(state, el->num_values,
+                                        &state->sysdb_dns);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = sdap_process_group_create_dns(state, el->num_values,
+                                        &state->ghost_dns);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    switch (state->opts->schema_type) {
+        case SDAP_SCHEMA_RFC2307:
+            ret = sdap_process_group_members_2307(state, el, ghostel);
+            break;
+
+        case SDAP_SCHEMA_IPA_V1:
+        case SDAP_SCHEMA_AD:
+        case SDAP_SCHEMA_RFC2307BIS:
+            /* Note that this code branch will be used only if
+             * ldap_nesting_level = 0 is set in config file
+             */
+            ret = sdap_process_group_members_2307bis(req, state, el);
+            break;
+
+        default:
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "Unknown schema type %d\n", state->opts->schema_type);
+            ret = EINVAL;
+            break;
+    }
+
+    return ret;
+}
+
 static struct tevent_req *
 sdap_process_group_send(TALLOC_CTX *memctx,
                         struct tevent_context *ev,
@@ -1230,8 +1332,6 @@ sdap_process_group_send(TALLOC_CTX *memctx,
                         struct sysdb_attrs *group,
                         bool enumeration)
 {
-    struct ldb_message_element *el;
-    struct ldb_message_element *ghostel;
     struct sdap_process_group_state *grp_state;
     struct tevent_req *req = NULL;
     const char **attrs;
@@ -1267,85 +1367,96 @@ sdap_process_group_send(TALLOC_CTX *memctx,
     grp_state->attrs = attrs;
     grp_state->enumeration = enumeration;
 
-    ret = sysdb_attrs_get_el(group,
-                             opts->group_map[SDAP_AT_GROUP_MEMBER].sys_name,
-                             &el);
-    if (ret) {
-        goto done;
+    ret = sdap_process_group_start(req, grp_state);
+
+done:
+    /* We managed to process all the entries */
+    /* EBUSY means we need to wait for entries in LDAP */
+    if (ret == EOK) {
+        DEBUG(SSSDBG_TRACE_LIBS, "All group members processed\n");
+        tevent_req_done(req);
+        tevent_req_post(req, ev);
     }
 
-    /* Group without members */
-    if (el->num_values == 0) {
-        DEBUG(SSSDBG_FUNC_DATA, "No Members. Done!\n");
-        ret = EOK;
-        goto done;
+    if (ret != EOK && ret != EBUSY) {
+        tevent_req_error(req, ret);
+        tevent_req_post(req, ev);
     }
+    return req;
+}
 
-    ret = sysdb_attrs_get_el(group,
-                             SYSDB_GHOST,
-                             &ghostel);
-    if (ret) {
-        goto done;
+/* Processes the members of an enumerated group synchronously, members which
+ * are not cached yet but might be groups are added to pending. */
+static errno_t
+sdap_process_group_enum(struct sss_domain_info *dom,
+                        struct sdap_options *opts,
+                        struct sdap_search_base **group_search_bases,
+                        struct sysdb_attrs *group,
+                        struct sdap_pending_members *pending)
+{
+    struct sdap_process_group_state *state;
+    errno_t ret;
+
+    state = talloc_zero(NULL, struct sdap_process_group_state);
+    if (state == NULL) {
+        return ENOMEM;
     }
 
-    if (ghostel->num_values == 0) {
-        /* Element was probably newly created, look for "member" again */
-        ret = sysdb_attrs_get_el(group,
-                                 opts->group_map[SDAP_AT_GROUP_MEMBER].sys_name,
-                                 &el);
-        if (ret != EOK) {
-            goto done;
-        }
+    state->opts = opts;
+    state->dom = dom;
+    state->sysdb = dom->sysdb;
+    state->group = group;
+    state->enumeration = true;
+    state->group_search_bases = group_search_bases;
+    state->pending = pending;
+
+    ret = sdap_process_group_start(NULL, state);
+    if (ret == EBUSY) {
+        /* cannot happen for an enumeration */
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unexpected LDAP lookup of a member\n");
+        ret = EINVAL;
     }
 
+    talloc_free(state);
+    return ret;
+}
 
-    ret = sdap_process_group_create_dns(grp_state, el->num_values,
-                                        &grp_state->sysdb_dns);
-    if (ret != EOK) {
-        goto done;
+static errno_t sdap_pending_members_add(struct sdap_process_group_state *state,
+                                        const char *member_dn)
+{
+    struct sdap_pending_members *pending = state->pending;
+    const char *group_dn;
+    errno_t ret;
+
+    /* Only entries from the group search bases can be groups */
+    if (!sss_ldap_dn_in_search_bases(state, member_dn,
+                                     state->group_search_bases, NULL)) {
+        return EOK;
     }
 
-    ret = sdap_process_group_create_dns(grp_state, el->num_values,
-                                        &grp_state->ghost_dns);
+    ret = sysdb_attrs_get_string(state->group, SYSDB_ORIG_DN, &group_dn);
     if (ret != EOK) {
-        goto done;
+        return ret;
     }
 
-    switch (opts->schema_type) {
-        case SDAP_SCHEMA_RFC2307:
-            ret = sdap_process_group_members_2307(grp_state, el, ghostel);
-            break;
-
-        case SDAP_SCHEMA_IPA_V1:
-        case SDAP_SCHEMA_AD:
-        case SDAP_SCHEMA_RFC2307BIS:
-            /* Note that this code branch will be used only if
-             * ldap_nesting_level = 0 is set in config file
-             */
-            ret = sdap_process_group_members_2307bis(req, grp_state, el);
-            break;
-
-        default:
-            DEBUG(SSSDBG_CRIT_FAILURE,
-                  "Unknown schema type %d\n", opts->schema_type);
-            ret = EINVAL;
-            break;
+    pending->list = talloc_realloc(pending, pending->list,
+                                   struct sdap_pending_member,
+                                   pending->count + 1);
+    if (pending->list == NULL) {
+        return ENOMEM;
     }
 
-done:
-    /* We managed to process all the entries */
-    /* EBUSY means we need to wait for entries in LDAP */
-    if (ret == EOK) {
-        DEBUG(SSSDBG_TRACE_LIBS, "All group members processed\n");
-        tevent_req_done(req);
-        tevent_req_post(req, ev);
+    pending->list[pending->count].group_dn = talloc_strdup(pending->list,
+                                                           group_dn);
+    pending->list[pending->count].member_dn = talloc_strdup(pending->list,
+                                                            member_dn);
+    if (pending->list[pending->count].group_dn == NULL
+            || pending->list[pending->count].member_dn == NULL) {
+        return ENOMEM;
     }
+    pending->count++;
 
-    if (ret != EOK && ret != EBUSY) {
-        tevent_req_error(req, ret);
-        tevent_req_post(req, ev);
-    }
-    return req;
+    return EOK;
 }
 
 static int
@@ -1419,7 +1530,14 @@ sdap_process_group_members_2307bis(struct tevent_req *req,
                 strlen(strdn);
             state->sysdb_dns->num_values++;
         } else if (ret == ENOENT) {
-            if (!state->enumeration) {
+            if (state->enumeration && state->pending != NULL
+                    && nesting_level != 0) {
+                /* Might be a group which is not saved yet */
+                ret = sdap_pending_members_add(state, member_dn);
+                if (ret != EOK) {
+                    return ret;
+                }
+            } else if (!state->enumeration) {
                 /* The user is not in sysdb, need to add it
                  * We don't need to do this if we're in an enumeration,
                  * because all real members should all be populated
@@ -1761,9 +1879,15 @@ struct sdap_get_groups_state {
 
     struct sdap_handle *ldap_sh;
     struct sdap_id_op *op;
+
+    bool streamed;
+    struct sdap_pending_members *pending;
 };
 
 static errno_t sdap_get_groups_next_base(struct tevent_req *req);
+static errno_t sdap_get_groups_save_batch(struct sysdb_attrs **groups,
+                                          size_t count,
+                                          void *pvt);
 static void sdap_get_groups_ldap_connect_done(struct tevent_req *subreq);
 static void sdap_get_groups_process(struct tevent_req *subreq);
 static void sdap_get_groups_done(struct tevent_req *subreq);
@@ -1812,6 +1936,17 @@ struct tevent_req *sdap_get_groups_send(TALLOC_CTX *memctx,
         goto done;
     }
 
+    /* An enumeration saves the groups while the search is running instead
+     * of keeping all of them in memory until it finishes */
+    if (lookup_type == SDAP_LOOKUP_ENUMERATE && !no_members) {
+        state->streamed = true;
+        state->pending = talloc_zero(state, struct sdap_pending_members);
+        if (state->pending == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+    }
+
     /* With AD by default the Global Catalog is used for lookup. But the GC
      * group object might not have full group membership data. To make sure we
      * connect to an LDAP server of the group's domain. */
@@ -1910,15 +2045,27 @@ static errno_t sdap_get_groups_next_base(struct tevent_req *req)
         break;
     }
 
-    subreq = sdap_get_and_parse_generic_send(
-            state, state->ev, state->opts,
-            state->ldap_sh != NULL ? state->ldap_sh : state->sh,
-            state->search_bases[state->base_iter]->basedn,
-            state->search_bases[state->base_iter]->scope,
-            state->filter, state->attrs,
-            state->opts->group_map, SDAP_OPTS_GROUP,
-            0, NULL, NULL, sizelimit, state->timeout,
-            need_paging);
+    if (state->streamed) {
+        subreq = sdap_get_and_parse_generic_stream_send(
+                state, state->ev, state->opts,
+                state->ldap_sh != NULL ? state->ldap_sh : state->sh,
+                state->search_bases[state->base_iter]->basedn,
+                state->search_bases[state->base_iter]->scope,
+                state->filter, state->attrs,
+                state->opts->group_map, SDAP_OPTS_GROUP,
+                sizelimit, state->timeout, need_paging,
+                sdap_get_groups_save_batch, state);
+    } else {
+        subreq = sdap_get_and_parse_generic_send(
+                state, state->ev, state->opts,
+                state->ldap_sh != NULL ? state->ldap_sh : state->sh,
+                state->search_bases[state->base_iter]->basedn,
+                state->search_bases[state->base_iter]->scope,
+                state->filter, state->attrs,
+                state->opts->group_map, SDAP_OPTS_GROUP,
+                0, NULL, NULL, sizelimit, state->timeout,
+                need_paging);
+    }
     if (!subreq) {
         return ENOMEM;
     }
@@ -1927,6 +2074,181 @@ static errno_t sdap_get_groups_next_base(struct tevent_req *req)
     return EOK;
 }
 
+static errno_t sdap_get_groups_save_batch(struct sysdb_attrs **groups,
+                                          size_t count,
+                                          void *pvt)
+{
+    struct sdap_get_groups_state *state = talloc_get_type(pvt,
+                                                struct sdap_get_groups_state);
+    char *usn_value = NULL;
+    bool in_transaction = false;
+    errno_t ret;
+    errno_t sret;
+    size_t i;
+
+    state->count += count;
+
+    ret = sysdb_transaction_start(state->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE, "Failed to start transaction\n");
+        goto done;
+    }
+    in_transaction = true;
+
+    if (state->opts->schema_type != SDAP_SCHEMA_RFC2307
+            && dp_opt_get_int(state->opts->basic, SDAP_NESTING_LEVEL) != 0) {
+        DEBUG(SSSDBG_TRACE_ALL, "Saving groups without members first "
+                  "to allow unrolling of nested groups.\n");
+        ret = sdap_save_groups(state, state->sysdb, state->dom, state->opts,
+                               groups, count, false, NULL, true, NULL);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "Failed to store groups.\n");
+            goto done;
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        ret = sdap_process_group_enum(state->dom, state->opts,
+                                      state->search_bases, groups[i],
+                                      state->pending);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "Failed to process group members.\n");
+            goto done;
+        }
+    }
+
+    ret = sdap_save_groups(state, state->sysdb, state->dom, state->opts,
+                           groups, count,
+                           !state->dom->ignore_group_members, NULL,
+                           false, &usn_value);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Failed to store groups.\n");
+        goto done;
+    }
+
+    ret = sysdb_transaction_commit(state->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE, "Couldn't commit transaction\n");
+        goto done;
+    }
+    in_transaction = false;
+
+    if (usn_value != NULL) {
+        if (state->higher_usn == NULL
+                || strlen(usn_value) > strlen(state->higher_usn)
+                || (strlen(usn_value) == strlen(state->higher_usn)
+                    && strcmp(usn_value, state->higher_usn) > 0)) {
+            talloc_free(state->higher_usn);
+            state->higher_usn = usn_value;
+        } else {
+            talloc_free(usn_value);
+        }
+    }
+
+    DEBUG(SSSDBG_TRACE_ALL, "Saving %zu Groups - Done\n", count);
+    ret = EOK;
+
+done:
+    if (in_transaction) {
+        sret = sysdb_transaction_cancel(state->sysdb);
+        if (sret != EOK) {
+            DEBUG(SSSDBG_FATAL_FAILURE, "Could not cancel sysdb transaction\n");
+        }
+    }
+    return ret;
+}
+
+/* Adds the memberships which could not be resolved because the member group
+ * was saved in a later batch than the group */
+static errno_t sdap_get_groups_apply_pending(struct sdap_get_groups_state *state)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct sdap_pending_member *item;
+    struct ldb_message **msgs;
+    struct ldb_dn *member_dn;
+    struct ldb_dn *group_dn;
+    const char *attrs[] = { SYSDB_NAME, NULL };
+    size_t num_added = 0;
+    size_t count;
+    bool in_transaction = false;
+    errno_t ret;
+    errno_t sret;
+    size_t i;
+
+    if (state->pending == NULL || state->pending->count == 0) {
+        return EOK;
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sysdb_transaction_start(state->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE, "Failed to start transaction\n");
+        goto done;
+    }
+    in_transaction = true;
+
+    for (i = 0; i < state->pending->count; i++) {
+        item = &state->pending->list[i];
+
+        ret = sysdb_search_groups_by_orig_dn(tmp_ctx, state->dom,
+                                             item->member_dn, attrs,
+                                             &count, &msgs);
+        if (ret == ENOENT || (ret == EOK && count != 1)) {
+            /* not a group or not cached at all */
+            continue;
+        } else if (ret != EOK) {
+            goto done;
+        }
+        member_dn = msgs[0]->dn;
+
+        ret = sysdb_search_groups_by_orig_dn(tmp_ctx, state->dom,
+                                             item->group_dn, attrs,
+                                             &count, &msgs);
+        if (ret == ENOENT || (ret == EOK && count != 1)) {
+            continue;
+        } else if (ret != EOK) {
+            goto done;
+        }
+        group_dn = msgs[0]->dn;
+
+        ret = sysdb_mod_group_member(state->dom, member_dn, group_dn,
+                                     LDB_FLAG_MOD_ADD);
+        if (ret == EEXIST) {
+            continue;
+        } else if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "Failed to add [%s] to [%s] [%d]: %s\n",
+                  item->member_dn, item->group_dn, ret, sss_strerror(ret));
+            goto done;
+        }
+        num_added++;
+    }
+
+    ret = sysdb_transaction_commit(state->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE, "Couldn't commit transaction\n");
+        goto done;
+    }
+    in_transaction = false;
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Added %zu of %zu pending group memberships\n",
+          num_added, state->pending->count);
+    ret = EOK;
+
+done:
+    if (in_transaction) {
+        sret = sysdb_transaction_cancel(state->sysdb);
+        if (sret != EOK) {
+            DEBUG(SSSDBG_FATAL_FAILURE, "Could not cancel sysdb transaction\n");
+        }
+    }
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
 static void sdap_nested_done(struct tevent_req *req);
 static void sdap_search_group_copy_batch(struct sdap_get_groups_state *state,
                                          struct sysdb_attrs **groups,
@@ -1998,6 +2320,19 @@ static void sdap_get_groups_process(struct tevent_req *subreq)
         return;
     }
 
+    if (state->streamed) {
+        /* The groups were saved batch by batch already */
+        ret = sdap_get_groups_apply_pending(state);
+        if (ret != EOK) {
+            tevent_req_error(req, ret);
+            return;
+        }
+
+        DEBUG(SSSDBG_TRACE_FUNC, "Saved %zu Groups\n", state->count);
+        tevent_req_done(req);
+        return;
+    }
+
     if (state->no_members) {
         ret = sdap_get_primary_fqdn_list(state->dom, state,
                                 state->groups, state->count,
@@ -55,12 +55,26 @@ struct sdap_nested_group_member {
     const char *dn;
     const char *user_filter;
     const char *group_filter;
+
+    struct ldb_dn *ldb_dn;
+    bool found;
 };
 
 #ifndef EXTERNAL_MEMBERS_CHUNK
 #define EXTERNAL_MEMBERS_CHUNK  16
 #endif /* EXTERNAL_MEMBERS_CHUNK */
 
+/* Members which are looked up with a single search. If there are more of
+ * them, they share the parent container which is searched with one level
+ * scope and an OR filter of their RDNs. */
+struct sdap_nested_group_batch {
+    const char *parent_dn;
+    const char *filter;
+    char *rdn_filter;
+    struct sdap_nested_group_member **members;
+    int num_members;
+};
+
 struct sdap_external_missing_member {
     const char **parent_group_dns;
     size_t parent_dn_idx;
@@ -76,62 +90,36 @@ struct sdap_nested_group_ctx {
     hash_table_t *users;
     hash_table_t *groups;
     hash_table_t *missing_external;
+    hash_table_t *lookups;
     bool try_deref;
     int deref_threshold;
     int max_nesting_level;
+
+    /* statistics of the walk */
+    int num_levels;
+    int num_lookups;
+    int num_derefs;
 };
 
 static struct tevent_req *
-sdap_nested_group_process_send(TALLOC_CTX *mem_ctx,
-                             struct tevent_context *ev,
-                             struct sdap_nested_group_ctx *group_ctx,
-                             int nesting_level,
-                             struct sysdb_attrs *group);
+sdap_nested_group_walk_send(TALLOC_CTX *mem_ctx,
+                            struct tevent_context *ev,
+                            struct sdap_nested_group_ctx *group_ctx,
+                            struct sysdb_attrs *group);
 
-static errno_t sdap_nested_group_process_recv(struct tevent_req *req);
+static errno_t sdap_nested_group_walk_recv(struct tevent_req *req);
 
 static struct tevent_req *
-sdap_nested_group_single_send(TALLOC_CTX *mem_ctx,
+sdap_nested_group_lookup_send(TALLOC_CTX *mem_ctx,
                               struct tevent_context *ev,
                               struct sdap_nested_group_ctx *group_ctx,
-                              struct sdap_nested_group_member *members,
-                              int num_members,
-                              int num_groups_max,
-                              int nesting_level);
-
-static errno_t sdap_nested_group_single_recv(struct tevent_req *req);
-
-static struct tevent_req *
-sdap_nested_group_lookup_user_send(TALLOC_CTX *mem_ctx,
-                                   struct tevent_context *ev,
-                                   struct sdap_nested_group_ctx *group_ctx,
-                                   struct sdap_nested_group_member *member);
-
-static errno_t sdap_nested_group_lookup_user_recv(TALLOC_CTX *mem_ctx,
-                                                  struct tevent_req *req,
-                                                  struct sysdb_attrs **_user);
-
-static struct tevent_req *
-sdap_nested_group_lookup_group_send(TALLOC_CTX *mem_ctx,
-                                    struct tevent_context *ev,
-                                    struct sdap_nested_group_ctx *group_ctx,
-                                    struct sdap_nested_group_member *member);
-
-static errno_t sdap_nested_group_lookup_group_recv(TALLOC_CTX *mem_ctx,
-                                                   struct tevent_req *req,
-                                                   struct sysdb_attrs **_group);
-
-static struct tevent_req *
-sdap_nested_group_lookup_unknown_send(TALLOC_CTX *mem_ctx,
-                                      struct tevent_context *ev,
-                                      struct sdap_nested_group_ctx *group_ctx,
-                                      struct sdap_nested_group_member *member);
+                              enum sdap_nested_group_dn_type type,
+                              struct sdap_nested_group_batch *batch);
 
-static errno_t
-sdap_nested_group_lookup_unknown_recv(TALLOC_CTX *mem_ctx,
-                                      struct tevent_req *req,
-                                      struct sysdb_attrs **_entry,
-                                      enum sdap_nested_group_dn_type *_type);
+static errno_t sdap_nested_group_lookup_recv(TALLOC_CTX *mem_ctx,
+                                             struct tevent_req *req,
+                                             size_t *_num_entries,
+                                             struct sysdb_attrs ***_entries);
 
 static struct tevent_req *
 sdap_nested_group_deref_send(TALLOC_CTX *mem_ctx,
@@ -141,7 +129,10 @@ sdap_nested_group_deref_send(TALLOC_CTX *mem_ctx,
                              const char *group_dn,
                              int nesting_level);
 
-static errno_t sdap_nested_group_deref_recv(struct tevent_req *req);
+static errno_t sdap_nested_group_deref_recv(TALLOC_CTX *mem_ctx,
+                                            struct tevent_req *req,
+                                            struct sysdb_attrs ***_nested_groups,
+                                            int *_num_groups);
 
 static errno_t
 sdap_nested_group_extract_hash_table(TALLOC_CTX *mem_ctx,
@@ -825,6 +816,13 @@ sdap_nested_group_send(TALLOC_CTX *mem_ctx,
         goto immediately;
     }
 
+    ret = sss_hash_create(state->group_ctx, 0, &state->group_ctx->lookups);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to create hash table [%d]: %s\n",
+                                    ret, strerror(ret));
+        goto immediately;
+    }
+
     state->group_ctx->try_deref = true;
     state->group_ctx->deref_threshold = dp_opt_get_int(opts->basic,
                                                       SDAP_DEREF_THRESHOLD);
@@ -875,8 +873,7 @@ sdap_nested_group_send(TALLOC_CTX *mem_ctx,
     }
 
     /* resolve group */
-    subreq = sdap_nested_group_process_send(state, ev, state->group_ctx,
-                                            0, group);
+    subreq = sdap_nested_group_walk_send(state, ev, state->group_ctx, group);
     if (subreq == NULL) {
         ret = ENOMEM;
         goto immediately;
@@ -904,7 +901,7 @@ static void sdap_nested_group_done(struct tevent_req *subreq)
 
     req = tevent_req_callback_data(subreq, struct tevent_req);
 
-    ret = sdap_nested_group_process_recv(subreq);
+    ret = sdap_nested_group_walk_recv(subreq);
     talloc_zfree(subreq);
     if (ret != EOK) {
         tevent_req_error(req, ret);
@@ -931,9 +928,15 @@ errno_t sdap_nested_group_recv(TALLOC_CTX *mem_ctx,
 
     state = tevent_req_data(req, struct sdap_nested_group_state);
 
-    PROBE(SDAP_NESTED_GROUP_RECV);
+    PROBE(SDAP_NESTED_GROUP_RECV, state->group_ctx->num_levels,
+          state->group_ctx->num_lookups, state->group_ctx->num_derefs);
     TEVENT_REQ_RETURN_ON_ERROR(req);
 
+    DEBUG(SSSDBG_TRACE_FUNC, "Nested groups were resolved in %d levels with "
+          "%d searches and %d dereference requests\n",
+          state->group_ctx->num_levels, state->group_ctx->num_lookups,
+          state->group_ctx->num_derefs);
+
     ret = sdap_nested_group_extract_hash_table(state, state->group_ctx->users,
                                                &num_users, &users);
     if (ret != EOK) {
@@ -976,280 +979,291 @@ errno_t sdap_nested_group_recv(TALLOC_CTX *mem_ctx,
     return EOK;
 }
 
-struct sdap_nested_group_process_state {
-    struct tevent_context *ev;
-    struct sdap_nested_group_ctx *group_ctx;
-    struct sdap_nested_group_member *missing;
-    int num_missing_total;
-    int num_missing_groups;
-    struct ldb_message_element *ext_members;
-    struct ldb_message_element *members;
-    int nesting_level;
-    char *group_dn;
-    bool deref;
-    bool deref_shortcut;
-};
+static errno_t must_ignore(struct sdap_search_base **ignore_user_search_bases,
+                           struct ldb_context *ldb_ctx,
+                           const char *dn_str,
+                           bool *_ignore)
+{
+    bool ignore;
+    struct ldb_dn *ldn;
+    struct sdap_search_base **base;
+
+    if (ldb_ctx == NULL || dn_str == NULL) {
+        return EINVAL;
+    }
 
-static void sdap_nested_group_process_done(struct tevent_req *subreq);
+    if (ignore_user_search_bases == NULL) {
+        *_ignore = false;
+        return EOK;
+    }
 
-static struct tevent_req *
-sdap_nested_group_process_send(TALLOC_CTX *mem_ctx,
-                               struct tevent_context *ev,
-                               struct sdap_nested_group_ctx *group_ctx,
-                               int nesting_level,
-                               struct sysdb_attrs *group)
+    ldn = ldb_dn_new(NULL, ldb_ctx, dn_str);
+    if (ldn == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to allocate memory for the DN\n");
+        return ENOMEM;
+    }
+
+    ignore = false;
+    for (base = ignore_user_search_bases; *base != NULL; base++) {
+        if ((*base)->ldb_basedn != NULL) {
+            if (ldb_dn_compare_base((*base)->ldb_basedn, ldn) == 0) {
+                ignore = true;
+                DEBUG(SSSDBG_TRACE_INTERNAL, "Ignoring entry [%s]\n", dn_str);
+                break;
+            }
+        } else {
+            DEBUG(SSSDBG_TRACE_INTERNAL,
+                  "Not checking ignore user search base %s \n",
+                  (*base)->basedn);
+        }
+    }
+    *_ignore = ignore;
+
+    talloc_free(ldn);
+    return EOK;
+}
+
+static errno_t sdap_nested_group_get_ipa_user(TALLOC_CTX *mem_ctx,
+                                              const char *user_dn,
+                                              struct sysdb_ctx *sysdb,
+                                              struct sysdb_attrs **_user)
 {
-    struct sdap_nested_group_process_state *state = NULL;
-    struct sdap_attr_map *group_map = NULL;
-    struct tevent_req *req = NULL;
-    struct tevent_req *subreq = NULL;
-    const char *orig_dn = NULL;
+    TALLOC_CTX *tmp_ctx;
+    struct sysdb_attrs *user;
+    char *name;
     errno_t ret;
-    int split_threshold;
 
-    req = tevent_req_create(mem_ctx, &state,
-                            struct sdap_nested_group_process_state);
-    if (req == NULL) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "tevent_req_create() failed\n");
-        return NULL;
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
     }
 
-    state->ev = ev;
-    state->group_ctx = group_ctx;
-    state->nesting_level = nesting_level;
-    group_map = state->group_ctx->opts->group_map;
-
-    /* get original dn */
-    ret = sysdb_attrs_get_string(group, SYSDB_ORIG_DN, &orig_dn);
+    ret = ipa_get_rdn(tmp_ctx, sysdb, user_dn, &name, "uid",
+                      "cn", "users", "cn", "accounts");
     if (ret != EOK) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to retrieve original dn "
-                                    "[%d]: %s\n", ret, strerror(ret));
-        goto immediately;
+        goto done;
     }
 
-    state->group_dn = talloc_strdup(state, orig_dn);
-    if (state->group_dn == NULL) {
+    user = sysdb_new_attrs(tmp_ctx);
+    if (user == NULL) {
         ret = ENOMEM;
-        goto immediately;
+        goto done;
     }
 
-    DEBUG(SSSDBG_TRACE_INTERNAL, "About to process group [%s]\n", orig_dn);
-    PROBE(SDAP_NESTED_GROUP_PROCESS_SEND, state->group_dn);
+    ret = sysdb_attrs_add_string(user, SYSDB_NAME, name);
+    if (ret != EOK) {
+        goto done;
+    }
 
-    /* get member list, both direct and external */
-    state->ext_members = sdap_nested_group_ext_members(state->group_ctx->opts,
-                                                       group);
+    ret = sysdb_attrs_add_string(user, SYSDB_ORIG_DN, user_dn);
+    if (ret != EOK) {
+        goto done;
+    }
 
-    ret = sysdb_attrs_get_el_ext(group, group_map[SDAP_AT_GROUP_MEMBER].sys_name,
-                                 false, &state->members);
-    if (ret == ENOENT && state->ext_members == NULL) {
-        ret = EOK; /* no members, direct or external */
-        goto immediately;
-    } else if (ret != EOK && ret != ENOENT) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to retrieve member list "
-                                    "[%d]: %s\n", ret, strerror(ret));
-        goto immediately;
+    ret = sysdb_attrs_add_string(user, SYSDB_OBJECTCATEGORY, SYSDB_USER_CLASS);
+    if (ret != EOK) {
+        goto done;
     }
 
-    split_threshold = state->group_ctx->try_deref ? \
-                            state->group_ctx->deref_threshold : \
-                            -1;
+    *_user = talloc_steal(mem_ctx, user);
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
 
-    /* get members that need to be refreshed */
-    PROBE(SDAP_NESTED_GROUP_PROCESS_SPLIT_PRE);
-    ret = sdap_nested_group_split_members(state, state->group_ctx,
-                                          split_threshold,
-                                          state->nesting_level,
-                                          state->members,
-                                          &state->missing,
-                                          &state->num_missing_total,
-                                          &state->num_missing_groups);
-    PROBE(SDAP_NESTED_GROUP_PROCESS_SPLIT_POST);
-    if (ret == ERR_DEREF_THRESHOLD) {
-        DEBUG(SSSDBG_TRACE_FUNC,
-              "More members were missing than the deref threshold\n");
-        state->deref_shortcut = true;
-    } else if (ret != EOK) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to split member list "
-                                    "[%d]: %s\n", ret, sss_strerror(ret));
-        goto immediately;
+/* Splits the member DN into its parent container and a filter matching its
+ * RDN, e.g. "(cn=user1)". EINVAL is returned if the DN cannot be split. */
+static errno_t
+sdap_nested_group_member_rdn(TALLOC_CTX *mem_ctx,
+                             struct ldb_context *ldb,
+                             struct sdap_nested_group_member *member,
+                             const char **_parent_dn,
+                             char **_rdn_filter)
+{
+    TALLOC_CTX *tmp_ctx = NULL;
+    struct ldb_dn *parent = NULL;
+    const struct ldb_val *rdn_val = NULL;
+    const char *rdn_name = NULL;
+    const char *parent_dn = NULL;
+    char *value = NULL;
+    char *sanitized = NULL;
+    char *rdn_filter = NULL;
+    errno_t ret;
+
+    if (member->ldb_dn == NULL) {
+        member->ldb_dn = ldb_dn_new(mem_ctx, ldb, member->dn);
+        if (member->ldb_dn == NULL) {
+            return ENOMEM;
+        }
     }
 
-    ret = sdap_nested_group_add_ext_members(state->group_ctx,
-                                            group,
-                                            state->ext_members);
-    if (ret != EOK) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to split external member list "
-                                    "[%d]: %s\n", ret, sss_strerror(ret));
-        goto immediately;
+    if (!ldb_dn_validate(member->ldb_dn)
+            || ldb_dn_get_comp_num(member->ldb_dn) < 2) {
+        return EINVAL;
     }
 
-    if (state->num_missing_total == 0
-            && hash_count(state->group_ctx->missing_external) == 0) {
-        ret = EOK; /* we're done */
-        goto immediately;
+    rdn_name = ldb_dn_get_rdn_name(member->ldb_dn);
+    rdn_val = ldb_dn_get_rdn_val(member->ldb_dn);
+    if (rdn_name == NULL || rdn_val == NULL) {
+        return EINVAL;
     }
 
-    /* If there are only indirect members of the group, it's still safe to
-     * proceed and let the direct lookup code just fall through.
-     */
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
 
-    DEBUG(SSSDBG_TRACE_INTERNAL,
-          "Looking up %d/%d members of group [%s]\n",
-          state->num_missing_total,
-          state->members ? state->members->num_values : 0,
-          orig_dn);
+    parent = ldb_dn_get_parent(tmp_ctx, member->ldb_dn);
+    if (parent == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
 
-    /* process members */
-    if (group_ctx->try_deref
-            && state->num_missing_total > group_ctx->deref_threshold) {
-        DEBUG(SSSDBG_TRACE_INTERNAL, "Dereferencing members of group [%s]\n",
-                                      orig_dn);
-        state->deref = true;
-        subreq = sdap_nested_group_deref_send(state, ev, group_ctx,
-                                              state->members, orig_dn,
-                                              state->nesting_level);
-    } else {
-        DEBUG(SSSDBG_TRACE_INTERNAL, "Members of group [%s] will be "
-                                      "processed individually\n", orig_dn);
-        state->deref = false;
-        subreq = sdap_nested_group_single_send(state, ev, group_ctx,
-                                               state->missing,
-                                               state->num_missing_total,
-                                               state->num_missing_groups,
-                                               state->nesting_level);
+    parent_dn = ldb_dn_get_linearized(parent);
+    if (parent_dn == NULL) {
+        ret = EINVAL;
+        goto done;
     }
-    if (subreq == NULL) {
+
+    value = talloc_strndup(tmp_ctx, (const char *)rdn_val->data,
+                           rdn_val->length);
+    if (value == NULL) {
         ret = ENOMEM;
-        goto immediately;
+        goto done;
     }
 
-    tevent_req_set_callback(subreq, sdap_nested_group_process_done, req);
+    ret = sss_filter_sanitize(tmp_ctx, value, &sanitized);
+    if (ret != EOK) {
+        goto done;
+    }
 
-    return req;
+    rdn_filter = talloc_asprintf(mem_ctx, "(%s=%s)", rdn_name, sanitized);
+    if (rdn_filter == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
 
-immediately:
-    if (ret == EOK) {
-        tevent_req_done(req);
-    } else {
-        tevent_req_error(req, ret);
+    *_parent_dn = talloc_strdup(mem_ctx, parent_dn);
+    if (*_parent_dn == NULL) {
+        talloc_free(rdn_filter);
+        ret = ENOMEM;
+        goto done;
     }
-    tevent_req_post(req, ev);
 
-    return req;
+    *_rdn_filter = rdn_filter;
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
 }
 
-static void sdap_nested_group_process_done(struct tevent_req *subreq)
+/* Finds the batch member that was returned by its search. A search for
+ * several members may also return entries which matched the RDN filter
+ * through a value of another attribute, those are not members. */
+static errno_t
+sdap_nested_group_batch_match(struct ldb_context *ldb,
+                              struct sdap_nested_group_batch *batch,
+                              struct sysdb_attrs *entry,
+                              struct sdap_nested_group_member **_member)
 {
-    struct sdap_nested_group_process_state *state = NULL;
-    struct tevent_req *req = NULL;
+    struct ldb_dn *dn = NULL;
+    const char *orig_dn = NULL;
     errno_t ret;
+    int i;
 
-    req = tevent_req_callback_data(subreq, struct tevent_req);
-    state = tevent_req_data(req, struct sdap_nested_group_process_state);
+    *_member = NULL;
 
-    if (state->deref) {
-        ret = sdap_nested_group_deref_recv(subreq);
-        talloc_zfree(subreq);
-        if (ret == ENOTSUP) {
-            /* dereference is not supported, try again without dereference */
-            state->group_ctx->try_deref = false;
-            state->deref = false;
-
-            DEBUG(SSSDBG_TRACE_INTERNAL, "Members of group [%s] will be "
-                  "processed individually\n", state->group_dn);
-
-            if (state->deref_shortcut == true) {
-                /* If we previously short-cut dereference, we need to split the
-                 * members again to get full list of missing member types
-                 */
-                PROBE(SDAP_NESTED_GROUP_PROCESS_SPLIT_PRE);
-                ret = sdap_nested_group_split_members(state, state->group_ctx,
-                                                      -1,
-                                                      state->nesting_level,
-                                                      state->members,
-                                                      &state->missing,
-                                                      &state->num_missing_total,
-                                                      &state->num_missing_groups);
-                PROBE(SDAP_NESTED_GROUP_PROCESS_SPLIT_POST);
-                if (ret != EOK) {
-                    DEBUG(SSSDBG_CRIT_FAILURE, "Unable to split member list "
-                                                "[%d]: %s\n",
-                                                ret, sss_strerror(ret));
-                    goto done;
-                }
-            }
+    if (batch->num_members == 1) {
+        /* base search, the entry is the member */
+        *_member = batch->members[0];
+        return EOK;
+    }
 
-            subreq = sdap_nested_group_single_send(state,
-                                                   state->ev,
-                                                   state->group_ctx,
-                                                   state->missing,
-                                                   state->num_missing_total,
-                                                   state->num_missing_groups,
-                                                   state->nesting_level);
-            if (subreq == NULL) {
-                ret = ENOMEM;
-                goto done;
-            }
+    ret = sysdb_attrs_get_string(entry, SYSDB_ORIG_DN, &orig_dn);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "The entry has no originalDN\n");
+        return ret;
+    }
 
-            tevent_req_set_callback(subreq, sdap_nested_group_process_done,
-                                    req);
+    dn = ldb_dn_new(NULL, ldb, orig_dn);
+    if (dn == NULL) {
+        return ENOMEM;
+    }
 
-            ret = EAGAIN;
+    for (i = 0; i < batch->num_members; i++) {
+        if (ldb_dn_compare(batch->members[i]->ldb_dn, dn) == 0) {
+            *_member = batch->members[i];
+            break;
         }
-    } else {
-        ret = sdap_nested_group_single_recv(subreq);
-        talloc_zfree(subreq);
     }
 
-done:
-    if (ret == EOK) {
-        tevent_req_done(req);
-    } else if (ret != EAGAIN) {
-        tevent_req_error(req, ret);
+    if (*_member == NULL) {
+        DEBUG(SSSDBG_TRACE_ALL, "[%s] was not requested, skipping\n",
+              orig_dn);
     }
-}
-
-static errno_t sdap_nested_group_process_recv(struct tevent_req *req)
-{
-#ifdef HAVE_SYSTEMTAP
-    struct sdap_nested_group_process_state *state = NULL;
-    state = tevent_req_data(req, struct sdap_nested_group_process_state);
-
-    PROBE(SDAP_NESTED_GROUP_PROCESS_RECV, state->group_dn);
-#endif
-
-    TEVENT_REQ_RETURN_ON_ERROR(req);
 
+    talloc_free(dn);
     return EOK;
 }
 
-struct sdap_nested_group_recurse_state {
+enum sdap_nested_group_walk_phase {
+    SDAP_NESTED_GROUP_WALK_DEREF,
+    SDAP_NESTED_GROUP_WALK_USERS,
+    SDAP_NESTED_GROUP_WALK_GROUPS
+};
+
+/* The group is resolved breadth first. Missing members of all groups of one
+ * nesting level are collected and deduplicated first, then they are looked
+ * up in batches, users before groups. The groups found this way form the
+ * next nesting level. Groups with more missing members than the deref
+ * threshold are dereferenced instead. */
+struct sdap_nested_group_walk_state {
     struct tevent_context *ev;
     struct sdap_nested_group_ctx *group_ctx;
+    bool ignore_unreadable_references;
+    int nesting_level;
+
     struct sysdb_attrs **groups;
     int num_groups;
-    int index;
-    int nesting_level;
+    struct sysdb_attrs **next_groups;
+    int num_next_groups;
+
+    /* everything below is allocated on level_ctx */
+    TALLOC_CTX *level_ctx;
+    enum sdap_nested_group_walk_phase phase;
+
+    struct sysdb_attrs **deref_groups;
+    int num_deref_groups;
+    int deref_index;
+
+    struct sdap_nested_group_member **missing;
+    int num_missing;
+
+    struct sdap_nested_group_batch *batches;
+    int num_batches;
+    int batch_index;
 };
 
-static errno_t sdap_nested_group_recurse_step(struct tevent_req *req);
-static void sdap_nested_group_recurse_done(struct tevent_req *subreq);
+static errno_t sdap_nested_group_walk_start_level(
+                                    struct sdap_nested_group_walk_state *state);
+static errno_t sdap_nested_group_walk_step(struct tevent_req *req);
+static void sdap_nested_group_walk_deref_done(struct tevent_req *subreq);
+static void sdap_nested_group_walk_lookup_done(struct tevent_req *subreq);
 
 static struct tevent_req *
-sdap_nested_group_recurse_send(TALLOC_CTX *mem_ctx,
-                               struct tevent_context *ev,
-                               struct sdap_nested_group_ctx *group_ctx,
-                               struct sysdb_attrs **nested_groups,
-                               int num_groups,
-                               int nesting_level)
+sdap_nested_group_walk_send(TALLOC_CTX *mem_ctx,
+                            struct tevent_context *ev,
+                            struct sdap_nested_group_ctx *group_ctx,
+                            struct sysdb_attrs *group)
 {
-    struct sdap_nested_group_recurse_state *state = NULL;
+    struct sdap_nested_group_walk_state *state = NULL;
     struct tevent_req *req = NULL;
     errno_t ret;
 
     req = tevent_req_create(mem_ctx, &state,
-                            struct sdap_nested_group_recurse_state);
+                            struct sdap_nested_group_walk_state);
     if (req == NULL) {
         DEBUG(SSSDBG_CRIT_FAILURE, "tevent_req_create() failed\n");
         return NULL;
@@ -1257,13 +1271,25 @@ sdap_nested_group_recurse_send(TALLOC_CTX *mem_ctx,
 
     state->ev = ev;
     state->group_ctx = group_ctx;
-    state->groups = nested_groups;
-    state->num_groups = num_groups;
-    state->index = 0;
-    state->nesting_level = nesting_level;
+    state->nesting_level = 0;
+    state->ignore_unreadable_references = dp_opt_get_bool(
+            group_ctx->opts->basic, SDAP_IGNORE_UNREADABLE_REFERENCES);
+
+    state->groups = talloc_array(state, struct sysdb_attrs *, 1);
+    if (state->groups == NULL) {
+        ret = ENOMEM;
+        goto immediately;
+    }
+
+    state->groups[0] = group;
+    state->num_groups = 1;
 
-    /* process each group individually */
-    ret = sdap_nested_group_recurse_step(req);
+    ret = sdap_nested_group_walk_start_level(state);
+    if (ret != EOK) {
+        goto immediately;
+    }
+
+    ret = sdap_nested_group_walk_step(req);
     if (ret != EAGAIN) {
         goto immediately;
     }
@@ -1281,277 +1307,261 @@ immediately:
     return req;
 }
 
-static errno_t sdap_nested_group_recurse_step(struct tevent_req *req)
+static errno_t
+sdap_nested_group_walk_add_groups(struct sdap_nested_group_walk_state *state,
+                                  struct sysdb_attrs **groups,
+                                  int num_groups)
 {
-    struct sdap_nested_group_recurse_state *state = NULL;
-    struct tevent_req *subreq = NULL;
-
-    state = tevent_req_data(req, struct sdap_nested_group_recurse_state);
+    struct sysdb_attrs **next_groups = NULL;
+    int i;
 
-    if (state->index >= state->num_groups) {
-        /* we're done */
+    if (num_groups == 0) {
         return EOK;
     }
 
-    subreq = sdap_nested_group_process_send(state, state->ev, state->group_ctx,
-                                            state->nesting_level,
-                                            state->groups[state->index]);
-    if (subreq == NULL) {
+    next_groups = talloc_realloc(state, state->next_groups,
+                                 struct sysdb_attrs *,
+                                 state->num_next_groups + num_groups);
+    if (next_groups == NULL) {
         return ENOMEM;
     }
 
-    tevent_req_set_callback(subreq, sdap_nested_group_recurse_done, req);
+    for (i = 0; i < num_groups; i++) {
+        next_groups[state->num_next_groups + i] = groups[i];
+    }
 
-    state->index++;
+    state->next_groups = next_groups;
+    state->num_next_groups += num_groups;
 
-    return EAGAIN;
+    return EOK;
 }
 
-static void sdap_nested_group_recurse_done(struct tevent_req *subreq)
+static errno_t
+sdap_nested_group_walk_add_missing(struct sdap_nested_group_walk_state *state,
+                                   struct sdap_nested_group_member *missing,
+                                   int num_missing)
 {
-    struct tevent_req *req = NULL;
+    struct sdap_nested_group_member **members = NULL;
+    hash_key_t key;
+    hash_value_t value;
+    bool ignore;
     errno_t ret;
+    int hret;
+    int i;
 
-    req = tevent_req_callback_data(subreq, struct tevent_req);
-
-    ret = sdap_nested_group_process_recv(subreq);
-    talloc_zfree(subreq);
-    if (ret != EOK) {
-        goto done;
+    if (num_missing == 0) {
+        return EOK;
     }
 
-    ret = sdap_nested_group_recurse_step(req);
-
-done:
-    if (ret == EOK) {
-        tevent_req_done(req);
-    } else if (ret != EAGAIN) {
-        tevent_req_error(req, ret);
+    members = talloc_realloc(state->level_ctx, state->missing,
+                             struct sdap_nested_group_member *,
+                             state->num_missing + num_missing);
+    if (members == NULL) {
+        return ENOMEM;
     }
 
-    return;
-}
-
-static errno_t sdap_nested_group_recurse_recv(struct tevent_req *req)
-{
-    TEVENT_REQ_RETURN_ON_ERROR(req);
+    state->missing = members;
 
-    return EOK;
-}
-
-struct sdap_nested_group_single_state {
-    struct tevent_context *ev;
-    struct sdap_nested_group_ctx *group_ctx;
-    struct sdap_nested_group_member *members;
-    int nesting_level;
-
-    struct sdap_nested_group_member *current_member;
-    int num_members;
-    int member_index;
-
-    struct sysdb_attrs **nested_groups;
-    int num_groups;
-    bool ignore_unreadable_references;
-};
-
-static errno_t sdap_nested_group_single_step(struct tevent_req *req);
-static void sdap_nested_group_single_step_done(struct tevent_req *subreq);
-static void sdap_nested_group_single_done(struct tevent_req *subreq);
-
-static struct tevent_req *
-sdap_nested_group_single_send(TALLOC_CTX *mem_ctx,
-                              struct tevent_context *ev,
-                              struct sdap_nested_group_ctx *group_ctx,
-                              struct sdap_nested_group_member *members,
-                              int num_members,
-                              int num_groups_max,
-                              int nesting_level)
-{
-    struct sdap_nested_group_single_state *state = NULL;
-    struct tevent_req *req = NULL;
-    errno_t ret;
+    key.type = HASH_KEY_CONST_STRING;
+    value.type = HASH_VALUE_UNDEF;
 
-    req = tevent_req_create(mem_ctx, &state,
-                            struct sdap_nested_group_single_state);
-    if (req == NULL) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "tevent_req_create() failed\n");
-        return NULL;
-    }
+    for (i = 0; i < num_missing; i++) {
+        /* the member was already looked up, maybe for another group */
+        key.c_str = missing[i].dn;
+        if (hash_has_key(state->group_ctx->lookups, &key)) {
+            continue;
+        }
 
-    state->ev = ev;
-    state->group_ctx = group_ctx;
-    state->members = members;
-    state->nesting_level = nesting_level;
-    state->current_member = NULL;
-    state->num_members = num_members;
-    state->member_index = 0;
-    state->nested_groups = talloc_zero_array(state, struct sysdb_attrs *,
-                                             num_groups_max);
-    if (state->nested_groups == NULL) {
-        ret = ENOMEM;
-        goto immediately;
-    }
-    state->num_groups = 0; /* we will count exact number of the groups */
-    state->ignore_unreadable_references = dp_opt_get_bool(
-            group_ctx->opts->basic, SDAP_IGNORE_UNREADABLE_REFERENCES);
+        ret = must_ignore(state->group_ctx->ignore_user_search_bases,
+                          sysdb_ctx_get_ldb(state->group_ctx->domain->sysdb),
+                          missing[i].dn, &ignore);
+        if (ret != EOK) {
+            return ret;
+        }
 
-    /* process each member individually */
-    ret = sdap_nested_group_single_step(req);
-    if (ret != EAGAIN) {
-        goto immediately;
-    }
+        if (ignore) {
+            continue;
+        }
 
-    return req;
+        hret = hash_enter(state->group_ctx->lookups, &key, &value);
+        if (hret != HASH_SUCCESS) {
+            return EIO;
+        }
 
-immediately:
-    if (ret == EOK) {
-        tevent_req_done(req);
-    } else {
-        tevent_req_error(req, ret);
+        state->missing[state->num_missing] = &missing[i];
+        state->num_missing++;
     }
-    tevent_req_post(req, ev);
 
-    return req;
+    return EOK;
 }
 
-static errno_t must_ignore(struct sdap_search_base **ignore_user_search_bases,
-                           struct ldb_context *ldb_ctx,
-                           const char *dn_str,
-                           bool *_ignore)
+static errno_t
+sdap_nested_group_walk_collect(struct sdap_nested_group_walk_state *state,
+                               struct sysdb_attrs *group)
 {
-    bool ignore;
-    struct ldb_dn *ldn;
-    struct sdap_search_base **base;
+    struct sdap_nested_group_ctx *group_ctx = state->group_ctx;
+    struct sdap_attr_map *group_map = group_ctx->opts->group_map;
+    struct ldb_message_element *ext_members = NULL;
+    struct ldb_message_element *members = NULL;
+    struct sdap_nested_group_member *missing = NULL;
+    struct sysdb_attrs **deref_groups = NULL;
+    const char *orig_dn = NULL;
+    int num_missing = 0;
+    int num_groups = 0;
+    int split_threshold;
+    errno_t ret;
 
-    if (ldb_ctx == NULL || dn_str == NULL) {
-        return EINVAL;
+    /* get original dn */
+    ret = sysdb_attrs_get_string(group, SYSDB_ORIG_DN, &orig_dn);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to retrieve original dn "
+                                    "[%d]: %s\n", ret, strerror(ret));
+        return ret;
     }
 
-    if (ignore_user_search_bases == NULL) {
-        *_ignore = false;
-        return EOK;
-    }
+    DEBUG(SSSDBG_TRACE_INTERNAL, "About to process group [%s]\n", orig_dn);
+    PROBE(SDAP_NESTED_GROUP_PROCESS_SEND, orig_dn);
 
-    ldn = ldb_dn_new(NULL, ldb_ctx, dn_str);
-    if (ldn == NULL) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to allocate memory for the DN\n");
-        return ENOMEM;
-    }
+    /* get member list, both direct and external */
+    ext_members = sdap_nested_group_ext_members(group_ctx->opts, group);
 
-    ignore = false;
-    for (base = ignore_user_search_bases; *base != NULL; base++) {
-        if ((*base)->ldb_basedn != NULL) {
-            if (ldb_dn_compare_base((*base)->ldb_basedn, ldn) == 0) {
-                ignore = true;
-                DEBUG(SSSDBG_TRACE_INTERNAL, "Ignoring entry [%s]\n", dn_str);
-                break;
-            }
-        } else {
-            DEBUG(SSSDBG_TRACE_INTERNAL,
-                  "Not checking ignore user search base %s \n",
-                  (*base)->basedn);
-        }
+    ret = sysdb_attrs_get_el_ext(group, group_map[SDAP_AT_GROUP_MEMBER].sys_name,
+                                 false, &members);
+    if (ret == ENOENT) {
+        members = NULL;
+    } else if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to retrieve member list "
+                                    "[%d]: %s\n", ret, strerror(ret));
+        goto done;
     }
-    *_ignore = ignore;
 
-    talloc_free(ldn);
-    return EOK;
-}
-
-static errno_t sdap_nested_group_single_step(struct tevent_req *req)
-{
-    struct sdap_nested_group_single_state *state = NULL;
-    struct tevent_req *subreq = NULL;
-    errno_t ret;
-    bool ignore;
+    split_threshold = group_ctx->try_deref ? group_ctx->deref_threshold : -1;
 
-    state = tevent_req_data(req, struct sdap_nested_group_single_state);
+    /* get members that need to be refreshed */
+    PROBE(SDAP_NESTED_GROUP_PROCESS_SPLIT_PRE);
+    ret = sdap_nested_group_split_members(state->level_ctx, group_ctx,
+                                          split_threshold,
+                                          state->nesting_level,
+                                          members,
+                                          &missing,
+                                          &num_missing,
+                                          &num_groups);
+    PROBE(SDAP_NESTED_GROUP_PROCESS_SPLIT_POST);
+    if (ret == ERR_DEREF_THRESHOLD) {
+        DEBUG(SSSDBG_TRACE_INTERNAL, "Dereferencing members of group [%s]\n",
+                                      orig_dn);
 
-    do {
-        if (state->member_index >= state->num_members) {
-            /* we're done */
-            return EOK;
+        deref_groups = talloc_realloc(state->level_ctx, state->deref_groups,
+                                      struct sysdb_attrs *,
+                                      state->num_deref_groups + 1);
+        if (deref_groups == NULL) {
+            ret = ENOMEM;
+            goto done;
         }
 
-        state->current_member = &state->members[state->member_index];
-        state->member_index++;
+        deref_groups[state->num_deref_groups] = group;
+        state->deref_groups = deref_groups;
+        state->num_deref_groups++;
+    } else if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to split member list "
+                                    "[%d]: %s\n", ret, sss_strerror(ret));
+        goto done;
+    } else {
+        DEBUG(SSSDBG_TRACE_INTERNAL,
+              "Looking up %d/%d members of group [%s]\n",
+              num_missing, members ? members->num_values : 0, orig_dn);
 
-        ret = must_ignore(state->group_ctx->ignore_user_search_bases,
-                          sysdb_ctx_get_ldb(state->group_ctx->domain->sysdb),
-                          state->current_member->dn, &ignore);
+        ret = sdap_nested_group_walk_add_missing(state, missing, num_missing);
         if (ret != EOK) {
-            return ret;
+            goto done;
         }
-    } while (ignore);
-
-    switch (state->current_member->type) {
-    case SDAP_NESTED_GROUP_DN_USER:
-        subreq = sdap_nested_group_lookup_user_send(state, state->ev,
-                                                    state->group_ctx,
-                                                    state->current_member);
-        break;
-    case SDAP_NESTED_GROUP_DN_GROUP:
-        subreq = sdap_nested_group_lookup_group_send(state, state->ev,
-                                                     state->group_ctx,
-                                                     state->current_member);
-        break;
-    case SDAP_NESTED_GROUP_DN_UNKNOWN:
-        subreq = sdap_nested_group_lookup_unknown_send(state, state->ev,
-                                                   state->group_ctx,
-                                                   state->current_member);
-        break;
     }
 
-    if (subreq == NULL) {
-        return ENOMEM;
+    ret = sdap_nested_group_add_ext_members(group_ctx, group, ext_members);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to split external member list "
+                                    "[%d]: %s\n", ret, sss_strerror(ret));
+        goto done;
     }
 
-    tevent_req_set_callback(subreq, sdap_nested_group_single_step_done, req);
+    ret = EOK;
 
-    return EAGAIN;
+done:
+    PROBE(SDAP_NESTED_GROUP_PROCESS_RECV, orig_dn);
+    return ret;
 }
 
+/* Dereference is not supported, the members of the groups which were not
+ * dereferenced yet are looked up together with the other missing members. */
 static errno_t
-sdap_nested_group_single_step_process(struct tevent_req *subreq)
+sdap_nested_group_walk_undo_deref(struct sdap_nested_group_walk_state *state,
+                                  int first)
 {
-    struct sdap_nested_group_single_state *state = NULL;
-    struct tevent_req *req = NULL;
-    struct sysdb_attrs *entry = NULL;
-    enum sdap_nested_group_dn_type type = SDAP_NESTED_GROUP_DN_UNKNOWN;
+    struct sdap_attr_map *group_map = state->group_ctx->opts->group_map;
+    struct ldb_message_element *members = NULL;
+    struct sdap_nested_group_member *missing = NULL;
     const char *orig_dn = NULL;
+    int num_missing = 0;
+    int num_groups = 0;
     errno_t ret;
+    int i;
 
-    req = tevent_req_callback_data(subreq, struct tevent_req);
-    state = tevent_req_data(req, struct sdap_nested_group_single_state);
+    for (i = first; i < state->num_deref_groups; i++) {
+        ret = sysdb_attrs_get_string(state->deref_groups[i], SYSDB_ORIG_DN,
+                                     &orig_dn);
+        if (ret != EOK) {
+            return ret;
+        }
+
+        DEBUG(SSSDBG_TRACE_INTERNAL, "Members of group [%s] will be "
+              "looked up in batches\n", orig_dn);
+
+        ret = sysdb_attrs_get_el_ext(state->deref_groups[i],
+                                     group_map[SDAP_AT_GROUP_MEMBER].sys_name,
+                                     false, &members);
+        if (ret == ENOENT) {
+            continue;
+        } else if (ret != EOK) {
+            return ret;
+        }
 
-    /* set correct type if possible */
-    if (state->current_member->type == SDAP_NESTED_GROUP_DN_UNKNOWN) {
-        ret = sdap_nested_group_lookup_unknown_recv(state, subreq,
-                                                    &entry, &type);
+        PROBE(SDAP_NESTED_GROUP_PROCESS_SPLIT_PRE);
+        ret = sdap_nested_group_split_members(state->level_ctx,
+                                              state->group_ctx,
+                                              -1,
+                                              state->nesting_level,
+                                              members,
+                                              &missing,
+                                              &num_missing,
+                                              &num_groups);
+        PROBE(SDAP_NESTED_GROUP_PROCESS_SPLIT_POST);
         if (ret != EOK) {
-            goto done;
+            DEBUG(SSSDBG_CRIT_FAILURE, "Unable to split member list "
+                                        "[%d]: %s\n", ret, sss_strerror(ret));
+            return ret;
         }
 
-        if (entry != NULL) {
-            state->current_member->type = type;
+        ret = sdap_nested_group_walk_add_missing(state, missing, num_missing);
+        if (ret != EOK) {
+            return ret;
         }
     }
 
-    switch (state->current_member->type) {
-    case SDAP_NESTED_GROUP_DN_USER:
-        if (entry == NULL) {
-            /* type was not unknown, receive data */
-            ret = sdap_nested_group_lookup_user_recv(state, subreq, &entry);
-            if (ret != EOK) {
-                goto done;
-            }
+    state->deref_index = state->num_deref_groups;
 
-            if (entry == NULL) {
-                /* user not found, continue */
-                break;
-            }
-        }
+    return EOK;
+}
+
+static errno_t
+sdap_nested_group_walk_save(struct sdap_nested_group_walk_state *state,
+                            struct sdap_nested_group_member *member,
+                            enum sdap_nested_group_dn_type type,
+                            struct sysdb_attrs *entry)
+{
+    errno_t ret;
 
+    switch (type) {
+    case SDAP_NESTED_GROUP_DN_USER:
         /* The original DN of the user object itself might differ from the one
          * used in the member attribute, e.g. different case. To make sure if
          * can be found in a hash table when iterating over group members the
@@ -1559,664 +1569,676 @@ sdap_nested_group_single_step_process(struct tevent_req *subreq)
          */
         ret = sysdb_attrs_add_string(entry,
                                      SYSDB_DN_FOR_MEMBER_HASH_TABLE,
-                                     state->current_member->dn);
+                                     member->dn);
         if (ret != EOK) {
             DEBUG(SSSDBG_OP_FAILURE, "sysdb_attrs_add_string failed.\n");
-            goto done;
+            return ret;
         }
 
         /* save user in hash table */
         ret = sdap_nested_group_hash_user(state->group_ctx, entry);
         if (ret == EEXIST) {
             /* the user is already present, skip it */
-            talloc_zfree(entry);
-            ret = EOK;
-            goto done;
+            return EOK;
         } else if (ret != EOK) {
             DEBUG(SSSDBG_CRIT_FAILURE, "Unable to save user in hash table "
                                         "[%d]: %s\n", ret, strerror(ret));
-            goto done;
+            return ret;
         }
-        break;
-    case SDAP_NESTED_GROUP_DN_GROUP:
-        if (entry == NULL) {
-            /* type was not unknown, receive data */
-            ret = sdap_nested_group_lookup_group_recv(state, subreq, &entry);
-            if (ret != EOK) {
-                goto done;
-            }
 
-            if (entry == NULL) {
-                /* group not found, continue */
-                break;
-            }
-        } else {
-            /* the type was unknown so we had to pull the group,
-             * but we don't want to process it if we have reached
-             * the nesting level */
-            if (state->nesting_level >= state->group_ctx->max_nesting_level) {
-                ret = sysdb_attrs_get_string(entry, SYSDB_ORIG_DN, &orig_dn);
-                if (ret != EOK) {
-                    DEBUG(SSSDBG_MINOR_FAILURE,
-                          "The entry has no originalDN\n");
-                    orig_dn = "invalid";
-                }
-
-                DEBUG(SSSDBG_TRACE_ALL, "[%s] is outside nesting limit "
-                      "(level %d), skipping\n", orig_dn, state->nesting_level);
-                break;
-            }
+        return EOK;
+    case SDAP_NESTED_GROUP_DN_GROUP:
+        /* the type was unknown so we had to pull the group,
+         * but we don't want to process it if we have reached
+         * the nesting level */
+        if (member->type == SDAP_NESTED_GROUP_DN_UNKNOWN
+                && state->nesting_level >= state->group_ctx->max_nesting_level) {
+            DEBUG(SSSDBG_TRACE_ALL, "[%s] is outside nesting limit "
+                  "(level %d), skipping\n", member->dn, state->nesting_level);
+            return EOK;
         }
 
         /* save group in hash table */
         ret = sdap_nested_group_hash_group(state->group_ctx, entry);
         if (ret == EEXIST) {
             /* the group is already present, skip it */
-            talloc_zfree(entry);
-            ret = EOK;
-            goto done;
+            return EOK;
         } else if (ret != EOK) {
             DEBUG(SSSDBG_CRIT_FAILURE, "Unable to save group in hash table "
                                         "[%d]: %s\n", ret, strerror(ret));
-            goto done;
+            return ret;
         }
 
-        /* remember the group for later processing */
-        state->nested_groups[state->num_groups] = entry;
-        state->num_groups++;
-
-        break;
+        /* remember the group for the next nesting level */
+        return sdap_nested_group_walk_add_groups(state, &entry, 1);
     case SDAP_NESTED_GROUP_DN_UNKNOWN:
-        if (state->ignore_unreadable_references) {
-            DEBUG(SSSDBG_TRACE_FUNC, "Ignoring unreadable reference [%s]\n",
-                  state->current_member->dn);
-        } else {
-            DEBUG(SSSDBG_OP_FAILURE, "Unknown entry type [%s]!\n",
-                  state->current_member->dn);
-            DEBUG(SSSDBG_OP_FAILURE, "Consider enabling sssd-ldap option "
-                                     "ldap_ignore_unreadable_references\n");
-            ret = EINVAL;
-            goto done;
-        }
         break;
     }
 
-    ret = EOK;
-
-done:
-    return ret;
+    return EINVAL;
 }
 
-static void sdap_nested_group_single_step_done(struct tevent_req *subreq)
+/* Builds the batches for members which may be of the given type and were not
+ * found yet. Members sharing the parent container and the search base filter
+ * are searched together, up to NESTED_GROUP_LOOKUP_CHUNK members at once. */
+static errno_t
+sdap_nested_group_walk_batches(struct sdap_nested_group_walk_state *state,
+                               enum sdap_nested_group_dn_type type)
 {
-    struct sdap_nested_group_single_state *state = NULL;
-    struct tevent_req *req = NULL;
+    TALLOC_CTX *tmp_ctx = NULL;
+    struct sdap_nested_group_ctx *group_ctx = state->group_ctx;
+    struct ldb_context *ldb = sysdb_ctx_get_ldb(group_ctx->domain->sysdb);
+    struct sdap_nested_group_member *member = NULL;
+    struct sdap_nested_group_batch *batch = NULL;
+    struct sysdb_attrs *user = NULL;
+    hash_table_t *open_batches = NULL;
+    const char *parent_dn = NULL;
+    const char *filter = NULL;
+    char *rdn_filter = NULL;
+    hash_key_t key;
+    hash_value_t value;
     errno_t ret;
+    int hret;
+    int i;
 
-    req = tevent_req_callback_data(subreq, struct tevent_req);
-    state = tevent_req_data(req, struct sdap_nested_group_single_state);
+    state->batches = NULL;
+    state->num_batches = 0;
+    state->batch_index = 0;
 
-    /* process direct members */
-    ret = sdap_nested_group_single_step_process(subreq);
-    talloc_zfree(subreq);
+    if (state->num_missing == 0) {
+        return EOK;
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    state->batches = talloc_zero_array(state->level_ctx,
+                                       struct sdap_nested_group_batch,
+                                       state->num_missing);
+    if (state->batches == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = sss_hash_create(tmp_ctx, 0, &open_batches);
     if (ret != EOK) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Error processing direct membership "
-                                    "[%d]: %s\n", ret, strerror(ret));
         goto done;
     }
 
-    ret = sdap_nested_group_single_step(req);
-    if (ret == EOK) {
-        /* we have processed all direct members,
-         * now recurse and process nested groups */
-        subreq = sdap_nested_group_recurse_send(state, state->ev,
-                                                state->group_ctx,
-                                                state->nested_groups,
-                                                state->num_groups,
-                                                state->nesting_level + 1);
-        if (subreq == NULL) {
-            ret = ENOMEM;
+    key.type = HASH_KEY_STRING;
+
+    for (i = 0; i < state->num_missing; i++) {
+        member = state->missing[i];
+        if (member->found) {
+            continue;
+        }
+
+        if (member->type != type
+                && member->type != SDAP_NESTED_GROUP_DN_UNKNOWN) {
+            continue;
+        }
+
+        if (type == SDAP_NESTED_GROUP_DN_USER
+                && group_ctx->opts->schema_type == SDAP_SCHEMA_IPA_V1) {
+            /* if the schema is IPA, then just shortcut and guess the name */
+            ret = sdap_nested_group_get_ipa_user(tmp_ctx, member->dn,
+                                                 group_ctx->domain->sysdb,
+                                                 &user);
+            if (ret == EOK) {
+                member->found = true;
+                ret = sdap_nested_group_walk_save(state, member, type, user);
+                if (ret != EOK) {
+                    goto done;
+                }
+                continue;
+            }
+
+            DEBUG(SSSDBG_MINOR_FAILURE, "Couldn't parse out user information "
+                  "based on DN %s, falling back to an LDAP lookup\n",
+                  member->dn);
+        }
+
+        filter = type == SDAP_NESTED_GROUP_DN_USER ? member->user_filter
+                                                   : member->group_filter;
+
+        ret = sdap_nested_group_member_rdn(state->level_ctx, ldb, member,
+                                           &parent_dn, &rdn_filter);
+        if (ret == EINVAL) {
+            DEBUG(SSSDBG_TRACE_ALL, "Unable to split [%s], it will be "
+                  "looked up alone\n", member->dn);
+            parent_dn = NULL;
+            rdn_filter = NULL;
+        } else if (ret != EOK) {
             goto done;
         }
 
-        tevent_req_set_callback(subreq, sdap_nested_group_single_done, req);
-    } else if (ret != EAGAIN) {
-        /* error */
-        goto done;
-    }
+        batch = NULL;
+        if (parent_dn != NULL) {
+            key.str = talloc_asprintf(tmp_ctx, "%s\n%s", parent_dn,
+                                      filter == NULL ? "" : filter);
+            if (key.str == NULL) {
+                ret = ENOMEM;
+                goto done;
+            }
 
-    /* we're not done yet */
-    ret = EAGAIN;
+            hret = hash_lookup(open_batches, &key, &value);
+            if (hret == HASH_SUCCESS) {
+                batch = &state->batches[value.ul];
+                if (batch->num_members >= NESTED_GROUP_LOOKUP_CHUNK) {
+                    batch = NULL;
+                }
+            } else if (hret != HASH_ERROR_KEY_NOT_FOUND) {
+                ret = EIO;
+                goto done;
+            }
+        }
 
-done:
-    if (ret == EOK) {
-        /* tevent_req_error() cannot cope with EOK */
-        DEBUG(SSSDBG_CRIT_FAILURE, "We should not get here with EOK\n");
-        tevent_req_error(req, EINVAL);
-    } else if (ret != EAGAIN) {
-        tevent_req_error(req, ret);
+        if (batch == NULL) {
+            batch = &state->batches[state->num_batches];
+            batch->parent_dn = parent_dn;
+            batch->filter = filter;
+            batch->rdn_filter = talloc_strdup(state->level_ctx, "");
+            batch->members = talloc_array(state->level_ctx,
+                                          struct sdap_nested_group_member *,
+                                          parent_dn == NULL ? 1 :
+                                              NESTED_GROUP_LOOKUP_CHUNK);
+            if (batch->rdn_filter == NULL || batch->members == NULL) {
+                ret = ENOMEM;
+                goto done;
+            }
+
+            if (parent_dn != NULL) {
+                value.type = HASH_VALUE_ULONG;
+                value.ul = state->num_batches;
+                hret = hash_enter(open_batches, &key, &value);
+                if (hret != HASH_SUCCESS) {
+                    ret = EIO;
+                    goto done;
+                }
+            }
+
+            state->num_batches++;
+        }
+
+        batch->members[batch->num_members] = member;
+        batch->num_members++;
+
+        if (rdn_filter != NULL) {
+            batch->rdn_filter = talloc_strdup_append(batch->rdn_filter,
+                                                     rdn_filter);
+            talloc_free(rdn_filter);
+            if (batch->rdn_filter == NULL) {
+                ret = ENOMEM;
+                goto done;
+            }
+        }
     }
 
-    return;
+    DEBUG(SSSDBG_TRACE_INTERNAL, "%d %s searches are needed in nesting "
+          "level %d\n", state->num_batches,
+          type == SDAP_NESTED_GROUP_DN_USER ? "user" : "group",
+          state->nesting_level);
+
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
 }
 
-static void sdap_nested_group_single_done(struct tevent_req *subreq)
+static errno_t
+sdap_nested_group_walk_next_level(struct sdap_nested_group_walk_state *state)
 {
-    struct tevent_req *req = NULL;
-    errno_t ret;
+    struct sdap_nested_group_member *member = NULL;
+    int i;
 
-    req = tevent_req_callback_data(subreq, struct tevent_req);
+    /* members which are neither users nor groups */
+    for (i = 0; i < state->num_missing; i++) {
+        member = state->missing[i];
+        if (member->found || member->type != SDAP_NESTED_GROUP_DN_UNKNOWN) {
+            continue;
+        }
 
-    /* all nested groups are completed */
-    ret = sdap_nested_group_recurse_recv(subreq);
-    talloc_zfree(subreq);
-    if (ret != EOK) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Error processing nested groups "
-                                    "[%d]: %s.\n", ret, strerror(ret));
-        tevent_req_error(req, ret);
-        return;
+        if (state->ignore_unreadable_references) {
+            DEBUG(SSSDBG_TRACE_FUNC, "Ignoring unreadable reference [%s]\n",
+                  member->dn);
+        } else {
+            DEBUG(SSSDBG_OP_FAILURE, "Unknown entry type [%s]!\n",
+                  member->dn);
+            DEBUG(SSSDBG_OP_FAILURE, "Consider enabling sssd-ldap option "
+                                     "ldap_ignore_unreadable_references\n");
+            return EINVAL;
+        }
     }
 
-    tevent_req_done(req);
+    DEBUG(SSSDBG_TRACE_INTERNAL, "Nesting level %d is resolved, %d nested "
+          "groups were found\n", state->nesting_level, state->num_next_groups);
 
-    return;
-}
+    talloc_zfree(state->level_ctx);
+    talloc_free(state->groups);
 
-static errno_t sdap_nested_group_single_recv(struct tevent_req *req)
-{
-    TEVENT_REQ_RETURN_ON_ERROR(req);
+    state->groups = state->next_groups;
+    state->num_groups = state->num_next_groups;
+    state->next_groups = NULL;
+    state->num_next_groups = 0;
+    state->nesting_level++;
 
-    return EOK;
+    if (state->num_groups == 0) {
+        return EOK;
+    }
+
+    return sdap_nested_group_walk_start_level(state);
 }
 
-static errno_t sdap_nested_group_get_ipa_user(TALLOC_CTX *mem_ctx,
-                                              const char *user_dn,
-                                              struct sysdb_ctx *sysdb,
-                                              struct sysdb_attrs **_user)
+static errno_t
+sdap_nested_group_walk_start_level(struct sdap_nested_group_walk_state *state)
 {
-    TALLOC_CTX *tmp_ctx;
-    struct sysdb_attrs *user;
-    char *name;
     errno_t ret;
+    int i;
 
-    tmp_ctx = talloc_new(NULL);
-    if (tmp_ctx == NULL) {
+    state->level_ctx = talloc_new(state);
+    if (state->level_ctx == NULL) {
         return ENOMEM;
     }
 
-    ret = ipa_get_rdn(tmp_ctx, sysdb, user_dn, &name, "uid",
-                      "cn", "users", "cn", "accounts");
-    if (ret != EOK) {
-        goto done;
-    }
+    state->phase = SDAP_NESTED_GROUP_WALK_DEREF;
+    state->deref_groups = NULL;
+    state->num_deref_groups = 0;
+    state->deref_index = 0;
+    state->missing = NULL;
+    state->num_missing = 0;
+    state->batches = NULL;
+    state->num_batches = 0;
+    state->batch_index = 0;
 
-    user = sysdb_new_attrs(tmp_ctx);
-    if (user == NULL) {
-        ret = ENOMEM;
-        goto done;
-    }
-
-    ret = sysdb_attrs_add_string(user, SYSDB_NAME, name);
-    if (ret != EOK) {
-        goto done;
-    }
+    state->group_ctx->num_levels++;
 
-    ret = sysdb_attrs_add_string(user, SYSDB_ORIG_DN, user_dn);
-    if (ret != EOK) {
-        goto done;
-    }
-
-    ret = sysdb_attrs_add_string(user, SYSDB_OBJECTCATEGORY, SYSDB_USER_CLASS);
-    if (ret != EOK) {
-        goto done;
+    for (i = 0; i < state->num_groups; i++) {
+        ret = sdap_nested_group_walk_collect(state, state->groups[i]);
+        if (ret != EOK) {
+            return ret;
+        }
     }
 
-    *_user = talloc_steal(mem_ctx, user);
+    DEBUG(SSSDBG_TRACE_FUNC, "Nesting level %d: %d groups, %d missing "
+          "members, %d groups to dereference\n", state->nesting_level,
+          state->num_groups, state->num_missing, state->num_deref_groups);
 
-done:
-    talloc_free(tmp_ctx);
-    return ret;
+    return EOK;
 }
 
-struct sdap_nested_group_lookup_user_state {
-    struct sysdb_attrs *user;
-};
-
-static void sdap_nested_group_lookup_user_done(struct tevent_req *subreq);
-
-static struct tevent_req *
-sdap_nested_group_lookup_user_send(TALLOC_CTX *mem_ctx,
-                                   struct tevent_context *ev,
-                                   struct sdap_nested_group_ctx *group_ctx,
-                                   struct sdap_nested_group_member *member)
+static errno_t sdap_nested_group_walk_step(struct tevent_req *req)
 {
-    struct sdap_nested_group_lookup_user_state *state = NULL;
-    struct tevent_req *req = NULL;
+    struct sdap_nested_group_walk_state *state = NULL;
+    struct sdap_attr_map *group_map = NULL;
+    struct ldb_message_element *members = NULL;
     struct tevent_req *subreq = NULL;
-    const char **attrs = NULL;
-    const char *base_filter = NULL;
-    const char *filter = NULL;
+    struct sysdb_attrs *group = NULL;
+    enum sdap_nested_group_dn_type type;
+    const char *orig_dn = NULL;
     errno_t ret;
 
-    req = tevent_req_create(mem_ctx, &state,
-                            struct sdap_nested_group_lookup_user_state);
-    if (req == NULL) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "tevent_req_create() failed\n");
-        return NULL;
-    }
-
-    PROBE(SDAP_NESTED_GROUP_LOOKUP_USER_SEND);
+    state = tevent_req_data(req, struct sdap_nested_group_walk_state);
+    group_map = state->group_ctx->opts->group_map;
 
-    if (group_ctx->opts->schema_type == SDAP_SCHEMA_IPA_V1) {
-        /* if the schema is IPA, then just shortcut and guess the name */
-        ret = sdap_nested_group_get_ipa_user(state, member->dn,
-                                             group_ctx->domain->sysdb,
-                                             &state->user);
-        if (ret == EOK) {
-            goto immediately;
-        }
+    while (true) {
+        switch (state->phase) {
+        case SDAP_NESTED_GROUP_WALK_DEREF:
+            if (state->deref_index < state->num_deref_groups) {
+                group = state->deref_groups[state->deref_index];
+                state->deref_index++;
 
-        DEBUG(SSSDBG_MINOR_FAILURE, "Couldn't parse out user information "
-              "based on DN %s, falling back to an LDAP lookup\n", member->dn);
-    }
+                ret = sysdb_attrs_get_string(group, SYSDB_ORIG_DN, &orig_dn);
+                if (ret != EOK) {
+                    return ret;
+                }
 
-    /* only pull down username and originalDN */
-    attrs = talloc_array(state, const char *, 3);
-    if (attrs == NULL) {
-        ret = ENOMEM;
-        goto immediately;
-    }
+                ret = sysdb_attrs_get_el_ext(group,
+                                     group_map[SDAP_AT_GROUP_MEMBER].sys_name,
+                                     false, &members);
+                if (ret != EOK) {
+                    return ret;
+                }
 
-    attrs[0] = "objectClass";
-    attrs[1] = group_ctx->opts->user_map[SDAP_AT_USER_NAME].name;
-    attrs[2] = NULL;
+                subreq = sdap_nested_group_deref_send(state, state->ev,
+                                                      state->group_ctx,
+                                                      members, orig_dn,
+                                                      state->nesting_level);
+                if (subreq == NULL) {
+                    return ENOMEM;
+                }
 
-    /* create filter */
-    base_filter = talloc_asprintf(state, "(objectclass=%s)",
-                                  group_ctx->opts->user_map[SDAP_OC_USER].name);
-    if (base_filter == NULL) {
-        ret = ENOMEM;
-        goto immediately;
-    }
+                tevent_req_set_callback(subreq,
+                                        sdap_nested_group_walk_deref_done,
+                                        req);
+                return EAGAIN;
+            }
 
-    /* use search base filter if needed */
-    filter = sdap_combine_filters(state, base_filter, member->user_filter);
-    if (filter == NULL) {
-        ret = ENOMEM;
-        goto immediately;
-    }
+            state->phase = SDAP_NESTED_GROUP_WALK_USERS;
+            ret = sdap_nested_group_walk_batches(state,
+                                                 SDAP_NESTED_GROUP_DN_USER);
+            if (ret != EOK) {
+                return ret;
+            }
+            break;
+        case SDAP_NESTED_GROUP_WALK_USERS:
+        case SDAP_NESTED_GROUP_WALK_GROUPS:
+            type = state->phase == SDAP_NESTED_GROUP_WALK_USERS ? \
+                        SDAP_NESTED_GROUP_DN_USER : \
+                        SDAP_NESTED_GROUP_DN_GROUP;
+
+            if (state->batch_index < state->num_batches) {
+                subreq = sdap_nested_group_lookup_send(state, state->ev,
+                                        state->group_ctx, type,
+                                        &state->batches[state->batch_index]);
+                if (subreq == NULL) {
+                    return ENOMEM;
+                }
 
-    /* search */
-    subreq = sdap_get_generic_send(state, ev, group_ctx->opts, group_ctx->sh,
-                                   member->dn, LDAP_SCOPE_BASE, filter, attrs,
-                                   group_ctx->opts->user_map,
-                                   group_ctx->opts->user_map_cnt,
-                                   dp_opt_get_int(group_ctx->opts->basic,
-                                                  SDAP_SEARCH_TIMEOUT),
-                                   false);
-    if (subreq == NULL) {
-        ret = ENOMEM;
-        goto immediately;
-    }
+                state->batch_index++;
 
-    tevent_req_set_callback(subreq, sdap_nested_group_lookup_user_done, req);
+                tevent_req_set_callback(subreq,
+                                        sdap_nested_group_walk_lookup_done,
+                                        req);
+                return EAGAIN;
+            }
 
-    return req;
+            if (state->phase == SDAP_NESTED_GROUP_WALK_USERS) {
+                /* users are resolved, continue with groups and with
+                 * members of unknown type which are not users */
+                state->phase = SDAP_NESTED_GROUP_WALK_GROUPS;
+                ret = sdap_nested_group_walk_batches(state,
+                                                SDAP_NESTED_GROUP_DN_GROUP);
+                if (ret != EOK) {
+                    return ret;
+                }
+                break;
+            }
 
-immediately:
-    if (ret == EOK) {
-        tevent_req_done(req);
-    } else {
-        tevent_req_error(req, ret);
-    }
-    tevent_req_post(req, ev);
+            ret = sdap_nested_group_walk_next_level(state);
+            if (ret != EOK) {
+                return ret;
+            }
 
-    return req;
+            if (state->num_groups == 0) {
+                /* we're done */
+                return EOK;
+            }
+            break;
+        }
+    }
 }
 
-static void sdap_nested_group_lookup_user_done(struct tevent_req *subreq)
+static void sdap_nested_group_walk_deref_done(struct tevent_req *subreq)
 {
-    struct sdap_nested_group_lookup_user_state *state = NULL;
+    struct sdap_nested_group_walk_state *state = NULL;
+    struct sysdb_attrs **nested_groups = NULL;
     struct tevent_req *req = NULL;
-    struct sysdb_attrs **user = NULL;
-    size_t count = 0;
+    int num_groups = 0;
     errno_t ret;
 
     req = tevent_req_callback_data(subreq, struct tevent_req);
-    state = tevent_req_data(req, struct sdap_nested_group_lookup_user_state);
+    state = tevent_req_data(req, struct sdap_nested_group_walk_state);
 
-    ret = sdap_get_generic_recv(subreq, state, &count, &user);
+    ret = sdap_nested_group_deref_recv(state, subreq, &nested_groups,
+                                       &num_groups);
     talloc_zfree(subreq);
-    if (ret == ENOENT) {
-        count = 0;
-    } else if (ret != EOK) {
-        goto done;
+    if (ret == ENOTSUP) {
+        /* dereference is not supported, try again without dereference */
+        state->group_ctx->try_deref = false;
+        ret = sdap_nested_group_walk_undo_deref(state, state->deref_index - 1);
+    } else if (ret == EOK) {
+        ret = sdap_nested_group_walk_add_groups(state, nested_groups,
+                                                num_groups);
+        talloc_free(nested_groups);
     }
 
-    if (count == 1) {
-        state->user = user[0];
-    } else if (count == 0) {
-        /* group not found */
-        state->user = NULL;
-    } else {
-        DEBUG(SSSDBG_OP_FAILURE,
-              "BASE search returned more than one records\n");
-        ret = EIO;
+    if (ret != EOK) {
         goto done;
     }
 
-    ret = EOK;
+    ret = sdap_nested_group_walk_step(req);
 
 done:
-    if (ret != EOK) {
-        tevent_req_error(req, ret);
-        return;
-    }
-
-    tevent_req_done(req);
-}
-
-static errno_t sdap_nested_group_lookup_user_recv(TALLOC_CTX *mem_ctx,
-                                                  struct tevent_req *req,
-                                                  struct sysdb_attrs **_user)
-{
-    struct sdap_nested_group_lookup_user_state *state = NULL;
-    state = tevent_req_data(req, struct sdap_nested_group_lookup_user_state);
-
-    PROBE(SDAP_NESTED_GROUP_LOOKUP_USER_RECV);
-
-    TEVENT_REQ_RETURN_ON_ERROR(req);
-
-    if (_user != NULL) {
-        *_user = talloc_steal(mem_ctx, state->user);
-    }
-
-    return EOK;
-}
-
-struct sdap_nested_group_lookup_group_state {
-    struct sysdb_attrs *group;
-};
-
-static void sdap_nested_group_lookup_group_done(struct tevent_req *subreq);
-
-static struct tevent_req *
-sdap_nested_group_lookup_group_send(TALLOC_CTX *mem_ctx,
-                                    struct tevent_context *ev,
-                                    struct sdap_nested_group_ctx *group_ctx,
-                                    struct sdap_nested_group_member *member)
-{
-     struct sdap_nested_group_lookup_group_state *state = NULL;
-     struct tevent_req *req = NULL;
-     struct tevent_req *subreq = NULL;
-     struct sdap_attr_map *map = group_ctx->opts->group_map;
-     const char **attrs = NULL;
-     const char *base_filter = NULL;
-     const char *filter = NULL;
-     char *oc_list;
-     errno_t ret;
-
-     PROBE(SDAP_NESTED_GROUP_LOOKUP_GROUP_SEND);
-
-     req = tevent_req_create(mem_ctx, &state,
-                             struct sdap_nested_group_lookup_group_state);
-     if (req == NULL) {
-         DEBUG(SSSDBG_CRIT_FAILURE, "tevent_req_create() failed\n");
-         return NULL;
-     }
-
-     ret = build_attrs_from_map(state, group_ctx->opts->group_map,
-                                SDAP_OPTS_GROUP, NULL, &attrs, NULL);
-     if (ret != EOK) {
-         goto immediately;
-     }
-
-     /* create filter */
-     oc_list = sdap_make_oc_list(state, map);
-     if (oc_list == NULL) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to create objectClass list.\n");
-        ret = ENOMEM;
-        goto immediately;
-     }
-
-     base_filter = talloc_asprintf(attrs, "(&(%s)(%s=*))", oc_list,
-                                   map[SDAP_AT_GROUP_NAME].name);
-     if (base_filter == NULL) {
-         ret = ENOMEM;
-         goto immediately;
-     }
-
-     /* use search base filter if needed */
-     filter = sdap_combine_filters(state, base_filter, member->group_filter);
-     if (filter == NULL) {
-         ret = ENOMEM;
-         goto immediately;
-     }
-
-     /* search */
-     subreq = sdap_get_generic_send(state, ev, group_ctx->opts, group_ctx->sh,
-                                    member->dn, LDAP_SCOPE_BASE, filter, attrs,
-                                    map, SDAP_OPTS_GROUP,
-                                    dp_opt_get_int(group_ctx->opts->basic,
-                                                   SDAP_SEARCH_TIMEOUT),
-                                    false);
-     if (subreq == NULL) {
-         ret = ENOMEM;
-         goto immediately;
-     }
-
-     tevent_req_set_callback(subreq, sdap_nested_group_lookup_group_done, req);
-
-     return req;
-
-immediately:
     if (ret == EOK) {
         tevent_req_done(req);
-    } else {
+    } else if (ret != EAGAIN) {
         tevent_req_error(req, ret);
     }
-    tevent_req_post(req, ev);
-
-    return req;
 }
 
-static void sdap_nested_group_lookup_group_done(struct tevent_req *subreq)
+static void sdap_nested_group_walk_lookup_done(struct tevent_req *subreq)
 {
-    struct sdap_nested_group_lookup_group_state *state = NULL;
+    struct sdap_nested_group_walk_state *state = NULL;
+    struct sdap_nested_group_batch *batch = NULL;
+    struct sdap_nested_group_member *member = NULL;
+    struct sysdb_attrs **entries = NULL;
     struct tevent_req *req = NULL;
-    struct sysdb_attrs **group = NULL;
-    size_t count = 0;
+    struct ldb_context *ldb = NULL;
+    enum sdap_nested_group_dn_type type;
+    TALLOC_CTX *tmp_ctx = NULL;
+    size_t num_entries = 0;
+    size_t i;
     errno_t ret;
 
     req = tevent_req_callback_data(subreq, struct tevent_req);
-    state = tevent_req_data(req, struct sdap_nested_group_lookup_group_state);
+    state = tevent_req_data(req, struct sdap_nested_group_walk_state);
+    batch = &state->batches[state->batch_index - 1];
+    ldb = sysdb_ctx_get_ldb(state->group_ctx->domain->sysdb);
+    type = state->phase == SDAP_NESTED_GROUP_WALK_USERS ? \
+                SDAP_NESTED_GROUP_DN_USER : \
+                SDAP_NESTED_GROUP_DN_GROUP;
 
-    ret = sdap_get_generic_recv(subreq, state, &count, &group);
-    talloc_zfree(subreq);
-    if (ret == ENOENT) {
-        count = 0;
-    } else if (ret != EOK) {
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        talloc_zfree(subreq);
+        ret = ENOMEM;
         goto done;
     }
 
-    if (count == 1) {
-        state->group = group[0];
-    } else if (count == 0) {
-        /* group not found */
-        state->group = NULL;
-    } else {
-        DEBUG(SSSDBG_OP_FAILURE,
-              "BASE search returned more than one records\n");
-        ret = EIO;
+    ret = sdap_nested_group_lookup_recv(tmp_ctx, subreq, &num_entries,
+                                        &entries);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Error processing direct membership "
+                                    "[%d]: %s\n", ret, strerror(ret));
         goto done;
     }
 
-    ret = EOK;
+    for (i = 0; i < num_entries; i++) {
+        ret = sdap_nested_group_batch_match(ldb, batch, entries[i], &member);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        if (member == NULL || member->found) {
+            continue;
+        }
+
+        member->found = true;
+
+        ret = sdap_nested_group_walk_save(state, member, type, entries[i]);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    ret = sdap_nested_group_walk_step(req);
 
 done:
-    if (ret != EOK) {
+    talloc_free(tmp_ctx);
+
+    if (ret == EOK) {
+        tevent_req_done(req);
+    } else if (ret != EAGAIN) {
         tevent_req_error(req, ret);
-        return;
     }
-
-    tevent_req_done(req);
 }
 
-static errno_t sdap_nested_group_lookup_group_recv(TALLOC_CTX *mem_ctx,
-                                                   struct tevent_req *req,
-                                                   struct sysdb_attrs **_group)
+static errno_t sdap_nested_group_walk_recv(struct tevent_req *req)
 {
-     struct sdap_nested_group_lookup_group_state *state = NULL;
-     state = tevent_req_data(req, struct sdap_nested_group_lookup_group_state);
-
-     PROBE(SDAP_NESTED_GROUP_LOOKUP_GROUP_RECV);
-
-     TEVENT_REQ_RETURN_ON_ERROR(req);
-
-     if (_group != NULL) {
-         *_group = talloc_steal(mem_ctx, state->group);
-     }
+    TEVENT_REQ_RETURN_ON_ERROR(req);
 
-     return EOK;
+    return EOK;
 }
 
-struct sdap_nested_group_lookup_unknown_state {
-    struct tevent_context *ev;
-    struct sdap_nested_group_ctx *group_ctx;
-    struct sdap_nested_group_member *member;
+struct sdap_nested_group_lookup_state {
     enum sdap_nested_group_dn_type type;
-    struct sysdb_attrs *entry;
-};
+    int num_members;
 
-static void
-sdap_nested_group_lookup_unknown_user_done(struct tevent_req *subreq);
+    size_t num_entries;
+    struct sysdb_attrs **entries;
+};
 
-static void
-sdap_nested_group_lookup_unknown_group_done(struct tevent_req *subreq);
+static void sdap_nested_group_lookup_done(struct tevent_req *subreq);
 
 static struct tevent_req *
-sdap_nested_group_lookup_unknown_send(TALLOC_CTX *mem_ctx,
-                                      struct tevent_context *ev,
-                                      struct sdap_nested_group_ctx *group_ctx,
-                                      struct sdap_nested_group_member *member)
+sdap_nested_group_lookup_send(TALLOC_CTX *mem_ctx,
+                              struct tevent_context *ev,
+                              struct sdap_nested_group_ctx *group_ctx,
+                              enum sdap_nested_group_dn_type type,
+                              struct sdap_nested_group_batch *batch)
 {
-    struct sdap_nested_group_lookup_unknown_state *state = NULL;
+    struct sdap_nested_group_lookup_state *state = NULL;
     struct tevent_req *req = NULL;
     struct tevent_req *subreq = NULL;
+    struct sdap_attr_map *map = NULL;
+    const char **attrs = NULL;
+    const char *base_dn = NULL;
+    const char *base_filter = NULL;
+    const char *filter = NULL;
+    char *oc_list = NULL;
+    int map_num_attrs;
+    int scope;
     errno_t ret;
 
     req = tevent_req_create(mem_ctx, &state,
-                            struct sdap_nested_group_lookup_unknown_state);
+                            struct sdap_nested_group_lookup_state);
     if (req == NULL) {
         DEBUG(SSSDBG_CRIT_FAILURE, "tevent_req_create() failed\n");
         return NULL;
     }
 
-    PROBE(SDAP_NESTED_GROUP_LOOKUP_UNKNOWN_SEND);
+    state->type = type;
+    state->num_members = batch->num_members;
 
-    state->ev = ev;
-    state->group_ctx = group_ctx;
-    state->member = member;
+    if (type == SDAP_NESTED_GROUP_DN_USER) {
+        PROBE(SDAP_NESTED_GROUP_LOOKUP_USER_SEND, state->num_members);
 
-    /* try users first */
-    subreq = sdap_nested_group_lookup_user_send(state,
-                                                state->ev,
-                                                state->group_ctx,
-                                                state->member);
-    if (subreq == NULL) {
-        ret = ENOMEM;
-        tevent_req_error(req, ret);
-        tevent_req_post(req, ev);
+        map = group_ctx->opts->user_map;
+        map_num_attrs = group_ctx->opts->user_map_cnt;
+
+        /* only pull down username and originalDN */
+        attrs = talloc_array(state, const char *, 3);
+        if (attrs == NULL) {
+            ret = ENOMEM;
+            goto immediately;
+        }
+
+        attrs[0] = "objectClass";
+        attrs[1] = map[SDAP_AT_USER_NAME].name;
+        attrs[2] = NULL;
+
+        base_filter = talloc_asprintf(state, "(objectclass=%s)",
+                                      map[SDAP_OC_USER].name);
     } else {
-        tevent_req_set_callback(subreq,
-                                sdap_nested_group_lookup_unknown_user_done,
-                                req);
-    }
+        PROBE(SDAP_NESTED_GROUP_LOOKUP_GROUP_SEND, state->num_members);
 
-    return req;
-}
+        map = group_ctx->opts->group_map;
+        map_num_attrs = SDAP_OPTS_GROUP;
 
-static void
-sdap_nested_group_lookup_unknown_user_done(struct tevent_req *subreq)
-{
-    struct sdap_nested_group_lookup_unknown_state *state = NULL;
-    struct tevent_req *req = NULL;
-    struct sysdb_attrs *entry = NULL;
-    errno_t ret;
+        ret = build_attrs_from_map(state, map, SDAP_OPTS_GROUP, NULL,
+                                   &attrs, NULL);
+        if (ret != EOK) {
+            goto immediately;
+        }
 
-    req = tevent_req_callback_data(subreq, struct tevent_req);
-    state = tevent_req_data(req, struct sdap_nested_group_lookup_unknown_state);
+        oc_list = sdap_make_oc_list(state, map);
+        if (oc_list == NULL) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Failed to create objectClass list.\n");
+            ret = ENOMEM;
+            goto immediately;
+        }
 
-    ret = sdap_nested_group_lookup_user_recv(state, subreq, &entry);
-    talloc_zfree(subreq);
-    if (ret != EOK) {
-        goto done;
+        base_filter = talloc_asprintf(state, "(&(%s)(%s=*))", oc_list,
+                                      map[SDAP_AT_GROUP_NAME].name);
+    }
+    if (base_filter == NULL) {
+        ret = ENOMEM;
+        goto immediately;
     }
 
-    if (entry != NULL) {
-        /* found in users */
-        state->entry = entry;
-        state->type = SDAP_NESTED_GROUP_DN_USER;
-        ret = EOK;
-        goto done;
+    if (batch->num_members == 1 || batch->parent_dn == NULL) {
+        /* a single member is read directly */
+        base_dn = batch->members[0]->dn;
+        scope = LDAP_SCOPE_BASE;
+    } else {
+        /* all members are children of the same container */
+        base_dn = batch->parent_dn;
+        scope = LDAP_SCOPE_ONELEVEL;
+        base_filter = talloc_asprintf(state, "(&%s(|%s))", base_filter,
+                                      batch->rdn_filter);
+        if (base_filter == NULL) {
+            ret = ENOMEM;
+            goto immediately;
+        }
+    }
+
+    /* use search base filter if needed */
+    filter = sdap_combine_filters(state, base_filter, batch->filter);
+    if (filter == NULL) {
+        ret = ENOMEM;
+        goto immediately;
     }
 
-    /* not found in users, try group */
-    subreq = sdap_nested_group_lookup_group_send(state,
-                                                 state->ev,
-                                                 state->group_ctx,
-                                                 state->member);
+    group_ctx->num_lookups++;
+
+    /* search */
+    subreq = sdap_get_generic_send(state, ev, group_ctx->opts, group_ctx->sh,
+                                   base_dn, scope, filter, attrs,
+                                   map, map_num_attrs,
+                                   dp_opt_get_int(group_ctx->opts->basic,
+                                                  SDAP_SEARCH_TIMEOUT),
+                                   false);
     if (subreq == NULL) {
         ret = ENOMEM;
-        goto done;
+        goto immediately;
     }
 
-    tevent_req_set_callback(subreq, sdap_nested_group_lookup_unknown_group_done,
-                            req);
+    tevent_req_set_callback(subreq, sdap_nested_group_lookup_done, req);
 
-    ret = EAGAIN;
+    return req;
 
-done:
+immediately:
     if (ret == EOK) {
         tevent_req_done(req);
-    } else if (ret != EAGAIN) {
+    } else {
         tevent_req_error(req, ret);
     }
+    tevent_req_post(req, ev);
 
-    return;
+    return req;
 }
 
-static void
-sdap_nested_group_lookup_unknown_group_done(struct tevent_req *subreq)
+static void sdap_nested_group_lookup_done(struct tevent_req *subreq)
 {
-    struct sdap_nested_group_lookup_unknown_state *state = NULL;
+    struct sdap_nested_group_lookup_state *state = NULL;
     struct tevent_req *req = NULL;
-    struct sysdb_attrs *entry = NULL;
     errno_t ret;
 
     req = tevent_req_callback_data(subreq, struct tevent_req);
-    state = tevent_req_data(req, struct sdap_nested_group_lookup_unknown_state);
+    state = tevent_req_data(req, struct sdap_nested_group_lookup_state);
 
-    ret = sdap_nested_group_lookup_group_recv(state, subreq, &entry);
+    ret = sdap_get_generic_recv(subreq, state, &state->num_entries,
+                                &state->entries);
     talloc_zfree(subreq);
-    if (ret != EOK) {
-        goto done;
-    }
-
-    if (entry == NULL) {
-        /* not found, end request */
-        state->entry = NULL;
-        state->type = SDAP_NESTED_GROUP_DN_UNKNOWN;
-    } else {
-        /* found in groups */
-        state->entry = entry;
-        state->type = SDAP_NESTED_GROUP_DN_GROUP;
-    }
-
-    ret = EOK;
-
-done:
-    if (ret != EOK) {
+    if (ret == ENOENT) {
+        /* no member was found */
+        state->num_entries = 0;
+        state->entries = NULL;
+    } else if (ret != EOK) {
         tevent_req_error(req, ret);
         return;
     }
@@ -2224,28 +2246,32 @@ done:
     tevent_req_done(req);
 }
 
-static errno_t
-sdap_nested_group_lookup_unknown_recv(TALLOC_CTX *mem_ctx,
-                                      struct tevent_req *req,
-                                      struct sysdb_attrs **_entry,
-                                      enum sdap_nested_group_dn_type *_type)
+static errno_t sdap_nested_group_lookup_recv(TALLOC_CTX *mem_ctx,
+                                             struct tevent_req *req,
+                                             size_t *_num_entries,
+                                             struct sysdb_attrs ***_entries)
 {
-    struct sdap_nested_group_lookup_unknown_state *state = NULL;
-    state = tevent_req_data(req, struct sdap_nested_group_lookup_unknown_state);
+    struct sdap_nested_group_lookup_state *state = NULL;
+    state = tevent_req_data(req, struct sdap_nested_group_lookup_state);
 
-    PROBE(SDAP_NESTED_GROUP_LOOKUP_UNKNOWN_RECV);
+    if (state->type == SDAP_NESTED_GROUP_DN_USER) {
+        PROBE(SDAP_NESTED_GROUP_LOOKUP_USER_RECV, state->num_members,
+              state->num_entries);
+    } else {
+        PROBE(SDAP_NESTED_GROUP_LOOKUP_GROUP_RECV, state->num_members,
+              state->num_entries);
+    }
 
     TEVENT_REQ_RETURN_ON_ERROR(req);
 
-    if (_entry != NULL) {
-        *_entry = talloc_steal(mem_ctx, state->entry);
+    if (_num_entries != NULL) {
+        *_num_entries = state->num_entries;
     }
 
-    if (_type != NULL) {
-        *_type = state->type;
+    if (_entries != NULL) {
+        *_entries = talloc_steal(mem_ctx, state->entries);
     }
 
-
     return EOK;
 }
 
@@ -2260,7 +2286,6 @@ struct sdap_nested_group_deref_state {
 };
 
 static void sdap_nested_group_deref_direct_done(struct tevent_req *subreq);
-static void sdap_nested_group_deref_done(struct tevent_req *subreq);
 
 static struct tevent_req *
 sdap_nested_group_deref_send(TALLOC_CTX *mem_ctx,
@@ -2295,6 +2320,8 @@ sdap_nested_group_deref_send(TALLOC_CTX *mem_ctx,
     state->nesting_level = nesting_level;
     state->num_groups = 0; /* we will count exact number of the groups */
 
+    group_ctx->num_derefs++;
+
     maps = talloc_array(state, struct sdap_attr_map_info, num_maps);
     if (maps == NULL) {
         ret = ENOMEM;
@@ -2556,76 +2583,43 @@ done:
 
 static void sdap_nested_group_deref_direct_done(struct tevent_req *subreq)
 {
-    struct sdap_nested_group_deref_state *state = NULL;
     struct tevent_req *req = NULL;
     errno_t ret;
 
     req = tevent_req_callback_data(subreq, struct tevent_req);
-    state = tevent_req_data(req, struct sdap_nested_group_deref_state);
 
-    /* process direct members */
+    /* process direct members, nested groups are resolved by the caller */
     ret = sdap_nested_group_deref_direct_process(subreq);
     talloc_zfree(subreq);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Error processing direct membership "
                                     "[%d]: %s\n", ret, strerror(ret));
-        goto done;
-    }
-
-    /* we have processed all direct members,
-     * now recurse and process nested groups */
-    subreq = sdap_nested_group_recurse_send(state, state->ev,
-                                            state->group_ctx,
-                                            state->nested_groups,
-                                            state->num_groups,
-                                            state->nesting_level + 1);
-    if (subreq == NULL) {
-        ret = ENOMEM;
-        goto done;
-    }
-
-    tevent_req_set_callback(subreq, sdap_nested_group_deref_done, req);
-
-    ret = EAGAIN;
-
-done:
-    if (ret == EOK) {
-        /* tevent_req_error() cannot cope with EOK */
-        DEBUG(SSSDBG_CRIT_FAILURE, "We should not get here with EOK\n");
-        tevent_req_error(req, EINVAL);
-    } else if (ret != EAGAIN) {
         tevent_req_error(req, ret);
+        return;
     }
 
-    return;
-
+    tevent_req_done(req);
 }
 
-static void sdap_nested_group_deref_done(struct tevent_req *subreq)
+static errno_t sdap_nested_group_deref_recv(TALLOC_CTX *mem_ctx,
+                                            struct tevent_req *req,
+                                            struct sysdb_attrs ***_nested_groups,
+                                            int *_num_groups)
 {
-    struct tevent_req *req = NULL;
-    errno_t ret;
+    struct sdap_nested_group_deref_state *state = NULL;
+    state = tevent_req_data(req, struct sdap_nested_group_deref_state);
 
-    req = tevent_req_callback_data(subreq, struct tevent_req);
+    PROBE(SDAP_NESTED_GROUP_DEREF_RECV);
 
-    /* process nested groups */
-    ret = sdap_nested_group_recurse_recv(subreq);
-    talloc_zfree(subreq);
+    TEVENT_REQ_RETURN_ON_ERROR(req);
 
-    if (ret == EOK) {
-        tevent_req_done(req);
-    } else {
-        tevent_req_error(req, ret);
+    if (_nested_groups != NULL) {
+        *_nested_groups = talloc_steal(mem_ctx, state->nested_groups);
     }
 
-    return;
-}
-
-static errno_t sdap_nested_group_deref_recv(struct tevent_req *req)
-{
-    PROBE(SDAP_NESTED_GROUP_DEREF_RECV);
-
-    TEVENT_REQ_RETURN_ON_ERROR(req);
+    if (_num_groups != NULL) {
+        *_num_groups = state->num_groups;
+    }
 
     return EOK;
 }
@@ -128,6 +128,12 @@ errno_t get_sysdb_grouplist_dn(TALLOC_CTX *mem_ctx,
                                char ***grouplist);
 
 /* from sdap_async_nested_groups.c */
+/* Maximum number of members looked up with a single search, it keeps the OR
+ * filter well below the filter size limits of the servers. */
+#ifndef NESTED_GROUP_LOOKUP_CHUNK
+#define NESTED_GROUP_LOOKUP_CHUNK  50
+#endif /* NESTED_GROUP_LOOKUP_CHUNK */
+
 struct tevent_req *sdap_nested_group_send(TALLOC_CTX *mem_ctx,
                                           struct tevent_context *ev,
                                           struct sdap_domain *sdom,
@@ -168,15 +168,17 @@ static int sdap_user_set_mpg(struct sysdb_attrs *user_attrs,
     return EOK;
 }
 
-/* FIXME: support storing additional attributes */
-int sdap_save_user(TALLOC_CTX *memctx,
-                   struct sdap_options *opts,
-                   struct sss_domain_info *dom,
-                   struct sysdb_attrs *attrs,
-                   struct sysdb_attrs *mapped_attrs,
-                   char **_usn_value,
-                   time_t now,
-                   bool set_non_posix)
+/* Translates the LDAP attributes of a user into the arguments needed to
+ * store it in the cache. On success with item->name left NULL the user
+ * must be skipped without storing anything.
+ */
+static errno_t sdap_save_user_prepare(TALLOC_CTX *memctx,
+                                      struct sdap_options *opts,
+                                      struct sss_domain_info *dom,
+                                      struct sysdb_attrs *attrs,
+                                      bool set_non_posix,
+                                      struct sysdb_store_user_item *item,
+                                      char **_usn_value)
 {
     struct ldb_message_element *el;
     int ret;
@@ -193,7 +195,6 @@ int sdap_save_user(TALLOC_CTX *memctx,
     struct sysdb_attrs *user_attrs;
     char *upn = NULL;
     size_t i;
-    int cache_timeout;
     char *usn_value = NULL;
     char **missing = NULL;
     TALLOC_CTX *tmpctx = NULL;
@@ -209,6 +210,8 @@ int sdap_save_user(TALLOC_CTX *memctx,
 
     DEBUG(SSSDBG_TRACE_FUNC, "Save user\n");
 
+    memset(item, 0, sizeof(struct sysdb_store_user_item));
+
     tmpctx = talloc_new(NULL);
     if (!tmpctx) {
         ret = ENOMEM;
@@ -624,8 +627,6 @@ int sdap_save_user(TALLOC_CTX *memctx,
         }
     }
 
-    cache_timeout = dom->user_timeout;
-
     ret = sdap_save_all_names(user_name, attrs, dom,
                               SYSDB_MEMBER_USER, user_attrs);
     if (ret != EOK) {
@@ -642,23 +643,23 @@ int sdap_save_user(TALLOC_CTX *memctx,
         goto done;
     }
 
-    DEBUG(SSSDBG_TRACE_FUNC, "Storing info for user %s\n", user_name);
-
-    ret = sysdb_store_user(dom, user_name, pwd, uid, gid,
-                           gecos, homedir, shell, orig_dn,
-                           user_attrs, missing, cache_timeout, now);
-    if (ret) goto done;
-
-    if (mapped_attrs != NULL) {
-        ret = sysdb_set_user_attr(dom, user_name, mapped_attrs, SYSDB_MOD_ADD);
-        if (ret) return ret;
-    }
+    item->domain = dom;
+    item->name = user_name;
+    item->pwd = pwd;
+    item->uid = uid;
+    item->gid = gid;
+    item->gecos = gecos;
+    item->homedir = homedir;
+    item->shell = shell;
+    item->orig_dn = orig_dn;
+    item->attrs = talloc_steal(memctx, user_attrs);
+    item->remove_attrs = missing;
+    item->cache_timeout = dom->user_timeout;
 
     if (_usn_value) {
         *_usn_value = talloc_steal(memctx, usn_value);
     }
 
-    talloc_steal(memctx, user_attrs);
     ret = EOK;
 
 done:
@@ -671,6 +672,52 @@ done:
     return ret;
 }
 
+/* FIXME: support storing additional attributes */
+int sdap_save_user(TALLOC_CTX *memctx,
+                   struct sdap_options *opts,
+                   struct sss_domain_info *dom,
+                   struct sysdb_attrs *attrs,
+                   struct sysdb_attrs *mapped_attrs,
+                   char **_usn_value,
+                   time_t now,
+                   bool set_non_posix)
+{
+    struct sysdb_store_user_item item;
+    char *usn_value = NULL;
+    errno_t ret;
+
+    ret = sdap_save_user_prepare(memctx, opts, dom, attrs, set_non_posix,
+                                 &item, &usn_value);
+    if (ret != EOK || item.name == NULL) {
+        return ret;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Storing info for user %s\n", item.name);
+
+    ret = sysdb_store_user(item.domain, item.name, item.pwd,
+                           item.uid, item.gid, item.gecos,
+                           item.homedir, item.shell, item.orig_dn,
+                           item.attrs, item.remove_attrs,
+                           item.cache_timeout, now);
+    if (ret == EOK && mapped_attrs != NULL) {
+        ret = sysdb_set_user_attr(item.domain, item.name, mapped_attrs,
+                                  SYSDB_MOD_ADD);
+    }
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to save user [%s]\n", item.name);
+        talloc_free(usn_value);
+        return ret;
+    }
+
+    if (_usn_value) {
+        *_usn_value = usn_value;
+    } else {
+        talloc_free(usn_value);
+    }
+
+    return EOK;
+}
+
 
 /* ==Generic-Function-to-save-multiple-users============================= */
 
@@ -684,6 +731,10 @@ int sdap_save_users(TALLOC_CTX *memctx,
                     char **_usn_value)
 {
     TALLOC_CTX *tmpctx;
+    struct sysdb_store_user_item *items;
+    char **usn_values;
+    size_t num_items = 0;
+    size_t c;
     char *higher_usn = NULL;
     char *usn_value;
     int ret;
@@ -717,21 +768,50 @@ int sdap_save_users(TALLOC_CTX *memctx,
         }
     }
 
-    now = time(NULL);
+    items = talloc_zero_array(tmpctx, struct sysdb_store_user_item, num_users);
+    usn_values = talloc_zero_array(tmpctx, char *, num_users);
+    if (items == NULL || usn_values == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    /* Do not fail completely on errors.
+     * Just report the failure to save and go on */
     for (i = 0; i < num_users; i++) {
-        usn_value = NULL;
+        ret = sdap_save_user_prepare(tmpctx, opts, dom, users[i], false,
+                                     &items[num_items],
+                                     &usn_values[num_items]);
+        if (ret) {
+            DEBUG(SSSDBG_OP_FAILURE, "Failed to store user %d. Ignoring.\n", i);
+        } else if (items[num_items].name != NULL) {
+            num_items++;
+        }
+    }
 
-        ret = sdap_save_user(tmpctx, opts, dom, users[i], mapped_attrs,
-                             &usn_value, now, false);
+    now = time(NULL);
+    ret = sysdb_store_users_bulk(sysdb, items, num_items, now);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to store users [%d]: %s\n",
+              ret, sss_strerror(ret));
+        goto done;
+    }
+
+    for (c = 0; c < num_items; c++) {
+        ret = items[c].ret;
+        if (ret == EOK && mapped_attrs != NULL) {
+            ret = sysdb_set_user_attr(items[c].domain, items[c].name,
+                                      mapped_attrs, SYSDB_MOD_ADD);
+        }
 
-        /* Do not fail completely on errors.
-         * Just report the failure to save and go on */
         if (ret) {
-            DEBUG(SSSDBG_OP_FAILURE, "Failed to store user %d. Ignoring.\n", i);
-        } else {
-            DEBUG(SSSDBG_TRACE_ALL, "User %d processed!\n", i);
+            DEBUG(SSSDBG_OP_FAILURE, "Failed to store user %s. Ignoring.\n",
+                  items[c].name);
+            continue;
         }
 
+        DEBUG(SSSDBG_TRACE_ALL, "User %s processed!\n", items[c].name);
+
+        usn_value = usn_values[c];
         if (usn_value) {
             if (higher_usn) {
                 if ((strlen(usn_value) > strlen(higher_usn)) ||
@@ -790,6 +870,9 @@ struct sdap_search_user_state {
 
     size_t base_iter;
     struct sdap_search_base **search_bases;
+
+    sdap_stream_batch_fn batch_fn;
+    void *batch_pvt;
 };
 
 static errno_t sdap_search_user_next_base(struct tevent_req *req);
@@ -798,16 +881,19 @@ static void sdap_search_user_copy_batch(struct sdap_search_user_state *state,
                                         size_t count);
 static void sdap_search_user_process(struct tevent_req *subreq);
 
-struct tevent_req *sdap_search_user_send(TALLOC_CTX *memctx,
-                                         struct tevent_context *ev,
-                                         struct sss_domain_info *dom,
-                                         struct sdap_options *opts,
-                                         struct sdap_search_base **search_bases,
-                                         struct sdap_handle *sh,
-                                         const char **attrs,
-                                         const char *filter,
-                                         int timeout,
-                                         enum sdap_entry_lookup_type lookup_type)
+static struct tevent_req *
+sdap_search_user_internal_send(TALLOC_CTX *memctx,
+                               struct tevent_context *ev,
+                               struct sss_domain_info *dom,
+                               struct sdap_options *opts,
+                               struct sdap_search_base **search_bases,
+                               struct sdap_handle *sh,
+                               const char **attrs,
+                               const char *filter,
+                               int timeout,
+                               enum sdap_entry_lookup_type lookup_type,
+                               sdap_stream_batch_fn batch_fn,
+                               void *batch_pvt)
 {
     errno_t ret;
     struct tevent_req *req;
@@ -829,6 +915,8 @@ struct tevent_req *sdap_search_user_send(TALLOC_CTX *memctx,
     state->base_iter = 0;
     state->search_bases = search_bases;
     state->lookup_type = lookup_type;
+    state->batch_fn = batch_fn;
+    state->batch_pvt = batch_pvt;
 
     if (!state->search_bases) {
         DEBUG(SSSDBG_CRIT_FAILURE,
@@ -848,6 +936,35 @@ done:
     return req;
 }
 
+struct tevent_req *sdap_search_user_send(TALLOC_CTX *memctx,
+                                         struct tevent_context *ev,
+                                         struct sss_domain_info *dom,
+                                         struct sdap_options *opts,
+                                         struct sdap_search_base **search_bases,
+                                         struct sdap_handle *sh,
+                                         const char **attrs,
+                                         const char *filter,
+                                         int timeout,
+                                         enum sdap_entry_lookup_type lookup_type)
+{
+    return sdap_search_user_internal_send(memctx, ev, dom, opts, search_bases,
+                                          sh, attrs, filter, timeout,
+                                          lookup_type, NULL, NULL);
+}
+
+/* Enumerations keep all entries, there is nothing to filter out, so the
+ * batches are just counted and passed on */
+static errno_t sdap_search_user_batch(struct sysdb_attrs **entries,
+                                      size_t count,
+                                      void *pvt)
+{
+    struct sdap_search_user_state *state = talloc_get_type(pvt,
+                                                struct sdap_search_user_state);
+
+    state->count += count;
+    return state->batch_fn(entries, count, state->batch_pvt);
+}
+
 static errno_t sdap_search_user_next_base(struct tevent_req *req)
 {
     struct tevent_req *subreq;
@@ -883,14 +1000,25 @@ static errno_t sdap_search_user_next_base(struct tevent_req *req)
         break;
     }
 
-    subreq = sdap_get_and_parse_generic_send(
-            state, state->ev, state->opts, state->sh,
-            state->search_bases[state->base_iter]->basedn,
-            state->search_bases[state->base_iter]->scope,
-            state->filter, state->attrs,
-            state->opts->user_map, state->opts->user_map_cnt,
-            0, NULL, NULL, sizelimit, state->timeout,
-            need_paging);
+    if (state->batch_fn != NULL) {
+        subreq = sdap_get_and_parse_generic_stream_send(
+                state, state->ev, state->opts, state->sh,
+                state->search_bases[state->base_iter]->basedn,
+                state->search_bases[state->base_iter]->scope,
+                state->filter, state->attrs,
+                state->opts->user_map, state->opts->user_map_cnt,
+                sizelimit, state->timeout, need_paging,
+                sdap_search_user_batch, state);
+    } else {
+        subreq = sdap_get_and_parse_generic_send(
+                state, state->ev, state->opts, state->sh,
+                state->search_bases[state->base_iter]->basedn,
+                state->search_bases[state->base_iter]->scope,
+                state->filter, state->attrs,
+                state->opts->user_map, state->opts->user_map_cnt,
+                0, NULL, NULL, sizelimit, state->timeout,
+                need_paging);
+    }
     if (subreq == NULL) {
         return ENOMEM;
     }
@@ -1023,8 +1151,37 @@ struct sdap_get_users_state {
     struct sysdb_attrs **users;
     struct sysdb_attrs *mapped_attrs;
     size_t count;
+    bool streamed;
+
+    sdap_entry_keep_fn keep_fn;
+    void *keep_pvt;
 };
 
+static size_t sdap_get_users_keep(struct sdap_get_users_state *state,
+                                  struct sysdb_attrs **users,
+                                  size_t count)
+{
+    size_t kept = 0;
+    size_t i;
+
+    if (state->keep_fn == NULL) {
+        return count;
+    }
+
+    /* The users which are not kept stay allocated with the array */
+    for (i = 0; i < count; i++) {
+        if (state->keep_fn(users[i], state->keep_pvt)) {
+            users[kept] = users[i];
+            kept++;
+        }
+    }
+
+    return kept;
+}
+
+static errno_t sdap_get_users_save_batch(struct sysdb_attrs **users,
+                                         size_t count,
+                                         void *pvt);
 static void sdap_get_users_done(struct tevent_req *subreq);
 
 struct tevent_req *sdap_get_users_send(TALLOC_CTX *memctx,
@@ -1038,7 +1195,9 @@ struct tevent_req *sdap_get_users_send(TALLOC_CTX *memctx,
                                        const char *filter,
                                        int timeout,
                                        enum sdap_entry_lookup_type lookup_type,
-                                       struct sysdb_attrs *mapped_attrs)
+                                       struct sysdb_attrs *mapped_attrs,
+                                       sdap_entry_keep_fn keep_fn,
+                                       void *keep_pvt)
 {
     errno_t ret;
     struct tevent_req *req;
@@ -1051,6 +1210,8 @@ struct tevent_req *sdap_get_users_send(TALLOC_CTX *memctx,
     state->sysdb = sysdb;
     state->opts = opts;
     state->dom = dom;
+    state->keep_fn = keep_fn;
+    state->keep_pvt = keep_pvt;
 
     state->filter = filter;
     PROBE(SDAP_SEARCH_USER_SEND, state->filter);
@@ -1072,8 +1233,17 @@ struct tevent_req *sdap_get_users_send(TALLOC_CTX *memctx,
         }
     }
 
-    subreq = sdap_search_user_send(state, ev, dom, opts, search_bases,
-                                   sh, attrs, filter, timeout, lookup_type);
+    /* An enumeration saves the users while the search is running instead
+     * of keeping all of them in memory until it finishes */
+    state->streamed = (lookup_type == SDAP_LOOKUP_ENUMERATE);
+
+    subreq = sdap_search_user_internal_send(state, ev, dom, opts,
+                                            search_bases, sh, attrs, filter,
+                                            timeout, lookup_type,
+                                            state->streamed ?
+                                                sdap_get_users_save_batch :
+                                                NULL,
+                                            state);
     if (subreq == NULL) {
         ret = ENOMEM;
         goto done;
@@ -1090,6 +1260,49 @@ done:
     return req;
 }
 
+static errno_t sdap_get_users_save_batch(struct sysdb_attrs **users,
+                                         size_t count,
+                                         void *pvt)
+{
+    struct sdap_get_users_state *state = talloc_get_type(pvt,
+                                                struct sdap_get_users_state);
+    char *usn_value = NULL;
+    errno_t ret;
+
+    count = sdap_get_users_keep(state, users, count);
+    if (count == 0) {
+        return EOK;
+    }
+
+    PROBE(SDAP_SEARCH_USER_SAVE_BEGIN, state->filter);
+    ret = sdap_save_users(state, state->sysdb,
+                          state->dom, state->opts,
+                          users, count,
+                          state->mapped_attrs,
+                          &usn_value);
+    PROBE(SDAP_SEARCH_USER_SAVE_END, state->filter);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Failed to store users [%d][%s].\n",
+              ret, sss_strerror(ret));
+        return ret;
+    }
+
+    if (usn_value != NULL) {
+        if (state->higher_usn == NULL
+                || strlen(usn_value) > strlen(state->higher_usn)
+                || (strlen(usn_value) == strlen(state->higher_usn)
+                    && strcmp(usn_value, state->higher_usn) > 0)) {
+            talloc_free(state->higher_usn);
+            state->higher_usn = usn_value;
+        } else {
+            talloc_free(usn_value);
+        }
+    }
+
+    DEBUG(SSSDBG_TRACE_ALL, "Saving %zu Users - Done\n", count);
+    return EOK;
+}
+
 static void sdap_get_users_done(struct tevent_req *subreq)
 {
     struct tevent_req *req = tevent_req_callback_data(subreq,
@@ -1098,6 +1311,25 @@ static void sdap_get_users_done(struct tevent_req *subreq)
                                             struct sdap_get_users_state);
     int ret;
 
+    if (state->streamed) {
+        /* The users were saved batch by batch already */
+        ret = sdap_search_user_recv(state, subreq, NULL, NULL, &state->count);
+        talloc_zfree(subreq);
+        if (ret != EOK) {
+            if (ret != ENOENT) {
+                DEBUG(SSSDBG_OP_FAILURE,
+                      "Failed to retrieve users [%d][%s].\n",
+                      ret, sss_strerror(ret));
+            }
+            tevent_req_error(req, ret);
+            return;
+        }
+
+        DEBUG(SSSDBG_TRACE_FUNC, "Saved %zu Users\n", state->count);
+        tevent_req_done(req);
+        return;
+    }
+
     ret = sdap_search_user_recv(state, subreq, &state->higher_usn,
                                 &state->users, &state->count);
     if (ret) {
@@ -1109,6 +1341,8 @@ static void sdap_get_users_done(struct tevent_req *subreq)
         return;
     }
 
+    state->count = sdap_get_users_keep(state, state->users, state->count);
+
     PROBE(SDAP_SEARCH_USER_SAVE_BEGIN, state->filter);
 
     ret = sdap_save_users(state, state->sysdb,
@@ -33,8 +33,10 @@ struct sdap_id_conn_cache {
 
     /* list of all open connections */
     struct sdap_id_conn_data *connections;
-    /* cached (current) connection */
-    struct sdap_id_conn_data *cached_connection;
+    /* number of pooled connections, new operations are spread over them */
+    int num_pooled;
+    /* id of the next connection, used in debug messages */
+    unsigned int next_conn_id;
 };
 
 /* LDAP async operation tracker:
@@ -82,12 +84,20 @@ struct sdap_id_conn_data {
      * connection will be disconnected and should
      * not be used any more */
     bool disconnecting;
+    /* connection is part of the pool and can be used by new operations */
+    bool pooled;
+    /* connection id and operation counters for debug messages */
+    unsigned int id;
+    int num_ops;
+    uint64_t total_ops;
 };
 
 static void sdap_id_conn_cache_be_offline_cb(void *pvt);
 static void sdap_id_conn_cache_fo_reconnect_cb(void *pvt);
 
 static void sdap_id_release_conn_data(struct sdap_id_conn_data *conn_data);
+static void sdap_id_conn_data_pool(struct sdap_id_conn_data *conn_data);
+static void sdap_id_conn_data_unpool(struct sdap_id_conn_data *conn_data);
 static int sdap_id_conn_data_destroy(struct sdap_id_conn_data *conn_data);
 static bool sdap_is_connection_expired(struct sdap_id_conn_data *conn_data, int timeout);
 static bool sdap_can_reuse_connection(struct sdap_id_conn_data *conn_data);
@@ -153,16 +163,64 @@ fail:
     return ret;
 }
 
+/* Pool size configured for the connection cache */
+static int sdap_id_conn_cache_pool_size(struct sdap_id_conn_cache *conn_cache)
+{
+    int pool_size;
+
+    pool_size = dp_opt_get_int(conn_cache->id_conn->id_ctx->opts->basic,
+                               SDAP_CONNECTION_POOL_SIZE);
+
+    return pool_size < 1 ? 1 : pool_size;
+}
+
+/* Make new operations use the connection */
+static void sdap_id_conn_data_pool(struct sdap_id_conn_data *conn_data)
+{
+    if (!conn_data->pooled) {
+        conn_data->pooled = true;
+        conn_data->conn_cache->num_pooled++;
+    }
+}
+
+/* Stop using the connection for new operations, the running ones continue */
+static void sdap_id_conn_data_unpool(struct sdap_id_conn_data *conn_data)
+{
+    if (conn_data->pooled) {
+        conn_data->pooled = false;
+        conn_data->conn_cache->num_pooled--;
+    }
+}
+
+/* Check whether another pooled connection is already established */
+static bool sdap_id_conn_cache_has_other(struct sdap_id_conn_cache *conn_cache,
+                                         struct sdap_id_conn_data *conn_data)
+{
+    struct sdap_id_conn_data *iter;
+
+    DLIST_FOR_EACH(iter, conn_cache->connections) {
+        if (iter != conn_data && iter->pooled && iter->connect_req == NULL
+                && iter->sh != NULL && iter->sh->connected) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 /* Callback on BE going offline */
 static void sdap_id_conn_cache_be_offline_cb(void *pvt)
 {
     struct sdap_id_conn_cache *conn_cache = talloc_get_type(pvt, struct sdap_id_conn_cache);
-    struct sdap_id_conn_data *cached_connection = conn_cache->cached_connection;
+    struct sdap_id_conn_data *conn_data;
+    struct sdap_id_conn_data *next;
 
-    /* Release any cached connection on going offline */
-    if (cached_connection != NULL) {
-        conn_cache->cached_connection = NULL;
-        sdap_id_release_conn_data(cached_connection);
+    /* Release all pooled connections on going offline */
+    DLIST_FOR_EACH_SAFE(conn_data, next, conn_cache->connections) {
+        if (conn_data->pooled) {
+            sdap_id_conn_data_unpool(conn_data);
+            sdap_id_release_conn_data(conn_data);
+        }
     }
 }
 
@@ -170,11 +228,13 @@ static void sdap_id_conn_cache_be_offline_cb(void *pvt)
 static void sdap_id_conn_cache_fo_reconnect_cb(void *pvt)
 {
     struct sdap_id_conn_cache *conn_cache = talloc_get_type(pvt, struct sdap_id_conn_cache);
-    struct sdap_id_conn_data *cached_connection = conn_cache->cached_connection;
+    struct sdap_id_conn_data *conn_data;
 
-    /* Release any cached connection on going offline */
-    if (cached_connection != NULL) {
-        cached_connection->disconnecting = true;
+    /* Pooled connections are replaced by new ones with the next operation */
+    DLIST_FOR_EACH(conn_data, conn_cache->connections) {
+        if (conn_data->pooled) {
+            conn_data->disconnecting = true;
+        }
     }
 }
 
@@ -191,7 +251,7 @@ static void sdap_id_release_conn_data(struct sdap_id_conn_data *conn_data)
     }
 
     conn_cache = conn_data->conn_cache;
-    if (conn_data == conn_cache->cached_connection) {
+    if (conn_data->pooled) {
         return;
     }
 
@@ -204,7 +264,9 @@ static void sdap_id_release_conn_data(struct sdap_id_conn_data *conn_data)
         }
     }
 
-    DEBUG(SSSDBG_TRACE_ALL, "Releasing unused connection with fd [%d]\n", fd);
+    DEBUG(SSSDBG_TRACE_ALL,
+          "Releasing unused connection #%u with fd [%d] after %"PRIu64" "
+          "operations\n", conn_data->id, fd, conn_data->total_ops);
 
     DLIST_REMOVE(conn_cache->connections, conn_data);
     talloc_zfree(conn_data);
@@ -220,6 +282,9 @@ static int sdap_id_conn_data_destroy(struct sdap_id_conn_data *conn_data)
         op->conn_data = NULL;
         DLIST_REMOVE(conn_data->ops, op);
     }
+    conn_data->num_ops = 0;
+
+    sdap_id_conn_data_unpool(conn_data);
 
     return 0;
 }
@@ -302,12 +367,12 @@ static void sdap_id_conn_data_expire_handler(struct tevent_context *ev,
 {
     struct sdap_id_conn_data *conn_data = talloc_get_type(pvt,
                                                           struct sdap_id_conn_data);
-    struct sdap_id_conn_cache *conn_cache = conn_data->conn_cache;
 
-    if (conn_cache->cached_connection == conn_data) {
+    if (conn_data->pooled) {
         DEBUG(SSSDBG_TRACE_ALL,
-              "Connection is about to expire, releasing it\n");
-        conn_cache->cached_connection = NULL;
+              "Connection #%u is about to expire, releasing it\n",
+              conn_data->id);
+        sdap_id_conn_data_unpool(conn_data);
         sdap_id_release_conn_data(conn_data);
     }
 }
@@ -369,14 +434,13 @@ static void sdap_id_conn_data_idle_handler(struct tevent_context *ev,
 {
     struct sdap_id_conn_data *conn_data = talloc_get_type(pvt,
                                                           struct sdap_id_conn_data);
-    struct sdap_id_conn_cache *conn_cache = conn_data->conn_cache;
 
     time_t now;
     time_t idle_time;
     int idle_timeout;
     struct timeval tv;
 
-    if (conn_cache->cached_connection != conn_data) {
+    if (!conn_data->pooled) {
         DEBUG(SSSDBG_TRACE_ALL, "Abandoning idle timer for released connection\n");
         return;
     }
@@ -387,8 +451,9 @@ static void sdap_id_conn_data_idle_handler(struct tevent_context *ev,
 
     if (idle_time != 0 && idle_time + idle_timeout <= now) {
         DEBUG(SSSDBG_TRACE_ALL,
-              "Connection has reached idle timeout, releasing it\n");
-        conn_cache->cached_connection = NULL;
+              "Connection #%u has reached idle timeout, releasing it\n",
+              conn_data->id);
+        sdap_id_conn_data_unpool(conn_data);
         sdap_id_release_conn_data(conn_data);
         return;
     }
@@ -463,6 +528,7 @@ static void sdap_id_op_hook_conn_data(struct sdap_id_op *op, struct sdap_id_conn
 
     if (current) {
         DLIST_REMOVE(current->ops, op);
+        current->num_ops--;
     }
 
     op->conn_data = conn_data;
@@ -470,10 +536,15 @@ static void sdap_id_op_hook_conn_data(struct sdap_id_op *op, struct sdap_id_conn
     if (conn_data) {
         sdap_id_conn_data_not_idle(conn_data);
         DLIST_ADD_END(conn_data->ops, op, struct sdap_id_op*);
+        conn_data->num_ops++;
+        conn_data->total_ops++;
+        DEBUG(SSSDBG_TRACE_ALL,
+              "Connection #%u has %d running operations, %"PRIu64" in total\n",
+              conn_data->id, conn_data->num_ops, conn_data->total_ops);
     }
 
     if (current && !current->ops) {
-        if (current == current->conn_cache->cached_connection) {
+        if (current->pooled) {
             sdap_id_conn_data_idle(current);
         } else {
             sdap_id_release_conn_data(current);
@@ -610,29 +681,53 @@ static int sdap_id_op_connect_step(struct tevent_req *req)
 
     int ret = EOK;
     struct sdap_id_conn_data *conn_data;
+    struct sdap_id_conn_data *next;
+    struct sdap_id_conn_data *best = NULL;
+    bool connecting = false;
     struct tevent_req *subreq = NULL;
 
-    /* Try to reuse context cached connection */
-    conn_data = conn_cache->cached_connection;
-    if (conn_data) {
+    /* Pick the pooled connection with the fewest running operations */
+    DLIST_FOR_EACH_SAFE(conn_data, next, conn_cache->connections) {
+        if (!conn_data->pooled) {
+            continue;
+        }
+
         if (conn_data->connect_req) {
-            DEBUG(SSSDBG_TRACE_ALL, "waiting for connection to complete\n");
-            sdap_id_op_hook_conn_data(op, conn_data);
-            goto done;
+            connecting = true;
+        } else if (!sdap_can_reuse_connection(conn_data)) {
+            DEBUG(SSSDBG_TRACE_ALL,
+                  "releasing expired pooled connection #%u\n", conn_data->id);
+            sdap_id_conn_data_unpool(conn_data);
+            sdap_id_release_conn_data(conn_data);
+            continue;
         }
 
-        if (sdap_can_reuse_connection(conn_data)) {
-            DEBUG(SSSDBG_TRACE_ALL, "reusing cached connection\n");
-            sdap_id_op_hook_conn_data(op, conn_data);
-            goto done;
+        if (best == NULL || conn_data->num_ops < best->num_ops) {
+            best = conn_data;
         }
+    }
 
-        DEBUG(SSSDBG_TRACE_ALL, "releasing expired cached connection\n");
-        conn_cache->cached_connection = NULL;
-        sdap_id_release_conn_data(conn_data);
+    /* Open another connection only if all pooled connections are busy and
+     * established, so an unreachable server is not hit by a burst of
+     * connection attempts. */
+    if (best != NULL
+            && (best->num_ops == 0 || connecting
+                || conn_cache->num_pooled >= sdap_id_conn_cache_pool_size(conn_cache))) {
+        if (best->connect_req) {
+            DEBUG(SSSDBG_TRACE_ALL,
+                  "waiting for connection #%u to complete\n", best->id);
+        } else {
+            DEBUG(SSSDBG_TRACE_ALL,
+                  "reusing pooled connection #%u\n", best->id);
+        }
+        sdap_id_op_hook_conn_data(op, best);
+        conn_data = NULL;
+        goto done;
     }
 
-    DEBUG(SSSDBG_TRACE_ALL, "beginning to connect\n");
+    DEBUG(SSSDBG_TRACE_ALL, "beginning to connect, %d of %d pooled "
+          "connections are open\n", conn_cache->num_pooled,
+          sdap_id_conn_cache_pool_size(conn_cache));
 
     conn_data = talloc_zero(conn_cache, struct sdap_id_conn_data);
     if (!conn_data) {
@@ -643,6 +738,7 @@ static int sdap_id_op_connect_step(struct tevent_req *req)
     talloc_set_destructor(conn_data, sdap_id_conn_data_destroy);
 
     conn_data->conn_cache = conn_cache;
+    conn_data->id = conn_cache->next_conn_id++;
     subreq = sdap_cli_connect_send(conn_data, state->ev,
                                    state->id_conn->id_ctx->opts,
                                    state->id_conn->id_ctx->be,
@@ -658,7 +754,7 @@ static int sdap_id_op_connect_step(struct tevent_req *req)
     conn_data->connect_req = subreq;
 
     DLIST_ADD(conn_cache->connections, conn_data);
-    conn_cache->cached_connection = conn_data;
+    sdap_id_conn_data_pool(conn_data);
 
     sdap_id_op_hook_conn_data(op, conn_data);
 
@@ -813,10 +909,8 @@ static void sdap_id_op_connect_done(struct tevent_req *subreq)
             /* failed to connect or connection got broken during notify */
             bool retry = false;
 
-            /* drop connection from cache now */
-            if (conn_cache->cached_connection == conn_data) {
-                conn_cache->cached_connection = NULL;
-            }
+            /* drop connection from the pool now */
+            sdap_id_conn_data_unpool(conn_data);
 
             if (can_retry) {
                 /* determining whether retry is possible */
@@ -876,20 +970,22 @@ static void sdap_id_op_connect_done(struct tevent_req *subreq)
 
     if ((ret == EOK)
             && conn_data->sh->connected
-            && !be_is_offline(conn_cache->id_conn->id_ctx->be)) {
+            && !be_is_offline(conn_cache->id_conn->id_ctx->be)
+            && (conn_data->pooled
+                || conn_cache->num_pooled < sdap_id_conn_cache_pool_size(conn_cache))) {
         DEBUG(SSSDBG_TRACE_ALL,
-              "caching successful connection after %d notifies\n", notify_count);
-        conn_cache->cached_connection = conn_data;
-
-        /* Run any post-connection routines */
-        be_run_unconditional_online_cb(conn_cache->id_conn->id_ctx->be);
-        be_run_online_cb(conn_cache->id_conn->id_ctx->be);
-
-    } else {
-        if (conn_cache->cached_connection == conn_data) {
-            conn_cache->cached_connection = NULL;
+              "pooling successful connection #%u after %d notifies\n",
+              conn_data->id, notify_count);
+        sdap_id_conn_data_pool(conn_data);
+
+        /* Run any post-connection routines, but only once when the pool
+         * grows beyond the first connection */
+        if (!sdap_id_conn_cache_has_other(conn_cache, conn_data)) {
+            be_run_unconditional_online_cb(conn_cache->id_conn->id_ctx->be);
+            be_run_online_cb(conn_cache->id_conn->id_ctx->be);
         }
-
+    } else {
+        sdap_id_conn_data_unpool(conn_data);
         sdap_id_release_conn_data(conn_data);
     }
 
@@ -994,13 +1090,15 @@ int sdap_id_op_done(struct sdap_id_op *op, int retval, int *dp_err_out)
             break;
     }
 
-    if (communication_error && current_conn != 0
-            && current_conn == op->conn_cache->cached_connection) {
-        /* do not reuse failed connection */
-        op->conn_cache->cached_connection = NULL;
+    if (communication_error && current_conn != 0 && current_conn->pooled) {
+        /* do not reuse failed connection, the other pooled connections
+         * are replaced as well as they use the same server */
+        sdap_id_conn_data_unpool(current_conn);
+        sdap_id_conn_cache_fo_reconnect_cb(op->conn_cache);
 
         DEBUG(SSSDBG_FUNC_DATA,
-              "communication error on cached connection, moving to next server\n");
+              "communication error on pooled connection #%u, moving to next "
+              "server\n", current_conn->id);
         be_fo_try_next_server(op->conn_cache->id_conn->id_ctx->be,
                               op->conn_cache->id_conn->service->name);
     }
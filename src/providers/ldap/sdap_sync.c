@@ -0,0 +1,1421 @@
+/*
+    SSSD
+
+    LDAP server side change tracking (syncrepl and DirSync)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+
+#include "util/util.h"
+#include "db/sysdb.h"
+#include "providers/ldap/ldap_common.h"
+#include "providers/ldap/sdap_async.h"
+#include "providers/ldap/sdap_sync.h"
+
+/* syncUUID is an RFC 4122 UUID in network byte order */
+#define SDAP_SYNC_UUID_LEN 16
+
+/* Upper limit for the data returned by a single DirSync search */
+#define SDAP_DIRSYNC_MAX_BYTES 0x100000
+
+/* DirSync returns the changes in rounds, stop after this many rounds and
+ * continue with the next run of the task */
+#define SDAP_DIRSYNC_MAX_ROUNDS 100
+
+errno_t sdap_sync_mode_from_string(const char *str,
+                                   enum sdap_sync_mode *_mode)
+{
+    if (str == NULL || strcasecmp(str, "none") == 0) {
+        *_mode = SDAP_SYNC_NONE;
+    } else if (strcasecmp(str, "auto") == 0) {
+        *_mode = SDAP_SYNC_AUTO;
+    } else if (strcasecmp(str, "syncrepl") == 0) {
+        *_mode = SDAP_SYNC_SYNCREPL;
+    } else if (strcasecmp(str, "dirsync") == 0) {
+        *_mode = SDAP_SYNC_DIRSYNC;
+    } else {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Unknown value [%s] of ldap_change_tracking\n", str);
+        return EINVAL;
+    }
+
+    return EOK;
+}
+
+static struct berval *sdap_sync_bv_dup(TALLOC_CTX *mem_ctx,
+                                       const struct berval *src)
+{
+    struct berval *bv;
+
+    bv = talloc_zero(mem_ctx, struct berval);
+    if (bv == NULL) {
+        return NULL;
+    }
+
+    if (src->bv_len == 0) {
+        return bv;
+    }
+
+    bv->bv_val = talloc_memdup(bv, src->bv_val, src->bv_len);
+    if (bv->bv_val == NULL) {
+        talloc_free(bv);
+        return NULL;
+    }
+    bv->bv_len = src->bv_len;
+
+    return bv;
+}
+
+static char *sdap_sync_uuid_to_str(TALLOC_CTX *mem_ctx,
+                                   const struct berval *uuid)
+{
+    const uint8_t *b = (const uint8_t *) uuid->bv_val;
+
+    if (uuid->bv_len != SDAP_SYNC_UUID_LEN) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Unexpected syncUUID length [%zu]\n", (size_t) uuid->bv_len);
+        return NULL;
+    }
+
+    return talloc_asprintf(mem_ctx,
+                           "%02x%02x%02x%02x-%02x%02x-%02x%02x-"
+                           "%02x%02x-%02x%02x%02x%02x%02x%02x",
+                           b[0], b[1], b[2], b[3], b[4], b[5], b[6], b[7],
+                           b[8], b[9], b[10], b[11], b[12], b[13], b[14],
+                           b[15]);
+}
+
+static errno_t sdap_sync_ber_flatten(TALLOC_CTX *mem_ctx,
+                                     BerElement *ber,
+                                     struct berval **_value)
+{
+    struct berval *flat = NULL;
+    struct berval *value;
+    int lret;
+
+    lret = ber_flatten(ber, &flat);
+    if (lret == -1) {
+        DEBUG(SSSDBG_OP_FAILURE, "ber_flatten failed\n");
+        return EIO;
+    }
+
+    value = sdap_sync_bv_dup(mem_ctx, flat);
+    ber_bvfree(flat);
+    if (value == NULL) {
+        return ENOMEM;
+    }
+
+    *_value = value;
+    return EOK;
+}
+
+errno_t sdap_sync_encode_syncrepl_request(TALLOC_CTX *mem_ctx,
+                                          struct berval *cookie,
+                                          struct berval **_value)
+{
+    BerElement *ber;
+    errno_t ret;
+    int lret;
+
+    ber = ber_alloc_t(LBER_USE_DER);
+    if (ber == NULL) {
+        return ENOMEM;
+    }
+
+    /* syncRequestValue ::= SEQUENCE { mode, cookie OPTIONAL,
+     *                                 reloadHint DEFAULT FALSE } */
+    if (cookie != NULL && cookie->bv_len > 0) {
+        lret = ber_printf(ber, "{eO}", (ber_int_t) LDAP_SYNC_REFRESH_ONLY,
+                          cookie);
+    } else {
+        lret = ber_printf(ber, "{e}", (ber_int_t) LDAP_SYNC_REFRESH_ONLY);
+    }
+    if (lret == -1) {
+        DEBUG(SSSDBG_OP_FAILURE, "ber_printf failed\n");
+        ret = EIO;
+        goto done;
+    }
+
+    ret = sdap_sync_ber_flatten(mem_ctx, ber, _value);
+
+done:
+    ber_free(ber, 1);
+    return ret;
+}
+
+errno_t sdap_sync_parse_state_control(TALLOC_CTX *mem_ctx,
+                                      struct berval *value,
+                                      int *_state,
+                                      char **_uuid,
+                                      struct berval **_cookie)
+{
+    BerElement *ber;
+    ber_int_t state;
+    struct berval uuid_bv;
+    struct berval cookie_bv;
+    struct berval *cookie = NULL;
+    char *uuid;
+    ber_tag_t tag;
+    ber_len_t len;
+    errno_t ret;
+
+    ber = ber_init(value);
+    if (ber == NULL) {
+        return ENOMEM;
+    }
+
+    /* syncStateValue ::= SEQUENCE { state, entryUUID, cookie OPTIONAL } */
+    tag = ber_scanf(ber, "{em", &state, &uuid_bv);
+    if (tag == LBER_ERROR) {
+        DEBUG(SSSDBG_OP_FAILURE, "Malformed Sync State control\n");
+        ret = EINVAL;
+        goto done;
+    }
+
+    uuid = sdap_sync_uuid_to_str(mem_ctx, &uuid_bv);
+    if (uuid == NULL) {
+        ret = EINVAL;
+        goto done;
+    }
+
+    tag = ber_peek_tag(ber, &len);
+    if (tag == LDAP_TAG_SYNC_COOKIE) {
+        tag = ber_scanf(ber, "m", &cookie_bv);
+        if (tag == LBER_ERROR) {
+            DEBUG(SSSDBG_OP_FAILURE, "Malformed Sync State cookie\n");
+            talloc_free(uuid);
+            ret = EINVAL;
+            goto done;
+        }
+
+        cookie = sdap_sync_bv_dup(mem_ctx, &cookie_bv);
+        if (cookie == NULL) {
+            talloc_free(uuid);
+            ret = ENOMEM;
+            goto done;
+        }
+    }
+
+    *_state = state;
+    *_uuid = uuid;
+    *_cookie = cookie;
+    ret = EOK;
+
+done:
+    ber_free(ber, 1);
+    return ret;
+}
+
+static errno_t sdap_sync_scan_cookie(TALLOC_CTX *mem_ctx,
+                                     BerElement *ber,
+                                     struct berval **_cookie)
+{
+    struct berval cookie_bv;
+    ber_tag_t tag;
+    ber_len_t len;
+
+    tag = ber_peek_tag(ber, &len);
+    if (tag != LDAP_TAG_SYNC_COOKIE) {
+        *_cookie = NULL;
+        return EOK;
+    }
+
+    tag = ber_scanf(ber, "m", &cookie_bv);
+    if (tag == LBER_ERROR) {
+        return EINVAL;
+    }
+
+    *_cookie = sdap_sync_bv_dup(mem_ctx, &cookie_bv);
+    if (*_cookie == NULL) {
+        return ENOMEM;
+    }
+
+    return EOK;
+}
+
+static errno_t sdap_sync_scan_uuids(TALLOC_CTX *mem_ctx,
+                                    BerElement *ber,
+                                    char ***_uuids)
+{
+    BerVarray uuids_bv = NULL;
+    char **uuids;
+    ber_tag_t tag;
+    size_t count;
+    size_t i;
+    errno_t ret;
+
+    tag = ber_scanf(ber, "[W]", &uuids_bv);
+    if (tag == LBER_ERROR) {
+        return EINVAL;
+    }
+
+    for (count = 0; uuids_bv != NULL && uuids_bv[count].bv_val != NULL;
+         count++);
+
+    uuids = talloc_zero_array(mem_ctx, char *, count + 1);
+    if (uuids == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (i = 0; i < count; i++) {
+        uuids[i] = sdap_sync_uuid_to_str(uuids, &uuids_bv[i]);
+        if (uuids[i] == NULL) {
+            talloc_free(uuids);
+            ret = EINVAL;
+            goto done;
+        }
+    }
+
+    *_uuids = uuids;
+    ret = EOK;
+
+done:
+    ber_bvarray_free(uuids_bv);
+    return ret;
+}
+
+errno_t sdap_sync_parse_info(TALLOC_CTX *mem_ctx,
+                             struct berval *value,
+                             struct berval **_cookie,
+                             char ***_deleted_uuids)
+{
+    TALLOC_CTX *tmp_ctx;
+    BerElement *ber;
+    struct berval *cookie = NULL;
+    char **uuids = NULL;
+    ber_int_t refresh_deletes = 0;
+    struct berval cookie_bv;
+    ber_tag_t tag;
+    ber_len_t len;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ber = ber_init(value);
+    if (ber == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    tag = ber_peek_tag(ber, &len);
+    switch (tag) {
+    case LDAP_TAG_SYNC_NEW_COOKIE:
+        tag = ber_scanf(ber, "m", &cookie_bv);
+        if (tag == LBER_ERROR) {
+            ret = EINVAL;
+            goto done;
+        }
+
+        cookie = sdap_sync_bv_dup(tmp_ctx, &cookie_bv);
+        if (cookie == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+        break;
+
+    case LDAP_TAG_SYNC_REFRESH_DELETE:
+    case LDAP_TAG_SYNC_REFRESH_PRESENT:
+        /* SEQUENCE { cookie OPTIONAL, refreshDone DEFAULT TRUE } */
+        tag = ber_scanf(ber, "{");
+        if (tag == LBER_ERROR) {
+            ret = EINVAL;
+            goto done;
+        }
+
+        ret = sdap_sync_scan_cookie(tmp_ctx, ber, &cookie);
+        if (ret != EOK) {
+            goto done;
+        }
+        break;
+
+    case LDAP_TAG_SYNC_ID_SET:
+        /* SEQUENCE { cookie OPTIONAL, refreshDeletes DEFAULT FALSE,
+         *            syncUUIDs SET OF syncUUID } */
+        tag = ber_scanf(ber, "{");
+        if (tag == LBER_ERROR) {
+            ret = EINVAL;
+            goto done;
+        }
+
+        ret = sdap_sync_scan_cookie(tmp_ctx, ber, &cookie);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        tag = ber_peek_tag(ber, &len);
+        if (tag == LDAP_TAG_REFRESHDELETES) {
+            tag = ber_scanf(ber, "b", &refresh_deletes);
+            if (tag == LBER_ERROR) {
+                ret = EINVAL;
+                goto done;
+            }
+        }
+
+        if (!refresh_deletes) {
+            /* The present phase lists the entries which did not change,
+             * removed entries are only implied by their absence. */
+            DEBUG(SSSDBG_TRACE_FUNC,
+                  "Ignoring syncIdSet of present entries\n");
+            break;
+        }
+
+        ret = sdap_sync_scan_uuids(tmp_ctx, ber, &uuids);
+        if (ret != EOK) {
+            goto done;
+        }
+        break;
+
+    default:
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Unknown Sync Info Message [%#lx]\n", (unsigned long) tag);
+        ret = EINVAL;
+        goto done;
+    }
+
+    *_cookie = talloc_steal(mem_ctx, cookie);
+    *_deleted_uuids = talloc_steal(mem_ctx, uuids);
+    ret = EOK;
+
+done:
+    if (ber != NULL) {
+        ber_free(ber, 1);
+    }
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+errno_t sdap_sync_parse_done_control(TALLOC_CTX *mem_ctx,
+                                     struct berval *value,
+                                     struct berval **_cookie)
+{
+    BerElement *ber;
+    ber_tag_t tag;
+    errno_t ret;
+
+    ber = ber_init(value);
+    if (ber == NULL) {
+        return ENOMEM;
+    }
+
+    /* syncDoneValue ::= SEQUENCE { cookie OPTIONAL,
+     *                              refreshDeletes DEFAULT FALSE } */
+    tag = ber_scanf(ber, "{");
+    if (tag == LBER_ERROR) {
+        DEBUG(SSSDBG_OP_FAILURE, "Malformed Sync Done control\n");
+        ret = EINVAL;
+        goto done;
+    }
+
+    ret = sdap_sync_scan_cookie(mem_ctx, ber, _cookie);
+
+done:
+    ber_free(ber, 1);
+    return ret;
+}
+
+errno_t sdap_sync_encode_dirsync_request(TALLOC_CTX *mem_ctx,
+                                         int flags,
+                                         struct berval *cookie,
+                                         struct berval **_value)
+{
+    struct berval empty = { 0, NULL };
+    BerElement *ber;
+    errno_t ret;
+    int lret;
+
+    ber = ber_alloc_t(LBER_USE_DER);
+    if (ber == NULL) {
+        return ENOMEM;
+    }
+
+    /* SEQUENCE { Flags, MaxBytes, Cookie } */
+    lret = ber_printf(ber, "{iiO}", (ber_int_t) flags,
+                      (ber_int_t) SDAP_DIRSYNC_MAX_BYTES,
+                      cookie != NULL ? cookie : &empty);
+    if (lret == -1) {
+        DEBUG(SSSDBG_OP_FAILURE, "ber_printf failed\n");
+        ret = EIO;
+        goto done;
+    }
+
+    ret = sdap_sync_ber_flatten(mem_ctx, ber, _value);
+
+done:
+    ber_free(ber, 1);
+    return ret;
+}
+
+errno_t sdap_sync_parse_dirsync_response(TALLOC_CTX *mem_ctx,
+                                         struct berval *value,
+                                         bool *_more,
+                                         struct berval **_cookie)
+{
+    BerElement *ber;
+    ber_int_t more;
+    ber_int_t unused;
+    struct berval cookie_bv;
+    struct berval *cookie;
+    ber_tag_t tag;
+    errno_t ret;
+
+    ber = ber_init(value);
+    if (ber == NULL) {
+        return ENOMEM;
+    }
+
+    /* SEQUENCE { MoreResults, unused, CookieServer } */
+    tag = ber_scanf(ber, "{iim}", &more, &unused, &cookie_bv);
+    if (tag == LBER_ERROR) {
+        DEBUG(SSSDBG_OP_FAILURE, "Malformed DirSync response control\n");
+        ret = EINVAL;
+        goto done;
+    }
+
+    cookie = sdap_sync_bv_dup(mem_ctx, &cookie_bv);
+    if (cookie == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    *_more = (more != 0);
+    *_cookie = cookie;
+    ret = EOK;
+
+done:
+    ber_free(ber, 1);
+    return ret;
+}
+
+static errno_t sdap_sync_find_cached(TALLOC_CTX *mem_ctx,
+                                     struct sss_domain_info *dom,
+                                     struct sdap_sync_change *change,
+                                     struct ldb_message **_msg)
+{
+    const char *attrs[] = { SYSDB_NAME, SYSDB_OBJECTCATEGORY, NULL };
+    enum sysdb_member_type types[] = { SYSDB_MEMBER_USER, SYSDB_MEMBER_GROUP };
+    struct ldb_message **msgs;
+    struct ldb_result *res;
+    size_t count;
+    size_t i;
+    errno_t ret;
+
+    if (change->dn != NULL) {
+        for (i = 0; i < N_ELEMENTS(types); i++) {
+            ret = sysdb_search_by_orig_dn(mem_ctx, dom, types[i], change->dn,
+                                          attrs, &count, &msgs);
+            if (ret == EOK && count > 0) {
+                *_msg = msgs[0];
+                return EOK;
+            } else if (ret != EOK && ret != ENOENT) {
+                return ret;
+            }
+        }
+    }
+
+    /* The DN is not known for UUIDs from a syncIdSet, it also changes
+     * when the entry is renamed or deleted in Active Directory */
+    if (change->uuid != NULL) {
+        ret = sysdb_search_object_by_uuid(mem_ctx, dom, change->uuid,
+                                          attrs, &res);
+        if (ret == EOK && res->count > 0) {
+            *_msg = res->msgs[0];
+            return EOK;
+        } else if (ret != EOK && ret != ENOENT) {
+            return ret;
+        }
+    }
+
+    return ENOENT;
+}
+
+errno_t sdap_sync_apply_changes(struct sss_domain_info *dom,
+                                struct sdap_sync_change *changes,
+                                size_t num_changes,
+                                size_t *_num_expired,
+                                size_t *_num_deleted)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message *msg;
+    const char *name;
+    const char *category;
+    size_t num_expired = 0;
+    size_t num_deleted = 0;
+    size_t i;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    for (i = 0; i < num_changes; i++) {
+        ret = sdap_sync_find_cached(tmp_ctx, dom, &changes[i], &msg);
+        if (ret == ENOENT) {
+            /* Not cached, it will be looked up when requested */
+            continue;
+        } else if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "Cannot look up [%s][%s] in cache "
+                  "[%d]: %s\n", changes[i].dn ? changes[i].dn : "-",
+                  changes[i].uuid ? changes[i].uuid : "-",
+                  ret, sss_strerror(ret));
+            goto done;
+        }
+
+        if (changes[i].deleted) {
+            DEBUG(SSSDBG_TRACE_FUNC, "Removing [%s] deleted on the server\n",
+                  ldb_dn_get_linearized(msg->dn));
+            ret = sysdb_delete_entry(dom->sysdb, msg->dn, true);
+            if (ret != EOK) {
+                DEBUG(SSSDBG_OP_FAILURE, "Cannot remove [%s] [%d]: %s\n",
+                      ldb_dn_get_linearized(msg->dn), ret, sss_strerror(ret));
+                goto done;
+            }
+            num_deleted++;
+            continue;
+        }
+
+        name = ldb_msg_find_attr_as_string(msg, SYSDB_NAME, NULL);
+        category = ldb_msg_find_attr_as_string(msg, SYSDB_OBJECTCATEGORY, NULL);
+        if (name == NULL || category == NULL) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "Skipping incomplete entry [%s]\n",
+                  ldb_dn_get_linearized(msg->dn));
+            continue;
+        }
+
+        DEBUG(SSSDBG_TRACE_FUNC, "Expiring [%s] changed on the server\n",
+              ldb_dn_get_linearized(msg->dn));
+        ret = sysdb_invalidate_cache_entry(dom, name,
+                                    strcasecmp(category, SYSDB_USER_CLASS) == 0);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "Cannot expire [%s] [%d]: %s\n",
+                  ldb_dn_get_linearized(msg->dn), ret, sss_strerror(ret));
+            goto done;
+        }
+        num_expired++;
+    }
+
+    if (_num_expired != NULL) {
+        *_num_expired = num_expired;
+    }
+
+    if (_num_deleted != NULL) {
+        *_num_deleted = num_deleted;
+    }
+
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+/* ==Change-Tracking-Request================================================ */
+struct sdap_sync_ctx {
+    struct sdap_id_ctx *id_ctx;
+    struct sdap_domain *sdom;
+    enum sdap_sync_mode mode;
+};
+
+struct sdap_sync_state {
+    struct tevent_context *ev;
+    struct sdap_sync_ctx *sctx;
+    struct sss_domain_info *dom;
+    struct sdap_id_op *op;
+    struct sdap_handle *sh;
+
+    enum sdap_sync_mode mode;
+    const char *base;
+    const char *filter;
+    int timeout;
+
+    /* DirSync only reports entries with changes of the requested
+     * attributes, so all mapped attributes are requested */
+    const char **dirsync_attrs;
+
+    /* No cookie was stored yet, only the cookie is recorded */
+    bool initial;
+    struct berval *cookie;
+    int rounds;
+
+    struct sdap_sync_change *changes;
+    size_t num_changes;
+
+    /* The server lost track of the cookie, tracking starts over */
+    bool refresh_required;
+};
+
+static void sdap_sync_connect_done(struct tevent_req *subreq);
+static errno_t sdap_sync_next_search(struct tevent_req *req);
+static errno_t sdap_sync_parse_msg(struct sdap_handle *sh,
+                                   LDAPMessage *msg,
+                                   void *pvt);
+static void sdap_sync_search_done(struct tevent_req *subreq);
+static errno_t sdap_sync_finish(struct tevent_req *req);
+
+static struct tevent_req *
+sdap_sync_send(TALLOC_CTX *mem_ctx,
+               struct tevent_context *ev,
+               struct be_ctx *be_ctx,
+               struct be_ptask *be_ptask,
+               void *pvt)
+{
+    struct sdap_sync_state *state;
+    struct sdap_options *opts;
+    struct tevent_req *req;
+    struct tevent_req *subreq;
+    uint8_t *cookie;
+    size_t cookie_len;
+    errno_t ret;
+
+    req = tevent_req_create(mem_ctx, &state, struct sdap_sync_state);
+    if (req == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "tevent_req_create() failed\n");
+        return NULL;
+    }
+
+    state->ev = ev;
+    state->sctx = talloc_get_type_abort(pvt, struct sdap_sync_ctx);
+    state->dom = state->sctx->sdom->dom;
+    opts = state->sctx->id_ctx->opts;
+
+    state->base = state->sctx->sdom->naming_context != NULL
+                        ? state->sctx->sdom->naming_context
+                        : state->sctx->sdom->basedn;
+    state->timeout = dp_opt_get_int(opts->basic, SDAP_ENUM_SEARCH_TIMEOUT);
+    state->filter = talloc_asprintf(state, "(|(objectClass=%s)(objectClass=%s))",
+                                    opts->user_map[SDAP_OC_USER].name,
+                                    opts->group_map[SDAP_OC_GROUP].name);
+    if (state->filter == NULL) {
+        ret = ENOMEM;
+        goto immediately;
+    }
+
+    ret = sysdb_get_change_tracking_cookie(state, state->dom,
+                                           &cookie, &cookie_len);
+    if (ret == ENOENT) {
+        state->initial = true;
+    } else if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot read change tracking cookie "
+              "[%d]: %s\n", ret, sss_strerror(ret));
+        goto immediately;
+    } else {
+        state->cookie = talloc_zero(state, struct berval);
+        if (state->cookie == NULL) {
+            ret = ENOMEM;
+            goto immediately;
+        }
+        state->cookie->bv_val = (char *) talloc_steal(state->cookie, cookie);
+        state->cookie->bv_len = cookie_len;
+    }
+
+    state->op = sdap_id_op_create(state, state->sctx->id_ctx->conn->conn_cache);
+    if (state->op == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "sdap_id_op_create failed\n");
+        ret = ENOMEM;
+        goto immediately;
+    }
+
+    subreq = sdap_id_op_connect_send(state->op, state, &ret);
+    if (subreq == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE, "sdap_id_op_connect_send failed: %d\n", ret);
+        goto immediately;
+    }
+
+    tevent_req_set_callback(subreq, sdap_sync_connect_done, req);
+    return req;
+
+immediately:
+    tevent_req_error(req, ret);
+    tevent_req_post(req, ev);
+    return req;
+}
+
+static void sdap_sync_connect_done(struct tevent_req *subreq)
+{
+    struct tevent_req *req = tevent_req_callback_data(subreq,
+                                                      struct tevent_req);
+    struct sdap_sync_state *state = tevent_req_data(req,
+                                                    struct sdap_sync_state);
+    int dp_error;
+    errno_t ret;
+
+    ret = sdap_id_op_connect_recv(subreq, &dp_error);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        if (dp_error == DP_ERR_OFFLINE) {
+            DEBUG(SSSDBG_TRACE_FUNC,
+                  "Backend is marked offline, retry later!\n");
+            tevent_req_done(req);
+        } else {
+            DEBUG(SSSDBG_MINOR_FAILURE, "Change tracking failed to connect "
+                  "to LDAP server: (%d)[%s]\n", ret, sss_strerror(ret));
+            tevent_req_error(req, ret);
+        }
+        return;
+    }
+
+    state->sh = sdap_id_op_handle(state->op);
+
+    state->mode = state->sctx->mode;
+    if (state->mode == SDAP_SYNC_AUTO) {
+        if (sdap_is_control_supported(state->sh, LDAP_CONTROL_SYNC)) {
+            state->mode = SDAP_SYNC_SYNCREPL;
+        } else if (sdap_is_control_supported(state->sh,
+                                             LDAP_CONTROL_X_DIRSYNC)) {
+            state->mode = SDAP_SYNC_DIRSYNC;
+        } else {
+            DEBUG(SSSDBG_MINOR_FAILURE, "The server supports neither "
+                  "syncrepl nor DirSync, changes are not tracked\n");
+            tevent_req_error(req, ENOTSUP);
+            return;
+        }
+    }
+
+    ret = sdap_sync_next_search(req);
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+}
+
+static errno_t sdap_sync_dirsync_attrs(struct sdap_sync_state *state,
+                                       const char ***_attrs)
+{
+    struct sdap_options *opts = state->sctx->id_ctx->opts;
+    const char **user_attrs;
+    const char **group_attrs;
+    const char **attrs;
+    size_t num_user_attrs;
+    size_t num_group_attrs;
+    size_t n = 0;
+    size_t i;
+    errno_t ret;
+
+    if (state->dirsync_attrs != NULL) {
+        *_attrs = state->dirsync_attrs;
+        return EOK;
+    }
+
+    ret = build_attrs_from_map(state, opts->user_map, opts->user_map_cnt,
+                               NULL, &user_attrs, &num_user_attrs);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = build_attrs_from_map(state, opts->group_map, SDAP_OPTS_GROUP,
+                               NULL, &group_attrs, &num_group_attrs);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    attrs = talloc_zero_array(state, const char *,
+                              num_user_attrs + num_group_attrs + 3);
+    if (attrs == NULL) {
+        return ENOMEM;
+    }
+
+    attrs[n++] = "objectGUID";
+    attrs[n++] = "isDeleted";
+    for (i = 0; i < num_user_attrs; i++) {
+        attrs[n++] = user_attrs[i];
+    }
+    for (i = 0; i < num_group_attrs; i++) {
+        if (!string_in_list(group_attrs[i], discard_const(attrs), false)) {
+            attrs[n++] = group_attrs[i];
+        }
+    }
+
+    state->dirsync_attrs = attrs;
+    *_attrs = attrs;
+    return EOK;
+}
+
+static errno_t sdap_sync_next_search(struct tevent_req *req)
+{
+    struct sdap_sync_state *state = tevent_req_data(req,
+                                                    struct sdap_sync_state);
+    /* Only the DN and the UUID are needed to find the cached entry */
+    const char *syncrepl_attrs[] = { LDAP_NO_ATTRS, NULL };
+    const char *dirsync_initial_attrs[] = { "objectGUID", NULL };
+    const char **attrs;
+    const char *ctrl_oid;
+    const char *resp_ctrl_oid;
+    struct berval *value = NULL;
+    LDAPControl *ctrls[2] = { NULL, NULL };
+    struct tevent_req *subreq;
+    errno_t ret;
+    int lret;
+
+    if (state->mode == SDAP_SYNC_SYNCREPL) {
+        ctrl_oid = LDAP_CONTROL_SYNC;
+        resp_ctrl_oid = LDAP_CONTROL_SYNC_DONE;
+        attrs = syncrepl_attrs;
+        ret = sdap_sync_encode_syncrepl_request(state, state->cookie, &value);
+    } else {
+        ctrl_oid = LDAP_CONTROL_X_DIRSYNC;
+        resp_ctrl_oid = LDAP_CONTROL_X_DIRSYNC;
+        if (state->initial) {
+            attrs = dirsync_initial_attrs;
+        } else {
+            ret = sdap_sync_dirsync_attrs(state, &attrs);
+            if (ret != EOK) {
+                return ret;
+            }
+        }
+        ret = sdap_sync_encode_dirsync_request(state,
+                                               LDAP_DIRSYNC_OBJECT_SECURITY
+                                               | LDAP_DIRSYNC_INCREMENTAL_VALUES,
+                                               state->cookie, &value);
+    }
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot encode [%s] control [%d]: %s\n",
+              ctrl_oid, ret, sss_strerror(ret));
+        return ret;
+    }
+
+    lret = sdap_control_create(state->sh, ctrl_oid, 1, value, 1, &ctrls[0]);
+    talloc_free(value);
+    if (lret != LDAP_SUCCESS) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "The server does not support the change tracking control, "
+              "check ldap_change_tracking\n");
+        return lret == LDAP_NOT_SUPPORTED ? ENOTSUP : EIO;
+    }
+
+    state->rounds++;
+    DEBUG(SSSDBG_TRACE_FUNC, "Requesting %s changes of [%s] under [%s]\n",
+          state->initial ? "the initial state instead of the" : "the",
+          state->dom->name, state->base);
+
+    subreq = sdap_get_ctrl_search_send(state, state->ev, state->sh,
+                                       state->base, LDAP_SCOPE_SUBTREE,
+                                       state->filter, attrs, ctrls,
+                                       resp_ctrl_oid, state->timeout,
+                                       sdap_sync_parse_msg, req);
+    ldap_control_free(ctrls[0]);
+    if (subreq == NULL) {
+        return ENOMEM;
+    }
+
+    tevent_req_set_callback(subreq, sdap_sync_search_done, req);
+    return EOK;
+}
+
+static errno_t sdap_sync_add_change(struct sdap_sync_state *state,
+                                    const char *dn,
+                                    const char *uuid,
+                                    bool deleted)
+{
+    struct sdap_sync_change *change;
+
+    if (state->initial) {
+        /* Everything is reported during the initial refresh, it only
+         * serves to obtain a cookie */
+        return EOK;
+    }
+
+    state->changes = talloc_realloc(state, state->changes,
+                                    struct sdap_sync_change,
+                                    state->num_changes + 1);
+    if (state->changes == NULL) {
+        return ENOMEM;
+    }
+
+    change = &state->changes[state->num_changes];
+    change->dn = NULL;
+    change->uuid = NULL;
+    change->deleted = deleted;
+
+    if (dn != NULL) {
+        change->dn = talloc_strdup(state->changes, dn);
+        if (change->dn == NULL) {
+            return ENOMEM;
+        }
+    }
+
+    if (uuid != NULL) {
+        change->uuid = talloc_strdup(state->changes, uuid);
+        if (change->uuid == NULL) {
+            return ENOMEM;
+        }
+    }
+
+    state->num_changes++;
+    return EOK;
+}
+
+static void sdap_sync_set_cookie(struct sdap_sync_state *state,
+                                 struct berval *cookie)
+{
+    if (cookie == NULL) {
+        return;
+    }
+
+    talloc_free(state->cookie);
+    state->cookie = talloc_steal(state, cookie);
+}
+
+/* Sync Info Message, it carries a new cookie or the UUIDs of deleted
+ * entries */
+static errno_t sdap_sync_process_info(struct sdap_sync_state *state,
+                                      struct berval *data)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct berval *cookie;
+    char **uuids;
+    size_t i;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sdap_sync_parse_info(tmp_ctx, data, &cookie, &uuids);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    sdap_sync_set_cookie(state, cookie);
+
+    for (i = 0; uuids != NULL && uuids[i] != NULL; i++) {
+        ret = sdap_sync_add_change(state, NULL, uuids[i], true);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+static errno_t sdap_sync_parse_intermediate(struct sdap_sync_state *state,
+                                            struct sdap_handle *sh,
+                                            LDAPMessage *msg)
+{
+    char *oid = NULL;
+    struct berval *data = NULL;
+    errno_t ret;
+    int lret;
+
+    lret = ldap_parse_intermediate(sh->ldap, msg, &oid, &data, NULL, 0);
+    if (lret != LDAP_SUCCESS) {
+        DEBUG(SSSDBG_OP_FAILURE, "ldap_parse_intermediate failed: %s\n",
+              sss_ldap_err2string(lret));
+        return EIO;
+    }
+
+    if (oid == NULL || strcmp(oid, LDAP_SYNC_INFO) != 0 || data == NULL) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Ignoring intermediate response [%s]\n",
+              oid ? oid : "no oid");
+        ret = EOK;
+        goto done;
+    }
+
+    ret = sdap_sync_process_info(state, data);
+
+done:
+    ldap_memfree(oid);
+    ber_bvfree(data);
+    return ret;
+}
+
+/* Entry returned by syncrepl with its Sync State control */
+static errno_t sdap_sync_process_state(struct sdap_sync_state *state,
+                                       const char *dn,
+                                       struct berval *value)
+{
+    struct berval *cookie;
+    char *uuid = NULL;
+    int sync_state;
+    errno_t ret;
+
+    ret = sdap_sync_parse_state_control(state, value, &sync_state,
+                                        &uuid, &cookie);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    sdap_sync_set_cookie(state, cookie);
+
+    switch (sync_state) {
+    case LDAP_SYNC_PRESENT:
+        ret = EOK;
+        break;
+    case LDAP_SYNC_ADD:
+    case LDAP_SYNC_MODIFY:
+        ret = sdap_sync_add_change(state, dn, uuid, false);
+        break;
+    case LDAP_SYNC_DELETE:
+        ret = sdap_sync_add_change(state, dn, uuid, true);
+        break;
+    default:
+        DEBUG(SSSDBG_MINOR_FAILURE, "Unknown sync state [%d] of [%s]\n",
+              sync_state, dn);
+        ret = EOK;
+        break;
+    }
+
+    talloc_free(uuid);
+    return ret;
+}
+
+static errno_t sdap_sync_parse_syncrepl_entry(struct sdap_sync_state *state,
+                                              struct sdap_handle *sh,
+                                              LDAPMessage *msg,
+                                              const char *dn)
+{
+    LDAPControl **ctrls = NULL;
+    LDAPControl *state_ctrl;
+    errno_t ret;
+    int lret;
+
+    lret = ldap_get_entry_controls(sh->ldap, msg, &ctrls);
+    if (lret != LDAP_SUCCESS) {
+        DEBUG(SSSDBG_OP_FAILURE, "ldap_get_entry_controls failed: %s\n",
+              sss_ldap_err2string(lret));
+        return EIO;
+    }
+
+    state_ctrl = ldap_control_find(LDAP_CONTROL_SYNC_STATE, ctrls, NULL);
+    if (state_ctrl == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE, "Entry [%s] has no Sync State control\n", dn);
+        ret = EINVAL;
+        goto done;
+    }
+
+    ret = sdap_sync_process_state(state, dn, &state_ctrl->ldctl_value);
+
+done:
+    ldap_controls_free(ctrls);
+    return ret;
+}
+
+/* Entry returned by DirSync, deleted entries have isDeleted set */
+static errno_t sdap_sync_process_dirsync_entry(struct sdap_sync_state *state,
+                                               const char *dn,
+                                               struct berval *guid_val,
+                                               struct berval *deleted_val)
+{
+    char guid[GUID_STR_BUF_SIZE];
+    const char *uuid = NULL;
+    bool deleted = false;
+    errno_t ret;
+
+    if (guid_val != NULL && guid_val->bv_len == GUID_BIN_LENGTH) {
+        ret = guid_blob_to_string_buf((const uint8_t *) guid_val->bv_val,
+                                      guid, GUID_STR_BUF_SIZE);
+        if (ret == EOK) {
+            uuid = guid;
+        }
+    }
+
+    if (deleted_val != NULL) {
+        deleted = (deleted_val->bv_len == 4
+                    && strncasecmp(deleted_val->bv_val, "TRUE", 4) == 0);
+    }
+
+    return sdap_sync_add_change(state, dn, uuid, deleted);
+}
+
+static errno_t sdap_sync_parse_dirsync_entry(struct sdap_sync_state *state,
+                                             struct sdap_handle *sh,
+                                             LDAPMessage *msg,
+                                             const char *dn)
+{
+    struct berval **guid_vals;
+    struct berval **deleted_vals;
+    errno_t ret;
+
+    guid_vals = ldap_get_values_len(sh->ldap, msg, "objectGUID");
+    deleted_vals = ldap_get_values_len(sh->ldap, msg, "isDeleted");
+
+    ret = sdap_sync_process_dirsync_entry(state, dn,
+                                guid_vals != NULL ? guid_vals[0] : NULL,
+                                deleted_vals != NULL ? deleted_vals[0] : NULL);
+
+    ldap_value_free_len(guid_vals);
+    ldap_value_free_len(deleted_vals);
+    return ret;
+}
+
+static errno_t sdap_sync_parse_msg(struct sdap_handle *sh,
+                                   LDAPMessage *msg,
+                                   void *pvt)
+{
+    struct tevent_req *req = talloc_get_type(pvt, struct tevent_req);
+    struct sdap_sync_state *state = tevent_req_data(req,
+                                                    struct sdap_sync_state);
+    char *dn;
+    errno_t ret;
+
+    if (ldap_msgtype(msg) == LDAP_RES_INTERMEDIATE) {
+        return sdap_sync_parse_intermediate(state, sh, msg);
+    }
+
+    dn = ldap_get_dn(sh->ldap, msg);
+    if (dn == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot get the DN of a change\n");
+        return EIO;
+    }
+
+    if (state->mode == SDAP_SYNC_SYNCREPL) {
+        ret = sdap_sync_parse_syncrepl_entry(state, sh, msg, dn);
+    } else {
+        ret = sdap_sync_parse_dirsync_entry(state, sh, msg, dn);
+    }
+
+    ldap_memfree(dn);
+    return ret;
+}
+
+/* Result of a search with the Sync Done or the DirSync response control,
+ * _more is set if DirSync has more changes to return */
+static errno_t sdap_sync_process_result(struct sdap_sync_state *state,
+                                        int result,
+                                        struct berval *resp_value,
+                                        bool *_more)
+{
+    struct berval *cookie = NULL;
+    bool more = false;
+    errno_t ret;
+
+    if (state->mode == SDAP_SYNC_SYNCREPL
+            && result == LDAP_SYNC_REFRESH_REQUIRED) {
+        /* The server cannot provide the changes since the cookie, start
+         * over. Changes made in between are picked up when the cached
+         * entries expire. */
+        DEBUG(SSSDBG_MINOR_FAILURE, "The server requires a full refresh "
+              "of [%s], change tracking restarts\n", state->dom->name);
+        state->refresh_required = true;
+        return sysdb_set_change_tracking_cookie(state->dom, NULL, 0);
+    } else if (result != LDAP_SUCCESS) {
+        DEBUG(SSSDBG_OP_FAILURE, "Change tracking search failed: %s(%d)\n",
+              sss_ldap_err2string(result), result);
+        return result == LDAP_UNAVAILABLE_CRITICAL_EXTENSION ? ENOTSUP : EIO;
+    }
+
+    if (resp_value != NULL) {
+        if (state->mode == SDAP_SYNC_SYNCREPL) {
+            ret = sdap_sync_parse_done_control(state, resp_value, &cookie);
+        } else {
+            ret = sdap_sync_parse_dirsync_response(state, resp_value,
+                                                   &more, &cookie);
+        }
+        if (ret != EOK) {
+            return ret;
+        }
+        sdap_sync_set_cookie(state, cookie);
+    }
+
+    *_more = more;
+    return EOK;
+}
+
+static void sdap_sync_search_done(struct tevent_req *subreq)
+{
+    struct tevent_req *req = tevent_req_callback_data(subreq,
+                                                      struct tevent_req);
+    struct sdap_sync_state *state = tevent_req_data(req,
+                                                    struct sdap_sync_state);
+    struct berval *resp_value = NULL;
+    bool more = false;
+    int dp_error;
+    int result;
+    errno_t ret;
+
+    ret = sdap_get_ctrl_search_recv(subreq, state, &result, &resp_value);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        sdap_id_op_done(state->op, ret, &dp_error);
+        if (dp_error == DP_ERR_OFFLINE) {
+            tevent_req_done(req);
+        } else {
+            tevent_req_error(req, ret);
+        }
+        return;
+    }
+
+    ret = sdap_sync_process_result(state, result, resp_value, &more);
+    if (ret != EOK || state->refresh_required) {
+        goto done;
+    }
+
+    if (more && state->rounds < SDAP_DIRSYNC_MAX_ROUNDS) {
+        ret = sdap_sync_next_search(req);
+        if (ret != EOK) {
+            goto done;
+        }
+        return;
+    }
+
+    ret = sdap_sync_finish(req);
+
+done:
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    tevent_req_done(req);
+}
+
+static errno_t sdap_sync_finish(struct tevent_req *req)
+{
+    struct sdap_sync_state *state = tevent_req_data(req,
+                                                    struct sdap_sync_state);
+    size_t num_expired = 0;
+    size_t num_deleted = 0;
+    bool in_transaction = false;
+    errno_t sret;
+    errno_t ret;
+
+    if (state->cookie == NULL || state->cookie->bv_len == 0) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "The server did not return a change tracking cookie\n");
+        return EIO;
+    }
+
+    ret = sysdb_transaction_start(state->dom->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to start transaction\n");
+        goto done;
+    }
+    in_transaction = true;
+
+    ret = sdap_sync_apply_changes(state->dom, state->changes,
+                                  state->num_changes,
+                                  &num_expired, &num_deleted);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sysdb_set_change_tracking_cookie(state->dom,
+                                       (const uint8_t *) state->cookie->bv_val,
+                                       state->cookie->bv_len);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot store change tracking cookie "
+              "[%d]: %s\n", ret, sss_strerror(ret));
+        goto done;
+    }
+
+    ret = sysdb_transaction_commit(state->dom->sysdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to commit transaction\n");
+        goto done;
+    }
+    in_transaction = false;
+
+    DEBUG(SSSDBG_TRACE_FUNC, "%s: %zu changes reported, %zu cached entries "
+          "expired, %zu removed\n", state->dom->name, state->num_changes,
+          num_expired, num_deleted);
+
+done:
+    if (in_transaction) {
+        sret = sysdb_transaction_cancel(state->dom->sysdb);
+        if (sret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Failed to cancel transaction\n");
+        }
+    }
+
+    return ret;
+}
+
+static errno_t sdap_sync_recv(struct tevent_req *req)
+{
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    return EOK;
+}
+
+errno_t sdap_sync_setup_task(struct be_ctx *be_ctx,
+                             struct sdap_id_ctx *id_ctx,
+                             struct sdap_domain *sdom)
+{
+    struct sdap_sync_ctx *sctx;
+    enum sdap_sync_mode mode;
+    time_t period;
+    char *name = NULL;
+    errno_t ret;
+
+    ret = sdap_sync_mode_from_string(dp_opt_get_string(id_ctx->opts->basic,
+                                                       SDAP_CHANGE_TRACKING),
+                                     &mode);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    if (mode == SDAP_SYNC_NONE) {
+        return EOK;
+    }
+
+    period = dp_opt_get_int(id_ctx->opts->basic,
+                            SDAP_CHANGE_TRACKING_INTERVAL);
+    if (period <= 0) {
+        DEBUG(SSSDBG_CONF_SETTINGS, "ldap_change_tracking_interval is not "
+              "positive, change tracking is disabled\n");
+        return EOK;
+    }
+
+    sctx = talloc_zero(sdom, struct sdap_sync_ctx);
+    if (sctx == NULL) {
+        return ENOMEM;
+    }
+    sctx->id_ctx = id_ctx;
+    sctx->sdom = sdom;
+    sctx->mode = mode;
+
+    name = talloc_asprintf(NULL, "Change tracking of %s", sdom->dom->name);
+    if (name == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = be_ptask_create(id_ctx, be_ctx,
+                          period,                   /* period */
+                          10,                       /* first_delay */
+                          5,                        /* enabled delay */
+                          0,                        /* random offset */
+                          0,                        /* timeout */
+                          10 * period,              /* max_backoff */
+                          sdap_sync_send, sdap_sync_recv,
+                          sctx, name,
+                          BE_PTASK_OFFLINE_SKIP | BE_PTASK_SCHEDULE_FROM_LAST,
+                          NULL);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "Unable to initialize change tracking periodic task\n");
+        goto done;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Change tracking of %s runs every %ld seconds\n",
+          sdom->dom->name, (long) period);
+    ret = EOK;
+
+done:
+    talloc_free(name);
+    if (ret != EOK) {
+        talloc_free(sctx);
+    }
+    return ret;
+}
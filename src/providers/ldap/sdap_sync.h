@@ -0,0 +1,133 @@
+/*
+    SSSD
+
+    LDAP server side change tracking (syncrepl and DirSync)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SDAP_SYNC_H_
+#define _SDAP_SYNC_H_
+
+#include "providers/ldap/ldap_common.h"
+
+/* RFC 4533, normally provided by OpenLDAP's ldap.h */
+#ifndef LDAP_CONTROL_SYNC
+#define LDAP_CONTROL_SYNC       "1.3.6.1.4.1.4203.1.9.1.1"
+#define LDAP_CONTROL_SYNC_STATE "1.3.6.1.4.1.4203.1.9.1.2"
+#define LDAP_CONTROL_SYNC_DONE  "1.3.6.1.4.1.4203.1.9.1.3"
+#define LDAP_SYNC_INFO          "1.3.6.1.4.1.4203.1.9.1.4"
+#endif
+
+#ifndef LDAP_SYNC_REFRESH_ONLY
+#define LDAP_SYNC_REFRESH_ONLY  0x01
+#endif
+
+#ifndef LDAP_SYNC_PRESENT
+#define LDAP_SYNC_PRESENT       0
+#define LDAP_SYNC_ADD           1
+#define LDAP_SYNC_MODIFY        2
+#define LDAP_SYNC_DELETE        3
+#endif
+
+#ifndef LDAP_SYNC_REFRESH_REQUIRED
+#define LDAP_SYNC_REFRESH_REQUIRED 0x1000
+#endif
+
+#ifndef LDAP_TAG_SYNC_NEW_COOKIE
+#define LDAP_TAG_SYNC_NEW_COOKIE        ((ber_tag_t) 0x80U)
+#define LDAP_TAG_SYNC_REFRESH_DELETE    ((ber_tag_t) 0xa1U)
+#define LDAP_TAG_SYNC_REFRESH_PRESENT   ((ber_tag_t) 0xa2U)
+#define LDAP_TAG_SYNC_ID_SET            ((ber_tag_t) 0xa3U)
+#define LDAP_TAG_SYNC_COOKIE            ((ber_tag_t) 0x04U)
+#define LDAP_TAG_REFRESHDELETES         ((ber_tag_t) 0x01U)
+#define LDAP_TAG_REFRESHDONE            ((ber_tag_t) 0x01U)
+#endif
+
+/* Active Directory DirSync control */
+#ifndef LDAP_CONTROL_X_DIRSYNC
+#define LDAP_CONTROL_X_DIRSYNC  "1.2.840.113556.1.4.841"
+#endif
+
+#ifndef LDAP_DIRSYNC_OBJECT_SECURITY
+#define LDAP_DIRSYNC_OBJECT_SECURITY 0x00000001
+#endif
+
+#ifndef LDAP_DIRSYNC_INCREMENTAL_VALUES
+#define LDAP_DIRSYNC_INCREMENTAL_VALUES 0x80000000
+#endif
+
+enum sdap_sync_mode {
+    SDAP_SYNC_NONE,
+    SDAP_SYNC_AUTO,
+    SDAP_SYNC_SYNCREPL,
+    SDAP_SYNC_DIRSYNC
+};
+
+/* An entry reported by the server, either the DN or the UUID may be
+ * missing. */
+struct sdap_sync_change {
+    const char *dn;
+    const char *uuid;
+    bool deleted;
+};
+
+errno_t sdap_sync_mode_from_string(const char *str,
+                                   enum sdap_sync_mode *_mode);
+
+errno_t sdap_sync_setup_task(struct be_ctx *be_ctx,
+                             struct sdap_id_ctx *id_ctx,
+                             struct sdap_domain *sdom);
+
+/* BER helpers, cookies and control values are talloc allocated */
+errno_t sdap_sync_encode_syncrepl_request(TALLOC_CTX *mem_ctx,
+                                          struct berval *cookie,
+                                          struct berval **_value);
+
+errno_t sdap_sync_parse_state_control(TALLOC_CTX *mem_ctx,
+                                      struct berval *value,
+                                      int *_state,
+                                      char **_uuid,
+                                      struct berval **_cookie);
+
+/* Parses the Sync Info Message. _deleted_uuids is set only for a syncIdSet with
+ * refreshDeletes set, it is NULL terminated. */
+errno_t sdap_sync_parse_info(TALLOC_CTX *mem_ctx,
+                             struct berval *value,
+                             struct berval **_cookie,
+                             char ***_deleted_uuids);
+
+errno_t sdap_sync_parse_done_control(TALLOC_CTX *mem_ctx,
+                                     struct berval *value,
+                                     struct berval **_cookie);
+
+errno_t sdap_sync_encode_dirsync_request(TALLOC_CTX *mem_ctx,
+                                         int flags,
+                                         struct berval *cookie,
+                                         struct berval **_value);
+
+errno_t sdap_sync_parse_dirsync_response(TALLOC_CTX *mem_ctx,
+                                         struct berval *value,
+                                         bool *_more,
+                                         struct berval **_cookie);
+
+/* Expires cached entries which changed on the server and removes the ones
+ * which were deleted. Entries which are not cached are ignored. */
+errno_t sdap_sync_apply_changes(struct sss_domain_info *dom,
+                                struct sdap_sync_change *changes,
+                                size_t num_changes,
+                                size_t *_num_expired,
+                                size_t *_num_deleted);
+
+#endif /* _SDAP_SYNC_H_ */
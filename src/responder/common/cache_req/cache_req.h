@@ -177,6 +177,10 @@ void
 cache_req_data_set_bypass_dp(struct cache_req_data *data,
                              bool bypass_dp);
 
+void
+cache_req_data_set_no_members(struct cache_req_data *data,
+                              bool no_members);
+
 void
 cache_req_data_set_requested_domains(struct cache_req_data *data,
                                      char **requested_domains);
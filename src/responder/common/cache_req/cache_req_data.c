@@ -470,6 +470,18 @@ cache_req_data_set_bypass_dp(struct cache_req_data *data,
     data->bypass_dp = bypass_dp;
 }
 
+void
+cache_req_data_set_no_members(struct cache_req_data *data,
+                              bool no_members)
+{
+    if (data == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "cache_req_data should never be NULL\n");
+        return;
+    }
+
+    data->no_members = no_members;
+}
+
 void
 cache_req_data_set_requested_domains(struct cache_req_data *data,
                                      char **requested_domains)
@@ -106,6 +106,9 @@ struct cache_req_data {
     bool bypass_cache;
     bool bypass_dp;
 
+    /* if set, group members are not expanded */
+    bool no_members;
+
     /* if set, only search in the listed domains */
     char **requested_domains;
 
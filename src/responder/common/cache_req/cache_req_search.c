@@ -23,6 +23,7 @@
 #include <tevent.h>
 
 #include "util/util.h"
+#include "util/sss_ptr_hash.h"
 #include "responder/common/cache_req/cache_req_private.h"
 #include "responder/common/cache_req/cache_req_plugin.h"
 #include "db/sysdb.h"
@@ -281,6 +282,8 @@ cache_req_expiration_status(struct cache_req *cr,
     return CACHE_OBJECT_EXPIRED;
 }
 
+struct cache_req_search_inflight;
+
 struct cache_req_search_state {
     /* input data */
     struct tevent_context *ev;
@@ -290,6 +293,12 @@ struct cache_req_search_state {
     /* output data */
     struct ldb_result *result;
     bool dp_success;
+
+    /* set if the request waits for an identical in-flight search */
+    struct cache_req_search_inflight *inflight;
+    struct tevent_req *req;
+    struct cache_req_search_state *prev;
+    struct cache_req_search_state *next;
 };
 
 static errno_t cache_req_search_dp(struct tevent_req *req,
@@ -297,12 +306,12 @@ static errno_t cache_req_search_dp(struct tevent_req *req,
 static void cache_req_search_oob_done(struct tevent_req *subreq);
 static void cache_req_search_done(struct tevent_req *subreq);
 
-struct tevent_req *
-cache_req_search_send(TALLOC_CTX *mem_ctx,
-                      struct tevent_context *ev,
-                      struct cache_req *cr,
-                      bool first_iteration,
-                      bool cache_only_override)
+static struct tevent_req *
+cache_req_search_run_send(TALLOC_CTX *mem_ctx,
+                          struct tevent_context *ev,
+                          struct cache_req *cr,
+                          bool first_iteration,
+                          bool cache_only_override)
 {
     struct cache_req_search_state *state;
     enum cache_object_status status;
@@ -544,6 +553,323 @@ errno_t cache_req_search_recv(TALLOC_CTX *mem_ctx,
     return EOK;
 }
 
+/* Identical lookups that arrive while a search is already running (e.g.
+ * during a login storm) are attached to the running search instead of
+ * querying the cache and the data provider again. The search runs on its
+ * own copy of the cache_req so it does not depend on the lifetime of the
+ * request that started it. */
+struct cache_req_search_inflight {
+    hash_table_t *table;
+    const char *key;
+    struct cache_req_search_state *waiters;
+};
+
+static bool cache_req_search_can_coalesce(struct cache_req *cr)
+{
+    if (cr->data->attrs != NULL) {
+        return false;
+    }
+
+    switch (cr->data->type) {
+    case CACHE_REQ_USER_BY_NAME:
+    case CACHE_REQ_USER_BY_UPN:
+    case CACHE_REQ_USER_BY_ID:
+    case CACHE_REQ_GROUP_BY_NAME:
+    case CACHE_REQ_GROUP_BY_ID:
+    case CACHE_REQ_INITGROUPS:
+    case CACHE_REQ_INITGROUPS_BY_UPN:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static char *
+cache_req_search_coalesce_key(TALLOC_CTX *mem_ctx,
+                              struct cache_req *cr,
+                              bool first_iteration,
+                              bool cache_only_override)
+{
+    return talloc_asprintf(mem_ctx, "%d:%s:%s:%"PRIu32":%p:%d:%d:%d:%d:%d:%d",
+                           cr->data->type, cr->domain->name,
+                           cr->data->name.lookup == NULL
+                                ? "" : cr->data->name.lookup,
+                           cr->data->id, cr->ncache, cr->midpoint,
+                           cr->cache_behavior, first_iteration,
+                           cache_only_override, cr->data->no_members,
+                           cr->data->hybrid_lookup);
+}
+
+static errno_t cache_req_search_strdup(TALLOC_CTX *mem_ctx,
+                                       const char **_str)
+{
+    if (*_str == NULL) {
+        return EOK;
+    }
+
+    *_str = talloc_strdup(mem_ctx, *_str);
+    if (*_str == NULL) {
+        return ENOMEM;
+    }
+
+    return EOK;
+}
+
+static struct cache_req *
+cache_req_search_copy_cr(TALLOC_CTX *mem_ctx, struct cache_req *cr)
+{
+    struct cache_req_data *data;
+    struct cache_req *copy;
+    errno_t ret;
+
+    copy = talloc_memdup(mem_ctx, cr, sizeof(struct cache_req));
+    if (copy == NULL) {
+        return NULL;
+    }
+
+    /* Only the name and id are used by the plugins that can be coalesced,
+     * see cache_req_search_can_coalesce(). */
+    data = talloc_zero(copy, struct cache_req_data);
+    if (data == NULL) {
+        goto fail;
+    }
+
+    data->type = cr->data->type;
+    data->name = cr->data->name;
+    data->id = cr->data->id;
+    data->bypass_cache = cr->data->bypass_cache;
+    data->bypass_dp = cr->data->bypass_dp;
+    data->no_members = cr->data->no_members;
+    data->propogate_offline_status = cr->data->propogate_offline_status;
+    data->hybrid_lookup = cr->data->hybrid_lookup;
+    copy->data = data;
+
+    ret = cache_req_search_strdup(data, &data->name.input);
+    ret = ret == EOK ? cache_req_search_strdup(data, &data->name.name) : ret;
+    ret = ret == EOK ? cache_req_search_strdup(data, &data->name.lookup) : ret;
+    ret = ret == EOK ? cache_req_search_strdup(data, &data->name.attr) : ret;
+    ret = ret == EOK ? cache_req_search_strdup(copy, &copy->reqname) : ret;
+    ret = ret == EOK ? cache_req_search_strdup(copy, &copy->debugobj) : ret;
+    if (ret != EOK) {
+        goto fail;
+    }
+
+    return copy;
+
+fail:
+    talloc_free(copy);
+    return NULL;
+}
+
+static struct ldb_result *
+cache_req_search_copy_result(TALLOC_CTX *mem_ctx, struct ldb_result *result)
+{
+    struct ldb_result *copy;
+    unsigned int i;
+
+    copy = talloc_zero(mem_ctx, struct ldb_result);
+    if (copy == NULL) {
+        return NULL;
+    }
+
+    copy->count = result->count;
+    copy->msgs = talloc_zero_array(copy, struct ldb_message *, result->count);
+    if (copy->msgs == NULL) {
+        talloc_free(copy);
+        return NULL;
+    }
+
+    for (i = 0; i < result->count; i++) {
+        copy->msgs[i] = ldb_msg_copy(copy->msgs, result->msgs[i]);
+        if (copy->msgs[i] == NULL) {
+            talloc_free(copy);
+            return NULL;
+        }
+    }
+
+    return copy;
+}
+
+static int cache_req_search_waiter_destructor(struct cache_req_search_state *state)
+{
+    if (state->inflight != NULL) {
+        DLIST_REMOVE(state->inflight->waiters, state);
+        state->inflight = NULL;
+    }
+
+    return 0;
+}
+
+static void cache_req_search_inflight_done(struct tevent_req *subreq);
+
+static struct cache_req_search_inflight *
+cache_req_search_inflight_create(struct resp_ctx *rctx,
+                                 struct tevent_context *ev,
+                                 struct cache_req *cr,
+                                 const char *key,
+                                 bool first_iteration,
+                                 bool cache_only_override)
+{
+    struct cache_req_search_inflight *inflight;
+    struct tevent_req *subreq;
+    struct cache_req *copy;
+    errno_t ret;
+
+    if (rctx->cache_req_inflight == NULL) {
+        rctx->cache_req_inflight = sss_ptr_hash_create(rctx, NULL, NULL);
+        if (rctx->cache_req_inflight == NULL) {
+            return NULL;
+        }
+    }
+
+    inflight = talloc_zero(rctx, struct cache_req_search_inflight);
+    if (inflight == NULL) {
+        return NULL;
+    }
+
+    inflight->table = rctx->cache_req_inflight;
+    inflight->key = talloc_strdup(inflight, key);
+    if (inflight->key == NULL) {
+        goto fail;
+    }
+
+    copy = cache_req_search_copy_cr(inflight, cr);
+    if (copy == NULL) {
+        goto fail;
+    }
+
+    subreq = cache_req_search_run_send(inflight, ev, copy, first_iteration,
+                                       cache_only_override);
+    if (subreq == NULL) {
+        goto fail;
+    }
+
+    tevent_req_set_callback(subreq, cache_req_search_inflight_done, inflight);
+
+    ret = sss_ptr_hash_add(inflight->table, key, inflight,
+                           struct cache_req_search_inflight);
+    if (ret != EOK) {
+        goto fail;
+    }
+
+    return inflight;
+
+fail:
+    talloc_free(inflight);
+    return NULL;
+}
+
+static void cache_req_search_inflight_done(struct tevent_req *subreq)
+{
+    struct cache_req_search_inflight *inflight;
+    struct cache_req_search_state *state;
+    struct ldb_result *result = NULL;
+    bool dp_success;
+    errno_t ret;
+
+    inflight = tevent_req_callback_data(subreq,
+                                        struct cache_req_search_inflight);
+
+    ret = cache_req_search_recv(inflight, subreq, &result, &dp_success);
+    talloc_zfree(subreq);
+
+    /* Requests started from now on must perform a new search. */
+    sss_ptr_hash_delete(inflight->table, inflight->key, false);
+
+    while ((state = inflight->waiters) != NULL) {
+        DLIST_REMOVE(inflight->waiters, state);
+        state->inflight = NULL;
+        state->dp_success = dp_success;
+
+        if (ret != EOK) {
+            tevent_req_error(state->req, ret);
+            continue;
+        }
+
+        /* The last waiter takes the result, the others get a copy. */
+        if (inflight->waiters == NULL) {
+            state->result = talloc_steal(state, result);
+        } else {
+            state->result = cache_req_search_copy_result(state, result);
+            if (state->result == NULL) {
+                tevent_req_error(state->req, ENOMEM);
+                continue;
+            }
+        }
+
+        tevent_req_done(state->req);
+    }
+
+    talloc_free(inflight);
+}
+
+struct tevent_req *
+cache_req_search_send(TALLOC_CTX *mem_ctx,
+                      struct tevent_context *ev,
+                      struct cache_req *cr,
+                      bool first_iteration,
+                      bool cache_only_override)
+{
+    struct cache_req_search_inflight *inflight;
+    struct cache_req_search_state *state;
+    struct tevent_req *req;
+    char *key;
+
+    if (!cache_req_search_can_coalesce(cr)) {
+        return cache_req_search_run_send(mem_ctx, ev, cr, first_iteration,
+                                         cache_only_override);
+    }
+
+    req = tevent_req_create(mem_ctx, &state, struct cache_req_search_state);
+    if (req == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "tevent_req_create() failed\n");
+        return NULL;
+    }
+
+    state->ev = ev;
+    state->cr = cr;
+    state->req = req;
+
+    key = cache_req_search_coalesce_key(state, cr, first_iteration,
+                                        cache_only_override);
+    if (key == NULL) {
+        goto fail;
+    }
+
+    inflight = NULL;
+    if (cr->rctx->cache_req_inflight != NULL) {
+        inflight = sss_ptr_hash_lookup(cr->rctx->cache_req_inflight, key,
+                                       struct cache_req_search_inflight);
+    }
+
+    if (inflight != NULL) {
+        cr->rctx->cache_req_coalesced_num++;
+        CACHE_REQ_DEBUG(SSSDBG_TRACE_FUNC, cr,
+                        "Joining in-flight lookup of [%s] "
+                        "(%"PRIu64" coalesced lookups so far)\n",
+                        cr->debugobj, cr->rctx->cache_req_coalesced_num);
+    } else {
+        inflight = cache_req_search_inflight_create(cr->rctx, ev, cr, key,
+                                                    first_iteration,
+                                                    cache_only_override);
+        if (inflight == NULL) {
+            goto fail;
+        }
+    }
+
+    talloc_zfree(key);
+
+    state->inflight = inflight;
+    DLIST_ADD_END(inflight->waiters, state, struct cache_req_search_state *);
+    talloc_set_destructor(state, cache_req_search_waiter_destructor);
+
+    return req;
+
+fail:
+    talloc_free(req);
+    return NULL;
+}
+
 struct cache_req_locate_domain_state {
     struct cache_req *cr;
 
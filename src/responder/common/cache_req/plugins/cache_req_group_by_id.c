@@ -87,7 +87,8 @@ cache_req_group_by_id_lookup(TALLOC_CTX *mem_ctx,
     if (ret != EOK) {
         return ret;
     }
-    return sysdb_getgrgid_with_views(mem_ctx, domain, data->id, _result);
+    return sysdb_getgrgid_with_views_ex(mem_ctx, domain, data->id,
+                                        !data->no_members, _result);
 }
 
 static errno_t
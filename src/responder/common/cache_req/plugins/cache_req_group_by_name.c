@@ -101,8 +101,8 @@ cache_req_group_by_name_lookup(TALLOC_CTX *mem_ctx,
                                struct sss_domain_info *domain,
                                struct ldb_result **_result)
 {
-    return sysdb_getgrnam_with_views(mem_ctx, domain, data->name.lookup,
-                                     _result);
+    return sysdb_getgrnam_with_views_ex(mem_ctx, domain, data->name.lookup,
+                                        !data->no_members, _result);
 }
 
 static errno_t
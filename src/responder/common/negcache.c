@@ -19,30 +19,78 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include <fcntl.h>
 #include <time.h>
-#include "tdb.h"
 #include "util/util.h"
+#include "shared/murmurhash3.h"
 #include "util/nss_dl_load.h"
 #include "confdb/confdb.h"
 #include "responder/common/responder.h"
 #include "responder/common/negcache.h"
 
 
-#define NC_ENTRY_PREFIX "NCE/"
-#define NC_USER_PREFIX NC_ENTRY_PREFIX"USER"
-#define NC_GROUP_PREFIX NC_ENTRY_PREFIX"GROUP"
-#define NC_NETGROUP_PREFIX NC_ENTRY_PREFIX"NETGR"
-#define NC_SERVICE_PREFIX NC_ENTRY_PREFIX"SERVICE"
-#define NC_UID_PREFIX NC_ENTRY_PREFIX"UID"
-#define NC_GID_PREFIX NC_ENTRY_PREFIX"GID"
-#define NC_SID_PREFIX NC_ENTRY_PREFIX"SID"
-#define NC_CERT_PREFIX NC_ENTRY_PREFIX"CERT"
-#define NC_DOMAIN_ACCT_LOCATE_PREFIX NC_ENTRY_PREFIX"DOM_LOCATE"
-#define NC_DOMAIN_ACCT_LOCATE_TYPE_PREFIX NC_ENTRY_PREFIX"DOM_LOCATE_TYPE"
+/* Entry types, they are part of the key together with the domain name
+ * (if any) and the name or id of the entry. */
+enum sss_nc_type {
+    NC_TYPE_FREE = 0,           /* slot was never used */
+    NC_TYPE_DELETED,            /* slot is a tombstone */
+    NC_TYPE_USER,
+    NC_TYPE_GROUP,
+    NC_TYPE_NETGROUP,
+    NC_TYPE_SERVICE,
+    NC_TYPE_UID,
+    NC_TYPE_GID,
+    NC_TYPE_SID,
+    NC_TYPE_CERT,
+    NC_TYPE_LOCATE_UID,
+    NC_TYPE_LOCATE_GID,
+    NC_TYPE_LOCATE_SID,
+    NC_TYPE_LOCATE_TYPE,
+};
+
+static const char *sss_nc_type_str[] = {
+    [NC_TYPE_USER] = "USER",
+    [NC_TYPE_GROUP] = "GROUP",
+    [NC_TYPE_NETGROUP] = "NETGR",
+    [NC_TYPE_SERVICE] = "SERVICE",
+    [NC_TYPE_UID] = "UID",
+    [NC_TYPE_GID] = "GID",
+    [NC_TYPE_SID] = "SID",
+    [NC_TYPE_CERT] = "CERT",
+    [NC_TYPE_LOCATE_UID] = "DOM_LOCATE/UID",
+    [NC_TYPE_LOCATE_GID] = "DOM_LOCATE/GID",
+    [NC_TYPE_LOCATE_SID] = "DOM_LOCATE/SID",
+    [NC_TYPE_LOCATE_TYPE] = "DOM_LOCATE_TYPE",
+};
+
+/* The cache is split into NC_SHARDS open addressing tables (linear
+ * probing) selected by the top bits of the key hash. Every shard grows on
+ * its own so a rehash never stalls the responder for the whole cache. */
+#define NC_SHARD_BITS 4
+#define NC_SHARDS (1 << NC_SHARD_BITS)
+#define NC_SHARD_MIN_SIZE 64    /* must be a power of 2 */
+#define NC_SHARD(hash) ((hash) >> (32 - NC_SHARD_BITS))
+
+/* big enough for any uid or gid printed as a string */
+#define NC_ID_STR_SIZE 24
+
+struct sss_nc_entry {
+    char *name;             /* NULL if the slot is free or deleted */
+    char *domain;           /* same allocation as name, NULL if the
+                             * entry is not bound to a domain */
+    time_t expire;          /* 0 for permanent entries */
+    uint32_t hash;
+    uint8_t type;           /* enum sss_nc_type */
+};
+
+struct sss_nc_shard {
+    struct sss_nc_entry *entries;
+    uint32_t size;          /* number of slots, a power of 2 */
+    uint32_t live;          /* slots holding an entry */
+    uint32_t used;          /* live slots plus tombstones */
+};
 
 struct sss_nc_ctx {
-    struct tdb_context *tdb;
+    struct sss_nc_shard shards[NC_SHARDS];
     uint32_t timeout;
 };
 
@@ -53,207 +101,293 @@ static int sss_ncache_set_ent(struct sss_nc_ctx *ctx, bool permanent,
                               struct sss_domain_info *dom, const char *name,
                               ncache_set_byname_fn_t setter);
 
-static int string_to_tdb_data(char *str, TDB_DATA *ret)
+static uint32_t sss_nc_hash(enum sss_nc_type type, const char *domain,
+                            const char *name)
 {
-    if (!str || !ret) return EINVAL;
+    uint32_t hash;
 
-    ret->dptr = (uint8_t *)str;
-    ret->dsize = strlen(str)+1;
+    hash = murmurhash3(name, strlen(name), type);
+    if (domain != NULL) {
+        hash = murmurhash3(domain, strlen(domain), hash);
+    }
 
-    return EOK;
+    return hash;
 }
 
-int sss_ncache_init(TALLOC_CTX *memctx, uint32_t timeout,
-                    struct sss_nc_ctx **_ctx)
+static bool sss_nc_entry_matches(struct sss_nc_entry *e, uint32_t hash,
+                                 enum sss_nc_type type, const char *domain,
+                                 const char *name)
 {
-    struct sss_nc_ctx *ctx;
-
-    ctx = talloc_zero(memctx, struct sss_nc_ctx);
-    if (!ctx) return ENOMEM;
+    if (e->hash != hash || e->type != type) {
+        return false;
+    }
 
-    errno = 0;
-    /* open a memory only tdb with default hash size */
-    ctx->tdb = tdb_open("memcache", 0, TDB_INTERNAL, O_RDWR|O_CREAT, 0);
-    if (!ctx->tdb) return errno;
+    if ((e->domain == NULL) != (domain == NULL)) {
+        return false;
+    }
 
-    ctx->timeout = timeout;
+    if (domain != NULL && strcmp(e->domain, domain) != 0) {
+        return false;
+    }
 
-    *_ctx = ctx;
-    return EOK;
-};
+    return strcmp(e->name, name) == 0;
+}
 
-uint32_t sss_ncache_get_timeout(struct sss_nc_ctx *ctx)
+static void sss_nc_entry_delete(struct sss_nc_shard *shard,
+                                struct sss_nc_entry *e)
 {
-    return ctx->timeout;
+    talloc_free(e->name);
+    e->name = NULL;
+    e->domain = NULL;
+    e->type = NC_TYPE_DELETED;
+    shard->live--;
 }
 
-static int sss_ncache_check_str(struct sss_nc_ctx *ctx, char *str)
+static struct sss_nc_entry *sss_nc_lookup(struct sss_nc_shard *shard,
+                                          uint32_t hash,
+                                          enum sss_nc_type type,
+                                          const char *domain,
+                                          const char *name)
 {
-    TDB_DATA key;
-    TDB_DATA data;
-    unsigned long long int timestamp;
-    bool expired = false;
-    char *ep;
-    int ret;
-
-    DEBUG_CONDITIONAL(SSSDBG_TRACE_INTERNAL, "Checking negative cache for [%s]\n", str);
-
-    data.dptr = NULL;
+    struct sss_nc_entry *e;
+    uint32_t mask = shard->size - 1;
+    uint32_t i;
+    uint32_t n;
+
+    for (i = hash & mask, n = 0; n < shard->size; i = (i + 1) & mask, n++) {
+        e = &shard->entries[i];
+        if (e->type == NC_TYPE_FREE) {
+            /* end of the probe sequence */
+            return NULL;
+        }
 
-    ret = string_to_tdb_data(str, &key);
-    if (ret != EOK) goto done;
+        if (e->name != NULL
+                && sss_nc_entry_matches(e, hash, type, domain, name)) {
+            return e;
+        }
+    }
 
-    data = tdb_fetch(ctx->tdb, key);
+    return NULL;
+}
 
-    if (!data.dptr) {
-        ret = ENOENT;
-        goto done;
+/* Rebuilds the shard with room for twice the live entries, tombstones and
+ * expired entries are dropped on the way. */
+static errno_t sss_nc_shard_resize(TALLOC_CTX *mem_ctx,
+                                   struct sss_nc_shard *shard)
+{
+    struct sss_nc_entry *entries;
+    struct sss_nc_entry *e;
+    uint32_t size;
+    uint32_t live = 0;
+    uint32_t mask;
+    uint32_t i;
+    uint32_t j;
+    time_t now;
+
+    size = NC_SHARD_MIN_SIZE;
+    while (size < (shard->live + 1) * 2) {
+        size *= 2;
     }
 
-    errno = 0;
-    timestamp = strtoull((const char *)data.dptr, &ep, 10);
-    if (errno != 0 || *ep != '\0') {
-        /* Malformed entry, remove it and return no entry */
-        expired = true;
-        goto done;
+    entries = talloc_zero_array(mem_ctx, struct sss_nc_entry, size);
+    if (entries == NULL) {
+        return ENOMEM;
     }
 
-    if (timestamp == 0) {
-        /* a 0 timestamp means this is a permanent entry */
-        ret = EEXIST;
-        goto done;
-    }
+    now = time(NULL);
+    mask = size - 1;
+    for (i = 0; i < shard->size; i++) {
+        e = &shard->entries[i];
+        if (e->name == NULL) {
+            continue;
+        }
 
-    if (timestamp >= time(NULL)) {
-        /* still valid */
-        ret = EEXIST;
-        goto done;
+        if (e->expire != 0 && e->expire < now) {
+            talloc_free(e->name);
+            continue;
+        }
+
+        for (j = e->hash & mask; entries[j].type != NC_TYPE_FREE;
+             j = (j + 1) & mask);
+        entries[j] = *e;
+        live++;
     }
 
-    expired = true;
+    talloc_free(shard->entries);
+    shard->entries = entries;
+    shard->size = size;
+    shard->live = live;
+    shard->used = live;
 
-done:
-    if (expired) {
-        /* expired, remove and return no entry */
-        tdb_delete(ctx->tdb, key);
-        ret = ENOENT;
+    return EOK;
+}
+
+static int sss_nc_check(struct sss_nc_ctx *ctx, enum sss_nc_type type,
+                        const char *domain, const char *name)
+{
+    struct sss_nc_shard *shard;
+    struct sss_nc_entry *e;
+    uint32_t hash;
+
+    DEBUG_CONDITIONAL(SSSDBG_TRACE_INTERNAL,
+                      "Checking negative cache for [%s/%s/%s]\n",
+                      sss_nc_type_str[type], domain ? domain : "*", name);
+
+    hash = sss_nc_hash(type, domain, name);
+    shard = &ctx->shards[NC_SHARD(hash)];
+
+    e = sss_nc_lookup(shard, hash, type, domain, name);
+    if (e == NULL) {
+        return ENOENT;
     }
 
-    free(data.dptr);
-    return ret;
+    /* a 0 timestamp means this is a permanent entry */
+    if (e->expire == 0 || e->expire >= time(NULL)) {
+        return EEXIST;
+    }
+
+    /* expired, remove and return no entry */
+    sss_nc_entry_delete(shard, e);
+    return ENOENT;
 }
 
-static int sss_ncache_set_str(struct sss_nc_ctx *ctx, char *str, bool permanent)
+static int sss_nc_set(struct sss_nc_ctx *ctx, enum sss_nc_type type,
+                      const char *domain, const char *name, bool permanent)
 {
-    TDB_DATA key;
-    TDB_DATA data;
-    char *timest;
-    unsigned long long int timell;
-    int ret;
-
-    ret = string_to_tdb_data(str, &key);
-    if (ret != EOK) return ret;
+    struct sss_nc_shard *shard;
+    struct sss_nc_entry *e;
+    size_t name_len;
+    size_t dom_len;
+    time_t expire;
+    uint32_t hash;
+    uint32_t mask;
+    uint32_t i;
+    errno_t ret;
 
     if (permanent) {
-        timest = talloc_strdup(ctx, "0");
+        expire = 0;
     } else {
         /* EOK is tested in cwrap based unit test */
         if (ctx->timeout == 0) {
             return EOK;
         }
-        timell = ctx->timeout + (unsigned long long int)time(NULL);
-        timest = talloc_asprintf(ctx, "%llu", timell);
+        expire = time(NULL) + ctx->timeout;
     }
-    if (!timest) return ENOMEM;
 
-    ret = string_to_tdb_data(timest, &data);
-    if (ret != EOK) goto done;
+    DEBUG(SSSDBG_TRACE_FUNC, "Adding [%s/%s/%s] to negative cache%s\n",
+          sss_nc_type_str[type], domain ? domain : "*", name,
+          permanent ? " permanently" : "");
 
-    DEBUG(SSSDBG_TRACE_FUNC, "Adding [%s] to negative cache%s\n",
-              str, permanent?" permanently":"");
+    hash = sss_nc_hash(type, domain, name);
+    shard = &ctx->shards[NC_SHARD(hash)];
 
-    ret = tdb_store(ctx->tdb, key, data, TDB_REPLACE);
-    if (ret != 0) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Negative cache failed to set entry: [%s]\n",
-                  tdb_errorstr(ctx->tdb));
-        ret = EFAULT;
+    e = sss_nc_lookup(shard, hash, type, domain, name);
+    if (e != NULL) {
+        e->expire = expire;
+        return EOK;
     }
 
-done:
-    talloc_free(timest);
-    return ret;
+    /* keep the load factor, tombstones included, under 3/4 */
+    if ((shard->used + 1) * 4 > shard->size * 3) {
+        ret = sss_nc_shard_resize(ctx, shard);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "Negative cache failed to grow: [%d]: %s\n",
+                  ret, sss_strerror(ret));
+            return ret;
+        }
+    }
+
+    mask = shard->size - 1;
+    for (i = hash & mask; shard->entries[i].name != NULL; i = (i + 1) & mask);
+    e = &shard->entries[i];
+
+    name_len = strlen(name) + 1;
+    dom_len = domain ? strlen(domain) + 1 : 0;
+    e->name = talloc_size(ctx, name_len + dom_len);
+    if (e->name == NULL) {
+        return ENOMEM;
+    }
+    memcpy(e->name, name, name_len);
+    if (domain != NULL) {
+        e->domain = e->name + name_len;
+        memcpy(e->domain, domain, dom_len);
+    } else {
+        e->domain = NULL;
+    }
+
+    if (e->type == NC_TYPE_FREE) {
+        shard->used++;
+    }
+    e->type = type;
+    e->hash = hash;
+    e->expire = expire;
+    shard->live++;
+
+    return EOK;
 }
 
-static int sss_ncache_check_user_int(struct sss_nc_ctx *ctx, const char *domain,
-                                     const char *name)
+int sss_ncache_init(TALLOC_CTX *memctx, uint32_t timeout,
+                    struct sss_nc_ctx **_ctx)
 {
-    char *str;
-    int ret;
+    struct sss_nc_ctx *ctx;
+    int i;
 
-    if (!name || !*name) return EINVAL;
+    ctx = talloc_zero(memctx, struct sss_nc_ctx);
+    if (!ctx) return ENOMEM;
 
-    str = talloc_asprintf(ctx, "%s/%s/%s", NC_USER_PREFIX, domain, name);
-    if (!str) return ENOMEM;
+    for (i = 0; i < NC_SHARDS; i++) {
+        ctx->shards[i].entries = talloc_zero_array(ctx, struct sss_nc_entry,
+                                                   NC_SHARD_MIN_SIZE);
+        if (ctx->shards[i].entries == NULL) {
+            talloc_free(ctx);
+            return ENOMEM;
+        }
+        ctx->shards[i].size = NC_SHARD_MIN_SIZE;
+    }
 
-    ret = sss_ncache_check_str(ctx, str);
+    ctx->timeout = timeout;
 
-    talloc_free(str);
-    return ret;
-}
+    *_ctx = ctx;
+    return EOK;
+};
 
-static int sss_ncache_check_group_int(struct sss_nc_ctx *ctx,
-                                      const char *domain, const char *name)
+uint32_t sss_ncache_get_timeout(struct sss_nc_ctx *ctx)
 {
-    char *str;
-    int ret;
+    return ctx->timeout;
+}
 
+static int sss_ncache_check_user_int(struct sss_nc_ctx *ctx, const char *domain,
+                                     const char *name)
+{
     if (!name || !*name) return EINVAL;
 
-    str = talloc_asprintf(ctx, "%s/%s/%s", NC_GROUP_PREFIX, domain, name);
-    if (!str) return ENOMEM;
+    return sss_nc_check(ctx, NC_TYPE_USER, domain, name);
+}
 
-    ret = sss_ncache_check_str(ctx, str);
+static int sss_ncache_check_group_int(struct sss_nc_ctx *ctx,
+                                      const char *domain, const char *name)
+{
+    if (!name || !*name) return EINVAL;
 
-    talloc_free(str);
-    return ret;
+    return sss_nc_check(ctx, NC_TYPE_GROUP, domain, name);
 }
 
 static int sss_ncache_check_netgr_int(struct sss_nc_ctx *ctx,
                                       const char *domain, const char *name)
 {
-    char *str;
-    int ret;
-
     if (!name || !*name) return EINVAL;
 
-    str = talloc_asprintf(ctx, "%s/%s/%s", NC_NETGROUP_PREFIX, domain, name);
-    if (!str) return ENOMEM;
-
-    ret = sss_ncache_check_str(ctx, str);
-
-    talloc_free(str);
-    return ret;
+    return sss_nc_check(ctx, NC_TYPE_NETGROUP, domain, name);
 }
 
 static int sss_ncache_check_service_int(struct sss_nc_ctx *ctx,
                                         const char *domain,
                                         const char *name)
 {
-    char *str;
-    int ret;
-
     if (!name || !*name) return EINVAL;
 
-    str = talloc_asprintf(ctx, "%s/%s/%s",
-                          NC_SERVICE_PREFIX,
-                          domain,
-                          name);
-    if (!str) return ENOMEM;
-
-    ret = sss_ncache_check_str(ctx, str);
-
-    talloc_free(str);
-    return ret;
+    return sss_nc_check(ctx, NC_TYPE_SERVICE, domain, name);
 }
 
 typedef int (*ncache_check_byname_fn_t)(struct sss_nc_ctx *, const char *,
@@ -317,18 +451,9 @@ int sss_ncache_check_netgr(struct sss_nc_ctx *ctx, struct sss_domain_info *dom,
 static int sss_ncache_set_service_int(struct sss_nc_ctx *ctx, bool permanent,
                                       const char *domain, const char *name)
 {
-    char *str;
-    int ret;
-
     if (!name || !*name) return EINVAL;
 
-    str = talloc_asprintf(ctx, "%s/%s/%s", NC_SERVICE_PREFIX, domain, name);
-    if (!str) return ENOMEM;
-
-    ret = sss_ncache_set_str(ctx, str, permanent);
-
-    talloc_free(str);
-    return ret;
+    return sss_nc_set(ctx, NC_TYPE_SERVICE, domain, name, permanent);
 }
 
 int sss_ncache_set_service_name(struct sss_nc_ctx *ctx, bool permanent,
@@ -402,126 +527,57 @@ int sss_ncache_check_service_port(struct sss_nc_ctx *ctx,
 int sss_ncache_check_uid(struct sss_nc_ctx *ctx, struct sss_domain_info *dom,
                          uid_t uid)
 {
-    char *str;
-    int ret;
-
-    if (dom != NULL) {
-        str = talloc_asprintf(ctx, "%s/%s/%"SPRIuid, NC_UID_PREFIX, dom->name,
-                              uid);
-    } else {
-        str = talloc_asprintf(ctx, "%s/%"SPRIuid, NC_UID_PREFIX, uid);
-    }
-    if (!str) return ENOMEM;
+    char str[NC_ID_STR_SIZE];
 
-    ret = sss_ncache_check_str(ctx, str);
+    snprintf(str, sizeof(str), "%"SPRIuid, uid);
 
-    talloc_free(str);
-    return ret;
+    return sss_nc_check(ctx, NC_TYPE_UID, dom ? dom->name : NULL, str);
 }
 
 int sss_ncache_check_gid(struct sss_nc_ctx *ctx, struct sss_domain_info *dom,
                          gid_t gid)
 {
-    char *str;
-    int ret;
+    char str[NC_ID_STR_SIZE];
 
-    if (dom != NULL) {
-        str = talloc_asprintf(ctx, "%s/%s/%"SPRIgid, NC_GID_PREFIX, dom->name,
-                              gid);
-    } else {
-        str = talloc_asprintf(ctx, "%s/%"SPRIgid, NC_GID_PREFIX, gid);
-    }
-    if (!str) return ENOMEM;
+    snprintf(str, sizeof(str), "%"SPRIgid, gid);
 
-    ret = sss_ncache_check_str(ctx, str);
-
-    talloc_free(str);
-    return ret;
+    return sss_nc_check(ctx, NC_TYPE_GID, dom ? dom->name : NULL, str);
 }
 
 int sss_ncache_check_sid(struct sss_nc_ctx *ctx, struct sss_domain_info *dom,
                          const char *sid)
 {
-    char *str;
-    int ret;
-
-    if (dom != NULL) {
-        str = talloc_asprintf(ctx, "%s/%s/%s", NC_SID_PREFIX, dom->name, sid);
-    } else {
-        str = talloc_asprintf(ctx, "%s/%s", NC_SID_PREFIX, sid);
-    }
-    if (!str) return ENOMEM;
-
-    ret = sss_ncache_check_str(ctx, str);
-
-    talloc_free(str);
-    return ret;
+    return sss_nc_check(ctx, NC_TYPE_SID, dom ? dom->name : NULL, sid);
 }
 
 int sss_ncache_check_cert(struct sss_nc_ctx *ctx, const char *cert)
 {
-    char *str;
-    int ret;
-
-    str = talloc_asprintf(ctx, "%s/%s", NC_CERT_PREFIX, cert);
-    if (!str) return ENOMEM;
-
-    ret = sss_ncache_check_str(ctx, str);
-
-    talloc_free(str);
-    return ret;
+    return sss_nc_check(ctx, NC_TYPE_CERT, NULL, cert);
 }
 
 
 static int sss_ncache_set_user_int(struct sss_nc_ctx *ctx, bool permanent,
                                    const char *domain, const char *name)
 {
-    char *str;
-    int ret;
-
     if (!name || !*name) return EINVAL;
 
-    str = talloc_asprintf(ctx, "%s/%s/%s", NC_USER_PREFIX, domain, name);
-    if (!str) return ENOMEM;
-
-    ret = sss_ncache_set_str(ctx, str, permanent);
-
-    talloc_free(str);
-    return ret;
+    return sss_nc_set(ctx, NC_TYPE_USER, domain, name, permanent);
 }
 
 static int sss_ncache_set_group_int(struct sss_nc_ctx *ctx, bool permanent,
                                     const char *domain, const char *name)
 {
-    char *str;
-    int ret;
-
     if (!name || !*name) return EINVAL;
 
-    str = talloc_asprintf(ctx, "%s/%s/%s", NC_GROUP_PREFIX, domain, name);
-    if (!str) return ENOMEM;
-
-    ret = sss_ncache_set_str(ctx, str, permanent);
-
-    talloc_free(str);
-    return ret;
+    return sss_nc_set(ctx, NC_TYPE_GROUP, domain, name, permanent);
 }
 
 static int sss_ncache_set_netgr_int(struct sss_nc_ctx *ctx, bool permanent,
                                     const char *domain, const char *name)
 {
-    char *str;
-    int ret;
-
     if (!name || !*name) return EINVAL;
 
-    str = talloc_asprintf(ctx, "%s/%s/%s", NC_NETGROUP_PREFIX, domain, name);
-    if (!str) return ENOMEM;
-
-    ret = sss_ncache_set_str(ctx, str, permanent);
-
-    talloc_free(str);
-    return ret;
+    return sss_nc_set(ctx, NC_TYPE_NETGROUP, domain, name, permanent);
 }
 
 static int sss_ncache_set_ent(struct sss_nc_ctx *ctx, bool permanent,
@@ -583,392 +639,214 @@ int sss_ncache_set_netgr(struct sss_nc_ctx *ctx, bool permanent,
 int sss_ncache_set_uid(struct sss_nc_ctx *ctx, bool permanent,
                        struct sss_domain_info *dom, uid_t uid)
 {
-    char *str;
-    int ret;
-
-    if (dom != NULL) {
-        str = talloc_asprintf(ctx, "%s/%s/%"SPRIuid, NC_UID_PREFIX, dom->name,
-                              uid);
-    } else {
-        str = talloc_asprintf(ctx, "%s/%"SPRIuid, NC_UID_PREFIX, uid);
-    }
-    if (!str) return ENOMEM;
+    char str[NC_ID_STR_SIZE];
 
-    ret = sss_ncache_set_str(ctx, str, permanent);
+    snprintf(str, sizeof(str), "%"SPRIuid, uid);
 
-    talloc_free(str);
-    return ret;
+    return sss_nc_set(ctx, NC_TYPE_UID, dom ? dom->name : NULL, str,
+                      permanent);
 }
 
 int sss_ncache_set_gid(struct sss_nc_ctx *ctx, bool permanent,
                        struct sss_domain_info *dom, gid_t gid)
 {
-    char *str;
-    int ret;
-
-    if (dom != NULL) {
-        str = talloc_asprintf(ctx, "%s/%s/%"SPRIgid, NC_GID_PREFIX, dom->name,
-                              gid);
-    } else {
-        str = talloc_asprintf(ctx, "%s/%"SPRIgid, NC_GID_PREFIX, gid);
-    }
-    if (!str) return ENOMEM;
+    char str[NC_ID_STR_SIZE];
 
-    ret = sss_ncache_set_str(ctx, str, permanent);
+    snprintf(str, sizeof(str), "%"SPRIgid, gid);
 
-    talloc_free(str);
-    return ret;
+    return sss_nc_set(ctx, NC_TYPE_GID, dom ? dom->name : NULL, str,
+                      permanent);
 }
 
 int sss_ncache_set_sid(struct sss_nc_ctx *ctx, bool permanent,
                        struct sss_domain_info *dom, const char *sid)
 {
-    char *str;
-    int ret;
-
-    if (dom != NULL) {
-        str = talloc_asprintf(ctx, "%s/%s/%s", NC_SID_PREFIX, dom->name, sid);
-    } else {
-        str = talloc_asprintf(ctx, "%s/%s", NC_SID_PREFIX, sid);
-    }
-    if (!str) return ENOMEM;
-
-    ret = sss_ncache_set_str(ctx, str, permanent);
-
-    talloc_free(str);
-    return ret;
+    return sss_nc_set(ctx, NC_TYPE_SID, dom ? dom->name : NULL, sid,
+                      permanent);
 }
 
 int sss_ncache_set_cert(struct sss_nc_ctx *ctx, bool permanent,
                         const char *cert)
 {
-    char *str;
-    int ret;
-
-    str = talloc_asprintf(ctx, "%s/%s", NC_CERT_PREFIX, cert);
-    if (!str) return ENOMEM;
-
-    ret = sss_ncache_set_str(ctx, str, permanent);
-
-    talloc_free(str);
-    return ret;
-}
-
-static char *domain_lookup_type_str(TALLOC_CTX *mem_ctx,
-                                    struct sss_domain_info *dom,
-                                    const char *lookup_type)
-{
-    return talloc_asprintf(mem_ctx,
-                           "%s/%s/%s",
-                           NC_DOMAIN_ACCT_LOCATE_TYPE_PREFIX,
-                           dom->name,
-                           lookup_type);
+    return sss_nc_set(ctx, NC_TYPE_CERT, NULL, cert, permanent);
 }
 
 int sss_ncache_set_domain_locate_type(struct sss_nc_ctx *ctx,
                                       struct sss_domain_info *dom,
                                       const char *lookup_type)
 {
-    char *str;
-    int ret;
-
-    str = domain_lookup_type_str(ctx, dom, lookup_type);
-    if (!str) return ENOMEM;
-
     /* Permanent cache is always used here, because the lookup
      * type's (getgrgid, getpwuid, ..) support locating an entry's domain
      * doesn't change
      */
-    ret = sss_ncache_set_str(ctx, str, true);
-    talloc_free(str);
-    return ret;
+    return sss_nc_set(ctx, NC_TYPE_LOCATE_TYPE, dom->name, lookup_type, true);
 }
 
 int sss_ncache_check_domain_locate_type(struct sss_nc_ctx *ctx,
                                         struct sss_domain_info *dom,
                                         const char *lookup_type)
 {
-    char *str;
-    int ret;
-
-    str = domain_lookup_type_str(ctx, dom, lookup_type);
-    if (!str) return ENOMEM;
-
-    ret = sss_ncache_check_str(ctx, str);
-    talloc_free(str);
-    return ret;
-}
-
-static char *locate_gid_str(TALLOC_CTX *mem_ctx,
-                            struct sss_domain_info *dom,
-                            gid_t gid)
-{
-    return talloc_asprintf(mem_ctx,
-                           "%s/%s/%s/%"SPRIgid,
-                           NC_DOMAIN_ACCT_LOCATE_PREFIX,
-                           NC_GID_PREFIX,
-                           dom->name,
-                           gid);
+    return sss_nc_check(ctx, NC_TYPE_LOCATE_TYPE, dom->name, lookup_type);
 }
 
 int sss_ncache_set_locate_gid(struct sss_nc_ctx *ctx,
                               struct sss_domain_info *dom,
                               gid_t gid)
 {
-    char *str;
-    int ret;
+    char str[NC_ID_STR_SIZE];
 
     if (dom == NULL) {
         return EINVAL;
     }
 
-    str = locate_gid_str(ctx, dom, gid);
-    if (str == NULL) {
-        return ENOMEM;
-    }
+    snprintf(str, sizeof(str), "%"SPRIgid, gid);
 
-    ret = sss_ncache_set_str(ctx, str, false);
-    talloc_free(str);
-    return ret;
+    return sss_nc_set(ctx, NC_TYPE_LOCATE_GID, dom->name, str, false);
 }
 
 int sss_ncache_check_locate_gid(struct sss_nc_ctx *ctx,
                                 struct sss_domain_info *dom,
                                 gid_t gid)
 {
-    char *str;
-    int ret;
+    char str[NC_ID_STR_SIZE];
 
     if (dom == NULL) {
         return EINVAL;
     }
 
-    str = locate_gid_str(ctx, dom, gid);
-    if (str == NULL) {
-        return ENOMEM;
-    }
+    snprintf(str, sizeof(str), "%"SPRIgid, gid);
 
-    ret = sss_ncache_check_str(ctx, str);
-    talloc_free(str);
-    return ret;
-}
-
-static char *locate_uid_str(struct sss_nc_ctx *ctx,
-                            struct sss_domain_info *dom,
-                            uid_t uid)
-{
-    return talloc_asprintf(ctx,
-                           "%s/%s/%s/%"SPRIuid,
-                           NC_DOMAIN_ACCT_LOCATE_PREFIX,
-                           NC_UID_PREFIX,
-                           dom->name,
-                           uid);
+    return sss_nc_check(ctx, NC_TYPE_LOCATE_GID, dom->name, str);
 }
 
 int sss_ncache_set_locate_uid(struct sss_nc_ctx *ctx,
                               struct sss_domain_info *dom,
                               uid_t uid)
 {
-    char *str;
-    int ret;
+    char str[NC_ID_STR_SIZE];
 
     if (dom == NULL) {
         return EINVAL;
     }
 
-    str = locate_uid_str(ctx, dom, uid);
-    if (str == NULL) {
-        return ENOMEM;
-    }
+    snprintf(str, sizeof(str), "%"SPRIuid, uid);
 
-    ret = sss_ncache_set_str(ctx, str, false);
-    talloc_free(str);
-    return ret;
+    return sss_nc_set(ctx, NC_TYPE_LOCATE_UID, dom->name, str, false);
 }
 
 int sss_ncache_check_locate_uid(struct sss_nc_ctx *ctx,
                                 struct sss_domain_info *dom,
                                 uid_t uid)
 {
-    char *str;
-    int ret;
+    char str[NC_ID_STR_SIZE];
 
     if (dom == NULL) {
         return EINVAL;
     }
 
-    str = locate_uid_str(ctx, dom, uid);
-    if (str == NULL) {
-        return ENOMEM;
-    }
-
-    ret = sss_ncache_check_str(ctx, str);
-    talloc_free(str);
-    return ret;
-}
+    snprintf(str, sizeof(str), "%"SPRIuid, uid);
 
-static char *locate_sid_str(struct sss_nc_ctx *ctx,
-                            struct sss_domain_info *dom,
-                            const char *sid)
-{
-    return talloc_asprintf(ctx,
-                           "%s/%s/%s/%s",
-                           NC_DOMAIN_ACCT_LOCATE_PREFIX,
-                           NC_SID_PREFIX,
-                           dom->name,
-                           sid);
+    return sss_nc_check(ctx, NC_TYPE_LOCATE_UID, dom->name, str);
 }
 
 int sss_ncache_check_locate_sid(struct sss_nc_ctx *ctx,
                                 struct sss_domain_info *dom,
                                 const char *sid)
 {
-    char *str;
-    int ret;
-
     if (dom == NULL) {
         return EINVAL;
     }
 
-    str = locate_sid_str(ctx, dom, sid);
-    if (str == NULL) {
-        return ENOMEM;
-    }
-
-    ret = sss_ncache_check_str(ctx, str);
-    talloc_free(str);
-    return ret;
+    return sss_nc_check(ctx, NC_TYPE_LOCATE_SID, dom->name, sid);
 }
 
 int sss_ncache_set_locate_sid(struct sss_nc_ctx *ctx,
                               struct sss_domain_info *dom,
                               const char *sid)
 {
-    char *str;
-    int ret;
-
     if (dom == NULL) {
         return EINVAL;
     }
 
-    str = locate_sid_str(ctx, dom, sid);
-    if (str == NULL) {
-        return ENOMEM;
-    }
-
-    ret = sss_ncache_set_str(ctx, str, false);
-    talloc_free(str);
-    return ret;
+    return sss_nc_set(ctx, NC_TYPE_LOCATE_SID, dom->name, sid, false);
 }
 
-static int delete_permanent(struct tdb_context *tdb,
-                            TDB_DATA key, TDB_DATA data, void *state)
-{
-    unsigned long long int timestamp;
-    bool remove_key = false;
-    char *ep;
-
-    if (strncmp((char *)key.dptr,
-                NC_ENTRY_PREFIX, sizeof(NC_ENTRY_PREFIX) - 1) != 0) {
-        /* not interested in this key */
-        return 0;
-    }
-
-    errno = 0;
-    timestamp = strtoull((const char *)data.dptr, &ep, 10);
-    if (errno != 0 || *ep != '\0') {
-        /* Malformed entry, remove it */
-        remove_key = true;
-        goto done;
-    }
-
-    if (timestamp == 0) {
-        /* a 0 timestamp means this is a permanent entry */
-        remove_key = true;
-    }
+typedef bool (*ncache_reset_fn_t)(struct sss_nc_entry *, void *);
 
-done:
-    if (remove_key) {
-        return tdb_delete(tdb, key);
+static void sss_ncache_reset_entries(struct sss_nc_ctx *ctx,
+                                     ncache_reset_fn_t filter, void *pvt)
+{
+    struct sss_nc_shard *shard;
+    uint32_t i;
+    int s;
+
+    for (s = 0; s < NC_SHARDS; s++) {
+        shard = &ctx->shards[s];
+        for (i = 0; i < shard->size; i++) {
+            if (shard->entries[i].name != NULL
+                    && filter(&shard->entries[i], pvt)) {
+                sss_nc_entry_delete(shard, &shard->entries[i]);
+            }
+        }
     }
+}
 
-    return 0;
+static bool is_permanent(struct sss_nc_entry *e, void *pvt)
+{
+    return e->expire == 0;
 }
 
 int sss_ncache_reset_permanent(struct sss_nc_ctx *ctx)
 {
-    int ret;
-
-    ret = tdb_traverse(ctx->tdb, delete_permanent, NULL);
-    if (ret < 0)
-        return EIO;
+    sss_ncache_reset_entries(ctx, is_permanent, NULL);
 
     return EOK;
 }
 
-static int delete_prefix(struct tdb_context *tdb,
-                         TDB_DATA key, TDB_DATA data, void *state)
+/* pvt is a list of types terminated by NC_TYPE_FREE */
+static bool is_temporary_of_type(struct sss_nc_entry *e, void *pvt)
 {
-    const char *prefix = (const char *) state;
-    unsigned long long int timestamp;
-    char *ep = NULL;
-
-    if (strncmp((char *)key.dptr, prefix, strlen(prefix) - 1) != 0) {
-        /* not interested in this key */
-        return 0;
-    }
+    const enum sss_nc_type *types = pvt;
+    int i;
 
-    errno = 0;
-    timestamp = strtoull((const char *)data.dptr, &ep, 10);
-    if ((errno == 0) && (*ep == '\0') && (timestamp == 0)) {
+    if (e->expire == 0) {
         /* skip permanent entries */
-        return 0;
-    }
-
-    return tdb_delete(tdb, key);
-}
-
-static int sss_ncache_reset_pfx(struct sss_nc_ctx *ctx,
-                                const char **prefixes)
-{
-    int ret;
-
-    if (prefixes == NULL) {
-        return EOK;
+        return false;
     }
 
-    for (int i = 0; prefixes[i] != NULL; i++) {
-        ret = tdb_traverse(ctx->tdb,
-                           delete_prefix,
-                           discard_const(prefixes[i]));
-        if (ret < 0) {
-            return EIO;
+    for (i = 0; types[i] != NC_TYPE_FREE; i++) {
+        if (e->type == types[i]) {
+            return true;
         }
     }
 
-    return EOK;
+    return false;
 }
 
 int sss_ncache_reset_users(struct sss_nc_ctx *ctx)
 {
-    const char *prefixes[] = {
-        NC_USER_PREFIX,
-        NC_UID_PREFIX,
-        NULL,
+    enum sss_nc_type types[] = {
+        NC_TYPE_USER,
+        NC_TYPE_UID,
+        NC_TYPE_FREE,
     };
 
-    return sss_ncache_reset_pfx(ctx, prefixes);
+    sss_ncache_reset_entries(ctx, is_temporary_of_type, types);
+
+    return EOK;
 }
 
 int sss_ncache_reset_groups(struct sss_nc_ctx *ctx)
 {
-    const char *prefixes[] = {
-        NC_GROUP_PREFIX,
-        NC_GID_PREFIX,
-        NULL,
+    enum sss_nc_type types[] = {
+        NC_TYPE_GROUP,
+        NC_TYPE_GID,
+        NC_TYPE_FREE,
     };
 
-    return sss_ncache_reset_pfx(ctx, prefixes);
+    sss_ncache_reset_entries(ctx, is_temporary_of_type, types);
+
+    return EOK;
 }
 
 errno_t sss_ncache_prepopulate(struct sss_nc_ctx *ncache,
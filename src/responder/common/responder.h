@@ -118,6 +118,10 @@ struct resp_ctx {
     uint32_t cache_req_num;
     uint32_t client_id_num;
 
+    /* cache_req searches in progress, used to coalesce identical lookups */
+    hash_table_t *cache_req_inflight;
+    uint64_t cache_req_coalesced_num;
+
     void *pvt_ctx;
 
     bool shutting_down;
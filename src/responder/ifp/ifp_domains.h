@@ -180,6 +180,18 @@ ifp_domains_domain_list_servers_recv(TALLOC_CTX *mem_ctx,
                                       struct tevent_req *req,
                                       const char ***_servers);
 
+struct tevent_req *
+ifp_domains_domain_transaction_stats_send(TALLOC_CTX *mem_ctx,
+                                          struct tevent_context *ev,
+                                          struct sbus_request *sbus_req,
+                                          struct ifp_ctx *ifp_ctx);
+
+errno_t
+ifp_domains_domain_transaction_stats_recv(TALLOC_CTX *mem_ctx,
+                                          struct tevent_req *req,
+                                          const char ***_names,
+                                          uint64_t **_values);
+
 struct tevent_req *
 ifp_domains_domain_refresh_access_rules_send(TALLOC_CTX *mem_ctx,
                                              struct tevent_context *ev,
@@ -85,6 +85,45 @@ errno_t _sbus_ifp_invoker_write_as
     return EOK;
 }
 
+errno_t _sbus_ifp_invoker_read_asat
+   (TALLOC_CTX *mem_ctx,
+    DBusMessageIter *iter,
+    struct _sbus_ifp_invoker_args_asat *args)
+{
+    errno_t ret;
+
+    ret = sbus_iterator_read_as(mem_ctx, iter, &args->arg0);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = sbus_iterator_read_at(mem_ctx, iter, &args->arg1);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    return EOK;
+}
+
+errno_t _sbus_ifp_invoker_write_asat
+   (DBusMessageIter *iter,
+    struct _sbus_ifp_invoker_args_asat *args)
+{
+    errno_t ret;
+
+    ret = sbus_iterator_write_as(iter, args->arg0);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = sbus_iterator_write_at(iter, args->arg1);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    return EOK;
+}
+
 errno_t _sbus_ifp_invoker_read_b
    (TALLOC_CTX *mem_ctx,
     DBusMessageIter *iter,
@@ -58,6 +58,22 @@ _sbus_ifp_invoker_write_as
    (DBusMessageIter *iter,
     struct _sbus_ifp_invoker_args_as *args);
 
+struct _sbus_ifp_invoker_args_asat {
+    const char ** arg0;
+    uint64_t * arg1;
+};
+
+errno_t
+_sbus_ifp_invoker_read_asat
+   (TALLOC_CTX *mem_ctx,
+    DBusMessageIter *iter,
+    struct _sbus_ifp_invoker_args_asat *args);
+
+errno_t
+_sbus_ifp_invoker_write_asat
+   (DBusMessageIter *iter,
+    struct _sbus_ifp_invoker_args_asat *args);
+
 struct _sbus_ifp_invoker_args_b {
     bool arg0;
 };
@@ -193,6 +193,15 @@ sbus_call_ifp_domain_RefreshAccessRules
      const char *busname,
      const char *object_path);
 
+errno_t
+sbus_call_ifp_domain_TransactionStats
+    (TALLOC_CTX *mem_ctx,
+     struct sbus_sync_connection *conn,
+     const char *busname,
+     const char *object_path,
+     const char *** _arg_names,
+     uint64_t ** _arg_values);
+
 errno_t
 sbus_call_ifp_groups_FindByID
     (TALLOC_CTX *mem_ctx,
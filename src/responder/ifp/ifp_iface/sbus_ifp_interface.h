@@ -1166,6 +1166,28 @@
         (handler_send), (handler_recv), (data)); \
 })
 
+/* Method: org.freedesktop.sssd.infopipe.Domains.Domain.TransactionStats */
+#define SBUS_METHOD_SYNC_org_freedesktop_sssd_infopipe_Domains_Domain_TransactionStats(handler, data) ({ \
+    SBUS_CHECK_SYNC((handler), (data), const char ***, uint64_t **); \
+    sbus_method_sync("TransactionStats", \
+        &_sbus_ifp_args_org_freedesktop_sssd_infopipe_Domains_Domain_TransactionStats, \
+        NULL, \
+        _sbus_ifp_invoke_in__out_asat_send, \
+        _sbus_ifp_key_, \
+        (handler), (data)); \
+})
+
+#define SBUS_METHOD_ASYNC_org_freedesktop_sssd_infopipe_Domains_Domain_TransactionStats(handler_send, handler_recv, data) ({ \
+    SBUS_CHECK_SEND((handler_send), (data)); \
+    SBUS_CHECK_RECV((handler_recv), const char ***, uint64_t **); \
+    sbus_method_async("TransactionStats", \
+        &_sbus_ifp_args_org_freedesktop_sssd_infopipe_Domains_Domain_TransactionStats, \
+        NULL, \
+        _sbus_ifp_invoke_in__out_asat_send, \
+        _sbus_ifp_key_, \
+        (handler_send), (handler_recv), (data)); \
+})
+
 /* Interface: org.freedesktop.sssd.infopipe.Groups */
 #define SBUS_IFACE_org_freedesktop_sssd_infopipe_Groups(methods, signals, properties) ({ \
     sbus_interface("org.freedesktop.sssd.infopipe.Groups", NULL, \
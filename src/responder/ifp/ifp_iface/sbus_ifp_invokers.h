@@ -42,6 +42,7 @@
 _sbus_ifp_declare_invoker(, );
 _sbus_ifp_declare_invoker(, ao);
 _sbus_ifp_declare_invoker(, as);
+_sbus_ifp_declare_invoker(, asat);
 _sbus_ifp_declare_invoker(, b);
 _sbus_ifp_declare_invoker(, ifp_extra);
 _sbus_ifp_declare_invoker(, o);
@@ -249,6 +249,18 @@ _sbus_ifp_args_org_freedesktop_sssd_infopipe_Domains_Domain_RefreshAccessRules =
     }
 };
 
+const struct sbus_method_arguments
+_sbus_ifp_args_org_freedesktop_sssd_infopipe_Domains_Domain_TransactionStats = {
+    .input = (const struct sbus_argument[]){
+        {NULL}
+    },
+    .output = (const struct sbus_argument[]){
+        {.type = "as", .name = "names"},
+        {.type = "at", .name = "values"},
+        {NULL}
+    }
+};
+
 const struct sbus_method_arguments
 _sbus_ifp_args_org_freedesktop_sssd_infopipe_Groups_FindByID = {
     .input = (const struct sbus_argument[]){
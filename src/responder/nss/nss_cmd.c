@@ -67,10 +67,15 @@ static errno_t eval_flags(struct sss_nss_cmd_ctx *cmd_ctx,
         cache_req_data_set_bypass_dp(data, true);
     }
 
+    if ((cmd_ctx->flags & SSS_NSS_EX_FLAG_NO_MEMBERS) != 0) {
+        cache_req_data_set_no_members(data, true);
+    }
+
     return EOK;
 }
 
 static void sss_nss_getby_done(struct tevent_req *subreq);
+static void sss_nss_getby_batch_done(struct tevent_req *subreq);
 static void sss_nss_getlistby_done(struct tevent_req *subreq);
 
 static errno_t sss_nss_getby_name(struct cli_ctx *cli_ctx,
@@ -205,6 +210,117 @@ done:
     return EOK;
 }
 
+struct sss_nss_batch_ctx {
+    struct sss_nss_cmd_ctx *cmd_ctx;
+    uint32_t num_ids;
+    uint32_t *ids;
+    struct cache_req_result **results;
+    uint32_t pending;
+};
+
+struct sss_nss_batch_item {
+    struct sss_nss_batch_ctx *batch;
+    uint32_t index;
+};
+
+static errno_t sss_nss_getby_id_batch(struct cli_ctx *cli_ctx,
+                                      enum cache_req_type type,
+                                      enum sss_mc_type memcache,
+                                      sss_nss_protocol_fill_packet_fn fill_fn)
+{
+    struct cache_req_data *data;
+    struct sss_nss_cmd_ctx *cmd_ctx;
+    struct sss_nss_batch_ctx *batch;
+    struct sss_nss_batch_item *item;
+    struct tevent_req *subreq;
+    uint32_t i;
+    uint32_t j;
+    errno_t ret;
+
+    cmd_ctx = sss_nss_cmd_ctx_create(cli_ctx, cli_ctx, type, fill_fn);
+    if (cmd_ctx == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    batch = talloc_zero(cmd_ctx, struct sss_nss_batch_ctx);
+    if (batch == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+    batch->cmd_ctx = cmd_ctx;
+
+    ret = sss_nss_protocol_parse_id_batch(batch, cli_ctx, &batch->ids,
+                                          &batch->num_ids, &cmd_ctx->flags);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Invalid request message!\n");
+        goto done;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Input: %"PRIu32" IDs\n", batch->num_ids);
+
+    batch->results = talloc_zero_array(batch, struct cache_req_result *,
+                                       batch->num_ids);
+    if (batch->results == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (i = 0; i < batch->num_ids; i++) {
+        /* Duplicate IDs are resolved only once and copied afterwards. */
+        for (j = 0; j < i; j++) {
+            if (batch->ids[j] == batch->ids[i]) {
+                break;
+            }
+        }
+        if (j < i) {
+            continue;
+        }
+
+        data = cache_req_data_id(batch, type, batch->ids[i]);
+        if (data == NULL) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Unable to set cache request data!\n");
+            ret = ENOMEM;
+            goto done;
+        }
+
+        ret = eval_flags(cmd_ctx, data);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "eval_flags failed.\n");
+            goto done;
+        }
+
+        item = talloc_zero(batch, struct sss_nss_batch_item);
+        if (item == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+        item->batch = batch;
+        item->index = i;
+
+        subreq = sss_nss_get_object_send(batch, cli_ctx->ev, cli_ctx,
+                                         data, memcache, NULL, batch->ids[i]);
+        if (subreq == NULL) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "sss_nss_get_object_send() failed\n");
+            ret = ENOMEM;
+            goto done;
+        }
+
+        tevent_req_set_callback(subreq, sss_nss_getby_batch_done, item);
+        batch->pending++;
+    }
+
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        talloc_free(cmd_ctx);
+        return sss_nss_protocol_done(cli_ctx, ret);
+    }
+
+    return EOK;
+}
+
 static errno_t sss_nss_getby_svc(struct cli_ctx *cli_ctx,
                                  enum cache_req_type type,
                                  const char *protocol,
@@ -623,6 +739,65 @@ done:
     talloc_free(cmd_ctx);
 }
 
+static void sss_nss_getby_batch_done(struct tevent_req *subreq)
+{
+    struct sss_nss_batch_item *item;
+    struct sss_nss_batch_ctx *batch;
+    struct sss_nss_cmd_ctx *cmd_ctx;
+    struct cache_req_result *result;
+    uint32_t i;
+    uint32_t j;
+    errno_t ret;
+
+    item = tevent_req_callback_data(subreq, struct sss_nss_batch_item);
+    batch = item->batch;
+    cmd_ctx = batch->cmd_ctx;
+
+    ret = sss_nss_get_object_recv(batch, subreq, &result, NULL);
+    talloc_zfree(subreq);
+    if (ret == EOK) {
+        batch->results[item->index] = result;
+
+        if ((cmd_ctx->flags & SSS_NSS_EX_FLAG_INVALIDATE_CACHE) != 0) {
+            ret = invalidate_cache(cmd_ctx, result);
+            if (ret != EOK) {
+                DEBUG(SSSDBG_OP_FAILURE, "Failed to invalidate cache for "
+                      "ID [%"PRIu32"].\n", batch->ids[item->index]);
+            }
+        }
+    } else if (ret != ENOENT) {
+        /* A failed lookup does not fail the whole batch, the client just
+         * gets an empty record for this ID. */
+        DEBUG(SSSDBG_OP_FAILURE, "Unable to look up ID [%"PRIu32"] [%d]: %s\n",
+              batch->ids[item->index], ret, sss_strerror(ret));
+    }
+
+    talloc_free(item);
+
+    batch->pending--;
+    if (batch->pending > 0) {
+        return;
+    }
+
+    for (i = 0; i < batch->num_ids; i++) {
+        if (batch->results[i] != NULL) {
+            continue;
+        }
+        for (j = 0; j < i; j++) {
+            if (batch->ids[j] == batch->ids[i]) {
+                batch->results[i] = batch->results[j];
+                break;
+            }
+        }
+    }
+
+    sss_nss_protocol_reply_batch(cmd_ctx->cli_ctx, cmd_ctx->nss_ctx, cmd_ctx,
+                                 batch->num_ids, batch->ids, batch->results,
+                                 cmd_ctx->fill_fn);
+
+    talloc_free(cmd_ctx);
+}
+
 static void sss_nss_setent_done(struct tevent_req *subreq);
 
 static errno_t sss_nss_setent(struct cli_ctx *cli_ctx,
@@ -925,6 +1100,12 @@ static errno_t sss_nss_cmd_getpwuid_ex(struct cli_ctx *cli_ctx)
                             SSS_MC_PASSWD, sss_nss_protocol_fill_pwent);
 }
 
+static errno_t sss_nss_cmd_getpwuid_batch(struct cli_ctx *cli_ctx)
+{
+    return sss_nss_getby_id_batch(cli_ctx, CACHE_REQ_USER_BY_ID,
+                                  SSS_MC_PASSWD, sss_nss_protocol_fill_pwent);
+}
+
 static errno_t sss_nss_cmd_setpwent(struct cli_ctx *cli_ctx)
 {
     struct sss_nss_ctx *nss_ctx;
@@ -986,6 +1167,13 @@ static errno_t sss_nss_cmd_getgrgid_ex(struct cli_ctx *cli_ctx)
 }
 
 
+static errno_t sss_nss_cmd_getgrgid_batch(struct cli_ctx *cli_ctx)
+{
+    return sss_nss_getby_id_batch(cli_ctx, CACHE_REQ_GROUP_BY_ID,
+                                  SSS_MC_GROUP, sss_nss_protocol_fill_grent);
+}
+
+
 static errno_t sss_nss_cmd_setgrent(struct cli_ctx *cli_ctx)
 {
     struct sss_nss_ctx *nss_ctx;
@@ -1395,6 +1583,8 @@ struct sss_cmd_table *get_sss_nss_cmds(void)
         { SSS_NSS_GETPWUID_EX, sss_nss_cmd_getpwuid_ex },
         { SSS_NSS_GETGRNAM_EX, sss_nss_cmd_getgrnam_ex },
         { SSS_NSS_GETGRGID_EX, sss_nss_cmd_getgrgid_ex },
+        { SSS_NSS_GETPWUID_BATCH, sss_nss_cmd_getpwuid_batch },
+        { SSS_NSS_GETGRGID_BATCH, sss_nss_cmd_getgrgid_batch },
         { SSS_NSS_INITGR_EX, sss_nss_cmd_initgroups_ex },
         { SSS_NSS_GETHOSTBYNAME, sss_nss_cmd_gethostbyname },
         { SSS_NSS_GETHOSTBYNAME2, sss_nss_cmd_gethostbyname },
@@ -163,6 +163,63 @@ memcache_delete_entry(struct sss_nss_ctx *nss_ctx,
     return EOK;
 }
 
+/* The object was not found in any domain, remember it in the memory cache
+ * so that clients do not have to ask again until the negative cache entry
+ * would expire. */
+static errno_t
+memcache_store_negative(struct sss_nss_ctx *nss_ctx,
+                        struct resp_ctx *rctx,
+                        const char *name,
+                        uint32_t id,
+                        enum sss_mc_type type)
+{
+    struct sss_mc_ctx **mc_ctx;
+    struct sized_string key;
+    char idstr[11];
+    time_t ttl;
+    errno_t ret;
+
+    switch (type) {
+    case SSS_MC_PASSWD:
+        mc_ctx = &nss_ctx->pwd_mc_ctx;
+        break;
+    case SSS_MC_GROUP:
+        mc_ctx = &nss_ctx->grp_mc_ctx;
+        break;
+    default:
+        return EOK;
+    }
+
+    if (*mc_ctx == NULL) { /* mem-cache disabled */
+        return EOK;
+    }
+
+    if (name != NULL) {
+        to_sized_string(&key, name);
+    } else if (id != 0) {
+        ret = snprintf(idstr, sizeof(idstr), "%ld", (long)id);
+        if (ret < 0 || ret >= sizeof(idstr)) {
+            return EINVAL;
+        }
+        to_sized_string(&key, idstr);
+    } else {
+        /* "root" is not handled by SSSD */
+        return EOK;
+    }
+
+    ttl = sss_ncache_get_timeout(rctx->ncache);
+
+    ret = sss_mmap_cache_neg_store(mc_ctx, &key, name == NULL, ttl);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Unable to store negative memory cache entry for '%s' "
+              "[%d]: %s\n", key.str, ret, sss_strerror(ret));
+        return ret;
+    }
+
+    return EOK;
+}
+
 static struct cache_req_data *
 hybrid_domain_retry_data(TALLOC_CTX *mem_ctx,
                          struct cache_req_data *orig,
@@ -390,6 +447,9 @@ static void sss_nss_get_object_finish_req(struct tevent_req *req,
             memcache_delete_entry(state->nss_ctx, state->rctx, NULL,
                                   state->input_name, state->input_id,
                                   state->memcache);
+            memcache_store_negative(state->nss_ctx, state->rctx,
+                                    state->input_name, state->input_id,
+                                    state->memcache);
         }
 
         tevent_req_error(req, ENOENT);
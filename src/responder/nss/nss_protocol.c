@@ -99,6 +99,100 @@ done:
     sss_nss_protocol_done(cli_ctx, ret);
 }
 
+/* Batch reply body:
+ *
+ * 0-3: 32bit unsigned number of results (same as number of requested IDs)
+ * 4-7: 32bit unsigned (reserved/padding)
+ * For each requested ID, in request order:
+ *  0-3: 32bit unsigned ID
+ *  4-7: 32bit unsigned length of the following data, 0 if not found
+ *  8-X: reply body of the matching single lookup command
+ */
+void sss_nss_protocol_reply_batch(struct cli_ctx *cli_ctx,
+                                  struct sss_nss_ctx *nss_ctx,
+                                  struct sss_nss_cmd_ctx *cmd_ctx,
+                                  uint32_t num_ids,
+                                  uint32_t *ids,
+                                  struct cache_req_result **results,
+                                  sss_nss_protocol_fill_packet_fn fill_fn)
+{
+    struct cli_protocol *pctx;
+    struct sss_packet *item;
+    uint8_t *item_body;
+    size_t item_len;
+    uint8_t *body;
+    size_t body_len;
+    size_t rp;
+    uint32_t len;
+    uint32_t i;
+    errno_t ret;
+
+    pctx = talloc_get_type(cli_ctx->protocol_ctx, struct cli_protocol);
+
+    ret = sss_packet_new(pctx->creq, 0, sss_packet_get_cmd(pctx->creq->in),
+                         &pctx->creq->out);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sss_packet_grow(pctx->creq->out, 2 * sizeof(uint32_t));
+    if (ret != EOK) {
+        goto done;
+    }
+
+    sss_packet_get_body(pctx->creq->out, &body, &body_len);
+    rp = 0;
+    SAFEALIGN_SET_UINT32(&body[rp], num_ids, &rp);
+    SAFEALIGN_SET_UINT32(&body[rp], 0, &rp); /* reserved */
+
+    for (i = 0; i < num_ids; i++) {
+        item = NULL;
+        item_body = NULL;
+        item_len = 0;
+
+        if (results[i] != NULL) {
+            /* Let the single lookup fill function build the record so the
+             * format and memory cache handling stay exactly the same. */
+            ret = sss_packet_new(cmd_ctx, 0,
+                                 sss_packet_get_cmd(pctx->creq->in), &item);
+            if (ret != EOK) {
+                goto done;
+            }
+
+            ret = fill_fn(nss_ctx, cmd_ctx, item, results[i]);
+            if (ret == EOK) {
+                sss_packet_get_body(item, &item_body, &item_len);
+            } else if (ret != ENOENT) {
+                DEBUG(SSSDBG_OP_FAILURE, "Unable to fill record for ID "
+                      "[%"PRIu32"] [%d]: %s\n", ids[i], ret,
+                      sss_strerror(ret));
+            }
+        }
+
+        ret = sss_packet_grow(pctx->creq->out, 2 * sizeof(uint32_t) + item_len);
+        if (ret != EOK) {
+            talloc_free(item);
+            goto done;
+        }
+
+        sss_packet_get_body(pctx->creq->out, &body, &body_len);
+        len = item_len;
+        SAFEALIGN_SET_UINT32(&body[rp], ids[i], &rp);
+        SAFEALIGN_SET_UINT32(&body[rp], len, &rp);
+        if (item_len > 0) {
+            safealign_memcpy(&body[rp], item_body, item_len, &rp);
+        }
+
+        talloc_free(item);
+    }
+
+    sss_packet_set_error(pctx->creq->out, EOK);
+    ret = EOK;
+
+done:
+    sss_nss_protocol_done(cli_ctx, ret);
+}
+
 errno_t
 sss_nss_protocol_parse_name(struct cli_ctx *cli_ctx, const char **_rawname)
 {
@@ -245,6 +339,67 @@ sss_nss_protocol_parse_id_ex(struct cli_ctx *cli_ctx, uint32_t *_id,
     return EOK;
 }
 
+/* Batch request body:
+ *
+ * 0-3: 32bit unsigned number of IDs (at most SSS_NSS_MAX_ENTRIES)
+ * 4-7: 32bit unsigned flags (SSS_NSS_EX_FLAG_*)
+ * For each ID:
+ *  0-3: 32bit unsigned ID
+ */
+errno_t
+sss_nss_protocol_parse_id_batch(TALLOC_CTX *mem_ctx,
+                                struct cli_ctx *cli_ctx,
+                                uint32_t **_ids,
+                                uint32_t *_num_ids,
+                                uint32_t *_flags)
+{
+    struct cli_protocol *pctx;
+    uint8_t *body;
+    size_t blen;
+    size_t rp;
+    uint32_t num_ids;
+    uint32_t flags;
+    uint32_t *ids;
+    uint32_t i;
+
+    pctx = talloc_get_type(cli_ctx->protocol_ctx, struct cli_protocol);
+
+    sss_packet_get_body(pctx->creq->in, &body, &blen);
+
+    if (blen < 2 * sizeof(uint32_t)) {
+        return EINVAL;
+    }
+
+    rp = 0;
+    SAFEALIGN_COPY_UINT32(&num_ids, body, &rp);
+    SAFEALIGN_COPY_UINT32(&flags, body + rp, &rp);
+
+    if (num_ids == 0 || num_ids > SSS_NSS_MAX_ENTRIES) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Invalid number of IDs [%"PRIu32"]\n",
+              num_ids);
+        return EINVAL;
+    }
+
+    if (blen != (2 + num_ids) * sizeof(uint32_t)) {
+        return EINVAL;
+    }
+
+    ids = talloc_array(mem_ctx, uint32_t, num_ids);
+    if (ids == NULL) {
+        return ENOMEM;
+    }
+
+    for (i = 0; i < num_ids; i++) {
+        SAFEALIGN_COPY_UINT32(&ids[i], body + rp, &rp);
+    }
+
+    *_ids = ids;
+    *_num_ids = num_ids;
+    *_flags = flags;
+
+    return EOK;
+}
+
 errno_t
 sss_nss_protocol_parse_limit(struct cli_ctx *cli_ctx, uint32_t *_limit)
 {
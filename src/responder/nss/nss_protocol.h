@@ -84,6 +84,18 @@ void sss_nss_protocol_reply(struct cli_ctx *cli_ctx,
                         struct cache_req_result *result,
                         sss_nss_protocol_fill_packet_fn fill_fn);
 
+/**
+ * Create and send a reply to a batch lookup. Each non-NULL result is filled
+ * with @fill_fn into its own record, missing results are sent as empty ones.
+ */
+void sss_nss_protocol_reply_batch(struct cli_ctx *cli_ctx,
+                                  struct sss_nss_ctx *nss_ctx,
+                                  struct sss_nss_cmd_ctx *cmd_ctx,
+                                  uint32_t num_ids,
+                                  uint32_t *ids,
+                                  struct cache_req_result **results,
+                                  sss_nss_protocol_fill_packet_fn fill_fn);
+
 /* Parse input packet. */
 
 errno_t
@@ -100,6 +112,13 @@ errno_t
 sss_nss_protocol_parse_id_ex(struct cli_ctx *cli_ctx, uint32_t *_id,
                          uint32_t *_flags);
 
+errno_t
+sss_nss_protocol_parse_id_batch(TALLOC_CTX *mem_ctx,
+                                struct cli_ctx *cli_ctx,
+                                uint32_t **_ids,
+                                uint32_t *_num_ids,
+                                uint32_t *_flags);
+
 errno_t
 sss_nss_protocol_parse_limit(struct cli_ctx *cli_ctx, uint32_t *_limit);
 
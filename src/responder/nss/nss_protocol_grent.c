@@ -20,6 +20,7 @@
 
 #include "responder/nss/nss_protocol.h"
 #include "util/sss_format.h"
+#include "util/probes.h"
 
 static errno_t
 sss_nss_get_grent(TALLOC_CTX *mem_ctx,
@@ -126,9 +127,11 @@ sss_nss_protocol_fill_members(struct sss_packet *packet,
     struct resp_ctx *rctx = nss_ctx->rctx;
     struct ldb_message_element *members[2];
     struct ldb_message_element *el;
-    struct sized_string *name;
+    struct sized_string **names;
     const char *member_name;
     uint32_t num_members = 0;
+    unsigned int max_members = 0;
+    size_t members_len = 0;
     size_t body_len;
     uint8_t *body;
     errno_t ret;
@@ -139,11 +142,25 @@ sss_nss_protocol_fill_members(struct sss_packet *packet,
         return ENOMEM;
     }
 
+    PROBE(NSS_GROUP_MEMBERS_START, group_name);
+
     members[0] = sss_nss_get_group_members(domain, msg);
     members[1] = sss_nss_get_group_ghosts(domain, msg, group_name);
 
-    sss_packet_get_body(packet, &body, &body_len);
+    for (i = 0; i < sizeof(members) / sizeof(members[0]); i++) {
+        if (members[i] != NULL) {
+            max_members += members[i]->num_values;
+        }
+    }
 
+    names = talloc_array(tmp_ctx, struct sized_string *, max_members);
+    if (names == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    /* Collect the member names first so that the packet is grown only
+     * once, large groups would otherwise reallocate it over and over. */
     for (i = 0; i < sizeof(members) / sizeof(members[0]); i++) {
         el = members[i];
         if (el == NULL) {
@@ -163,28 +180,35 @@ sss_nss_protocol_fill_members(struct sss_packet *packet,
                 }
             }
 
-            ret = sized_domain_name(tmp_ctx, rctx, member_name, &name);
+            ret = sized_domain_name(names, rctx, member_name,
+                                    &names[num_members]);
             if (ret != EOK) {
                 DEBUG(SSSDBG_OP_FAILURE, "Unable to get sized name [%d]: %s\n",
                       ret, sss_strerror(ret));
+                num_members = 0;
                 goto done;
             }
 
-            ret = sss_packet_grow(packet, name->len);
-            if (ret != EOK) {
-                goto done;
-            }
-
-            sss_packet_get_body(packet, &body, &body_len);
-            SAFEALIGN_SET_STRING(&body[*_rp], name->str, name->len, _rp);
-
+            members_len += names[num_members]->len;
             num_members++;
         }
     }
 
+    ret = sss_packet_grow(packet, members_len);
+    if (ret != EOK) {
+        num_members = 0;
+        goto done;
+    }
+
+    sss_packet_get_body(packet, &body, &body_len);
+    for (i = 0; i < num_members; i++) {
+        SAFEALIGN_SET_STRING(&body[*_rp], names[i]->str, names[i]->len, _rp);
+    }
+
     ret = EOK;
 
 done:
+    PROBE(NSS_GROUP_MEMBERS_END, group_name, num_members);
     *_num_members = num_members;
     talloc_free(tmp_ctx);
 
@@ -262,11 +286,16 @@ sss_nss_protocol_fill_grent(struct sss_nss_ctx *nss_ctx,
         SAFEALIGN_SET_STRING(&body[rp], pwfield.str, pwfield.len, &rp);
         rp_members = rp;
 
-        /* Fill members. */
-        ret = sss_nss_protocol_fill_members(packet, nss_ctx, result->domain, msg,
-                                        name->str, &rp, &num_members);
-        if (ret != EOK) {
-            goto done;
+        /* Fill members unless only the group header was requested. */
+        if ((cmd_ctx->flags & SSS_NSS_EX_FLAG_NO_MEMBERS) == 0) {
+            ret = sss_nss_protocol_fill_members(packet, nss_ctx, result->domain,
+                                                msg, name->str, &rp,
+                                                &num_members);
+            if (ret != EOK) {
+                goto done;
+            }
+        } else {
+            num_members = 0;
         }
 
         sss_packet_get_body(packet, &body, &body_len);
@@ -275,9 +304,11 @@ sss_nss_protocol_fill_grent(struct sss_nss_ctx *nss_ctx,
         num_results++;
 
         /* Do not store entry in memory cache during enumeration or when
-         * requested or if cache explicitly disabled. */
+         * requested or if cache explicitly disabled. A header-only reply
+         * must not be stored either, it would look like an empty group. */
         if (!cmd_ctx->enumeration
                 && ((cmd_ctx->flags & SSS_NSS_EX_FLAG_INVALIDATE_CACHE) == 0)
+                && ((cmd_ctx->flags & SSS_NSS_EX_FLAG_NO_MEMBERS) == 0)
                 && (nss_ctx->grp_mc_ctx != NULL)) {
             members = (char *)&body[rp_members];
             members_size = body_len - rp_members;
@@ -154,6 +154,25 @@ sss_nss_clear_negcache(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
+    /* negative records in the memory cache mirror the negative cache */
+    if (nctx->pwd_mc_ctx != NULL) {
+        ret = sss_mmap_cache_neg_purge(&nctx->pwd_mc_ctx);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Clearing negative passwd memory cache records failed\n");
+        }
+    }
+
+    if (nctx->grp_mc_ctx != NULL) {
+        ret = sss_mmap_cache_neg_purge(&nctx->grp_mc_ctx);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Clearing negative group memory cache records failed\n");
+        }
+    }
+
+    ret = EOK;
+
 done:
     return ret;
 }
@@ -280,9 +299,11 @@ static int setup_memcaches(struct sss_nss_ctx *nctx)
     static const size_t SSS_MC_CACHE_GROUP_SIZE     =  6;
     static const size_t SSS_MC_CACHE_INITGROUP_SIZE = 10;
     static const size_t SSS_MC_CACHE_SID_SIZE       =  6;
+    static const int SSS_MC_CACHE_GROWTH_LIMIT      =  4;
 
     int ret;
     int memcache_timeout;
+    int mc_growth_limit;
     int mc_size_passwd;
     int mc_size_group;
     int mc_size_initgroups;
@@ -358,11 +379,31 @@ static int setup_memcaches(struct sss_nss_ctx *nctx)
         return ret;
     }
 
+    ret = confdb_get_int(nctx->rctx->cdb,
+                         CONFDB_NSS_CONF_ENTRY,
+                         CONFDB_NSS_MEMCACHE_GROWTH_LIMIT,
+                         SSS_MC_CACHE_GROWTH_LIMIT,
+                         &mc_growth_limit);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "Failed to get '"CONFDB_NSS_MEMCACHE_GROWTH_LIMIT
+              "' option from confdb.\n");
+        return ret;
+    }
+    if (mc_growth_limit < 1) {
+        DEBUG(SSSDBG_CONF_SETTINGS,
+              "Invalid '"CONFDB_NSS_MEMCACHE_GROWTH_LIMIT"' value %d, "
+              "in-memory caches will not grow\n", mc_growth_limit);
+        mc_growth_limit = 1;
+    }
+
     /* Initialize the fast in-memory caches if they were not disabled */
 
     ret = sss_mmap_cache_init(nctx, "passwd",
                               SSS_MC_PASSWD,
                               mc_size_passwd * SSS_MC_CACHE_SLOTS_PER_MB,
+                              mc_size_passwd * mc_growth_limit
+                                  * SSS_MC_CACHE_SLOTS_PER_MB,
                               (time_t)memcache_timeout,
                               &nctx->pwd_mc_ctx);
     if (ret) {
@@ -374,6 +415,8 @@ static int setup_memcaches(struct sss_nss_ctx *nctx)
     ret = sss_mmap_cache_init(nctx, "group",
                               SSS_MC_GROUP,
                               mc_size_group * SSS_MC_CACHE_SLOTS_PER_MB,
+                              mc_size_group * mc_growth_limit
+                                  * SSS_MC_CACHE_SLOTS_PER_MB,
                               (time_t)memcache_timeout,
                               &nctx->grp_mc_ctx);
     if (ret) {
@@ -385,6 +428,8 @@ static int setup_memcaches(struct sss_nss_ctx *nctx)
     ret = sss_mmap_cache_init(nctx, "initgroups",
                               SSS_MC_INITGROUPS,
                               mc_size_initgroups * SSS_MC_CACHE_SLOTS_PER_MB,
+                              mc_size_initgroups * mc_growth_limit
+                                  * SSS_MC_CACHE_SLOTS_PER_MB,
                               (time_t)memcache_timeout,
                               &nctx->initgr_mc_ctx);
     if (ret) {
@@ -396,6 +441,8 @@ static int setup_memcaches(struct sss_nss_ctx *nctx)
     ret = sss_mmap_cache_init(nctx, "sid",
                               SSS_MC_SID,
                               mc_size_sid * SSS_MC_CACHE_SLOTS_PER_MB,
+                              mc_size_sid * mc_growth_limit
+                                  * SSS_MC_CACHE_SLOTS_PER_MB,
                               (time_t)memcache_timeout,
                               &nctx->sid_mc_ctx);
     if (ret) {
@@ -47,6 +47,9 @@
     __sync_synchronize(); \
 } while (0)
 
+#define MC_EXT_BINS 32
+#define MC_EXT_BIN(len) (31 - __builtin_clz(len))
+
 struct sss_mc_ctx {
     char *name;             /* mmap cache name */
     enum sss_mc_type type;  /* mmap cache type */
@@ -62,14 +65,46 @@ struct sss_mc_ctx {
     uint32_t *hash_table;   /* hash table address (in mmap) */
     uint32_t ht_size;       /* size of hash table */
 
+    uint32_t *seq_table;    /* per bucket sequence counters (in mmap),
+                             * same number of elements as hash_table */
+
     uint8_t *free_table;    /* free list bitmaps */
     uint32_t ft_size;       /* size of free table */
     uint32_t next_slot;     /* the next slot after last allocation done via erasure */
 
+    /* Free extents of the data table, kept in responder memory only.
+     * Every run of free slots is linked in the bin of its size class,
+     * bin n holds extents of 2^n to 2^(n+1)-1 slots. */
+    uint32_t *ext_len;      /* boundary tags, length of the extent that
+                             * starts or ends at the slot */
+    uint32_t *ext_next;     /* next extent in the bin, valid at heads */
+    uint32_t *ext_prev;     /* previous extent in the bin, valid at heads */
+    uint32_t ext_bins[MC_EXT_BINS];
+
     uint8_t *data_table;    /* data table address (in mmap) */
     uint32_t dt_size;       /* size of data table */
+
+    size_t max_elems;       /* the cache is never grown past this size */
+    time_t evict_window;    /* start of the eviction accounting window */
+    uint32_t evicted_slots; /* slots evicted in the current window */
+    bool grow;              /* eviction rate too high, grow on next store */
+
+    /* allocation statistics */
+    uint64_t stats_stores;      /* records stored */
+    uint64_t stats_hits;        /* stored without evicting anything */
+    uint64_t stats_evictions;   /* stored after evicting other records */
+    uint64_t stats_failures;    /* could not be stored */
 };
 
+/* log the allocation statistics every MC_STATS_INTERVAL stores */
+#define MC_STATS_INTERVAL 1000
+
+/* If more than 1/MC_GROW_EVICT_RATIO of all slots had to be evicted to make
+ * room for new records within MC_GROW_WINDOW seconds, the working set does
+ * not fit and the cache is grown to twice its size (up to max_elems). */
+#define MC_GROW_WINDOW 60
+#define MC_GROW_EVICT_RATIO 8
+
 #define MC_FIND_BIT(base, num) \
     uint32_t n = (num); \
     uint8_t *b = (base) + n / 8; \
@@ -91,6 +126,44 @@ struct sss_mc_ctx {
     else used = false; \
 } while (0)
 
+/* Only the responder writes to the cache so a plain increment surrounded
+ * by full barriers is enough, readers only ever load the counter. */
+static inline void sss_mc_seq_bump(struct sss_mc_ctx *mcc, uint32_t hash)
+{
+    if (hash >= MC_HT_ELEMS(mcc->ht_size)) {
+        /* invalid hash, e.g. a record that is not chained yet */
+        return;
+    }
+
+    __sync_synchronize();
+    mcc->seq_table[hash]++;
+    __sync_synchronize();
+}
+
+#define MC_SEQ_WRITE_BEGIN(mcc, hash) sss_mc_seq_bump(mcc, hash)
+#define MC_SEQ_WRITE_END(mcc, hash) sss_mc_seq_bump(mcc, hash)
+
+/* A record is linked in two buckets, bracket both of them. If both hashes
+ * point to the same bucket it must be bumped only once, otherwise the
+ * counter would end up even while the write is still in progress. */
+static inline void sss_mc_rec_write_begin(struct sss_mc_ctx *mcc,
+                                          uint32_t hash1, uint32_t hash2)
+{
+    MC_SEQ_WRITE_BEGIN(mcc, hash1);
+    if (hash2 != hash1) {
+        MC_SEQ_WRITE_BEGIN(mcc, hash2);
+    }
+}
+
+static inline void sss_mc_rec_write_end(struct sss_mc_ctx *mcc,
+                                        uint32_t hash1, uint32_t hash2)
+{
+    if (hash2 != hash1) {
+        MC_SEQ_WRITE_END(mcc, hash2);
+    }
+    MC_SEQ_WRITE_END(mcc, hash1);
+}
+
 static inline
 uint32_t sss_mc_next_slot_with_hash(struct sss_mc_rec *rec,
                                     uint32_t hash)
@@ -196,6 +269,8 @@ static uint32_t sss_mc_hash(struct sss_mc_ctx *mcc,
     return murmurhash3(key, len, mcc->seed) % MC_HT_ELEMS(mcc->ht_size);
 }
 
+/* The chain helpers below do not touch the bucket sequence counters,
+ * callers are expected to bracket them with sss_mc_rec_write_begin/end() */
 static void sss_mc_add_rec_to_chain(struct sss_mc_ctx *mcc,
                                     struct sss_mc_rec *rec,
                                     uint32_t hash)
@@ -273,6 +348,159 @@ static void sss_mc_rm_rec_from_chain(struct sss_mc_ctx *mcc,
     }
 }
 
+/***************************************************************************
+ * free extents
+ ***************************************************************************/
+
+static void sss_mc_ext_link(struct sss_mc_ctx *mcc,
+                            uint32_t start, uint32_t len)
+{
+    uint32_t bin = MC_EXT_BIN(len);
+
+    mcc->ext_len[start] = len;
+    mcc->ext_len[start + len - 1] = len;
+
+    mcc->ext_prev[start] = MC_INVALID_VAL;
+    mcc->ext_next[start] = mcc->ext_bins[bin];
+    if (mcc->ext_bins[bin] != MC_INVALID_VAL) {
+        mcc->ext_prev[mcc->ext_bins[bin]] = start;
+    }
+    mcc->ext_bins[bin] = start;
+}
+
+static void sss_mc_ext_unlink(struct sss_mc_ctx *mcc, uint32_t start)
+{
+    uint32_t bin = MC_EXT_BIN(mcc->ext_len[start]);
+    uint32_t next = mcc->ext_next[start];
+    uint32_t prev = mcc->ext_prev[start];
+
+    if (prev != MC_INVALID_VAL) {
+        mcc->ext_next[prev] = next;
+    } else {
+        mcc->ext_bins[bin] = next;
+    }
+    if (next != MC_INVALID_VAL) {
+        mcc->ext_prev[next] = prev;
+    }
+}
+
+/* All slots are free, the whole data table is a single extent */
+static void sss_mc_ext_reset(struct sss_mc_ctx *mcc)
+{
+    uint32_t i;
+
+    for (i = 0; i < MC_EXT_BINS; i++) {
+        mcc->ext_bins[i] = MC_INVALID_VAL;
+    }
+    mcc->next_slot = 0;
+
+    if (mcc->ft_size != 0) {
+        sss_mc_ext_link(mcc, 0, mcc->ft_size * 8);
+    }
+}
+
+/* The slots must already be marked as free in free_table, the extent is
+ * merged with its free neighbours so that extents are always maximal. */
+static void sss_mc_ext_release(struct sss_mc_ctx *mcc,
+                               uint32_t start, uint32_t len)
+{
+    uint32_t tot_slots = mcc->ft_size * 8;
+    uint32_t n;
+    bool used;
+
+    if (start > 0) {
+        MC_PROBE_BIT(mcc->free_table, start - 1, used);
+        if (!used) {
+            n = mcc->ext_len[start - 1];
+            start -= n;
+            len += n;
+            sss_mc_ext_unlink(mcc, start);
+        }
+    }
+
+    if (start + len < tot_slots) {
+        MC_PROBE_BIT(mcc->free_table, start + len, used);
+        if (!used) {
+            n = mcc->ext_len[start + len];
+            sss_mc_ext_unlink(mcc, start + len);
+            len += n;
+        }
+    }
+
+    sss_mc_ext_link(mcc, start, len);
+}
+
+/* Takes num_slots from the smallest size class that can satisfy the
+ * request, so large extents are preserved for large records. The slots
+ * are marked as used in free_table. */
+static bool sss_mc_ext_alloc(struct sss_mc_ctx *mcc,
+                             uint32_t num_slots, uint32_t *_slot)
+{
+    uint32_t bin;
+    uint32_t cur = MC_INVALID_VAL;
+    uint32_t len;
+    uint32_t i;
+
+    for (bin = MC_EXT_BIN(num_slots); bin < MC_EXT_BINS; bin++) {
+        /* only the first bin can hold extents that are too small */
+        for (cur = mcc->ext_bins[bin];
+             cur != MC_INVALID_VAL && mcc->ext_len[cur] < num_slots;
+             cur = mcc->ext_next[cur]);
+        if (cur != MC_INVALID_VAL) {
+            break;
+        }
+    }
+    if (cur == MC_INVALID_VAL) {
+        return false;
+    }
+
+    len = mcc->ext_len[cur];
+    sss_mc_ext_unlink(mcc, cur);
+    if (len > num_slots) {
+        sss_mc_ext_link(mcc, cur + num_slots, len - num_slots);
+    }
+
+    for (i = 0; i < num_slots; i++) {
+        MC_SET_BIT(mcc->free_table, cur + i);
+    }
+
+    *_slot = cur;
+    return true;
+}
+
+/* Takes exactly the slots [start, start + num_slots), which must be free.
+ * The extent they are part of starts less than num_slots before start if
+ * the caller did not find a big enough extent with sss_mc_ext_alloc(). */
+static void sss_mc_ext_take(struct sss_mc_ctx *mcc,
+                            uint32_t start, uint32_t num_slots)
+{
+    uint32_t ext;
+    uint32_t len;
+    uint32_t i;
+    bool used;
+
+    for (ext = start; ext > 0; ext--) {
+        MC_PROBE_BIT(mcc->free_table, ext - 1, used);
+        if (used) {
+            break;
+        }
+    }
+
+    len = mcc->ext_len[ext];
+    sss_mc_ext_unlink(mcc, ext);
+    if (start > ext) {
+        sss_mc_ext_link(mcc, ext, start - ext);
+    }
+    if (ext + len > start + num_slots) {
+        sss_mc_ext_link(mcc, start + num_slots,
+                        ext + len - (start + num_slots));
+    }
+
+    for (i = 0; i < num_slots; i++) {
+        MC_SET_BIT(mcc->free_table, start + i);
+    }
+}
+
 static void sss_mc_free_slots(struct sss_mc_ctx *mcc, struct sss_mc_rec *rec)
 {
     uint32_t slot;
@@ -284,16 +512,26 @@ static void sss_mc_free_slots(struct sss_mc_ctx *mcc, struct sss_mc_rec *rec)
     for (i = 0; i < num; i++) {
         MC_CLEAR_BIT(mcc->free_table, slot + i);
     }
+
+    sss_mc_ext_release(mcc, slot, num);
 }
 
 static void sss_mc_invalidate_rec(struct sss_mc_ctx *mcc,
                                   struct sss_mc_rec *rec)
 {
+    uint32_t hash1;
+    uint32_t hash2;
+
     if (rec->b1 == MC_INVALID_VAL) {
         /* record already invalid */
         return;
     }
 
+    /* readers that reached the record before it was unlinked must notice */
+    hash1 = rec->hash1;
+    hash2 = rec->hash2;
+    sss_mc_rec_write_begin(mcc, hash1, hash2);
+
     /* Remove from hash chains */
     /* hash chain 1 */
     sss_mc_rm_rec_from_chain(mcc, rec, rec->hash1);
@@ -314,6 +552,8 @@ static void sss_mc_invalidate_rec(struct sss_mc_ctx *mcc,
     rec->hash1 = MC_INVALID_VAL32;
     rec->hash2 = MC_INVALID_VAL32;
     MC_LOWER_BARRIER(rec);
+
+    sss_mc_rec_write_end(mcc, hash1, hash2);
 }
 
 static bool sss_mc_is_valid_rec(struct sss_mc_ctx *mcc, struct sss_mc_rec *rec)
@@ -386,9 +626,35 @@ static const char *mc_type_to_str(enum sss_mc_type type)
     }
 }
 
-/* FIXME: This is a very simplistic, inefficient, memory allocator,
- * it will just free the oldest entries regardless of expiration if it
- * cycled the whole free bits map and found no empty slot */
+static void sss_mc_account_eviction(struct sss_mc_ctx *mcc, uint32_t slots)
+{
+    time_t now;
+
+    if (mcc->ft_size * 8 >= mcc->max_elems) {
+        /* can't grow anymore, nothing to account for */
+        return;
+    }
+
+    now = time(NULL);
+    if (now - mcc->evict_window > MC_GROW_WINDOW) {
+        mcc->evict_window = now;
+        mcc->evicted_slots = 0;
+    }
+
+    mcc->evicted_slots += slots;
+    if (mcc->evicted_slots > (mcc->ft_size * 8) / MC_GROW_EVICT_RATIO) {
+        DEBUG(SSSDBG_TRACE_FUNC,
+              "%u slots of mmap cache '%s' evicted in less than %d seconds, "
+              "the cache will be grown\n",
+              mcc->evicted_slots, mc_type_to_str(mcc->type), MC_GROW_WINDOW);
+        mcc->grow = true;
+    }
+}
+
+/* Finds num_slots consecutive free slots and marks them as used.
+ * Free runs are looked up in the size class bins first, only if there is
+ * no run big enough the oldest entries are freed regardless of their
+ * expiration, cycling through the whole table. */
 static errno_t sss_mc_find_free_slots(struct sss_mc_ctx *mcc,
                                       int num_slots, uint32_t *free_slot)
 {
@@ -396,58 +662,15 @@ static errno_t sss_mc_find_free_slots(struct sss_mc_ctx *mcc,
     uint32_t tot_slots;
     uint32_t cur;
     uint32_t i;
-    uint32_t t;
     bool used;
 
     tot_slots = mcc->ft_size * 8;
-
-    /* Try to find a free slot w/o removing anything first */
-    /* FIXME: Is it really worth it? Maybe it is easier to
-     * just recycle the next set of slots? */
-    if ((mcc->next_slot + num_slots) > tot_slots) {
-        cur = 0;
-    } else {
-        cur = mcc->next_slot;
+    if (num_slots > tot_slots) {
+        return ENOMEM;
     }
 
-    /* search for enough (num_slots) consecutive zero bits, indicating
-     * consecutive empty slots */
-    for (i = 0; i < mcc->ft_size; i++) {
-        t = cur / 8;
-        /* if all full in this byte skip directly to the next */
-        if (mcc->free_table[t] == 0xff) {
-            cur = ((cur + 8) & ~7);
-            if (cur >= tot_slots) {
-                cur = 0;
-            }
-            continue;
-        }
-
-        /* at least one bit in this byte is marked as empty */
-        for (t = ((cur + 8) & ~7) ; cur < t; cur++) {
-            MC_PROBE_BIT(mcc->free_table, cur, used);
-            if (!used) break;
-        }
-        /* check if we have enough slots before hitting the table end */
-        if ((cur + num_slots) > tot_slots) {
-            cur = 0;
-            continue;
-        }
-
-        /* check if we have at least num_slots empty starting from the first
-         * we found in the previous steps */
-        for (t = cur + num_slots; cur < t; cur++) {
-            MC_PROBE_BIT(mcc->free_table, cur, used);
-            if (used) break;
-        }
-        if (cur == t) {
-            /* ok found num_slots consecutive free bits */
-            *free_slot = cur - num_slots;
-            /* `mcc->next_slot` is not updated here intentionally.
-             * For details see discussion in https://github.com/SSSD/sssd/pull/999
-             */
-            return EOK;
-        }
+    if (sss_mc_ext_alloc(mcc, num_slots, free_slot)) {
+        return EOK;
     }
 
     /* no free slots found, free occupied slots after next_slot */
@@ -464,6 +687,8 @@ static errno_t sss_mc_find_free_slots(struct sss_mc_ctx *mcc,
                 "this message often then please consider increase of cache size",
                 mc_type_to_str(mcc->type));
     }
+
+evict:
     for (i = 0; i < num_slots; i++) {
         MC_PROBE_BIT(mcc->free_table, cur + i, used);
         if (used) {
@@ -471,6 +696,15 @@ static errno_t sss_mc_find_free_slots(struct sss_mc_ctx *mcc,
              * carefully check it is a valid header and hardfail if not */
             rec = MC_SLOT_TO_PTR(mcc->data_table, cur + i, struct sss_mc_rec);
             if (!sss_mc_is_valid_rec(mcc, rec)) {
+                if (i == 0 && cur != 0) {
+                    /* next_slot is always left on a record boundary, but
+                     * a record allocated later from the free extent
+                     * around it can cover it. Nothing was freed yet,
+                     * start over from the first slot which is always a
+                     * boundary. */
+                    cur = 0;
+                    goto evict;
+                }
                 /* this is a fatal error, the caller should probably just
                  * invalidate the whole cache */
                 return EFAULT;
@@ -483,8 +717,18 @@ static errno_t sss_mc_find_free_slots(struct sss_mc_ctx *mcc,
         }
     }
 
-    mcc->next_slot = cur + num_slots;
+    sss_mc_account_eviction(mcc, num_slots);
+    mcc->stats_evictions++;
+
+    /* the last freed record may end after the window, the next eviction
+     * starts after it rather than in its middle */
+    mcc->next_slot = cur + i;
+
+    /* the window is free now, take exactly that and not a fitting extent
+     * somewhere else which would leave the window unused */
+    sss_mc_ext_take(mcc, cur, num_slots);
     *free_slot = cur;
+
     return EOK;
 }
 
@@ -571,6 +815,12 @@ static struct sss_mc_rec *sss_mc_find_record(struct sss_mc_ctx *mcc,
         }
 
         rec = MC_SLOT_TO_PTR(mcc->data_table, slot, struct sss_mc_rec);
+        if (rec->flags & MC_REC_FLAGS_NEGATIVE) {
+            /* negative records are looked up by sss_mc_find_neg_record() */
+            slot = sss_mc_next_slot_with_hash(rec, hash);
+            continue;
+        }
+
         ret = sss_mc_get_strs_len(mcc, rec, &strs_len);
         if (ret != EOK) {
             return NULL;
@@ -612,6 +862,58 @@ static struct sss_mc_rec *sss_mc_find_record(struct sss_mc_ctx *mcc,
     return NULL;
 }
 
+static struct sss_mc_rec *sss_mc_find_neg_record(struct sss_mc_ctx *mcc,
+                                                 const struct sized_string *key,
+                                                 uint32_t flag)
+{
+    struct sss_mc_rec *rec;
+    struct sss_mc_neg_data *data;
+    uint32_t hash;
+    uint32_t slot;
+
+    hash = sss_mc_hash(mcc, key->str, key->len);
+
+    slot = mcc->hash_table[hash];
+    while (slot != MC_INVALID_VAL) {
+        if (!MC_SLOT_WITHIN_BOUNDS(slot, mcc->dt_size)) {
+            DEBUG(SSSDBG_FATAL_FAILURE,
+                  "Corrupted memcache. Slot number too big.\n");
+            sss_mc_save_corrupted(mcc);
+            sss_mmap_cache_reset(mcc);
+            return NULL;
+        }
+
+        rec = MC_SLOT_TO_PTR(mcc->data_table, slot, struct sss_mc_rec);
+        data = (struct sss_mc_neg_data *)rec->data;
+        /* the key is written by the responder itself and is always stored
+         * right behind the data header */
+        if ((rec->flags & flag) && data->key_len == key->len
+                && memcmp(key->str, data->key, key->len) == 0) {
+            return rec;
+        }
+
+        slot = sss_mc_next_slot_with_hash(rec, hash);
+    }
+
+    return NULL;
+}
+
+static errno_t sss_mmap_cache_grow(struct sss_mc_ctx **_mcc);
+
+/* The hit rate tells how often a record could be stored without evicting
+ * other ones, mostly interesting for the big initgroups records. */
+static void sss_mc_log_stats(struct sss_mc_ctx *mcc)
+{
+    DEBUG(SSSDBG_TRACE_FUNC,
+          "mmap cache '%s': %"PRIu64" stores, hit rate %"PRIu64"%%, "
+          "%"PRIu64" needed eviction, %"PRIu64" failed\n",
+          mc_type_to_str(mcc->type), mcc->stats_stores,
+          mcc->stats_hits * 100 / mcc->stats_stores,
+          mcc->stats_evictions, mcc->stats_failures);
+}
+
+/* Returns a record of rec_len bytes. If key is not NULL and the record
+ * stored under key has the same size it is returned to be overwritten. */
 static errno_t sss_mc_get_record(struct sss_mc_ctx **_mcc,
                                  size_t rec_len,
                                  const struct sized_string *key,
@@ -620,19 +922,41 @@ static errno_t sss_mc_get_record(struct sss_mc_ctx **_mcc,
     struct sss_mc_ctx *mcc = *_mcc;
     struct sss_mc_rec *old_rec = NULL;
     struct sss_mc_rec *rec;
+    uint64_t evictions;
     int old_slots;
     int num_slots;
     uint32_t base_slot;
     errno_t ret;
-    int i;
+
+    if (mcc->grow) {
+        ret = sss_mmap_cache_grow(_mcc);
+        if (ret != EOK) {
+            /* keep using the current file, records will just be evicted */
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Failed to grow mmap cache [%d]: %s\n",
+                  ret, sss_strerror(ret));
+        }
+        mcc = *_mcc;
+        if (mcc == NULL) {
+            return EINVAL;
+        }
+    }
 
     num_slots = MC_SIZE_TO_SLOTS(rec_len);
 
-    old_rec = sss_mc_find_record(mcc, key);
+    mcc->stats_stores++;
+    if (mcc->stats_stores % MC_STATS_INTERVAL == 0) {
+        sss_mc_log_stats(mcc);
+    }
+
+    if (key != NULL) {
+        old_rec = sss_mc_find_record(mcc, key);
+    }
     if (old_rec) {
         old_slots = MC_SIZE_TO_SLOTS(old_rec->len);
 
         if (old_slots == num_slots) {
+            mcc->stats_hits++;
             *_rec = old_rec;
             return EOK;
         }
@@ -643,8 +967,10 @@ static errno_t sss_mc_get_record(struct sss_mc_ctx **_mcc,
     }
 
     /* we are going to use more space, find enough free slots */
+    evictions = mcc->stats_evictions;
     ret = sss_mc_find_free_slots(mcc, num_slots, &base_slot);
     if (ret != EOK) {
+        mcc->stats_failures++;
         if (ret == EFAULT) {
             DEBUG(SSSDBG_CRIT_FAILURE,
                   "Fatal internal mmap cache error, invalidating cache!\n");
@@ -653,6 +979,13 @@ static errno_t sss_mc_get_record(struct sss_mc_ctx **_mcc,
         return ret;
     }
 
+    /* Counted here rather than in sss_mc_find_free_slots() so that the
+     * slots taken while migrating to a grown cache are not counted as
+     * hits without a matching store. */
+    if (mcc->stats_evictions == evictions) {
+        mcc->stats_hits++;
+    }
+
     rec = MC_SLOT_TO_PTR(mcc->data_table, base_slot, struct sss_mc_rec);
 
     /* mark as not valid yet */
@@ -660,14 +993,9 @@ static errno_t sss_mc_get_record(struct sss_mc_ctx **_mcc,
     rec->len = rec_len;
     rec->next1 = MC_INVALID_VAL;
     rec->next2 = MC_INVALID_VAL;
-    rec->padding = MC_INVALID_VAL;
+    rec->flags = 0;
     MC_LOWER_BARRIER(rec);
 
-    /* and now mark slots as used */
-    for (i = 0; i < num_slots; i++) {
-        MC_SET_BIT(mcc->free_table, base_slot + i);
-    }
-
     *_rec = rec;
     return EOK;
 }
@@ -682,15 +1010,18 @@ static inline void sss_mmap_set_rec_header(struct sss_mc_ctx *mcc,
     rec->expire = time(NULL) + ttl;
     rec->hash1 = sss_mc_hash(mcc, key1, key1_len);
     rec->hash2 = sss_mc_hash(mcc, key2, key2_len);
+    rec->flags = 0;
 }
 
 static inline void sss_mmap_chain_in_rec(struct sss_mc_ctx *mcc,
                                          struct sss_mc_rec *rec)
 {
+    sss_mc_rec_write_begin(mcc, rec->hash1, rec->hash2);
     /* name first */
     sss_mc_add_rec_to_chain(mcc, rec, rec->hash1);
     /* then uid/gid */
     sss_mc_add_rec_to_chain(mcc, rec, rec->hash2);
+    sss_mc_rec_write_end(mcc, rec->hash1, rec->hash2);
 }
 
 /***************************************************************************
@@ -724,6 +1055,25 @@ static errno_t sss_mmap_cache_invalidate(struct sss_mc_ctx **_mcc,
     return EOK;
 }
 
+/* An entry that is about to be stored must not be shadowed by negative
+ * records left over from the time it did not exist. */
+static void sss_mc_drop_negative(struct sss_mc_ctx *mcc,
+                                 const struct sized_string *name,
+                                 const struct sized_string *idkey)
+{
+    struct sss_mc_rec *rec;
+
+    rec = sss_mc_find_neg_record(mcc, name, MC_REC_FLAG_NEG_NAME);
+    if (rec != NULL) {
+        sss_mc_invalidate_rec(mcc, rec);
+    }
+
+    rec = sss_mc_find_neg_record(mcc, idkey, MC_REC_FLAG_NEG_ID);
+    if (rec != NULL) {
+        sss_mc_invalidate_rec(mcc, rec);
+    }
+}
+
 static errno_t sss_mmap_cache_validate_or_reinit(struct sss_mc_ctx **_mcc)
 {
     struct sss_mc_ctx *mcc = *_mcc;
@@ -791,6 +1141,8 @@ errno_t sss_mmap_cache_pw_store(struct sss_mc_ctx **_mcc,
     struct sss_mc_rec *rec;
     struct sss_mc_pwd_data *data;
     struct sized_string uidkey;
+    uint32_t old_hash1;
+    uint32_t old_hash2;
     char uidstr[11];
     size_t data_len;
     size_t rec_len;
@@ -818,14 +1170,23 @@ errno_t sss_mmap_cache_pw_store(struct sss_mc_ctx **_mcc,
         return ENOMEM;
     }
 
+    sss_mc_drop_negative(mcc, name, &uidkey);
+
     ret = sss_mc_get_record(_mcc, rec_len, name, &rec);
     if (ret != EOK) {
         return ret;
     }
 
+    /* the cache may have been grown */
+    mcc = *_mcc;
+
     data = (struct sss_mc_pwd_data *)rec->data;
     pos = 0;
 
+    /* the record may be a reused one still linked in its old chains */
+    old_hash1 = rec->hash1;
+    old_hash2 = rec->hash2;
+    sss_mc_rec_write_begin(mcc, old_hash1, old_hash2);
     MC_RAISE_BARRIER(rec);
 
     /* header */
@@ -848,6 +1209,7 @@ errno_t sss_mmap_cache_pw_store(struct sss_mc_ctx **_mcc,
     memcpy(&data->strs[pos], shell->str, shell->len);
 
     MC_LOWER_BARRIER(rec);
+    sss_mc_rec_write_end(mcc, old_hash1, old_hash2);
 
     /* finally chain the rec in the hash table */
     sss_mmap_chain_in_rec(mcc, rec);
@@ -903,7 +1265,7 @@ errno_t sss_mmap_cache_pw_invalidate_uid(struct sss_mc_ctx **_mcc, uid_t uid)
         rec = MC_SLOT_TO_PTR(mcc->data_table, slot, struct sss_mc_rec);
         data = (struct sss_mc_pwd_data *)(&rec->data);
 
-        if (uid == data->uid) {
+        if (!(rec->flags & MC_REC_FLAGS_NEGATIVE) && uid == data->uid) {
             break;
         }
 
@@ -938,6 +1300,8 @@ int sss_mmap_cache_gr_store(struct sss_mc_ctx **_mcc,
     struct sss_mc_rec *rec;
     struct sss_mc_grp_data *data;
     struct sized_string gidkey;
+    uint32_t old_hash1;
+    uint32_t old_hash2;
     char gidstr[11];
     size_t data_len;
     size_t rec_len;
@@ -965,14 +1329,23 @@ int sss_mmap_cache_gr_store(struct sss_mc_ctx **_mcc,
         return ENOMEM;
     }
 
+    sss_mc_drop_negative(mcc, name, &gidkey);
+
     ret = sss_mc_get_record(_mcc, rec_len, name, &rec);
     if (ret != EOK) {
         return ret;
     }
 
+    /* the cache may have been grown */
+    mcc = *_mcc;
+
     data = (struct sss_mc_grp_data *)rec->data;
     pos = 0;
 
+    /* the record may be a reused one still linked in its old chains */
+    old_hash1 = rec->hash1;
+    old_hash2 = rec->hash2;
+    sss_mc_rec_write_begin(mcc, old_hash1, old_hash2);
     MC_RAISE_BARRIER(rec);
 
     /* header */
@@ -991,6 +1364,7 @@ int sss_mmap_cache_gr_store(struct sss_mc_ctx **_mcc,
     memcpy(&data->strs[pos], membuf, memsize);
 
     MC_LOWER_BARRIER(rec);
+    sss_mc_rec_write_end(mcc, old_hash1, old_hash2);
 
     /* finally chain the rec in the hash table */
     sss_mmap_chain_in_rec(mcc, rec);
@@ -1046,7 +1420,7 @@ errno_t sss_mmap_cache_gr_invalidate_gid(struct sss_mc_ctx **_mcc, gid_t gid)
         rec = MC_SLOT_TO_PTR(mcc->data_table, slot, struct sss_mc_rec);
         data = (struct sss_mc_grp_data *)(&rec->data);
 
-        if (gid == data->gid) {
+        if (!(rec->flags & MC_REC_FLAGS_NEGATIVE) && gid == data->gid) {
             break;
         }
 
@@ -1076,6 +1450,8 @@ errno_t sss_mmap_cache_initgr_store(struct sss_mc_ctx **_mcc,
     struct sss_mc_ctx *mcc;
     struct sss_mc_rec *rec;
     struct sss_mc_initgr_data *data;
+    uint32_t old_hash1;
+    uint32_t old_hash2;
     size_t data_len;
     size_t rec_len;
     size_t pos;
@@ -1102,9 +1478,16 @@ errno_t sss_mmap_cache_initgr_store(struct sss_mc_ctx **_mcc,
         return ret;
     }
 
+    /* the cache may have been grown */
+    mcc = *_mcc;
+
     data = (struct sss_mc_initgr_data *)rec->data;
     pos = 0;
 
+    /* the record may be a reused one still linked in its old chains */
+    old_hash1 = rec->hash1;
+    old_hash2 = rec->hash2;
+    sss_mc_rec_write_begin(mcc, old_hash1, old_hash2);
     MC_RAISE_BARRIER(rec);
 
     sss_mmap_set_rec_header(mcc, rec, rec_len, mcc->valid_time_slot,
@@ -1126,6 +1509,7 @@ errno_t sss_mmap_cache_initgr_store(struct sss_mc_ctx **_mcc,
     data->name = MC_PTR_DIFF((char *)data->gids + pos, data);
 
     MC_LOWER_BARRIER(rec);
+    sss_mc_rec_write_end(mcc, old_hash1, old_hash2);
 
     /* finally chain the rec in the hash table */
     sss_mmap_chain_in_rec(mcc, rec);
@@ -1139,6 +1523,21 @@ errno_t sss_mmap_cache_initgr_invalidate(struct sss_mc_ctx **_mcc,
     return sss_mmap_cache_invalidate(_mcc, name);
 }
 
+static errno_t sss_mc_sid_idkey(uint32_t type, uint32_t id,
+                                char *idkey, size_t idkey_size)
+{
+    int ret;
+
+    ret = snprintf(idkey, idkey_size, "%d-%ld",
+                   (type == SSS_ID_TYPE_GID) ? SSS_ID_TYPE_GID : SSS_ID_TYPE_UID,
+                   (long)id);
+    if (ret < 0 || ret > (idkey_size - 1)) {
+        return EINVAL;
+    }
+
+    return EOK;
+}
+
 errno_t sss_mmap_cache_sid_store(struct sss_mc_ctx **_mcc,
                                  const struct sized_string *sid,
                                  uint32_t id,
@@ -1148,6 +1547,8 @@ errno_t sss_mmap_cache_sid_store(struct sss_mc_ctx **_mcc,
     struct sss_mc_ctx *mcc;
     struct sss_mc_rec *rec;
     struct sss_mc_sid_data *data;
+    uint32_t old_hash1;
+    uint32_t old_hash2;
     char idkey[16];
     size_t rec_len;
     int ret;
@@ -1159,11 +1560,9 @@ errno_t sss_mmap_cache_sid_store(struct sss_mc_ctx **_mcc,
 
     mcc = *_mcc;
 
-    ret = snprintf(idkey, sizeof(idkey), "%d-%ld",
-                   (type == SSS_ID_TYPE_GID) ? SSS_ID_TYPE_GID : SSS_ID_TYPE_UID,
-                   (long)id);
-    if (ret > (sizeof(idkey) - 1)) {
-        return EINVAL;
+    ret = sss_mc_sid_idkey(type, id, idkey, sizeof(idkey));
+    if (ret != EOK) {
+        return ret;
     }
 
     rec_len = sizeof(struct sss_mc_rec) +
@@ -1175,7 +1574,14 @@ errno_t sss_mmap_cache_sid_store(struct sss_mc_ctx **_mcc,
         return ret;
     }
 
+    /* the cache may have been grown */
+    mcc = *_mcc;
+
     data = (struct sss_mc_sid_data *)rec->data;
+    /* the record may be a reused one still linked in its old chains */
+    old_hash1 = rec->hash1;
+    old_hash2 = rec->hash2;
+    sss_mc_rec_write_begin(mcc, old_hash1, old_hash2);
     MC_RAISE_BARRIER(rec);
 
     sss_mmap_set_rec_header(mcc, rec, rec_len, mcc->valid_time_slot,
@@ -1189,11 +1595,139 @@ errno_t sss_mmap_cache_sid_store(struct sss_mc_ctx **_mcc,
     memcpy(data->sid, sid->str, sid->len);
 
     MC_LOWER_BARRIER(rec);
+    sss_mc_rec_write_end(mcc, old_hash1, old_hash2);
+
     sss_mmap_chain_in_rec(mcc, rec);
 
     return EOK;
 }
 
+/***************************************************************************
+ * negative records
+ ***************************************************************************/
+
+errno_t sss_mmap_cache_neg_store(struct sss_mc_ctx **_mcc,
+                                 const struct sized_string *key,
+                                 bool is_id, time_t ttl)
+{
+    struct sss_mc_ctx *mcc;
+    struct sss_mc_rec *rec;
+    struct sss_mc_neg_data *data;
+    uint32_t old_hash1;
+    uint32_t old_hash2;
+    uint32_t flag;
+    size_t rec_len;
+    int ret;
+
+    ret = sss_mmap_cache_validate_or_reinit(_mcc);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    mcc = *_mcc;
+
+    if (mcc->type != SSS_MC_PASSWD && mcc->type != SSS_MC_GROUP) {
+        return EINVAL;
+    }
+
+    flag = is_id ? MC_REC_FLAG_NEG_ID : MC_REC_FLAG_NEG_NAME;
+
+    /* a negative entry must never outlive a positive one */
+    if (ttl <= 0 || ttl > mcc->valid_time_slot) {
+        ttl = mcc->valid_time_slot;
+    }
+
+    rec_len = sizeof(struct sss_mc_rec) +
+              sizeof(struct sss_mc_neg_data) +
+              key->len;
+    if (rec_len > mcc->dt_size) {
+        return ENOMEM;
+    }
+
+    rec = sss_mc_find_neg_record(mcc, key, flag);
+    if (rec != NULL) {
+        sss_mc_invalidate_rec(mcc, rec);
+    }
+
+    ret = sss_mc_get_record(_mcc, rec_len, NULL, &rec);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    /* the cache may have been grown */
+    mcc = *_mcc;
+
+    data = (struct sss_mc_neg_data *)rec->data;
+    old_hash1 = rec->hash1;
+    old_hash2 = rec->hash2;
+    sss_mc_rec_write_begin(mcc, old_hash1, old_hash2);
+    MC_RAISE_BARRIER(rec);
+
+    /* both hashes point to the same chain */
+    sss_mmap_set_rec_header(mcc, rec, rec_len, ttl,
+                            key->str, key->len, key->str, key->len);
+    rec->flags = flag;
+
+    data->name = MC_PTR_DIFF(data->key, data);
+    data->key_len = key->len;
+    memcpy(data->key, key->str, key->len);
+
+    MC_LOWER_BARRIER(rec);
+    sss_mc_rec_write_end(mcc, old_hash1, old_hash2);
+
+    sss_mmap_chain_in_rec(mcc, rec);
+
+    return EOK;
+}
+
+errno_t sss_mmap_cache_neg_purge(struct sss_mc_ctx **_mcc)
+{
+    struct sss_mc_ctx *mcc;
+    struct sss_mc_rec *rec;
+    uint32_t tot_slots;
+    uint32_t num_slots;
+    uint32_t slot;
+    size_t purged = 0;
+    bool used;
+    errno_t ret;
+
+    ret = sss_mmap_cache_validate_or_reinit(_mcc);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    mcc = *_mcc;
+    tot_slots = mcc->ft_size * 8;
+
+    for (slot = 0; slot < tot_slots; slot += num_slots) {
+        num_slots = 1;
+
+        MC_PROBE_BIT(mcc->free_table, slot, used);
+        if (!used) {
+            continue;
+        }
+
+        rec = MC_SLOT_TO_PTR(mcc->data_table, slot, struct sss_mc_rec);
+        if (!MC_VALID_BARRIER(rec->b1) || rec->b1 != rec->b2
+                || !MC_CHECK_RECORD_LENGTH(mcc, rec)) {
+            /* not a record header, skip the slot */
+            continue;
+        }
+        num_slots = MC_SIZE_TO_SLOTS(rec->len);
+
+        if (rec->flags & MC_REC_FLAGS_NEGATIVE) {
+            sss_mc_invalidate_rec(mcc, rec);
+            purged++;
+        }
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC,
+          "Purged %zu negative records of mmap cache '%s'\n",
+          purged, mc_type_to_str(mcc->type));
+
+    return EOK;
+}
+
 /***************************************************************************
  * initialization
  ***************************************************************************/
@@ -1330,7 +1864,7 @@ static void sss_mc_header_update(struct sss_mc_ctx *mc_ctx, int status)
         h->major_vno = SSS_MC_MAJOR_VNO;
         h->minor_vno = SSS_MC_MINOR_VNO;
         h->seed = mc_ctx->seed;
-        h->reserved = 0;
+        h->seq_table = MC_PTR_DIFF(mc_ctx->seq_table, mc_ctx->mmap_base);
     }
     h->status = status;
     MC_LOWER_BARRIER(h);
@@ -1370,6 +1904,7 @@ static int mc_ctx_destructor(struct sss_mc_ctx *mc_ctx)
 
 errno_t sss_mmap_cache_init(TALLOC_CTX *mem_ctx, const char *name,
                             enum sss_mc_type type, size_t n_elem,
+                            size_t max_elems,
                             time_t timeout, struct sss_mc_ctx **mcc)
 {
     /* sss_mc_rec alone occupies whole slot,
@@ -1427,6 +1962,8 @@ errno_t sss_mmap_cache_init(TALLOC_CTX *mem_ctx, const char *name,
     /* We can use MC_ALIGN64 for this */
     n_elem = MC_ALIGN64(n_elem);
 
+    mc_ctx->max_elems = MAX(max_elems, n_elem);
+
     /* hash table is double the size because it will store both forward and
      * reverse keys (name/uid, name/gid, ..) */
     mc_ctx->ht_size = MC_HT_SIZE(2 * n_elem / PAYLOAD_FACTOR);
@@ -1435,7 +1972,8 @@ errno_t sss_mmap_cache_init(TALLOC_CTX *mem_ctx, const char *name,
     mc_ctx->mmap_size = MC_HEADER_SIZE +
                         MC_ALIGN64(mc_ctx->dt_size) +
                         MC_ALIGN64(mc_ctx->ft_size) +
-                        MC_ALIGN64(mc_ctx->ht_size);
+                        MC_ALIGN64(mc_ctx->ht_size) +
+                        MC_ALIGN64(mc_ctx->ht_size); /* seq_table */
 
 
     ret = sss_mc_create_file(mc_ctx);
@@ -1482,10 +2020,23 @@ errno_t sss_mmap_cache_init(TALLOC_CTX *mem_ctx, const char *name,
                                     MC_ALIGN64(mc_ctx->dt_size));
     mc_ctx->hash_table = MC_PTR_ADD(mc_ctx->free_table,
                                     MC_ALIGN64(mc_ctx->ft_size));
+    mc_ctx->seq_table = MC_PTR_ADD(mc_ctx->hash_table,
+                                   MC_ALIGN64(mc_ctx->ht_size));
 
     memset(mc_ctx->data_table, 0xff, mc_ctx->dt_size);
     memset(mc_ctx->free_table, 0x00, mc_ctx->ft_size);
     memset(mc_ctx->hash_table, 0xff, mc_ctx->ht_size);
+    memset(mc_ctx->seq_table, 0x00, mc_ctx->ht_size);
+
+    mc_ctx->ext_len = talloc_array(mc_ctx, uint32_t, n_elem);
+    mc_ctx->ext_next = talloc_array(mc_ctx, uint32_t, n_elem);
+    mc_ctx->ext_prev = talloc_array(mc_ctx, uint32_t, n_elem);
+    if (mc_ctx->ext_len == NULL || mc_ctx->ext_next == NULL
+            || mc_ctx->ext_prev == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+    sss_mc_ext_reset(mc_ctx);
 
     /* generate a pseudo-random seed.
      * Needed to fend off dictionary based collision attacks */
@@ -1527,6 +2078,7 @@ errno_t sss_mmap_cache_reinit(TALLOC_CTX *mem_ctx,
     TALLOC_CTX* tmp_ctx = NULL;
     char *name;
     enum sss_mc_type type;
+    size_t max_elems;
 
     if (mc_ctx == NULL || (*mc_ctx) == NULL) {
         DEBUG(SSSDBG_CRIT_FAILURE,
@@ -1548,6 +2100,7 @@ errno_t sss_mmap_cache_reinit(TALLOC_CTX *mem_ctx,
     }
 
     type = (*mc_ctx)->type;
+    max_elems = (*mc_ctx)->max_elems;
 
     if (n_elem == (size_t)-1) {
         n_elem = (*mc_ctx)->ft_size * 8;
@@ -1566,6 +2119,7 @@ errno_t sss_mmap_cache_reinit(TALLOC_CTX *mem_ctx,
                               name,
                               type,
                               n_elem,
+                              max_elems,
                               timeout,
                               mc_ctx);
     if (ret != EOK) {
@@ -1578,10 +2132,182 @@ done:
     return ret;
 }
 
+/* Computes the two hash table keys of a record already stored in the
+ * cache, so that it can be chained into a table with a different seed
+ * and size. */
+static errno_t sss_mc_rec_keys(struct sss_mc_ctx *mcc,
+                               struct sss_mc_rec *rec,
+                               char *idbuf, size_t idbuf_size,
+                               struct sized_string *key1,
+                               struct sized_string *key2)
+{
+    struct sss_mc_pwd_data *pwd;
+    struct sss_mc_grp_data *grp;
+    struct sss_mc_initgr_data *initgr;
+    struct sss_mc_sid_data *sid;
+    struct sss_mc_neg_data *neg;
+    errno_t ret;
+    int len;
+
+    if (rec->flags & MC_REC_FLAGS_NEGATIVE) {
+        neg = (struct sss_mc_neg_data *)rec->data;
+        to_sized_string(key1, (char *)neg + neg->name);
+        *key2 = *key1;
+        return EOK;
+    }
+
+    switch (mcc->type) {
+    case SSS_MC_PASSWD:
+        pwd = (struct sss_mc_pwd_data *)rec->data;
+        to_sized_string(key1, (char *)pwd + pwd->name);
+        len = snprintf(idbuf, idbuf_size, "%ld", (long)pwd->uid);
+        break;
+    case SSS_MC_GROUP:
+        grp = (struct sss_mc_grp_data *)rec->data;
+        to_sized_string(key1, (char *)grp + grp->name);
+        len = snprintf(idbuf, idbuf_size, "%ld", (long)grp->gid);
+        break;
+    case SSS_MC_INITGROUPS:
+        initgr = (struct sss_mc_initgr_data *)rec->data;
+        to_sized_string(key1, (char *)initgr + initgr->name);
+        to_sized_string(key2, (char *)initgr + initgr->unique_name);
+        return EOK;
+    case SSS_MC_SID:
+        sid = (struct sss_mc_sid_data *)rec->data;
+        to_sized_string(key1, (char *)sid + sid->name);
+        ret = sss_mc_sid_idkey(sid->type, sid->id, idbuf, idbuf_size);
+        if (ret != EOK) {
+            return ret;
+        }
+        to_sized_string(key2, idbuf);
+        return EOK;
+    default:
+        return EINVAL;
+    }
+
+    if (len < 0 || len > (idbuf_size - 1)) {
+        return EINVAL;
+    }
+    to_sized_string(key2, idbuf);
+
+    return EOK;
+}
+
+/* Copies all live records from the old cache to the new, bigger one. */
+static void sss_mc_migrate(struct sss_mc_ctx *old_mcc,
+                           struct sss_mc_ctx *new_mcc)
+{
+    struct sss_mc_rec *rec;
+    struct sss_mc_rec *new_rec;
+    struct sized_string key1;
+    struct sized_string key2;
+    char idbuf[16];
+    uint32_t tot_slots;
+    uint32_t num_slots;
+    uint32_t new_slot;
+    uint32_t slot;
+    time_t now;
+    size_t migrated = 0;
+    bool used;
+    errno_t ret;
+
+    now = time(NULL);
+    tot_slots = old_mcc->ft_size * 8;
+
+    for (slot = 0; slot < tot_slots; slot += num_slots) {
+        num_slots = 1;
+
+        MC_PROBE_BIT(old_mcc->free_table, slot, used);
+        if (!used) {
+            continue;
+        }
+
+        rec = MC_SLOT_TO_PTR(old_mcc->data_table, slot, struct sss_mc_rec);
+        if (!MC_VALID_BARRIER(rec->b1) || rec->b1 != rec->b2
+                || !MC_CHECK_RECORD_LENGTH(old_mcc, rec)) {
+            /* not a record header, skip the slot */
+            continue;
+        }
+        num_slots = MC_SIZE_TO_SLOTS(rec->len);
+
+        if (rec->expire == MC_INVALID_VAL64 || rec->expire < now) {
+            continue;
+        }
+
+        ret = sss_mc_rec_keys(old_mcc, rec, idbuf, sizeof(idbuf),
+                              &key1, &key2);
+        if (ret != EOK) {
+            continue;
+        }
+
+        /* the new table is bigger and empty so nothing gets evicted */
+        ret = sss_mc_find_free_slots(new_mcc, num_slots, &new_slot);
+        if (ret != EOK) {
+            break;
+        }
+
+        new_rec = MC_SLOT_TO_PTR(new_mcc->data_table, new_slot,
+                                 struct sss_mc_rec);
+        memcpy(new_rec, rec, rec->len);
+        new_rec->next1 = MC_INVALID_VAL;
+        new_rec->next2 = MC_INVALID_VAL;
+        new_rec->hash1 = sss_mc_hash(new_mcc, key1.str, key1.len);
+        new_rec->hash2 = sss_mc_hash(new_mcc, key2.str, key2.len);
+
+        sss_mmap_chain_in_rec(new_mcc, new_rec);
+        migrated++;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Migrated %zu records of mmap cache '%s'\n",
+          migrated, mc_type_to_str(new_mcc->type));
+}
+
+/* Replaces the cache with a twice as big one that keeps all current
+ * records. The old file is marked as recycled by sss_mmap_cache_init()
+ * so clients will remap the new one on their next lookup. */
+static errno_t sss_mmap_cache_grow(struct sss_mc_ctx **_mcc)
+{
+    struct sss_mc_ctx *old_mcc = *_mcc;
+    struct sss_mc_ctx *new_mcc = NULL;
+    size_t n_elem;
+    errno_t ret;
+
+    old_mcc->grow = false;
+    old_mcc->evicted_slots = 0;
+
+    n_elem = MIN(old_mcc->ft_size * 8 * 2, old_mcc->max_elems);
+    if (n_elem <= old_mcc->ft_size * 8) {
+        return EOK;
+    }
+
+    ret = sss_mmap_cache_init(talloc_parent(old_mcc), old_mcc->name,
+                              old_mcc->type, n_elem, old_mcc->max_elems,
+                              old_mcc->valid_time_slot, &new_mcc);
+    if (ret != EOK) {
+        /* the old file was already recycled, start over from scratch */
+        (void)sss_mmap_cache_reinit(talloc_parent(old_mcc), -1, -1, _mcc);
+        return ret;
+    }
+
+    sss_mc_migrate(old_mcc, new_mcc);
+
+    DEBUG(SSSDBG_IMPORTANT_INFO,
+          "Fast '%s' mmap cache grown from %u to %u slots\n",
+          mc_type_to_str(new_mcc->type),
+          old_mcc->ft_size * 8, new_mcc->ft_size * 8);
+
+    talloc_free(old_mcc);
+    *_mcc = new_mcc;
+
+    return EOK;
+}
+
 /* Erase all contents of the mmap cache. This will bring the cache
  * to the same state as if it was just initialized. */
 void sss_mmap_cache_reset(struct sss_mc_ctx *mc_ctx)
 {
+    uint32_t i;
+
     if (mc_ctx == NULL) {
         DEBUG(SSSDBG_TRACE_FUNC,
               "Fastcache not initialized. Nothing to do.\n");
@@ -1590,10 +2316,22 @@ void sss_mmap_cache_reset(struct sss_mc_ctx *mc_ctx)
 
     sss_mc_header_update(mc_ctx, SSS_MC_HEADER_UNINIT);
 
+    /* Every chain is about to change, readers in the middle of a walk
+     * must retry. The counters are kept, not zeroed, so that a snapshot
+     * taken before the reset can never match again. */
+    for (i = 0; i < MC_HT_ELEMS(mc_ctx->ht_size); i++) {
+        MC_SEQ_WRITE_BEGIN(mc_ctx, i);
+    }
+
     /* Reset the mmapped area */
     memset(mc_ctx->data_table, 0xff, mc_ctx->dt_size);
     memset(mc_ctx->free_table, 0x00, mc_ctx->ft_size);
     memset(mc_ctx->hash_table, 0xff, mc_ctx->ht_size);
+    sss_mc_ext_reset(mc_ctx);
+
+    for (i = 0; i < MC_HT_ELEMS(mc_ctx->ht_size); i++) {
+        MC_SEQ_WRITE_END(mc_ctx, i);
+    }
 
     sss_mc_header_update(mc_ctx, SSS_MC_HEADER_ALIVE);
 }
@@ -32,8 +32,11 @@ enum sss_mc_type {
     SSS_MC_SID,
 };
 
+/* The cache starts with n_elem slots and is grown online, up to max_elems
+ * slots, when records keep being evicted to make room for new ones. */
 errno_t sss_mmap_cache_init(TALLOC_CTX *mem_ctx, const char *name,
                             enum sss_mc_type type, size_t n_elem,
+                            size_t max_elems,
                             time_t valid_time, struct sss_mc_ctx **mcc);
 
 errno_t sss_mmap_cache_pw_store(struct sss_mc_ctx **_mcc,
@@ -75,6 +78,16 @@ errno_t sss_mmap_cache_gr_invalidate_gid(struct sss_mc_ctx **_mcc, gid_t gid);
 errno_t sss_mmap_cache_initgr_invalidate(struct sss_mc_ctx **_mcc,
                                          const struct sized_string *name);
 
+/* Negative records tell clients that key (a name, or an id if is_id is
+ * set) was not found, they expire after ttl seconds but never later than
+ * positive records. Storing a positive record drops the matching negative
+ * ones. Only the passwd and group caches support them. */
+errno_t sss_mmap_cache_neg_store(struct sss_mc_ctx **_mcc,
+                                 const struct sized_string *key,
+                                 bool is_id, time_t ttl);
+
+errno_t sss_mmap_cache_neg_purge(struct sss_mc_ctx **_mcc);
+
 errno_t sss_mmap_cache_reinit(TALLOC_CTX *mem_ctx,
                               size_t n_elem,
                               time_t timeout, struct sss_mc_ctx **mc_ctx);
@@ -32,6 +32,7 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -184,6 +185,8 @@ static enum sss_status sss_cli_send_req(enum sss_cli_command cmd,
 
     while (datasent < header[0]) {
         struct pollfd pfd;
+        struct msghdr msg;
+        struct iovec iov[2];
         size_t rdsent;
         int res, error;
         ssize_t sent;
@@ -230,19 +233,28 @@ static enum sss_status sss_cli_send_req(enum sss_cli_command cmd,
             return SSS_STATUS_UNAVAIL;
         }
 
-        errno = 0;
+        /* Send header and data with a single call so a request on a
+         * persistent connection costs one syscall and one segment */
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 0;
+
+        rdsent = 0;
         if (datasent < SSS_NSS_HEADER_SIZE) {
-            sent = send(sss_cli_sd_get(),
-                        (char *)header + datasent,
-                        SSS_NSS_HEADER_SIZE - datasent,
-                        SSS_DEFAULT_WRITE_FLAGS);
+            iov[msg.msg_iovlen].iov_base = (char *)header + datasent;
+            iov[msg.msg_iovlen].iov_len = SSS_NSS_HEADER_SIZE - datasent;
+            msg.msg_iovlen++;
         } else {
             rdsent = datasent - SSS_NSS_HEADER_SIZE;
-            sent = send(sss_cli_sd_get(),
-                        (const char *)rd->data + rdsent,
-                        rd->len - rdsent,
-                        SSS_DEFAULT_WRITE_FLAGS);
         }
+        if (rd != NULL && rd->len > rdsent) {
+            iov[msg.msg_iovlen].iov_base = (char *)(uintptr_t)rd->data + rdsent;
+            iov[msg.msg_iovlen].iov_len = rd->len - rdsent;
+            msg.msg_iovlen++;
+        }
+
+        errno = 0;
+        sent = sendmsg(sss_cli_sd_get(), &msg, SSS_DEFAULT_WRITE_FLAGS);
         error = errno;
 
         if (sent <= 0) {
@@ -385,8 +397,11 @@ static enum sss_status sss_cli_recv_rep(enum sss_cli_command cmd,
              * allocated and the header has just
              * been read, do checks and proceed */
             if (header[2] != 0) {
-                /* server side error */
-                sss_cli_close_socket();
+                /* server side error, an error reply without data leaves
+                 * the stream in sync so the connection can be reused */
+                if (header[0] != SSS_NSS_HEADER_SIZE) {
+                    sss_cli_close_socket();
+                }
                 *errnop = header[2];
                 if (*errnop == EAGAIN) {
                     ret = SSS_STATUS_TRYAGAIN;
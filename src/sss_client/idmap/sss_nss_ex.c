@@ -57,7 +57,7 @@ struct nss_input {
     } result;
 };
 
-static errno_t sss_nss_mc_get(struct nss_input *inp)
+static errno_t sss_nss_mc_get(struct nss_input *inp, uint32_t flags)
 {
     switch(inp->cmd) {
     case SSS_NSS_GETPWNAM:
@@ -76,6 +76,13 @@ static errno_t sss_nss_mc_get(struct nss_input *inp)
         break;
     case SSS_NSS_GETGRNAM:
     case SSS_NSS_GETGRNAM_EX:
+        if ((flags & SSS_NSS_EX_FLAG_NO_MEMBERS) != 0) {
+            return sss_nss_mc_getgrnam_no_members(inp->input.name,
+                                                  strlen(inp->input.name),
+                                                  inp->result.grrep.result,
+                                                  inp->result.grrep.buffer,
+                                                  inp->result.grrep.buflen);
+        }
         return sss_nss_mc_getgrnam(inp->input.name, strlen(inp->input.name),
                                    inp->result.grrep.result,
                                    inp->result.grrep.buffer,
@@ -83,6 +90,12 @@ static errno_t sss_nss_mc_get(struct nss_input *inp)
         break;
     case SSS_NSS_GETGRGID:
     case SSS_NSS_GETGRGID_EX:
+        if ((flags & SSS_NSS_EX_FLAG_NO_MEMBERS) != 0) {
+            return sss_nss_mc_getgrgid_no_members(inp->input.gid,
+                                                  inp->result.grrep.result,
+                                                  inp->result.grrep.buffer,
+                                                  inp->result.grrep.buflen);
+        }
         return sss_nss_mc_getgrgid(inp->input.gid,
                                    inp->result.grrep.result,
                                    inp->result.grrep.buffer,
@@ -188,7 +201,7 @@ static int sss_get_ex(struct nss_input *inp, uint32_t flags,
     }
 
     if (!skip_mc && !skip_data) {
-        ret = sss_nss_mc_get(inp);
+        ret = sss_nss_mc_get(inp, flags);
         switch (ret) {
         case 0:
             return 0;
@@ -212,7 +225,7 @@ static int sss_get_ex(struct nss_input *inp, uint32_t flags,
 
     if (!skip_mc && !skip_data) {
         /* previous thread might already initialize entry in mmap cache */
-        ret = sss_nss_mc_get(inp);
+        ret = sss_nss_mc_get(inp, flags);
         switch (ret) {
         case 0:
             ret = 0;
@@ -323,6 +336,250 @@ out:
     return ret;
 }
 
+/* Batch lookups share one caller provided buffer, every record is placed
+ * behind the previous one at a pointer aligned offset. */
+struct nss_batch_input {
+    enum sss_cli_command cmd;
+    enum sss_cli_command single_cmd;
+    size_t num;
+    const uint32_t *ids;
+    struct passwd *pwds;
+    struct group *grps;
+    int *errs;
+    char *buffer;
+    size_t buflen;
+};
+
+static size_t batch_str_end(const char *str, const char *buffer)
+{
+    if (str == NULL) {
+        return 0;
+    }
+
+    return (str - buffer) + strlen(str) + 1;
+}
+
+static size_t batch_used(struct nss_batch_input *b, size_t i,
+                         const char *buffer)
+{
+    size_t used = 0;
+    size_t c;
+
+    if (b->pwds != NULL) {
+        used = MAX(used, batch_str_end(b->pwds[i].pw_name, buffer));
+        used = MAX(used, batch_str_end(b->pwds[i].pw_passwd, buffer));
+        used = MAX(used, batch_str_end(b->pwds[i].pw_gecos, buffer));
+        used = MAX(used, batch_str_end(b->pwds[i].pw_dir, buffer));
+        used = MAX(used, batch_str_end(b->pwds[i].pw_shell, buffer));
+        return used;
+    }
+
+    used = MAX(used, batch_str_end(b->grps[i].gr_name, buffer));
+    used = MAX(used, batch_str_end(b->grps[i].gr_passwd, buffer));
+    for (c = 0; b->grps[i].gr_mem[c] != NULL; c++) {
+        used = MAX(used, batch_str_end(b->grps[i].gr_mem[c], buffer));
+    }
+    used = MAX(used, (size_t)((const char *)&b->grps[i].gr_mem[c + 1]
+                              - buffer));
+
+    return used;
+}
+
+static void batch_set_input(struct nss_batch_input *b, size_t i, size_t pos,
+                            struct nss_input *inp)
+{
+    memset(inp, 0, sizeof(struct nss_input));
+    inp->cmd = b->single_cmd;
+
+    if (b->pwds != NULL) {
+        inp->input.uid = b->ids[i];
+        inp->result.pwrep.result = &b->pwds[i];
+        inp->result.pwrep.buffer = b->buffer + pos;
+        inp->result.pwrep.buflen = b->buflen - pos;
+    } else {
+        inp->input.gid = b->ids[i];
+        inp->result.grrep.result = &b->grps[i];
+        inp->result.grrep.buffer = b->buffer + pos;
+        inp->result.grrep.buflen = b->buflen - pos;
+    }
+}
+
+static size_t batch_align(struct nss_batch_input *b, size_t pos)
+{
+    pos += PADDING_SIZE((uintptr_t)(b->buffer + pos), char *);
+
+    return MIN(pos, b->buflen);
+}
+
+static int sss_get_batch_ex(struct nss_batch_input *b, uint32_t flags,
+                            unsigned int timeout)
+{
+    struct nss_input inp;
+    struct sss_cli_req_data rd;
+    uint32_t *req_data = NULL;
+    size_t *req_idx = NULL;
+    uint8_t *repbuf = NULL;
+    size_t replen;
+    size_t num_req = 0;
+    size_t pos = 0;
+    size_t rp;
+    size_t len;
+    size_t i;
+    size_t c;
+    uint32_t num_results;
+    uint32_t id;
+    uint32_t rec_len;
+    int time_left;
+    int errnop;
+    bool skip_mc = false;
+    bool skip_data = false;
+    int ret;
+
+    if (b->num == 0 || b->num > SSS_NSS_MAX_ENTRIES || b->ids == NULL
+            || b->errs == NULL) {
+        return EINVAL;
+    }
+
+    for (i = 0; i < b->num; i++) {
+        b->errs[i] = ENOENT;
+    }
+
+    batch_set_input(b, 0, 0, &inp);
+    ret = check_flags(&inp, flags, &skip_mc, &skip_data);
+    if (ret != 0) {
+        return ret;
+    }
+
+    req_data = malloc((2 + b->num) * sizeof(uint32_t));
+    req_idx = malloc(b->num * sizeof(size_t));
+    if (req_data == NULL || req_idx == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    /* Answer what we can from the memory cache and only ask the responder
+     * for the rest. */
+    for (i = 0; i < b->num; i++) {
+        if (!skip_mc && !skip_data) {
+            pos = batch_align(b, pos);
+            batch_set_input(b, i, pos, &inp);
+            ret = sss_nss_mc_get(&inp, flags);
+            switch (ret) {
+            case 0:
+                b->errs[i] = 0;
+                pos += batch_used(b, i, b->buffer + pos);
+                continue;
+            case ERANGE:
+                b->errs[i] = ERANGE;
+                continue;
+            case SSS_NSS_MC_NEGATIVE:
+                continue;
+            default:
+                break;
+            }
+        }
+
+        SAFEALIGN_COPY_UINT32(&req_data[2 + num_req], &b->ids[i], NULL);
+        req_idx[num_req] = i;
+        num_req++;
+    }
+
+    if (num_req == 0) {
+        ret = 0;
+        goto done;
+    }
+
+    req_data[0] = num_req;
+    req_data[1] = flags;
+    rd.len = (2 + num_req) * sizeof(uint32_t);
+    rd.data = req_data;
+
+    ret = sss_nss_timedlock(timeout, &time_left);
+    if (ret != 0) {
+        goto done;
+    }
+
+    ret = sss_nss_make_request_timeout(b->cmd, &rd, time_left,
+                                       &repbuf, &replen, &errnop);
+    sss_nss_unlock();
+    if (ret != NSS_STATUS_SUCCESS) {
+        ret = errnop != 0 ? errnop : EIO;
+        goto done;
+    }
+
+    if (replen < 2 * sizeof(uint32_t)) {
+        ret = EBADMSG;
+        goto done;
+    }
+
+    rp = 0;
+    SAFEALIGN_COPY_UINT32(&num_results, repbuf, &rp);
+    rp += sizeof(uint32_t); /* reserved */
+    if (num_results != num_req) {
+        ret = EBADMSG;
+        goto done;
+    }
+
+    for (c = 0; c < num_req; c++) {
+        i = req_idx[c];
+
+        if (rp + 2 * sizeof(uint32_t) > replen) {
+            ret = EBADMSG;
+            goto done;
+        }
+        SAFEALIGN_COPY_UINT32(&id, repbuf + rp, &rp);
+        SAFEALIGN_COPY_UINT32(&rec_len, repbuf + rp, &rp);
+        if (id != b->ids[i] || rec_len > replen - rp) {
+            ret = EBADMSG;
+            goto done;
+        }
+
+        if (rec_len < 2 * sizeof(uint32_t)) {
+            /* not found */
+            rp += rec_len;
+            continue;
+        }
+
+        SAFEALIGN_COPY_UINT32(&num_results, repbuf + rp, NULL);
+        if (num_results != 1) {
+            b->errs[i] = num_results == 0 ? ENOENT : EBADMSG;
+            rp += rec_len;
+            continue;
+        }
+
+        if (skip_data) {
+            b->errs[i] = 0;
+            rp += rec_len;
+            continue;
+        }
+
+        pos = batch_align(b, pos);
+        batch_set_input(b, i, pos, &inp);
+        len = rec_len - 2 * sizeof(uint32_t);
+        if (b->pwds != NULL) {
+            b->errs[i] = sss_nss_getpw_readrep(&inp.result.pwrep,
+                                               repbuf + rp + 8, &len);
+        } else {
+            b->errs[i] = sss_nss_getgr_readrep(&inp.result.grrep,
+                                               repbuf + rp + 8, &len);
+        }
+        if (b->errs[i] == 0) {
+            pos += batch_used(b, i, b->buffer + pos);
+        }
+
+        rp += rec_len;
+    }
+
+    ret = 0;
+
+done:
+    free(repbuf);
+    free(req_idx);
+    free(req_data);
+
+    return ret;
+}
+
 static int make_name_flag_req_data(const char *name, uint32_t flags,
                                    struct sss_cli_req_data *rd)
 {
@@ -482,6 +739,68 @@ int sss_nss_getgrgid_timeout(gid_t gid, struct group *grp,
     return ret;
 }
 
+int sss_nss_getpwuid_batch_timeout(const uid_t *uids, size_t num,
+                                   struct passwd *pwds, int *errs,
+                                   char *buffer, size_t buflen,
+                                   uint32_t flags, unsigned int timeout)
+{
+    int ret;
+    uint32_t ids[SSS_NSS_MAX_ENTRIES];
+    size_t i;
+    struct nss_batch_input b = {
+        .cmd = SSS_NSS_GETPWUID_BATCH,
+        .single_cmd = SSS_NSS_GETPWUID_EX,
+        .num = num,
+        .ids = ids,
+        .pwds = pwds,
+        .errs = errs,
+        .buffer = buffer,
+        .buflen = buflen};
+
+    if (uids == NULL || pwds == NULL || num > SSS_NSS_MAX_ENTRIES) {
+        return EINVAL;
+    }
+
+    for (i = 0; i < num; i++) {
+        ids[i] = uids[i];
+    }
+
+    ret = sss_get_batch_ex(&b, flags, timeout);
+
+    return ret;
+}
+
+int sss_nss_getgrgid_batch_timeout(const gid_t *gids, size_t num,
+                                   struct group *grps, int *errs,
+                                   char *buffer, size_t buflen,
+                                   uint32_t flags, unsigned int timeout)
+{
+    int ret;
+    uint32_t ids[SSS_NSS_MAX_ENTRIES];
+    size_t i;
+    struct nss_batch_input b = {
+        .cmd = SSS_NSS_GETGRGID_BATCH,
+        .single_cmd = SSS_NSS_GETGRGID_EX,
+        .num = num,
+        .ids = ids,
+        .grps = grps,
+        .errs = errs,
+        .buffer = buffer,
+        .buflen = buflen};
+
+    if (gids == NULL || grps == NULL || num > SSS_NSS_MAX_ENTRIES) {
+        return EINVAL;
+    }
+
+    for (i = 0; i < num; i++) {
+        ids[i] = gids[i];
+    }
+
+    ret = sss_get_batch_ex(&b, flags, timeout);
+
+    return ret;
+}
+
 int sss_nss_getgrouplist_timeout(const char *name, gid_t group,
                                  gid_t *groups, int *ngroups,
                                  uint32_t flags, unsigned int timeout)
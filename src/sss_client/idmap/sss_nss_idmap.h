@@ -278,6 +278,11 @@ void sss_nss_free_kv(struct sss_nss_kv *kv_list);
  *  This flag cannot be used together with SSS_NSS_EX_FLAG_NO_CACHE */
 #define SSS_NSS_EX_FLAG_INVALIDATE_CACHE (1 << 1)
 
+/** Only return the group name, password and gid, the member list is left
+ *  empty. This avoids expanding the members of large groups if the caller
+ *  only needs the group itself. Only meaningful for group lookups. */
+#define SSS_NSS_EX_FLAG_NO_MEMBERS (1 << 2)
+
 #ifdef IPA_389DS_PLUGIN_HELPER_CALLS
 
 /**
@@ -370,6 +375,64 @@ int sss_nss_getgrgid_timeout(gid_t gid, struct group *grp,
                              char *buffer, size_t buflen, struct group **result,
                              uint32_t flags, unsigned int timeout);
 
+/**
+ * @brief Return user information for several uids with a single request
+ *
+ * Entries found in the memory cache are served from there, all others are
+ * requested from SSSD in one round trip.
+ *
+ * @param[in]  uids       array of uids to look up
+ * @param[in]  num        number of elements in uids, at most 256
+ * @param[out] pwds       array of num passwd structs, pwds[i] is valid if
+ *                        errs[i] is 0
+ * @param[out] errs       array of num results: 0 if pwds[i] was filled,
+ *                        ENOENT if no user with uids[i] was found, ERANGE
+ *                        if the buffer was too small for this entry
+ * @param[in]  buffer     buffer shared by all returned entries
+ * @param[in]  buflen     size of buffer
+ * @param[in]  flags      flags to control the behavior and the results of the
+ *                        call
+ * @param[in]  timeout    timeout in milliseconds
+ *
+ * @return
+ *  - 0:         the request was processed, see errs for the single results
+ *  - EINVAL:    invalid input
+ *  - ETIMEDOUT: request timed out
+ */
+int sss_nss_getpwuid_batch_timeout(const uid_t *uids, size_t num,
+                                   struct passwd *pwds, int *errs,
+                                   char *buffer, size_t buflen,
+                                   uint32_t flags, unsigned int timeout);
+
+/**
+ * @brief Return group information for several gids with a single request
+ *
+ * Entries found in the memory cache are served from there, all others are
+ * requested from SSSD in one round trip.
+ *
+ * @param[in]  gids       array of gids to look up
+ * @param[in]  num        number of elements in gids, at most 256
+ * @param[out] grps       array of num group structs, grps[i] is valid if
+ *                        errs[i] is 0
+ * @param[out] errs       array of num results: 0 if grps[i] was filled,
+ *                        ENOENT if no group with gids[i] was found, ERANGE
+ *                        if the buffer was too small for this entry
+ * @param[in]  buffer     buffer shared by all returned entries
+ * @param[in]  buflen     size of buffer
+ * @param[in]  flags      flags to control the behavior and the results of the
+ *                        call
+ * @param[in]  timeout    timeout in milliseconds
+ *
+ * @return
+ *  - 0:         the request was processed, see errs for the single results
+ *  - EINVAL:    invalid input
+ *  - ETIMEDOUT: request timed out
+ */
+int sss_nss_getgrgid_batch_timeout(const gid_t *gids, size_t num,
+                                   struct group *grps, int *errs,
+                                   char *buffer, size_t buflen,
+                                   uint32_t flags, unsigned int timeout);
+
 /**
  * @brief Return a list of groups to which a user belongs
  *
@@ -456,6 +456,9 @@ enum nss_status _nss_sss_getgrnam_r(const char *name, struct group *result,
     case ERANGE:
         *errnop = ERANGE;
         return NSS_STATUS_TRYAGAIN;
+    case SSS_NSS_MC_NEGATIVE:
+        *errnop = 0;
+        return NSS_STATUS_NOTFOUND;
     case ENOENT:
         /* fall through, we need to actively ask the parent
          * if no entry is found */
@@ -482,6 +485,10 @@ enum nss_status _nss_sss_getgrnam_r(const char *name, struct group *result,
         *errnop = ERANGE;
         nret = NSS_STATUS_TRYAGAIN;
         goto out;
+    case SSS_NSS_MC_NEGATIVE:
+        *errnop = 0;
+        nret = NSS_STATUS_NOTFOUND;
+        goto out;
     case ENOENT:
         /* fall through, we need to actively ask the parent
          * if no entry is found */
@@ -570,6 +577,9 @@ enum nss_status _nss_sss_getgrgid_r(gid_t gid, struct group *result,
     case ERANGE:
         *errnop = ERANGE;
         return NSS_STATUS_TRYAGAIN;
+    case SSS_NSS_MC_NEGATIVE:
+        *errnop = 0;
+        return NSS_STATUS_NOTFOUND;
     case ENOENT:
         /* fall through, we need to actively ask the parent
          * if no entry is found */
@@ -597,6 +607,10 @@ enum nss_status _nss_sss_getgrgid_r(gid_t gid, struct group *result,
         *errnop = ERANGE;
         nret = NSS_STATUS_TRYAGAIN;
         goto out;
+    case SSS_NSS_MC_NEGATIVE:
+        *errnop = 0;
+        nret = NSS_STATUS_NOTFOUND;
+        goto out;
     case ENOENT:
         /* fall through, we need to actively ask the parent
          * if no entry is found */
@@ -68,13 +68,16 @@ struct sss_cli_mc_ctx {
     uint32_t *hash_table;   /* hash table address (in mmap) */
     uint32_t ht_size;       /* size of hash table */
 
+    uint32_t *seq_table;    /* bucket sequence counters (in mmap),
+                             * NULL for v1 files */
+
     uint32_t active_threads; /* count of threads which use memory cache */
 };
 
 #if HAVE_PTHREAD
-#define SSS_CLI_MC_CTX_INITIALIZER(mtx) {UNINITIALIZED, (mtx), -1, 0, 0, 0, NULL, 0, NULL, 0, NULL, 0, 0}
+#define SSS_CLI_MC_CTX_INITIALIZER(mtx) {UNINITIALIZED, (mtx), -1, 0, 0, 0, NULL, 0, NULL, 0, NULL, 0, NULL, 0}
 #else
-#define SSS_CLI_MC_CTX_INITIALIZER {UNINITIALIZED, -1, 0, 0, 0, NULL, 0, NULL, 0, NULL, 0, 0}
+#define SSS_CLI_MC_CTX_INITIALIZER {UNINITIALIZED, -1, 0, 0, 0, NULL, 0, NULL, 0, NULL, 0, NULL, 0}
 #endif
 
 errno_t sss_nss_mc_get_ctx(const char *name, struct sss_cli_mc_ctx *ctx);
@@ -88,6 +91,24 @@ errno_t sss_nss_str_ptr_from_buffer(char **str, void **cookie,
 uint32_t sss_nss_mc_next_slot_with_hash(struct sss_mc_rec *rec,
                                         uint32_t hash);
 
+/* number of times a chain walk is repeated when a concurrent update of
+ * the bucket was detected */
+#define SSS_NSS_MC_CHAIN_RETRIES 5
+
+uint32_t sss_nss_mc_chain_start(struct sss_cli_mc_ctx *ctx,
+                                uint32_t hash, uint32_t *_seq);
+bool sss_nss_mc_chain_changed(struct sss_cli_mc_ctx *ctx,
+                              uint32_t hash, uint32_t seq);
+
+/* returned by the lookups below when a negative record tells that the
+ * entry does not exist, the responder does not need to be asked */
+#define SSS_NSS_MC_NEGATIVE ENODATA
+
+bool sss_nss_mc_is_negative(struct sss_cli_mc_ctx *ctx,
+                            struct sss_mc_rec *rec, uint32_t flag,
+                            const char *key, size_t key_len,
+                            bool *_match);
+
 /* passwd db */
 errno_t sss_nss_mc_getpwnam(const char *name, size_t name_len,
                             struct passwd *result,
@@ -103,6 +124,14 @@ errno_t sss_nss_mc_getgrnam(const char *name, size_t name_len,
 errno_t sss_nss_mc_getgrgid(gid_t gid,
                             struct group *result,
                             char *buffer, size_t buflen);
+/* same as above but gr_mem is returned empty, only the group header is
+ * copied so huge groups do not need a huge buffer */
+errno_t sss_nss_mc_getgrnam_no_members(const char *name, size_t name_len,
+                                       struct group *result,
+                                       char *buffer, size_t buflen);
+errno_t sss_nss_mc_getgrgid_no_members(gid_t gid,
+                                       struct group *result,
+                                       char *buffer, size_t buflen);
 
 /* initgroups db */
 errno_t sss_nss_mc_initgroups_dyn(const char *name, size_t name_len,
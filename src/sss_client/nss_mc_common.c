@@ -104,6 +104,7 @@ static errno_t sss_nss_mc_validate(struct sss_cli_mc_ctx *ctx)
 errno_t sss_nss_check_header(struct sss_cli_mc_ctx *ctx)
 {
     struct sss_mc_header h;
+    uint32_t *seq_table;
     bool copy_ok;
     int count;
     int ret;
@@ -128,9 +129,22 @@ errno_t sss_nss_check_header(struct sss_cli_mc_ctx *ctx)
         return EIO;
     }
 
-    if (h.major_vno != SSS_MC_MAJOR_VNO ||
-        h.minor_vno != SSS_MC_MINOR_VNO ||
-        h.status == SSS_MC_HEADER_RECYCLED) {
+    if (h.status == SSS_MC_HEADER_RECYCLED) {
+        return EINVAL;
+    }
+
+    if (h.major_vno == SSS_MC_MAJOR_VNO && h.minor_vno == SSS_MC_MINOR_VNO) {
+        if (h.seq_table == 0
+                || h.seq_table > ctx->mmap_size
+                || h.ht_size > ctx->mmap_size - h.seq_table) {
+            return EINVAL;
+        }
+        seq_table = MC_PTR_ADD(ctx->mmap_base, h.seq_table);
+    } else if (h.major_vno == SSS_MC_MAJOR_VNO_V1
+                   && h.minor_vno == SSS_MC_MINOR_VNO_V1) {
+        /* compatibility mode, records are only protected by barriers */
+        seq_table = NULL;
+    } else {
         return EINVAL;
     }
 
@@ -139,12 +153,14 @@ errno_t sss_nss_check_header(struct sss_cli_mc_ctx *ctx)
         ctx->seed = h.seed;
         ctx->data_table = MC_PTR_ADD(ctx->mmap_base, h.data_table);
         ctx->hash_table = MC_PTR_ADD(ctx->mmap_base, h.hash_table);
+        ctx->seq_table = seq_table;
         ctx->dt_size = h.dt_size;
         ctx->ht_size = h.ht_size;
     } else {
         if (ctx->seed != h.seed ||
             ctx->data_table != MC_PTR_ADD(ctx->mmap_base, h.data_table) ||
             ctx->hash_table != MC_PTR_ADD(ctx->mmap_base, h.hash_table) ||
+            ctx->seq_table != seq_table ||
             ctx->dt_size != h.dt_size ||
             ctx->ht_size != h.ht_size) {
             return EINVAL;
@@ -175,6 +191,7 @@ static void sss_nss_mc_destroy_ctx(struct sss_cli_mc_ctx *ctx)
     ctx->dt_size = 0;
     ctx->hash_table = NULL;
     ctx->ht_size = 0;
+    ctx->seq_table = NULL;
     ctx->initialized = UNINITIALIZED;
     /* `mutex` and `active_threads` should be left intact */
 }
@@ -424,3 +441,78 @@ uint32_t sss_nss_mc_next_slot_with_hash(struct sss_mc_rec *rec,
     }
 
 }
+
+/*
+ * Returns the first slot of the chain for the given hash and stores a
+ * snapshot of the bucket sequence counter in *_seq. Once the whole chain
+ * was walked, sss_nss_mc_chain_changed() tells whether the walk could have
+ * observed a concurrent update and must be repeated.
+ *
+ * With v1 files there are no counters and the walk is never repeated,
+ * consistency is then only guaranteed per record by the barriers.
+ */
+uint32_t sss_nss_mc_chain_start(struct sss_cli_mc_ctx *ctx,
+                                uint32_t hash, uint32_t *_seq)
+{
+    uint32_t seq = 0;
+    int count;
+
+    if (ctx->seq_table != NULL) {
+        /* the writer holds the bucket only for a handful of stores,
+         * give it a chance to finish before we start walking */
+        for (count = 100; count > 0; count--) {
+            seq = ctx->seq_table[hash];
+            if (!MC_SEQ_IS_WRITING(seq)) {
+                break;
+            }
+        }
+        __sync_synchronize();
+    }
+
+    *_seq = seq;
+    return ctx->hash_table[hash];
+}
+
+bool sss_nss_mc_chain_changed(struct sss_cli_mc_ctx *ctx,
+                              uint32_t hash, uint32_t seq)
+{
+    if (ctx->seq_table == NULL) {
+        return false;
+    }
+
+    __sync_synchronize();
+    return MC_SEQ_IS_WRITING(seq) || ctx->seq_table[hash] != seq;
+}
+
+/*
+ * Negative records (v2+) tell that the responder did not find the key in
+ * any domain. Returns true if rec is a negative record, in that case
+ * *_match tells whether it was stored for the given key and kind of key
+ * (MC_REC_FLAG_NEG_NAME or MC_REC_FLAG_NEG_ID).
+ *
+ * In v1 files the flags were padding and are ignored.
+ */
+bool sss_nss_mc_is_negative(struct sss_cli_mc_ctx *ctx,
+                            struct sss_mc_rec *rec, uint32_t flag,
+                            const char *key, size_t key_len,
+                            bool *_match)
+{
+    struct sss_mc_neg_data *data;
+    const size_t key_offset = offsetof(struct sss_mc_neg_data, key);
+
+    if (ctx->seq_table == NULL || !(rec->flags & MC_REC_FLAGS_NEGATIVE)) {
+        return false;
+    }
+
+    data = (struct sss_mc_neg_data *)rec->data;
+    /* Integrity check
+     * - the key must follow the data header
+     * - the key must be within copy of record */
+    *_match = (rec->flags & flag) != 0
+              && data->name == key_offset
+              && data->key_len == key_len
+              && rec->len >= sizeof(struct sss_mc_rec) + key_offset + key_len
+              && memcmp(data->key, key, key_len) == 0;
+
+    return true;
+}
@@ -36,7 +36,29 @@ static struct sss_cli_mc_ctx gr_mc_ctx = SSS_CLI_MC_CTX_INITIALIZER(&gr_mc_ctx_m
 static struct sss_cli_mc_ctx gr_mc_ctx = SSS_CLI_MC_CTX_INITIALIZER;
 #endif
 
+/* Length of the name and password strings at the start of strs. */
+static errno_t sss_nss_mc_grp_header_len(struct sss_mc_grp_data *data,
+                                         size_t *_len)
+{
+    size_t len = 0;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        if (len >= data->strs_len) {
+            return EINVAL;
+        }
+        len += strnlen(data->strs + len, data->strs_len - len) + 1;
+    }
+    if (len > data->strs_len) {
+        return EINVAL;
+    }
+
+    *_len = len;
+    return 0;
+}
+
 static errno_t sss_nss_mc_parse_result(struct sss_mc_rec *rec,
+                                       bool with_members,
                                        struct group *result,
                                        char *buffer, size_t buflen)
 {
@@ -45,6 +67,8 @@ static errno_t sss_nss_mc_parse_result(struct sss_mc_rec *rec,
     void *cookie;
     char *membuf;
     size_t memsize;
+    size_t strs_len;
+    uint32_t members;
     int ret;
     int i;
 
@@ -57,8 +81,20 @@ static errno_t sss_nss_mc_parse_result(struct sss_mc_rec *rec,
 
     data = (struct sss_mc_grp_data *)rec->data;
 
-    memsize = (data->members + 1) * sizeof(char *);
-    if (data->strs_len + memsize > buflen) {
+    if (with_members) {
+        members = data->members;
+        strs_len = data->strs_len;
+    } else {
+        /* only name and password are copied, gr_mem stays empty */
+        members = 0;
+        ret = sss_nss_mc_grp_header_len(data, &strs_len);
+        if (ret) {
+            return ret;
+        }
+    }
+
+    memsize = (members + 1) * sizeof(char *);
+    if (strs_len + memsize > buflen) {
         return ERANGE;
     }
 
@@ -66,7 +102,7 @@ static errno_t sss_nss_mc_parse_result(struct sss_mc_rec *rec,
 
     /* copy in buffer */
     membuf = buffer + memsize;
-    memcpy(membuf, data->strs, data->strs_len);
+    memcpy(membuf, data->strs, strs_len);
 
     /* fill in group */
     result->gr_gid = data->gid;
@@ -78,23 +114,23 @@ static errno_t sss_nss_mc_parse_result(struct sss_mc_rec *rec,
     }
 
     result->gr_mem = DISCARD_ALIGN(buffer, char **);
-    result->gr_mem[data->members] = NULL;
+    result->gr_mem[members] = NULL;
 
     cookie = NULL;
     ret = sss_nss_str_ptr_from_buffer(&result->gr_name, &cookie,
-                                      membuf, data->strs_len);
+                                      membuf, strs_len);
     if (ret) {
         return ret;
     }
     ret = sss_nss_str_ptr_from_buffer(&result->gr_passwd, &cookie,
-                                      membuf, data->strs_len);
+                                      membuf, strs_len);
     if (ret) {
         return ret;
     }
 
-    for (i = 0; i < data->members; i++) {
+    for (i = 0; i < members; i++) {
         ret = sss_nss_str_ptr_from_buffer(&result->gr_mem[i], &cookie,
-                                          membuf, data->strs_len);
+                                          membuf, strs_len);
         if (ret) {
             return ret;
         }
@@ -106,15 +142,19 @@ static errno_t sss_nss_mc_parse_result(struct sss_mc_rec *rec,
     return 0;
 }
 
-errno_t sss_nss_mc_getgrnam(const char *name, size_t name_len,
-                            struct group *result,
-                            char *buffer, size_t buflen)
+static errno_t sss_nss_mc_getgrnam_int(const char *name, size_t name_len,
+                                       bool with_members,
+                                       struct group *result,
+                                       char *buffer, size_t buflen)
 {
     struct sss_mc_rec *rec = NULL;
     struct sss_mc_grp_data *data;
     char *rec_name;
     uint32_t hash;
     uint32_t slot;
+    uint32_t seq;
+    int retries;
+    bool negative;
     int ret;
     const size_t strs_offset = offsetof(struct sss_mc_grp_data, strs);
     size_t data_size;
@@ -129,46 +169,80 @@ errno_t sss_nss_mc_getgrnam(const char *name, size_t name_len,
 
     /* hashes are calculated including the NULL terminator */
     hash = sss_nss_mc_hash(&gr_mc_ctx, name, name_len + 1);
-    slot = gr_mc_ctx.hash_table[hash];
-
-    /* If slot is not within the bounds of mmapped region and
-     * it's value is not MC_INVALID_VAL, then the cache is
-     * probably corrupted. */
-    while (MC_SLOT_WITHIN_BOUNDS(slot, data_size)) {
-        /* free record from previous iteration */
-        free(rec);
-        rec = NULL;
-
-        ret = sss_nss_mc_get_record(&gr_mc_ctx, slot, &rec);
-        if (ret) {
-            goto done;
-        }
+    for (retries = SSS_NSS_MC_CHAIN_RETRIES; retries > 0; retries--) {
+        slot = sss_nss_mc_chain_start(&gr_mc_ctx, hash, &seq);
+        ret = 0;
+        negative = false;
+
+        /* If slot is not within the bounds of mmapped region and
+         * it's value is not MC_INVALID_VAL, then the cache is
+         * probably corrupted. */
+        while (MC_SLOT_WITHIN_BOUNDS(slot, data_size)) {
+            /* free record from previous iteration */
+            free(rec);
+            rec = NULL;
+
+            ret = sss_nss_mc_get_record(&gr_mc_ctx, slot, &rec);
+            if (ret) {
+                break;
+            }
+
+            /* check record matches what we are searching for */
+            if (hash != rec->hash1) {
+                /* if name hash does not match we can skip this immediately */
+                slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+                continue;
+            }
+
+            if (sss_nss_mc_is_negative(&gr_mc_ctx, rec, MC_REC_FLAG_NEG_NAME,
+                                       name, name_len + 1, &negative)) {
+                if (negative) {
+                    break;
+                }
+                slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+                continue;
+            }
+
+            data = (struct sss_mc_grp_data *)rec->data;
+            rec_name = (char *)data + data->name;
+            /* Integrity check
+             * - data->name cannot point outside strings
+             * - all strings must be within copy of record
+             * - rec_name is a zero-terminated string */
+            if (data->name < strs_offset
+                || data->name >= strs_offset + data->strs_len
+                || data->strs_len > rec->len) {
+                ret = ENOENT;
+                break;
+            }
+
+            if (strcmp(name, rec_name) == 0) {
+                break;
+            }
 
-        /* check record matches what we are searching for */
-        if (hash != rec->hash1) {
-            /* if name hash does not match we can skip this immediately */
             slot = sss_nss_mc_next_slot_with_hash(rec, hash);
-            continue;
         }
 
-        data = (struct sss_mc_grp_data *)rec->data;
-        rec_name = (char *)data + data->name;
-        /* Integrity check
-         * - data->name cannot point outside strings
-         * - all strings must be within copy of record
-         * - rec_name is a zero-terminated string */
-        if (data->name < strs_offset
-            || data->name >= strs_offset + data->strs_len
-            || data->strs_len > rec->len) {
-            ret = ENOENT;
-            goto done;
-        }
-
-        if (strcmp(name, rec_name) == 0) {
+        if (!sss_nss_mc_chain_changed(&gr_mc_ctx, hash, seq)) {
             break;
         }
+        /* the chain was modified while we walked it, start over */
+        free(rec);
+        rec = NULL;
+    }
+    if (retries == 0) {
+        /* too busy, let the caller fall back to the responder */
+        ret = EIO;
+        goto done;
+    }
+    if (ret) {
+        goto done;
+    }
 
-        slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+    if (negative) {
+        /* an expired negative record means we have to ask the responder */
+        ret = (rec->expire < time(NULL)) ? ENOENT : SSS_NSS_MC_NEGATIVE;
+        goto done;
     }
 
     if (!MC_SLOT_WITHIN_BOUNDS(slot, data_size)) {
@@ -176,7 +250,8 @@ errno_t sss_nss_mc_getgrnam(const char *name, size_t name_len,
         goto done;
     }
 
-    ret = sss_nss_mc_parse_result(rec, result, buffer, buflen);
+    ret = sss_nss_mc_parse_result(rec, with_members,
+                                  result, buffer, buflen);
 
 done:
     free(rec);
@@ -184,15 +259,18 @@ done:
     return ret;
 }
 
-errno_t sss_nss_mc_getgrgid(gid_t gid,
-                            struct group *result,
-                            char *buffer, size_t buflen)
+static errno_t sss_nss_mc_getgrgid_int(gid_t gid, bool with_members,
+                                       struct group *result,
+                                       char *buffer, size_t buflen)
 {
     struct sss_mc_rec *rec = NULL;
     struct sss_mc_grp_data *data;
     char gidstr[11];
     uint32_t hash;
     uint32_t slot;
+    uint32_t seq;
+    int retries;
+    bool negative;
     int len;
     int ret;
 
@@ -209,34 +287,68 @@ errno_t sss_nss_mc_getgrgid(gid_t gid,
 
     /* hashes are calculated including the NULL terminator */
     hash = sss_nss_mc_hash(&gr_mc_ctx, gidstr, len+1);
-    slot = gr_mc_ctx.hash_table[hash];
-
-    /* If slot is not within the bounds of mmapped region and
-     * it's value is not MC_INVALID_VAL, then the cache is
-     * probably corrupted. */
-    while (MC_SLOT_WITHIN_BOUNDS(slot, gr_mc_ctx.dt_size)) {
-        /* free record from previous iteration */
-        free(rec);
-        rec = NULL;
+    for (retries = SSS_NSS_MC_CHAIN_RETRIES; retries > 0; retries--) {
+        slot = sss_nss_mc_chain_start(&gr_mc_ctx, hash, &seq);
+        ret = 0;
+        negative = false;
+
+        /* If slot is not within the bounds of mmapped region and
+         * it's value is not MC_INVALID_VAL, then the cache is
+         * probably corrupted. */
+        while (MC_SLOT_WITHIN_BOUNDS(slot, gr_mc_ctx.dt_size)) {
+            /* free record from previous iteration */
+            free(rec);
+            rec = NULL;
+
+            ret = sss_nss_mc_get_record(&gr_mc_ctx, slot, &rec);
+            if (ret) {
+                break;
+            }
+
+            /* check record matches what we are searching for */
+            if (hash != rec->hash2) {
+                /* if uid hash does not match we can skip this immediately */
+                slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+                continue;
+            }
+
+            if (sss_nss_mc_is_negative(&gr_mc_ctx, rec, MC_REC_FLAG_NEG_ID,
+                                       gidstr, len + 1, &negative)) {
+                if (negative) {
+                    break;
+                }
+                slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+                continue;
+            }
+
+            data = (struct sss_mc_grp_data *)rec->data;
+            if (gid == data->gid) {
+                break;
+            }
 
-        ret = sss_nss_mc_get_record(&gr_mc_ctx, slot, &rec);
-        if (ret) {
-            goto done;
-        }
-
-        /* check record matches what we are searching for */
-        if (hash != rec->hash2) {
-            /* if uid hash does not match we can skip this immediately */
             slot = sss_nss_mc_next_slot_with_hash(rec, hash);
-            continue;
         }
 
-        data = (struct sss_mc_grp_data *)rec->data;
-        if (gid == data->gid) {
+        if (!sss_nss_mc_chain_changed(&gr_mc_ctx, hash, seq)) {
             break;
         }
+        /* the chain was modified while we walked it, start over */
+        free(rec);
+        rec = NULL;
+    }
+    if (retries == 0) {
+        /* too busy, let the caller fall back to the responder */
+        ret = EIO;
+        goto done;
+    }
+    if (ret) {
+        goto done;
+    }
 
-        slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+    if (negative) {
+        /* an expired negative record means we have to ask the responder */
+        ret = (rec->expire < time(NULL)) ? ENOENT : SSS_NSS_MC_NEGATIVE;
+        goto done;
     }
 
     if (!MC_SLOT_WITHIN_BOUNDS(slot, gr_mc_ctx.dt_size)) {
@@ -244,7 +356,8 @@ errno_t sss_nss_mc_getgrgid(gid_t gid,
         goto done;
     }
 
-    ret = sss_nss_mc_parse_result(rec, result, buffer, buflen);
+    ret = sss_nss_mc_parse_result(rec, with_members,
+                                  result, buffer, buflen);
 
 done:
     free(rec);
@@ -252,3 +365,32 @@ done:
     return ret;
 }
 
+errno_t sss_nss_mc_getgrnam(const char *name, size_t name_len,
+                            struct group *result,
+                            char *buffer, size_t buflen)
+{
+    return sss_nss_mc_getgrnam_int(name, name_len, true,
+                                   result, buffer, buflen);
+}
+
+errno_t sss_nss_mc_getgrnam_no_members(const char *name, size_t name_len,
+                                       struct group *result,
+                                       char *buffer, size_t buflen)
+{
+    return sss_nss_mc_getgrnam_int(name, name_len, false,
+                                   result, buffer, buflen);
+}
+
+errno_t sss_nss_mc_getgrgid(gid_t gid,
+                            struct group *result,
+                            char *buffer, size_t buflen)
+{
+    return sss_nss_mc_getgrgid_int(gid, true, result, buffer, buflen);
+}
+
+errno_t sss_nss_mc_getgrgid_no_members(gid_t gid,
+                                       struct group *result,
+                                       char *buffer, size_t buflen)
+{
+    return sss_nss_mc_getgrgid_int(gid, false, result, buffer, buflen);
+}
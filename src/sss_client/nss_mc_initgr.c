@@ -96,6 +96,8 @@ errno_t sss_nss_mc_initgroups_dyn(const char *name, size_t name_len,
     char *rec_name;
     uint32_t hash;
     uint32_t slot;
+    uint32_t seq;
+    int retries;
     int ret;
     const size_t data_offset = offsetof(struct sss_mc_initgr_data, gids);
     size_t data_size;
@@ -110,48 +112,66 @@ errno_t sss_nss_mc_initgroups_dyn(const char *name, size_t name_len,
 
     /* hashes are calculated including the NULL terminator */
     hash = sss_nss_mc_hash(&initgr_mc_ctx, name, name_len + 1);
-    slot = initgr_mc_ctx.hash_table[hash];
+    for (retries = SSS_NSS_MC_CHAIN_RETRIES; retries > 0; retries--) {
+        slot = sss_nss_mc_chain_start(&initgr_mc_ctx, hash, &seq);
+        ret = 0;
+
+        /* If slot is not within the bounds of mmapped region and
+         * it's value is not MC_INVALID_VAL, then the cache is
+         * probably corrupted. */
+        while (MC_SLOT_WITHIN_BOUNDS(slot, data_size)) {
+            /* free record from previous iteration */
+            free(rec);
+            rec = NULL;
+
+            ret = sss_nss_mc_get_record(&initgr_mc_ctx, slot, &rec);
+            if (ret) {
+                break;
+            }
+
+            /* check record matches what we are searching for */
+            if (hash != rec->hash1) {
+                /* if name hash does not match we can skip this immediately */
+                slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+                continue;
+            }
+
+            data = (struct sss_mc_initgr_data *)rec->data;
+            rec_name = (char *)data + data->name;
+            /* Integrity check
+             * - data->name cannot point outside all strings or data
+             * - all data must be within copy of record
+             * - data->strs cannot point outside strings
+             * - rec_name is a zero-terminated string */
+            if (data->name < data_offset
+                || data->name >= data_offset + data->data_len
+                || data->strs_len > data->data_len
+                || data->data_len > rec->len) {
+                ret = ENOENT;
+                break;
+            }
+
+            if (strcmp(name, rec_name) == 0) {
+                break;
+            }
 
-    /* If slot is not within the bounds of mmapped region and
-     * it's value is not MC_INVALID_VAL, then the cache is
-     * probably corrupted. */
-    while (MC_SLOT_WITHIN_BOUNDS(slot, data_size)) {
-        /* free record from previous iteration */
-        free(rec);
-        rec = NULL;
-
-        ret = sss_nss_mc_get_record(&initgr_mc_ctx, slot, &rec);
-        if (ret) {
-            goto done;
-        }
-
-        /* check record matches what we are searching for */
-        if (hash != rec->hash1) {
-            /* if name hash does not match we can skip this immediately */
             slot = sss_nss_mc_next_slot_with_hash(rec, hash);
-            continue;
-        }
-
-        data = (struct sss_mc_initgr_data *)rec->data;
-        rec_name = (char *)data + data->name;
-        /* Integrity check
-         * - data->name cannot point outside all strings or data
-         * - all data must be within copy of record
-         * - data->strs cannot point outside strings
-         * - rec_name is a zero-terminated string */
-        if (data->name < data_offset
-            || data->name >= data_offset + data->data_len
-            || data->strs_len > data->data_len
-            || data->data_len > rec->len) {
-            ret = ENOENT;
-            goto done;
         }
 
-        if (strcmp(name, rec_name) == 0) {
+        if (!sss_nss_mc_chain_changed(&initgr_mc_ctx, hash, seq)) {
             break;
         }
-
-        slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+        /* the chain was modified while we walked it, start over */
+        free(rec);
+        rec = NULL;
+    }
+    if (retries == 0) {
+        /* too busy, let the caller fall back to the responder */
+        ret = EIO;
+        goto done;
+    }
+    if (ret) {
+        goto done;
     }
 
     if (!MC_SLOT_WITHIN_BOUNDS(slot, data_size)) {
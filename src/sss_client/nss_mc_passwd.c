@@ -108,6 +108,9 @@ errno_t sss_nss_mc_getpwnam(const char *name, size_t name_len,
     char *rec_name;
     uint32_t hash;
     uint32_t slot;
+    uint32_t seq;
+    int retries;
+    bool negative;
     int ret;
     const size_t strs_offset = offsetof(struct sss_mc_pwd_data, strs);
     size_t data_size;
@@ -122,46 +125,80 @@ errno_t sss_nss_mc_getpwnam(const char *name, size_t name_len,
 
     /* hashes are calculated including the NULL terminator */
     hash = sss_nss_mc_hash(&pw_mc_ctx, name, name_len + 1);
-    slot = pw_mc_ctx.hash_table[hash];
+    for (retries = SSS_NSS_MC_CHAIN_RETRIES; retries > 0; retries--) {
+        slot = sss_nss_mc_chain_start(&pw_mc_ctx, hash, &seq);
+        ret = 0;
+        negative = false;
+
+        /* If slot is not within the bounds of mmapped region and
+         * it's value is not MC_INVALID_VAL, then the cache is
+         * probably corrupted. */
+        while (MC_SLOT_WITHIN_BOUNDS(slot, data_size)) {
+            /* free record from previous iteration */
+            free(rec);
+            rec = NULL;
+
+            ret = sss_nss_mc_get_record(&pw_mc_ctx, slot, &rec);
+            if (ret) {
+                break;
+            }
+
+            /* check record matches what we are searching for */
+            if (hash != rec->hash1) {
+                /* if name hash does not match we can skip this immediately */
+                slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+                continue;
+            }
+
+            if (sss_nss_mc_is_negative(&pw_mc_ctx, rec, MC_REC_FLAG_NEG_NAME,
+                                       name, name_len + 1, &negative)) {
+                if (negative) {
+                    break;
+                }
+                slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+                continue;
+            }
+
+            data = (struct sss_mc_pwd_data *)rec->data;
+            rec_name = (char *)data + data->name;
+            /* Integrity check
+             * - data->name cannot point outside strings
+             * - all strings must be within copy of record
+             * - rec_name is a zero-terminated string */
+            if (data->name < strs_offset
+                || data->name >= strs_offset + data->strs_len
+                || data->strs_len > rec->len) {
+                ret = ENOENT;
+                break;
+            }
+
+            if (strcmp(name, rec_name) == 0) {
+                break;
+            }
 
-    /* If slot is not within the bounds of mmapped region and
-     * it's value is not MC_INVALID_VAL, then the cache is
-     * probably corrupted. */
-    while (MC_SLOT_WITHIN_BOUNDS(slot, data_size)) {
-        /* free record from previous iteration */
-        free(rec);
-        rec = NULL;
-
-        ret = sss_nss_mc_get_record(&pw_mc_ctx, slot, &rec);
-        if (ret) {
-            goto done;
-        }
-
-        /* check record matches what we are searching for */
-        if (hash != rec->hash1) {
-            /* if name hash does not match we can skip this immediately */
             slot = sss_nss_mc_next_slot_with_hash(rec, hash);
-            continue;
-        }
-
-        data = (struct sss_mc_pwd_data *)rec->data;
-        rec_name = (char *)data + data->name;
-        /* Integrity check
-         * - data->name cannot point outside strings
-         * - all strings must be within copy of record
-         * - rec_name is a zero-terminated string */
-        if (data->name < strs_offset
-            || data->name >= strs_offset + data->strs_len
-            || data->strs_len > rec->len) {
-            ret = ENOENT;
-            goto done;
         }
 
-        if (strcmp(name, rec_name) == 0) {
+        if (!sss_nss_mc_chain_changed(&pw_mc_ctx, hash, seq)) {
             break;
         }
+        /* the chain was modified while we walked it, start over */
+        free(rec);
+        rec = NULL;
+    }
+    if (retries == 0) {
+        /* too busy, let the caller fall back to the responder */
+        ret = EIO;
+        goto done;
+    }
+    if (ret) {
+        goto done;
+    }
 
-        slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+    if (negative) {
+        /* an expired negative record means we have to ask the responder */
+        ret = (rec->expire < time(NULL)) ? ENOENT : SSS_NSS_MC_NEGATIVE;
+        goto done;
     }
 
     if (!MC_SLOT_WITHIN_BOUNDS(slot, data_size)) {
@@ -186,6 +223,9 @@ errno_t sss_nss_mc_getpwuid(uid_t uid,
     char uidstr[11];
     uint32_t hash;
     uint32_t slot;
+    uint32_t seq;
+    int retries;
+    bool negative;
     int len;
     int ret;
 
@@ -202,34 +242,68 @@ errno_t sss_nss_mc_getpwuid(uid_t uid,
 
     /* hashes are calculated including the NULL terminator */
     hash = sss_nss_mc_hash(&pw_mc_ctx, uidstr, len+1);
-    slot = pw_mc_ctx.hash_table[hash];
-
-    /* If slot is not within the bounds of mmapped region and
-     * it's value is not MC_INVALID_VAL, then the cache is
-     * probably corrupted. */
-    while (MC_SLOT_WITHIN_BOUNDS(slot, pw_mc_ctx.dt_size)) {
-        /* free record from previous iteration */
-        free(rec);
-        rec = NULL;
+    for (retries = SSS_NSS_MC_CHAIN_RETRIES; retries > 0; retries--) {
+        slot = sss_nss_mc_chain_start(&pw_mc_ctx, hash, &seq);
+        ret = 0;
+        negative = false;
+
+        /* If slot is not within the bounds of mmapped region and
+         * it's value is not MC_INVALID_VAL, then the cache is
+         * probably corrupted. */
+        while (MC_SLOT_WITHIN_BOUNDS(slot, pw_mc_ctx.dt_size)) {
+            /* free record from previous iteration */
+            free(rec);
+            rec = NULL;
+
+            ret = sss_nss_mc_get_record(&pw_mc_ctx, slot, &rec);
+            if (ret) {
+                break;
+            }
+
+            /* check record matches what we are searching for */
+            if (hash != rec->hash2) {
+                /* if uid hash does not match we can skip this immediately */
+                slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+                continue;
+            }
+
+            if (sss_nss_mc_is_negative(&pw_mc_ctx, rec, MC_REC_FLAG_NEG_ID,
+                                       uidstr, len + 1, &negative)) {
+                if (negative) {
+                    break;
+                }
+                slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+                continue;
+            }
+
+            data = (struct sss_mc_pwd_data *)rec->data;
+            if (uid == data->uid) {
+                break;
+            }
 
-        ret = sss_nss_mc_get_record(&pw_mc_ctx, slot, &rec);
-        if (ret) {
-            goto done;
-        }
-
-        /* check record matches what we are searching for */
-        if (hash != rec->hash2) {
-            /* if uid hash does not match we can skip this immediately */
             slot = sss_nss_mc_next_slot_with_hash(rec, hash);
-            continue;
         }
 
-        data = (struct sss_mc_pwd_data *)rec->data;
-        if (uid == data->uid) {
+        if (!sss_nss_mc_chain_changed(&pw_mc_ctx, hash, seq)) {
             break;
         }
+        /* the chain was modified while we walked it, start over */
+        free(rec);
+        rec = NULL;
+    }
+    if (retries == 0) {
+        /* too busy, let the caller fall back to the responder */
+        ret = EIO;
+        goto done;
+    }
+    if (ret) {
+        goto done;
+    }
 
-        slot = sss_nss_mc_next_slot_with_hash(rec, hash);
+    if (negative) {
+        /* an expired negative record means we have to ask the responder */
+        ret = (rec->expire < time(NULL)) ? ENOENT : SSS_NSS_MC_NEGATIVE;
+        goto done;
     }
 
     if (!MC_SLOT_WITHIN_BOUNDS(slot, pw_mc_ctx.dt_size)) {
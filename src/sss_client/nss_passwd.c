@@ -177,6 +177,9 @@ enum nss_status _nss_sss_getpwnam_r(const char *name, struct passwd *result,
     case ERANGE:
         *errnop = ERANGE;
         return NSS_STATUS_TRYAGAIN;
+    case SSS_NSS_MC_NEGATIVE:
+        *errnop = 0;
+        return NSS_STATUS_NOTFOUND;
     case ENOENT:
         /* fall through, we need to actively ask the parent
          * if no entry is found */
@@ -203,6 +206,10 @@ enum nss_status _nss_sss_getpwnam_r(const char *name, struct passwd *result,
         *errnop = ERANGE;
         nret = NSS_STATUS_TRYAGAIN;
         goto out;
+    case SSS_NSS_MC_NEGATIVE:
+        *errnop = 0;
+        nret = NSS_STATUS_NOTFOUND;
+        goto out;
     case ENOENT:
         /* fall through, we need to actively ask the parent
          * if no entry is found */
@@ -283,6 +290,9 @@ enum nss_status _nss_sss_getpwuid_r(uid_t uid, struct passwd *result,
     case ERANGE:
         *errnop = ERANGE;
         return NSS_STATUS_TRYAGAIN;
+    case SSS_NSS_MC_NEGATIVE:
+        *errnop = 0;
+        return NSS_STATUS_NOTFOUND;
     case ENOENT:
         /* fall through, we need to actively ask the parent
          * if no entry is found */
@@ -310,6 +320,10 @@ enum nss_status _nss_sss_getpwuid_r(uid_t uid, struct passwd *result,
         *errnop = ERANGE;
         nret = NSS_STATUS_TRYAGAIN;
         goto out;
+    case SSS_NSS_MC_NEGATIVE:
+        *errnop = 0;
+        nret = NSS_STATUS_NOTFOUND;
+        goto out;
     case ENOENT:
         /* fall through, we need to actively ask the parent
          * if no entry is found */
@@ -89,6 +89,8 @@ enum sss_cli_command {
 
     SSS_NSS_GETPWNAM_EX    = 0x0019,
     SSS_NSS_GETPWUID_EX    = 0x001A,
+    SSS_NSS_GETPWUID_BATCH = 0x001B, /**< look up at most SSS_NSS_MAX_ENTRIES
+                                          users by UID in one request */
 
 /* group */
 
@@ -101,6 +103,8 @@ enum sss_cli_command {
 
     SSS_NSS_GETGRNAM_EX    = 0x0029,
     SSS_NSS_GETGRGID_EX    = 0x002A,
+    SSS_NSS_GETGRGID_BATCH = 0x002B, /**< look up at most SSS_NSS_MAX_ENTRIES
+                                          groups by GID in one request */
     SSS_NSS_INITGR_EX      = 0x002E,
 
 #if 0
@@ -418,6 +418,112 @@ sbus_method_in_s_out_as_recv
     return EOK;
 }
 
+struct sbus_method_in_s_out_asat_state {
+    struct _sbus_sss_invoker_args_s in;
+    struct _sbus_sss_invoker_args_asat *out;
+};
+
+static void sbus_method_in_s_out_asat_done(struct tevent_req *subreq);
+
+static struct tevent_req *
+sbus_method_in_s_out_asat_send
+    (TALLOC_CTX *mem_ctx,
+     struct sbus_connection *conn,
+     sbus_invoker_keygen keygen,
+     const char *bus,
+     const char *path,
+     const char *iface,
+     const char *method,
+     const char * arg0)
+{
+    struct sbus_method_in_s_out_asat_state *state;
+    struct tevent_req *subreq;
+    struct tevent_req *req;
+    errno_t ret;
+
+    req = tevent_req_create(mem_ctx, &state, struct sbus_method_in_s_out_asat_state);
+    if (req == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to create tevent request!\n");
+        return NULL;
+    }
+
+    state->out = talloc_zero(state, struct _sbus_sss_invoker_args_asat);
+    if (state->out == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Unable to allocate space for output parameters!\n");
+        ret = ENOMEM;
+        goto done;
+    }
+
+    state->in.arg0 = arg0;
+
+    subreq = sbus_call_method_send(state, conn, NULL, keygen,
+                                   (sbus_invoker_writer_fn)_sbus_sss_invoker_write_s,
+                                   bus, path, iface, method, &state->in);
+    if (subreq == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to create subrequest!\n");
+        ret = ENOMEM;
+        goto done;
+    }
+
+    tevent_req_set_callback(subreq, sbus_method_in_s_out_asat_done, req);
+
+    ret = EAGAIN;
+
+done:
+    if (ret != EAGAIN) {
+        tevent_req_error(req, ret);
+        tevent_req_post(req, conn->ev);
+    }
+
+    return req;
+}
+
+static void sbus_method_in_s_out_asat_done(struct tevent_req *subreq)
+{
+    struct sbus_method_in_s_out_asat_state *state;
+    struct tevent_req *req;
+    DBusMessage *reply;
+    errno_t ret;
+
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+    state = tevent_req_data(req, struct sbus_method_in_s_out_asat_state);
+
+    ret = sbus_call_method_recv(state, subreq, &reply);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    ret = sbus_read_output(state->out, reply, (sbus_invoker_reader_fn)_sbus_sss_invoker_read_asat, state->out);
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    tevent_req_done(req);
+    return;
+}
+
+static errno_t
+sbus_method_in_s_out_asat_recv
+    (TALLOC_CTX *mem_ctx,
+     struct tevent_req *req,
+     const char *** _arg0,
+     uint64_t ** _arg1)
+{
+    struct sbus_method_in_s_out_asat_state *state;
+    state = tevent_req_data(req, struct sbus_method_in_s_out_asat_state);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    *_arg0 = talloc_steal(mem_ctx, state->out->arg0);
+    *_arg1 = talloc_steal(mem_ctx, state->out->arg1);
+
+    return EOK;
+}
+
 struct sbus_method_in_s_out_b_state {
     struct _sbus_sss_invoker_args_s in;
     struct _sbus_sss_invoker_args_b *out;
@@ -1853,6 +1959,28 @@ sbus_call_dp_backend_IsOnline_recv
     return sbus_method_in_s_out_b_recv(req, _status);
 }
 
+struct tevent_req *
+sbus_call_dp_backend_TransactionStats_send
+    (TALLOC_CTX *mem_ctx,
+     struct sbus_connection *conn,
+     const char *busname,
+     const char *object_path,
+     const char * arg_domain_name)
+{
+    return sbus_method_in_s_out_asat_send(mem_ctx, conn, _sbus_sss_key_s_0,
+        busname, object_path, "sssd.DataProvider.Backend", "TransactionStats", arg_domain_name);
+}
+
+errno_t
+sbus_call_dp_backend_TransactionStats_recv
+    (TALLOC_CTX *mem_ctx,
+     struct tevent_req *req,
+     const char *** _names,
+     uint64_t ** _values)
+{
+    return sbus_method_in_s_out_asat_recv(mem_ctx, req, _names, _values);
+}
+
 struct tevent_req *
 sbus_call_dp_failover_ActiveServer_send
     (TALLOC_CTX *mem_ctx,
@@ -109,6 +109,21 @@ sbus_call_dp_backend_IsOnline_recv
     (struct tevent_req *req,
      bool* _status);
 
+struct tevent_req *
+sbus_call_dp_backend_TransactionStats_send
+    (TALLOC_CTX *mem_ctx,
+     struct sbus_connection *conn,
+     const char *busname,
+     const char *object_path,
+     const char * arg_domain_name);
+
+errno_t
+sbus_call_dp_backend_TransactionStats_recv
+    (TALLOC_CTX *mem_ctx,
+     struct tevent_req *req,
+     const char *** _names,
+     uint64_t ** _values);
+
 struct tevent_req *
 sbus_call_dp_failover_ActiveServer_send
     (TALLOC_CTX *mem_ctx,
@@ -253,6 +253,28 @@
         (handler_send), (handler_recv), (data)); \
 })
 
+/* Method: sssd.DataProvider.Backend.TransactionStats */
+#define SBUS_METHOD_SYNC_sssd_DataProvider_Backend_TransactionStats(handler, data) ({ \
+    SBUS_CHECK_SYNC((handler), (data), const char *, const char ***, uint64_t **); \
+    sbus_method_sync("TransactionStats", \
+        &_sbus_sss_args_sssd_DataProvider_Backend_TransactionStats, \
+        NULL, \
+        _sbus_sss_invoke_in_s_out_asat_send, \
+        _sbus_sss_key_s_0, \
+        (handler), (data)); \
+})
+
+#define SBUS_METHOD_ASYNC_sssd_DataProvider_Backend_TransactionStats(handler_send, handler_recv, data) ({ \
+    SBUS_CHECK_SEND((handler_send), (data), const char *); \
+    SBUS_CHECK_RECV((handler_recv), const char ***, uint64_t **); \
+    sbus_method_async("TransactionStats", \
+        &_sbus_sss_args_sssd_DataProvider_Backend_TransactionStats, \
+        NULL, \
+        _sbus_sss_invoke_in_s_out_asat_send, \
+        _sbus_sss_key_s_0, \
+        (handler_send), (handler_recv), (data)); \
+})
+
 /* Interface: sssd.DataProvider.Failover */
 #define SBUS_IFACE_sssd_DataProvider_Failover(methods, signals, properties) ({ \
     sbus_interface("sssd.DataProvider.Failover", NULL, \
@@ -134,6 +134,19 @@ _sbus_sss_args_sssd_DataProvider_Backend_IsOnline = {
     }
 };
 
+const struct sbus_method_arguments
+_sbus_sss_args_sssd_DataProvider_Backend_TransactionStats = {
+    .input = (const struct sbus_argument[]){
+        {.type = "s", .name = "domain_name"},
+        {NULL}
+    },
+    .output = (const struct sbus_argument[]){
+        {.type = "as", .name = "names"},
+        {.type = "at", .name = "values"},
+        {NULL}
+    }
+};
+
 const struct sbus_method_arguments
 _sbus_sss_args_sssd_DataProvider_Failover_ActiveServer = {
     .input = (const struct sbus_argument[]){
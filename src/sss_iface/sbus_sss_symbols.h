@@ -49,6 +49,9 @@ _sbus_sss_args_sssd_DataProvider_Autofs_GetMap;
 extern const struct sbus_method_arguments
 _sbus_sss_args_sssd_DataProvider_Backend_IsOnline;
 
+extern const struct sbus_method_arguments
+_sbus_sss_args_sssd_DataProvider_Backend_TransactionStats;
+
 extern const struct sbus_method_arguments
 _sbus_sss_args_sssd_DataProvider_Failover_ActiveServer;
 
@@ -24,6 +24,9 @@
 #include "providers/ldap/ldap_common.h"
 #include "providers/ldap/sdap.h"
 #include "tests/cmocka/common_mock.h"
+#include "tests/cmocka/common_mock_sdap.h"
+
+static struct mock_sdap_search_log *search_log = NULL;
 
 struct sdap_id_ctx *mock_sdap_id_ctx(TALLOC_CTX *mem_ctx,
                                      struct be_ctx *be_ctx,
@@ -67,6 +70,53 @@ struct sdap_handle *mock_sdap_handle(TALLOC_CTX *mem_ctx)
     return handle;
 }
 
+static int mock_sdap_search_log_destructor(struct mock_sdap_search_log *log)
+{
+    if (search_log == log) {
+        search_log = NULL;
+    }
+
+    return 0;
+}
+
+struct mock_sdap_search_log *mock_sdap_search_log(TALLOC_CTX *mem_ctx)
+{
+    struct mock_sdap_search_log *log;
+
+    log = talloc_zero(mem_ctx, struct mock_sdap_search_log);
+    assert_non_null(log);
+
+    talloc_set_destructor(log, mock_sdap_search_log_destructor);
+    search_log = log;
+
+    return log;
+}
+
+static void mock_sdap_search_log_add(const char *search_base,
+                                     int scope,
+                                     const char *filter)
+{
+    struct mock_sdap_search *search;
+
+    if (search_log == NULL) {
+        return;
+    }
+
+    search_log->searches = talloc_realloc(search_log, search_log->searches,
+                                          struct mock_sdap_search,
+                                          search_log->num_searches + 1);
+    assert_non_null(search_log->searches);
+
+    search = &search_log->searches[search_log->num_searches];
+    search->search_base = talloc_strdup(search_log, search_base);
+    assert_non_null(search->search_base);
+    search->scope = scope;
+    search->filter = talloc_strdup(search_log, filter);
+    assert_non_null(search->filter);
+
+    search_log->num_searches++;
+}
+
 /*
  * Mock sdap_async.c
  *
@@ -102,6 +152,8 @@ struct tevent_req *sdap_get_generic_send(TALLOC_CTX *mem_ctx,
                                          int timeout,
                                          bool allow_paging)
 {
+    mock_sdap_search_log_add(search_base, scope, filter);
+
     return test_req_succeed_send(mem_ctx, ev);
 }
 
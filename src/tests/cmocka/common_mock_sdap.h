@@ -37,4 +37,19 @@ struct sdap_id_ctx *mock_sdap_id_ctx(TALLOC_CTX *mem_ctx,
 
 struct sdap_handle *mock_sdap_handle(TALLOC_CTX *mem_ctx);
 
+/* Searches issued through the sdap_get_generic_send() mock are recorded
+ * while a search log is allocated. Freeing the log stops the recording. */
+struct mock_sdap_search {
+    const char *search_base;
+    int scope;
+    const char *filter;
+};
+
+struct mock_sdap_search_log {
+    struct mock_sdap_search *searches;
+    size_t num_searches;
+};
+
+struct mock_sdap_search_log *mock_sdap_search_log(TALLOC_CTX *mem_ctx);
+
 #endif /* COMMON_MOCK_SDAP_H_ */
@@ -0,0 +1,429 @@
+/*
+    SSSD
+
+    memberof - Stress test for nested group membership changes
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+#include "db/sysdb_private.h"
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "tests_conf.ldb"
+#define TEST_ID_PROVIDER "ldap"
+
+#define TEST_DOM_NAME "test_memberof_stress"
+
+#define TEST_BASE_GID           100000
+#define TEST_BASE_UID           200000
+
+/* The defaults keep the run short enough for "make check", use
+ * --groups=10000 for the full size stress run. */
+#define DEFAULT_NUM_GROUPS      800
+#define DEFAULT_NUM_LEVELS      8
+#define DEFAULT_NUM_CHANGES     20
+#define DEFAULT_NUM_GHOSTS      20000
+
+static int num_groups = DEFAULT_NUM_GROUPS;
+static int num_levels = DEFAULT_NUM_LEVELS;
+static int num_changes = DEFAULT_NUM_CHANGES;
+static int num_ghosts = DEFAULT_NUM_GHOSTS;
+
+struct memberof_stress_test_ctx {
+    struct sss_test_ctx *tctx;
+    int width;
+};
+
+const char *domains[] = { TEST_DOM_NAME,
+                          NULL };
+
+static const char *group_name(TALLOC_CTX *mem_ctx, int level, int idx)
+{
+    const char *name;
+
+    name = talloc_asprintf(mem_ctx, "grp_%d_%d", level, idx);
+    assert_non_null(name);
+    return name;
+}
+
+static struct ldb_dn *group_dn(TALLOC_CTX *mem_ctx,
+                               struct memberof_stress_test_ctx *test_ctx,
+                               int level, int idx)
+{
+    struct ldb_dn *dn;
+
+    dn = sysdb_group_dn(mem_ctx, test_ctx->tctx->dom,
+                        group_name(mem_ctx, level, idx));
+    assert_non_null(dn);
+    return dn;
+}
+
+static struct ldb_dn *user_dn(TALLOC_CTX *mem_ctx,
+                              struct memberof_stress_test_ctx *test_ctx,
+                              int idx)
+{
+    struct ldb_dn *dn;
+    const char *name;
+
+    name = talloc_asprintf(mem_ctx, "usr_%d", idx);
+    assert_non_null(name);
+    dn = sysdb_user_dn(mem_ctx, test_ctx->tctx->dom, name);
+    assert_non_null(dn);
+    return dn;
+}
+
+/* Every level holds "width" groups and each group is a member of two
+ * groups of the level above, so most entries are reachable over several
+ * paths. Every group of the lowest level has one user member. */
+static int test_memberof_stress_setup(void **state)
+{
+    struct memberof_stress_test_ctx *test_ctx;
+    struct sss_domain_info *dom;
+    TALLOC_CTX *tmp_ctx;
+    uint64_t start;
+    const char *name;
+    int level;
+    int i;
+    int ret;
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context,
+                           struct memberof_stress_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_dom_suite_setup(TESTS_PATH);
+
+    test_ctx->tctx = create_multidom_test_ctx(test_ctx, TESTS_PATH,
+                                              TEST_CONF_DB, domains,
+                                              TEST_ID_PROVIDER, NULL);
+    assert_non_null(test_ctx->tctx);
+    dom = test_ctx->tctx->dom;
+
+    test_ctx->width = num_groups / num_levels;
+    assert_true(test_ctx->width >= 2 * num_levels);
+
+    tmp_ctx = talloc_new(test_ctx);
+    assert_non_null(tmp_ctx);
+
+    start = test_clock_usec();
+
+    ret = sysdb_transaction_start(dom->sysdb);
+    assert_int_equal(ret, EOK);
+
+    for (level = 0; level < num_levels; level++) {
+        for (i = 0; i < test_ctx->width; i++) {
+            ret = sysdb_add_group(dom, group_name(tmp_ctx, level, i),
+                                  TEST_BASE_GID
+                                      + level * test_ctx->width + i,
+                                  NULL, 0, 0);
+            assert_int_equal(ret, EOK);
+
+            if (level == 0) {
+                continue;
+            }
+
+            ret = sysdb_mod_group_member(dom,
+                                group_dn(tmp_ctx, test_ctx, level, i),
+                                group_dn(tmp_ctx, test_ctx, level - 1, i),
+                                SYSDB_MOD_ADD);
+            assert_int_equal(ret, EOK);
+
+            ret = sysdb_mod_group_member(dom,
+                                group_dn(tmp_ctx, test_ctx, level, i),
+                                group_dn(tmp_ctx, test_ctx, level - 1,
+                                         (i + 1) % test_ctx->width),
+                                SYSDB_MOD_ADD);
+            assert_int_equal(ret, EOK);
+        }
+        talloc_free_children(tmp_ctx);
+    }
+
+    for (i = 0; i < test_ctx->width; i++) {
+        name = talloc_asprintf(tmp_ctx, "usr_%d", i);
+        assert_non_null(name);
+
+        ret = sysdb_add_user(dom, name, TEST_BASE_UID + i, TEST_BASE_GID,
+                             name, "/home/test", "/bin/bash",
+                             NULL, NULL, 0, 0);
+        assert_int_equal(ret, EOK);
+
+        ret = sysdb_mod_group_member(dom,
+                            user_dn(tmp_ctx, test_ctx, i),
+                            group_dn(tmp_ctx, test_ctx, num_levels - 1, i),
+                            SYSDB_MOD_ADD);
+        assert_int_equal(ret, EOK);
+        talloc_free_children(tmp_ctx);
+    }
+
+    ret = sysdb_transaction_commit(dom->sysdb);
+    assert_int_equal(ret, EOK);
+
+    print_message("Built %d groups in %d levels in %"PRIu64" ms\n",
+                  test_ctx->width * num_levels, num_levels,
+                  (test_clock_usec() - start) / 1000);
+
+    talloc_free(tmp_ctx);
+    *state = test_ctx;
+    return 0;
+}
+
+static int test_memberof_stress_teardown(void **state)
+{
+    struct memberof_stress_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                            struct memberof_stress_test_ctx);
+
+    talloc_zfree(test_ctx);
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    return 0;
+}
+
+static bool group_has_ghost(struct memberof_stress_test_ctx *test_ctx,
+                            const char *group,
+                            const char *ghost)
+{
+    const char *attrs[] = { SYSDB_GHOST, NULL };
+    struct ldb_message *msg;
+    struct ldb_val val;
+    bool found;
+    int ret;
+
+    ret = sysdb_search_group_by_name(test_ctx, test_ctx->tctx->dom,
+                                     group, attrs, &msg);
+    assert_int_equal(ret, EOK);
+
+    val.data = discard_const_p(uint8_t, ghost);
+    val.length = strlen(ghost);
+    found = ldb_msg_find_val(ldb_msg_find_element(msg, SYSDB_GHOST),
+                             &val) != NULL;
+
+    talloc_free(msg);
+    return found;
+}
+
+static void set_ghosts(struct memberof_stress_test_ctx *test_ctx,
+                       const char *group,
+                       int first,
+                       int count)
+{
+    struct sysdb_attrs *attrs;
+    char *name;
+    int i;
+    int ret;
+
+    attrs = sysdb_new_attrs(test_ctx);
+    assert_non_null(attrs);
+
+    for (i = first; i < first + count; i++) {
+        name = talloc_asprintf(attrs, "ghost_%d", i);
+        assert_non_null(name);
+        ret = sysdb_attrs_add_string(attrs, SYSDB_GHOST, name);
+        assert_int_equal(ret, EOK);
+    }
+
+    ret = sysdb_set_group_attr(test_ctx->tctx->dom, group, attrs,
+                               SYSDB_MOD_REP);
+    assert_int_equal(ret, EOK);
+    talloc_free(attrs);
+}
+
+static bool user_is_memberof(struct memberof_stress_test_ctx *test_ctx,
+                             int user_idx,
+                             struct ldb_dn *parent)
+{
+    const char *attrs[] = { SYSDB_MEMBEROF, NULL };
+    struct ldb_message_element *el;
+    struct ldb_message *msg;
+    char *name;
+    const char *parent_str;
+    bool found = false;
+    unsigned int i;
+    int ret;
+
+    name = talloc_asprintf(test_ctx, "usr_%d", user_idx);
+    assert_non_null(name);
+
+    ret = sysdb_search_user_by_name(test_ctx, test_ctx->tctx->dom,
+                                    name, attrs, &msg);
+    assert_int_equal(ret, EOK);
+
+    parent_str = ldb_dn_get_linearized(parent);
+    el = ldb_msg_find_element(msg, SYSDB_MEMBEROF);
+    for (i = 0; el != NULL && i < el->num_values; i++) {
+        if (strcasecmp((const char *) el->values[i].data, parent_str) == 0) {
+            found = true;
+            break;
+        }
+    }
+
+    talloc_free(msg);
+    talloc_free(name);
+    return found;
+}
+
+/* Attach a group of the lowest level directly to a top level group it is
+ * not yet nested in and detach it again. Both changes have to reach the
+ * user at the bottom of the hierarchy. */
+static void test_memberof_stress_changes(void **state)
+{
+    struct memberof_stress_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                            struct memberof_stress_test_ctx);
+    struct sss_domain_info *dom = test_ctx->tctx->dom;
+    struct ldb_dn *member;
+    struct ldb_dn *parent;
+    uint64_t start;
+    uint64_t add_usec = 0;
+    uint64_t del_usec = 0;
+    int changes;
+    int idx;
+    int i;
+    int ret;
+
+    changes = MIN(num_changes, test_ctx->width);
+
+    for (i = 0; i < changes; i++) {
+        idx = i * (test_ctx->width / changes);
+        member = group_dn(test_ctx, test_ctx, num_levels - 1, idx);
+        parent = group_dn(test_ctx, test_ctx, 0,
+                          (idx + test_ctx->width / 2) % test_ctx->width);
+
+        assert_false(user_is_memberof(test_ctx, idx, parent));
+
+        start = test_clock_usec();
+        ret = sysdb_mod_group_member(dom, member, parent, SYSDB_MOD_ADD);
+        add_usec += test_clock_usec() - start;
+        assert_int_equal(ret, EOK);
+
+        assert_true(user_is_memberof(test_ctx, idx, parent));
+
+        start = test_clock_usec();
+        ret = sysdb_mod_group_member(dom, member, parent, SYSDB_MOD_DEL);
+        del_usec += test_clock_usec() - start;
+        assert_int_equal(ret, EOK);
+
+        assert_false(user_is_memberof(test_ctx, idx, parent));
+
+        talloc_free(member);
+        talloc_free(parent);
+    }
+
+    print_message("%d membership changes: add %"PRIu64" us/change, "
+                  "delete %"PRIu64" us/change\n",
+                  changes, add_usec / changes, del_usec / changes);
+}
+
+/* Resend the whole ghost list of a large nested group with one member
+ * replaced, as a refresh does. Only the difference may reach the
+ * parent groups. */
+static void test_memberof_stress_ghosts(void **state)
+{
+    struct memberof_stress_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                            struct memberof_stress_test_ctx);
+    const char *group;
+    const char *top;
+    uint64_t start;
+
+    group = group_name(test_ctx, num_levels - 1, 0);
+    top = group_name(test_ctx, 0, 0);
+
+    start = test_clock_usec();
+    set_ghosts(test_ctx, group, 0, num_ghosts);
+    print_message("Stored %d ghost members in %"PRIu64" ms\n",
+                  num_ghosts, (test_clock_usec() - start) / 1000);
+
+    assert_true(group_has_ghost(test_ctx, top, "ghost_0"));
+
+    start = test_clock_usec();
+    set_ghosts(test_ctx, group, 1, num_ghosts);
+    print_message("Replaced %d ghost members in %"PRIu64" ms\n",
+                  num_ghosts, (test_clock_usec() - start) / 1000);
+
+    assert_false(group_has_ghost(test_ctx, top, "ghost_0"));
+    assert_true(group_has_ghost(test_ctx, top, "ghost_1"));
+    assert_true(group_has_ghost(test_ctx, top,
+                                talloc_asprintf(test_ctx, "ghost_%d",
+                                                num_ghosts)));
+}
+
+int main(int argc, const char *argv[])
+{
+    int rv;
+    int no_cleanup = 0;
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        {"no-cleanup", 'n', POPT_ARG_NONE, &no_cleanup, 0,
+         _("Do not delete the test database after a test run"), NULL },
+        {"groups", 0, POPT_ARG_INT, &num_groups, 0,
+         _("Number of groups to create"), NULL },
+        {"levels", 0, POPT_ARG_INT, &num_levels, 0,
+         _("Number of nesting levels"), NULL },
+        {"changes", 0, POPT_ARG_INT, &num_changes, 0,
+         _("Number of membership changes to measure"), NULL },
+        {"ghosts", 0, POPT_ARG_INT, &num_ghosts, 0,
+         _("Number of ghost members of the large group"), NULL },
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_memberof_stress_changes,
+                                        test_memberof_stress_setup,
+                                        test_memberof_stress_teardown),
+        cmocka_unit_test_setup_teardown(test_memberof_stress_ghosts,
+                                        test_memberof_stress_setup,
+                                        test_memberof_stress_teardown),
+    };
+
+    /* Set debug level to invalid value so we can decide if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    if (num_levels < 2 || num_changes < 1 || num_ghosts < 1
+            || num_groups / num_levels < 2 * num_levels) {
+        fprintf(stderr, "\nInvalid stress test size\n\n");
+        return 1;
+    }
+
+    DEBUG_CLI_INIT(debug_level);
+
+    tests_set_cwd();
+    test_multidom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, domains);
+    test_dom_suite_setup(TESTS_PATH);
+    rv = cmocka_run_group_tests(tests, NULL, NULL);
+
+    if (rv == 0 && no_cleanup == 0) {
+        test_multidom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, domains);
+    }
+    return rv;
+}
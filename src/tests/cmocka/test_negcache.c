@@ -29,7 +29,10 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <inttypes.h>
+#include <fcntl.h>
+#include <time.h>
 #include <cmocka.h>
+#include <tdb.h>
 
 #include "tests/cmocka/common_mock.h"
 #include "tests/cmocka/common_mock_resp.h"
@@ -1330,6 +1333,213 @@ static void test_sss_ncache_domain_locate_type(void **state)
     assert_int_equal(ret, ENOENT);
 }
 
+#define NUM_BULK_DOMAINS 15
+#define NUM_BULK_NAMES 1000
+
+static struct sss_domain_info **bulk_domains(TALLOC_CTX *mem_ctx)
+{
+    struct sss_domain_info **doms;
+    int i;
+
+    doms = talloc_array(mem_ctx, struct sss_domain_info *, NUM_BULK_DOMAINS);
+    assert_non_null(doms);
+
+    for (i = 0; i < NUM_BULK_DOMAINS; i++) {
+        doms[i] = talloc_zero(doms, struct sss_domain_info);
+        assert_non_null(doms[i]);
+        doms[i]->name = talloc_asprintf(doms[i], "dom%d.test", i);
+        assert_non_null(doms[i]->name);
+        doms[i]->case_sensitive = true;
+    }
+
+    return doms;
+}
+
+static void test_sss_ncache_many_entries(void **state)
+{
+    errno_t ret;
+    struct test_state *ts;
+    struct sss_domain_info **doms;
+    char name[64];
+    int i;
+    int d;
+
+    ts = talloc_get_type_abort(*state, struct test_state);
+    doms = bulk_domains(ts);
+
+    for (d = 0; d < NUM_BULK_DOMAINS; d++) {
+        for (i = 0; i < NUM_BULK_NAMES; i++) {
+            snprintf(name, sizeof(name), "user%d", i);
+            ret = sss_ncache_set_user(ts->ctx, true, doms[d], name);
+            assert_int_equal(ret, EOK);
+            ret = sss_ncache_set_uid(ts->ctx, true, doms[d], i);
+            assert_int_equal(ret, EOK);
+        }
+    }
+
+    for (d = 0; d < NUM_BULK_DOMAINS; d++) {
+        for (i = 0; i < NUM_BULK_NAMES; i++) {
+            snprintf(name, sizeof(name), "user%d", i);
+            ret = sss_ncache_check_user(ts->ctx, doms[d], name);
+            assert_int_equal(ret, EEXIST);
+            ret = sss_ncache_check_uid(ts->ctx, doms[d], i);
+            assert_int_equal(ret, EEXIST);
+
+            /* same keys of a different type or without domain */
+            ret = sss_ncache_check_group(ts->ctx, doms[d], name);
+            assert_int_equal(ret, ENOENT);
+            ret = sss_ncache_check_uid(ts->ctx, NULL, i);
+            assert_int_equal(ret, ENOENT);
+        }
+
+        snprintf(name, sizeof(name), "user%d", NUM_BULK_NAMES);
+        ret = sss_ncache_check_user(ts->ctx, doms[d], name);
+        assert_int_equal(ret, ENOENT);
+    }
+
+    ret = sss_ncache_reset_permanent(ts->ctx);
+    assert_int_equal(ret, EOK);
+
+    for (d = 0; d < NUM_BULK_DOMAINS; d++) {
+        for (i = 0; i < NUM_BULK_NAMES; i++) {
+            snprintf(name, sizeof(name), "user%d", i);
+            ret = sss_ncache_check_user(ts->ctx, doms[d], name);
+            assert_int_equal(ret, ENOENT);
+            ret = sss_ncache_check_uid(ts->ctx, doms[d], i);
+            assert_int_equal(ret, ENOENT);
+        }
+    }
+
+    talloc_free(doms);
+}
+
+/* The negative cache used to keep its entries in an internal TDB, the
+ * benchmark below runs the same workload against such a TDB with the old
+ * key format so that both can be compared. It only reports the numbers. */
+static int tdb_ncache_check(struct tdb_context *tdb, const char *domain,
+                            const char *name)
+{
+    TDB_DATA key;
+    TDB_DATA data;
+    unsigned long long int timestamp;
+    char *str;
+    int ret;
+
+    str = talloc_asprintf(NULL, "NCE/USER/%s/%s", domain, name);
+    assert_non_null(str);
+
+    key.dptr = (uint8_t *)str;
+    key.dsize = strlen(str) + 1;
+    data = tdb_fetch(tdb, key);
+    if (data.dptr == NULL) {
+        ret = ENOENT;
+    } else {
+        timestamp = strtoull((const char *)data.dptr, NULL, 10);
+        ret = (timestamp >= time(NULL)) ? EEXIST : ENOENT;
+    }
+
+    free(data.dptr);
+    talloc_free(str);
+    return ret;
+}
+
+static void tdb_ncache_set(struct tdb_context *tdb, const char *domain,
+                           const char *name)
+{
+    TDB_DATA key;
+    TDB_DATA data;
+    char *str;
+    char *timest;
+    int ret;
+
+    str = talloc_asprintf(NULL, "NCE/USER/%s/%s", domain, name);
+    assert_non_null(str);
+    timest = talloc_asprintf(str, "%llu",
+                             (unsigned long long int)time(NULL) + 3600);
+    assert_non_null(timest);
+
+    key.dptr = (uint8_t *)str;
+    key.dsize = strlen(str) + 1;
+    data.dptr = (uint8_t *)timest;
+    data.dsize = strlen(timest) + 1;
+    ret = tdb_store(tdb, key, data, TDB_REPLACE);
+    assert_int_equal(ret, 0);
+
+    talloc_free(str);
+}
+
+static void test_sss_ncache_bench(void **state)
+{
+    errno_t ret;
+    struct test_state *ts;
+    struct sss_domain_info **doms;
+    struct sss_nc_ctx *ncache;
+    struct tdb_context *tdb;
+    uint64_t start;
+    double nc_set, nc_check, tdb_set, tdb_check;
+    char name[64];
+    int i;
+    int d;
+
+    ts = talloc_get_type_abort(*state, struct test_state);
+    doms = bulk_domains(ts);
+
+    ret = sss_ncache_init(ts, 3600, &ncache);
+    assert_int_equal(ret, EOK);
+
+    tdb = tdb_open("bench", 0, TDB_INTERNAL, O_RDWR|O_CREAT, 0);
+    assert_non_null(tdb);
+
+    /* every name is set in the last domain only, a lookup walks all
+     * domains like cache_req does and misses in all but the last one */
+    start = test_clock_usec();
+    for (i = 0; i < NUM_BULK_NAMES; i++) {
+        snprintf(name, sizeof(name), "user%d", i);
+        ret = sss_ncache_set_user(ncache, false,
+                                  doms[NUM_BULK_DOMAINS - 1], name);
+        assert_int_equal(ret, EOK);
+    }
+    nc_set = (test_clock_usec() - start) / 1000.0;
+
+    start = test_clock_usec();
+    for (i = 0; i < NUM_BULK_NAMES; i++) {
+        snprintf(name, sizeof(name), "user%d", i);
+        for (d = 0; d < NUM_BULK_DOMAINS; d++) {
+            ret = sss_ncache_check_user(ncache, doms[d], name);
+            assert_int_equal(ret, d == NUM_BULK_DOMAINS - 1 ? EEXIST : ENOENT);
+        }
+    }
+    nc_check = (test_clock_usec() - start) / 1000.0;
+
+    start = test_clock_usec();
+    for (i = 0; i < NUM_BULK_NAMES; i++) {
+        snprintf(name, sizeof(name), "user%d", i);
+        tdb_ncache_set(tdb, doms[NUM_BULK_DOMAINS - 1]->name, name);
+    }
+    tdb_set = (test_clock_usec() - start) / 1000.0;
+
+    start = test_clock_usec();
+    for (i = 0; i < NUM_BULK_NAMES; i++) {
+        snprintf(name, sizeof(name), "user%d", i);
+        for (d = 0; d < NUM_BULK_DOMAINS; d++) {
+            ret = tdb_ncache_check(tdb, doms[d]->name, name);
+            assert_int_equal(ret, d == NUM_BULK_DOMAINS - 1 ? EEXIST : ENOENT);
+        }
+    }
+    tdb_check = (test_clock_usec() - start) / 1000.0;
+
+    print_message("negcache: %d sets %.3f ms, %d checks %.3f ms\n",
+                  NUM_BULK_NAMES, nc_set,
+                  NUM_BULK_NAMES * NUM_BULK_DOMAINS, nc_check);
+    print_message("tdb:      %d sets %.3f ms, %d checks %.3f ms\n",
+                  NUM_BULK_NAMES, tdb_set,
+                  NUM_BULK_NAMES * NUM_BULK_DOMAINS, tdb_check);
+
+    tdb_close(tdb);
+    talloc_free(ncache);
+    talloc_free(doms);
+}
+
 int main(void)
 {
     int rv;
@@ -1364,6 +1574,10 @@ int main(void)
                                         setup, teardown),
         cmocka_unit_test_setup_teardown(test_sss_ncache_domain_locate_type,
                                         setup, teardown),
+        cmocka_unit_test_setup_teardown(test_sss_ncache_many_entries,
+                                        setup, teardown),
+        cmocka_unit_test_setup_teardown(test_sss_ncache_bench,
+                                        setup, teardown),
 
         /* user */
         cmocka_unit_test_setup_teardown(test_ncache_nocache_user,
@@ -188,8 +188,7 @@ static void nested_groups_test_one_group_unique_members(void **state)
     const char *users[] = { "cn=user1,"USER_BASE_DN,
                             "cn=user2,"USER_BASE_DN,
                             NULL };
-    const struct sysdb_attrs *user1_reply[2] = { NULL };
-    const struct sysdb_attrs *user2_reply[2] = { NULL };
+    const struct sysdb_attrs *users_reply[3] = { NULL };
     const char * expected[] = { "user1",
                                 "user2" };
 
@@ -200,16 +199,13 @@ static void nested_groups_test_one_group_unique_members(void **state)
     rootgroup = mock_sysdb_group_rfc2307bis(test_ctx, GROUP_BASE_DN, 1000,
                                             "rootgroup", users);
 
-    user1_reply[0] = mock_sysdb_user(test_ctx, USER_BASE_DN, 2001, "user1");
-    assert_non_null(user1_reply[0]);
-    will_return(sdap_get_generic_recv, 1);
-    will_return(sdap_get_generic_recv, user1_reply);
-    will_return(sdap_get_generic_recv, ERR_OK);
-
-    user2_reply[0] = mock_sysdb_user(test_ctx, USER_BASE_DN, 2002, "user2");
-    assert_non_null(user2_reply[0]);
-    will_return(sdap_get_generic_recv, 1);
-    will_return(sdap_get_generic_recv, user2_reply);
+    /* both users are in the same container, one search is enough */
+    users_reply[0] = mock_sysdb_user(test_ctx, USER_BASE_DN, 2001, "user1");
+    assert_non_null(users_reply[0]);
+    users_reply[1] = mock_sysdb_user(test_ctx, USER_BASE_DN, 2002, "user2");
+    assert_non_null(users_reply[1]);
+    will_return(sdap_get_generic_recv, 2);
+    will_return(sdap_get_generic_recv, users_reply);
     will_return(sdap_get_generic_recv, ERR_OK);
 
     sss_will_return_always(sdap_has_deref_support, false);
@@ -329,7 +325,6 @@ static void nested_groups_test_one_group_dup_users(void **state)
                             "cn=user1,"USER_BASE_DN,
                             NULL };
     const struct sysdb_attrs *user1_reply[2] = { NULL };
-    const struct sysdb_attrs *user2_reply[2] = { NULL };
 
     test_ctx = talloc_get_type_abort(*state, struct nested_groups_test_ctx);
 
@@ -337,18 +332,13 @@ static void nested_groups_test_one_group_dup_users(void **state)
     rootgroup = mock_sysdb_group_rfc2307bis(test_ctx, GROUP_BASE_DN, 1000,
                                             "rootgroup", users);
 
+    /* the duplicate member is looked up only once */
     user1_reply[0] = mock_sysdb_user(test_ctx, USER_BASE_DN, 2001, "user1");
     assert_non_null(user1_reply[0]);
     will_return(sdap_get_generic_recv, 1);
     will_return(sdap_get_generic_recv, user1_reply);
     will_return(sdap_get_generic_recv, ERR_OK);
 
-    user2_reply[0] = mock_sysdb_user(test_ctx, USER_BASE_DN, 2001, "user1");
-    assert_non_null(user2_reply[0]);
-    will_return(sdap_get_generic_recv, 1);
-    will_return(sdap_get_generic_recv, user2_reply);
-    will_return(sdap_get_generic_recv, ERR_OK);
-
     sss_will_return_always(sdap_has_deref_support, false);
 
     /* run test, check for memory leaks */
@@ -388,8 +378,7 @@ static void nested_groups_test_one_group_unique_group_members(void **state)
     const char *groups[] = { "cn=emptygroup1,"GROUP_BASE_DN,
                              "cn=emptygroup2,"GROUP_BASE_DN,
                              NULL };
-    const struct sysdb_attrs *group1_reply[2] = { NULL };
-    const struct sysdb_attrs *group2_reply[2] = { NULL };
+    const struct sysdb_attrs *groups_reply[3] = { NULL };
     const char * expected[] = { "rootgroup",
                                 "emptygroup1",
                                 "emptygroup2" };
@@ -400,18 +389,15 @@ static void nested_groups_test_one_group_unique_group_members(void **state)
     rootgroup = mock_sysdb_group_rfc2307bis(test_ctx, GROUP_BASE_DN, 1000,
                                             "rootgroup", groups);
 
-    group1_reply[0] = mock_sysdb_group_rfc2307bis(test_ctx, GROUP_BASE_DN,
+    /* both groups are in the same container, one search is enough */
+    groups_reply[0] = mock_sysdb_group_rfc2307bis(test_ctx, GROUP_BASE_DN,
                                                   1001, "emptygroup1", NULL);
-    assert_non_null(group1_reply[0]);
-    will_return(sdap_get_generic_recv, 1);
-    will_return(sdap_get_generic_recv, group1_reply);
-    will_return(sdap_get_generic_recv, ERR_OK);
-
-    group2_reply[0] = mock_sysdb_group_rfc2307bis(test_ctx, GROUP_BASE_DN,
+    assert_non_null(groups_reply[0]);
+    groups_reply[1] = mock_sysdb_group_rfc2307bis(test_ctx, GROUP_BASE_DN,
                                                   1002, "emptygroup2", NULL);
-    assert_non_null(group2_reply[0]);
-    will_return(sdap_get_generic_recv, 1);
-    will_return(sdap_get_generic_recv, group2_reply);
+    assert_non_null(groups_reply[1]);
+    will_return(sdap_get_generic_recv, 2);
+    will_return(sdap_get_generic_recv, groups_reply);
     will_return(sdap_get_generic_recv, ERR_OK);
 
     sss_will_return_always(sdap_has_deref_support, false);
@@ -453,7 +439,6 @@ static void nested_groups_test_one_group_dup_group_members(void **state)
                              "cn=emptygroup1,"GROUP_BASE_DN,
                              NULL };
     const struct sysdb_attrs *group1_reply[2] = { NULL };
-    const struct sysdb_attrs *group2_reply[2] = { NULL };
     const char * expected[] = { "rootgroup",
                                 "emptygroup1" };
 
@@ -463,6 +448,7 @@ static void nested_groups_test_one_group_dup_group_members(void **state)
     rootgroup = mock_sysdb_group_rfc2307bis(test_ctx, GROUP_BASE_DN, 1000,
                                             "rootgroup", groups);
 
+    /* the duplicate member is looked up only once */
     group1_reply[0] = mock_sysdb_group_rfc2307bis(test_ctx, GROUP_BASE_DN,
                                                   1001, "emptygroup1", NULL);
     assert_non_null(group1_reply[0]);
@@ -470,13 +456,6 @@ static void nested_groups_test_one_group_dup_group_members(void **state)
     will_return(sdap_get_generic_recv, group1_reply);
     will_return(sdap_get_generic_recv, ERR_OK);
 
-    group2_reply[0] = mock_sysdb_group_rfc2307bis(test_ctx, GROUP_BASE_DN,
-                                                  1001, "emptygroup1", NULL);
-    assert_non_null(group2_reply[0]);
-    will_return(sdap_get_generic_recv, 1);
-    will_return(sdap_get_generic_recv, group2_reply);
-    will_return(sdap_get_generic_recv, ERR_OK);
-
     sss_will_return_always(sdap_has_deref_support, false);
 
     /* run test, check for memory leaks */
@@ -667,6 +646,226 @@ static void nested_groups_test_nested_chain_with_error(void **state)
     assert_int_equal(ret, EIO);
 }
 
+static void assert_batched_search(struct mock_sdap_search *search,
+                                  const char *search_base,
+                                  int scope,
+                                  size_t num_rdns)
+{
+    const char *pos;
+    size_t count = 0;
+
+    assert_string_equal(search->search_base, search_base);
+    assert_int_equal(search->scope, scope);
+
+    if (scope == LDAP_SCOPE_ONELEVEL) {
+        assert_non_null(strstr(search->filter, "(|(cn="));
+    }
+
+    for (pos = strstr(search->filter, "(cn=");
+         pos != NULL;
+         pos = strstr(pos + 1, "(cn=")) {
+        count++;
+    }
+    assert_int_equal(count, num_rdns);
+}
+
+#define NUM_CHUNKED_USERS 60
+
+static void nested_groups_test_one_group_chunked_members(void **state)
+{
+    struct nested_groups_test_ctx *test_ctx = NULL;
+    struct mock_sdap_search_log *log = NULL;
+    struct sysdb_attrs *rootgroup = NULL;
+    struct tevent_req *req = NULL;
+    TALLOC_CTX *req_mem_ctx = NULL;
+    errno_t ret;
+    const char *users[NUM_CHUNKED_USERS + 1] = { NULL };
+    const char *expected[NUM_CHUNKED_USERS] = { NULL };
+    const struct sysdb_attrs *chunk1_reply[NESTED_GROUP_LOOKUP_CHUNK + 1] = { NULL };
+    const struct sysdb_attrs *chunk2_reply[NUM_CHUNKED_USERS
+                                    - NESTED_GROUP_LOOKUP_CHUNK + 1] = { NULL };
+    char *name;
+    int i, j;
+
+    test_ctx = talloc_get_type_abort(*state, struct nested_groups_test_ctx);
+    log = mock_sdap_search_log(test_ctx);
+
+    /* mock return values */
+    for (i = 0; i < NUM_CHUNKED_USERS; i++) {
+        name = talloc_asprintf(test_ctx, "user%d", i + 1);
+        assert_non_null(name);
+        expected[i] = name;
+        users[i] = talloc_asprintf(test_ctx, "cn=%s,"USER_BASE_DN, name);
+        assert_non_null(users[i]);
+
+        if (i < NESTED_GROUP_LOOKUP_CHUNK) {
+            chunk1_reply[i] = mock_sysdb_user(test_ctx, USER_BASE_DN,
+                                              2001 + i, name);
+            assert_non_null(chunk1_reply[i]);
+        } else {
+            j = i - NESTED_GROUP_LOOKUP_CHUNK;
+            chunk2_reply[j] = mock_sysdb_user(test_ctx, USER_BASE_DN,
+                                              2001 + i, name);
+            assert_non_null(chunk2_reply[j]);
+        }
+    }
+
+    rootgroup = mock_sysdb_group_rfc2307bis(test_ctx, GROUP_BASE_DN, 1000,
+                                            "rootgroup", users);
+    assert_non_null(rootgroup);
+
+    /* all users are in the same container but do not fit into one search */
+    will_return(sdap_get_generic_recv, NESTED_GROUP_LOOKUP_CHUNK);
+    will_return(sdap_get_generic_recv, chunk1_reply);
+    will_return(sdap_get_generic_recv, ERR_OK);
+    will_return(sdap_get_generic_recv,
+                NUM_CHUNKED_USERS - NESTED_GROUP_LOOKUP_CHUNK);
+    will_return(sdap_get_generic_recv, chunk2_reply);
+    will_return(sdap_get_generic_recv, ERR_OK);
+
+    sss_will_return_always(sdap_has_deref_support, false);
+
+    /* run test, check for memory leaks */
+    req_mem_ctx = talloc_new(global_talloc_context);
+    assert_non_null(req_mem_ctx);
+    check_leaks_push(req_mem_ctx);
+
+    req = sdap_nested_group_send(req_mem_ctx, test_ctx->tctx->ev,
+                                 test_ctx->sdap_domain, test_ctx->sdap_opts,
+                                 test_ctx->sdap_handle, rootgroup);
+    assert_non_null(req);
+    tevent_req_set_callback(req, nested_groups_test_done, test_ctx);
+
+    ret = test_ev_loop(test_ctx->tctx);
+    assert_true(check_leaks_pop(req_mem_ctx) == true);
+    talloc_zfree(req_mem_ctx);
+
+    /* check return code */
+    assert_int_equal(ret, ERR_OK);
+
+    /* check the searches */
+    assert_int_equal(log->num_searches, 2);
+    assert_batched_search(&log->searches[0], USER_BASE_DN,
+                          LDAP_SCOPE_ONELEVEL, NESTED_GROUP_LOOKUP_CHUNK);
+    assert_batched_search(&log->searches[1], USER_BASE_DN,
+                          LDAP_SCOPE_ONELEVEL,
+                          NUM_CHUNKED_USERS - NESTED_GROUP_LOOKUP_CHUNK);
+
+    /* check the users */
+    assert_int_equal(test_ctx->num_users, NUM_CHUNKED_USERS);
+    assert_int_equal(test_ctx->num_groups, 1);
+
+    compare_sysdb_string_array_noorder(test_ctx->users,
+                                       expected, N_ELEMENTS(expected));
+}
+
+static void nested_groups_test_multi_level_lookup_once(void **state)
+{
+    struct nested_groups_test_ctx *test_ctx = NULL;
+    struct mock_sdap_search_log *log = NULL;
+    struct tevent_req *req = NULL;
+    TALLOC_CTX *req_mem_ctx = NULL;
+    errno_t ret;
+    const char *rootgroup_members[] = { "cn=user1,"USER_BASE_DN,
+                                        "cn=group1,"GROUP_BASE_DN,
+                                        "cn=group2,"GROUP_BASE_DN,
+                                        NULL };
+    const char *group1_members[] = { "cn=user1,"USER_BASE_DN,
+                                     "cn=user2,"USER_BASE_DN,
+                                     "cn=group2,"GROUP_BASE_DN,
+                                     NULL };
+    const char *group2_members[] = { "cn=user2,"USER_BASE_DN,
+                                     "cn=user3,"USER_BASE_DN,
+                                     NULL };
+    struct sysdb_attrs *rootgroup;
+    const struct sysdb_attrs *user1_reply[2] = { NULL };
+    const struct sysdb_attrs *groups_reply[3] = { NULL };
+    const struct sysdb_attrs *users_reply[3] = { NULL };
+    const char *expected_groups[] = { "rootgroup", "group1", "group2" };
+    const char *expected_users[] = { "user1", "user2", "user3" };
+
+    test_ctx = talloc_get_type_abort(*state, struct nested_groups_test_ctx);
+    log = mock_sdap_search_log(test_ctx);
+
+    /* mock return values */
+    rootgroup = mock_sysdb_group_rfc2307bis(test_ctx, GROUP_BASE_DN, 1000,
+                                            "rootgroup", rootgroup_members);
+    assert_non_null(rootgroup);
+
+    /* first level: user1 is read directly, both groups in one search */
+    user1_reply[0] = mock_sysdb_user(test_ctx, USER_BASE_DN, 2001, "user1");
+    assert_non_null(user1_reply[0]);
+    will_return(sdap_get_generic_recv, 1);
+    will_return(sdap_get_generic_recv, user1_reply);
+    will_return(sdap_get_generic_recv, ERR_OK);
+
+    groups_reply[0] = mock_sysdb_group_rfc2307bis(test_ctx, GROUP_BASE_DN,
+                                                  1001, "group1",
+                                                  group1_members);
+    assert_non_null(groups_reply[0]);
+    groups_reply[1] = mock_sysdb_group_rfc2307bis(test_ctx, GROUP_BASE_DN,
+                                                  1002, "group2",
+                                                  group2_members);
+    assert_non_null(groups_reply[1]);
+    will_return(sdap_get_generic_recv, 2);
+    will_return(sdap_get_generic_recv, groups_reply);
+    will_return(sdap_get_generic_recv, ERR_OK);
+
+    /* second level: user1 and group2 were already looked up, user2 is
+     * a member of both groups but is searched only once */
+    users_reply[0] = mock_sysdb_user(test_ctx, USER_BASE_DN, 2002, "user2");
+    assert_non_null(users_reply[0]);
+    users_reply[1] = mock_sysdb_user(test_ctx, USER_BASE_DN, 2003, "user3");
+    assert_non_null(users_reply[1]);
+    will_return(sdap_get_generic_recv, 2);
+    will_return(sdap_get_generic_recv, users_reply);
+    will_return(sdap_get_generic_recv, ERR_OK);
+
+    sss_will_return_always(sdap_has_deref_support, false);
+
+    /* run test, check for memory leaks */
+    req_mem_ctx = talloc_new(global_talloc_context);
+    assert_non_null(req_mem_ctx);
+    check_leaks_push(req_mem_ctx);
+
+    req = sdap_nested_group_send(req_mem_ctx, test_ctx->tctx->ev,
+                                 test_ctx->sdap_domain, test_ctx->sdap_opts,
+                                 test_ctx->sdap_handle, rootgroup);
+    assert_non_null(req);
+    tevent_req_set_callback(req, nested_groups_test_done, test_ctx);
+
+    ret = test_ev_loop(test_ctx->tctx);
+    assert_true(check_leaks_pop(req_mem_ctx) == true);
+    talloc_zfree(req_mem_ctx);
+
+    /* check return code */
+    assert_int_equal(ret, ERR_OK);
+
+    /* check the searches */
+    assert_int_equal(log->num_searches, 3);
+    assert_batched_search(&log->searches[0], "cn=user1,"USER_BASE_DN,
+                          LDAP_SCOPE_BASE, 0);
+    assert_batched_search(&log->searches[1], GROUP_BASE_DN,
+                          LDAP_SCOPE_ONELEVEL, 2);
+    assert_non_null(strstr(log->searches[1].filter, "(cn=group1)"));
+    assert_non_null(strstr(log->searches[1].filter, "(cn=group2)"));
+    assert_batched_search(&log->searches[2], USER_BASE_DN,
+                          LDAP_SCOPE_ONELEVEL, 2);
+    assert_non_null(strstr(log->searches[2].filter, "(cn=user2)"));
+    assert_non_null(strstr(log->searches[2].filter, "(cn=user3)"));
+
+    /* check the members */
+    assert_int_equal(test_ctx->num_users, N_ELEMENTS(expected_users));
+    assert_int_equal(test_ctx->num_groups, N_ELEMENTS(expected_groups));
+
+    compare_sysdb_string_array_noorder(test_ctx->groups,
+                                       expected_groups,
+                                       N_ELEMENTS(expected_groups));
+    compare_sysdb_string_array_noorder(test_ctx->users,
+                                       expected_users,
+                                       N_ELEMENTS(expected_users));
+}
+
 static int nested_groups_test_setup(void **state)
 {
     errno_t ret;
@@ -984,21 +1183,12 @@ mock_group_with_ext_members(struct nested_groups_test_ctx *test_ctx,
                             const char *ext_members[])
 {
     struct sysdb_attrs *ext_group = NULL;
-    const struct sysdb_attrs **ext_group_reply;
     int i;
     errno_t ret;
 
-    ext_group_reply = talloc_zero_array(test_ctx,
-                                        const struct sysdb_attrs *,
-                                        2);
-    if (ext_group_reply == NULL) {
-        return NULL;
-    }
-
-    ext_group = mock_sysdb_object(ext_group_reply, GROUP_BASE_DN, name,
+    ext_group = mock_sysdb_object(test_ctx, GROUP_BASE_DN, name,
                                   SYSDB_GIDNUM, gid);
     if (ext_group == NULL) {
-        talloc_free(ext_group_reply);
         return NULL;
     }
 
@@ -1008,16 +1198,11 @@ mock_group_with_ext_members(struct nested_groups_test_ctx *test_ctx,
                     test_ctx->sdap_opts->group_map[SDAP_AT_GROUP_EXT_MEMBER].sys_name,
                     ext_members[i]);
         if (ret != EOK) {
-            talloc_free(ext_group_reply);
+            talloc_free(ext_group);
             return NULL;
         }
     }
 
-    ext_group_reply[0] = ext_group;
-    will_return(sdap_get_generic_recv, 1);
-    will_return(sdap_get_generic_recv, ext_group_reply);
-    will_return(sdap_get_generic_recv, ERR_OK);
-
     return ext_group;
 }
 
@@ -1166,7 +1351,8 @@ static void nested_group_external_member_test(void **state)
         "S-1-5-21-3623811015-3361044348-30300820-20001",
         NULL
     };
-    const struct sysdb_attrs *nested_group_reply[2] = { NULL };
+    const struct sysdb_attrs *rootgroup_reply[3] = { NULL };
+    const struct sysdb_attrs *ext_group_nested_reply[2] = { NULL };
     struct ldb_message *msg;
     struct ldb_message_element *member;
     const char *sysdb_gr_attrs[] = { SYSDB_MEMBEROF,
@@ -1197,10 +1383,6 @@ static void nested_group_external_member_test(void **state)
                                                           nested_group.gr_name,
                                                           nestedgroup_members);
     assert_non_null(nested_group_ldap_attrs);
-    nested_group_reply[0] = nested_group_ldap_attrs;
-    will_return(sdap_get_generic_recv, 1);
-    will_return(sdap_get_generic_recv, nested_group_reply);
-    will_return(sdap_get_generic_recv, ERR_OK);
 
     ext_group.gr_name = discard_const("extgroup");
     ext_group.gr_gid = 2001;
@@ -1218,6 +1400,18 @@ static void nested_group_external_member_test(void **state)
                                                    extgroup_nested_members);
     assert_non_null(ext_group_nested_ldap_attrs);
 
+    /* members of rootgroup are looked up with a single search */
+    rootgroup_reply[0] = nested_group_ldap_attrs;
+    rootgroup_reply[1] = ext_group_ldap_attrs;
+    will_return(sdap_get_generic_recv, 2);
+    will_return(sdap_get_generic_recv, rootgroup_reply);
+    will_return(sdap_get_generic_recv, ERR_OK);
+
+    ext_group_nested_reply[0] = ext_group_nested_ldap_attrs;
+    will_return(sdap_get_generic_recv, 1);
+    will_return(sdap_get_generic_recv, ext_group_nested_reply);
+    will_return(sdap_get_generic_recv, ERR_OK);
+
     /* run test, check for memory leaks */
     req_mem_ctx = talloc_new(global_talloc_context);
     assert_non_null(req_mem_ctx);
@@ -1379,6 +1573,8 @@ int main(int argc, const char *argv[])
         new_test(one_group_dup_group_members),
         new_test(nested_chain),
         new_test(nested_chain_with_error),
+        new_test(one_group_chunked_members),
+        new_test(multi_level_lookup_once),
         cmocka_unit_test_setup_teardown(nested_group_external_member_test,
                                         nested_group_external_member_setup,
                                         nested_group_external_member_teardown),
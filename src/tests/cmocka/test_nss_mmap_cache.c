@@ -0,0 +1,763 @@
+/*
+    SSSD
+
+    NSS Responder - Mmap Cache tests
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+#include <pthread.h>
+
+#include "tests/cmocka/common_mock.h"
+#include "sss_client/nss_mc.h"
+
+/* the tests check the allocator state which is private to the cache */
+#include "responder/nss/nsssrv_mmap_cache.c"
+
+#define TEST_MC_NAME        "passwd"
+#define TEST_MC_SLOTS       64
+#define TEST_MC_MAX_SLOTS   (4 * TEST_MC_SLOTS)
+#define TEST_MC_TIMEOUT     300
+
+#define TEST_USER_UID       10000
+#define TEST_USER_GID       10000
+#define TEST_USER_UID_STR   "10000"
+
+#define TEST_RACE_USER      "raceuser"
+#define TEST_RACE_STORES    5000
+
+#define TEST_GROW_STORES    1000
+
+#define TEST_NEG_NAME       "ghost"
+#define TEST_NEG_UID        10042
+#define TEST_NEG_UID_STR    "10042"
+#define TEST_NEG_TTL        60
+
+struct mmap_cache_test_ctx {
+    struct sss_mc_ctx *mcc;
+};
+
+/* The client library keeps the file of the previous test mapped until a
+ * lookup notices that it was recycled, that lookup fails. */
+static void client_remap(void)
+{
+    struct passwd pwd;
+    char buf[1024];
+
+    (void)sss_nss_mc_getpwnam("", 0, &pwd, buf, sizeof(buf));
+}
+
+static errno_t client_getpwnam(const char *name,
+                               struct passwd *pwd,
+                               char *buf, size_t buflen)
+{
+    return sss_nss_mc_getpwnam(name, strlen(name), pwd, buf, buflen);
+}
+
+static void mmap_cache_setup(void **state, size_t max_elems)
+{
+    struct mmap_cache_test_ctx *test_ctx;
+    errno_t ret;
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context, struct mmap_cache_test_ctx);
+    assert_non_null(test_ctx);
+
+    ret = sss_mmap_cache_init(test_ctx, TEST_MC_NAME, SSS_MC_PASSWD,
+                              TEST_MC_SLOTS, max_elems, TEST_MC_TIMEOUT,
+                              &test_ctx->mcc);
+    assert_int_equal(ret, EOK);
+    assert_non_null(test_ctx->mcc);
+
+    client_remap();
+
+    check_leaks_push(test_ctx);
+    *state = test_ctx;
+}
+
+/* max_elems equal to n_elem, the cache is never grown */
+static int test_mmap_cache_setup(void **state)
+{
+    mmap_cache_setup(state, TEST_MC_SLOTS);
+    return 0;
+}
+
+static int test_mmap_cache_grow_setup(void **state)
+{
+    mmap_cache_setup(state, TEST_MC_MAX_SLOTS);
+    return 0;
+}
+
+static int test_mmap_cache_teardown(void **state)
+{
+    struct mmap_cache_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                struct mmap_cache_test_ctx);
+    char *file;
+
+    assert_true(check_leaks_pop(test_ctx));
+
+    file = talloc_strdup(global_talloc_context, test_ctx->mcc->file);
+    assert_non_null(file);
+
+    talloc_free(test_ctx);
+    sss_mc_destroy_file(file);
+    talloc_free(file);
+
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+static errno_t store_pw(struct mmap_cache_test_ctx *test_ctx,
+                        const char *name, uid_t uid,
+                        const char *gecos, const char *dir)
+{
+    struct sized_string s_name;
+    struct sized_string s_pw;
+    struct sized_string s_gecos;
+    struct sized_string s_dir;
+    struct sized_string s_shell;
+
+    to_sized_string(&s_name, name);
+    to_sized_string(&s_pw, "x");
+    to_sized_string(&s_gecos, gecos);
+    to_sized_string(&s_dir, dir);
+    to_sized_string(&s_shell, "/");
+
+    return sss_mmap_cache_pw_store(&test_ctx->mcc, &s_name, &s_pw,
+                                   uid, TEST_USER_GID,
+                                   &s_gecos, &s_dir, &s_shell);
+}
+
+/* Stores a passwd entry whose record takes exactly num_slots slots, the
+ * gecos field is used as padding. */
+static errno_t store_user(struct mmap_cache_test_ctx *test_ctx,
+                          const char *name, uid_t uid, uint32_t num_slots)
+{
+    char gecos[MC_SLOT_SIZE * TEST_MC_SLOTS];
+    size_t fixed_len;
+    size_t gecos_len;
+
+    /* name, "x", gecos, "/" and "/" with their terminators */
+    fixed_len = sizeof(struct sss_mc_rec) + sizeof(struct sss_mc_pwd_data)
+                + strlen(name) + 1 + 2 + 1 + 2 + 2;
+    assert_true(num_slots * MC_SLOT_SIZE >= fixed_len);
+    gecos_len = num_slots * MC_SLOT_SIZE - fixed_len;
+    assert_true(gecos_len < sizeof(gecos));
+
+    memset(gecos, 'g', gecos_len);
+    gecos[gecos_len] = '\0';
+
+    return store_pw(test_ctx, name, uid, gecos, "/");
+}
+
+static void invalidate_user(struct mmap_cache_test_ctx *test_ctx,
+                            const char *name)
+{
+    struct sized_string s_name;
+    errno_t ret;
+
+    to_sized_string(&s_name, name);
+    ret = sss_mmap_cache_pw_invalidate(&test_ctx->mcc, &s_name);
+    assert_int_equal(ret, EOK);
+}
+
+/* Returns the first slot of the record stored under name or
+ * MC_INVALID_VAL if there is none. */
+static uint32_t user_slot(struct mmap_cache_test_ctx *test_ctx,
+                          const char *name)
+{
+    struct sized_string s_name;
+    struct sss_mc_rec *rec;
+
+    to_sized_string(&s_name, name);
+    rec = sss_mc_find_record(test_ctx->mcc, &s_name);
+    if (rec == NULL) {
+        return MC_INVALID_VAL;
+    }
+
+    return MC_PTR_TO_SLOT(test_ctx->mcc->data_table, rec);
+}
+
+static bool slot_used(struct sss_mc_ctx *mcc, uint32_t slot)
+{
+    bool used;
+
+    MC_PROBE_BIT(mcc->free_table, slot, used);
+    return used;
+}
+
+/* Walks the whole data table: used slots must be covered by valid records
+ * and every run of free slots must be a single maximal extent which is
+ * linked in the bin of its size class. */
+static void check_layout(struct sss_mc_ctx *mcc)
+{
+    struct sss_mc_rec *rec;
+    uint32_t tot_slots = mcc->ft_size * 8;
+    uint32_t free_slots = 0;
+    uint32_t linked_slots = 0;
+    uint32_t slot = 0;
+    uint32_t len;
+    uint32_t cur;
+    uint32_t bin;
+    uint32_t i;
+
+    while (slot < tot_slots) {
+        if (slot_used(mcc, slot)) {
+            rec = MC_SLOT_TO_PTR(mcc->data_table, slot, struct sss_mc_rec);
+            assert_true(sss_mc_is_valid_rec(mcc, rec));
+
+            len = MC_SIZE_TO_SLOTS(rec->len);
+            assert_true(slot + len <= tot_slots);
+            for (i = 0; i < len; i++) {
+                assert_true(slot_used(mcc, slot + i));
+            }
+        } else {
+            len = mcc->ext_len[slot];
+            assert_true(len > 0);
+            assert_true(slot + len <= tot_slots);
+            assert_int_equal(mcc->ext_len[slot + len - 1], len);
+            for (i = 0; i < len; i++) {
+                assert_false(slot_used(mcc, slot + i));
+            }
+            if (slot + len < tot_slots) {
+                assert_true(slot_used(mcc, slot + len));
+            }
+            free_slots += len;
+        }
+        slot += len;
+    }
+
+    for (bin = 0; bin < MC_EXT_BINS; bin++) {
+        for (cur = mcc->ext_bins[bin];
+             cur != MC_INVALID_VAL;
+             cur = mcc->ext_next[cur]) {
+            assert_int_equal(MC_EXT_BIN(mcc->ext_len[cur]), bin);
+            linked_slots += mcc->ext_len[cur];
+        }
+    }
+    assert_int_equal(linked_slots, free_slots);
+}
+
+static void test_mmap_cache_evict_fragmented(void **state)
+{
+    struct mmap_cache_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                struct mmap_cache_test_ctx);
+    struct sss_mc_ctx *mcc = test_ctx->mcc;
+    char name[16];
+    errno_t ret;
+    int i;
+
+    /* fill the whole cache with records of two slots */
+    for (i = 0; i < TEST_MC_SLOTS / 2; i++) {
+        snprintf(name, sizeof(name), "user%02d", i);
+        ret = store_user(test_ctx, name, TEST_USER_UID + i, 2);
+        assert_int_equal(ret, EOK);
+        assert_int_equal(user_slot(test_ctx, name), 2 * i);
+    }
+    assert_int_equal(mcc->stats_evictions, 0);
+
+    /* every other record is removed, no free extent is longer than two */
+    for (i = 1; i < TEST_MC_SLOTS / 2; i += 2) {
+        snprintf(name, sizeof(name), "user%02d", i);
+        invalidate_user(test_ctx, name);
+    }
+    check_layout(mcc);
+
+    /* evicts user00 and user02 from the window [0, 5), the slot after the
+     * window is left free and next_slot follows user02 */
+    ret = store_user(test_ctx, "big1", TEST_USER_UID + 100, 5);
+    assert_int_equal(ret, EOK);
+    assert_ptr_equal(test_ctx->mcc, mcc);
+    assert_int_equal(mcc->stats_evictions, 1);
+    assert_int_equal(mcc->stats_failures, 0);
+    assert_int_equal(user_slot(test_ctx, "big1"), 0);
+    assert_int_equal(user_slot(test_ctx, "user00"), MC_INVALID_VAL);
+    assert_int_equal(user_slot(test_ctx, "user02"), MC_INVALID_VAL);
+    assert_int_equal(user_slot(test_ctx, "user04"), 8);
+    assert_false(slot_used(mcc, 5));
+    assert_int_equal(mcc->ext_len[5], 3);
+    assert_int_equal(mcc->next_slot, 6);
+    check_layout(mcc);
+
+    /* the only extent of three slots is [5, 8), the record covers
+     * next_slot */
+    ret = store_user(test_ctx, "mid", TEST_USER_UID + 101, 3);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(mcc->stats_evictions, 1);
+    assert_int_equal(user_slot(test_ctx, "mid"), 5);
+
+    /* next_slot is inside "mid" now, the eviction must start over from
+     * the first slot rather than fail on a slot that is not a header */
+    ret = store_user(test_ctx, "big2", TEST_USER_UID + 102, 5);
+    assert_int_equal(ret, EOK);
+    assert_ptr_equal(test_ctx->mcc, mcc);
+    assert_int_equal(mcc->stats_evictions, 2);
+    assert_int_equal(mcc->stats_failures, 0);
+    assert_int_equal(user_slot(test_ctx, "big2"), 0);
+    assert_int_equal(user_slot(test_ctx, "big1"), MC_INVALID_VAL);
+    assert_int_equal(user_slot(test_ctx, "mid"), 5);
+    assert_int_equal(mcc->next_slot, 5);
+    check_layout(mcc);
+}
+
+static void test_mmap_cache_evict_mixed_sizes(void **state)
+{
+    struct mmap_cache_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                struct mmap_cache_test_ctx);
+    struct sss_mc_ctx *mcc = test_ctx->mcc;
+    char name[16];
+    errno_t ret;
+    int i;
+
+    /* records of 2 to 10 slots in an order that keeps fragmenting the
+     * table, some of them are removed again to leave holes behind */
+    for (i = 0; i < 1000; i++) {
+        snprintf(name, sizeof(name), "user%03d", i % 200);
+        ret = store_user(test_ctx, name, TEST_USER_UID + i % 200,
+                         2 + (i * 7) % 9);
+        assert_int_equal(ret, EOK);
+        assert_ptr_equal(test_ctx->mcc, mcc);
+        assert_int_not_equal(user_slot(test_ctx, name), MC_INVALID_VAL);
+
+        if (i % 5 == 0) {
+            snprintf(name, sizeof(name), "user%03d", (i + 197) % 200);
+            if (user_slot(test_ctx, name) != MC_INVALID_VAL) {
+                invalidate_user(test_ctx, name);
+            }
+        }
+
+        check_layout(mcc);
+    }
+
+    assert_true(mcc->stats_evictions > 0);
+    assert_int_equal(mcc->stats_failures, 0);
+}
+
+/* An older client only knows the v1 layout, it must reject the v2 header
+ * and ask the responder instead. The current client still reads files
+ * written by an older responder. */
+static void test_mmap_cache_v1_compat(void **state)
+{
+    struct mmap_cache_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                struct mmap_cache_test_ctx);
+    struct sss_mc_header *h;
+    struct passwd pwd;
+    char buf[1024];
+    errno_t ret;
+
+    h = (struct sss_mc_header *)test_ctx->mcc->mmap_base;
+    assert_int_equal(h->major_vno, SSS_MC_MAJOR_VNO);
+    assert_int_equal(h->minor_vno, SSS_MC_MINOR_VNO);
+    assert_int_not_equal(h->seq_table, 0);
+    /* what a v1 client checks */
+    assert_false(h->major_vno == SSS_MC_MAJOR_VNO_V1
+                     && h->minor_vno == SSS_MC_MINOR_VNO_V1);
+
+    ret = store_user(test_ctx, "user01", TEST_USER_UID + 1, 2);
+    assert_int_equal(ret, EOK);
+
+    ret = client_getpwnam("user01", &pwd, buf, sizeof(buf));
+    assert_int_equal(ret, EOK);
+    assert_string_equal(pwd.pw_name, "user01");
+    assert_int_equal(pwd.pw_uid, TEST_USER_UID + 1);
+
+    /* turn the file into what an older responder writes */
+    MC_RAISE_BARRIER(h);
+    h->major_vno = SSS_MC_MAJOR_VNO_V1;
+    h->minor_vno = SSS_MC_MINOR_VNO_V1;
+    h->seq_table = 0;
+    MC_LOWER_BARRIER(h);
+
+    /* the layout changed under the client, it drops the mapping */
+    ret = client_getpwnam("user01", &pwd, buf, sizeof(buf));
+    assert_int_equal(ret, EINVAL);
+
+    /* and maps the file again in compatibility mode */
+    ret = client_getpwnam("user01", &pwd, buf, sizeof(buf));
+    assert_int_equal(ret, EOK);
+    assert_string_equal(pwd.pw_name, "user01");
+    assert_int_equal(pwd.pw_uid, TEST_USER_UID + 1);
+
+    ret = store_user(test_ctx, "user02", TEST_USER_UID + 2, 3);
+    assert_int_equal(ret, EOK);
+
+    ret = client_getpwnam("user02", &pwd, buf, sizeof(buf));
+    assert_int_equal(ret, EOK);
+    assert_string_equal(pwd.pw_name, "user02");
+    assert_int_equal(pwd.pw_uid, TEST_USER_UID + 2);
+}
+
+struct race_reader_ctx {
+    volatile bool done;
+    unsigned int found;
+    unsigned int torn;
+    unsigned int failed;
+};
+
+/* Every version of the entry carries its number in both gecos and the
+ * home directory, a record mixing two versions has different numbers. */
+static void *race_reader(void *pvt)
+{
+    struct race_reader_ctx *rctx = pvt;
+    struct passwd pwd;
+    char buf[1024];
+    unsigned int gecos_ver;
+    unsigned int dir_ver;
+    errno_t ret;
+
+    while (!rctx->done) {
+        ret = client_getpwnam(TEST_RACE_USER, &pwd, buf, sizeof(buf));
+        switch (ret) {
+        case EOK:
+            rctx->found++;
+            if (sscanf(pwd.pw_gecos, "gecos%u", &gecos_ver) != 1
+                    || sscanf(pwd.pw_dir, "/home/%u", &dir_ver) != 1
+                    || gecos_ver != dir_ver
+                    || pwd.pw_uid != TEST_USER_UID
+                    || strcmp(pwd.pw_name, TEST_RACE_USER) != 0) {
+                rctx->torn++;
+            }
+            break;
+        case ENOENT:
+            /* a resized record is unlinked before its copy is chained */
+        case EIO:
+            /* the writer kept the bucket busy, the responder is asked */
+            break;
+        default:
+            rctx->failed++;
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static void test_mmap_cache_concurrent_reads(void **state)
+{
+    struct mmap_cache_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                struct mmap_cache_test_ctx);
+    struct race_reader_ctx rctx = { 0 };
+    struct passwd pwd;
+    pthread_t reader;
+    char gecos[128];
+    char dir[32];
+    char buf[1024];
+    errno_t ret;
+    int i;
+
+    ret = store_pw(test_ctx, TEST_RACE_USER, TEST_USER_UID,
+                   "gecos0", "/home/0");
+    assert_int_equal(ret, EOK);
+
+    ret = pthread_create(&reader, NULL, race_reader, &rctx);
+    assert_int_equal(ret, 0);
+
+    /* the padding changes every other version, so the record is both
+     * overwritten in place and moved to new slots */
+    for (i = 1; i <= TEST_RACE_STORES; i++) {
+        snprintf(gecos, sizeof(gecos), "gecos%d%*s",
+                 i, ((i / 2) % 3) * 40, "");
+        snprintf(dir, sizeof(dir), "/home/%d", i);
+
+        ret = store_pw(test_ctx, TEST_RACE_USER, TEST_USER_UID, gecos, dir);
+        assert_int_equal(ret, EOK);
+    }
+
+    rctx.done = true;
+    ret = pthread_join(reader, NULL);
+    assert_int_equal(ret, 0);
+
+    assert_int_equal(rctx.torn, 0);
+    assert_int_equal(rctx.failed, 0);
+
+    ret = client_getpwnam(TEST_RACE_USER, &pwd, buf, sizeof(buf));
+    assert_int_equal(ret, EOK);
+    snprintf(dir, sizeof(dir), "/home/%d", TEST_RACE_STORES);
+    assert_string_equal(pwd.pw_dir, dir);
+}
+
+static void check_client_user(int num)
+{
+    struct passwd pwd;
+    char name[16];
+    char buf[1024];
+    errno_t ret;
+
+    snprintf(name, sizeof(name), "user%03d", num);
+    ret = client_getpwnam(name, &pwd, buf, sizeof(buf));
+    assert_int_equal(ret, EOK);
+    assert_string_equal(pwd.pw_name, name);
+    assert_int_equal(pwd.pw_uid, TEST_USER_UID + num);
+}
+
+/* Records are evicted at a high rate, the cache is grown online twice up
+ * to max_elems and clients move to every new file. */
+static void test_mmap_cache_grow(void **state)
+{
+    struct mmap_cache_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                struct mmap_cache_test_ctx);
+    struct sss_mc_ctx *mcc = test_ctx->mcc;
+    uint32_t slots = TEST_MC_SLOTS;
+    struct passwd pwd;
+    char name[16];
+    char buf[1024];
+    int grown = 0;
+    errno_t ret;
+    int i;
+
+    for (i = 0; i < TEST_GROW_STORES; i++) {
+        snprintf(name, sizeof(name), "user%03d", i);
+        ret = store_user(test_ctx, name, TEST_USER_UID + i, 2);
+        assert_int_equal(ret, EOK);
+
+        if (i == 0) {
+            /* the client maps the first file */
+            check_client_user(i);
+        }
+
+        if (test_ctx->mcc == mcc) {
+            continue;
+        }
+
+        /* the cache was replaced by a twice as big one */
+        mcc = test_ctx->mcc;
+        slots *= 2;
+        grown++;
+        assert_int_equal(mcc->ft_size * 8, slots);
+        assert_int_equal(mcc->dt_size, slots * MC_SLOT_SIZE);
+        check_layout(mcc);
+
+        /* the client still has the old file mapped, it was recycled so
+         * the lookup goes to the responder */
+        ret = client_getpwnam(name, &pwd, buf, sizeof(buf));
+        assert_int_equal(ret, EINVAL);
+
+        /* the new file has the entries of the old one and the new entry */
+        check_client_user(i - 1);
+        check_client_user(i);
+    }
+
+    /* never grown past max_elems */
+    assert_int_equal(grown, 2);
+    assert_int_equal(mcc->ft_size * 8, TEST_MC_MAX_SLOTS);
+    assert_false(mcc->grow);
+    assert_int_equal(mcc->stats_failures, 0);
+    check_client_user(TEST_GROW_STORES - 1);
+}
+
+static void neg_store(struct mmap_cache_test_ctx *test_ctx,
+                      const char *key, bool is_id, time_t ttl)
+{
+    struct sized_string s_key;
+    errno_t ret;
+
+    to_sized_string(&s_key, key);
+    ret = sss_mmap_cache_neg_store(&test_ctx->mcc, &s_key, is_id, ttl);
+    assert_int_equal(ret, EOK);
+}
+
+static struct sss_mc_rec *neg_record(struct mmap_cache_test_ctx *test_ctx,
+                                     const char *key, bool is_id)
+{
+    struct sized_string s_key;
+
+    to_sized_string(&s_key, key);
+    return sss_mc_find_neg_record(test_ctx->mcc, &s_key,
+                                  is_id ? MC_REC_FLAG_NEG_ID
+                                        : MC_REC_FLAG_NEG_NAME);
+}
+
+static void test_mmap_cache_negative(void **state)
+{
+    struct mmap_cache_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                struct mmap_cache_test_ctx);
+    struct sss_mc_rec *rec;
+    struct passwd pwd;
+    char buf[1024];
+    time_t now;
+    errno_t ret;
+
+    now = time(NULL);
+    neg_store(test_ctx, TEST_NEG_NAME, false, TEST_NEG_TTL);
+    neg_store(test_ctx, TEST_NEG_UID_STR, true, TEST_NEG_TTL);
+
+    rec = neg_record(test_ctx, TEST_NEG_NAME, false);
+    assert_non_null(rec);
+    assert_int_equal(rec->flags, MC_REC_FLAG_NEG_NAME);
+    assert_true(rec->expire >= now + TEST_NEG_TTL);
+
+    ret = client_getpwnam(TEST_NEG_NAME, &pwd, buf, sizeof(buf));
+    assert_int_equal(ret, SSS_NSS_MC_NEGATIVE);
+
+    ret = sss_nss_mc_getpwuid(TEST_NEG_UID, &pwd, buf, sizeof(buf));
+    assert_int_equal(ret, SSS_NSS_MC_NEGATIVE);
+
+    /* a key without any record must still be asked for */
+    ret = client_getpwnam("nosuchuser", &pwd, buf, sizeof(buf));
+    assert_int_equal(ret, ENOENT);
+
+    /* a negative name record does not answer the id lookup */
+    neg_store(test_ctx, TEST_USER_UID_STR, false, TEST_NEG_TTL);
+    ret = sss_nss_mc_getpwuid(TEST_USER_UID, &pwd, buf, sizeof(buf));
+    assert_int_equal(ret, ENOENT);
+
+    /* storing it again replaces the record */
+    neg_store(test_ctx, TEST_NEG_NAME, false, TEST_NEG_TTL);
+    assert_non_null(neg_record(test_ctx, TEST_NEG_NAME, false));
+    check_layout(test_ctx->mcc);
+
+    /* the ttl is capped at the validity of positive records */
+    now = time(NULL);
+    neg_store(test_ctx, "capped", false, 10 * TEST_MC_TIMEOUT);
+    rec = neg_record(test_ctx, "capped", false);
+    assert_non_null(rec);
+    assert_true(rec->expire <= time(NULL) + TEST_MC_TIMEOUT);
+    assert_true(rec->expire >= now + TEST_MC_TIMEOUT);
+}
+
+static void test_mmap_cache_negative_expired(void **state)
+{
+    struct mmap_cache_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                struct mmap_cache_test_ctx);
+    struct sss_mc_rec *rec;
+    struct passwd pwd;
+    char buf[1024];
+    errno_t ret;
+
+    neg_store(test_ctx, TEST_NEG_NAME, false, TEST_NEG_TTL);
+
+    ret = client_getpwnam(TEST_NEG_NAME, &pwd, buf, sizeof(buf));
+    assert_int_equal(ret, SSS_NSS_MC_NEGATIVE);
+
+    /* age the record instead of waiting for it to expire */
+    rec = neg_record(test_ctx, TEST_NEG_NAME, false);
+    assert_non_null(rec);
+    MC_RAISE_BARRIER(rec);
+    rec->expire = time(NULL) - 1;
+    MC_LOWER_BARRIER(rec);
+
+    /* an expired negative record sends the client to the responder */
+    ret = client_getpwnam(TEST_NEG_NAME, &pwd, buf, sizeof(buf));
+    assert_int_equal(ret, ENOENT);
+}
+
+static void test_mmap_cache_negative_dropped(void **state)
+{
+    struct mmap_cache_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                struct mmap_cache_test_ctx);
+    struct passwd pwd;
+    char buf[1024];
+    errno_t ret;
+
+    neg_store(test_ctx, TEST_NEG_NAME, false, TEST_NEG_TTL);
+    neg_store(test_ctx, TEST_NEG_UID_STR, true, TEST_NEG_TTL);
+
+    ret = client_getpwnam(TEST_NEG_NAME, &pwd, buf, sizeof(buf));
+    assert_int_equal(ret, SSS_NSS_MC_NEGATIVE);
+
+    /* the entry was created later, it must not be shadowed by the
+     * negative records of its name or its id */
+    ret = store_pw(test_ctx, TEST_NEG_NAME, TEST_NEG_UID, "Ghost", "/home");
+    assert_int_equal(ret, EOK);
+
+    assert_null(neg_record(test_ctx, TEST_NEG_NAME, false));
+    assert_null(neg_record(test_ctx, TEST_NEG_UID_STR, true));
+    check_layout(test_ctx->mcc);
+
+    ret = client_getpwnam(TEST_NEG_NAME, &pwd, buf, sizeof(buf));
+    assert_int_equal(ret, EOK);
+    assert_string_equal(pwd.pw_name, TEST_NEG_NAME);
+    assert_int_equal(pwd.pw_uid, TEST_NEG_UID);
+
+    ret = sss_nss_mc_getpwuid(TEST_NEG_UID, &pwd, buf, sizeof(buf));
+    assert_int_equal(ret, EOK);
+    assert_string_equal(pwd.pw_name, TEST_NEG_NAME);
+
+    /* purging removes only the negative records */
+    neg_store(test_ctx, "gone", false, TEST_NEG_TTL);
+    ret = sss_mmap_cache_neg_purge(&test_ctx->mcc);
+    assert_int_equal(ret, EOK);
+    assert_null(neg_record(test_ctx, "gone", false));
+    check_layout(test_ctx->mcc);
+
+    ret = client_getpwnam("gone", &pwd, buf, sizeof(buf));
+    assert_int_equal(ret, ENOENT);
+
+    ret = client_getpwnam(TEST_NEG_NAME, &pwd, buf, sizeof(buf));
+    assert_int_equal(ret, EOK);
+}
+
+int main(int argc, const char *argv[])
+{
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_mmap_cache_evict_fragmented,
+                                        test_mmap_cache_setup,
+                                        test_mmap_cache_teardown),
+        cmocka_unit_test_setup_teardown(test_mmap_cache_evict_mixed_sizes,
+                                        test_mmap_cache_setup,
+                                        test_mmap_cache_teardown),
+        cmocka_unit_test_setup_teardown(test_mmap_cache_v1_compat,
+                                        test_mmap_cache_setup,
+                                        test_mmap_cache_teardown),
+        cmocka_unit_test_setup_teardown(test_mmap_cache_concurrent_reads,
+                                        test_mmap_cache_setup,
+                                        test_mmap_cache_teardown),
+        cmocka_unit_test_setup_teardown(test_mmap_cache_grow,
+                                        test_mmap_cache_grow_setup,
+                                        test_mmap_cache_teardown),
+        cmocka_unit_test_setup_teardown(test_mmap_cache_negative,
+                                        test_mmap_cache_setup,
+                                        test_mmap_cache_teardown),
+        cmocka_unit_test_setup_teardown(test_mmap_cache_negative_expired,
+                                        test_mmap_cache_setup,
+                                        test_mmap_cache_teardown),
+        cmocka_unit_test_setup_teardown(test_mmap_cache_negative_dropped,
+                                        test_mmap_cache_setup,
+                                        test_mmap_cache_teardown),
+    };
+
+    /* Set debug level to invalid value so we can decide if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    tests_set_cwd();
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
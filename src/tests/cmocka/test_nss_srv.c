@@ -1640,6 +1640,133 @@ void test_sss_nss_getgrnam_members(void **state)
     assert_int_equal(ret, EOK);
 }
 
+#define LARGE_GROUP_GHOSTS 1000
+
+struct group testgroup_large = {
+    .gr_gid = 1125,
+    .gr_name = discard_const("testgroup_large"),
+    .gr_passwd = discard_const("*"),
+    .gr_mem = NULL,
+};
+
+static int test_sss_nss_getgrnam_large_group_check(uint32_t status,
+                                                   uint8_t *body, size_t blen)
+{
+    int ret;
+    int i;
+    uint32_t nmem;
+    size_t exp_len;
+    struct group gr;
+    const char **exp_members;
+    struct group expected = {
+        .gr_gid = testgroup_large.gr_gid,
+        .gr_name = testgroup_large.gr_name,
+        .gr_passwd = testgroup_large.gr_passwd,
+    };
+
+    assert_int_equal(status, EOK);
+
+    exp_members = talloc_array(sss_nss_test_ctx, const char *,
+                               LARGE_GROUP_GHOSTS + 2);
+    assert_non_null(exp_members);
+    exp_members[0] = testmember1.pw_name;
+    exp_members[1] = testmember2.pw_name;
+    for (i = 0; i < LARGE_GROUP_GHOSTS; i++) {
+        exp_members[i + 2] = talloc_asprintf(exp_members,
+                                             "ghostmember%04d", i);
+        assert_non_null(exp_members[i + 2]);
+    }
+    expected.gr_mem = discard_const(exp_members);
+
+    /* number of results, reserved, gid and number of members followed by
+     * the strings, the packet was grown exactly by the member names */
+    exp_len = 4 * sizeof(uint32_t)
+              + strlen(expected.gr_name) + 1
+              + strlen(expected.gr_passwd) + 1;
+    for (i = 0; i < LARGE_GROUP_GHOSTS + 2; i++) {
+        exp_len += strlen(exp_members[i]) + 1;
+    }
+    assert_int_equal(blen, exp_len);
+
+    ret = parse_group_packet(body, blen, &gr, &nmem);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(nmem, LARGE_GROUP_GHOSTS + 2);
+
+    assert_groups_equal(&expected, &gr, nmem);
+
+    talloc_free(gr.gr_mem);
+    talloc_free(exp_members);
+    return EOK;
+}
+
+/* Test that a group with a large number of members, both real members and
+ * ghost members, is returned complete in a single reply
+ */
+void test_sss_nss_getgrnam_large_group(void **state)
+{
+    errno_t ret;
+    int i;
+    char *name;
+    struct sysdb_attrs *attrs;
+
+    attrs = sysdb_new_attrs(sss_nss_test_ctx);
+    assert_non_null(attrs);
+
+    for (i = 0; i < LARGE_GROUP_GHOSTS; i++) {
+        name = talloc_asprintf(attrs, "ghostmember%04d", i);
+        assert_non_null(name);
+        name = sss_create_internal_fqname(attrs, name,
+                                          sss_nss_test_ctx->tctx->dom->name);
+        assert_non_null(name);
+
+        ret = sysdb_attrs_add_string(attrs, SYSDB_GHOST, name);
+        assert_int_equal(ret, EOK);
+    }
+
+    ret = store_group(sss_nss_test_ctx, sss_nss_test_ctx->tctx->dom,
+                      &testgroup_large, attrs, 0);
+    assert_int_equal(ret, EOK);
+    talloc_free(attrs);
+
+    ret = store_user(sss_nss_test_ctx, sss_nss_test_ctx->tctx->dom,
+                     &testmember1, NULL, 0);
+    assert_int_equal(ret, EOK);
+
+    ret = store_user(sss_nss_test_ctx, sss_nss_test_ctx->tctx->dom,
+                     &testmember2, NULL, 0);
+    assert_int_equal(ret, EOK);
+
+    ret = store_group_member(sss_nss_test_ctx,
+                             testgroup_large.gr_name,
+                             sss_nss_test_ctx->tctx->dom,
+                             testmember1.pw_name,
+                             sss_nss_test_ctx->tctx->dom,
+                             SYSDB_MEMBER_USER);
+    assert_int_equal(ret, EOK);
+
+    ret = store_group_member(sss_nss_test_ctx,
+                             testgroup_large.gr_name,
+                             sss_nss_test_ctx->tctx->dom,
+                             testmember2.pw_name,
+                             sss_nss_test_ctx->tctx->dom,
+                             SYSDB_MEMBER_USER);
+    assert_int_equal(ret, EOK);
+
+    mock_input_user_or_group(testgroup_large.gr_name);
+    will_return(__wrap_sss_packet_get_cmd, SSS_NSS_GETGRNAM);
+    will_return_always(__wrap_sss_packet_get_body, WRAP_CALL_REAL);
+
+    /* Query for that group, call a callback when command finishes */
+    set_cmd_cb(test_sss_nss_getgrnam_large_group_check);
+    ret = sss_cmd_execute(sss_nss_test_ctx->cctx, SSS_NSS_GETGRNAM,
+                          sss_nss_test_ctx->sss_nss_cmds);
+    assert_int_equal(ret, EOK);
+
+    /* Wait until the test finishes with EOK */
+    ret = test_ev_loop(sss_nss_test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+}
+
 static int test_sss_nss_getgrnam_members_check_fqdn(uint32_t status,
                                                 uint8_t *body, size_t blen)
 {
@@ -5126,6 +5253,124 @@ void test_sss_nss_getpwuid_ex(void **state)
     assert_int_equal(ret, EOK);
 }
 
+static void mock_input_id_batch(TALLOC_CTX *mem_ctx, uint32_t *ids,
+                                uint32_t num_ids, uint32_t flags)
+{
+    uint8_t *body;
+    size_t rp = 0;
+    uint32_t i;
+
+    body = talloc_zero_array(mem_ctx, uint8_t,
+                             (2 + num_ids) * sizeof(uint32_t));
+    if (body == NULL) return;
+
+    SAFEALIGN_SETMEM_UINT32(body + rp, num_ids, &rp);
+    SAFEALIGN_SETMEM_UINT32(body + rp, flags, &rp);
+    for (i = 0; i < num_ids; i++) {
+        SAFEALIGN_SETMEM_UINT32(body + rp, ids[i], &rp);
+    }
+
+    will_return(__wrap_sss_packet_get_body, WRAP_CALL_WRAPPER);
+    will_return(__wrap_sss_packet_get_body, body);
+    will_return(__wrap_sss_packet_get_body, rp);
+}
+
+static int test_sss_nss_getpwuid_batch_check(uint32_t status, uint8_t *body,
+                                             size_t blen)
+{
+    struct passwd pwd;
+    uint32_t num_results;
+    uint32_t id;
+    uint32_t len;
+    size_t rp = 0;
+    errno_t ret;
+
+    assert_int_equal(status, EOK);
+
+    SAFEALIGN_COPY_UINT32(&num_results, body + rp, &rp);
+    assert_int_equal(num_results, 3);
+    rp += sizeof(uint32_t); /* reserved */
+
+    SAFEALIGN_COPY_UINT32(&id, body + rp, &rp);
+    SAFEALIGN_COPY_UINT32(&len, body + rp, &rp);
+    assert_int_equal(id, 101);
+    ret = parse_user_packet(body + rp, len, &pwd);
+    assert_int_equal(ret, EOK);
+    assert_users_equal(&pwd, &getpwuid_usr);
+    rp += len;
+
+    SAFEALIGN_COPY_UINT32(&id, body + rp, &rp);
+    SAFEALIGN_COPY_UINT32(&len, body + rp, &rp);
+    assert_int_equal(id, 123);
+    ret = parse_user_packet(body + rp, len, &pwd);
+    assert_int_equal(ret, EOK);
+    assert_users_equal(&pwd, &getpwnam_usr);
+    rp += len;
+
+    /* Duplicate ID gets the same record */
+    SAFEALIGN_COPY_UINT32(&id, body + rp, &rp);
+    SAFEALIGN_COPY_UINT32(&len, body + rp, &rp);
+    assert_int_equal(id, 101);
+    ret = parse_user_packet(body + rp, len, &pwd);
+    assert_int_equal(ret, EOK);
+    assert_users_equal(&pwd, &getpwuid_usr);
+    rp += len;
+
+    assert_int_equal(rp, blen);
+    return EOK;
+}
+
+void test_sss_nss_getpwuid_batch(void **state)
+{
+    errno_t ret;
+    uint32_t ids[] = { 101, 123, 101 };
+    int i;
+
+    ret = store_user(sss_nss_test_ctx, sss_nss_test_ctx->tctx->dom,
+                     &getpwuid_usr, NULL, 0);
+    assert_int_equal(ret, EOK);
+    ret = store_user(sss_nss_test_ctx, sss_nss_test_ctx->tctx->dom,
+                     &getpwnam_usr, NULL, 0);
+    assert_int_equal(ret, EOK);
+
+    mock_input_id_batch(sss_nss_test_ctx, ids, 3, 0);
+    /* One reply packet plus one packet per record */
+    for (i = 0; i < 4; i++) {
+        will_return(__wrap_sss_packet_get_cmd, SSS_NSS_GETPWUID_BATCH);
+    }
+    /* Reply header, then for each record the fill function, the record
+     * itself and the reply growing by one record */
+    will_return(__wrap_sss_packet_get_body, WRAP_CALL_REAL);
+    for (i = 0; i < 3; i++) {
+        mock_fill_user();
+        will_return(__wrap_sss_packet_get_body, WRAP_CALL_REAL);
+        will_return(__wrap_sss_packet_get_body, WRAP_CALL_REAL);
+    }
+
+    set_cmd_cb(test_sss_nss_getpwuid_batch_check);
+    ret = sss_cmd_execute(sss_nss_test_ctx->cctx, SSS_NSS_GETPWUID_BATCH,
+                          sss_nss_test_ctx->sss_nss_cmds);
+    assert_int_equal(ret, EOK);
+
+    /* Wait until the test finishes with EOK */
+    ret = test_ev_loop(sss_nss_test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+    RESET_TCTX;
+
+    /* An empty batch is rejected */
+    mock_input_id_batch(sss_nss_test_ctx, ids, 0, 0);
+    will_return(__wrap_sss_packet_get_cmd, SSS_NSS_GETPWUID_BATCH);
+
+    set_cmd_cb(test_sss_nss_EINVAL_check);
+    ret = sss_cmd_execute(sss_nss_test_ctx->cctx, SSS_NSS_GETPWUID_BATCH,
+                          sss_nss_test_ctx->sss_nss_cmds);
+    assert_int_equal(ret, EOK);
+
+    /* Wait until the test finishes with EOK */
+    ret = test_ev_loop(sss_nss_test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+}
+
 void test_sss_nss_getgrnam_ex_no_members(void **state)
 {
     errno_t ret;
@@ -6033,6 +6278,8 @@ int main(int argc, const char *argv[])
                                         sss_nss_test_setup, sss_nss_test_teardown),
         cmocka_unit_test_setup_teardown(test_sss_nss_getgrnam_members,
                                         sss_nss_test_setup, sss_nss_test_teardown),
+        cmocka_unit_test_setup_teardown(test_sss_nss_getgrnam_large_group,
+                                        sss_nss_test_setup, sss_nss_test_teardown),
         cmocka_unit_test_setup_teardown(test_sss_nss_getgrnam_members_fqdn,
                                         sss_nss_fqdn_test_setup, sss_nss_test_teardown),
         cmocka_unit_test_setup_teardown(test_sss_nss_getgrnam_members_subdom,
@@ -6169,6 +6416,8 @@ int main(int argc, const char *argv[])
                                         sss_nss_test_setup, sss_nss_test_teardown),
         cmocka_unit_test_setup_teardown(test_sss_nss_getpwuid_ex,
                                         sss_nss_test_setup, sss_nss_test_teardown),
+        cmocka_unit_test_setup_teardown(test_sss_nss_getpwuid_batch,
+                                        sss_nss_test_setup, sss_nss_test_teardown),
         cmocka_unit_test_setup_teardown(test_sss_nss_getgrnam_ex_no_members,
                                         sss_nss_test_setup, sss_nss_test_teardown),
         cmocka_unit_test_setup_teardown(test_sss_nss_getgrgid_ex_no_members,
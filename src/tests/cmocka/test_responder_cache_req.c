@@ -1732,6 +1732,80 @@ void test_user_by_id_missing_notfound(void **state)
     assert_true(test_ctx->dp_called);
 }
 
+struct coalesce_test_ctx {
+    struct cache_req_test_ctx *test_ctx;
+    int num_done;
+};
+
+static void cache_req_user_by_id_coalesce_done(struct tevent_req *req)
+{
+    struct coalesce_test_ctx *ctx = NULL;
+    struct cache_req_result *result = NULL;
+    errno_t ret;
+
+    ctx = tevent_req_callback_data(req, struct coalesce_test_ctx);
+
+    ret = cache_req_user_by_id_recv(ctx->test_ctx, req, &result);
+    talloc_zfree(req);
+    assert_int_equal(ret, EOK);
+    assert_non_null(result);
+    assert_int_equal(result->count, 1);
+    assert_int_equal(ldb_msg_find_attr_as_uint(result->msgs[0],
+                                               SYSDB_UIDNUM, 0),
+                     users[0].uid);
+    talloc_free(result);
+
+    ctx->num_done++;
+    if (ctx->num_done == 2) {
+        ctx->test_ctx->tctx->error = EOK;
+        ctx->test_ctx->tctx->done = true;
+    }
+}
+
+void test_user_by_id_missing_coalesced(void **state)
+{
+    struct cache_req_test_ctx *test_ctx = NULL;
+    struct coalesce_test_ctx ctx;
+    TALLOC_CTX *req_mem_ctx;
+    struct tevent_req *req;
+    errno_t ret;
+    int i;
+
+    test_ctx = talloc_get_type_abort(*state, struct cache_req_test_ctx);
+
+    /* Mock values. Data provider must be contacted only once. */
+    will_return(__wrap_sss_dp_get_account_send, test_ctx);
+    mock_account_recv_simple();
+
+    test_ctx->create_user1 = true;
+    test_ctx->create_user2 = false;
+
+    ctx.test_ctx = test_ctx;
+    ctx.num_done = 0;
+
+    /* Test. */
+    req_mem_ctx = talloc_new(global_talloc_context);
+    check_leaks_push(req_mem_ctx);
+
+    for (i = 0; i < 2; i++) {
+        req = cache_req_user_by_id_send(req_mem_ctx, test_ctx->tctx->ev,
+                                        test_ctx->rctx, test_ctx->ncache, 0,
+                                        test_ctx->tctx->dom->name,
+                                        users[0].uid);
+        assert_non_null(req);
+        tevent_req_set_callback(req, cache_req_user_by_id_coalesce_done, &ctx);
+    }
+
+    ret = test_ev_loop(test_ctx->tctx);
+    assert_int_equal(ret, ERR_OK);
+    assert_int_equal(ctx.num_done, 2);
+    assert_true(test_ctx->dp_called);
+    assert_int_equal(test_ctx->rctx->cache_req_coalesced_num, 1);
+    assert_true(check_leaks_pop(req_mem_ctx));
+
+    talloc_free(req_mem_ctx);
+}
+
 void test_group_by_name_multiple_domains_found(void **state)
 {
     struct cache_req_test_ctx *test_ctx = NULL;
@@ -4388,6 +4462,7 @@ int main(int argc, const char *argv[])
         new_single_domain_test(user_by_id_ncache),
         new_single_domain_test(user_by_id_missing_found),
         new_single_domain_test(user_by_id_missing_notfound),
+        new_single_domain_test(user_by_id_missing_coalesced),
         new_multi_domain_test(user_by_id_multiple_domains_found),
         new_multi_domain_test(user_by_id_multiple_domains_notfound),
         new_single_domain_id_limit_test(user_by_id_below_id_range),
@@ -0,0 +1,531 @@
+/*
+    SSSD
+
+    sdap_async_enum - Tests for the partitioned enumeration searches
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <talloc.h>
+#include <tevent.h>
+#include <errno.h>
+#include <popt.h>
+#include <ctype.h>
+
+#include "tests/cmocka/common_mock.h"
+#include "tests/cmocka/common_mock_sdap.h"
+
+#include "providers/ldap/sdap_async_enum.c"
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "test_sdap_enum_conf.ldb"
+#define TEST_DOM_NAME "sdap_enum_test"
+#define TEST_ID_PROVIDER "ldap"
+
+#define TEST_PARTITIONS "4"
+#define TEST_MAX_NAMES 3
+
+/* The entries of the directory, the searches return those whose names
+ * match the filter of the search */
+struct test_entry {
+    const char *names[TEST_MAX_NAMES];
+};
+
+/* With four partitions the searches return the names starting with a-l,
+ * m-x, y-9 and all other characters */
+static struct test_entry test_users[] = {
+    { { "alice", NULL } },
+    { { "Bob", NULL } },
+    /* returned by the first and the third search */
+    { { "zed", "andy", NULL } },
+    /* returned by the first search only, é is not in any range */
+    { { "\xc3\xa9mile", "emile", NULL } },
+    /* returned by the last search only */
+    { { "_svc", "~svc", NULL } },
+    /* returned by the second and the third search */
+    { { "9lives", "Mallory", NULL } },
+};
+
+#define TEST_NUM_USERS (sizeof(test_users) / sizeof(test_users[0]))
+
+/* admins has the nested member zgroup, the names fall into different
+ * partitions */
+#define TEST_GROUP_ADMINS 0
+#define TEST_GROUP_NESTED 1
+
+static struct test_entry test_groups[] = {
+    { { "admins", NULL } },
+    { { "zgroup", NULL } },
+    { { "_staff", NULL } },
+};
+
+#define TEST_NUM_GROUPS (sizeof(test_groups) / sizeof(test_groups[0]))
+
+static struct mock_calls {
+    struct tevent_context *ev;
+
+    size_t user_searches;
+    size_t users_saved[TEST_NUM_USERS];
+
+    size_t group_searches;
+    /* the search which returned the group, 0 if none did */
+    size_t groups_found_by[TEST_NUM_GROUPS];
+} mock_calls;
+
+struct test_sdap_enum_ctx {
+    struct sss_test_ctx *tctx;
+    struct sdap_options *opts;
+    struct sdap_id_ctx *id_ctx;
+    struct sdap_id_op *op;
+};
+
+/* Evaluates the filter of a partitioned search like the server would */
+static bool mock_filter_matches(const char *filter,
+                                const char *name_attr,
+                                struct test_entry *entry)
+{
+    bool negated;
+    bool listed = false;
+    char *term;
+    size_t i;
+
+    negated = (strstr(filter, "(!(|") != NULL);
+
+    for (i = 0; i < TEST_MAX_NAMES && entry->names[i] != NULL; i++) {
+        term = talloc_asprintf(NULL, "(%s=%c*)", name_attr,
+                               tolower((unsigned char) entry->names[i][0]));
+        assert_non_null(term);
+
+        if (strstr(filter, term) != NULL) {
+            listed = true;
+        }
+        talloc_free(term);
+    }
+
+    return negated ? !listed : listed;
+}
+
+/* A split search lists the characters its names start with */
+static bool mock_filter_is_split(const char *filter, const char *name_attr)
+{
+    const char *chars = ENUM_PARTITION_CHARS;
+    char *term;
+    bool split = false;
+    size_t i;
+
+    for (i = 0; chars[i] != '\0' && !split; i++) {
+        term = talloc_asprintf(NULL, "(%s=%c*)", name_attr, chars[i]);
+        assert_non_null(term);
+        split = (strstr(filter, term) != NULL);
+        talloc_free(term);
+    }
+
+    return split;
+}
+
+static struct sysdb_attrs *mock_entry_attrs(TALLOC_CTX *mem_ctx,
+                                            struct test_entry *entry)
+{
+    struct sysdb_attrs *attrs;
+    size_t i;
+    errno_t ret;
+
+    attrs = sysdb_new_attrs(mem_ctx);
+    assert_non_null(attrs);
+
+    for (i = 0; i < TEST_MAX_NAMES && entry->names[i] != NULL; i++) {
+        ret = sysdb_attrs_add_string(attrs, SYSDB_NAME, entry->names[i]);
+        assert_int_equal(ret, EOK);
+    }
+
+    return attrs;
+}
+
+struct mock_search_state {
+    int dummy;
+};
+
+static struct tevent_req *mock_search_done(TALLOC_CTX *mem_ctx,
+                                           struct tevent_context *ev)
+{
+    struct tevent_req *req;
+    struct mock_search_state *state;
+
+    req = tevent_req_create(mem_ctx, &state, struct mock_search_state);
+    assert_non_null(req);
+
+    tevent_req_done(req);
+    tevent_req_post(req, ev);
+    return req;
+}
+
+struct tevent_req *sdap_get_users_send(TALLOC_CTX *memctx,
+                                       struct tevent_context *ev,
+                                       struct sss_domain_info *dom,
+                                       struct sysdb_ctx *sysdb,
+                                       struct sdap_options *opts,
+                                       struct sdap_search_base **search_bases,
+                                       struct sdap_handle *sh,
+                                       const char **attrs,
+                                       const char *filter,
+                                       int timeout,
+                                       enum sdap_entry_lookup_type lookup_type,
+                                       struct sysdb_attrs *mapped_attrs,
+                                       sdap_entry_keep_fn keep_fn,
+                                       void *keep_pvt)
+{
+    const char *name_attr = opts->user_map[SDAP_AT_USER_NAME].name;
+    struct sysdb_attrs *entry;
+    bool split;
+    size_t i;
+
+    mock_calls.user_searches++;
+    split = mock_filter_is_split(filter, name_attr);
+
+    for (i = 0; i < TEST_NUM_USERS; i++) {
+        if (split && !mock_filter_matches(filter, name_attr, &test_users[i])) {
+            continue;
+        }
+
+        entry = mock_entry_attrs(memctx, &test_users[i]);
+        if (keep_fn == NULL || keep_fn(entry, keep_pvt)) {
+            mock_calls.users_saved[i]++;
+        }
+        talloc_free(entry);
+    }
+
+    return mock_search_done(memctx, ev);
+}
+
+int sdap_get_users_recv(struct tevent_req *req,
+                        TALLOC_CTX *mem_ctx, char **timestamp)
+{
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    *timestamp = NULL;
+    return EOK;
+}
+
+struct tevent_req *sdap_get_groups_send(TALLOC_CTX *memctx,
+                                       struct tevent_context *ev,
+                                       struct sdap_domain *sdom,
+                                       struct sdap_options *opts,
+                                       struct sdap_handle *sh,
+                                       const char **attrs,
+                                       const char *filter,
+                                       int timeout,
+                                       enum sdap_entry_lookup_type lookup_type,
+                                       bool no_members)
+{
+    const char *name_attr = opts->group_map[SDAP_AT_GROUP_NAME].name;
+    bool split;
+    size_t i;
+
+    mock_calls.group_searches++;
+    split = mock_filter_is_split(filter, name_attr);
+
+    for (i = 0; i < TEST_NUM_GROUPS; i++) {
+        if (split && !mock_filter_matches(filter, name_attr, &test_groups[i])) {
+            continue;
+        }
+
+        mock_calls.groups_found_by[i] = mock_calls.group_searches;
+    }
+
+    return mock_search_done(memctx, ev);
+}
+
+int sdap_get_groups_recv(struct tevent_req *req,
+                         TALLOC_CTX *mem_ctx, char **timestamp)
+{
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    *timestamp = NULL;
+    return EOK;
+}
+
+struct sdap_id_op *sdap_id_op_create(TALLOC_CTX *memctx,
+                                     struct sdap_id_conn_cache *cache)
+{
+    return talloc_new(memctx);
+}
+
+struct tevent_req *sdap_id_op_connect_send(struct sdap_id_op *op,
+                                           TALLOC_CTX *memctx,
+                                           int *ret_out)
+{
+    *ret_out = EOK;
+    return mock_search_done(memctx, mock_calls.ev);
+}
+
+int sdap_id_op_connect_recv(struct tevent_req *req, int *dp_error)
+{
+    *dp_error = DP_ERR_OK;
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    return EOK;
+}
+
+int sdap_id_op_done(struct sdap_id_op *op, int retval, int *dp_err_out)
+{
+    *dp_err_out = (retval == EOK ? DP_ERR_OK : DP_ERR_FATAL);
+    return retval;
+}
+
+struct sdap_handle *sdap_id_op_handle(struct sdap_id_op *op)
+{
+    return NULL;
+}
+
+bool sdap_idmap_domain_has_algorithmic_mapping(struct sdap_idmap_ctx *ctx,
+                                               const char *dom_name,
+                                               const char *dom_sid)
+{
+    return false;
+}
+
+static int test_sdap_enum_setup(void **state)
+{
+    struct test_sdap_enum_ctx *test_ctx;
+    struct sss_test_conf_param params[] = {
+        { "ldap_schema", "rfc2307bis" },
+        { "ldap_search_base", "dc=sdap_enum_test" },
+        { "ldap_enumeration_search_partitions", TEST_PARTITIONS },
+        { NULL, NULL },
+    };
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context, struct test_sdap_enum_ctx);
+    assert_non_null(test_ctx);
+
+    test_ctx->tctx = create_dom_test_ctx(test_ctx, TESTS_PATH, TEST_CONF_DB,
+                                         TEST_DOM_NAME, TEST_ID_PROVIDER,
+                                         params);
+    assert_non_null(test_ctx->tctx);
+
+    test_ctx->opts = mock_sdap_options_ldap(test_ctx, test_ctx->tctx->dom,
+                                            test_ctx->tctx->confdb,
+                                            test_ctx->tctx->conf_dom_path);
+    assert_non_null(test_ctx->opts);
+
+    test_ctx->id_ctx = mock_sdap_id_ctx(test_ctx, NULL, test_ctx->opts);
+    assert_non_null(test_ctx->id_ctx);
+
+    test_ctx->id_ctx->srv_opts = talloc_zero(test_ctx->id_ctx,
+                                             struct sdap_server_opts);
+    assert_non_null(test_ctx->id_ctx->srv_opts);
+
+    test_ctx->op = sdap_id_op_create(test_ctx, NULL);
+    assert_non_null(test_ctx->op);
+
+    memset(&mock_calls, 0, sizeof(mock_calls));
+    mock_calls.ev = test_ctx->tctx->ev;
+
+    check_leaks_push(test_ctx);
+    *state = test_ctx;
+    return 0;
+}
+
+static int test_sdap_enum_teardown(void **state)
+{
+    struct test_sdap_enum_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                struct test_sdap_enum_ctx);
+
+    assert_true(check_leaks_pop(test_ctx));
+    talloc_zfree(test_ctx);
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+static void test_enum_users_done(struct tevent_req *req)
+{
+    struct test_sdap_enum_ctx *test_ctx = tevent_req_callback_data(req,
+                                                struct test_sdap_enum_ctx);
+    errno_t ret;
+
+    ret = enum_users_recv(req);
+    talloc_zfree(req);
+
+    test_ev_done(test_ctx->tctx, ret);
+}
+
+static void test_enum_groups_done(struct tevent_req *req)
+{
+    struct test_sdap_enum_ctx *test_ctx = tevent_req_callback_data(req,
+                                                struct test_sdap_enum_ctx);
+    errno_t ret;
+
+    ret = enum_groups_recv(req);
+    talloc_zfree(req);
+
+    test_ev_done(test_ctx->tctx, ret);
+}
+
+static void test_enum_part_filters(void **state)
+{
+    struct test_sdap_enum_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                struct test_sdap_enum_ctx);
+    const char *chars = ENUM_PARTITION_CHARS;
+    size_t num_parts = 4;
+    char *filter;
+    char *term;
+    size_t owner;
+    size_t idx;
+    size_t i;
+
+    /* every character is searched by exactly one partition */
+    for (i = 0; chars[i] != '\0'; i++) {
+        owner = enum_search_char_part(chars[i], num_parts);
+        assert_true(owner < num_parts - 1);
+        assert_int_equal(enum_search_char_part(toupper(chars[i]), num_parts),
+                         owner);
+
+        term = talloc_asprintf(test_ctx, "(uid=%c*)", chars[i]);
+        assert_non_null(term);
+
+        for (idx = 0; idx < num_parts; idx++) {
+            filter = enum_search_part_filter(test_ctx, "uid", "(objectClass=*)",
+                                             idx, num_parts);
+            assert_non_null(filter);
+
+            if (idx == num_parts - 1) {
+                /* the last partition excludes all of them */
+                assert_non_null(strstr(filter, "(!(|"));
+                assert_non_null(strstr(filter, term));
+            } else if (idx == owner) {
+                assert_non_null(strstr(filter, term));
+            } else {
+                assert_null(strstr(filter, term));
+            }
+            talloc_free(filter);
+        }
+        talloc_free(term);
+    }
+
+    assert_int_equal(enum_search_char_part('_', num_parts), num_parts - 1);
+    assert_int_equal(enum_search_char_part('\xc3', num_parts), num_parts - 1);
+
+    /* a single partition searches with the unchanged filter */
+    filter = enum_search_part_filter(test_ctx, "uid", "(objectClass=*)", 0, 1);
+    assert_non_null(filter);
+    assert_string_equal(filter, "(objectClass=*)");
+    talloc_free(filter);
+}
+
+static void test_enum_users_partitioned(void **state)
+{
+    struct test_sdap_enum_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                struct test_sdap_enum_ctx);
+    struct tevent_req *req;
+    errno_t ret;
+    size_t i;
+
+    req = enum_users_send(test_ctx, test_ctx->tctx->ev, test_ctx->id_ctx,
+                          test_ctx->opts->sdom, NULL, test_ctx->op, true);
+    assert_non_null(req);
+    tevent_req_set_callback(req, test_enum_users_done, test_ctx);
+
+    ret = test_ev_loop(test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+
+    assert_int_equal(mock_calls.user_searches, atoi(TEST_PARTITIONS));
+
+    /* the users with several names are returned by more than one search
+     * but saved only once */
+    for (i = 0; i < TEST_NUM_USERS; i++) {
+        assert_int_equal(mock_calls.users_saved[i], 1);
+    }
+}
+
+static void test_enum_groups_not_partitioned(void **state)
+{
+    struct test_sdap_enum_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                struct test_sdap_enum_ctx);
+    struct tevent_req *req;
+    errno_t ret;
+    size_t i;
+
+    req = enum_groups_send(test_ctx, test_ctx->tctx->ev, test_ctx->id_ctx,
+                           test_ctx->opts->sdom, NULL, test_ctx->op, true);
+    assert_non_null(req);
+    tevent_req_set_callback(req, test_enum_groups_done, test_ctx);
+
+    ret = test_ev_loop(test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+
+    /* The member of admins would be returned by another partition than
+     * admins itself, so the groups are found by a single search which
+     * resolves the nested membership */
+    assert_int_equal(mock_calls.group_searches, 1);
+    for (i = 0; i < TEST_NUM_GROUPS; i++) {
+        assert_int_equal(mock_calls.groups_found_by[i], 1);
+    }
+    assert_int_equal(mock_calls.groups_found_by[TEST_GROUP_ADMINS],
+                     mock_calls.groups_found_by[TEST_GROUP_NESTED]);
+}
+
+int main(int argc, const char *argv[])
+{
+    int rv;
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_enum_part_filters,
+                                        test_sdap_enum_setup,
+                                        test_sdap_enum_teardown),
+        cmocka_unit_test_setup_teardown(test_enum_users_partitioned,
+                                        test_sdap_enum_setup,
+                                        test_sdap_enum_teardown),
+        cmocka_unit_test_setup_teardown(test_enum_groups_not_partitioned,
+                                        test_sdap_enum_setup,
+                                        test_sdap_enum_teardown),
+    };
+
+    /* Set debug level to invalid value so we can decide if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    /* Even though normally the tests should clean up after themselves
+     * they might not after a failed run. Remove the old DB to be sure */
+    tests_set_cwd();
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    test_dom_suite_setup(TESTS_PATH);
+
+    rv = cmocka_run_group_tests(tests, NULL, NULL);
+    if (rv == 0) {
+        test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    }
+
+    return rv;
+}
@@ -0,0 +1,605 @@
+/*
+    SSSD
+
+    sdap_id_op - Tests for the LDAP connection pool
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <talloc.h>
+#include <tevent.h>
+#include <errno.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+#include "tests/cmocka/common_mock_be.h"
+#include "tests/common.h"
+
+/* Include the source file directly so the tests can look at the
+ * connection cache internals. */
+#include "providers/ldap/sdap_id_op.c"
+
+#define TEST_SERVICE_NAME "LDAP"
+#define TEST_OPT_TIMEOUT 6
+
+struct test_ctx {
+    struct sss_test_ctx *tctx;
+    struct be_ctx *be_ctx;
+    struct sdap_id_ctx *id_ctx;
+    struct sdap_id_conn_ctx *id_conn;
+    struct sdap_id_conn_cache *conn_cache;
+};
+
+/* Number of calls of the mocked functions below */
+static struct {
+    int connects;
+    int online_cb_runs;
+    int fo_next_server;
+} mock_calls;
+
+/* Mock the backend and the connection functions so we don't have to bring
+ * the whole data provider and a real LDAP server into this test. */
+
+bool be_is_offline(struct be_ctx *ctx)
+{
+    return ctx->offline;
+}
+
+void be_mark_offline(struct be_ctx *ctx)
+{
+    ctx->offline = true;
+}
+
+int be_add_offline_cb(TALLOC_CTX *mem_ctx,
+                      struct be_ctx *ctx,
+                      be_callback_t cb,
+                      void *pvt,
+                      struct be_cb **offline_cb)
+{
+    return EOK;
+}
+
+int be_add_reconnect_cb(TALLOC_CTX *mem_ctx,
+                        struct be_ctx *ctx,
+                        be_callback_t cb,
+                        void *pvt,
+                        struct be_cb **reconnect_cb)
+{
+    return EOK;
+}
+
+void be_run_online_cb(struct be_ctx *be)
+{
+    mock_calls.online_cb_runs++;
+}
+
+void be_run_unconditional_online_cb(struct be_ctx *be)
+{
+    return;
+}
+
+int be_fo_get_server_count(struct be_ctx *ctx, const char *service_name)
+{
+    return 1;
+}
+
+void be_fo_try_next_server(struct be_ctx *ctx, const char *service_name)
+{
+    mock_calls.fo_next_server++;
+}
+
+void sdap_steal_server_opts(struct sdap_id_ctx *id_ctx,
+                            struct sdap_server_opts **srv_opts)
+{
+    return;
+}
+
+struct tevent_req *sdap_reinit_cleanup_send(TALLOC_CTX *mem_ctx,
+                                            struct be_ctx *be_ctx,
+                                            struct sdap_id_ctx *id_ctx)
+{
+    /* the tests never report a reinitialized server */
+    fail();
+    return NULL;
+}
+
+errno_t sdap_reinit_cleanup_recv(struct tevent_req *req)
+{
+    fail();
+    return EINVAL;
+}
+
+struct mock_connect_state {
+    bool can_retry;
+};
+
+struct tevent_req *sdap_cli_connect_send(TALLOC_CTX *memctx,
+                                         struct tevent_context *ev,
+                                         struct sdap_options *opts,
+                                         struct be_ctx *be,
+                                         struct sdap_service *service,
+                                         bool skip_rootdse,
+                                         enum connect_tls force_tls,
+                                         bool skip_auth)
+{
+    struct mock_connect_state *state;
+    struct tevent_req *req;
+
+    req = tevent_req_create(memctx, &state, struct mock_connect_state);
+    assert_non_null(req);
+
+    mock_calls.connects++;
+    return req;
+}
+
+int sdap_cli_connect_recv(struct tevent_req *req,
+                          TALLOC_CTX *memctx,
+                          bool *can_retry,
+                          struct sdap_handle **gsh,
+                          struct sdap_server_opts **srv_opts)
+{
+    struct mock_connect_state *state = tevent_req_data(req,
+                                                  struct mock_connect_state);
+    struct sdap_handle *sh;
+
+    *can_retry = state->can_retry;
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    sh = talloc_zero(memctx, struct sdap_handle);
+    assert_non_null(sh);
+    sh->connected = true;
+
+    *gsh = sh;
+    *srv_opts = NULL;
+    return EOK;
+}
+
+/* Complete the connection attempt the operation is waiting for */
+static void finish_connect(struct sdap_id_op *op, errno_t ret, bool can_retry)
+{
+    struct tevent_req *req;
+    struct mock_connect_state *state;
+
+    assert_non_null(op->conn_data);
+    req = op->conn_data->connect_req;
+    assert_non_null(req);
+
+    state = tevent_req_data(req, struct mock_connect_state);
+    state->can_retry = can_retry;
+
+    if (ret == EOK) {
+        tevent_req_done(req);
+    } else {
+        tevent_req_error(req, ret);
+    }
+}
+
+static struct sdap_id_op *start_op(struct test_ctx *test_ctx,
+                                   struct tevent_req **_req)
+{
+    struct sdap_id_op *op;
+    struct tevent_req *req;
+    int ret;
+
+    op = sdap_id_op_create(test_ctx, test_ctx->conn_cache);
+    assert_non_null(op);
+
+    req = sdap_id_op_connect_send(op, op, &ret);
+    assert_int_equal(ret, EOK);
+    assert_non_null(req);
+    assert_non_null(op->conn_data);
+
+    if (_req != NULL) {
+        *_req = req;
+    }
+
+    return op;
+}
+
+static void assert_connected(struct tevent_req *req)
+{
+    int dp_error;
+    int ret;
+
+    ret = sdap_id_op_connect_recv(req, &dp_error);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(dp_error, DP_ERR_OK);
+}
+
+static int count_connections(struct sdap_id_conn_cache *conn_cache)
+{
+    struct sdap_id_conn_data *conn_data;
+    int count = 0;
+
+    DLIST_FOR_EACH(conn_data, conn_cache->connections) {
+        count++;
+    }
+
+    return count;
+}
+
+static int test_setup(void **state, int pool_size)
+{
+    struct test_ctx *test_ctx;
+    struct sdap_options *opts;
+    struct dp_option *basic;
+    int ret;
+
+    assert_true(leak_check_setup());
+    memset(&mock_calls, 0, sizeof(mock_calls));
+
+    test_ctx = talloc_zero(global_talloc_context, struct test_ctx);
+    assert_non_null(test_ctx);
+
+    test_ctx->tctx = create_ev_test_ctx(test_ctx);
+    assert_non_null(test_ctx->tctx);
+
+    test_ctx->be_ctx = mock_be_ctx(test_ctx, test_ctx->tctx);
+    assert_non_null(test_ctx->be_ctx);
+
+    opts = talloc_zero(test_ctx, struct sdap_options);
+    assert_non_null(opts);
+
+    basic = talloc_zero_array(opts, struct dp_option, SDAP_OPTS_BASIC);
+    assert_non_null(basic);
+    basic[SDAP_OPT_TIMEOUT].type = DP_OPT_NUMBER;
+    basic[SDAP_OPT_TIMEOUT].val.number = TEST_OPT_TIMEOUT;
+    basic[SDAP_IDLE_TIMEOUT].type = DP_OPT_NUMBER;
+    basic[SDAP_IDLE_TIMEOUT].val.number = 0;
+    basic[SDAP_CONNECTION_POOL_SIZE].type = DP_OPT_NUMBER;
+    basic[SDAP_CONNECTION_POOL_SIZE].val.number = pool_size;
+    opts->basic = basic;
+
+    test_ctx->id_ctx = talloc_zero(test_ctx, struct sdap_id_ctx);
+    assert_non_null(test_ctx->id_ctx);
+    test_ctx->id_ctx->be = test_ctx->be_ctx;
+    test_ctx->id_ctx->opts = opts;
+
+    test_ctx->id_conn = talloc_zero(test_ctx, struct sdap_id_conn_ctx);
+    assert_non_null(test_ctx->id_conn);
+    test_ctx->id_conn->id_ctx = test_ctx->id_ctx;
+
+    test_ctx->id_conn->service = talloc_zero(test_ctx->id_conn,
+                                             struct sdap_service);
+    assert_non_null(test_ctx->id_conn->service);
+    test_ctx->id_conn->service->name = talloc_strdup(test_ctx->id_conn->service,
+                                                     TEST_SERVICE_NAME);
+    assert_non_null(test_ctx->id_conn->service->name);
+
+    ret = sdap_id_conn_cache_create(test_ctx, test_ctx->id_conn,
+                                    &test_ctx->conn_cache);
+    assert_int_equal(ret, EOK);
+    test_ctx->id_conn->conn_cache = test_ctx->conn_cache;
+
+    check_leaks_push(test_ctx);
+    *state = test_ctx;
+    return 0;
+}
+
+static int test_setup_pool_one(void **state)
+{
+    return test_setup(state, 1);
+}
+
+static int test_setup_pool_two(void **state)
+{
+    return test_setup(state, 2);
+}
+
+static int test_setup_pool_three(void **state)
+{
+    return test_setup(state, 3);
+}
+
+static int test_teardown(void **state)
+{
+    struct test_ctx *test_ctx = talloc_get_type_abort(*state, struct test_ctx);
+
+    /* every test frees its operations, release the idle pooled
+     * connections the same way as going offline does */
+    sdap_id_conn_cache_be_offline_cb(test_ctx->conn_cache);
+    assert_null(test_ctx->conn_cache->connections);
+    assert_int_equal(test_ctx->conn_cache->num_pooled, 0);
+
+    assert_true(check_leaks_pop(test_ctx));
+    talloc_zfree(test_ctx);
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+static void test_sdap_id_op_pool_least_loaded(void **state)
+{
+    struct test_ctx *test_ctx = talloc_get_type_abort(*state, struct test_ctx);
+    struct sdap_id_conn_cache *conn_cache = test_ctx->conn_cache;
+    struct sdap_id_op *op1;
+    struct sdap_id_op *op2;
+    struct sdap_id_op *op3;
+    struct sdap_id_op *op4;
+    struct sdap_id_op *op5;
+    struct sdap_id_conn_data *busy;
+    struct sdap_id_conn_data *idle;
+    struct tevent_req *req;
+
+    /* the pool grows by one connection for each busy operation */
+    op1 = start_op(test_ctx, &req);
+    assert_int_equal(mock_calls.connects, 1);
+    finish_connect(op1, EOK, true);
+    assert_connected(req);
+    assert_int_equal(mock_calls.online_cb_runs, 1);
+
+    op2 = start_op(test_ctx, &req);
+    assert_int_equal(mock_calls.connects, 2);
+    assert_ptr_not_equal(op2->conn_data, op1->conn_data);
+    finish_connect(op2, EOK, true);
+    assert_connected(req);
+
+    op3 = start_op(test_ctx, &req);
+    assert_int_equal(mock_calls.connects, 3);
+    assert_ptr_not_equal(op3->conn_data, op1->conn_data);
+    assert_ptr_not_equal(op3->conn_data, op2->conn_data);
+    finish_connect(op3, EOK, true);
+    assert_connected(req);
+
+    assert_int_equal(conn_cache->num_pooled, 3);
+    assert_int_equal(count_connections(conn_cache), 3);
+    /* the online callbacks run only for the first connection */
+    assert_int_equal(mock_calls.online_cb_runs, 1);
+
+    /* an idle connection stays in the pool */
+    idle = op2->conn_data;
+    talloc_zfree(op2);
+    assert_int_equal(idle->num_ops, 0);
+    assert_true(idle->pooled);
+    assert_int_equal(conn_cache->num_pooled, 3);
+
+    /* and it is preferred over the busy ones */
+    op4 = start_op(test_ctx, NULL);
+    assert_int_equal(mock_calls.connects, 3);
+    assert_ptr_equal(op4->conn_data, idle);
+    assert_int_equal(idle->num_ops, 1);
+
+    /* the pool is full, all connections are equally loaded */
+    op5 = start_op(test_ctx, NULL);
+    assert_int_equal(mock_calls.connects, 3);
+    assert_int_equal(count_connections(conn_cache), 3);
+    busy = op5->conn_data;
+    assert_true(busy->pooled);
+    assert_int_equal(busy->num_ops, 2);
+
+    talloc_free(op1);
+    talloc_free(op3);
+    talloc_free(op4);
+    talloc_free(op5);
+}
+
+static void test_sdap_id_op_pool_connection_failed(void **state)
+{
+    struct test_ctx *test_ctx = talloc_get_type_abort(*state, struct test_ctx);
+    struct sdap_id_conn_cache *conn_cache = test_ctx->conn_cache;
+    struct sdap_id_op *op1;
+    struct sdap_id_op *op2;
+    struct sdap_id_op *op3;
+    struct sdap_id_conn_data *failed;
+    struct sdap_id_conn_data *broken;
+    struct tevent_req *req;
+    int dp_error;
+    int ret;
+
+    op1 = start_op(test_ctx, &req);
+    finish_connect(op1, EOK, true);
+    assert_connected(req);
+
+    /* the second connection fails, the operation retries on a new one */
+    op2 = start_op(test_ctx, &req);
+    assert_int_equal(mock_calls.connects, 2);
+    failed = op2->conn_data;
+    finish_connect(op2, EIO, true);
+    assert_int_equal(mock_calls.connects, 3);
+    assert_non_null(op2->conn_data);
+    assert_ptr_not_equal(op2->conn_data, failed);
+    assert_ptr_not_equal(op2->conn_data, op1->conn_data);
+    assert_int_equal(op2->reconnect_retry_count, 1);
+    /* the failed connection is gone */
+    assert_int_equal(count_connections(conn_cache), 2);
+    assert_int_equal(conn_cache->num_pooled, 2);
+
+    finish_connect(op2, EOK, true);
+    assert_connected(req);
+    assert_false(be_is_offline(test_ctx->be_ctx));
+
+    /* a connection breaking during an operation is removed from the pool
+     * and the other pooled connections are replaced on the next use */
+    broken = op1->conn_data;
+    ret = sdap_id_op_done(op1, EIO, &dp_error);
+    assert_int_equal(ret, EAGAIN);
+    assert_int_equal(dp_error, DP_ERR_OK);
+    assert_int_equal(mock_calls.fo_next_server, 1);
+    assert_null(op1->conn_data);
+    assert_int_equal(count_connections(conn_cache), 1);
+    assert_ptr_not_equal(conn_cache->connections, broken);
+    assert_true(op2->conn_data->disconnecting);
+
+    op3 = start_op(test_ctx, &req);
+    assert_int_equal(mock_calls.connects, 4);
+    assert_ptr_not_equal(op3->conn_data, op2->conn_data);
+    /* the running operation keeps its connection outside of the pool */
+    assert_false(op2->conn_data->pooled);
+    assert_int_equal(conn_cache->num_pooled, 1);
+    finish_connect(op3, EOK, true);
+    assert_connected(req);
+
+    talloc_free(op2);
+    assert_int_equal(count_connections(conn_cache), 1);
+    assert_ptr_equal(conn_cache->connections, op3->conn_data);
+
+    talloc_free(op1);
+    talloc_free(op3);
+}
+
+static void test_sdap_id_op_pool_offline(void **state)
+{
+    struct test_ctx *test_ctx = talloc_get_type_abort(*state, struct test_ctx);
+    struct sdap_id_conn_cache *conn_cache = test_ctx->conn_cache;
+    struct sdap_id_op *op1;
+    struct sdap_id_op *op2;
+    struct sdap_id_op *op3;
+    struct sdap_id_conn_data *running;
+    struct tevent_req *req;
+    int dp_error;
+    int ret;
+
+    op1 = start_op(test_ctx, &req);
+    finish_connect(op1, EOK, true);
+    assert_connected(req);
+
+    op2 = start_op(test_ctx, &req);
+    finish_connect(op2, EOK, true);
+    assert_connected(req);
+    assert_int_equal(conn_cache->num_pooled, 2);
+
+    /* going offline releases the idle connections at once and the busy
+     * ones when their last operation finishes */
+    talloc_zfree(op1);
+    running = op2->conn_data;
+    sdap_id_conn_cache_be_offline_cb(conn_cache);
+    assert_int_equal(conn_cache->num_pooled, 0);
+    assert_int_equal(count_connections(conn_cache), 1);
+    assert_ptr_equal(conn_cache->connections, running);
+    assert_false(running->pooled);
+
+    /* a new operation does not use the released connection */
+    op3 = start_op(test_ctx, &req);
+    assert_int_equal(mock_calls.connects, 3);
+    assert_ptr_not_equal(op3->conn_data, running);
+
+    /* no server to retry with, the backend goes offline */
+    finish_connect(op3, EIO, false);
+    assert_true(be_is_offline(test_ctx->be_ctx));
+    ret = sdap_id_op_connect_recv(req, &dp_error);
+    assert_int_equal(ret, EAGAIN);
+    assert_int_equal(dp_error, DP_ERR_OFFLINE);
+    assert_null(op3->conn_data);
+    assert_int_equal(conn_cache->num_pooled, 0);
+    assert_int_equal(count_connections(conn_cache), 1);
+
+    talloc_free(op2);
+    assert_null(conn_cache->connections);
+
+    talloc_free(op3);
+}
+
+static void test_sdap_id_op_pool_size_one(void **state)
+{
+    struct test_ctx *test_ctx = talloc_get_type_abort(*state, struct test_ctx);
+    struct sdap_id_conn_cache *conn_cache = test_ctx->conn_cache;
+    struct sdap_id_op *op1;
+    struct sdap_id_op *op2;
+    struct sdap_id_op *op3;
+    struct sdap_id_op *op4;
+    struct sdap_id_conn_data *conn_data;
+    struct tevent_req *req1;
+    struct tevent_req *req2;
+    struct tevent_req *req;
+    int dp_error;
+    int ret;
+
+    /* the second operation waits for the pending connection */
+    op1 = start_op(test_ctx, &req1);
+    op2 = start_op(test_ctx, &req2);
+    assert_int_equal(mock_calls.connects, 1);
+    conn_data = op1->conn_data;
+    assert_ptr_equal(op2->conn_data, conn_data);
+
+    finish_connect(op1, EOK, true);
+    assert_connected(req1);
+    assert_connected(req2);
+    assert_int_equal(mock_calls.online_cb_runs, 1);
+
+    /* the only connection is shared even if it is busy */
+    op3 = start_op(test_ctx, NULL);
+    assert_int_equal(mock_calls.connects, 1);
+    assert_ptr_equal(op3->conn_data, conn_data);
+    assert_int_equal(conn_data->num_ops, 3);
+    assert_int_equal(conn_cache->num_pooled, 1);
+    assert_int_equal(count_connections(conn_cache), 1);
+
+    /* a broken connection is replaced */
+    ret = sdap_id_op_done(op1, EIO, &dp_error);
+    assert_int_equal(ret, EAGAIN);
+    assert_int_equal(dp_error, DP_ERR_OK);
+    assert_false(conn_data->pooled);
+    assert_int_equal(conn_cache->num_pooled, 0);
+
+    op4 = start_op(test_ctx, &req);
+    assert_int_equal(mock_calls.connects, 2);
+    assert_ptr_not_equal(op4->conn_data, conn_data);
+    finish_connect(op4, EOK, true);
+    assert_connected(req);
+    assert_int_equal(mock_calls.online_cb_runs, 2);
+    assert_int_equal(conn_cache->num_pooled, 1);
+
+    talloc_free(op2);
+    talloc_free(op3);
+    assert_int_equal(count_connections(conn_cache), 1);
+    assert_ptr_equal(conn_cache->connections, op4->conn_data);
+
+    talloc_free(op1);
+    talloc_free(op4);
+}
+
+int main(int argc, const char *argv[])
+{
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_sdap_id_op_pool_least_loaded,
+                                        test_setup_pool_three,
+                                        test_teardown),
+        cmocka_unit_test_setup_teardown(test_sdap_id_op_pool_connection_failed,
+                                        test_setup_pool_two,
+                                        test_teardown),
+        cmocka_unit_test_setup_teardown(test_sdap_id_op_pool_offline,
+                                        test_setup_pool_two,
+                                        test_teardown),
+        cmocka_unit_test_setup_teardown(test_sdap_id_op_pool_size_one,
+                                        test_setup_pool_one,
+                                        test_teardown),
+    };
+
+    /* Set debug level to invalid value so we can decide if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,491 @@
+/*
+    SSSD
+
+    sdap_async_groups - Tests for saving enumerated groups while the search
+    is running
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <talloc.h>
+#include <tevent.h>
+#include <errno.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+#include "tests/cmocka/common_mock_sdap.h"
+#include "tests/cmocka/common_mock_sysdb_objects.h"
+
+#include "providers/ldap/sdap_async_groups.c"
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "test_sdap_stream_conf.ldb"
+#define TEST_DOM_NAME "sdap_stream_test"
+#define TEST_ID_PROVIDER "ldap"
+
+#define OBJECT_BASE_DN "cn=objects,dc=test,dc=com"
+#define GROUP_BASE_DN "cn=groups," OBJECT_BASE_DN
+
+#define TEST_GROUP_PARENT "parent"
+#define TEST_GROUP_SIBLING "sibling"
+#define TEST_GROUP_CHILD "child"
+
+/* The streamed search, the test hands the batches over */
+static struct mock_stream {
+    struct tevent_req *req;
+    sdap_stream_batch_fn batch_fn;
+    void *batch_pvt;
+    size_t num_searches;
+} mock_stream;
+
+struct mock_stream_state {
+    int dummy;
+};
+
+struct tevent_req *
+sdap_get_and_parse_generic_stream_send(TALLOC_CTX *memctx,
+                                       struct tevent_context *ev,
+                                       struct sdap_options *opts,
+                                       struct sdap_handle *sh,
+                                       const char *search_base,
+                                       int scope,
+                                       const char *filter,
+                                       const char **attrs,
+                                       struct sdap_attr_map *map,
+                                       int map_num_attrs,
+                                       int sizelimit,
+                                       int timeout,
+                                       bool allow_paging,
+                                       sdap_stream_batch_fn batch_fn,
+                                       void *batch_pvt)
+{
+    struct tevent_req *req;
+    struct mock_stream_state *state;
+
+    req = tevent_req_create(memctx, &state, struct mock_stream_state);
+    assert_non_null(req);
+
+    mock_stream.req = req;
+    mock_stream.batch_fn = batch_fn;
+    mock_stream.batch_pvt = batch_pvt;
+    mock_stream.num_searches++;
+
+    return req;
+}
+
+int sdap_get_and_parse_generic_recv(struct tevent_req *req,
+                                    TALLOC_CTX *mem_ctx,
+                                    size_t *reply_count,
+                                    struct sysdb_attrs ***reply)
+{
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    /* a streamed search returns no entries */
+    *reply_count = 0;
+    *reply = NULL;
+    return EOK;
+}
+
+bool sdap_idmap_domain_has_algorithmic_mapping(struct sdap_idmap_ctx *ctx,
+                                               const char *dom_name,
+                                               const char *dom_sid)
+{
+    return false;
+}
+
+static void mock_stream_finish(errno_t ret)
+{
+    struct tevent_req *req = mock_stream.req;
+
+    assert_non_null(req);
+    mock_stream.req = NULL;
+
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    tevent_req_done(req);
+}
+
+/* Like the stream the batch is freed once it was handed over and an error
+ * of the callback ends the search */
+static errno_t mock_stream_batch(struct sysdb_attrs **batch, size_t count)
+{
+    errno_t ret;
+
+    assert_non_null(mock_stream.req);
+
+    ret = mock_stream.batch_fn(batch, count, mock_stream.batch_pvt);
+    talloc_free(batch);
+
+    if (ret != EOK) {
+        mock_stream_finish(ret);
+    }
+
+    return ret;
+}
+
+struct test_sdap_stream_ctx {
+    struct sss_test_ctx *tctx;
+    struct sdap_options *opts;
+    struct sdap_handle *sh;
+};
+
+static struct sysdb_attrs *test_group(TALLOC_CTX *mem_ctx,
+                                      const char *name,
+                                      gid_t gid,
+                                      const char *member)
+{
+    const char *members[] = { NULL, NULL };
+    struct sysdb_attrs *attrs;
+
+    if (member != NULL) {
+        members[0] = talloc_asprintf(mem_ctx, "cn=%s," GROUP_BASE_DN, member);
+        assert_non_null(members[0]);
+    }
+
+    attrs = mock_sysdb_group_rfc2307bis(mem_ctx, GROUP_BASE_DN, gid, name,
+                                        member != NULL ? members : NULL);
+    assert_non_null(attrs);
+
+    talloc_free(discard_const(members[0]));
+    return attrs;
+}
+
+/* The parent group contains the child group, which arrives in the next
+ * batch */
+static struct sysdb_attrs **test_first_batch(size_t *_count)
+{
+    struct sysdb_attrs **batch;
+
+    batch = talloc_array(NULL, struct sysdb_attrs *, 2);
+    assert_non_null(batch);
+
+    batch[0] = test_group(batch, TEST_GROUP_PARENT, 1001, TEST_GROUP_CHILD);
+    batch[1] = test_group(batch, TEST_GROUP_SIBLING, 1002, NULL);
+
+    *_count = 2;
+    return batch;
+}
+
+static struct sysdb_attrs **test_second_batch(size_t *_count)
+{
+    struct sysdb_attrs **batch;
+
+    batch = talloc_array(NULL, struct sysdb_attrs *, 1);
+    assert_non_null(batch);
+
+    batch[0] = test_group(batch, TEST_GROUP_CHILD, 1003, NULL);
+
+    *_count = 1;
+    return batch;
+}
+
+static struct ldb_message *test_get_group(struct test_sdap_stream_ctx *test_ctx,
+                                          const char *name)
+{
+    const char *attrs[] = { SYSDB_NAME, SYSDB_MEMBER, SYSDB_MEMBEROF, NULL };
+    struct ldb_message *msg;
+    char *fqname;
+    errno_t ret;
+
+    fqname = sss_create_internal_fqname(test_ctx, name,
+                                        test_ctx->tctx->dom->name);
+    assert_non_null(fqname);
+
+    ret = sysdb_search_group_by_name(test_ctx, test_ctx->tctx->dom, fqname,
+                                     attrs, &msg);
+    talloc_free(fqname);
+    if (ret == ENOENT) {
+        return NULL;
+    }
+    assert_int_equal(ret, EOK);
+
+    return msg;
+}
+
+static void assert_group_cached(struct test_sdap_stream_ctx *test_ctx,
+                                const char *name,
+                                bool cached)
+{
+    struct ldb_message *msg;
+
+    msg = test_get_group(test_ctx, name);
+    if (cached) {
+        assert_non_null(msg);
+    } else {
+        assert_null(msg);
+    }
+    talloc_free(msg);
+}
+
+/* Checks whether the child group is a member of the parent group */
+static bool test_child_is_member(struct test_sdap_stream_ctx *test_ctx)
+{
+    struct ldb_message *msg;
+    struct ldb_message_element *el;
+    char *fqname;
+    char *parent_dn;
+    bool found = false;
+    unsigned int i;
+
+    fqname = sss_create_internal_fqname(test_ctx, TEST_GROUP_PARENT,
+                                        test_ctx->tctx->dom->name);
+    assert_non_null(fqname);
+    parent_dn = sysdb_group_strdn(test_ctx, test_ctx->tctx->dom->name,
+                                  fqname);
+    assert_non_null(parent_dn);
+
+    msg = test_get_group(test_ctx, TEST_GROUP_CHILD);
+    assert_non_null(msg);
+
+    el = ldb_msg_find_element(msg, SYSDB_MEMBEROF);
+    for (i = 0; el != NULL && i < el->num_values; i++) {
+        if (strcasecmp((const char *) el->values[i].data, parent_dn) == 0) {
+            found = true;
+        }
+    }
+
+    talloc_free(msg);
+    talloc_free(parent_dn);
+    talloc_free(fqname);
+    return found;
+}
+
+static void test_groups_done(struct tevent_req *req)
+{
+    struct test_sdap_stream_ctx *test_ctx = tevent_req_callback_data(req,
+                                                struct test_sdap_stream_ctx);
+    char *usn_value = NULL;
+    errno_t ret;
+
+    ret = sdap_get_groups_recv(req, test_ctx, &usn_value);
+    talloc_zfree(req);
+    talloc_free(usn_value);
+
+    test_ev_done(test_ctx->tctx, ret);
+}
+
+static void test_start_enumeration(struct test_sdap_stream_ctx *test_ctx)
+{
+    struct tevent_req *req;
+
+    req = sdap_get_groups_send(test_ctx, test_ctx->tctx->ev,
+                               test_ctx->opts->sdom, test_ctx->opts,
+                               test_ctx->sh, NULL, "(objectClass=*)", 0,
+                               SDAP_LOOKUP_ENUMERATE, false);
+    assert_non_null(req);
+    tevent_req_set_callback(req, test_groups_done, test_ctx);
+
+    /* the groups are streamed */
+    assert_int_equal(mock_stream.num_searches, 1);
+    assert_non_null(mock_stream.req);
+}
+
+static int test_sdap_stream_setup(void **state)
+{
+    struct test_sdap_stream_ctx *test_ctx;
+    struct sss_test_conf_param params[] = {
+        { "ldap_schema", "rfc2307bis" }, /* enable nested groups */
+        { "ldap_search_base", OBJECT_BASE_DN },
+        { "ldap_group_search_base", GROUP_BASE_DN },
+        { NULL, NULL }
+    };
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context, struct test_sdap_stream_ctx);
+    assert_non_null(test_ctx);
+
+    test_dom_suite_setup(TESTS_PATH);
+
+    test_ctx->tctx = create_dom_test_ctx(test_ctx, TESTS_PATH, TEST_CONF_DB,
+                                         TEST_DOM_NAME, TEST_ID_PROVIDER,
+                                         params);
+    assert_non_null(test_ctx->tctx);
+
+    test_ctx->opts = mock_sdap_options_ldap(test_ctx, test_ctx->tctx->dom,
+                                            test_ctx->tctx->confdb,
+                                            test_ctx->tctx->conf_dom_path);
+    assert_non_null(test_ctx->opts);
+
+    test_ctx->sh = mock_sdap_handle(test_ctx);
+    assert_non_null(test_ctx->sh);
+
+    memset(&mock_stream, 0, sizeof(mock_stream));
+
+    *state = test_ctx;
+    return 0;
+}
+
+static int test_sdap_stream_teardown(void **state)
+{
+    struct test_sdap_stream_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                struct test_sdap_stream_ctx);
+
+    talloc_zfree(test_ctx);
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+static void test_stream_groups_saved_per_batch(void **state)
+{
+    struct test_sdap_stream_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                struct test_sdap_stream_ctx);
+    struct sysdb_attrs **batch;
+    size_t count;
+    errno_t ret;
+
+    test_start_enumeration(test_ctx);
+
+    /* the first batch is in the cache while the search is still running */
+    batch = test_first_batch(&count);
+    ret = mock_stream_batch(batch, count);
+    assert_int_equal(ret, EOK);
+
+    assert_group_cached(test_ctx, TEST_GROUP_PARENT, true);
+    assert_group_cached(test_ctx, TEST_GROUP_SIBLING, true);
+    assert_group_cached(test_ctx, TEST_GROUP_CHILD, false);
+    assert_false(test_ctx->tctx->done);
+
+    /* the member arrives, its link is added once the search finished */
+    batch = test_second_batch(&count);
+    ret = mock_stream_batch(batch, count);
+    assert_int_equal(ret, EOK);
+
+    assert_group_cached(test_ctx, TEST_GROUP_CHILD, true);
+    assert_false(test_child_is_member(test_ctx));
+
+    mock_stream_finish(EOK);
+    ret = test_ev_loop(test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+
+    assert_true(test_child_is_member(test_ctx));
+}
+
+static void test_stream_groups_member_first(void **state)
+{
+    struct test_sdap_stream_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                struct test_sdap_stream_ctx);
+    struct sysdb_attrs **batch;
+    size_t count;
+    errno_t ret;
+
+    test_start_enumeration(test_ctx);
+
+    /* the member is already cached when the parent group is saved, the link
+     * does not have to wait for the end of the search */
+    batch = test_second_batch(&count);
+    ret = mock_stream_batch(batch, count);
+    assert_int_equal(ret, EOK);
+
+    batch = test_first_batch(&count);
+    ret = mock_stream_batch(batch, count);
+    assert_int_equal(ret, EOK);
+
+    assert_true(test_child_is_member(test_ctx));
+
+    mock_stream_finish(EOK);
+    ret = test_ev_loop(test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+
+    assert_true(test_child_is_member(test_ctx));
+}
+
+static void test_stream_groups_search_failed(void **state)
+{
+    struct test_sdap_stream_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                struct test_sdap_stream_ctx);
+    struct sysdb_attrs **batch;
+    size_t count;
+    errno_t ret;
+
+    test_start_enumeration(test_ctx);
+
+    batch = test_first_batch(&count);
+    ret = mock_stream_batch(batch, count);
+    assert_int_equal(ret, EOK);
+
+    batch = test_second_batch(&count);
+    ret = mock_stream_batch(batch, count);
+    assert_int_equal(ret, EOK);
+
+    /* the connection is lost before the search finished */
+    mock_stream_finish(ETIMEDOUT);
+    ret = test_ev_loop(test_ctx->tctx);
+    assert_int_equal(ret, ETIMEDOUT);
+
+    /* the saved batches stay in the cache, the deferred links of an
+     * incomplete search are dropped */
+    assert_group_cached(test_ctx, TEST_GROUP_PARENT, true);
+    assert_group_cached(test_ctx, TEST_GROUP_SIBLING, true);
+    assert_group_cached(test_ctx, TEST_GROUP_CHILD, true);
+    assert_false(test_child_is_member(test_ctx));
+}
+
+int main(int argc, const char *argv[])
+{
+    int rv;
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_stream_groups_saved_per_batch,
+                                        test_sdap_stream_setup,
+                                        test_sdap_stream_teardown),
+        cmocka_unit_test_setup_teardown(test_stream_groups_member_first,
+                                        test_sdap_stream_setup,
+                                        test_sdap_stream_teardown),
+        cmocka_unit_test_setup_teardown(test_stream_groups_search_failed,
+                                        test_sdap_stream_setup,
+                                        test_sdap_stream_teardown),
+    };
+
+    /* Set debug level to invalid value so we can decide if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    /* Even though normally the tests should clean up after themselves
+     * they might not after a failed run. Remove the old DB to be sure */
+    tests_set_cwd();
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    test_dom_suite_setup(TESTS_PATH);
+
+    rv = cmocka_run_group_tests(tests, NULL, NULL);
+    if (rv == 0) {
+        test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    }
+
+    return rv;
+}
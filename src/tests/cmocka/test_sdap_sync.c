@@ -0,0 +1,969 @@
+/*
+    SSSD
+
+    Tests for the LDAP server side change tracking
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+/* Include the source file directly so the tests can feed the change
+ * tracking request without an LDAP server. */
+#include "providers/ldap/sdap_sync.c"
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "tests_conf.ldb"
+#define TEST_DOM_NAME "sdap_sync_test"
+#define TEST_ID_PROVIDER "ldap"
+
+#define TEST_USER_NAME  "sync_user"
+#define TEST_USER_DN    "uid=sync_user,ou=People,dc=example,dc=com"
+#define TEST_USER_UUID  "00112233-4455-6677-8899-aabbccddeeff"
+#define TEST_GROUP_NAME "sync_group"
+#define TEST_GROUP_DN   "cn=sync_group,ou=Groups,dc=example,dc=com"
+#define TEST_GROUP_UUID "ffeeddcc-bbaa-9988-7766-554433221100"
+#define TEST_USER2_NAME "sync_user2"
+#define TEST_USER2_DN   "uid=sync_user2,ou=People,dc=example,dc=com"
+#define TEST_USER2_UUID "0f1e2d3c-4b5a-6978-8796-a5b4c3d2e1f0"
+#define TEST_DELETED_GROUP_DN \
+    "CN=sync_group\\0ADEL:ffeeddcc-bbaa-9988-7766-554433221100," \
+    "CN=Deleted Objects,dc=example,dc=com"
+
+#define TEST_COOKIE_1   "rid=001,csn=1"
+#define TEST_COOKIE_2   "rid=001,csn=2"
+#define TEST_COOKIE_3   "rid=001,csn=3"
+#define TEST_COOKIE_4   "rid=001,csn=4"
+
+static const uint8_t test_user_uuid[] = { 0x00, 0x11, 0x22, 0x33,
+                                          0x44, 0x55, 0x66, 0x77,
+                                          0x88, 0x99, 0xaa, 0xbb,
+                                          0xcc, 0xdd, 0xee, 0xff };
+
+static const uint8_t test_group_uuid[] = { 0xff, 0xee, 0xdd, 0xcc,
+                                           0xbb, 0xaa, 0x99, 0x88,
+                                           0x77, 0x66, 0x55, 0x44,
+                                           0x33, 0x22, 0x11, 0x00 };
+
+static const uint8_t test_user2_uuid[] = { 0x0f, 0x1e, 0x2d, 0x3c,
+                                           0x4b, 0x5a, 0x69, 0x78,
+                                           0x87, 0x96, 0xa5, 0xb4,
+                                           0xc3, 0xd2, 0xe1, 0xf0 };
+
+struct sdap_sync_test_ctx {
+    struct sss_test_ctx *tctx;
+};
+
+static int test_sdap_sync_setup(void **state)
+{
+    struct sdap_sync_test_ctx *test_ctx;
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context, struct sdap_sync_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_dom_suite_setup(TESTS_PATH);
+
+    test_ctx->tctx = create_dom_test_ctx(test_ctx, TESTS_PATH, TEST_CONF_DB,
+                                         TEST_DOM_NAME, TEST_ID_PROVIDER,
+                                         NULL);
+    assert_non_null(test_ctx->tctx);
+
+    check_leaks_push(test_ctx);
+    *state = test_ctx;
+    return 0;
+}
+
+static int test_sdap_sync_teardown(void **state)
+{
+    struct sdap_sync_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                struct sdap_sync_test_ctx);
+
+    assert_true(check_leaks_pop(test_ctx));
+    talloc_zfree(test_ctx);
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+static struct berval *test_flatten(TALLOC_CTX *mem_ctx, BerElement *ber)
+{
+    struct berval *flat = NULL;
+    struct berval *value;
+
+    assert_int_not_equal(ber_flatten(ber, &flat), -1);
+    ber_free(ber, 1);
+
+    value = talloc_zero(mem_ctx, struct berval);
+    assert_non_null(value);
+    value->bv_val = talloc_memdup(value, flat->bv_val, flat->bv_len);
+    assert_non_null(value->bv_val);
+    value->bv_len = flat->bv_len;
+    ber_bvfree(flat);
+
+    return value;
+}
+
+static struct berval *test_state_value(TALLOC_CTX *mem_ctx,
+                                       int sync_state,
+                                       const uint8_t *uuid,
+                                       const char *cookie)
+{
+    struct berval uuid_bv = { SDAP_SYNC_UUID_LEN, discard_const(uuid) };
+    struct berval cookie_bv;
+    BerElement *ber;
+
+    ber = ber_alloc_t(LBER_USE_DER);
+    assert_non_null(ber);
+
+    if (cookie != NULL) {
+        cookie_bv.bv_len = strlen(cookie);
+        cookie_bv.bv_val = discard_const(cookie);
+        assert_int_not_equal(ber_printf(ber, "{eOO}", (ber_int_t) sync_state,
+                                        &uuid_bv, &cookie_bv), -1);
+    } else {
+        assert_int_not_equal(ber_printf(ber, "{eO}", (ber_int_t) sync_state,
+                                        &uuid_bv), -1);
+    }
+
+    return test_flatten(mem_ctx, ber);
+}
+
+static struct berval *test_done_value(TALLOC_CTX *mem_ctx, const char *cookie)
+{
+    struct berval cookie_bv = { strlen(cookie), discard_const(cookie) };
+    BerElement *ber;
+
+    ber = ber_alloc_t(LBER_USE_DER);
+    assert_non_null(ber);
+    assert_int_not_equal(ber_printf(ber, "{O}", &cookie_bv), -1);
+
+    return test_flatten(mem_ctx, ber);
+}
+
+static struct berval *test_dirsync_value(TALLOC_CTX *mem_ctx,
+                                         bool more,
+                                         struct berval *cookie)
+{
+    BerElement *ber;
+
+    ber = ber_alloc_t(LBER_USE_DER);
+    assert_non_null(ber);
+    assert_int_not_equal(ber_printf(ber, "{iiO}", (ber_int_t) more,
+                                    (ber_int_t) 0, cookie), -1);
+
+    return test_flatten(mem_ctx, ber);
+}
+
+/* Change tracking request as the task creates it, with the cookie
+ * stored in the cache */
+static struct tevent_req *test_sync_req(TALLOC_CTX *mem_ctx,
+                                        struct sss_domain_info *dom,
+                                        enum sdap_sync_mode mode,
+                                        struct sdap_sync_state **_state)
+{
+    struct sdap_sync_state *state;
+    struct tevent_req *req;
+    uint8_t *cookie;
+    size_t cookie_len;
+    errno_t ret;
+
+    req = tevent_req_create(mem_ctx, &state, struct sdap_sync_state);
+    assert_non_null(req);
+
+    state->dom = dom;
+    state->mode = mode;
+
+    ret = sysdb_get_change_tracking_cookie(state, dom, &cookie, &cookie_len);
+    if (ret == ENOENT) {
+        state->initial = true;
+    } else {
+        assert_int_equal(ret, EOK);
+        state->cookie = talloc_zero(state, struct berval);
+        assert_non_null(state->cookie);
+        state->cookie->bv_val = (char *) cookie;
+        state->cookie->bv_len = cookie_len;
+        talloc_steal(state->cookie, cookie);
+    }
+
+    *_state = state;
+    return req;
+}
+
+static void assert_cookie(struct berval *cookie, const void *data, size_t len)
+{
+    assert_non_null(cookie);
+    assert_int_equal(cookie->bv_len, len);
+    assert_memory_equal(cookie->bv_val, data, len);
+}
+
+static void assert_stored_cookie(struct sss_domain_info *dom,
+                                 const void *data, size_t len)
+{
+    uint8_t *cookie;
+    size_t cookie_len;
+    errno_t ret;
+
+    ret = sysdb_get_change_tracking_cookie(NULL, dom, &cookie, &cookie_len);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(cookie_len, len);
+    assert_memory_equal(cookie, data, len);
+    talloc_free(cookie);
+}
+
+static void test_store_user(struct sss_domain_info *dom,
+                            const char *name,
+                            uid_t uid,
+                            const char *uuid,
+                            const char *dn)
+{
+    struct sysdb_attrs *attrs;
+    errno_t ret;
+
+    attrs = sysdb_new_attrs(NULL);
+    assert_non_null(attrs);
+    ret = sysdb_attrs_add_string(attrs, SYSDB_UUID, uuid);
+    assert_int_equal(ret, EOK);
+    ret = sysdb_store_user(dom, name, NULL, uid, uid, NULL, "/home/test",
+                           "/bin/sh", dn, attrs, NULL, 3600, time(NULL));
+    assert_int_equal(ret, EOK);
+    talloc_free(attrs);
+}
+
+static void test_store_group(struct sss_domain_info *dom,
+                             const char *name,
+                             gid_t gid,
+                             const char *uuid,
+                             const char *dn)
+{
+    struct sysdb_attrs *attrs;
+    errno_t ret;
+
+    attrs = sysdb_new_attrs(NULL);
+    assert_non_null(attrs);
+    ret = sysdb_attrs_add_string(attrs, SYSDB_UUID, uuid);
+    assert_int_equal(ret, EOK);
+    ret = sysdb_attrs_add_string(attrs, SYSDB_ORIG_DN, dn);
+    assert_int_equal(ret, EOK);
+    ret = sysdb_store_group(dom, name, gid, attrs, 3600, time(NULL));
+    assert_int_equal(ret, EOK);
+    talloc_free(attrs);
+}
+
+static uint64_t test_user_expire(TALLOC_CTX *mem_ctx,
+                                 struct sss_domain_info *dom,
+                                 const char *name)
+{
+    struct ldb_result *res;
+    uint64_t expire;
+    errno_t ret;
+
+    ret = sysdb_getpwnam(mem_ctx, dom, name, &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, 1);
+    expire = ldb_msg_find_attr_as_uint64(res->msgs[0], SYSDB_CACHE_EXPIRE, 0);
+    talloc_free(res);
+
+    return expire;
+}
+
+static unsigned int test_user_count(TALLOC_CTX *mem_ctx,
+                                    struct sss_domain_info *dom,
+                                    const char *name)
+{
+    struct ldb_result *res;
+    unsigned int count;
+    errno_t ret;
+
+    ret = sysdb_getpwnam(mem_ctx, dom, name, &res);
+    assert_int_equal(ret, EOK);
+    count = res->count;
+    talloc_free(res);
+
+    return count;
+}
+
+static unsigned int test_group_count(TALLOC_CTX *mem_ctx,
+                                     struct sss_domain_info *dom,
+                                     const char *name)
+{
+    struct ldb_result *res;
+    unsigned int count;
+    errno_t ret;
+
+    ret = sysdb_getgrnam(mem_ctx, dom, name, &res);
+    assert_int_equal(ret, EOK);
+    count = res->count;
+    talloc_free(res);
+
+    return count;
+}
+
+static void test_sdap_sync_mode(void **state)
+{
+    enum sdap_sync_mode mode;
+    errno_t ret;
+
+    ret = sdap_sync_mode_from_string("none", &mode);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(mode, SDAP_SYNC_NONE);
+
+    ret = sdap_sync_mode_from_string("SyncRepl", &mode);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(mode, SDAP_SYNC_SYNCREPL);
+
+    ret = sdap_sync_mode_from_string("dirsync", &mode);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(mode, SDAP_SYNC_DIRSYNC);
+
+    ret = sdap_sync_mode_from_string("auto", &mode);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(mode, SDAP_SYNC_AUTO);
+
+    ret = sdap_sync_mode_from_string("persist", &mode);
+    assert_int_equal(ret, EINVAL);
+}
+
+static void test_sdap_sync_syncrepl_request(void **state)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct berval cookie = { 5, discard_const("rid=1") };
+    struct berval *value;
+    struct berval scanned;
+    BerElement *ber;
+    ber_int_t mode;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    assert_non_null(tmp_ctx);
+
+    ret = sdap_sync_encode_syncrepl_request(tmp_ctx, &cookie, &value);
+    assert_int_equal(ret, EOK);
+
+    ber = ber_init(value);
+    assert_non_null(ber);
+    assert_int_not_equal(ber_scanf(ber, "{em}", &mode, &scanned), LBER_ERROR);
+    assert_int_equal(mode, LDAP_SYNC_REFRESH_ONLY);
+    assert_int_equal(scanned.bv_len, cookie.bv_len);
+    assert_memory_equal(scanned.bv_val, cookie.bv_val, cookie.bv_len);
+    ber_free(ber, 1);
+
+    talloc_free(tmp_ctx);
+}
+
+static void test_sdap_sync_state_control(void **state)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct berval uuid_bv = { sizeof(test_user_uuid),
+                              discard_const(test_user_uuid) };
+    struct berval cookie = { 9, discard_const("rid=1,csn") };
+    struct berval *value;
+    struct berval *parsed_cookie;
+    BerElement *ber;
+    char *uuid;
+    int sync_state;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    assert_non_null(tmp_ctx);
+
+    ber = ber_alloc_t(LBER_USE_DER);
+    assert_non_null(ber);
+    assert_int_not_equal(ber_printf(ber, "{eOO}", (ber_int_t) LDAP_SYNC_MODIFY,
+                                    &uuid_bv, &cookie), -1);
+    value = test_flatten(tmp_ctx, ber);
+
+    ret = sdap_sync_parse_state_control(tmp_ctx, value, &sync_state,
+                                        &uuid, &parsed_cookie);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(sync_state, LDAP_SYNC_MODIFY);
+    assert_string_equal(uuid, TEST_USER_UUID);
+    assert_non_null(parsed_cookie);
+    assert_int_equal(parsed_cookie->bv_len, cookie.bv_len);
+    assert_memory_equal(parsed_cookie->bv_val, cookie.bv_val, cookie.bv_len);
+
+    /* The cookie is optional */
+    ber = ber_alloc_t(LBER_USE_DER);
+    assert_non_null(ber);
+    assert_int_not_equal(ber_printf(ber, "{eO}", (ber_int_t) LDAP_SYNC_DELETE,
+                                    &uuid_bv), -1);
+    value = test_flatten(tmp_ctx, ber);
+
+    ret = sdap_sync_parse_state_control(tmp_ctx, value, &sync_state,
+                                        &uuid, &parsed_cookie);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(sync_state, LDAP_SYNC_DELETE);
+    assert_null(parsed_cookie);
+
+    talloc_free(tmp_ctx);
+}
+
+static void test_sdap_sync_info(void **state)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct berval cookie = { 9, discard_const("rid=1,csn") };
+    struct berval uuids_bv[] = { { sizeof(test_user_uuid),
+                                   discard_const(test_user_uuid) },
+                                 { sizeof(test_group_uuid),
+                                   discard_const(test_group_uuid) },
+                                 { 0, NULL } };
+    struct berval *value;
+    struct berval *parsed_cookie;
+    BerElement *ber;
+    char **uuids;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    assert_non_null(tmp_ctx);
+
+    /* newcookie */
+    ber = ber_alloc_t(LBER_USE_DER);
+    assert_non_null(ber);
+    assert_int_not_equal(ber_printf(ber, "tO", LDAP_TAG_SYNC_NEW_COOKIE,
+                                    &cookie), -1);
+    value = test_flatten(tmp_ctx, ber);
+
+    ret = sdap_sync_parse_info(tmp_ctx, value, &parsed_cookie, &uuids);
+    assert_int_equal(ret, EOK);
+    assert_non_null(parsed_cookie);
+    assert_memory_equal(parsed_cookie->bv_val, cookie.bv_val, cookie.bv_len);
+    assert_null(uuids);
+
+    /* syncIdSet of deleted entries */
+    ber = ber_alloc_t(LBER_USE_DER);
+    assert_non_null(ber);
+    assert_int_not_equal(ber_printf(ber, "t{Ob[W]}", LDAP_TAG_SYNC_ID_SET,
+                                    &cookie, (ber_int_t) 1, uuids_bv), -1);
+    value = test_flatten(tmp_ctx, ber);
+
+    ret = sdap_sync_parse_info(tmp_ctx, value, &parsed_cookie, &uuids);
+    assert_int_equal(ret, EOK);
+    assert_non_null(parsed_cookie);
+    assert_non_null(uuids);
+    assert_string_equal(uuids[0], TEST_USER_UUID);
+    assert_string_equal(uuids[1], TEST_GROUP_UUID);
+    assert_null(uuids[2]);
+
+    /* syncIdSet of present entries does not report anything */
+    ber = ber_alloc_t(LBER_USE_DER);
+    assert_non_null(ber);
+    assert_int_not_equal(ber_printf(ber, "t{[W]}", LDAP_TAG_SYNC_ID_SET,
+                                    uuids_bv), -1);
+    value = test_flatten(tmp_ctx, ber);
+
+    ret = sdap_sync_parse_info(tmp_ctx, value, &parsed_cookie, &uuids);
+    assert_int_equal(ret, EOK);
+    assert_null(parsed_cookie);
+    assert_null(uuids);
+
+    talloc_free(tmp_ctx);
+}
+
+static void test_sdap_sync_dirsync(void **state)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct berval cookie = { 6, discard_const("\x01\x02\x00\x03\x04\x05") };
+    struct berval *value;
+    struct berval *parsed_cookie;
+    struct berval scanned;
+    BerElement *ber;
+    ber_int_t flags;
+    ber_int_t max_bytes;
+    bool more;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    assert_non_null(tmp_ctx);
+
+    /* The request carries an empty cookie the first time */
+    ret = sdap_sync_encode_dirsync_request(tmp_ctx,
+                                           LDAP_DIRSYNC_OBJECT_SECURITY,
+                                           NULL, &value);
+    assert_int_equal(ret, EOK);
+
+    ber = ber_init(value);
+    assert_non_null(ber);
+    assert_int_not_equal(ber_scanf(ber, "{iim}", &flags, &max_bytes,
+                                   &scanned), LBER_ERROR);
+    assert_int_equal(flags, LDAP_DIRSYNC_OBJECT_SECURITY);
+    assert_true(max_bytes > 0);
+    assert_int_equal(scanned.bv_len, 0);
+    ber_free(ber, 1);
+
+    /* Response with more results pending */
+    ber = ber_alloc_t(LBER_USE_DER);
+    assert_non_null(ber);
+    assert_int_not_equal(ber_printf(ber, "{iiO}", (ber_int_t) 1,
+                                    (ber_int_t) 0, &cookie), -1);
+    value = test_flatten(tmp_ctx, ber);
+
+    ret = sdap_sync_parse_dirsync_response(tmp_ctx, value, &more,
+                                           &parsed_cookie);
+    assert_int_equal(ret, EOK);
+    assert_true(more);
+    assert_int_equal(parsed_cookie->bv_len, cookie.bv_len);
+    assert_memory_equal(parsed_cookie->bv_val, cookie.bv_val, cookie.bv_len);
+
+    talloc_free(tmp_ctx);
+}
+
+static void test_sdap_sync_cookie(void **state)
+{
+    struct sdap_sync_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                struct sdap_sync_test_ctx);
+    struct sss_domain_info *dom = test_ctx->tctx->dom;
+    const uint8_t data[] = { 'r', 'i', 'd', 0x00, 0xff };
+    uint8_t *cookie;
+    size_t cookie_len;
+    errno_t ret;
+
+    ret = sysdb_get_change_tracking_cookie(test_ctx, dom,
+                                           &cookie, &cookie_len);
+    assert_int_equal(ret, ENOENT);
+
+    ret = sysdb_set_change_tracking_cookie(dom, data, sizeof(data));
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_get_change_tracking_cookie(test_ctx, dom,
+                                           &cookie, &cookie_len);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(cookie_len, sizeof(data));
+    assert_memory_equal(cookie, data, sizeof(data));
+    talloc_free(cookie);
+
+    ret = sysdb_set_change_tracking_cookie(dom, NULL, 0);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_get_change_tracking_cookie(test_ctx, dom,
+                                           &cookie, &cookie_len);
+    assert_int_equal(ret, ENOENT);
+}
+
+static void test_sdap_sync_apply_changes(void **state)
+{
+    struct sdap_sync_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                struct sdap_sync_test_ctx);
+    struct sss_domain_info *dom = test_ctx->tctx->dom;
+    struct sdap_sync_change changes[] = {
+        /* modified user, found by DN */
+        { TEST_USER_DN, NULL, false },
+        /* deleted group, found by UUID */
+        { NULL, TEST_GROUP_UUID, true },
+        /* not cached */
+        { "uid=other,ou=People,dc=example,dc=com", NULL, true },
+    };
+    struct sysdb_attrs *attrs;
+    struct ldb_result *res;
+    size_t num_expired;
+    size_t num_deleted;
+    time_t now = time(NULL);
+    errno_t ret;
+
+    attrs = sysdb_new_attrs(test_ctx);
+    assert_non_null(attrs);
+    ret = sysdb_attrs_add_string(attrs, SYSDB_UUID, TEST_USER_UUID);
+    assert_int_equal(ret, EOK);
+    ret = sysdb_store_user(dom, TEST_USER_NAME, NULL, 1234, 1234, NULL,
+                           "/home/" TEST_USER_NAME, "/bin/sh", TEST_USER_DN,
+                           attrs, NULL, 3600, now);
+    assert_int_equal(ret, EOK);
+    talloc_free(attrs);
+
+    attrs = sysdb_new_attrs(test_ctx);
+    assert_non_null(attrs);
+    ret = sysdb_attrs_add_string(attrs, SYSDB_UUID, TEST_GROUP_UUID);
+    assert_int_equal(ret, EOK);
+    ret = sysdb_attrs_add_string(attrs, SYSDB_ORIG_DN, TEST_GROUP_DN);
+    assert_int_equal(ret, EOK);
+    ret = sysdb_store_group(dom, TEST_GROUP_NAME, 1235, attrs, 3600, now);
+    assert_int_equal(ret, EOK);
+    talloc_free(attrs);
+
+    ret = sdap_sync_apply_changes(dom, changes, N_ELEMENTS(changes),
+                                  &num_expired, &num_deleted);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(num_expired, 1);
+    assert_int_equal(num_deleted, 1);
+
+    ret = sysdb_getpwnam(test_ctx, dom, TEST_USER_NAME, &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, 1);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(res->msgs[0],
+                                                 SYSDB_CACHE_EXPIRE, 0), 1);
+    talloc_free(res);
+
+    ret = sysdb_getgrnam(test_ctx, dom, TEST_GROUP_NAME, &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, 0);
+    talloc_free(res);
+}
+
+static void test_sdap_sync_syncrepl_changes(void **state)
+{
+    struct sdap_sync_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                struct sdap_sync_test_ctx);
+    struct sss_domain_info *dom = test_ctx->tctx->dom;
+    struct berval cookie_bv = { strlen(TEST_COOKIE_3),
+                                discard_const(TEST_COOKIE_3) };
+    struct berval uuids_bv[] = { { sizeof(test_user2_uuid),
+                                   discard_const(test_user2_uuid) },
+                                 { 0, NULL } };
+    struct sdap_sync_state *sync_state;
+    struct tevent_req *req;
+    struct berval *value;
+    BerElement *ber;
+    bool more = true;
+    errno_t ret;
+
+    ret = sysdb_set_change_tracking_cookie(dom,
+                                           (const uint8_t *) TEST_COOKIE_1,
+                                           strlen(TEST_COOKIE_1));
+    assert_int_equal(ret, EOK);
+
+    test_store_user(dom, TEST_USER_NAME, 1234, TEST_USER_UUID, TEST_USER_DN);
+    test_store_user(dom, TEST_USER2_NAME, 1236, TEST_USER2_UUID, TEST_USER2_DN);
+    test_store_group(dom, TEST_GROUP_NAME, 1235, TEST_GROUP_UUID,
+                     TEST_GROUP_DN);
+
+    req = test_sync_req(test_ctx, dom, SDAP_SYNC_SYNCREPL, &sync_state);
+    assert_false(sync_state->initial);
+    assert_cookie(sync_state->cookie, TEST_COOKIE_1, strlen(TEST_COOKIE_1));
+
+    /* A modified entry, the state control carries a new cookie */
+    value = test_state_value(req, LDAP_SYNC_MODIFY, test_user_uuid,
+                             TEST_COOKIE_2);
+    ret = sdap_sync_process_state(sync_state, TEST_USER_DN, value);
+    assert_int_equal(ret, EOK);
+    assert_cookie(sync_state->cookie, TEST_COOKIE_2, strlen(TEST_COOKIE_2));
+
+    /* A deleted entry without a cookie keeps the previous one */
+    value = test_state_value(req, LDAP_SYNC_DELETE, test_group_uuid, NULL);
+    ret = sdap_sync_process_state(sync_state, TEST_GROUP_DN, value);
+    assert_int_equal(ret, EOK);
+    assert_cookie(sync_state->cookie, TEST_COOKIE_2, strlen(TEST_COOKIE_2));
+
+    /* Unchanged entries are not reported */
+    value = test_state_value(req, LDAP_SYNC_PRESENT, test_user2_uuid, NULL);
+    ret = sdap_sync_process_state(sync_state, TEST_USER2_DN, value);
+    assert_int_equal(ret, EOK);
+
+    assert_int_equal(sync_state->num_changes, 2);
+    assert_string_equal(sync_state->changes[0].dn, TEST_USER_DN);
+    assert_string_equal(sync_state->changes[0].uuid, TEST_USER_UUID);
+    assert_false(sync_state->changes[0].deleted);
+    assert_string_equal(sync_state->changes[1].uuid, TEST_GROUP_UUID);
+    assert_true(sync_state->changes[1].deleted);
+
+    /* Deletions are also reported by UUID only in a syncIdSet */
+    ber = ber_alloc_t(LBER_USE_DER);
+    assert_non_null(ber);
+    assert_int_not_equal(ber_printf(ber, "t{Ob[W]}", LDAP_TAG_SYNC_ID_SET,
+                                    &cookie_bv, (ber_int_t) 1, uuids_bv), -1);
+    value = test_flatten(req, ber);
+
+    ret = sdap_sync_process_info(sync_state, value);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(sync_state->num_changes, 3);
+    assert_null(sync_state->changes[2].dn);
+    assert_string_equal(sync_state->changes[2].uuid, TEST_USER2_UUID);
+    assert_true(sync_state->changes[2].deleted);
+    assert_cookie(sync_state->cookie, TEST_COOKIE_3, strlen(TEST_COOKIE_3));
+
+    /* The Sync Done control ends the refresh */
+    value = test_done_value(req, TEST_COOKIE_4);
+    ret = sdap_sync_process_result(sync_state, LDAP_SUCCESS, value, &more);
+    assert_int_equal(ret, EOK);
+    assert_false(more);
+    assert_false(sync_state->refresh_required);
+    assert_cookie(sync_state->cookie, TEST_COOKIE_4, strlen(TEST_COOKIE_4));
+
+    /* Nothing is written to the cache before the search finishes */
+    assert_stored_cookie(dom, TEST_COOKIE_1, strlen(TEST_COOKIE_1));
+    assert_int_not_equal(test_user_expire(test_ctx, dom, TEST_USER_NAME), 1);
+
+    ret = sdap_sync_finish(req);
+    assert_int_equal(ret, EOK);
+
+    assert_int_equal(test_user_expire(test_ctx, dom, TEST_USER_NAME), 1);
+    assert_int_equal(test_user_count(test_ctx, dom, TEST_USER2_NAME), 0);
+    assert_int_equal(test_group_count(test_ctx, dom, TEST_GROUP_NAME), 0);
+    assert_stored_cookie(dom, TEST_COOKIE_4, strlen(TEST_COOKIE_4));
+
+    talloc_free(req);
+}
+
+static void test_sdap_sync_syncrepl_refresh_required(void **state)
+{
+    struct sdap_sync_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                struct sdap_sync_test_ctx);
+    struct sss_domain_info *dom = test_ctx->tctx->dom;
+    struct sdap_sync_state *sync_state;
+    struct tevent_req *req;
+    struct berval *value;
+    uint8_t *cookie;
+    size_t cookie_len;
+    bool more = false;
+    errno_t ret;
+
+    ret = sysdb_set_change_tracking_cookie(dom,
+                                           (const uint8_t *) TEST_COOKIE_1,
+                                           strlen(TEST_COOKIE_1));
+    assert_int_equal(ret, EOK);
+
+    test_store_user(dom, TEST_USER_NAME, 1234, TEST_USER_UUID, TEST_USER_DN);
+
+    req = test_sync_req(test_ctx, dom, SDAP_SYNC_SYNCREPL, &sync_state);
+
+    value = test_state_value(req, LDAP_SYNC_MODIFY, test_user_uuid,
+                             TEST_COOKIE_2);
+    ret = sdap_sync_process_state(sync_state, TEST_USER_DN, value);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(sync_state->num_changes, 1);
+
+    /* The server cannot use the cookie, the stored one is dropped and
+     * the changes are not applied */
+    ret = sdap_sync_process_result(sync_state, LDAP_SYNC_REFRESH_REQUIRED,
+                                   NULL, &more);
+    assert_int_equal(ret, EOK);
+    assert_true(sync_state->refresh_required);
+
+    ret = sysdb_get_change_tracking_cookie(test_ctx, dom,
+                                           &cookie, &cookie_len);
+    assert_int_equal(ret, ENOENT);
+    assert_int_not_equal(test_user_expire(test_ctx, dom, TEST_USER_NAME), 1);
+    talloc_free(req);
+
+    /* Other errors fail the run and keep the cookie */
+    ret = sysdb_set_change_tracking_cookie(dom,
+                                           (const uint8_t *) TEST_COOKIE_1,
+                                           strlen(TEST_COOKIE_1));
+    assert_int_equal(ret, EOK);
+
+    req = test_sync_req(test_ctx, dom, SDAP_SYNC_SYNCREPL, &sync_state);
+
+    ret = sdap_sync_process_result(sync_state,
+                                   LDAP_UNAVAILABLE_CRITICAL_EXTENSION,
+                                   NULL, &more);
+    assert_int_equal(ret, ENOTSUP);
+
+    ret = sdap_sync_process_result(sync_state, LDAP_OTHER, NULL, &more);
+    assert_int_equal(ret, EIO);
+    assert_false(sync_state->refresh_required);
+
+    assert_stored_cookie(dom, TEST_COOKIE_1, strlen(TEST_COOKIE_1));
+    talloc_free(req);
+}
+
+static void test_sdap_sync_initial(void **state)
+{
+    struct sdap_sync_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                struct sdap_sync_test_ctx);
+    struct sss_domain_info *dom = test_ctx->tctx->dom;
+    struct sdap_sync_state *sync_state;
+    struct tevent_req *req;
+    struct berval *value;
+    uint8_t *cookie;
+    size_t cookie_len;
+    bool more = true;
+    errno_t ret;
+
+    test_store_user(dom, TEST_USER_NAME, 1234, TEST_USER_UUID, TEST_USER_DN);
+
+    req = test_sync_req(test_ctx, dom, SDAP_SYNC_SYNCREPL, &sync_state);
+    assert_true(sync_state->initial);
+    assert_null(sync_state->cookie);
+
+    /* A run which did not get any cookie fails */
+    ret = sdap_sync_finish(req);
+    assert_int_equal(ret, EIO);
+
+    ret = sysdb_get_change_tracking_cookie(test_ctx, dom,
+                                           &cookie, &cookie_len);
+    assert_int_equal(ret, ENOENT);
+
+    /* The first run only records the cookie, the cache stays as it is */
+    value = test_state_value(req, LDAP_SYNC_ADD, test_user_uuid,
+                             TEST_COOKIE_1);
+    ret = sdap_sync_process_state(sync_state, TEST_USER_DN, value);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(sync_state->num_changes, 0);
+    assert_cookie(sync_state->cookie, TEST_COOKIE_1, strlen(TEST_COOKIE_1));
+
+    value = test_done_value(req, TEST_COOKIE_2);
+    ret = sdap_sync_process_result(sync_state, LDAP_SUCCESS, value, &more);
+    assert_int_equal(ret, EOK);
+    assert_false(more);
+
+    ret = sdap_sync_finish(req);
+    assert_int_equal(ret, EOK);
+
+    assert_stored_cookie(dom, TEST_COOKIE_2, strlen(TEST_COOKIE_2));
+    assert_int_not_equal(test_user_expire(test_ctx, dom, TEST_USER_NAME), 1);
+
+    talloc_free(req);
+}
+
+static void test_sdap_sync_dirsync_changes(void **state)
+{
+    struct sdap_sync_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                struct sdap_sync_test_ctx);
+    struct sss_domain_info *dom = test_ctx->tctx->dom;
+    struct berval cookie1 = { 6, discard_const("\x01\x02\x00\x03\x04\x05") };
+    struct berval cookie2 = { 6, discard_const("\x01\x02\x00\x03\x04\x06") };
+    struct berval cookie3 = { 6, discard_const("\x01\x02\x00\x03\x04\x07") };
+    struct berval user_guid = { GUID_BIN_LENGTH,
+                                discard_const(test_user_uuid) };
+    struct berval group_guid = { GUID_BIN_LENGTH,
+                                 discard_const(test_group_uuid) };
+    struct berval is_deleted = { 4, discard_const("TRUE") };
+    char user_uuid[GUID_STR_BUF_SIZE];
+    char group_uuid[GUID_STR_BUF_SIZE];
+    struct sdap_sync_state *sync_state;
+    struct tevent_req *req;
+    struct berval *value;
+    bool more = false;
+    errno_t ret;
+
+    /* DirSync returns the objectGUID in the Active Directory format */
+    ret = guid_blob_to_string_buf(test_user_uuid, user_uuid,
+                                  GUID_STR_BUF_SIZE);
+    assert_int_equal(ret, EOK);
+    ret = guid_blob_to_string_buf(test_group_uuid, group_uuid,
+                                  GUID_STR_BUF_SIZE);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_set_change_tracking_cookie(dom,
+                                           (const uint8_t *) cookie1.bv_val,
+                                           cookie1.bv_len);
+    assert_int_equal(ret, EOK);
+
+    test_store_user(dom, TEST_USER_NAME, 1234, user_uuid, TEST_USER_DN);
+    test_store_group(dom, TEST_GROUP_NAME, 1235, group_uuid, TEST_GROUP_DN);
+
+    req = test_sync_req(test_ctx, dom, SDAP_SYNC_DIRSYNC, &sync_state);
+    assert_false(sync_state->initial);
+    assert_cookie(sync_state->cookie, cookie1.bv_val, cookie1.bv_len);
+
+    /* A modified entry */
+    ret = sdap_sync_process_dirsync_entry(sync_state, TEST_USER_DN,
+                                          &user_guid, NULL);
+    assert_int_equal(ret, EOK);
+
+    /* Deleted objects are renamed, they are found by their GUID */
+    ret = sdap_sync_process_dirsync_entry(sync_state, TEST_DELETED_GROUP_DN,
+                                          &group_guid, &is_deleted);
+    assert_int_equal(ret, EOK);
+
+    assert_int_equal(sync_state->num_changes, 2);
+    assert_string_equal(sync_state->changes[0].uuid, user_uuid);
+    assert_false(sync_state->changes[0].deleted);
+    assert_string_equal(sync_state->changes[1].dn, TEST_DELETED_GROUP_DN);
+    assert_string_equal(sync_state->changes[1].uuid, group_uuid);
+    assert_true(sync_state->changes[1].deleted);
+
+    /* The changes come in rounds, each with a new cookie */
+    value = test_dirsync_value(req, true, &cookie2);
+    ret = sdap_sync_process_result(sync_state, LDAP_SUCCESS, value, &more);
+    assert_int_equal(ret, EOK);
+    assert_true(more);
+    assert_cookie(sync_state->cookie, cookie2.bv_val, cookie2.bv_len);
+
+    value = test_dirsync_value(req, false, &cookie3);
+    ret = sdap_sync_process_result(sync_state, LDAP_SUCCESS, value, &more);
+    assert_int_equal(ret, EOK);
+    assert_false(more);
+    assert_cookie(sync_state->cookie, cookie3.bv_val, cookie3.bv_len);
+
+    ret = sdap_sync_finish(req);
+    assert_int_equal(ret, EOK);
+
+    assert_int_equal(test_user_expire(test_ctx, dom, TEST_USER_NAME), 1);
+    assert_int_equal(test_group_count(test_ctx, dom, TEST_GROUP_NAME), 0);
+    assert_stored_cookie(dom, cookie3.bv_val, cookie3.bv_len);
+
+    talloc_free(req);
+}
+
+int main(int argc, const char *argv[])
+{
+    poptContext pc;
+    int opt;
+    int rv;
+    int no_cleanup = 0;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        {"no-cleanup", 'n', POPT_ARG_NONE, &no_cleanup, 0,
+         _("Do not delete the test database after a test run"), NULL },
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_sdap_sync_mode),
+        cmocka_unit_test(test_sdap_sync_syncrepl_request),
+        cmocka_unit_test(test_sdap_sync_state_control),
+        cmocka_unit_test(test_sdap_sync_info),
+        cmocka_unit_test(test_sdap_sync_dirsync),
+        cmocka_unit_test_setup_teardown(test_sdap_sync_cookie,
+                                        test_sdap_sync_setup,
+                                        test_sdap_sync_teardown),
+        cmocka_unit_test_setup_teardown(test_sdap_sync_apply_changes,
+                                        test_sdap_sync_setup,
+                                        test_sdap_sync_teardown),
+        cmocka_unit_test_setup_teardown(test_sdap_sync_syncrepl_changes,
+                                        test_sdap_sync_setup,
+                                        test_sdap_sync_teardown),
+        cmocka_unit_test_setup_teardown(test_sdap_sync_syncrepl_refresh_required,
+                                        test_sdap_sync_setup,
+                                        test_sdap_sync_teardown),
+        cmocka_unit_test_setup_teardown(test_sdap_sync_initial,
+                                        test_sdap_sync_setup,
+                                        test_sdap_sync_teardown),
+        cmocka_unit_test_setup_teardown(test_sdap_sync_dirsync_changes,
+                                        test_sdap_sync_setup,
+                                        test_sdap_sync_teardown),
+    };
+
+    /* Set debug level to invalid value so we can decide if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while ((opt = poptGetNextOpt(pc)) != -1) {
+        switch (opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    tests_set_cwd();
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    rv = cmocka_run_group_tests(tests, NULL, NULL);
+
+    if (rv == 0 && no_cleanup == 0) {
+        test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    }
+    return rv;
+}
@@ -0,0 +1,482 @@
+/*
+    SSSD
+
+    sssctl_cache - Tests for the cache-export and cache-import commands
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "tests/cmocka/common_mock.h"
+#include "tools/common/sss_tools.h"
+#include "tools/sssctl/sssctl.h"
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "tests_conf.ldb"
+#define TEST_ID_PROVIDER "ldap"
+#define TEST_DUMP_FILE "tp_" BASE_FILE_STEM ".dump"
+
+#define TEST_DOM_NAME_1 "test_sssctl_cache_1"
+#define TEST_DOM_NAME_2 "test_sssctl_cache_2"
+
+#define TEST_USER_1         "test_user_1"
+#define TEST_USER_2         "test_user_2"
+#define TEST_USER_UID_1     4321
+#define TEST_USER_UID_2     4322
+#define TEST_USER_GID       4320
+
+#define TEST_GROUP_1        "test_group_1"
+#define TEST_GROUP_2        "test_group_2"
+#define TEST_GROUP_GID_1    1234
+#define TEST_GROUP_GID_2    1235
+
+#define TEST_CACHE_TIMEOUT  300
+
+/* More than the import lists hold before they grow twice */
+#define TEST_NUM_MANY_USERS 300
+#define TEST_MANY_USER_UID  10000
+
+struct sssctl_cache_test_ctx {
+    struct sss_test_ctx *tctx;
+    struct sss_tool_ctx tool_ctx;
+};
+
+const char *domains[] = { TEST_DOM_NAME_1,
+                          TEST_DOM_NAME_2,
+                          NULL };
+
+static void create_domains(struct sssctl_cache_test_ctx *test_ctx)
+{
+    test_dom_suite_setup(TESTS_PATH);
+
+    test_ctx->tctx = create_multidom_test_ctx(test_ctx, TESTS_PATH,
+                                              TEST_CONF_DB, domains,
+                                              TEST_ID_PROVIDER, NULL);
+    assert_non_null(test_ctx->tctx);
+
+    test_ctx->tool_ctx.confdb = test_ctx->tctx->confdb;
+    test_ctx->tool_ctx.domains = test_ctx->tctx->dom;
+}
+
+/* Replaces the caches of all domains with empty ones. */
+static void reset_domains(struct sssctl_cache_test_ctx *test_ctx)
+{
+    talloc_zfree(test_ctx->tctx);
+    test_multidom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, domains);
+
+    create_domains(test_ctx);
+}
+
+static int test_sssctl_cache_setup(void **state)
+{
+    struct sssctl_cache_test_ctx *test_ctx;
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context,
+                           struct sssctl_cache_test_ctx);
+    assert_non_null(test_ctx);
+
+    create_domains(test_ctx);
+
+    *state = test_ctx;
+    return 0;
+}
+
+static int test_sssctl_cache_teardown(void **state)
+{
+    struct sssctl_cache_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                            struct sssctl_cache_test_ctx);
+
+    unlink(TEST_DUMP_FILE);
+    talloc_zfree(test_ctx);
+    test_multidom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, domains);
+    return 0;
+}
+
+/* Two users and two groups, TEST_GROUP_2 contains TEST_GROUP_1 so the
+ * memberships of TEST_USER_1 are nested. */
+static void populate_domain(struct sss_domain_info *dom)
+{
+    int ret;
+
+    ret = sysdb_store_user(dom, TEST_USER_1, NULL, TEST_USER_UID_1,
+                           TEST_USER_GID, TEST_USER_1, "/home/test_user_1",
+                           "/bin/bash", NULL, NULL, NULL,
+                           TEST_CACHE_TIMEOUT, 0);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_store_user(dom, TEST_USER_2, NULL, TEST_USER_UID_2,
+                           TEST_USER_GID, TEST_USER_2, "/home/test_user_2",
+                           "/bin/bash", NULL, NULL, NULL,
+                           TEST_CACHE_TIMEOUT, 0);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_store_group(dom, TEST_GROUP_1, TEST_GROUP_GID_1, NULL,
+                            TEST_CACHE_TIMEOUT, 0);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_store_group(dom, TEST_GROUP_2, TEST_GROUP_GID_2, NULL,
+                            TEST_CACHE_TIMEOUT, 0);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_add_group_member(dom, TEST_GROUP_1, TEST_USER_1,
+                                 SYSDB_MEMBER_USER, false);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_add_group_member(dom, TEST_GROUP_2, TEST_USER_2,
+                                 SYSDB_MEMBER_USER, false);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_add_group_member(dom, TEST_GROUP_2, TEST_GROUP_1,
+                                 SYSDB_MEMBER_GROUP, false);
+    assert_int_equal(ret, EOK);
+}
+
+static void assert_user(struct sss_domain_info *dom,
+                        const char *name,
+                        uid_t uid)
+{
+    struct ldb_result *res;
+    int ret;
+
+    ret = sysdb_getpwnam(dom, dom, name, &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, 1);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(res->msgs[0],
+                                                 SYSDB_UIDNUM, 0), uid);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(res->msgs[0],
+                                                 SYSDB_GIDNUM, 0),
+                     TEST_USER_GID);
+    assert_string_equal(ldb_msg_find_attr_as_string(res->msgs[0],
+                                                    SYSDB_GECOS, NULL), name);
+    talloc_free(res);
+}
+
+static void assert_group(struct sss_domain_info *dom,
+                         const char *name,
+                         gid_t gid,
+                         unsigned int num_members)
+{
+    const char *attrs[] = { SYSDB_GIDNUM, SYSDB_MEMBER, NULL };
+    struct ldb_message *msg;
+    struct ldb_message_element *el;
+    int ret;
+
+    ret = sysdb_search_group_by_name(dom, dom, name, attrs, &msg);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(msg, SYSDB_GIDNUM, 0), gid);
+
+    el = ldb_msg_find_element(msg, SYSDB_MEMBER);
+    assert_non_null(el);
+    assert_int_equal(el->num_values, num_members);
+    talloc_free(msg);
+}
+
+static void assert_initgroups(struct sss_domain_info *dom,
+                              const char *name,
+                              const char **groups,
+                              size_t num_groups)
+{
+    struct ldb_result *res;
+    const char *group;
+    size_t found = 0;
+    int ret;
+
+    ret = sysdb_initgroups(dom, dom, name, &res);
+    assert_int_equal(ret, EOK);
+
+    /* the first entry is the user itself */
+    assert_int_equal(res->count, num_groups + 1);
+
+    for (unsigned int i = 1; i < res->count; i++) {
+        group = ldb_msg_find_attr_as_string(res->msgs[i], SYSDB_NAME, NULL);
+        assert_non_null(group);
+
+        for (size_t j = 0; j < num_groups; j++) {
+            if (strcmp(group, groups[j]) == 0) {
+                found++;
+                break;
+            }
+        }
+    }
+    assert_int_equal(found, num_groups);
+    talloc_free(res);
+}
+
+static void assert_domain_content(struct sss_domain_info *dom)
+{
+    const char *user1_groups[] = { TEST_GROUP_1, TEST_GROUP_2 };
+    const char *user2_groups[] = { TEST_GROUP_2 };
+
+    assert_user(dom, TEST_USER_1, TEST_USER_UID_1);
+    assert_user(dom, TEST_USER_2, TEST_USER_UID_2);
+
+    assert_group(dom, TEST_GROUP_1, TEST_GROUP_GID_1, 1);
+    assert_group(dom, TEST_GROUP_2, TEST_GROUP_GID_2, 2);
+
+    assert_initgroups(dom, TEST_USER_1, user1_groups,
+                      N_ELEMENTS(user1_groups));
+    assert_initgroups(dom, TEST_USER_2, user2_groups,
+                      N_ELEMENTS(user2_groups));
+}
+
+static void assert_domain_empty(struct sss_domain_info *dom)
+{
+    struct ldb_result *res;
+    int ret;
+
+    ret = sysdb_getpwnam(dom, dom, TEST_USER_1, &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, 0);
+    talloc_free(res);
+
+    ret = sysdb_getgrnam(dom, dom, TEST_GROUP_1, &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, 0);
+    talloc_free(res);
+}
+
+static errno_t run_command(struct sssctl_cache_test_ctx *test_ctx,
+                           const char *command,
+                           sss_route_fn fn)
+{
+    const char *argv[] = { TEST_DUMP_FILE, NULL };
+    struct sss_cmdline cmdline = { "sssctl", command, 1, argv };
+
+    return fn(&cmdline, &test_ctx->tool_ctx);
+}
+
+/* Exports both populated domains and recreates their caches empty. */
+static void export_domains(struct sssctl_cache_test_ctx *test_ctx)
+{
+    struct sss_domain_info *dom;
+    errno_t ret;
+
+    for (dom = test_ctx->tctx->dom; dom != NULL; dom = dom->next) {
+        populate_domain(dom);
+        assert_domain_content(dom);
+    }
+
+    ret = run_command(test_ctx, "cache-export", sssctl_cache_export);
+    assert_int_equal(ret, EOK);
+
+    reset_domains(test_ctx);
+}
+
+static void truncate_dump(off_t by)
+{
+    struct stat st;
+    int ret;
+
+    ret = stat(TEST_DUMP_FILE, &st);
+    assert_int_equal(ret, 0);
+    assert_true(st.st_size > by);
+
+    ret = truncate(TEST_DUMP_FILE, st.st_size - by);
+    assert_int_equal(ret, 0);
+}
+
+static void assert_import_fails(struct sssctl_cache_test_ctx *test_ctx)
+{
+    struct sss_domain_info *dom;
+    errno_t ret;
+
+    ret = run_command(test_ctx, "cache-import", sssctl_cache_import);
+    assert_int_not_equal(ret, EOK);
+
+    /* nothing of the dump may be imported, not even the complete domain */
+    for (dom = test_ctx->tctx->dom; dom != NULL; dom = dom->next) {
+        assert_domain_empty(dom);
+    }
+}
+
+static void test_sssctl_cache_round_trip(void **state)
+{
+    struct sssctl_cache_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                            struct sssctl_cache_test_ctx);
+    struct sss_domain_info *dom;
+    errno_t ret;
+
+    export_domains(test_ctx);
+
+    for (dom = test_ctx->tctx->dom; dom != NULL; dom = dom->next) {
+        assert_domain_empty(dom);
+    }
+
+    ret = run_command(test_ctx, "cache-import", sssctl_cache_import);
+    assert_int_equal(ret, EOK);
+
+    for (dom = test_ctx->tctx->dom; dom != NULL; dom = dom->next) {
+        assert_domain_content(dom);
+    }
+}
+
+static void test_sssctl_cache_import_bad_header(void **state)
+{
+    struct sssctl_cache_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                            struct sssctl_cache_test_ctx);
+    FILE *fp;
+
+    export_domains(test_ctx);
+
+    fp = fopen(TEST_DUMP_FILE, "r+");
+    assert_non_null(fp);
+    assert_int_equal(fwrite("XXXX", 4, 1, fp), 1);
+    assert_int_equal(fclose(fp), 0);
+
+    assert_import_fails(test_ctx);
+}
+
+static void test_sssctl_cache_import_missing_end(void **state)
+{
+    struct sssctl_cache_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                            struct sssctl_cache_test_ctx);
+
+    export_domains(test_ctx);
+
+    /* drop the END record, the last domain is still complete */
+    truncate_dump(sizeof(uint32_t));
+
+    assert_import_fails(test_ctx);
+}
+
+static void test_sssctl_cache_import_truncated(void **state)
+{
+    struct sssctl_cache_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                            struct sssctl_cache_test_ctx);
+
+    export_domains(test_ctx);
+
+    /* cut the last entry of the second domain */
+    truncate_dump(sizeof(uint32_t) + 2);
+
+    assert_import_fails(test_ctx);
+}
+
+static void test_sssctl_cache_import_many_users(void **state)
+{
+    struct sssctl_cache_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                            struct sssctl_cache_test_ctx);
+    struct sss_domain_info *dom = test_ctx->tctx->dom;
+    bool seen[TEST_NUM_MANY_USERS] = { false };
+    struct ldb_result *res;
+    uint64_t uid;
+    char *name;
+    errno_t ret;
+
+    for (int i = 0; i < TEST_NUM_MANY_USERS; i++) {
+        name = talloc_asprintf(test_ctx, "many_user_%d", i);
+        assert_non_null(name);
+
+        ret = sysdb_store_user(dom, name, NULL, TEST_MANY_USER_UID + i,
+                               TEST_USER_GID, name, "/home/many",
+                               "/bin/bash", NULL, NULL, NULL,
+                               TEST_CACHE_TIMEOUT, 0);
+        assert_int_equal(ret, EOK);
+        talloc_free(name);
+    }
+
+    ret = run_command(test_ctx, "cache-export", sssctl_cache_export);
+    assert_int_equal(ret, EOK);
+
+    reset_domains(test_ctx);
+    dom = test_ctx->tctx->dom;
+
+    ret = run_command(test_ctx, "cache-import", sssctl_cache_import);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_enumpwent(test_ctx, dom, &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, TEST_NUM_MANY_USERS);
+
+    /* every user is imported exactly once */
+    for (unsigned int i = 0; i < res->count; i++) {
+        uid = ldb_msg_find_attr_as_uint64(res->msgs[i], SYSDB_UIDNUM, 0);
+        assert_true(uid >= TEST_MANY_USER_UID);
+        assert_true(uid < TEST_MANY_USER_UID + TEST_NUM_MANY_USERS);
+        assert_false(seen[uid - TEST_MANY_USER_UID]);
+        seen[uid - TEST_MANY_USER_UID] = true;
+    }
+    talloc_free(res);
+}
+
+int main(int argc, const char *argv[])
+{
+    int rv;
+    int no_cleanup = 0;
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        {"no-cleanup", 'n', POPT_ARG_NONE, &no_cleanup, 0,
+         _("Do not delete the test database after a test run"), NULL },
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_sssctl_cache_round_trip,
+                                        test_sssctl_cache_setup,
+                                        test_sssctl_cache_teardown),
+        cmocka_unit_test_setup_teardown(test_sssctl_cache_import_bad_header,
+                                        test_sssctl_cache_setup,
+                                        test_sssctl_cache_teardown),
+        cmocka_unit_test_setup_teardown(test_sssctl_cache_import_missing_end,
+                                        test_sssctl_cache_setup,
+                                        test_sssctl_cache_teardown),
+        cmocka_unit_test_setup_teardown(test_sssctl_cache_import_truncated,
+                                        test_sssctl_cache_setup,
+                                        test_sssctl_cache_teardown),
+        cmocka_unit_test_setup_teardown(test_sssctl_cache_import_many_users,
+                                        test_sssctl_cache_setup,
+                                        test_sssctl_cache_teardown),
+    };
+
+    /* Set debug level to invalid value so we can decide if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    tests_set_cwd();
+    unlink(TEST_DUMP_FILE);
+    test_multidom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, domains);
+    test_dom_suite_setup(TESTS_PATH);
+    rv = cmocka_run_group_tests(tests, NULL, NULL);
+
+    if (rv == 0 && no_cleanup == 0) {
+        test_multidom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, domains);
+    }
+    return rv;
+}
@@ -0,0 +1,243 @@
+/*
+    SSSD
+
+    sysdb_search_stats - Tests for the cache search instrumentation
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+#include "db/sysdb_private.h"
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "tests_conf.ldb"
+#define TEST_ID_PROVIDER "ldap"
+
+#define TEST_DOM_NAME "test_sysdb_search_stats"
+
+#define TEST_USER_NAME          "test_user"
+#define TEST_USER_UID           4321
+#define TEST_USER_GID           4320
+#define TEST_NUM_USERS          3
+
+#define TEST_CACHE_TIMEOUT      300
+
+struct sysdb_search_stats_test_ctx {
+    struct sss_test_ctx *tctx;
+};
+
+const char *domains[] = { TEST_DOM_NAME,
+                          NULL };
+
+static int test_sysdb_search_stats_setup(void **state)
+{
+    struct sysdb_search_stats_test_ctx *test_ctx;
+    char *name;
+    int ret;
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context,
+                           struct sysdb_search_stats_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_dom_suite_setup(TESTS_PATH);
+
+    test_ctx->tctx = create_multidom_test_ctx(test_ctx, TESTS_PATH,
+                                              TEST_CONF_DB, domains,
+                                              TEST_ID_PROVIDER, NULL);
+    assert_non_null(test_ctx->tctx);
+
+    for (int i = 0; i < TEST_NUM_USERS; i++) {
+        name = talloc_asprintf(test_ctx, "%s_%d", TEST_USER_NAME, i);
+        assert_non_null(name);
+
+        ret = sysdb_store_user(test_ctx->tctx->dom, name, NULL,
+                               TEST_USER_UID + i, TEST_USER_GID, name,
+                               "/home/test", "/bin/bash", NULL, NULL, NULL,
+                               TEST_CACHE_TIMEOUT, 0);
+        assert_int_equal(ret, EOK);
+        talloc_free(name);
+    }
+
+    *state = test_ctx;
+    return 0;
+}
+
+static int test_sysdb_search_stats_teardown(void **state)
+{
+    struct sysdb_search_stats_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                        struct sysdb_search_stats_test_ctx);
+
+    talloc_zfree(test_ctx);
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    return 0;
+}
+
+static void get_counters(struct sysdb_search_stats_test_ctx *test_ctx,
+                         struct sysdb_search_counters *counters)
+{
+    int ret;
+
+    ret = sysdb_search_stats_get_counters(test_ctx->tctx->sysdb->ldb,
+                                          counters);
+    assert_int_equal(ret, EOK);
+}
+
+static void lookup_user(struct sysdb_search_stats_test_ctx *test_ctx,
+                        const char *name,
+                        unsigned int expected)
+{
+    struct ldb_result *res;
+    int ret;
+
+    ret = sysdb_getpwnam(test_ctx, test_ctx->tctx->dom, name, &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, expected);
+    talloc_free(res);
+}
+
+static void test_sysdb_search_stats_counters(void **state)
+{
+    struct sysdb_search_stats_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                        struct sysdb_search_stats_test_ctx);
+    struct sysdb_search_counters before;
+    struct sysdb_search_counters after;
+    struct ldb_result *res;
+    int ret;
+
+    /* one search returning one entry */
+    get_counters(test_ctx, &before);
+    lookup_user(test_ctx, TEST_USER_NAME "_0", 1);
+    get_counters(test_ctx, &after);
+
+    assert_int_equal(after.searches, before.searches + 1);
+    assert_int_equal(after.entries, before.entries + 1);
+    assert_true(after.usec >= before.usec);
+
+    /* a search which does not find anything is counted as well */
+    before = after;
+    lookup_user(test_ctx, "no_such_user", 0);
+    get_counters(test_ctx, &after);
+
+    assert_int_equal(after.searches, before.searches + 1);
+    assert_int_equal(after.entries, before.entries);
+
+    /* the enumeration returns every user */
+    before = after;
+    ret = sysdb_enumpwent(test_ctx, test_ctx->tctx->dom, &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, TEST_NUM_USERS);
+    talloc_free(res);
+    get_counters(test_ctx, &after);
+
+    assert_true(after.searches > before.searches);
+    assert_true(after.entries >= before.entries + TEST_NUM_USERS);
+
+    /* a failed search */
+    before = after;
+    ret = sysdb_ldb_search(test_ctx->tctx->sysdb->ldb, test_ctx, &res,
+                           NULL, LDB_SCOPE_SUBTREE, NULL, "%s", "(name=");
+    assert_int_not_equal(ret, LDB_SUCCESS);
+    get_counters(test_ctx, &after);
+
+    assert_int_equal(after.searches, before.searches + 1);
+    assert_int_equal(after.errors, before.errors + 1);
+    assert_int_equal(after.entries, before.entries);
+
+    /* the slow search log is disabled by default */
+    assert_int_equal(after.slow_searches, 0);
+}
+
+static void test_sysdb_search_stats_slow(void **state)
+{
+    struct sysdb_search_stats_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                        struct sysdb_search_stats_test_ctx);
+    struct sysdb_search_counters counters;
+    int ret;
+
+    /* every search takes at least a microsecond */
+    ret = sysdb_search_stats_init(test_ctx->tctx->sysdb->ldb, NULL,
+                                  "cache", 1);
+    assert_int_equal(ret, EOK);
+
+    get_counters(test_ctx, &counters);
+    assert_int_equal(counters.searches, 0);
+    assert_int_equal(counters.slow_searches, 0);
+
+    lookup_user(test_ctx, TEST_USER_NAME "_1", 1);
+
+    get_counters(test_ctx, &counters);
+    assert_int_equal(counters.searches, 1);
+    assert_int_equal(counters.entries, 1);
+    assert_int_equal(counters.slow_searches, 1);
+    assert_true(counters.usec >= 1);
+}
+
+int main(int argc, const char *argv[])
+{
+    int rv;
+    int no_cleanup = 0;
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        {"no-cleanup", 'n', POPT_ARG_NONE, &no_cleanup, 0,
+         _("Do not delete the test database after a test run"), NULL },
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_sysdb_search_stats_counters,
+                                        test_sysdb_search_stats_setup,
+                                        test_sysdb_search_stats_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_search_stats_slow,
+                                        test_sysdb_search_stats_setup,
+                                        test_sysdb_search_stats_teardown),
+    };
+
+    /* Set debug level to invalid value so we can decide if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    tests_set_cwd();
+    test_multidom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, domains);
+    test_dom_suite_setup(TESTS_PATH);
+    rv = cmocka_run_group_tests(tests, NULL, NULL);
+
+    if (rv == 0 && no_cleanup == 0) {
+        test_multidom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, domains);
+    }
+    return rv;
+}
@@ -0,0 +1,462 @@
+/*
+    SSSD
+
+    sysdb_snapshot - Tests for the read-only cache snapshot
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+#include "db/sysdb_private.h"
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "tests_conf.ldb"
+#define TEST_ID_PROVIDER "ldap"
+
+#define TEST_DOM_NAME "test_sysdb_snapshot"
+
+#define TEST_USER_NAME          "test_user"
+#define TEST_USER_NAME_2        "test_user_2"
+#define TEST_USER_ALIAS         "test_alias"
+#define TEST_USER_UID           4321
+#define TEST_USER_UID_2         4323
+#define TEST_USER_GID           4322
+#define TEST_USER_SID           "S-1-5-21-123-456-789-222"
+#define TEST_USER_UPN           "test_user@TEST.REALM"
+
+#define TEST_GROUP_NAME         "test_group"
+#define TEST_GROUP_GID          1234
+#define TEST_GROUP_SID          "S-1-5-21-123-456-789-111"
+
+#define TEST_CACHE_TIMEOUT      5
+#define TEST_NOW_1              100
+#define TEST_NOW_2              200
+
+struct sysdb_snapshot_test_ctx {
+    struct sss_test_ctx *tctx;
+};
+
+const char *domains[] = { TEST_DOM_NAME,
+                          NULL };
+
+static int test_sysdb_snapshot_setup(void **state)
+{
+    struct sysdb_snapshot_test_ctx *test_ctx;
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context,
+                           struct sysdb_snapshot_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_dom_suite_setup(TESTS_PATH);
+
+    test_ctx->tctx = create_multidom_test_ctx(test_ctx, TESTS_PATH,
+                                              TEST_CONF_DB, domains,
+                                              TEST_ID_PROVIDER, NULL);
+    assert_non_null(test_ctx->tctx);
+
+    *state = test_ctx;
+    return 0;
+}
+
+static int test_sysdb_snapshot_teardown(void **state)
+{
+    struct sysdb_snapshot_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                            struct sysdb_snapshot_test_ctx);
+
+    sysdb_snapshot_remove(test_ctx->tctx->sysdb);
+    talloc_zfree(test_ctx);
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    return 0;
+}
+
+static void store_user(struct sysdb_snapshot_test_ctx *test_ctx,
+                       const char *name,
+                       uid_t uid,
+                       time_t now)
+{
+    struct sysdb_attrs *attrs;
+    int ret;
+
+    attrs = sysdb_new_attrs(test_ctx);
+    assert_non_null(attrs);
+
+    if (uid == TEST_USER_UID) {
+        ret = sysdb_attrs_add_string(attrs, SYSDB_NAME_ALIAS, TEST_USER_ALIAS);
+        assert_int_equal(ret, EOK);
+        ret = sysdb_attrs_add_string(attrs, SYSDB_UPN, TEST_USER_UPN);
+        assert_int_equal(ret, EOK);
+        ret = sysdb_attrs_add_string(attrs, SYSDB_SID_STR, TEST_USER_SID);
+        assert_int_equal(ret, EOK);
+    }
+
+    ret = sysdb_store_user(test_ctx->tctx->dom, name, NULL,
+                           uid, TEST_USER_GID, name, "/home/test",
+                           "/bin/bash", NULL, attrs, NULL,
+                           TEST_CACHE_TIMEOUT, now);
+    assert_int_equal(ret, EOK);
+    talloc_free(attrs);
+}
+
+static void store_group(struct sysdb_snapshot_test_ctx *test_ctx)
+{
+    struct sysdb_attrs *attrs;
+    int ret;
+
+    attrs = sysdb_new_attrs(test_ctx);
+    assert_non_null(attrs);
+
+    ret = sysdb_attrs_add_string(attrs, SYSDB_SID_STR, TEST_GROUP_SID);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_store_group(test_ctx->tctx->dom, TEST_GROUP_NAME,
+                            TEST_GROUP_GID, attrs, TEST_CACHE_TIMEOUT,
+                            TEST_NOW_1);
+    assert_int_equal(ret, EOK);
+    talloc_free(attrs);
+}
+
+static struct ldb_result *
+snapshot_search(struct sysdb_snapshot_test_ctx *test_ctx,
+                enum sysdb_snapshot_key_type type,
+                const char *value,
+                const char **attrs,
+                errno_t exp_ret)
+{
+    struct sysdb_snapshot_key key = { type, value };
+    struct ldb_result *res = NULL;
+    errno_t ret;
+
+    ret = sysdb_snapshot_search(test_ctx, test_ctx->tctx->dom, &key, 1,
+                                attrs, &res);
+    assert_int_equal(ret, exp_ret);
+    if (ret == EOK) {
+        assert_int_equal(res->count, 1);
+    }
+
+    return res;
+}
+
+static void assert_user(struct ldb_result *res, const char *name, uid_t uid)
+{
+    assert_non_null(res);
+    assert_int_equal(res->count, 1);
+    assert_string_equal(ldb_msg_find_attr_as_string(res->msgs[0],
+                                                    SYSDB_NAME, NULL),
+                        name);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(res->msgs[0],
+                                                 SYSDB_UIDNUM, 0),
+                     uid);
+}
+
+static void test_sysdb_snapshot_lookup(void **state)
+{
+    struct sysdb_snapshot_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                            struct sysdb_snapshot_test_ctx);
+    const char *name_attrs[] = { SYSDB_NAME, NULL };
+    struct ldb_result *res;
+    errno_t ret;
+
+    store_user(test_ctx, TEST_USER_NAME, TEST_USER_UID, TEST_NOW_1);
+    store_group(test_ctx);
+
+    /* Nothing published yet */
+    snapshot_search(test_ctx, SYSDB_SNAPSHOT_USER_NAME, TEST_USER_NAME,
+                    NULL, ENOENT);
+
+    ret = sysdb_snapshot_publish(test_ctx->tctx->sysdb);
+    assert_int_equal(ret, EOK);
+
+    res = snapshot_search(test_ctx, SYSDB_SNAPSHOT_USER_NAME, TEST_USER_NAME,
+                          NULL, EOK);
+    assert_user(res, TEST_USER_NAME, TEST_USER_UID);
+    assert_string_equal(ldb_dn_get_linearized(res->msgs[0]->dn),
+                        ldb_dn_get_linearized(sysdb_user_dn(res,
+                                                  test_ctx->tctx->dom,
+                                                  TEST_USER_NAME)));
+
+    res = snapshot_search(test_ctx, SYSDB_SNAPSHOT_USER_ALIAS,
+                          TEST_USER_ALIAS, NULL, EOK);
+    assert_user(res, TEST_USER_NAME, TEST_USER_UID);
+
+    res = snapshot_search(test_ctx, SYSDB_SNAPSHOT_USER_UID, "4321",
+                          NULL, EOK);
+    assert_user(res, TEST_USER_NAME, TEST_USER_UID);
+
+    /* UPNs are compared case-insensitively */
+    res = snapshot_search(test_ctx, SYSDB_SNAPSHOT_USER_UPN,
+                          "TEST_USER@test.realm", NULL, EOK);
+    assert_user(res, TEST_USER_NAME, TEST_USER_UID);
+
+    res = snapshot_search(test_ctx, SYSDB_SNAPSHOT_SID, TEST_USER_SID,
+                          NULL, EOK);
+    assert_user(res, TEST_USER_NAME, TEST_USER_UID);
+
+    res = snapshot_search(test_ctx, SYSDB_SNAPSHOT_GROUP_NAME,
+                          TEST_GROUP_NAME, NULL, EOK);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(res->msgs[0],
+                                                 SYSDB_GIDNUM, 0),
+                     TEST_GROUP_GID);
+
+    res = snapshot_search(test_ctx, SYSDB_SNAPSHOT_GROUP_GID, "1234",
+                          NULL, EOK);
+    assert_string_equal(ldb_msg_find_attr_as_string(res->msgs[0],
+                                                    SYSDB_NAME, NULL),
+                        TEST_GROUP_NAME);
+
+    res = snapshot_search(test_ctx, SYSDB_SNAPSHOT_SID, TEST_GROUP_SID,
+                          NULL, EOK);
+    assert_string_equal(ldb_msg_find_attr_as_string(res->msgs[0],
+                                                    SYSDB_NAME, NULL),
+                        TEST_GROUP_NAME);
+
+    /* Only the requested attributes are returned */
+    res = snapshot_search(test_ctx, SYSDB_SNAPSHOT_USER_NAME, TEST_USER_NAME,
+                          name_attrs, EOK);
+    assert_int_equal(res->msgs[0]->num_elements, 1);
+    assert_string_equal(res->msgs[0]->elements[0].name, SYSDB_NAME);
+
+    /* Key types do not mix */
+    snapshot_search(test_ctx, SYSDB_SNAPSHOT_GROUP_NAME, TEST_USER_NAME,
+                    NULL, ENOENT);
+    snapshot_search(test_ctx, SYSDB_SNAPSHOT_USER_NAME, TEST_USER_ALIAS,
+                    NULL, ENOENT);
+    snapshot_search(test_ctx, SYSDB_SNAPSHOT_USER_NAME, "unknown",
+                    NULL, ENOENT);
+
+    /* The regular lookups are answered the same way */
+    ret = sysdb_getpwnam(test_ctx, test_ctx->tctx->dom, TEST_USER_ALIAS,
+                         &res);
+    assert_int_equal(ret, EOK);
+    assert_user(res, TEST_USER_NAME, TEST_USER_UID);
+
+    ret = sysdb_getpwuid(test_ctx, test_ctx->tctx->dom, TEST_USER_UID, &res);
+    assert_int_equal(ret, EOK);
+    assert_user(res, TEST_USER_NAME, TEST_USER_UID);
+
+    ret = sysdb_getgrgid(test_ctx, test_ctx->tctx->dom, TEST_GROUP_GID, &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, 1);
+
+    ret = sysdb_search_object_by_sid(test_ctx, test_ctx->tctx->dom,
+                                     TEST_USER_SID, NULL, &res);
+    assert_int_equal(ret, EOK);
+    assert_user(res, TEST_USER_NAME, TEST_USER_UID);
+}
+
+static void test_sysdb_snapshot_outdated(void **state)
+{
+    struct sysdb_snapshot_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                            struct sysdb_snapshot_test_ctx);
+    struct ldb_result *res;
+    errno_t ret;
+
+    store_user(test_ctx, TEST_USER_NAME, TEST_USER_UID, TEST_NOW_1);
+
+    ret = sysdb_snapshot_publish(test_ctx->tctx->sysdb);
+    assert_int_equal(ret, EOK);
+
+    snapshot_search(test_ctx, SYSDB_SNAPSHOT_USER_NAME, TEST_USER_NAME,
+                    NULL, EOK);
+
+    /* The timestamps always come from the timestamp cache */
+    store_user(test_ctx, TEST_USER_NAME, TEST_USER_UID, TEST_NOW_2);
+
+    ret = sysdb_getpwnam(test_ctx, test_ctx->tctx->dom, TEST_USER_NAME,
+                         &res);
+    assert_int_equal(ret, EOK);
+    assert_user(res, TEST_USER_NAME, TEST_USER_UID);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(res->msgs[0],
+                                                 SYSDB_CACHE_EXPIRE, 0),
+                     TEST_CACHE_TIMEOUT + TEST_NOW_2);
+
+    /* Any change of the cache makes the snapshot outdated */
+    store_user(test_ctx, TEST_USER_NAME_2, TEST_USER_UID_2, TEST_NOW_2);
+
+    snapshot_search(test_ctx, SYSDB_SNAPSHOT_USER_NAME, TEST_USER_NAME,
+                    NULL, ENOENT);
+
+    ret = sysdb_getpwnam(test_ctx, test_ctx->tctx->dom, TEST_USER_NAME_2,
+                         &res);
+    assert_int_equal(ret, EOK);
+    assert_user(res, TEST_USER_NAME_2, TEST_USER_UID_2);
+
+    /* Until a new one is published */
+    ret = sysdb_snapshot_publish(test_ctx->tctx->sysdb);
+    assert_int_equal(ret, EOK);
+
+    res = snapshot_search(test_ctx, SYSDB_SNAPSHOT_USER_NAME,
+                          TEST_USER_NAME_2, NULL, EOK);
+    assert_user(res, TEST_USER_NAME_2, TEST_USER_UID_2);
+
+    /* Removing it sends all lookups to the cache again */
+    ret = sysdb_snapshot_remove(test_ctx->tctx->sysdb);
+    assert_int_equal(ret, EOK);
+
+    snapshot_search(test_ctx, SYSDB_SNAPSHOT_USER_NAME, TEST_USER_NAME,
+                    NULL, ENOENT);
+}
+
+/* Changes the cache through its own ldb context, like another process
+ * writing to the cache would */
+static void modify_user_elsewhere(struct sysdb_snapshot_test_ctx *test_ctx,
+                                  const char *name)
+{
+    struct ldb_context *ldb;
+    struct ldb_message *msg;
+    int ret;
+
+    ldb = ldb_init(test_ctx, test_ctx->tctx->ev);
+    assert_non_null(ldb);
+
+    ret = ldb_connect(ldb, test_ctx->tctx->sysdb->ldb_file, 0, NULL);
+    assert_int_equal(ret, LDB_SUCCESS);
+
+    msg = ldb_msg_new(ldb);
+    assert_non_null(msg);
+    msg->dn = sysdb_user_dn(msg, test_ctx->tctx->dom, name);
+    assert_non_null(msg->dn);
+
+    ret = ldb_msg_add_empty(msg, SYSDB_GECOS, LDB_FLAG_MOD_REPLACE, NULL);
+    assert_int_equal(ret, LDB_SUCCESS);
+    ret = ldb_msg_add_string(msg, SYSDB_GECOS, "changed elsewhere");
+    assert_int_equal(ret, LDB_SUCCESS);
+
+    ret = ldb_modify(ldb, msg);
+    assert_int_equal(ret, LDB_SUCCESS);
+
+    talloc_free(ldb);
+}
+
+static void test_sysdb_snapshot_foreign_write(void **state)
+{
+    struct sysdb_snapshot_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                            struct sysdb_snapshot_test_ctx);
+    errno_t ret;
+
+    store_user(test_ctx, TEST_USER_NAME, TEST_USER_UID, TEST_NOW_1);
+
+    ret = sysdb_snapshot_publish(test_ctx->tctx->sysdb);
+    assert_int_equal(ret, EOK);
+
+    snapshot_search(test_ctx, SYSDB_SNAPSHOT_USER_NAME, TEST_USER_NAME,
+                    NULL, EOK);
+
+    /* The change is noticed by the very next lookup */
+    modify_user_elsewhere(test_ctx, TEST_USER_NAME);
+
+    snapshot_search(test_ctx, SYSDB_SNAPSHOT_USER_NAME, TEST_USER_NAME,
+                    NULL, ENOENT);
+}
+
+static void test_sysdb_snapshot_publish_on_change(void **state)
+{
+    struct sysdb_snapshot_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                            struct sysdb_snapshot_test_ctx);
+    struct ldb_result *res;
+    errno_t ret;
+
+    ret = sysdb_snapshot_publish_on_change(test_ctx->tctx->sysdb,
+                                           test_ctx->tctx->ev, 0);
+    assert_int_equal(ret, EOK);
+
+    store_user(test_ctx, TEST_USER_NAME, TEST_USER_UID, TEST_NOW_1);
+
+    /* Published once the event loop runs */
+    snapshot_search(test_ctx, SYSDB_SNAPSHOT_USER_NAME, TEST_USER_NAME,
+                    NULL, ENOENT);
+
+    ret = tevent_loop_once(test_ctx->tctx->ev);
+    assert_int_equal(ret, 0);
+
+    snapshot_search(test_ctx, SYSDB_SNAPSHOT_USER_NAME, TEST_USER_NAME,
+                    NULL, EOK);
+
+    /* A later change is published the same way */
+    store_user(test_ctx, TEST_USER_NAME_2, TEST_USER_UID_2, TEST_NOW_2);
+
+    snapshot_search(test_ctx, SYSDB_SNAPSHOT_USER_NAME, TEST_USER_NAME_2,
+                    NULL, ENOENT);
+
+    ret = tevent_loop_once(test_ctx->tctx->ev);
+    assert_int_equal(ret, 0);
+
+    res = snapshot_search(test_ctx, SYSDB_SNAPSHOT_USER_NAME,
+                          TEST_USER_NAME_2, NULL, EOK);
+    assert_user(res, TEST_USER_NAME_2, TEST_USER_UID_2);
+}
+
+int main(int argc, const char *argv[])
+{
+    int rv;
+    int no_cleanup = 0;
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        {"no-cleanup", 'n', POPT_ARG_NONE, &no_cleanup, 0,
+         _("Do not delete the test database after a test run"), NULL },
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_sysdb_snapshot_lookup,
+                                        test_sysdb_snapshot_setup,
+                                        test_sysdb_snapshot_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_snapshot_outdated,
+                                        test_sysdb_snapshot_setup,
+                                        test_sysdb_snapshot_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_snapshot_foreign_write,
+                                        test_sysdb_snapshot_setup,
+                                        test_sysdb_snapshot_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_snapshot_publish_on_change,
+                                        test_sysdb_snapshot_setup,
+                                        test_sysdb_snapshot_teardown),
+    };
+
+    /* Set debug level to invalid value so we can decide if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    tests_set_cwd();
+    test_multidom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, domains);
+    test_dom_suite_setup(TESTS_PATH);
+    rv = cmocka_run_group_tests(tests, NULL, NULL);
+
+    if (rv == 0 && no_cleanup == 0) {
+        test_multidom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, domains);
+    }
+    return rv;
+}
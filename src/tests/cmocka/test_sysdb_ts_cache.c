@@ -44,8 +44,10 @@
 #define TEST_GROUP_SID          "S-1-5-21-123-456-789-111"
 
 #define TEST_USER_NAME          "test_user"
+#define TEST_USER_NAME_2        "test_user_2"
 #define TEST_USER_UID           4321
 #define TEST_USER_GID           4322
+#define TEST_USER_UID_2         4323
 #define TEST_USER_SID           "S-1-5-21-123-456-789-222"
 #define TEST_USER_UPN           "test_user@TEST_REALM"
 
@@ -1707,6 +1709,443 @@ static void test_sysdb_group_missing_ts(void **state)
     talloc_zfree(groupdn);
 }
 
+static void fill_bulk_user(struct sysdb_store_user_item *item,
+                           struct sss_domain_info *dom,
+                           const char *name,
+                           uid_t uid,
+                           const char *shell,
+                           struct sysdb_attrs *attrs)
+{
+    memset(item, 0, sizeof(struct sysdb_store_user_item));
+    item->domain = dom;
+    item->name = name;
+    item->uid = uid;
+    item->gid = TEST_USER_GID;
+    item->gecos = name;
+    item->homedir = "/home/test";
+    item->shell = shell;
+    item->attrs = attrs;
+    item->cache_timeout = TEST_CACHE_TIMEOUT;
+}
+
+static void fill_bulk_group(struct sysdb_store_group_item *item,
+                            struct sss_domain_info *dom,
+                            const char *name,
+                            gid_t gid,
+                            struct sysdb_attrs *attrs)
+{
+    memset(item, 0, sizeof(struct sysdb_store_group_item));
+    item->domain = dom;
+    item->name = name;
+    item->gid = gid;
+    item->attrs = attrs;
+    item->cache_timeout = TEST_CACHE_TIMEOUT;
+}
+
+static void test_sysdb_store_bulk(void **state)
+{
+    int ret;
+    struct sysdb_ts_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                     struct sysdb_ts_test_ctx);
+    struct sss_domain_info *dom = test_ctx->tctx->dom;
+    struct sysdb_store_user_item users[2];
+    struct sysdb_store_group_item groups[3];
+    uint64_t cache_expire_sysdb;
+    uint64_t cache_expire_ts;
+
+    /* First batch, everything is new and written to both caches */
+    fill_bulk_user(&users[0], dom, TEST_USER_NAME, TEST_USER_UID, "/bin/bash",
+                   create_modstamp_attrs(test_ctx, TEST_MODSTAMP_1));
+    fill_bulk_user(&users[1], dom, TEST_USER_NAME_2, TEST_USER_UID_2,
+                   "/bin/bash",
+                   create_modstamp_attrs(test_ctx, TEST_MODSTAMP_1));
+
+    ret = sysdb_store_users_bulk(dom->sysdb, users, 2, TEST_NOW_1);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(users[0].ret, EOK);
+    assert_int_equal(users[1].ret, EOK);
+
+    fill_bulk_group(&groups[0], dom, TEST_GROUP_NAME, TEST_GROUP_GID,
+                    create_modstamp_attrs(test_ctx, TEST_MODSTAMP_1));
+    fill_bulk_group(&groups[1], dom, TEST_GROUP_NAME_2, TEST_GROUP_GID_2,
+                    create_modstamp_attrs(test_ctx, TEST_MODSTAMP_1));
+
+    ret = sysdb_store_groups_bulk(dom->sysdb, groups, 2, TEST_NOW_1);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(groups[0].ret, EOK);
+    assert_int_equal(groups[1].ret, EOK);
+
+    get_pw_timestamp_attrs(test_ctx, TEST_USER_NAME_2,
+                           &cache_expire_sysdb, &cache_expire_ts);
+    assert_int_equal(cache_expire_sysdb, TEST_CACHE_TIMEOUT + TEST_NOW_1);
+    assert_int_equal(cache_expire_ts, TEST_CACHE_TIMEOUT + TEST_NOW_1);
+
+    /* Second batch: the first user is unchanged apart from the
+     * modifyTimestamp and must only bump the timestamp cache, the second
+     * one changes the shell and must be written to both caches.
+     */
+    fill_bulk_user(&users[0], dom, TEST_USER_NAME, TEST_USER_UID, "/bin/bash",
+                   create_modstamp_attrs(test_ctx, TEST_MODSTAMP_2));
+    fill_bulk_user(&users[1], dom, TEST_USER_NAME_2, TEST_USER_UID_2,
+                   "/bin/zsh",
+                   create_modstamp_attrs(test_ctx, TEST_MODSTAMP_2));
+
+    ret = sysdb_store_users_bulk(dom->sysdb, users, 2, TEST_NOW_2);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(users[0].ret, EOK);
+    assert_int_equal(users[1].ret, EOK);
+
+    get_pw_timestamp_attrs(test_ctx, TEST_USER_NAME,
+                           &cache_expire_sysdb, &cache_expire_ts);
+    assert_int_equal(cache_expire_sysdb, TEST_CACHE_TIMEOUT + TEST_NOW_1);
+    assert_int_equal(cache_expire_ts, TEST_CACHE_TIMEOUT + TEST_NOW_2);
+
+    get_pw_timestamp_attrs(test_ctx, TEST_USER_NAME_2,
+                           &cache_expire_sysdb, &cache_expire_ts);
+    assert_int_equal(cache_expire_sysdb, TEST_CACHE_TIMEOUT + TEST_NOW_2);
+    assert_int_equal(cache_expire_ts, TEST_CACHE_TIMEOUT + TEST_NOW_2);
+
+    /* Groups: the same modifyTimestamp, a different modifyTimestamp with
+     * the same attributes and a group that is not cached yet.
+     */
+    fill_bulk_group(&groups[0], dom, TEST_GROUP_NAME, TEST_GROUP_GID,
+                    create_modstamp_attrs(test_ctx, TEST_MODSTAMP_1));
+    fill_bulk_group(&groups[1], dom, TEST_GROUP_NAME_2, TEST_GROUP_GID_2,
+                    create_modstamp_attrs(test_ctx, TEST_MODSTAMP_2));
+    fill_bulk_group(&groups[2], dom, TEST_GROUP_NAME_3, TEST_GROUP_GID_3,
+                    create_modstamp_attrs(test_ctx, TEST_MODSTAMP_2));
+
+    ret = sysdb_store_groups_bulk(dom->sysdb, groups, 3, TEST_NOW_3);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(groups[0].ret, EOK);
+    assert_int_equal(groups[1].ret, EOK);
+    assert_int_equal(groups[2].ret, EOK);
+
+    get_gr_timestamp_attrs(test_ctx, TEST_GROUP_NAME,
+                           &cache_expire_sysdb, &cache_expire_ts);
+    assert_int_equal(cache_expire_sysdb, TEST_CACHE_TIMEOUT + TEST_NOW_1);
+    assert_int_equal(cache_expire_ts, TEST_CACHE_TIMEOUT + TEST_NOW_3);
+
+    get_gr_timestamp_attrs(test_ctx, TEST_GROUP_NAME_2,
+                           &cache_expire_sysdb, &cache_expire_ts);
+    assert_int_equal(cache_expire_sysdb, TEST_CACHE_TIMEOUT + TEST_NOW_1);
+    assert_int_equal(cache_expire_ts, TEST_CACHE_TIMEOUT + TEST_NOW_3);
+
+    get_gr_timestamp_attrs(test_ctx, TEST_GROUP_NAME_3,
+                           &cache_expire_sysdb, &cache_expire_ts);
+    assert_int_equal(cache_expire_sysdb, TEST_CACHE_TIMEOUT + TEST_NOW_3);
+    assert_int_equal(cache_expire_ts, TEST_CACHE_TIMEOUT + TEST_NOW_3);
+}
+
+static uint64_t get_pw_ts_disk_timestamp(struct sysdb_ts_test_ctx *test_ctx,
+                                         const char *name)
+{
+    struct ldb_result *res;
+    struct ldb_dn *dn;
+    uint64_t cache_expire_ts = 0;
+    const char *attrs[] = { SYSDB_CACHE_EXPIRE, NULL };
+    int ret;
+
+    /* Read the timestamp cache directly, bypassing the buffered updates */
+    dn = sysdb_user_dn(test_ctx, test_ctx->tctx->dom, name);
+    assert_non_null(dn);
+
+    ret = ldb_search(test_ctx->tctx->sysdb->ldb_ts, test_ctx, &res,
+                     dn, LDB_SCOPE_BASE, attrs, NULL);
+    if (ret == LDB_SUCCESS && res->count == 1) {
+        cache_expire_ts = ldb_msg_find_attr_as_uint64(res->msgs[0],
+                                                      SYSDB_CACHE_EXPIRE, 0);
+    }
+
+    talloc_free(res);
+    talloc_free(dn);
+    return cache_expire_ts;
+}
+
+static void test_sysdb_ts_batch(void **state)
+{
+    int ret;
+    struct sysdb_ts_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                     struct sysdb_ts_test_ctx);
+    struct sysdb_attrs *user_attrs;
+    uint64_t cache_expire_sysdb;
+    uint64_t cache_expire_ts;
+
+    ret = sysdb_ts_batch_begin(test_ctx->tctx->sysdb, test_ctx->tctx->ev,
+                               100, 60000);
+    assert_int_equal(ret, EOK);
+
+    /* The timestamp cache record of a new user is not buffered */
+    user_attrs = create_modstamp_attrs(test_ctx, TEST_MODSTAMP_1);
+    assert_non_null(user_attrs);
+    ret = sysdb_store_user(test_ctx->tctx->dom, TEST_USER_NAME, NULL,
+                           TEST_USER_UID, TEST_USER_GID, TEST_USER_NAME,
+                           "/home/"TEST_USER_NAME, "/bin/bash", NULL,
+                           user_attrs, NULL, TEST_CACHE_TIMEOUT,
+                           TEST_NOW_1);
+    assert_int_equal(ret, EOK);
+    talloc_free(user_attrs);
+
+    assert_int_equal(get_pw_ts_disk_timestamp(test_ctx, TEST_USER_NAME),
+                     TEST_CACHE_TIMEOUT + TEST_NOW_1);
+
+    get_pw_timestamp_attrs(test_ctx, TEST_USER_NAME,
+                           &cache_expire_sysdb, &cache_expire_ts);
+    assert_int_equal(cache_expire_sysdb, TEST_CACHE_TIMEOUT + TEST_NOW_1);
+    assert_int_equal(cache_expire_ts, TEST_CACHE_TIMEOUT + TEST_NOW_1);
+
+    /* Two unchanged refreshes are merged into one buffered update */
+    user_attrs = create_modstamp_attrs(test_ctx, TEST_MODSTAMP_1);
+    assert_non_null(user_attrs);
+    ret = sysdb_store_user(test_ctx->tctx->dom, TEST_USER_NAME, NULL,
+                           TEST_USER_UID, TEST_USER_GID, TEST_USER_NAME,
+                           "/home/"TEST_USER_NAME, "/bin/bash", NULL,
+                           user_attrs, NULL, TEST_CACHE_TIMEOUT,
+                           TEST_NOW_2);
+    assert_int_equal(ret, EOK);
+    talloc_free(user_attrs);
+
+    user_attrs = create_modstamp_attrs(test_ctx, TEST_MODSTAMP_1);
+    assert_non_null(user_attrs);
+    ret = sysdb_store_user(test_ctx->tctx->dom, TEST_USER_NAME, NULL,
+                           TEST_USER_UID, TEST_USER_GID, TEST_USER_NAME,
+                           "/home/"TEST_USER_NAME, "/bin/bash", NULL,
+                           user_attrs, NULL, TEST_CACHE_TIMEOUT,
+                           TEST_NOW_3);
+    assert_int_equal(ret, EOK);
+    talloc_free(user_attrs);
+
+    /* Searches see the buffered value even though it was not written */
+    get_pw_timestamp_attrs(test_ctx, TEST_USER_NAME,
+                           &cache_expire_sysdb, &cache_expire_ts);
+    assert_int_equal(cache_expire_sysdb, TEST_CACHE_TIMEOUT + TEST_NOW_1);
+    assert_int_equal(cache_expire_ts, TEST_CACHE_TIMEOUT + TEST_NOW_3);
+    assert_int_equal(get_pw_ts_disk_timestamp(test_ctx, TEST_USER_NAME),
+                     TEST_CACHE_TIMEOUT + TEST_NOW_1);
+
+    /* Ending the batch flushes the updates */
+    sysdb_ts_batch_end(test_ctx->tctx->sysdb);
+
+    assert_int_equal(get_pw_ts_disk_timestamp(test_ctx, TEST_USER_NAME),
+                     TEST_CACHE_TIMEOUT + TEST_NOW_3);
+}
+
+static void store_user_in_txn(struct sysdb_ts_test_ctx *test_ctx,
+                              uint64_t now,
+                              bool commit)
+{
+    struct sysdb_attrs *user_attrs;
+    int ret;
+
+    ret = sysdb_transaction_start(test_ctx->tctx->sysdb);
+    assert_int_equal(ret, EOK);
+
+    user_attrs = create_modstamp_attrs(test_ctx, TEST_MODSTAMP_1);
+    assert_non_null(user_attrs);
+    ret = sysdb_store_user(test_ctx->tctx->dom, TEST_USER_NAME, NULL,
+                           TEST_USER_UID, TEST_USER_GID, TEST_USER_NAME,
+                           "/home/"TEST_USER_NAME, "/bin/bash", NULL,
+                           user_attrs, NULL, TEST_CACHE_TIMEOUT, now);
+    assert_int_equal(ret, EOK);
+    talloc_free(user_attrs);
+
+    if (commit) {
+        ret = sysdb_transaction_commit(test_ctx->tctx->sysdb);
+    } else {
+        ret = sysdb_transaction_cancel(test_ctx->tctx->sysdb);
+    }
+    assert_int_equal(ret, EOK);
+}
+
+static void test_sysdb_ts_batch_cancel(void **state)
+{
+    int ret;
+    struct sysdb_ts_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                     struct sysdb_ts_test_ctx);
+    struct sysdb_attrs *user_attrs;
+    uint64_t cache_expire_sysdb;
+    uint64_t cache_expire_ts;
+
+    user_attrs = create_modstamp_attrs(test_ctx, TEST_MODSTAMP_1);
+    assert_non_null(user_attrs);
+    ret = sysdb_store_user(test_ctx->tctx->dom, TEST_USER_NAME, NULL,
+                           TEST_USER_UID, TEST_USER_GID, TEST_USER_NAME,
+                           "/home/"TEST_USER_NAME, "/bin/bash", NULL,
+                           user_attrs, NULL, TEST_CACHE_TIMEOUT,
+                           TEST_NOW_1);
+    assert_int_equal(ret, EOK);
+    talloc_free(user_attrs);
+
+    ret = sysdb_ts_batch_begin(test_ctx->tctx->sysdb, test_ctx->tctx->ev,
+                               100, 60000);
+    assert_int_equal(ret, EOK);
+
+    /* The update of a cancelled transaction is dropped */
+    store_user_in_txn(test_ctx, TEST_NOW_2, false);
+
+    get_pw_timestamp_attrs(test_ctx, TEST_USER_NAME,
+                           &cache_expire_sysdb, &cache_expire_ts);
+    assert_int_equal(cache_expire_ts, TEST_CACHE_TIMEOUT + TEST_NOW_1);
+
+    ret = sysdb_ts_batch_flush(test_ctx->tctx->sysdb);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(get_pw_ts_disk_timestamp(test_ctx, TEST_USER_NAME),
+                     TEST_CACHE_TIMEOUT + TEST_NOW_1);
+
+    /* The update of a committed transaction is buffered */
+    store_user_in_txn(test_ctx, TEST_NOW_3, true);
+
+    get_pw_timestamp_attrs(test_ctx, TEST_USER_NAME,
+                           &cache_expire_sysdb, &cache_expire_ts);
+    assert_int_equal(cache_expire_ts, TEST_CACHE_TIMEOUT + TEST_NOW_3);
+    assert_int_equal(get_pw_ts_disk_timestamp(test_ctx, TEST_USER_NAME),
+                     TEST_CACHE_TIMEOUT + TEST_NOW_1);
+
+    sysdb_ts_batch_end(test_ctx->tctx->sysdb);
+
+    assert_int_equal(get_pw_ts_disk_timestamp(test_ctx, TEST_USER_NAME),
+                     TEST_CACHE_TIMEOUT + TEST_NOW_3);
+}
+
+static void write_index_stats(const char *path, const char *data)
+{
+    FILE *f;
+
+    f = fopen(path, "w");
+    assert_non_null(f);
+    assert_true(fputs(data, f) >= 0);
+    assert_int_equal(fclose(f), 0);
+}
+
+static void test_sysdb_index_advise(void **state)
+{
+    struct sysdb_ts_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                     struct sysdb_ts_test_ctx);
+    const char *ldb_file = test_ctx->tctx->sysdb->ldb_file;
+    struct sysdb_index_advice *advice;
+    char *path_nss;
+    char *path_be;
+    size_t count;
+    errno_t ret;
+
+    ret = sysdb_index_advise(test_ctx, ldb_file, &advice, &count);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(count, 0);
+
+    path_nss = talloc_asprintf(test_ctx, "%s.idxstats.nss", ldb_file);
+    assert_non_null(path_nss);
+    path_be = talloc_asprintf(test_ctx, "%s.idxstats.be_"TEST_DOM1_NAME"_",
+                              ldb_file);
+    assert_non_null(path_be);
+
+    /* name is indexed, the others are not */
+    write_index_stats(path_nss, "fooAttr 2 300\n"
+                                SYSDB_NAME" 1 100\n");
+    write_index_stats(path_be, "fooAttr 1 200\n"
+                               "garbage\n"
+                               "barAttr 3 50\n");
+
+    ret = sysdb_index_advise(test_ctx, ldb_file, &advice, &count);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(count, 2);
+
+    assert_string_equal(advice[0].attr, "fooAttr");
+    assert_int_equal(advice[0].count, 3);
+    assert_int_equal(advice[0].usec, 500);
+    assert_string_equal(advice[1].attr, "barAttr");
+    assert_int_equal(advice[1].count, 3);
+    assert_int_equal(advice[1].usec, 50);
+    talloc_free(advice);
+
+    /* indexed attributes are no longer proposed */
+    ret = sysdb_ldb_mod_index(test_ctx, SYSDB_IDX_CREATE,
+                              test_ctx->tctx->sysdb->ldb, "fooAttr");
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_index_advise(test_ctx, ldb_file, &advice, &count);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(count, 1);
+    assert_string_equal(advice[0].attr, "barAttr");
+    talloc_free(advice);
+
+    unlink(path_nss);
+    unlink(path_be);
+    talloc_free(path_nss);
+    talloc_free(path_be);
+}
+
+static struct sysdb_txn_histogram *
+find_txn_caller(struct sysdb_txn_histogram *callers, size_t num_callers,
+                const char *name)
+{
+    for (size_t i = 0; i < num_callers; i++) {
+        if (strcmp(callers[i].name, name) == 0) {
+            return &callers[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void test_sysdb_transaction_stats(void **state)
+{
+    struct sysdb_ts_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                     struct sysdb_ts_test_ctx);
+    struct sysdb_ctx *sysdb = test_ctx->tctx->sysdb;
+    struct sysdb_txn_histogram *before;
+    struct sysdb_txn_histogram *levels;
+    struct sysdb_txn_histogram *callers;
+    struct sysdb_txn_histogram *caller;
+    size_t num_callers;
+    uint64_t buckets;
+    errno_t ret;
+
+    ret = sysdb_transaction_stats(test_ctx, sysdb, &before,
+                                  &callers, &num_callers);
+    assert_int_equal(ret, EOK);
+    assert_null(find_txn_caller(callers, num_callers, __func__));
+    talloc_free(callers);
+
+    ret = sysdb_transaction_start(sysdb);
+    assert_int_equal(ret, EOK);
+    ret = sysdb_transaction_start(sysdb);
+    assert_int_equal(ret, EOK);
+    ret = sysdb_transaction_commit(sysdb);
+    assert_int_equal(ret, EOK);
+    ret = sysdb_transaction_cancel(sysdb);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_transaction_start(sysdb);
+    assert_int_equal(ret, EOK);
+    ret = sysdb_transaction_commit(sysdb);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_transaction_stats(test_ctx, sysdb, &levels,
+                                  &callers, &num_callers);
+    assert_int_equal(ret, EOK);
+
+    assert_string_equal(levels[0].name, "nesting level 0");
+    assert_int_equal(levels[0].count - before[0].count, 2);
+    assert_int_equal(levels[0].cancelled - before[0].cancelled, 1);
+    assert_int_equal(levels[1].count - before[1].count, 1);
+    assert_int_equal(levels[1].cancelled - before[1].cancelled, 0);
+
+    caller = find_txn_caller(callers, num_callers, __func__);
+    assert_non_null(caller);
+    assert_int_equal(caller->count, 2);
+    assert_int_equal(caller->cancelled, 1);
+
+    buckets = 0;
+    for (int i = 0; i < SYSDB_TXN_STATS_BUCKETS; i++) {
+        buckets += caller->buckets[i];
+    }
+    assert_int_equal(buckets, 2);
+
+    talloc_free(before);
+    talloc_free(levels);
+    talloc_free(callers);
+}
+
 int main(int argc, const char *argv[])
 {
     int rv;
@@ -1767,6 +2206,21 @@ int main(int argc, const char *argv[])
         cmocka_unit_test_setup_teardown(test_sysdb_group_missing_ts,
                                         test_sysdb_ts_setup,
                                         test_sysdb_ts_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_store_bulk,
+                                        test_sysdb_ts_setup,
+                                        test_sysdb_ts_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_ts_batch,
+                                        test_sysdb_ts_setup,
+                                        test_sysdb_ts_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_ts_batch_cancel,
+                                        test_sysdb_ts_setup,
+                                        test_sysdb_ts_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_index_advise,
+                                        test_sysdb_ts_setup,
+                                        test_sysdb_ts_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_transaction_stats,
+                                        test_sysdb_ts_setup,
+                                        test_sysdb_ts_teardown),
     };
 
     /* Set debug level to invalid value so we can decide if -d 0 was used. */
@@ -155,6 +155,185 @@ void test_sysdb_cert_derb64_to_ldap_filter(void **state)
     talloc_free(filter);
 }
 
+#define TEST_NUM_ATTRS 64
+
+static void test_sysdb_attrs_index(void **state)
+{
+    struct sysdb_attrs *attrs;
+    struct ldb_message_element *el;
+    const char *str;
+    char name[32];
+    char value[32];
+    int ret;
+    int i;
+
+    attrs = sysdb_new_attrs(NULL);
+    assert_non_null(attrs);
+
+    for (i = 0; i < TEST_NUM_ATTRS; i++) {
+        snprintf(name, sizeof(name), "testAttr%d", i);
+        snprintf(value, sizeof(value), "value%d", i);
+        ret = sysdb_attrs_add_string(attrs, name, value);
+        assert_int_equal(ret, EOK);
+    }
+    assert_int_equal(attrs->num, TEST_NUM_ATTRS);
+
+    /* a second value is added to the existing element */
+    ret = sysdb_attrs_add_string(attrs, "TESTATTR5", "second");
+    assert_int_equal(ret, EOK);
+    assert_int_equal(attrs->num, TEST_NUM_ATTRS);
+
+    ret = sysdb_attrs_get_el(attrs, "testattr5", &el);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(el->num_values, 2);
+
+    for (i = 0; i < TEST_NUM_ATTRS; i++) {
+        snprintf(name, sizeof(name), "TestAttr%d", i);
+        snprintf(value, sizeof(value), "value%d", i);
+        ret = sysdb_attrs_get_string(attrs, name, &str);
+        assert_int_equal(ret, i == 5 ? ERANGE : EOK);
+        if (ret == EOK) {
+            assert_string_equal(str, value);
+        }
+    }
+
+    ret = sysdb_attrs_get_string(attrs, "noSuchAttr", &str);
+    assert_int_equal(ret, ENOENT);
+
+    /* renamed elements are found under the new name only */
+    ret = sysdb_attrs_replace_name(attrs, "testAttr7", "renamedAttr");
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_attrs_get_string(attrs, "testAttr7", &str);
+    assert_int_equal(ret, ENOENT);
+
+    ret = sysdb_attrs_get_string(attrs, "renamedattr", &str);
+    assert_int_equal(ret, EOK);
+    assert_string_equal(str, "value7");
+
+    /* elements appended directly are found as well */
+    el = talloc_realloc(attrs, attrs->a, struct ldb_message_element,
+                        attrs->num + 1);
+    assert_non_null(el);
+    attrs->a = el;
+    memset(&attrs->a[attrs->num], 0, sizeof(struct ldb_message_element));
+    attrs->a[attrs->num].name = "appendedAttr";
+    attrs->num++;
+
+    ret = sysdb_attrs_get_el_ext(attrs, "APPENDEDATTR", false, &el);
+    assert_int_equal(ret, EOK);
+    assert_ptr_equal(el, &attrs->a[attrs->num - 1]);
+
+    talloc_free(attrs);
+}
+
+/* Lookup by a linear scan, as sysdb_attrs_get_el_ext() did before the
+ * attribute lists were indexed. Used by the benchmark below. */
+static int linear_attrs_get_el(struct sysdb_attrs *attrs, const char *name,
+                               bool alloc, struct ldb_message_element **el)
+{
+    struct ldb_message_element *e = NULL;
+    int i;
+
+    for (i = 0; i < attrs->num; i++) {
+        if (strcasecmp(name, attrs->a[i].name) == 0)
+            e = &(attrs->a[i]);
+    }
+
+    if (!e && alloc) {
+        e = talloc_realloc(attrs, attrs->a,
+                           struct ldb_message_element, attrs->num+1);
+        if (!e) return ENOMEM;
+        attrs->a = e;
+
+        e[attrs->num].name = talloc_strdup(e, name);
+        if (!e[attrs->num].name) return ENOMEM;
+
+        e[attrs->num].num_values = 0;
+        e[attrs->num].values = NULL;
+        e[attrs->num].flags = 0;
+
+        e = &(attrs->a[attrs->num]);
+        attrs->num++;
+    }
+
+    if (!e) {
+        return ENOENT;
+    }
+
+    *el = e;
+
+    return EOK;
+}
+
+#define BENCH_NUM_ENTRIES 2000
+
+/* Builds and reads back entries the way the LDAP save path does: every
+ * attribute is added by name and then looked up again while the entry is
+ * mapped and stored. */
+static double bench_save(bool indexed, char **names)
+{
+    struct sysdb_attrs *attrs;
+    struct ldb_message_element *el;
+    uint64_t start;
+    int ret;
+    int e;
+    int i;
+
+    start = test_clock_usec();
+    for (e = 0; e < BENCH_NUM_ENTRIES; e++) {
+        attrs = sysdb_new_attrs(NULL);
+        assert_non_null(attrs);
+
+        for (i = 0; i < TEST_NUM_ATTRS; i++) {
+            if (indexed) {
+                ret = sysdb_attrs_get_el_ext(attrs, names[i], true, &el);
+            } else {
+                ret = linear_attrs_get_el(attrs, names[i], true, &el);
+            }
+            assert_int_equal(ret, EOK);
+        }
+
+        for (i = TEST_NUM_ATTRS - 1; i >= 0; i--) {
+            if (indexed) {
+                ret = sysdb_attrs_get_el_ext(attrs, names[i], false, &el);
+            } else {
+                ret = linear_attrs_get_el(attrs, names[i], false, &el);
+            }
+            assert_int_equal(ret, EOK);
+        }
+
+        talloc_free(attrs);
+    }
+
+    return (test_clock_usec() - start) / 1000.0;
+}
+
+static void test_sysdb_attrs_bench(void **state)
+{
+    char *names[TEST_NUM_ATTRS];
+    double linear;
+    double indexed;
+    int i;
+
+    for (i = 0; i < TEST_NUM_ATTRS; i++) {
+        names[i] = talloc_asprintf(NULL, "msDS-TestAttribute%d", i);
+        assert_non_null(names[i]);
+    }
+
+    linear = bench_save(false, names);
+    indexed = bench_save(true, names);
+
+    print_message("%d entries with %d attributes: linear %.3f ms "
+                  "(%.0f entries/s), indexed %.3f ms (%.0f entries/s)\n",
+                  BENCH_NUM_ENTRIES, TEST_NUM_ATTRS,
+                  linear, BENCH_NUM_ENTRIES * 1000.0 / linear,
+                  indexed, BENCH_NUM_ENTRIES * 1000.0 / indexed);
+
+    for (i = 0; i < TEST_NUM_ATTRS; i++) {
+        talloc_free(names[i]);
+    }
+}
 
 int main(int argc, const char *argv[])
 {
@@ -171,6 +350,8 @@ int main(int argc, const char *argv[])
         cmocka_unit_test(test_sysdb_handle_original_uuid),
         cmocka_unit_test(test_sysdb_attrs_add_base64_blob),
         cmocka_unit_test(test_sysdb_cert_derb64_to_ldap_filter),
+        cmocka_unit_test(test_sysdb_attrs_index),
+        cmocka_unit_test(test_sysdb_attrs_bench),
     };
 
     /* Set debug level to invalid value so we can decide if -d 0 was used. */
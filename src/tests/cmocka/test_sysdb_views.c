@@ -1454,6 +1454,63 @@ static void test_sysdb_enumgrent_filter_views(void **state)
     check_enumgrent(ret, test_ctx->domain, res, true);
 }
 
+static void assert_group_header(int ret, struct sss_domain_info *dom,
+                                struct ldb_result *res)
+{
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, 1);
+    assert_group_attrs(res->msgs[0], dom, "one", TEST_GID_OVERRIDE_BASE);
+    assert_null(ldb_msg_find_element(res->msgs[0], SYSDB_GHOST));
+    assert_null(ldb_msg_find_element(res->msgs[0], SYSDB_MEMBER));
+    assert_null(ldb_msg_find_element(res->msgs[0], SYSDB_MEMBERUID));
+}
+
+static void test_sysdb_getgr_with_views_no_members(void **state)
+{
+    int ret;
+    struct sysdb_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                        struct sysdb_test_ctx);
+    struct sysdb_attrs *attrs;
+    struct ldb_result *res;
+    char *gr_name;
+    char *member;
+
+    test_ctx->domain->view_name = talloc_strdup(test_ctx->domain,
+                                                TEST_VIEW_NAME);
+    assert_non_null(test_ctx->domain->view_name);
+
+    gr_name = sss_create_internal_fqname(test_ctx, "one",
+                                         test_ctx->domain->name);
+    assert_non_null(gr_name);
+    member = sss_create_internal_fqname(test_ctx, "ghost",
+                                        test_ctx->domain->name);
+    assert_non_null(member);
+
+    attrs = sysdb_new_attrs(test_ctx);
+    assert_non_null(attrs);
+    ret = sysdb_attrs_add_string(attrs, SYSDB_GHOST, member);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_store_group(test_ctx->domain, gr_name, 1234, attrs, 1, 1234);
+    assert_int_equal(ret, EOK);
+
+    /* Member overrides cannot be applied until the ghost member is
+     * resolved */
+    ret = sysdb_getgrnam_with_views_ex(test_ctx, test_ctx->domain, gr_name,
+                                       true, &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, 0);
+
+    /* The group itself is reported without reading any member */
+    ret = sysdb_getgrnam_with_views_ex(test_ctx, test_ctx->domain, gr_name,
+                                       false, &res);
+    assert_group_header(ret, test_ctx->domain, res);
+
+    ret = sysdb_getgrgid_with_views_ex(test_ctx, test_ctx->domain, 1234,
+                                       false, &res);
+    assert_group_header(ret, test_ctx->domain, res);
+}
+
 int main(int argc, const char *argv[])
 {
     int rv;
@@ -1519,6 +1576,9 @@ int main(int argc, const char *argv[])
         cmocka_unit_test_setup_teardown(test_sysdb_enumgrent_filter_views,
                                         test_enum_groups_setup,
                                         test_enum_groups_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_getgr_with_views_no_members,
+                                        test_enum_groups_setup,
+                                        test_enum_groups_teardown),
     };
 
     /* Set debug level to invalid value so we can decide if -d 0 was used. */
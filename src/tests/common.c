@@ -23,6 +23,7 @@
 */
 
 #include <stdio.h>
+#include <time.h>
 #include "tests/common.h"
 #include "util/util.h"
 
@@ -139,3 +140,11 @@ bool are_values_in_array(const char **values, size_t values_len,
 
     return ret;
 }
+
+uint64_t test_clock_usec(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
@@ -150,4 +150,8 @@ bool are_values_in_array(const char **values, size_t values_len,
         are_values_in_array(values, talloc_array_length(values), \
                             array, talloc_array_length(array))
 
+/* Monotonic clock in microseconds, for the timings printed by the
+ * benchmark tests */
+uint64_t test_clock_usec(void);
+
 #endif /* !__TESTS_COMMON_H__ */
@@ -21,6 +21,8 @@
 
 #include <signal.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
 #include <talloc.h>
 #include <popt.h>
 #include <sys/types.h>
@@ -37,6 +39,7 @@
 
 #define NAME_SIZE       255
 #define CHUNK           64
+#define LOOKUP_BUFSIZE  4096
 
 
 /* How many tests failed */
@@ -108,6 +111,118 @@ int run_one_testcase(const char *name, int group, int enoent_fail)
     }
 }
 
+/*
+ * Throughput mode: several threads of one process look up all names
+ * repeatedly with the reentrant calls, so the lookups share the process
+ * wide client state instead of getting a fresh process each.
+ */
+struct bench_thread {
+    pthread_t tid;
+    char **names;
+    int group;
+    int iterations;
+    int enoent_fail;
+    unsigned long lookups;
+    int failures;
+};
+
+static void *bench_thread_run(void *data)
+{
+    struct bench_thread *bt = (struct bench_thread *) data;
+    char buffer[LOOKUP_BUFSIZE];
+    struct passwd pwd;
+    struct passwd *pwd_res;
+    struct group grp;
+    struct group *grp_res;
+    int i;
+    int idx;
+    int ret;
+
+    for (i = 0; i < bt->iterations; i++) {
+        for (idx = 0; bt->names[idx]; idx++) {
+            if (bt->group) {
+                ret = getgrnam_r(bt->names[idx], &grp, buffer,
+                                 sizeof(buffer), &grp_res);
+                if (ret == 0 && grp_res == NULL) {
+                    ret = bt->enoent_fail ? ENOENT : 0;
+                }
+            } else {
+                ret = getpwnam_r(bt->names[idx], &pwd, buffer,
+                                 sizeof(buffer), &pwd_res);
+                if (ret == 0 && pwd_res == NULL) {
+                    ret = bt->enoent_fail ? ENOENT : 0;
+                }
+            }
+
+            if (ret != 0) {
+                if (verbose) {
+                    fprintf(stderr, "lookup failed (name: %s): %d, %s\n",
+                            bt->names[idx], ret, strerror(ret));
+                }
+                bt->failures++;
+            }
+            bt->lookups++;
+        }
+    }
+
+    return NULL;
+}
+
+int run_throughput(TALLOC_CTX *mem_ctx, char **names, int group,
+                   int enoent_fail, int num_threads, int iterations)
+{
+    struct bench_thread *threads;
+    struct timespec start;
+    struct timespec end;
+    unsigned long lookups = 0;
+    double elapsed;
+    int failures = 0;
+    int started;
+    int i;
+    int ret;
+
+    threads = talloc_zero_array(mem_ctx, struct bench_thread, num_threads);
+    if (threads == NULL) {
+        return ENOMEM;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (started = 0; started < num_threads; started++) {
+        threads[started].names = names;
+        threads[started].group = group;
+        threads[started].iterations = iterations;
+        threads[started].enoent_fail = enoent_fail;
+
+        ret = pthread_create(&threads[started].tid, NULL, bench_thread_run,
+                             &threads[started]);
+        if (ret != 0) {
+            fprintf(stderr, "pthread_create failed: %s\n", strerror(ret));
+            break;
+        }
+    }
+
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i].tid, NULL);
+        lookups += threads[i].lookups;
+        failures += threads[i].failures;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    elapsed = (end.tv_sec - start.tv_sec)
+              + (end.tv_nsec - start.tv_nsec) / 1000000000.0;
+
+    printf("%d threads, %lu lookups in %.3f s: %.0f lookups/s\n",
+           started, lookups, elapsed,
+           elapsed > 0 ? lookups / elapsed : 0.0);
+
+    failure_count += failures;
+    talloc_free(threads);
+
+    return started == num_threads ? EOK : EAGAIN;
+}
+
 /*
  * Beware, has side-effects: changes global variable failure_count
  */
@@ -203,6 +318,8 @@ int main(int argc, const char *argv[])
     int pc_enoent_fail=0;
     int pc_groups=0;
     int pc_verbosity = 0;
+    int pc_threads = 0;
+    int pc_iterations = 100;
     char *pc_prefix = NULL;
     TALLOC_CTX *ctx = NULL;
     char **names = NULL;
@@ -226,6 +343,12 @@ int main(int argc, const char *argv[])
         { "enoent-fail", '\0', POPT_ARG_NONE, &pc_enoent_fail, 0,
                     "Fail on not getting the requested NSS data (default: No)",
                     NULL },
+        { "threads", '\0', POPT_ARG_INT, &pc_threads, 0,
+                    "Measure throughput of this many threads in one process "
+                    "instead of forking a child per name", NULL },
+        { "iterations", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+                    &pc_iterations, 0,
+                    "How many times each thread looks up all names", NULL },
         { "verbose", 'v', POPT_ARG_NONE, 0, 'v',
                     "Be verbose", NULL },
         POPT_TABLEEND
@@ -272,6 +395,16 @@ int main(int argc, const char *argv[])
         }
     }
 
+    if (pc_threads > 0) {
+        ret = run_throughput(ctx, names, pc_groups, pc_enoent_fail,
+                             pc_threads, pc_iterations);
+        if (ret != EOK) {
+            exit(EXIT_FAILURE);
+        }
+
+        return (failure_count==0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
     /* Reap the children in a handler asynchronously so we can
      * somehow protect against too many processes */
     memset(&action, 0, sizeof(action));
@@ -334,6 +334,8 @@ int main(int argc, const char **argv)
         SSS_TOOL_COMMAND_FLAGS("cache-remove", "Backup local data and remove cached content", sssctl_cache_remove, SSS_TOOL_FLAG_SKIP_CMD_INIT),
         SSS_TOOL_COMMAND_FLAGS("cache-expire", "Invalidate cached objects", sssctl_cache_expire, SSS_TOOL_FLAG_SKIP_CMD_INIT|SSS_TOOL_FLAG_SKIP_ROOT_CHECK),
         SSS_TOOL_COMMAND_FLAGS("cache-index", "Manage cache indexes", sssctl_cache_index, SSS_TOOL_FLAG_SKIP_CMD_INIT),
+        SSS_TOOL_COMMAND("cache-export", "Export cached users and groups to a file", sssctl_cache_export),
+        SSS_TOOL_COMMAND("cache-import", "Import cached users and groups from a file", sssctl_cache_import),
         SSS_TOOL_DELIMITER("Log files tools:"),
         SSS_TOOL_COMMAND_FLAGS("logs-remove", "Remove existing SSSD log files", sssctl_logs_remove, SSS_TOOL_FLAG_SKIP_CMD_INIT),
         SSS_TOOL_COMMAND_FLAGS("logs-fetch", "Archive SSSD log files in tarball", sssctl_logs_fetch, SSS_TOOL_FLAG_SKIP_CMD_INIT),
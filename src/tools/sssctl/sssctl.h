@@ -135,4 +135,10 @@ errno_t sssctl_gpo_remove(struct sss_cmdline *cmdline,
 errno_t sssctl_gpo_purge(struct sss_cmdline *cmdline,
                          struct sss_tool_ctx *tool_ctx);
 
+errno_t sssctl_cache_export(struct sss_cmdline *cmdline,
+                            struct sss_tool_ctx *tool_ctx);
+
+errno_t sssctl_cache_import(struct sss_cmdline *cmdline,
+                            struct sss_tool_ctx *tool_ctx);
+
 #endif /* _SSSCTL_H_ */
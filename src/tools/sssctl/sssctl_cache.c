@@ -22,6 +22,9 @@
 #include <stdio.h>
 #include <time.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
 
 #include "util/util.h"
 #include "db/sysdb.h"
@@ -1258,3 +1261,967 @@ done:
 
     return ret;
 }
+
+/* The dump written by cache-export is a sequence of records, all integers
+ * are stored in network byte order so the dump can be moved between hosts:
+ *
+ *   header:  "SSSDDUMP" uint32 version
+ *   record:  uint32 type, followed by
+ *            DOMAIN:      string name
+ *            USER, GROUP: uint32 num_attrs, num_attrs * {
+ *                             string name, uint32 num_values,
+ *                             num_values * string value }
+ *            END:         nothing
+ *   string:  uint32 length, length bytes
+ */
+#define SSSCTL_DUMP_MAGIC "SSSDDUMP"
+#define SSSCTL_DUMP_MAGIC_LEN (sizeof(SSSCTL_DUMP_MAGIC) - 1)
+#define SSSCTL_DUMP_VERSION 1
+#define SSSCTL_DUMP_MAX_VALUE (16 * 1024 * 1024)
+
+enum sssctl_dump_record {
+    SSSCTL_DUMP_END = 0,
+    SSSCTL_DUMP_DOMAIN,
+    SSSCTL_DUMP_USER,
+    SSSCTL_DUMP_GROUP,
+};
+
+/* Attributes that are either maintained by sysdb itself or that hold local
+ * authentication state. They are never written to the dump. */
+static const char *sssctl_dump_skip_attrs[] = {
+    SYSDB_OBJECTCLASS,
+    SYSDB_OBJECTCATEGORY,
+    SYSDB_CREATE_TIME,
+    SYSDB_LAST_UPDATE,
+    SYSDB_CACHE_EXPIRE,
+    SYSDB_INITGR_EXPIRE,
+    SYSDB_IFP_CACHED,
+    SYSDB_MEMBEROF,
+    SYSDB_MEMBERUID,
+    SYSDB_OVERRIDE_DN,
+    SYSDB_PWD,
+    SYSDB_CACHEDPWD,
+    SYSDB_CACHEDPWD_TYPE,
+    SYSDB_CACHEDPWD_FA2_LEN,
+    SYSDB_LAST_LOGIN,
+    SYSDB_LAST_ONLINE_AUTH,
+    SYSDB_LAST_ONLINE_AUTH_WITH_CURR_TOKEN,
+    SYSDB_LAST_FAILED_LOGIN,
+    SYSDB_FAILED_LOGIN_ATTEMPTS,
+    SYSDB_CCACHE_FILE,
+    NULL
+};
+
+static bool sssctl_dump_skip_attr(const char *name)
+{
+    for (int i = 0; sssctl_dump_skip_attrs[i] != NULL; i++) {
+        if (strcasecmp(name, sssctl_dump_skip_attrs[i]) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static errno_t sssctl_dump_write_uint32(FILE *fp, uint32_t value)
+{
+    uint32_t nvalue = htonl(value);
+
+    if (fwrite(&nvalue, sizeof(nvalue), 1, fp) != 1) {
+        return EIO;
+    }
+
+    return EOK;
+}
+
+static errno_t sssctl_dump_write_blob(FILE *fp, const void *data, size_t len)
+{
+    errno_t ret;
+
+    if (len > SSSCTL_DUMP_MAX_VALUE) {
+        return EINVAL;
+    }
+
+    ret = sssctl_dump_write_uint32(fp, len);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    if (len > 0 && fwrite(data, len, 1, fp) != 1) {
+        return EIO;
+    }
+
+    return EOK;
+}
+
+static errno_t sssctl_dump_write_entry(FILE *fp,
+                                       enum sssctl_dump_record type,
+                                       struct ldb_message *msg)
+{
+    struct ldb_message_element *el;
+    uint32_t num_attrs = 0;
+    errno_t ret;
+
+    for (unsigned int i = 0; i < msg->num_elements; i++) {
+        if (!sssctl_dump_skip_attr(msg->elements[i].name)) {
+            num_attrs++;
+        }
+    }
+
+    ret = sssctl_dump_write_uint32(fp, type);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = sssctl_dump_write_uint32(fp, num_attrs);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    for (unsigned int i = 0; i < msg->num_elements; i++) {
+        el = &msg->elements[i];
+        if (sssctl_dump_skip_attr(el->name)) {
+            continue;
+        }
+
+        ret = sssctl_dump_write_blob(fp, el->name, strlen(el->name));
+        if (ret != EOK) {
+            return ret;
+        }
+
+        ret = sssctl_dump_write_uint32(fp, el->num_values);
+        if (ret != EOK) {
+            return ret;
+        }
+
+        for (unsigned int j = 0; j < el->num_values; j++) {
+            ret = sssctl_dump_write_blob(fp, el->values[j].data,
+                                         el->values[j].length);
+            if (ret != EOK) {
+                return ret;
+            }
+        }
+    }
+
+    return EOK;
+}
+
+static errno_t sssctl_dump_read_uint32(FILE *fp, uint32_t *_value)
+{
+    uint32_t nvalue;
+
+    if (fread(&nvalue, sizeof(nvalue), 1, fp) != 1) {
+        return EIO;
+    }
+
+    *_value = ntohl(nvalue);
+
+    return EOK;
+}
+
+/* The value is always NULL terminated so string attributes can be used
+ * directly. */
+static errno_t sssctl_dump_read_blob(TALLOC_CTX *mem_ctx,
+                                     FILE *fp,
+                                     struct ldb_val *_val)
+{
+    uint32_t len;
+    uint8_t *data;
+    errno_t ret;
+
+    ret = sssctl_dump_read_uint32(fp, &len);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    if (len > SSSCTL_DUMP_MAX_VALUE) {
+        return EINVAL;
+    }
+
+    data = talloc_size(mem_ctx, len + 1);
+    if (data == NULL) {
+        return ENOMEM;
+    }
+
+    if (len > 0 && fread(data, len, 1, fp) != 1) {
+        talloc_free(data);
+        return EIO;
+    }
+    data[len] = '\0';
+
+    _val->data = data;
+    _val->length = len;
+
+    return EOK;
+}
+
+static errno_t sssctl_dump_read_entry(TALLOC_CTX *mem_ctx,
+                                      FILE *fp,
+                                      struct sysdb_attrs **_attrs)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct sysdb_attrs *attrs;
+    struct ldb_val name;
+    struct ldb_val value;
+    uint32_t num_attrs;
+    uint32_t num_values;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    attrs = sysdb_new_attrs(tmp_ctx);
+    if (attrs == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = sssctl_dump_read_uint32(fp, &num_attrs);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    for (uint32_t i = 0; i < num_attrs; i++) {
+        ret = sssctl_dump_read_blob(tmp_ctx, fp, &name);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        ret = sssctl_dump_read_uint32(fp, &num_values);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        for (uint32_t j = 0; j < num_values; j++) {
+            ret = sssctl_dump_read_blob(tmp_ctx, fp, &value);
+            if (ret != EOK) {
+                goto done;
+            }
+
+            ret = sysdb_attrs_add_val(attrs, (const char *)name.data, &value);
+            if (ret != EOK) {
+                goto done;
+            }
+
+            talloc_free(value.data);
+        }
+
+        talloc_free(name.data);
+    }
+
+    *_attrs = talloc_steal(mem_ctx, attrs);
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+
+    return ret;
+}
+
+static errno_t sssctl_cache_export_objects(FILE *fp,
+                                           struct sss_domain_info *dom,
+                                           enum sssctl_dump_record type,
+                                           time_t max_age,
+                                           size_t *_count)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message **msgs = NULL;
+    const char *ts_filter;
+    size_t count = 0;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    if (max_age > 0) {
+        ts_filter = talloc_asprintf(tmp_ctx, "(%s>=%lld)", SYSDB_LAST_UPDATE,
+                                    (long long)(time(NULL) - max_age));
+        if (ts_filter == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        if (type == SSSCTL_DUMP_USER) {
+            ret = sysdb_search_users_by_timestamp(tmp_ctx, dom,
+                                                  "(" SYSDB_NAME "=*)",
+                                                  ts_filter, NULL,
+                                                  &count, &msgs);
+        } else {
+            ret = sysdb_search_groups_by_timestamp(tmp_ctx, dom,
+                                                   "(" SYSDB_NAME "=*)",
+                                                   ts_filter, NULL,
+                                                   &count, &msgs);
+        }
+    } else {
+        if (type == SSSCTL_DUMP_USER) {
+            ret = sysdb_search_users(tmp_ctx, dom, "(" SYSDB_NAME "=*)", NULL,
+                                     &count, &msgs);
+        } else {
+            ret = sysdb_search_groups(tmp_ctx, dom, "(" SYSDB_NAME "=*)", NULL,
+                                      &count, &msgs);
+        }
+    }
+    if (ret == ENOENT) {
+        count = 0;
+    } else if (ret != EOK) {
+        goto done;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        ret = sssctl_dump_write_entry(fp, type, msgs[i]);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    *_count = count;
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+
+    return ret;
+}
+
+errno_t sssctl_cache_export(struct sss_cmdline *cmdline,
+                            struct sss_tool_ctx *tool_ctx)
+{
+    const char *path = NULL;
+    const char *domain_name = NULL;
+    struct sss_domain_info *dom;
+    size_t num_users;
+    size_t num_groups;
+    int max_age = 0;
+    FILE *fp = NULL;
+    int fd;
+    errno_t ret;
+
+    struct poptOption options[] = {
+        {"domain", 'd', POPT_ARG_STRING, &domain_name, 0,
+            _("Only export the given domain"), _("domain") },
+        {"max-age", 'a', POPT_ARG_INT, &max_age, 0,
+            _("Only export entries updated in the last SECONDS"),
+            _("SECONDS") },
+        POPT_TABLEEND
+    };
+
+    ret = sss_tool_popt_ex(cmdline, options, NULL, SSS_TOOL_OPT_OPTIONAL,
+                           NULL, NULL, "FILE", _("Dump file to write."),
+                           SSS_TOOL_OPT_REQUIRED, &path, NULL);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to parse command arguments\n");
+        goto done;
+    }
+
+    if (max_age < 0) {
+        ERROR("Maximum age must not be negative\n");
+        ret = EINVAL;
+        goto done;
+    }
+
+    if (domain_name != NULL
+            && find_domain_by_name(tool_ctx->domains, domain_name,
+                                   true) == NULL) {
+        ERROR("Unknown domain: %s\n", domain_name);
+        ret = ERR_DOMAIN_NOT_FOUND;
+        goto done;
+    }
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1) {
+        ret = errno;
+        ERROR("Unable to open %s: %s\n", path, sss_strerror(ret));
+        goto done;
+    }
+
+    fp = fdopen(fd, "w");
+    if (fp == NULL) {
+        ret = errno;
+        close(fd);
+        goto done;
+    }
+
+    if (fwrite(SSSCTL_DUMP_MAGIC, SSSCTL_DUMP_MAGIC_LEN, 1, fp) != 1) {
+        ret = EIO;
+        goto done;
+    }
+
+    ret = sssctl_dump_write_uint32(fp, SSSCTL_DUMP_VERSION);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    for (dom = tool_ctx->domains; dom != NULL;
+         dom = get_next_domain(dom, SSS_GND_DESCEND)) {
+        if (domain_name != NULL && strcasecmp(dom->name, domain_name) != 0) {
+            continue;
+        }
+
+        ret = sssctl_dump_write_uint32(fp, SSSCTL_DUMP_DOMAIN);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        ret = sssctl_dump_write_blob(fp, dom->name, strlen(dom->name));
+        if (ret != EOK) {
+            goto done;
+        }
+
+        /* Users go first so group members exist when they are imported. */
+        ret = sssctl_cache_export_objects(fp, dom, SSSCTL_DUMP_USER,
+                                          max_age, &num_users);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        ret = sssctl_cache_export_objects(fp, dom, SSSCTL_DUMP_GROUP,
+                                          max_age, &num_groups);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        PRINT("Exported %zu users and %zu groups from domain %s\n",
+              num_users, num_groups, dom->name);
+    }
+
+    ret = sssctl_dump_write_uint32(fp, SSSCTL_DUMP_END);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = fclose(fp);
+    fp = NULL;
+    if (ret != 0) {
+        ret = errno;
+        goto done;
+    }
+
+    ret = EOK;
+
+done:
+    if (fp != NULL) {
+        fclose(fp);
+    }
+
+    if (ret != EOK && path != NULL) {
+        ERROR("Unable to export cache to %s: %s\n", path, sss_strerror(ret));
+    }
+
+    free(discard_const(domain_name));
+    free(discard_const(path));
+
+    return ret;
+}
+
+/* Copies all attributes of a dump entry except those in skip. */
+static struct sysdb_attrs *
+sssctl_import_attrs(TALLOC_CTX *mem_ctx,
+                    struct sysdb_attrs *entry,
+                    const char **skip)
+{
+    struct sysdb_attrs *attrs;
+    struct ldb_message_element *el;
+    bool skipped;
+    int ret;
+
+    attrs = sysdb_new_attrs(mem_ctx);
+    if (attrs == NULL) {
+        return NULL;
+    }
+
+    for (int i = 0; i < entry->num; i++) {
+        el = &entry->a[i];
+
+        skipped = false;
+        for (int j = 0; skip[j] != NULL; j++) {
+            if (strcasecmp(el->name, skip[j]) == 0) {
+                skipped = true;
+                break;
+            }
+        }
+
+        if (skipped) {
+            continue;
+        }
+
+        for (unsigned int j = 0; j < el->num_values; j++) {
+            ret = sysdb_attrs_add_val(attrs, el->name, &el->values[j]);
+            if (ret != EOK) {
+                talloc_free(attrs);
+                return NULL;
+            }
+        }
+    }
+
+    return attrs;
+}
+
+static const char *
+sssctl_import_string(struct sysdb_attrs *entry, const char *name)
+{
+    const char *value;
+    int ret;
+
+    ret = sysdb_attrs_get_string(entry, name, &value);
+    if (ret != EOK) {
+        return NULL;
+    }
+
+    return value;
+}
+
+static errno_t sssctl_import_users(struct sss_domain_info *dom,
+                                   struct sysdb_attrs **entries,
+                                   size_t count,
+                                   time_t now,
+                                   size_t *_imported)
+{
+    const char *skip[] = { SYSDB_NAME, SYSDB_UIDNUM, SYSDB_GIDNUM,
+                           SYSDB_GECOS, SYSDB_HOMEDIR, SYSDB_SHELL,
+                           SYSDB_ORIG_DN, NULL };
+    TALLOC_CTX *tmp_ctx;
+    struct sysdb_store_user_item *items;
+    size_t imported = 0;
+    errno_t ret;
+
+    if (count == 0) {
+        *_imported = 0;
+        return EOK;
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    items = talloc_zero_array(tmp_ctx, struct sysdb_store_user_item, count);
+    if (items == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        items[i].domain = dom;
+        items[i].name = sssctl_import_string(entries[i], SYSDB_NAME);
+        if (items[i].name == NULL) {
+            ret = EINVAL;
+            goto done;
+        }
+
+        ret = sysdb_attrs_get_uint32_t(entries[i], SYSDB_UIDNUM,
+                                       &items[i].uid);
+        if (ret != EOK) {
+            items[i].uid = 0;
+        }
+
+        ret = sysdb_attrs_get_uint32_t(entries[i], SYSDB_GIDNUM,
+                                       &items[i].gid);
+        if (ret != EOK) {
+            items[i].gid = 0;
+        }
+
+        items[i].gecos = sssctl_import_string(entries[i], SYSDB_GECOS);
+        items[i].homedir = sssctl_import_string(entries[i], SYSDB_HOMEDIR);
+        items[i].shell = sssctl_import_string(entries[i], SYSDB_SHELL);
+        items[i].orig_dn = sssctl_import_string(entries[i], SYSDB_ORIG_DN);
+        items[i].cache_timeout = dom->user_timeout;
+        items[i].attrs = sssctl_import_attrs(items, entries[i], skip);
+        if (items[i].attrs == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+    }
+
+    ret = sysdb_store_users_bulk(dom->sysdb, items, count, now);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (items[i].ret != EOK) {
+            ERROR("Unable to import user %s: %s\n",
+                  items[i].name, sss_strerror(items[i].ret));
+            continue;
+        }
+
+        ret = sysdb_invalidate_cache_entry(dom, items[i].name, true);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        imported++;
+    }
+
+    *_imported = imported;
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+
+    return ret;
+}
+
+/* Groups are stored without their members first. The members are set
+ * afterwards when every group of the dump exists, otherwise the memberof
+ * plugin would drop nested groups that were not imported yet. */
+static errno_t sssctl_import_groups(struct sss_domain_info *dom,
+                                    struct sysdb_attrs **entries,
+                                    size_t count,
+                                    time_t now,
+                                    size_t *_imported)
+{
+    const char *skip[] = { SYSDB_NAME, SYSDB_GIDNUM, SYSDB_MEMBER, NULL };
+    TALLOC_CTX *tmp_ctx;
+    struct sysdb_store_group_item *items;
+    struct ldb_message_element *el;
+    struct sysdb_attrs *members;
+    size_t imported = 0;
+    errno_t ret;
+
+    if (count == 0) {
+        *_imported = 0;
+        return EOK;
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    items = talloc_zero_array(tmp_ctx, struct sysdb_store_group_item, count);
+    if (items == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        items[i].domain = dom;
+        items[i].name = sssctl_import_string(entries[i], SYSDB_NAME);
+        if (items[i].name == NULL) {
+            ret = EINVAL;
+            goto done;
+        }
+
+        ret = sysdb_attrs_get_uint32_t(entries[i], SYSDB_GIDNUM,
+                                       &items[i].gid);
+        if (ret != EOK) {
+            items[i].gid = 0;
+        }
+
+        items[i].cache_timeout = dom->group_timeout;
+        items[i].attrs = sssctl_import_attrs(items, entries[i], skip);
+        if (items[i].attrs == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+    }
+
+    ret = sysdb_store_groups_bulk(dom->sysdb, items, count, now);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (items[i].ret != EOK) {
+            ERROR("Unable to import group %s: %s\n",
+                  items[i].name, sss_strerror(items[i].ret));
+            continue;
+        }
+
+        ret = sysdb_attrs_get_el_ext(entries[i], SYSDB_MEMBER, false, &el);
+        if (ret == EOK && el->num_values > 0) {
+            members = sysdb_new_attrs(tmp_ctx);
+            if (members == NULL) {
+                ret = ENOMEM;
+                goto done;
+            }
+
+            for (unsigned int j = 0; j < el->num_values; j++) {
+                ret = sysdb_attrs_add_val(members, SYSDB_MEMBER,
+                                          &el->values[j]);
+                if (ret != EOK) {
+                    goto done;
+                }
+            }
+
+            /* Members that are neither in the dump nor in the cache are
+             * dropped by the memberof plugin. */
+            ret = sysdb_set_group_attr(dom, items[i].name, members,
+                                       SYSDB_MOD_REP);
+            talloc_free(members);
+            if (ret != EOK) {
+                ERROR("Unable to import members of group %s: %s\n",
+                      items[i].name, sss_strerror(ret));
+                goto done;
+            }
+        } else if (ret != EOK && ret != ENOENT) {
+            goto done;
+        }
+
+        ret = sysdb_invalidate_cache_entry(dom, items[i].name, false);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        imported++;
+    }
+
+    *_imported = imported;
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+
+    return ret;
+}
+
+struct sssctl_import_domain {
+    struct sss_domain_info *dom;
+    const char *name;
+    struct sysdb_attrs **users;
+    size_t num_users;
+    size_t users_size;
+    struct sysdb_attrs **groups;
+    size_t num_groups;
+    size_t groups_size;
+};
+
+static errno_t sssctl_import_domain(struct sssctl_import_domain *data)
+{
+    size_t num_users;
+    size_t num_groups;
+    bool in_transaction = false;
+    time_t now;
+    errno_t ret;
+    errno_t sret;
+
+    if (data->dom == NULL) {
+        if (data->name != NULL) {
+            ERROR("Domain %s is not configured, skipping it\n", data->name);
+        }
+        return EOK;
+    }
+
+    now = time(NULL);
+
+    ret = sysdb_transaction_start(data->dom->sysdb);
+    if (ret != EOK) {
+        goto done;
+    }
+    in_transaction = true;
+
+    ret = sssctl_import_users(data->dom, data->users, data->num_users,
+                              now, &num_users);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sssctl_import_groups(data->dom, data->groups, data->num_groups,
+                               now, &num_groups);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sysdb_transaction_commit(data->dom->sysdb);
+    if (ret != EOK) {
+        goto done;
+    }
+    in_transaction = false;
+
+    PRINT("Imported %zu users and %zu groups into domain %s\n",
+          num_users, num_groups, data->dom->name);
+
+done:
+    if (in_transaction) {
+        sret = sysdb_transaction_cancel(data->dom->sysdb);
+        if (sret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Could not cancel transaction\n");
+        }
+    }
+
+    return ret;
+}
+
+/* The entry lists grow geometrically, dumps of large domains contain
+ * hundreds of thousands of entries. */
+#define SSSCTL_IMPORT_LIST_MIN_SIZE 64
+
+static errno_t sssctl_import_append(TALLOC_CTX *mem_ctx,
+                                    struct sysdb_attrs ***_list,
+                                    size_t *_count,
+                                    size_t *_size,
+                                    struct sysdb_attrs *entry)
+{
+    struct sysdb_attrs **list = *_list;
+    size_t size;
+
+    if (*_count == *_size) {
+        size = *_size == 0 ? SSSCTL_IMPORT_LIST_MIN_SIZE : *_size * 2;
+        list = talloc_realloc(mem_ctx, list, struct sysdb_attrs *, size);
+        if (list == NULL) {
+            return ENOMEM;
+        }
+
+        *_list = list;
+        *_size = size;
+    }
+
+    list[*_count] = talloc_steal(list, entry);
+    (*_count)++;
+
+    return EOK;
+}
+
+errno_t sssctl_cache_import(struct sss_cmdline *cmdline,
+                            struct sss_tool_ctx *tool_ctx)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct sssctl_import_domain *domains = NULL;
+    struct sssctl_import_domain *data;
+    size_t num_domains = 0;
+    const char *path = NULL;
+    char magic[SSSCTL_DUMP_MAGIC_LEN];
+    struct sysdb_attrs *entry;
+    struct ldb_val name;
+    uint32_t version;
+    uint32_t type;
+    FILE *fp = NULL;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sss_tool_popt_ex(cmdline, NULL, NULL, SSS_TOOL_OPT_OPTIONAL,
+                           NULL, NULL, "FILE", _("Dump file to import."),
+                           SSS_TOOL_OPT_REQUIRED, &path, NULL);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to parse command arguments\n");
+        goto done;
+    }
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        ret = errno;
+        ERROR("Unable to open %s: %s\n", path, sss_strerror(ret));
+        goto done;
+    }
+
+    if (fread(magic, sizeof(magic), 1, fp) != 1
+            || memcmp(magic, SSSCTL_DUMP_MAGIC, sizeof(magic)) != 0) {
+        ERROR("%s is not an SSSD cache dump\n", path);
+        ret = EINVAL;
+        goto done;
+    }
+
+    ret = sssctl_dump_read_uint32(fp, &version);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    if (version != SSSCTL_DUMP_VERSION) {
+        ERROR("Unsupported dump version %u\n", version);
+        ret = EINVAL;
+        goto done;
+    }
+
+    /* The whole dump is read before anything is imported, so a truncated
+     * or corrupt dump does not leave some of its domains in the cache. */
+    do {
+        ret = sssctl_dump_read_uint32(fp, &type);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        switch (type) {
+        case SSSCTL_DUMP_END:
+            break;
+        case SSSCTL_DUMP_DOMAIN:
+            domains = talloc_realloc(tmp_ctx, domains,
+                                     struct sssctl_import_domain,
+                                     num_domains + 1);
+            if (domains == NULL) {
+                ret = ENOMEM;
+                goto done;
+            }
+
+            data = &domains[num_domains];
+            memset(data, 0, sizeof(struct sssctl_import_domain));
+            num_domains++;
+
+            ret = sssctl_dump_read_blob(domains, fp, &name);
+            if (ret != EOK) {
+                goto done;
+            }
+
+            data->name = (const char *)name.data;
+            data->dom = find_domain_by_name(tool_ctx->domains, data->name,
+                                            true);
+            break;
+        case SSSCTL_DUMP_USER:
+        case SSSCTL_DUMP_GROUP:
+            if (num_domains == 0) {
+                ERROR("Entry without a domain in %s\n", path);
+                ret = EINVAL;
+                goto done;
+            }
+
+            ret = sssctl_dump_read_entry(domains, fp, &entry);
+            if (ret != EOK) {
+                goto done;
+            }
+
+            data = &domains[num_domains - 1];
+            if (data->dom == NULL) {
+                talloc_free(entry);
+                break;
+            }
+
+            if (type == SSSCTL_DUMP_USER) {
+                ret = sssctl_import_append(domains, &data->users,
+                                           &data->num_users,
+                                           &data->users_size, entry);
+            } else {
+                ret = sssctl_import_append(domains, &data->groups,
+                                           &data->num_groups,
+                                           &data->groups_size, entry);
+            }
+            if (ret != EOK) {
+                goto done;
+            }
+            break;
+        default:
+            ERROR("Unknown record type %u in %s\n", type, path);
+            ret = EINVAL;
+            goto done;
+        }
+    } while (type != SSSCTL_DUMP_END);
+
+    for (size_t i = 0; i < num_domains; i++) {
+        ret = sssctl_import_domain(&domains[i]);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    ret = EOK;
+
+done:
+    if (fp != NULL) {
+        fclose(fp);
+    }
+
+    if (ret != EOK && path != NULL) {
+        ERROR("Unable to import cache from %s: %s\n", path, sss_strerror(ret));
+    }
+
+    free(discard_const(path));
+    talloc_free(tmp_ctx);
+
+    return ret;
+}
@@ -338,13 +338,39 @@ done:
     return ret;
 }
 
+static errno_t sssctl_cache_index_domains(TALLOC_CTX *mem_ctx,
+                                          const char ***_domains)
+{
+    struct confdb_ctx *confdb = NULL;
+    errno_t ret;
+
+    if (*_domains != NULL) {
+        return EOK;
+    }
+
+    /* If the user selected no domain, act on all of them */
+    ret = sss_tool_confdb_init(mem_ctx, &confdb);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Could not connect to configuration database.\n");
+        return ret;
+    }
+
+    ret = get_confdb_domains(mem_ctx, confdb, discard_const(_domains));
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Could not list all the domains.\n");
+        return ret;
+    }
+
+    return EOK;
+}
+
 static errno_t sssctl_cache_index_action(enum sysdb_index_actions action,
                                          const char **domains,
                                          const char *attr)
 {
     errno_t ret;
     TALLOC_CTX *tmp_ctx = NULL;
-    struct confdb_ctx *confdb = NULL;
     char *cache;
     const char **domain;
     const char **index;
@@ -356,20 +382,9 @@ static errno_t sssctl_cache_index_action(enum sysdb_index_actions action,
         return ENOMEM;
     }
 
-    if (domains == NULL) {
-        /* If the user selected no domain, act on all of them */
-        ret = sss_tool_confdb_init(tmp_ctx, &confdb);
-        if (ret != EOK) {
-            DEBUG(SSSDBG_OP_FAILURE,
-                  "Could not connect to configuration database.\n");
-            goto done;
-        }
-
-        ret = get_confdb_domains(tmp_ctx, confdb, discard_const(&domains));
-        if (ret != EOK) {
-            DEBUG(SSSDBG_OP_FAILURE, "Could not list all the domains.\n");
-            goto done;
-        }
+    ret = sssctl_cache_index_domains(tmp_ctx, &domains);
+    if (ret != EOK) {
+        goto done;
     }
 
     for (domain = domains; *domain != NULL; domain++) {
@@ -412,6 +427,106 @@ done:
     return ret;
 }
 
+static errno_t sssctl_cache_index_advise_file(TALLOC_CTX *mem_ctx,
+                                              const char *cache,
+                                              bool apply)
+{
+    struct sysdb_index_advice *advice;
+    const char **indexes;
+    size_t count;
+    size_t i;
+    errno_t ret;
+
+    ret = sysdb_index_advise(mem_ctx, cache, &advice, &count);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    if (count == 0) {
+        PRINT("  No missing index was recorded\n");
+        return EOK;
+    }
+
+    for (i = 0; i < count; i++) {
+        PRINT("  Attribute: %1$s, searches: %2$"PRIu64", time: %3$s\n",
+              advice[i].attr, advice[i].count,
+              sss_format_time(advice[i].usec));
+    }
+
+    if (!apply) {
+        return EOK;
+    }
+
+    PRINT("  Re-indexing the cache, SSSD cannot update it until this is "
+          "done\n");
+    for (i = 0; i < count; i++) {
+        PRINT("  Creating index for attribute %1$s\n", advice[i].attr);
+        ret = sysdb_manage_index(mem_ctx, SYSDB_IDX_CREATE, cache,
+                                 advice[i].attr, &indexes);
+        if (ret != EOK && ret != EEXIST) {
+            return ret;
+        }
+    }
+
+    return EOK;
+}
+
+/* Lists the attributes the SSSD processes searched by without an index
+ * and optionally indexes them. Adding an index makes ldb re-index the
+ * whole cache in a single transaction, which holds the cache write lock
+ * until it is done. SSSD cannot update the cache in the meantime, so
+ * --apply should be run when the cache is not busy. */
+static errno_t sssctl_cache_index_advise(const char **domains, bool apply)
+{
+    TALLOC_CTX *tmp_ctx;
+    const char **domain;
+    char *cache;
+    char *ts_cache;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Failed to allocate the context\n");
+        return ENOMEM;
+    }
+
+    ret = sssctl_cache_index_domains(tmp_ctx, &domains);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    for (domain = domains; *domain != NULL; domain++) {
+        ret = sysdb_get_db_file(tmp_ctx, NULL, *domain, DB_PATH,
+                                &cache, &ts_cache);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "Failed to get the cache db name\n");
+            goto done;
+        }
+
+        PRINT("Missing cache indexes for domain %1$s:\n", *domain);
+        ret = sssctl_cache_index_advise_file(tmp_ctx, cache, apply);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        if (ts_cache == NULL) {
+            continue;
+        }
+
+        PRINT("Missing timestamp cache indexes for domain %1$s:\n", *domain);
+        ret = sssctl_cache_index_advise_file(tmp_ctx, ts_cache, apply);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
 errno_t sssctl_cache_index(struct sss_cmdline *cmdline,
                            struct sss_tool_ctx *)
 {
@@ -420,6 +535,7 @@ errno_t sssctl_cache_index(struct sss_cmdline *cmdline,
     const char **domains = NULL;
     const char **p;
     enum sysdb_index_actions action;
+    int apply = 0;
     errno_t ret;
 
     /* Parse command line. */
@@ -428,11 +544,13 @@ errno_t sssctl_cache_index(struct sss_cmdline *cmdline,
             0, _("Target a specific domain"), _("domain") },
         { "attribute", 'a', POPT_ARG_STRING, &attr,
             0, _("Attribute to index"), _("attribute") },
+        { "apply", 0, POPT_ARG_NONE, &apply,
+            0, _("Create the indexes proposed by advise"), NULL },
         POPT_TABLEEND
     };
 
     ret = sss_tool_popt_ex(cmdline, options, NULL, SSS_TOOL_OPT_OPTIONAL, NULL, NULL,
-                           "ACTION", "create | delete | list",
+                           "ACTION", "create | delete | list | advise",
                            SSS_TOOL_OPT_REQUIRED, &action_str, NULL);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Unable to parse command arguments\n");
@@ -445,6 +563,20 @@ errno_t sssctl_cache_index(struct sss_cmdline *cmdline,
         goto done;
     }
 
+    if (strcmp(action_str, "advise") == 0) {
+        ret = sssctl_cache_index_advise(domains, apply);
+        if (ret != EOK) {
+            ERROR("Index operation failed: %1$s\n", sss_strerror(ret));
+        }
+        goto done;
+    }
+
+    if (apply) {
+        ERROR("Option --apply is only valid with the advise action\n");
+        ret = EINVAL;
+        goto done;
+    }
+
     if (strcmp(action_str, "list") == 0) {
         action = SYSDB_IDX_LIST;
     } else {
@@ -454,8 +586,8 @@ errno_t sssctl_cache_index(struct sss_cmdline *cmdline,
             action = SYSDB_IDX_DELETE;
         } else {
             ERROR("Unknown action: %1$s\nValid actions are "
-                           "\"%2$s\", \"%3$s and \"%4$s\"\n",
-                  action_str, "create", "delete", "list");
+                           "\"%2$s\", \"%3$s\", \"%4$s\" and \"%5$s\"\n",
+                  action_str, "create", "delete", "list", "advise");
             ret = EINVAL;
             goto done;
         }
@@ -23,6 +23,7 @@
 #include <talloc.h>
 
 #include "util/util.h"
+#include "db/sysdb.h"
 #include "tools/common/sss_tools.h"
 #include "tools/sssctl/sssctl.h"
 #include "sbus/sbus_opath.h"
@@ -299,12 +300,166 @@ done:
     return ret;
 }
 
+/* Number of callers that are printed, ordered by total transaction time */
+#define SSSCTL_TXN_TOP_CALLERS 10
+
+struct sssctl_txn_stats {
+    const char *name;
+    uint64_t *values;
+};
+
+static int sssctl_txn_stats_cmp(const void *a, const void *b)
+{
+    const struct sssctl_txn_stats *sa = a;
+    const struct sssctl_txn_stats *sb = b;
+
+    /* Sort by total time, descending. */
+    if (sa->values[2] > sb->values[2]) {
+        return -1;
+    } else if (sa->values[2] < sb->values[2]) {
+        return 1;
+    }
+
+    return 0;
+}
+
+static const char *sssctl_txn_format_us(char *buf, size_t len, uint64_t us)
+{
+    if (us < 1000) {
+        snprintf(buf, len, "%"PRIu64" us", us);
+    } else if (us < 1000000) {
+        snprintf(buf, len, "%.1f ms", (double)us / 1000);
+    } else {
+        snprintf(buf, len, "%.1f s", (double)us / 1000000);
+    }
+
+    return buf;
+}
+
+static void sssctl_txn_stats_print(struct sssctl_txn_stats *stats,
+                                   size_t num_buckets,
+                                   bool histogram)
+{
+    uint64_t *v = stats->values;
+    char avg[32];
+    char max[32];
+    char bound[32];
+
+    if (v[0] == 0) {
+        return;
+    }
+
+    PRINT("%s: %"PRIu64" transactions, %"PRIu64" cancelled, "
+          "average %s, longest %s\n", stats->name, v[0], v[1],
+          sssctl_txn_format_us(avg, sizeof(avg), v[2] / v[0]),
+          sssctl_txn_format_us(max, sizeof(max), v[3]));
+
+    if (!histogram) {
+        return;
+    }
+
+    for (size_t i = 0; i < num_buckets; i++) {
+        if (v[4 + i] == 0) {
+            continue;
+        }
+
+        if (i == num_buckets - 1) {
+            PRINT("    longer: %"PRIu64"\n", v[4 + i]);
+        } else {
+            PRINT("    < %s: %"PRIu64"\n",
+                  sssctl_txn_format_us(bound, sizeof(bound),
+                                       UINT64_C(1) << (i + 1)),
+                  v[4 + i]);
+        }
+    }
+}
+
+static errno_t
+sssctl_domain_status_txn_stats(struct sbus_sync_connection *conn,
+                               const char *domain_path)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct sssctl_txn_stats *stats;
+    const char **names;
+    uint64_t *values;
+    size_t num_names;
+    size_t stride;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "talloc_new() failed\n");
+        return ENOMEM;
+    }
+
+    ret = sbus_call_ifp_domain_TransactionStats(tmp_ctx, conn, IFP_BUS,
+                                                domain_path, &names, &values);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Unable to get transaction statistics [%d]: %s\n",
+              ret, sss_strerror(ret));
+        PRINT_IFP_WARNING(ret);
+        goto done;
+    }
+
+    num_names = names == NULL ? 0 : talloc_array_length(names) - 1;
+    if (num_names < SYSDB_TXN_STATS_LEVELS) {
+        PRINT("No transaction statistics available.\n");
+        ret = EOK;
+        goto done;
+    }
+
+    /* Each name has count, cancelled, total, max and the buckets. */
+    stride = talloc_array_length(values) / num_names;
+    if (stride <= 4 || stride * num_names != talloc_array_length(values)) {
+        ERROR("Malformed transaction statistics\n");
+        ret = EINVAL;
+        goto done;
+    }
+
+    stats = talloc_array(tmp_ctx, struct sssctl_txn_stats, num_names);
+    if (stats == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (size_t i = 0; i < num_names; i++) {
+        stats[i].name = names[i];
+        stats[i].values = &values[i * stride];
+    }
+
+    PRINT("Cache transactions by nesting level:\n");
+    for (size_t i = 0; i < SYSDB_TXN_STATS_LEVELS; i++) {
+        sssctl_txn_stats_print(&stats[i], stride - 4, true);
+    }
+
+    if (num_names > SYSDB_TXN_STATS_LEVELS) {
+        qsort(&stats[SYSDB_TXN_STATS_LEVELS],
+              num_names - SYSDB_TXN_STATS_LEVELS,
+              sizeof(struct sssctl_txn_stats), sssctl_txn_stats_cmp);
+
+        PRINT("\nOutermost cache transactions by caller:\n");
+        for (size_t i = SYSDB_TXN_STATS_LEVELS;
+             i < num_names && i < SYSDB_TXN_STATS_LEVELS + SSSCTL_TXN_TOP_CALLERS;
+             i++) {
+            sssctl_txn_stats_print(&stats[i], stride - 4, false);
+        }
+    }
+
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
 struct sssctl_domain_status_opts {
     const char *domain;
     int online;
     int last;
     int active;
     int servers;
+    int stats;
     int force_start;
 };
 
@@ -323,6 +478,7 @@ errno_t sssctl_domain_status(struct sss_cmdline *cmdline,
         {"online", 'o', POPT_ARG_NONE , &opts.online, 0, _("Show online status"), NULL },
         {"active-server", 'a', POPT_ARG_NONE, &opts.active, 0, _("Show information about active server"), NULL },
         {"servers", 'r', POPT_ARG_NONE, &opts.servers, 0, _("Show list of discovered servers"), NULL },
+        {"stats", 't', POPT_ARG_NONE, &opts.stats, 0, _("Show cache transaction statistics"), NULL },
         {"start", 's', POPT_ARG_NONE, &opts.force_start, 0, _("Start SSSD if it is not running"), NULL },
         POPT_TABLEEND
     };
@@ -396,6 +552,14 @@ errno_t sssctl_domain_status(struct sss_cmdline *cmdline,
         }
     }
 
+    if (opts.stats) {
+        ret = sssctl_domain_status_txn_stats(conn, path);
+        if (ret != EOK) {
+            ERROR("Unable to get transaction statistics\n");
+            goto done;
+        }
+    }
+
     ret = EOK;
 
 done:
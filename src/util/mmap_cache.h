@@ -75,8 +75,30 @@ typedef uint32_t rel_ptr_t;
                             - MC_PTR_DIFF(rec, (mc_ctx)->data_table))))
 
 
-#define SSS_MC_MAJOR_VNO    1
-#define SSS_MC_MINOR_VNO    1
+#define SSS_MC_MAJOR_VNO    2
+#define SSS_MC_MINOR_VNO    0
+
+/* Version 1 files have no sequence table, clients still accept them so
+ * that a new client library keeps working against an older responder */
+#define SSS_MC_MAJOR_VNO_V1 1
+#define SSS_MC_MINOR_VNO_V1 1
+
+/* Per hash bucket sequence counters (v2+).
+ * The writer makes the counter odd before it touches a record chained in
+ * the bucket (or the chain itself) and even again when done. A reader
+ * snapshots the counter before walking the chain and compares it after,
+ * if it is odd or changed the walk may have seen a torn record and has to
+ * be repeated. */
+#define MC_SEQ_IS_WRITING(seq) (((seq) & 1) != 0)
+
+/* Record flags (v2+).
+ * A negative record remembers that a name or an id was not found in any
+ * domain, so clients can answer the lookup without contacting the
+ * responder. Both hashes of a negative record are computed from the same
+ * key, the flag tells whether the key is a name or an id. */
+#define MC_REC_FLAG_NEG_NAME    0x00000001
+#define MC_REC_FLAG_NEG_ID      0x00000002
+#define MC_REC_FLAGS_NEGATIVE   (MC_REC_FLAG_NEG_NAME | MC_REC_FLAG_NEG_ID)
 
 #define SSS_MC_HEADER_UNINIT    0   /* after ftruncate or before reset */
 #define SSS_MC_HEADER_ALIVE     1   /* current and in use */
@@ -95,7 +117,8 @@ struct sss_mc_header {
     rel_ptr_t data_table;   /* data table pointer relative to mmap base */
     rel_ptr_t free_table;   /* free table pointer relative to mmap base */
     rel_ptr_t hash_table;   /* hash table pointer relative to mmap base */
-    rel_ptr_t reserved;     /* reserved for future changes */
+    rel_ptr_t seq_table;    /* sequence table pointer relative to mmap
+                             * base, v2+ only, was reserved (0) in v1 */
     uint32_t b2;            /* barrier 2 */
 };
 
@@ -109,7 +132,7 @@ struct sss_mc_rec {
                             /* next2 is related to hash2 */
     uint32_t hash1;         /* val of first hash (usually name of record) */
     uint32_t hash2;         /* val of second hash (usually id of record) */
-    uint32_t padding;       /* padding & reserved for future changes */
+    uint32_t flags;         /* record flags (v2+), padding in v1 */
     uint32_t b2;            /* barrier 2 - 32 bytes mark, fits a slot */
     char data[0];
 };
@@ -146,6 +169,12 @@ struct sss_mc_initgr_data {
                              * after gids */
 };
 
+struct sss_mc_neg_data {
+    rel_ptr_t name;         /* ptr to key string, rel. to struct base addr */
+    uint32_t key_len;       /* length of key */
+    char key[0];            /* name or id (as string) that was not found */
+};
+
 struct sss_mc_sid_data {
     rel_ptr_t name;         /* ptr to SID string, rel. to struct base addr */
     uint32_t type;          /* enum sss_id_type */
@@ -43,6 +43,8 @@ const char *sss_cmd2str(enum sss_cli_command cmd)
         return "SSS_NSS_GETPWENT";
     case SSS_NSS_ENDPWENT:
         return "SSS_NSS_ENDPWENT";
+    case SSS_NSS_GETPWUID_BATCH:
+        return "SSS_NSS_GETPWUID_BATCH";
 
     /* group */
     case SSS_NSS_GETGRNAM:
@@ -57,6 +59,8 @@ const char *sss_cmd2str(enum sss_cli_command cmd)
         return "SSS_NSS_ENDGRENT";
     case SSS_NSS_INITGR:
         return "SSS_NSS_INITGR";
+    case SSS_NSS_GETGRGID_BATCH:
+        return "SSS_NSS_GETGRGID_BATCH";
 
 #if 0
     /* aliases */